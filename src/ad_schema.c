@@ -22,6 +22,7 @@
 #include "schema_p.h"
 
 #include "common.h"
+#include "directory.h"
 #include "domain.h"
 #include "entry.h"
 
@@ -265,6 +266,13 @@ schema_load_active_directory(struct ldap_connection_ctx_t* connection, struct ld
 {
     int rc = RETURN_CODE_SUCCESS;
 
+    const ld_rootdse_t *rootdse = directory_get_rootdse(connection);
+
+    if (!schema_entry_path && rootdse && rootdse->subschema_subentry)
+    {
+        schema_entry_path = talloc_strdup(schema, rootdse->subschema_subentry);
+    }
+
     if (!schema_entry_path)
     {
         rc = search(connection,
@@ -0,0 +1,668 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "aggregate.h"
+#include "directory.h"
+#include "dn.h"
+
+#include "helper_p.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib-2.0/glib.h>
+
+#define AGGREGATE_PAGE_SIZE 1000
+#define AGGREGATE_MAX_INTEGER_LENGTH 20
+
+/*!
+ * @brief aggregate_bucket_t - Totals of one group.
+ */
+typedef struct aggregate_bucket_s
+{
+    char *key;                                  //!< Value of the group as it has been received first.
+    unsigned long count;                        //!< Amount of entries in the group.
+    char *min;                                  //!< Smallest value of the measured attribute.
+    char *max;                                  //!< Largest value of the measured attribute.
+} aggregate_bucket_t;
+
+/*!
+ * @brief aggregate_t - Aggregation of search results.
+ */
+typedef struct aggregate_s
+{
+    struct ldap_connection_ctx_t *connection;   //!< Connection to work with.
+
+    char *base_dn;                              //!< Base of the search.
+    int scope;                                  //!< Scope of the search.
+    char *filter;                               //!< Filter of the search.
+    char *attrs[3];                             //!< Attributes requested by the search.
+    char *group_by;                             //!< Attribute entries are grouped by, NULL if they are not.
+    bool by_parent;                             //!< Entries are grouped by parent DN.
+    char *measure;                              //!< Attribute smallest and largest values are tracked of.
+
+    bool paged;                                 //!< Results are requested page by page.
+    struct berval cookie;                       //!< Paged results cookie of the next page.
+    int msgid;                                  //!< Message id of the search in flight.
+    bool in_progress;                           //!< Search has been sent and has not completed yet.
+
+    unsigned long total;                        //!< Amount of matching entries.
+    GHashTable *by_key;                         //!< Case folded value to aggregate_bucket_t.
+    aggregate_bucket_t *missing;                //!< Entries without value, all entries when they are not grouped.
+    GPtrArray *current;                         //!< Buckets of the entry being processed.
+
+    aggregate_complete_callback_fn callback;    //!< Callback to call on completion.
+    void *user_data;                            //!< User data passed to callback.
+} aggregate_t;
+
+static enum OperationReturnCode aggregate_on_read(int rc, LDAPMessage *message,
+                                                  struct ldap_connection_ctx_t *connection);
+
+static int aggregate_destructor(TALLOC_CTX *ctx)
+{
+    aggregate_t *aggregate = talloc_get_type_abort(ctx, aggregate_t);
+
+    if (aggregate->in_progress)
+    {
+        connection_cancel_read_request(aggregate->connection, aggregate->msgid);
+        ldap_abandon_ext(aggregate->connection->ldap, aggregate->msgid, NULL, NULL);
+    }
+
+    g_hash_table_destroy(aggregate->by_key);
+    g_ptr_array_free(aggregate->current, TRUE);
+
+    return 0;
+}
+
+/**
+ * @brief aggregate_parse_integer Parses value consisting of optional minus and decimal digits.
+ * @return
+ *        - true if value is an integer.
+ *        - false otherwise.
+ */
+static bool aggregate_parse_integer(const char *value, size_t len, long long *number)
+{
+    char buffer[AGGREGATE_MAX_INTEGER_LENGTH + 1];
+    size_t i = len > 0 && value[0] == '-' ? 1 : 0;
+
+    if (len <= i || len > AGGREGATE_MAX_INTEGER_LENGTH)
+    {
+        return false;
+    }
+
+    for (; i < len; ++i)
+    {
+        if (value[i] < '0' || value[i] > '9')
+        {
+            return false;
+        }
+    }
+
+    memcpy(buffer, value, len);
+    buffer[len] = '\0';
+
+    errno = 0;
+    *number = strtoll(buffer, NULL, 10);
+
+    return errno == 0;
+}
+
+/**
+ * @brief aggregate_compare_values Compares values of the measured attribute.
+ *
+ * Integers such as uSNChanged or lastLogonTimestamp are compared as numbers, other values byte by byte,
+ * which orders generalized time values chronologically.
+ * @return
+ *        - Negative value if the first value is smaller.
+ *        - Zero if values are equal.
+ *        - Positive value if the first value is larger.
+ */
+static int aggregate_compare_values(const char *first, const char *second, size_t second_len)
+{
+    size_t first_len = strlen(first);
+    long long first_number = 0;
+    long long second_number = 0;
+
+    if (aggregate_parse_integer(first, first_len, &first_number)
+        && aggregate_parse_integer(second, second_len, &second_number))
+    {
+        return first_number < second_number ? -1 : first_number > second_number ? 1 : 0;
+    }
+
+    int result = memcmp(first, second, first_len < second_len ? first_len : second_len);
+
+    return result != 0 ? result : first_len < second_len ? -1 : first_len > second_len ? 1 : 0;
+}
+
+/**
+ * @brief aggregate_bucket Returns bucket of the value, creates it if necessary.
+ * @param[in] aggregate     Aggregate to work with.
+ * @param[in] value         Value of the group, NULL for bucket without value.
+ * @param[in] len           Length of the value.
+ * @return
+ *        - Bucket.
+ *        - NULL on failure.
+ */
+static aggregate_bucket_t *aggregate_bucket(aggregate_t *aggregate, const char *value, size_t len)
+{
+    aggregate_bucket_t *bucket = NULL;
+    char *key = NULL;
+
+    if (!value)
+    {
+        if (!aggregate->missing)
+        {
+            aggregate->missing = talloc_zero(aggregate, aggregate_bucket_t);
+        }
+
+        return aggregate->missing;
+    }
+
+    key = g_utf8_casefold(value, len);
+
+    bucket = g_hash_table_lookup(aggregate->by_key, key);
+    if (bucket)
+    {
+        g_free(key);
+        return bucket;
+    }
+
+    ld_talloc_zero_e(bucket, error_exit, "aggregate_bucket - out of memory - unable to create bucket!\n",
+                     aggregate, aggregate_bucket_t);
+
+    bucket->key = talloc_strndup(bucket, value, len);
+    if (!bucket->key)
+    {
+        goto error_exit;
+    }
+
+    g_hash_table_insert(aggregate->by_key, key, bucket);
+
+    return bucket;
+
+    error_exit:
+        g_free(key);
+        talloc_free(bucket);
+        return NULL;
+}
+
+/**
+ * @brief aggregate_add_bucket Counts the entry being processed in the bucket, every bucket is counted once.
+ */
+static void aggregate_add_bucket(aggregate_t *aggregate, aggregate_bucket_t *bucket)
+{
+    if (!bucket)
+    {
+        return;
+    }
+
+    for (guint i = 0; i < aggregate->current->len; ++i)
+    {
+        if (aggregate->current->pdata[i] == bucket)
+        {
+            return;
+        }
+    }
+
+    ++bucket->count;
+
+    g_ptr_array_add(aggregate->current, bucket);
+}
+
+/**
+ * @brief aggregate_get_parent Returns copy of parent part of the DN.
+ * @param[in] ctx           Talloc ctx to allocate parent on.
+ * @param[in] dn            DN of the entry.
+ * @return
+ *        - Parent DN.
+ *        - NULL if DN is invalid or has no parent.
+ */
+static char *aggregate_get_parent(TALLOC_CTX *ctx, const char *dn)
+{
+    char *parent = NULL;
+
+    ld_dn_t *parsed = ld_dn_parse(ctx, dn, NULL);
+    if (!parsed)
+    {
+        return NULL;
+    }
+
+    for (unsigned int i = 0; i < ld_dn_get_ava_count(parsed); ++i)
+    {
+        const ld_dn_ava_t *ava = ld_dn_get_ava(parsed, i);
+
+        if (ava->rdn > 0)
+        {
+            // AVA points into parsed DN, copy it before the DN is released.
+            parent = talloc_strdup(ctx, ava->type);
+            break;
+        }
+    }
+
+    talloc_free(parsed);
+
+    return parent;
+}
+
+/**
+ * @brief aggregate_measure Updates smallest and largest values of buckets of the entry.
+ */
+static void aggregate_measure(aggregate_t *aggregate, const struct berval *value)
+{
+    for (guint i = 0; i < aggregate->current->len; ++i)
+    {
+        aggregate_bucket_t *bucket = aggregate->current->pdata[i];
+
+        if (!bucket->min || aggregate_compare_values(bucket->min, value->bv_val, value->bv_len) > 0)
+        {
+            talloc_free(bucket->min);
+            bucket->min = talloc_strndup(bucket, value->bv_val, value->bv_len);
+        }
+
+        if (!bucket->max || aggregate_compare_values(bucket->max, value->bv_val, value->bv_len) < 0)
+        {
+            talloc_free(bucket->max);
+            bucket->max = talloc_strndup(bucket, value->bv_val, value->bv_len);
+        }
+    }
+}
+
+/**
+ * @brief aggregate_entry Adds the entry to totals.
+ * @param[in] aggregate     Aggregate to work with.
+ * @param[in] message       Search entry.
+ */
+static void aggregate_entry(aggregate_t *aggregate, LDAPMessage *message)
+{
+    LDAP *ldap = aggregate->connection->ldap;
+
+    ++aggregate->total;
+
+    g_ptr_array_set_size(aggregate->current, 0);
+
+    if (aggregate->by_parent)
+    {
+        char *dn = ldap_get_dn(ldap, message);
+        char *parent = dn ? aggregate_get_parent(aggregate, dn) : NULL;
+
+        aggregate_add_bucket(aggregate, aggregate_bucket(aggregate, parent, parent ? strlen(parent) : 0));
+
+        talloc_free(parent);
+        ldap_memfree(dn);
+    }
+    else if (aggregate->group_by)
+    {
+        struct berval **values = ldap_get_values_len(ldap, message, aggregate->group_by);
+
+        for (int i = 0; values && values[i]; ++i)
+        {
+            aggregate_add_bucket(aggregate, aggregate_bucket(aggregate, values[i]->bv_val, values[i]->bv_len));
+        }
+
+        if (aggregate->current->len == 0)
+        {
+            aggregate_add_bucket(aggregate, aggregate_bucket(aggregate, NULL, 0));
+        }
+
+        ldap_value_free_len(values);
+    }
+    else
+    {
+        aggregate_add_bucket(aggregate, aggregate_bucket(aggregate, NULL, 0));
+    }
+
+    if (aggregate->measure)
+    {
+        struct berval **values = ldap_get_values_len(ldap, message, aggregate->measure);
+
+        for (int i = 0; values && values[i]; ++i)
+        {
+            aggregate_measure(aggregate, values[i]);
+        }
+
+        ldap_value_free_len(values);
+    }
+}
+
+/**
+ * @brief aggregate_compare_buckets Orders buckets by amount of entries, bucket without value goes last.
+ */
+static gint aggregate_compare_buckets(gconstpointer first, gconstpointer second)
+{
+    const ld_aggregate_bucket_t *first_bucket = first;
+    const ld_aggregate_bucket_t *second_bucket = second;
+
+    if (!first_bucket->key != !second_bucket->key)
+    {
+        return first_bucket->key ? -1 : 1;
+    }
+
+    if (first_bucket->count != second_bucket->count)
+    {
+        return first_bucket->count > second_bucket->count ? -1 : 1;
+    }
+
+    return first_bucket->key ? strcmp(first_bucket->key, second_bucket->key) : 0;
+}
+
+/**
+ * @brief aggregate_finish Passes totals to callback and releases aggregate.
+ */
+static void aggregate_finish(aggregate_t *aggregate, enum OperationReturnCode rc)
+{
+    GArray *buckets = g_array_new(FALSE, TRUE, sizeof(ld_aggregate_bucket_t));
+    GHashTableIter iter;
+    gpointer value = NULL;
+
+    aggregate->in_progress = false;
+
+    g_hash_table_iter_init(&iter, aggregate->by_key);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        aggregate_bucket_t *bucket = value;
+        ld_aggregate_bucket_t result = { bucket->key, bucket->count, bucket->min, bucket->max };
+        g_array_append_val(buckets, result);
+    }
+
+    // Plain count reports its total even if nothing matched.
+    if (aggregate->missing || (!aggregate->group_by && !aggregate->by_parent))
+    {
+        aggregate_bucket_t *bucket = aggregate->missing;
+        ld_aggregate_bucket_t result = { NULL,
+                                         bucket ? bucket->count : 0,
+                                         bucket ? bucket->min : NULL,
+                                         bucket ? bucket->max : NULL };
+        g_array_append_val(buckets, result);
+    }
+
+    g_array_sort(buckets, aggregate_compare_buckets);
+
+    if (aggregate->callback)
+    {
+        aggregate->callback((ld_aggregate_bucket_t*)buckets->data, buckets->len, aggregate->total, rc,
+                            aggregate->user_data);
+    }
+
+    g_array_free(buckets, TRUE);
+
+    talloc_free(aggregate);
+}
+
+/**
+ * @brief aggregate_search_send Sends request for the next page of search results.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode aggregate_search_send(aggregate_t *aggregate)
+{
+    struct ldap_connection_ctx_t *connection = aggregate->connection;
+    LDAPControl *controls[2] = { NULL, NULL };
+    int msgid = 0;
+
+    if (aggregate->paged
+        && ldap_create_page_control(connection->ldap, AGGREGATE_PAGE_SIZE, &aggregate->cookie, 0, &controls[0])
+           != LDAP_SUCCESS)
+    {
+        ld_error("aggregate_search_send - unable to create paged results control!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    int rc = ldap_search_ext(connection->ldap,
+                             aggregate->base_dn,
+                             aggregate->scope,
+                             aggregate->filter,
+                             aggregate->attrs,
+                             0,
+                             controls,
+                             NULL,
+                             NULL,
+                             LDAP_NO_LIMIT,
+                             &msgid);
+
+    if (controls[0])
+    {
+        ldap_control_free(controls[0]);
+    }
+
+    if (rc != LDAP_SUCCESS)
+    {
+        ld_error("Unable to create aggregate search request: %s\n", ldap_err2string(rc));
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (connection_add_stream_request(connection, msgid, aggregate_on_read, aggregate) != RETURN_CODE_SUCCESS)
+    {
+        ldap_abandon_ext(connection->ldap, msgid, NULL, NULL);
+        return RETURN_CODE_FAILURE;
+    }
+
+    aggregate->msgid = msgid;
+    aggregate->in_progress = true;
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief aggregate_search_result Processes search result, requests next page if there is one.
+ * @return RETURN_CODE_SUCCESS to remove request from connection.
+ */
+static enum OperationReturnCode aggregate_search_result(aggregate_t *aggregate, LDAPMessage *message)
+{
+    LDAP *ldap = aggregate->connection->ldap;
+    int error_code = 0;
+    char *diagnostic_message = NULL;
+    LDAPControl **controls = NULL;
+    bool more_results = false;
+
+    aggregate->in_progress = false;
+
+    if (ldap_parse_result(ldap, message, &error_code, NULL, &diagnostic_message, NULL, &controls, 0) != LDAP_SUCCESS)
+    {
+        aggregate_finish(aggregate, RETURN_CODE_FAILURE);
+        return RETURN_CODE_SUCCESS;
+    }
+
+    if (error_code != LDAP_SUCCESS)
+    {
+        ld_error("Aggregate search request failed: %s %s\n", ldap_err2string(error_code),
+                 diagnostic_message ? diagnostic_message : "");
+
+        ldap_memfree(diagnostic_message);
+        ldap_controls_free(controls);
+
+        aggregate_finish(aggregate, RETURN_CODE_FAILURE);
+        return RETURN_CODE_SUCCESS;
+    }
+
+    ldap_memfree(diagnostic_message);
+
+    LDAPControl *control = aggregate->paged ? ldap_control_find(LDAP_CONTROL_PAGEDRESULTS, controls, NULL) : NULL;
+    if (control)
+    {
+        ber_int_t count = 0;
+        struct berval cookie = { 0, NULL };
+
+        if (ldap_parse_pageresponse_control(ldap, control, &count, &cookie) == LDAP_SUCCESS)
+        {
+            talloc_free(aggregate->cookie.bv_val);
+            aggregate->cookie.bv_val = cookie.bv_len > 0
+                    ? talloc_memdup(aggregate, cookie.bv_val, cookie.bv_len)
+                    : NULL;
+            aggregate->cookie.bv_len = aggregate->cookie.bv_val ? cookie.bv_len : 0;
+            more_results = aggregate->cookie.bv_len > 0;
+            ber_memfree(cookie.bv_val);
+        }
+    }
+
+    ldap_controls_free(controls);
+
+    if (!more_results)
+    {
+        aggregate_finish(aggregate, RETURN_CODE_SUCCESS);
+    }
+    else if (aggregate_search_send(aggregate) != RETURN_CODE_SUCCESS)
+    {
+        aggregate_finish(aggregate, RETURN_CODE_FAILURE);
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief aggregate_on_read This callback is called when messages of aggregate search arrive.
+ * @param[in] rc            Return code of ldap_result.
+ * @param[in] message       Message received from ldap.
+ * @param[in] connection    Connection to work with.
+ * @return
+ *        - RETURN_CODE_OPERATION_IN_PROGRESS while results are being received.
+ *        - RETURN_CODE_SUCCESS when request has been completed.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode aggregate_on_read(int rc, LDAPMessage *message,
+                                                  struct ldap_connection_ctx_t *connection)
+{
+    aggregate_t *aggregate = connection->request_user_data;
+
+    if (!aggregate)
+    {
+        ld_error("aggregate_on_read - aggregate is missing!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (rc == LDAP_RES_ANY)
+    {
+        aggregate->in_progress = false;
+        aggregate_finish(aggregate, RETURN_CODE_FAILURE);
+        return RETURN_CODE_SUCCESS;
+    }
+
+    for (LDAPMessage *current = ldap_first_message(connection->ldap, message);
+         current != NULL;
+         current = ldap_next_message(connection->ldap, current))
+    {
+        switch (ldap_msgtype(current))
+        {
+        case LDAP_RES_SEARCH_ENTRY:
+            aggregate_entry(aggregate, current);
+            break;
+        case LDAP_RES_SEARCH_REFERENCE:
+            ld_info("Received search referral but not following it!");
+            break;
+        case LDAP_RES_SEARCH_RESULT:
+            return aggregate_search_result(aggregate, current);
+        default:
+            break;
+        }
+    }
+
+    return RETURN_CODE_OPERATION_IN_PROGRESS;
+}
+
+/**
+ * @brief ld_aggregate Counts entries matching the search.
+ *
+ * Only the grouping and measured attributes are requested, plain count requests no attributes at all.
+ * Values are grouped ignoring case, smallest and largest values are compared as numbers if both are integers
+ * and byte by byte otherwise.
+ * @param[in] ctx                Talloc ctx the aggregate is allocated on, freeing it cancels the search.
+ * @param[in] connection         Connection to work with, should be in LDAP_CONNECTION_STATE_RUN state.
+ * @param[in] base_dn            Base of the search.
+ * @param[in] scope              Scope of the search.
+ * @param[in] filter             Filter of the search.
+ * @param[in] group_by           Attribute to group entries by, LD_AGGREGATE_BY_PARENT to group them by parent
+ *                               container, NULL to count all entries together.
+ * @param[in] measure            Attribute to track smallest and largest values of, may be NULL.
+ * @param[in] callback           Callback to call on completion.
+ * @param[in] user_data          User data passed to callback.
+ * @return
+ *        - RETURN_CODE_SUCCESS if search has been started.
+ *        - RETURN_CODE_FAILURE on failure, callback is not called.
+ */
+enum OperationReturnCode ld_aggregate(TALLOC_CTX *ctx,
+                                      struct ldap_connection_ctx_t *connection,
+                                      const char *base_dn,
+                                      int scope,
+                                      const char *filter,
+                                      const char *group_by,
+                                      const char *measure,
+                                      aggregate_complete_callback_fn callback,
+                                      void *user_data)
+{
+    aggregate_t *aggregate = NULL;
+    int n_attrs = 0;
+
+    if (!connection || !base_dn || !filter || !callback)
+    {
+        ld_error("ld_aggregate - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    ld_talloc_zero_e(aggregate, error_exit, "ld_aggregate - out of memory - unable to create aggregate!\n",
+                     ctx, aggregate_t);
+
+    aggregate->by_key = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    aggregate->current = g_ptr_array_new();
+
+    talloc_set_destructor((void*)aggregate, aggregate_destructor);
+
+    aggregate->connection = connection;
+    aggregate->scope = scope;
+    aggregate->paged = directory_has_capability(connection, LDAP_CAPABILITY_PAGED_RESULTS);
+    aggregate->msgid = -1;
+    aggregate->callback = callback;
+    aggregate->user_data = user_data;
+
+    ld_talloc_strdup(aggregate->base_dn, error_exit, aggregate, base_dn);
+    ld_talloc_strdup(aggregate->filter, error_exit, aggregate, filter);
+
+    if (group_by && strcmp(group_by, LD_AGGREGATE_BY_PARENT) == 0)
+    {
+        aggregate->by_parent = true;
+    }
+    else if (group_by)
+    {
+        ld_talloc_strdup(aggregate->group_by, error_exit, aggregate, group_by);
+        aggregate->attrs[n_attrs++] = aggregate->group_by;
+    }
+
+    if (measure)
+    {
+        ld_talloc_strdup(aggregate->measure, error_exit, aggregate, measure);
+        aggregate->attrs[n_attrs++] = aggregate->measure;
+    }
+
+    if (n_attrs == 0)
+    {
+        aggregate->attrs[n_attrs++] = LDAP_NO_ATTRS;
+    }
+
+    if (aggregate_search_send(aggregate) != RETURN_CODE_SUCCESS)
+    {
+        goto error_exit;
+    }
+
+    return RETURN_CODE_SUCCESS;
+
+    error_exit:
+        talloc_free(aggregate);
+        return RETURN_CODE_FAILURE;
+}
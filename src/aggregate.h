@@ -0,0 +1,79 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+#ifndef LIBDOMAIN_AGGREGATE_H
+#define LIBDOMAIN_AGGREGATE_H
+
+#include "common.h"
+#include "connection.h"
+
+#include <stdbool.h>
+
+/**
+ * Aggregate counts entries matching the search, optionally grouped by values of an attribute or by parent
+ * container, and tracks smallest and largest values of another attribute. Totals are updated as entries arrive,
+ * only the requested attributes are transferred and entries are never constructed, so memory use depends on
+ * the amount of groups rather than on the amount of entries.
+ *
+ * E.g. disabled users per container:
+ *     ld_aggregate(ctx, connection, base_dn, LDAP_SCOPE_SUBTREE,
+ *                  "(&(objectClass=user)(userAccountControl:1.2.840.113556.1.4.803:=2))",
+ *                  LD_AGGREGATE_BY_PARENT, NULL, callback, user_data);
+ */
+
+//! Groups entries by DN of their parent instead of values of an attribute.
+#define LD_AGGREGATE_BY_PARENT "@parent"
+
+/*!
+ * @brief ld_aggregate_bucket_t - Totals of one group.
+ */
+typedef struct ld_aggregate_bucket_s
+{
+    const char *key;            //!< Value of the group, NULL for entries without it or when entries are not grouped.
+    unsigned long count;        //!< Amount of entries in the group.
+    const char *min;            //!< Smallest value of the measured attribute, NULL if no entry has it.
+    const char *max;            //!< Largest value of the measured attribute, NULL if no entry has it.
+} ld_aggregate_bucket_t;
+
+/**
+ * @brief aggregate_complete_callback_fn Callback fired once all entries have been counted.
+ *
+ * Buckets are sorted by amount of entries starting from the largest one, bucket without value is the last one.
+ * Entry with several values of the grouping attribute is counted in every group, total counts it once.
+ * On failure buckets hold totals of entries received before the failure.
+ * @param[in] buckets           Buckets, valid only during the call.
+ * @param[in] total             Amount of matching entries.
+ */
+typedef void (*aggregate_complete_callback_fn)(const ld_aggregate_bucket_t *buckets,
+                                               int n_buckets,
+                                               unsigned long total,
+                                               enum OperationReturnCode rc,
+                                               void *user_data);
+
+enum OperationReturnCode ld_aggregate(TALLOC_CTX *ctx,
+                                      struct ldap_connection_ctx_t *connection,
+                                      const char *base_dn,
+                                      int scope,
+                                      const char *filter,
+                                      const char *group_by,
+                                      const char *measure,
+                                      aggregate_complete_callback_fn callback,
+                                      void *user_data);
+
+#endif //LIBDOMAIN_AGGREGATE_H
@@ -0,0 +1,268 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "batch.h"
+#include "write_scheduler.h"
+
+#include "domain_p.h"
+#include "helper_p.h"
+
+#include <string.h>
+#include <strings.h>
+
+/*!
+ * @brief batch_add_t - Batch of entries being created.
+ */
+typedef struct batch_add_s
+{
+    LDHandle *handle;                           //!< Handle batch belongs to.
+    ld_batch_result_t *results;                 //!< Results of items.
+    int n_items;                                //!< Amount of items.
+    int *indexes;                               //!< Index of the item of every submitted request by request id.
+    int submitted;                              //!< Amount of submitted requests.
+    batch_complete_callback_fn callback;        //!< Completion callback.
+    void *user_data;                            //!< User data passed to callback.
+} batch_add_t;
+
+/**
+ * @brief batch_count_attributes Returns amount of attributes in NULL terminated array.
+ */
+static int batch_count_attributes(LDAPAttribute_t **attrs)
+{
+    int count = 0;
+
+    while (attrs && attrs[count])
+    {
+        ++count;
+    }
+
+    return count;
+}
+
+/**
+ * @brief batch_fill_mod Makes add modification which refers to values of the attribute.
+ *
+ * Values are not copied, write scheduler copies requests on submission.
+ */
+static void batch_fill_mod(LDAPMod *mod, LDAPAttribute_t *attribute)
+{
+    mod->mod_op = LDAP_MOD_ADD;
+    mod->mod_type = attribute->name;
+    mod->mod_values = attribute->values;
+}
+
+/**
+ * @brief batch_has_attribute Checks whether attributes contain attribute with the name.
+ */
+static bool batch_has_attribute(LDAPAttribute_t **attrs, const char *name)
+{
+    for (int i = 0; attrs && attrs[i]; ++i)
+    {
+        if (strcasecmp(attrs[i]->name, name) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void batch_on_request(ld_write_scheduler_t *scheduler, const ld_write_request_t *request,
+                             enum OperationReturnCode rc, int result_code, void *user_data)
+{
+    (void)(scheduler);
+
+    batch_add_t *batch = user_data;
+    ld_batch_result_t *result = &batch->results[batch->indexes[request->id - 1]];
+
+    result->rc = rc;
+    result->result_code = result_code;
+}
+
+static void batch_on_complete(ld_write_scheduler_t *scheduler, enum OperationReturnCode rc, void *user_data)
+{
+    (void)(scheduler);
+
+    batch_add_t *batch = user_data;
+
+    for (int i = 0; i < batch->n_items; ++i)
+    {
+        if (batch->results[i].rc != RETURN_CODE_SUCCESS)
+        {
+            rc = RETURN_CODE_FAILURE;
+        }
+    }
+
+    batch->callback(batch->handle, batch->results, batch->n_items, rc, batch->user_data);
+}
+
+/**
+ * @brief batch_submit Submits add request of the item.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode batch_submit(ld_write_scheduler_t *scheduler,
+                                             batch_add_t *batch,
+                                             int index,
+                                             const ld_batch_item_t *item,
+                                             LDAPMod *default_mods,
+                                             LDAPAttribute_t **defaults,
+                                             const char *parent,
+                                             const char *prefix)
+{
+    enum OperationReturnCode rc = RETURN_CODE_FAILURE;
+    TALLOC_CTX *talloc_ctx = NULL;
+    LDAPMod **mods = NULL;
+    LDAPMod *item_mods = NULL;
+    int n_mods = 0;
+
+    if (!item->name || strlen(item->name) == 0)
+    {
+        ld_error("batch_submit - empty name of item %d!\n", index);
+        return RETURN_CODE_FAILURE;
+    }
+
+    int n_attrs = batch_count_attributes(item->attrs);
+    int n_defaults = batch_count_attributes(defaults);
+
+    ld_talloc_new(talloc_ctx, error_exit, batch);
+
+    const char *dn = NULL;
+    ld_talloc_asprintf(dn, error_exit, talloc_ctx, "%s=%s,%s", prefix, item->name, parent);
+
+    ld_talloc_zero_array(item_mods, error_exit, talloc_ctx, LDAPMod, n_attrs + 1);
+    ld_talloc_zero_array(mods, error_exit, talloc_ctx, LDAPMod*, n_attrs + n_defaults + 1);
+
+    for (int i = 0; i < n_attrs; ++i)
+    {
+        batch_fill_mod(&item_mods[i], item->attrs[i]);
+        mods[n_mods++] = &item_mods[i];
+    }
+
+    for (int i = 0; i < n_defaults; ++i)
+    {
+        if (!batch_has_attribute(item->attrs, defaults[i]->name))
+        {
+            mods[n_mods++] = &default_mods[i];
+        }
+    }
+
+    // Request may complete before submission returns, so index is recorded in advance.
+    batch->indexes[batch->submitted] = index;
+
+    rc = ld_write_scheduler_add(scheduler, dn, mods);
+    if (rc == RETURN_CODE_SUCCESS)
+    {
+        ++batch->submitted;
+    }
+
+    error_exit:
+        talloc_free(talloc_ctx);
+        return rc;
+}
+
+/**
+ * @brief ld_batch_add_entries Creates entries in the container.
+ *
+ * Requests are sent pipelined, completion callback may be called before function returns.
+ * @param[in] handle           Pointer to libdomain session handle.
+ * @param[in] items            Entries to create.
+ * @param[in] n_items          Amount of entries.
+ * @param[in] defaults         Attributes shared by all entries, may be NULL.
+ * @param[in] parent           Container of the entries.
+ * @param[in] prefix           Attribute type of RDN of the entries.
+ * @param[in] window           Maximum amount of requests in flight, 0 for default.
+ * @param[in] callback         Callback to report results to.
+ * @param[in] user_data        User data passed to callback.
+ * @return
+ *        - RETURN_CODE_SUCCESS if batch has been started.
+ *        - RETURN_CODE_FAILURE on failure, callback is not called.
+ */
+enum OperationReturnCode ld_batch_add_entries(LDHandle *handle,
+                                              const ld_batch_item_t *items,
+                                              int n_items,
+                                              LDAPAttribute_t **defaults,
+                                              const char *parent,
+                                              const char *prefix,
+                                              unsigned int window,
+                                              batch_complete_callback_fn callback,
+                                              void *user_data)
+{
+    ld_write_scheduler_t *scheduler = NULL;
+    batch_add_t *batch = NULL;
+    LDAPMod *default_mods = NULL;
+
+    check_handle(handle, "ld_batch_add_entries");
+
+    if ((!items && n_items > 0) || n_items < 0 || !parent || strlen(parent) == 0 || !prefix || !callback)
+    {
+        ld_error("ld_batch_add_entries - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    ld_talloc_zero_e(batch, error_exit, "ld_batch_add_entries - out of memory - unable to create batch!\n",
+                     NULL, batch_add_t);
+
+    batch->handle = handle;
+    batch->n_items = n_items;
+    batch->callback = callback;
+    batch->user_data = user_data;
+
+    ld_talloc_zero_array(batch->results, error_exit, batch, ld_batch_result_t, n_items + 1);
+    ld_talloc_zero_array(batch->indexes, error_exit, batch, int, n_items + 1);
+
+    for (int i = 0; i < n_items; ++i)
+    {
+        batch->results[i].rc = RETURN_CODE_FAILURE;
+        batch->results[i].result_code = LDAP_PARAM_ERROR;
+    }
+
+    int n_defaults = batch_count_attributes(defaults);
+
+    ld_talloc_zero_array(default_mods, error_exit, batch, LDAPMod, n_defaults + 1);
+    for (int i = 0; i < n_defaults; ++i)
+    {
+        batch_fill_mod(&default_mods[i], defaults[i]);
+    }
+
+    scheduler = ld_write_scheduler_new(handle->talloc_ctx, handle->connection_ctx, window,
+                                       batch_on_request, batch_on_complete, batch);
+    if (!scheduler)
+    {
+        goto error_exit;
+    }
+
+    // Batch is released together with scheduler once it completes.
+    talloc_steal(scheduler, batch);
+
+    for (int i = 0; i < n_items; ++i)
+    {
+        batch_submit(scheduler, batch, i, &items[i], default_mods, defaults, parent, prefix);
+    }
+
+    ld_write_scheduler_finish(scheduler);
+
+    return RETURN_CODE_SUCCESS;
+
+    error_exit:
+        talloc_free(batch);
+        return RETURN_CODE_FAILURE;
+}
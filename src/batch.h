@@ -0,0 +1,73 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_BATCH_H
+#define LIBDOMAIN_BATCH_H
+
+#include "common.h"
+#include "domain.h"
+
+/**
+ * Batch operations create many entries in one container. Parent and shared default attributes are prepared once,
+ * requests are pipelined through the write scheduler of the connection.
+ */
+
+/*!
+ * @brief ld_batch_item_t - Entry to create.
+ */
+typedef struct ld_batch_item_s
+{
+    const char *name;                   //!< Name of the entry, used as RDN value as is.
+    LDAPAttribute_t **attrs;            //!< Attributes of the entry, they override defaults with the same name.
+                                        //!< May be NULL.
+} ld_batch_item_t;
+
+/*!
+ * @brief ld_batch_result_t - Result of the item.
+ */
+typedef struct ld_batch_result_s
+{
+    enum OperationReturnCode rc;        //!< RETURN_CODE_SUCCESS if entry has been created.
+    int result_code;                    //!< LDAP result code of the request.
+} ld_batch_result_t;
+
+/**
+ * @brief batch_complete_callback_fn Callback fired once all items have completed.
+ *
+ * Return code is RETURN_CODE_SUCCESS only if all entries have been created.
+ * @param[in] results           Results in order of items, valid only during the call.
+ */
+typedef void (*batch_complete_callback_fn)(LDHandle *handle,
+                                           const ld_batch_result_t *results,
+                                           int n_items,
+                                           enum OperationReturnCode rc,
+                                           void *user_data);
+
+enum OperationReturnCode ld_batch_add_entries(LDHandle *handle,
+                                              const ld_batch_item_t *items,
+                                              int n_items,
+                                              LDAPAttribute_t **defaults,
+                                              const char *parent,
+                                              const char *prefix,
+                                              unsigned int window,
+                                              batch_complete_callback_fn callback,
+                                              void *user_data);
+
+#endif //LIBDOMAIN_BATCH_H
@@ -0,0 +1,570 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "browse.h"
+#include "directory.h"
+#include "entry.h"
+
+#include "helper_p.h"
+
+#include <string.h>
+
+/*!
+ * @brief ld_browse_t - Sorted view of search results browsed window by window.
+ */
+struct ld_browse_s
+{
+    char *base_dn;                                 //!< Base of the search.
+    int scope;                                     //!< Scope of the search.
+    char *filter;                                  //!< Filter of the search.
+    char **attrs;                                  //!< Attributes to return, NULL for all user attributes.
+    LDAPSortKey **sort_keys;                       //!< Keys the view is sorted by.
+
+    struct berval context;                         //!< Context ID of the view returned by server.
+    unsigned int position;                         //!< Position of target entry reported by server.
+    unsigned int count;                            //!< Estimated amount of entries in the view reported by server.
+
+    bool in_progress;                              //!< Seek request has been sent and has not completed yet.
+    int msgid;                                     //!< Message id of the seek request.
+    struct ldap_connection_ctx_t *connection;      //!< Connection seek request has been sent through.
+
+    browse_callback_fn callback;                   //!< Window callback.
+    void *user_data;                               //!< User data passed to callback.
+};
+
+static int browse_destructor(TALLOC_CTX *ctx)
+{
+    ld_browse_t *browse = talloc_get_type_abort(ctx, ld_browse_t);
+
+    if (browse->in_progress && browse->connection)
+    {
+        connection_cancel_read_request(browse->connection, browse->msgid);
+        ldap_abandon_ext(browse->connection->ldap, browse->msgid, NULL, NULL);
+    }
+
+    if (browse->sort_keys)
+    {
+        ldap_free_sort_keylist(browse->sort_keys);
+        browse->sort_keys = NULL;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief browse_set_context Replaces context ID of the view.
+ * @param[in] browse         Browse to work with.
+ * @param[in] context        New context ID, NULL to forget the view.
+ */
+static void browse_set_context(ld_browse_t *browse, const struct berval *context)
+{
+    talloc_free(browse->context.bv_val);
+    browse->context.bv_val = NULL;
+    browse->context.bv_len = 0;
+
+    if (context && context->bv_len > 0)
+    {
+        browse->context.bv_val = talloc_memdup(browse, context->bv_val, context->bv_len);
+        browse->context.bv_len = browse->context.bv_val ? context->bv_len : 0;
+    }
+}
+
+/**
+ * @brief ld_browse_new Creates sorted view of search results.
+ * @param[in] ctx       Talloc ctx to use.
+ * @param[in] base_dn   Base of the search.
+ * @param[in] scope     Scope of the search.
+ * @param[in] filter    Filter of the search.
+ * @param[in] attrs     Attributes to return, NULL for all user attributes.
+ * @param[in] sort_keys Space separated sort keys in form [-]attribute[:matchingRule], e.g. "sn -givenName".
+ *                      Minus selects reverse order. Value passed to ld_browse_seek_value is compared
+ *                      with the first key.
+ * @return
+ *        - Valid pointer to browse on success.
+ *        - NULL on failure.
+ */
+ld_browse_t *ld_browse_new(TALLOC_CTX *ctx,
+                           const char *base_dn,
+                           int scope,
+                           const char *filter,
+                           char **attrs,
+                           const char *sort_keys)
+{
+    ld_browse_t *browse = NULL;
+    char *keys = NULL;
+
+    if (!base_dn || !filter || !sort_keys)
+    {
+        ld_error("ld_browse_new - invalid parameters!\n");
+        return NULL;
+    }
+
+    ld_talloc_zero_e(browse, error_exit, "ld_browse_new - out of memory - unable to create browse!\n",
+                     ctx, ld_browse_t);
+
+    talloc_set_destructor((void*)browse, browse_destructor);
+
+    ld_talloc_strdup(browse->base_dn, error_exit, browse, base_dn);
+    ld_talloc_strdup(browse->filter, error_exit, browse, filter);
+    browse->scope = scope;
+    browse->msgid = -1;
+
+    if (attrs)
+    {
+        int attrs_count = 0;
+        while (attrs[attrs_count])
+        {
+            ++attrs_count;
+        }
+
+        ld_talloc_zero_array(browse->attrs, error_exit, browse, char*, attrs_count + 1);
+
+        for (int i = 0; i < attrs_count; ++i)
+        {
+            ld_talloc_strdup(browse->attrs[i], error_exit, browse->attrs, attrs[i]);
+        }
+    }
+
+    // Parser of sort keys modifies its argument.
+    ld_talloc_strdup(keys, error_exit, browse, sort_keys);
+
+    if (ldap_create_sort_keylist(&browse->sort_keys, keys) != LDAP_SUCCESS || !browse->sort_keys
+        || !browse->sort_keys[0])
+    {
+        ld_error("ld_browse_new - invalid sort keys %s!\n", sort_keys);
+        goto error_exit;
+    }
+
+    talloc_free(keys);
+
+    return browse;
+
+    error_exit:
+        talloc_free(browse);
+        return NULL;
+}
+
+/**
+ * @brief ld_browse_set_callback Sets callback receiving windows of the view.
+ * @param[in] browse             Browse to work with.
+ * @param[in] callback           Window callback.
+ * @param[in] user_data          User data passed to callback.
+ */
+void ld_browse_set_callback(ld_browse_t *browse, browse_callback_fn callback, void *user_data)
+{
+    if (!browse)
+    {
+        ld_error("ld_browse_set_callback - invalid browse!\n");
+        return;
+    }
+
+    browse->callback = callback;
+    browse->user_data = user_data;
+}
+
+/**
+ * @brief browse_search Sends search request for the window described by virtual list view request.
+ * @param[in] connection Connection to work with.
+ * @param[in] browse     Browse to work with.
+ * @param[in] vlv        Target of the window.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_OPERATION_IN_PROGRESS if previous seek has not completed yet.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode browse_search(struct ldap_connection_ctx_t *connection,
+                                              ld_browse_t *browse,
+                                              LDAPVLVInfo *vlv)
+{
+    LDAPControl *controls[3] = { NULL, NULL, NULL };
+    int msgid = 0;
+
+    if (browse->in_progress)
+    {
+        return RETURN_CODE_OPERATION_IN_PROGRESS;
+    }
+
+    if (!browse->callback)
+    {
+        ld_error("browse_search - callback is not set!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (!directory_has_capability(connection, LDAP_CAPABILITY_SERVER_SIDE_SORT | LDAP_CAPABILITY_VLV))
+    {
+        ld_error("browse_search - server does not support sorted virtual list views!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    vlv->ldvlv_version = 1;
+    vlv->ldvlv_context = browse->context.bv_len > 0 ? &browse->context : NULL;
+
+    if (ldap_create_sort_control(connection->ldap, browse->sort_keys, 1, &controls[0]) != LDAP_SUCCESS
+        || ldap_create_vlv_control(connection->ldap, vlv, &controls[1]) != LDAP_SUCCESS)
+    {
+        ld_error("browse_search - unable to create virtual list view controls!\n");
+        goto error_exit;
+    }
+
+    int rc = ldap_search_ext(connection->ldap,
+                             browse->base_dn,
+                             browse->scope,
+                             browse->filter,
+                             browse->attrs,
+                             0,
+                             controls,
+                             NULL,
+                             NULL,
+                             LDAP_NO_LIMIT,
+                             &msgid);
+    if (rc != LDAP_SUCCESS)
+    {
+        ld_error("Unable to create browse request: %s\n", ldap_err2string(rc));
+        goto error_exit;
+    }
+
+    ldap_control_free(controls[0]);
+    ldap_control_free(controls[1]);
+
+    if (connection_add_read_request(connection, msgid, ld_browse_on_read, browse) != RETURN_CODE_SUCCESS)
+    {
+        ldap_abandon_ext(connection->ldap, msgid, NULL, NULL);
+        return RETURN_CODE_FAILURE;
+    }
+
+    browse->in_progress = true;
+    browse->msgid = msgid;
+    browse->connection = connection;
+
+    return RETURN_CODE_SUCCESS;
+
+    error_exit:
+        if (controls[0])
+        {
+            ldap_control_free(controls[0]);
+        }
+        if (controls[1])
+        {
+            ldap_control_free(controls[1]);
+        }
+        return RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief ld_browse_seek_offset Requests window around entry at given position of the view.
+ *
+ * Position is scaled by the server when amount of entries has changed since previous window,
+ * so scroll bar position maps onto the view as user sees it.
+ * @param[in] connection        Connection to work with, should be in LDAP_CONNECTION_STATE_RUN state.
+ * @param[in] browse            Browse to work with.
+ * @param[in] offset            Position of target entry starting from 1, ld_browse_get_count() selects the last one.
+ * @param[in] before_count      Amount of entries to return before target entry.
+ * @param[in] after_count       Amount of entries to return after target entry.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_OPERATION_IN_PROGRESS if previous seek has not completed yet.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_browse_seek_offset(struct ldap_connection_ctx_t *connection,
+                                               ld_browse_t *browse,
+                                               unsigned int offset,
+                                               unsigned int before_count,
+                                               unsigned int after_count)
+{
+    LDAPVLVInfo vlv;
+
+    if (!connection || !browse || offset == 0)
+    {
+        ld_error("ld_browse_seek_offset - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    memset(&vlv, 0, sizeof(vlv));
+    vlv.ldvlv_before_count = before_count;
+    vlv.ldvlv_after_count = after_count;
+    vlv.ldvlv_offset = offset;
+    vlv.ldvlv_count = browse->count;
+
+    return browse_search(connection, browse, &vlv);
+}
+
+/**
+ * @brief ld_browse_seek_value Requests window around first entry which sort key is greater or equal to value.
+ * @param[in] connection       Connection to work with, should be in LDAP_CONNECTION_STATE_RUN state.
+ * @param[in] browse           Browse to work with.
+ * @param[in] value            Value compared with the first sort key, e.g. typed prefix of a name.
+ * @param[in] before_count     Amount of entries to return before target entry.
+ * @param[in] after_count      Amount of entries to return after target entry.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_OPERATION_IN_PROGRESS if previous seek has not completed yet.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_browse_seek_value(struct ldap_connection_ctx_t *connection,
+                                              ld_browse_t *browse,
+                                              const char *value,
+                                              unsigned int before_count,
+                                              unsigned int after_count)
+{
+    LDAPVLVInfo vlv;
+    struct berval assertion = { 0, NULL };
+
+    if (!connection || !browse || !value)
+    {
+        ld_error("ld_browse_seek_value - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    assertion.bv_val = (char *)value;
+    assertion.bv_len = strlen(value);
+
+    memset(&vlv, 0, sizeof(vlv));
+    vlv.ldvlv_before_count = before_count;
+    vlv.ldvlv_after_count = after_count;
+    vlv.ldvlv_attrvalue = &assertion;
+
+    return browse_search(connection, browse, &vlv);
+}
+
+/**
+ * @brief browse_finish Completes seek request and passes window to callback.
+ * @param[in] connection Connection to work with.
+ * @param[in] browse     Browse to work with.
+ * @param[in] rc         Result of the request.
+ * @param[in] entries    Entries of the window, NULL on failure.
+ * @return Result of the request.
+ */
+static enum OperationReturnCode browse_finish(struct ldap_connection_ctx_t *connection,
+                                              ld_browse_t *browse,
+                                              enum OperationReturnCode rc,
+                                              ld_entry_t **entries)
+{
+    ld_entry_t *empty[1] = { NULL };
+
+    browse->in_progress = false;
+    browse->msgid = -1;
+    browse->connection = NULL;
+
+    if (rc != RETURN_CODE_SUCCESS)
+    {
+        // Server may have dropped the view, next seek starts a new one.
+        browse_set_context(browse, NULL);
+    }
+
+    // Callback may free the browse.
+    browse->callback(connection, browse, rc, rc == RETURN_CODE_SUCCESS && entries ? entries : empty,
+                     browse->user_data);
+
+    return rc;
+}
+
+/**
+ * @brief browse_process_result Reads sort and virtual list view response controls.
+ * @param[in] connection        Connection to work with.
+ * @param[in] browse            Browse to work with.
+ * @param[in] message           Search result message.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE if server has not sorted results or could not position the view.
+ */
+static enum OperationReturnCode browse_process_result(struct ldap_connection_ctx_t *connection,
+                                                      ld_browse_t *browse,
+                                                      LDAPMessage *message)
+{
+    int error_code = 0;
+    char *diagnostic_message = NULL;
+    LDAPControl **controls = NULL;
+    LDAPControl *control = NULL;
+    enum OperationReturnCode rc = RETURN_CODE_FAILURE;
+
+    if (ldap_parse_result(connection->ldap, message, &error_code, NULL, &diagnostic_message, NULL, &controls, 0)
+        != LDAP_SUCCESS)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (error_code != LDAP_SUCCESS)
+    {
+        ld_error("Browse request failed: %s %s\n", ldap_err2string(error_code),
+                 diagnostic_message ? diagnostic_message : "");
+        goto exit;
+    }
+
+    control = ldap_control_find(LDAP_CONTROL_SORTRESPONSE, controls, NULL);
+    if (control)
+    {
+        ber_int_t sort_result = LDAP_SUCCESS;
+        char *attribute = NULL;
+
+        if (ldap_parse_sortresponse_control(connection->ldap, control, &sort_result, &attribute) != LDAP_SUCCESS
+            || sort_result != LDAP_SUCCESS)
+        {
+            ld_error("Server is unable to sort by %s: %s\n", attribute ? attribute : "requested keys",
+                     ldap_err2string(sort_result));
+            ldap_memfree(attribute);
+            goto exit;
+        }
+
+        ldap_memfree(attribute);
+    }
+
+    control = ldap_control_find(LDAP_CONTROL_VLVRESPONSE, controls, NULL);
+    if (!control)
+    {
+        ld_error("Server has not returned virtual list view response!\n");
+        goto exit;
+    }
+
+    ber_int_t position = 0;
+    ber_int_t count = 0;
+    int vlv_result = LDAP_SUCCESS;
+    struct berval *context = NULL;
+
+    if (ldap_parse_vlvresponse_control(connection->ldap, control, &position, &count, &context, &vlv_result)
+        != LDAP_SUCCESS || vlv_result != LDAP_SUCCESS)
+    {
+        ld_error("Server is unable to position virtual list view: %s\n", ldap_err2string(vlv_result));
+        ber_bvfree(context);
+        goto exit;
+    }
+
+    browse->position = position > 0 ? (unsigned int)position : 0;
+    browse->count = count > 0 ? (unsigned int)count : 0;
+    browse_set_context(browse, context);
+    ber_bvfree(context);
+
+    rc = RETURN_CODE_SUCCESS;
+
+    exit:
+        ldap_memfree(diagnostic_message);
+        ldap_controls_free(controls);
+        return rc;
+}
+
+/**
+ * @brief ld_browse_on_read This callback is called upon completion of browse request.
+ * @param[in] rc            Return code of ldap_result.
+ * @param[in] message       Message received from ldap.
+ * @param[in] connection    Connection to work with.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_browse_on_read(int rc, LDAPMessage *message, struct ldap_connection_ctx_t *connection)
+{
+    ld_browse_t *browse = connection->request_user_data;
+
+    if (!browse)
+    {
+        ld_error("ld_browse_on_read - browse is missing!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (rc == LDAP_RES_ANY)
+    {
+        return browse_finish(connection, browse, RETURN_CODE_FAILURE, NULL);
+    }
+
+    TALLOC_CTX *window = talloc_new(NULL);
+    ld_entry_t **entries = NULL;
+    int count = 0;
+
+    ld_talloc_array_e(entries, error_exit, "ld_browse_on_read - out of memory - unable to create window!\n",
+                      window, ld_entry_t*, ldap_count_entries(connection->ldap, message) + 1);
+
+    for (LDAPMessage *current = ldap_first_message(connection->ldap, message);
+         current != NULL;
+         current = ldap_next_message(connection->ldap, current))
+    {
+        switch (ldap_msgtype(current))
+        {
+        case LDAP_RES_SEARCH_ENTRY:
+            entries[count] = ld_entry_from_message(window, connection->ldap, current);
+            if (!entries[count])
+            {
+                ld_error("ld_browse_on_read - out of memory - unable to create entry!\n");
+                goto error_exit;
+            }
+            entries[++count] = NULL;
+            break;
+        case LDAP_RES_SEARCH_REFERENCE:
+            ld_info("Received search referral but not following it!");
+            break;
+        case LDAP_RES_SEARCH_RESULT:
+        {
+            entries[count] = NULL;
+
+            enum OperationReturnCode result = browse_process_result(connection, browse, current);
+            browse_finish(connection, browse, result, entries);
+
+            talloc_free(window);
+            return result;
+        }
+        default:
+            break;
+        }
+    }
+
+    error_exit:
+        talloc_free(window);
+        return browse_finish(connection, browse, RETURN_CODE_FAILURE, NULL);
+}
+
+/**
+ * @brief ld_browse_reset Forgets the view kept by server, next seek creates a new one.
+ *
+ * Should be called after filter results have changed significantly, e.g. after bulk import.
+ * @param[in] browse      Browse to work with.
+ */
+void ld_browse_reset(ld_browse_t *browse)
+{
+    if (!browse)
+    {
+        return;
+    }
+
+    browse_set_context(browse, NULL);
+    browse->position = 0;
+    browse->count = 0;
+}
+
+/**
+ * @brief ld_browse_in_progress Checks whether seek request has been sent and has not completed yet.
+ */
+bool ld_browse_in_progress(const ld_browse_t *browse)
+{
+    return browse && browse->in_progress;
+}
+
+/**
+ * @brief ld_browse_get_position Returns position of target entry of the last window starting from 1.
+ */
+unsigned int ld_browse_get_position(const ld_browse_t *browse)
+{
+    return browse ? browse->position : 0;
+}
+
+/**
+ * @brief ld_browse_get_count Returns server's estimate of amount of entries in the view.
+ */
+unsigned int ld_browse_get_count(const ld_browse_t *browse)
+{
+    return browse ? browse->count : 0;
+}
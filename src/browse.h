@@ -0,0 +1,75 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_BROWSE_H
+#define LIBDOMAIN_BROWSE_H
+
+#include "common.h"
+#include "connection.h"
+
+#include <stdbool.h>
+
+/**
+ * Browse is a sorted view of search results kept by the server with server side sort (RFC 2891) and
+ * virtual list view controls. Every seek returns only a window of the view, the server keeps the view
+ * between seeks and identifies it with context ID returned in previous response.
+ */
+
+typedef struct ld_browse_s ld_browse_t;
+
+/**
+ * @brief browse_callback_fn Callback fired when window requested by ld_browse_seek_* arrives.
+ *
+ * Entries are ordered as in the view and freed after callback returns, use talloc_steal() to keep them.
+ * On failure entries array is empty.
+ */
+typedef void (*browse_callback_fn)(struct ldap_connection_ctx_t *connection,
+                                   ld_browse_t *browse,
+                                   enum OperationReturnCode rc,
+                                   ld_entry_t **entries,
+                                   void *user_data);
+
+ld_browse_t *ld_browse_new(TALLOC_CTX *ctx,
+                           const char *base_dn,
+                           int scope,
+                           const char *filter,
+                           char **attrs,
+                           const char *sort_keys);
+
+void ld_browse_set_callback(ld_browse_t *browse, browse_callback_fn callback, void *user_data);
+
+enum OperationReturnCode ld_browse_seek_offset(struct ldap_connection_ctx_t *connection,
+                                               ld_browse_t *browse,
+                                               unsigned int offset,
+                                               unsigned int before_count,
+                                               unsigned int after_count);
+enum OperationReturnCode ld_browse_seek_value(struct ldap_connection_ctx_t *connection,
+                                              ld_browse_t *browse,
+                                              const char *value,
+                                              unsigned int before_count,
+                                              unsigned int after_count);
+enum OperationReturnCode ld_browse_on_read(int rc, LDAPMessage *message, struct ldap_connection_ctx_t *connection);
+
+void ld_browse_reset(ld_browse_t *browse);
+bool ld_browse_in_progress(const ld_browse_t *browse);
+unsigned int ld_browse_get_position(const ld_browse_t *browse);
+unsigned int ld_browse_get_count(const ld_browse_t *browse);
+
+#endif //LIBDOMAIN_BROWSE_H
@@ -0,0 +1,498 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "bulk.h"
+#include "directory.h"
+#include "dn.h"
+#include "write_scheduler.h"
+
+#include "helper_p.h"
+
+#include <string.h>
+
+#define BULK_PAGE_SIZE 500
+
+static char *BULK_NO_ATTRIBUTES[] = { LDAP_NO_ATTRS, NULL };
+
+/*!
+ * @brief ld_bulk_t - Bulk operation over search results.
+ */
+struct ld_bulk_s
+{
+    struct ldap_connection_ctx_t *connection;   //!< Connection to work with.
+    ld_write_scheduler_t *scheduler;            //!< Scheduler of writes, bulk operation belongs to it.
+
+    char *base_dn;                              //!< Base of the search.
+    int scope;                                  //!< Scope of the search.
+    char *filter;                               //!< Filter of the search.
+    bool paged;                                 //!< Results are requested page by page.
+    struct berval cookie;                       //!< Paged results cookie of the next page.
+    bool page_delayed;                          //!< Next page waits for backlog of writes to drain.
+
+    enum LdapBulkOperation operation;           //!< Operation to apply.
+    LDAPMod **mods;                             //!< Modifications of LD_BULK_MODIFY.
+    char *new_superior;                         //!< New parent of LD_BULK_MOVE.
+    bool dry_run;                               //!< Matching entries are only reported.
+
+    bool search_failed;                         //!< Search has failed.
+    unsigned long matched;                      //!< Amount of matching entries.
+    unsigned long succeeded;                    //!< Amount of succeeded writes.
+    unsigned long failures;                     //!< Amount of failed writes.
+
+    bulk_progress_callback_fn progress_callback; //!< Callback to report results of entries to.
+    bulk_complete_callback_fn complete_callback; //!< Callback to call on completion.
+    void *user_data;                            //!< User data passed to callbacks.
+};
+
+static enum OperationReturnCode bulk_on_read(int rc, LDAPMessage *message, struct ldap_connection_ctx_t *connection);
+
+/**
+ * @brief bulk_search_send Sends request for the next page of search results.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode bulk_search_send(ld_bulk_t *bulk)
+{
+    struct ldap_connection_ctx_t *connection = bulk->connection;
+    LDAPControl *controls[2] = { NULL, NULL };
+    int msgid = 0;
+
+    if (bulk->paged && ldap_create_page_control(connection->ldap, BULK_PAGE_SIZE, &bulk->cookie, 0, &controls[0])
+        != LDAP_SUCCESS)
+    {
+        ld_error("bulk_search_send - unable to create paged results control!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    int rc = ldap_search_ext(connection->ldap,
+                             bulk->base_dn,
+                             bulk->scope,
+                             bulk->filter,
+                             BULK_NO_ATTRIBUTES,
+                             0,
+                             controls,
+                             NULL,
+                             NULL,
+                             LDAP_NO_LIMIT,
+                             &msgid);
+
+    if (controls[0])
+    {
+        ldap_control_free(controls[0]);
+    }
+
+    if (rc != LDAP_SUCCESS)
+    {
+        ld_error("Unable to create bulk search request: %s\n", ldap_err2string(rc));
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (connection_add_stream_request(connection, msgid, bulk_on_read, bulk) != RETURN_CODE_SUCCESS)
+    {
+        ldap_abandon_ext(connection->ldap, msgid, NULL, NULL);
+        return RETURN_CODE_FAILURE;
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief bulk_search_finish Completes search, bulk operation completes once all writes complete.
+ */
+static void bulk_search_finish(ld_bulk_t *bulk, enum OperationReturnCode rc)
+{
+    bulk->search_failed = rc != RETURN_CODE_SUCCESS;
+
+    // Completion callback may be called and bulk operation released here.
+    ld_write_scheduler_finish(bulk->scheduler);
+}
+
+/**
+ * @brief bulk_on_request This callback is called with result of every write.
+ */
+static void bulk_on_request(ld_write_scheduler_t *scheduler, const ld_write_request_t *request,
+                            enum OperationReturnCode rc, int result_code, void *user_data)
+{
+    ld_bulk_t *bulk = user_data;
+
+    if (rc == RETURN_CODE_SUCCESS)
+    {
+        ++bulk->succeeded;
+    }
+    else
+    {
+        ++bulk->failures;
+    }
+
+    if (bulk->progress_callback)
+    {
+        bulk->progress_callback(bulk, request->dn, rc, result_code, bulk->user_data);
+    }
+
+    // Pending requests include the current one.
+    if (bulk->page_delayed && ld_write_scheduler_get_pending(scheduler) <= BULK_PAGE_SIZE)
+    {
+        bulk->page_delayed = false;
+
+        if (bulk_search_send(bulk) != RETURN_CODE_SUCCESS)
+        {
+            bulk_search_finish(bulk, RETURN_CODE_FAILURE);
+        }
+    }
+}
+
+static void bulk_on_complete(ld_write_scheduler_t *scheduler, enum OperationReturnCode rc, void *user_data)
+{
+    (void)(scheduler);
+
+    ld_bulk_t *bulk = user_data;
+
+    if (bulk->complete_callback)
+    {
+        bulk->complete_callback(bulk, bulk->search_failed ? RETURN_CODE_FAILURE : rc, bulk->user_data);
+    }
+}
+
+/**
+ * @brief bulk_get_rdn Returns RDN of the DN as it appears in the DN.
+ * @return
+ *        - RDN.
+ *        - NULL if DN is invalid or on failure.
+ */
+static char *bulk_get_rdn(TALLOC_CTX *ctx, const char *dn)
+{
+    char *result = NULL;
+
+    ld_dn_t *parsed = ld_dn_parse(ctx, dn, NULL);
+    if (!parsed || ld_dn_get_ava_count(parsed) == 0)
+    {
+        talloc_free(parsed);
+        return NULL;
+    }
+
+    const ld_dn_ava_t *first = ld_dn_get_ava(parsed, 0);
+    const ld_dn_ava_t *last = first;
+
+    for (unsigned int i = 1; i < ld_dn_get_ava_count(parsed) && ld_dn_get_ava(parsed, i)->rdn == 0; ++i)
+    {
+        last = ld_dn_get_ava(parsed, i);
+    }
+
+    result = talloc_strndup(ctx, first->type, (last->value + last->value_len) - first->type);
+
+    talloc_free(parsed);
+
+    return result;
+}
+
+/**
+ * @brief bulk_apply Submits write of the matching entry or reports it in dry run mode.
+ */
+static void bulk_apply(ld_bulk_t *bulk, const char *dn)
+{
+    enum OperationReturnCode rc = RETURN_CODE_FAILURE;
+
+    ++bulk->matched;
+
+    if (bulk->dry_run)
+    {
+        ++bulk->succeeded;
+
+        if (bulk->progress_callback)
+        {
+            bulk->progress_callback(bulk, dn, RETURN_CODE_SUCCESS, LDAP_SUCCESS, bulk->user_data);
+        }
+
+        return;
+    }
+
+    switch (bulk->operation)
+    {
+    case LD_BULK_MODIFY:
+        rc = ld_write_scheduler_modify(bulk->scheduler, dn, bulk->mods);
+        break;
+    case LD_BULK_MOVE:
+    {
+        char *rdn = bulk_get_rdn(bulk, dn);
+        if (rdn)
+        {
+            rc = ld_write_scheduler_rename(bulk->scheduler, dn, rdn, bulk->new_superior, true);
+        }
+        talloc_free(rdn);
+    }
+        break;
+    case LD_BULK_DELETE:
+        rc = ld_write_scheduler_delete(bulk->scheduler, dn);
+        break;
+    default:
+        break;
+    }
+
+    if (rc != RETURN_CODE_SUCCESS)
+    {
+        ++bulk->failures;
+
+        if (bulk->progress_callback)
+        {
+            bulk->progress_callback(bulk, dn, RETURN_CODE_FAILURE, LDAP_PARAM_ERROR, bulk->user_data);
+        }
+    }
+}
+
+/**
+ * @brief bulk_search_result Processes search result, requests next page once backlog of writes allows it.
+ * @return RETURN_CODE_SUCCESS to remove request from connection.
+ */
+static enum OperationReturnCode bulk_search_result(ld_bulk_t *bulk, LDAPMessage *message)
+{
+    LDAP *ldap = bulk->connection->ldap;
+    int error_code = 0;
+    char *diagnostic_message = NULL;
+    LDAPControl **controls = NULL;
+    bool more_results = false;
+
+    if (ldap_parse_result(ldap, message, &error_code, NULL, &diagnostic_message, NULL, &controls, 0) != LDAP_SUCCESS)
+    {
+        bulk_search_finish(bulk, RETURN_CODE_FAILURE);
+        return RETURN_CODE_SUCCESS;
+    }
+
+    if (error_code != LDAP_SUCCESS)
+    {
+        ld_error("Bulk search request failed: %s %s\n", ldap_err2string(error_code),
+                 diagnostic_message ? diagnostic_message : "");
+
+        ldap_memfree(diagnostic_message);
+        ldap_controls_free(controls);
+
+        bulk_search_finish(bulk, RETURN_CODE_FAILURE);
+        return RETURN_CODE_SUCCESS;
+    }
+
+    ldap_memfree(diagnostic_message);
+
+    LDAPControl *control = bulk->paged ? ldap_control_find(LDAP_CONTROL_PAGEDRESULTS, controls, NULL) : NULL;
+    if (control)
+    {
+        ber_int_t count = 0;
+        struct berval cookie = { 0, NULL };
+
+        if (ldap_parse_pageresponse_control(ldap, control, &count, &cookie) == LDAP_SUCCESS)
+        {
+            talloc_free(bulk->cookie.bv_val);
+            bulk->cookie.bv_val = cookie.bv_len > 0 ? talloc_memdup(bulk, cookie.bv_val, cookie.bv_len) : NULL;
+            bulk->cookie.bv_len = bulk->cookie.bv_val ? cookie.bv_len : 0;
+            more_results = bulk->cookie.bv_len > 0;
+            ber_memfree(cookie.bv_val);
+        }
+    }
+
+    ldap_controls_free(controls);
+
+    if (!more_results)
+    {
+        bulk_search_finish(bulk, RETURN_CODE_SUCCESS);
+    }
+    else if (ld_write_scheduler_get_pending(bulk->scheduler) > BULK_PAGE_SIZE)
+    {
+        bulk->page_delayed = true;
+    }
+    else if (bulk_search_send(bulk) != RETURN_CODE_SUCCESS)
+    {
+        bulk_search_finish(bulk, RETURN_CODE_FAILURE);
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief bulk_on_read This callback is called when messages of bulk search arrive.
+ * @param[in] rc            Return code of ldap_result.
+ * @param[in] message       Message received from ldap.
+ * @param[in] connection    Connection to work with.
+ * @return
+ *        - RETURN_CODE_OPERATION_IN_PROGRESS while results are being received.
+ *        - RETURN_CODE_SUCCESS when request has been completed.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode bulk_on_read(int rc, LDAPMessage *message, struct ldap_connection_ctx_t *connection)
+{
+    ld_bulk_t *bulk = connection->request_user_data;
+
+    if (!bulk)
+    {
+        ld_error("bulk_on_read - bulk operation is missing!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (rc == LDAP_RES_ANY)
+    {
+        bulk_search_finish(bulk, RETURN_CODE_FAILURE);
+        return RETURN_CODE_SUCCESS;
+    }
+
+    for (LDAPMessage *current = ldap_first_message(connection->ldap, message);
+         current != NULL;
+         current = ldap_next_message(connection->ldap, current))
+    {
+        switch (ldap_msgtype(current))
+        {
+        case LDAP_RES_SEARCH_ENTRY:
+        {
+            char *dn = ldap_get_dn(connection->ldap, current);
+            if (dn)
+            {
+                bulk_apply(bulk, dn);
+                ldap_memfree(dn);
+            }
+        }
+            break;
+        case LDAP_RES_SEARCH_REFERENCE:
+            ld_info("Received search referral but not following it!");
+            break;
+        case LDAP_RES_SEARCH_RESULT:
+            return bulk_search_result(bulk, current);
+        default:
+            break;
+        }
+    }
+
+    return RETURN_CODE_OPERATION_IN_PROGRESS;
+}
+
+/**
+ * @brief ld_bulk_apply Applies operation to every entry matching the search.
+ *
+ * Writes start while search results are still arriving. Completion callback may be called before function returns.
+ * @param[in] ctx                Talloc ctx to use.
+ * @param[in] connection         Connection to work with, should be in LDAP_CONNECTION_STATE_RUN state.
+ * @param[in] base_dn            Base of the search.
+ * @param[in] scope              Scope of the search.
+ * @param[in] filter             Filter of the search.
+ * @param[in] template           Operation to apply, it is copied.
+ * @param[in] window             Maximum amount of writes in flight, 0 for default.
+ * @param[in] dry_run            Only report matching entries, do not write anything.
+ * @param[in] progress_callback  Callback to report result of every entry to, may be NULL.
+ * @param[in] complete_callback  Callback to call on completion, may be NULL.
+ * @param[in] user_data          User data passed to callbacks.
+ * @return
+ *        - RETURN_CODE_SUCCESS if bulk operation has been started.
+ *        - RETURN_CODE_FAILURE on failure, callbacks are not called.
+ */
+enum OperationReturnCode ld_bulk_apply(TALLOC_CTX *ctx,
+                                       struct ldap_connection_ctx_t *connection,
+                                       const char *base_dn,
+                                       int scope,
+                                       const char *filter,
+                                       const ld_bulk_template_t *template,
+                                       unsigned int window,
+                                       bool dry_run,
+                                       bulk_progress_callback_fn progress_callback,
+                                       bulk_complete_callback_fn complete_callback,
+                                       void *user_data)
+{
+    ld_bulk_t *bulk = NULL;
+
+    if (!connection || !base_dn || !filter || !template
+        || (template->operation == LD_BULK_MODIFY && !template->mods)
+        || (template->operation == LD_BULK_MOVE && !template->new_superior)
+        || template->operation < LD_BULK_MODIFY || template->operation > LD_BULK_DELETE)
+    {
+        ld_error("ld_bulk_apply - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    ld_talloc_zero_e(bulk, error_exit, "ld_bulk_apply - out of memory - unable to create bulk operation!\n",
+                     NULL, ld_bulk_t);
+
+    bulk->connection = connection;
+    bulk->scope = scope;
+    bulk->paged = directory_has_capability(connection, LDAP_CAPABILITY_PAGED_RESULTS);
+    bulk->operation = template->operation;
+    bulk->dry_run = dry_run;
+    bulk->progress_callback = progress_callback;
+    bulk->complete_callback = complete_callback;
+    bulk->user_data = user_data;
+
+    ld_talloc_strdup(bulk->base_dn, error_exit, bulk, base_dn);
+    ld_talloc_strdup(bulk->filter, error_exit, bulk, filter);
+
+    if (template->new_superior)
+    {
+        ld_talloc_strdup(bulk->new_superior, error_exit, bulk, template->new_superior);
+    }
+
+    // Entries keep arriving after function returns, so template may be gone by the time they are modified.
+    if (template->operation == LD_BULK_MODIFY)
+    {
+        bulk->mods = write_scheduler_copy_mods(bulk, template->mods);
+        if (!bulk->mods)
+        {
+            ld_error("ld_bulk_apply - out of memory - unable to copy modifications!\n");
+            goto error_exit;
+        }
+    }
+
+    bulk->scheduler = ld_write_scheduler_new(ctx, connection, window, bulk_on_request, bulk_on_complete, bulk);
+    if (!bulk->scheduler)
+    {
+        goto error_exit;
+    }
+
+    // Bulk operation lives until scheduler completes.
+    talloc_steal(bulk->scheduler, bulk);
+
+    if (bulk_search_send(bulk) != RETURN_CODE_SUCCESS)
+    {
+        talloc_free(bulk->scheduler);
+        return RETURN_CODE_FAILURE;
+    }
+
+    return RETURN_CODE_SUCCESS;
+
+    error_exit:
+        talloc_free(bulk);
+        return RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief ld_bulk_get_matched Returns amount of entries matching the search so far.
+ */
+unsigned long ld_bulk_get_matched(const ld_bulk_t *bulk)
+{
+    return bulk->matched;
+}
+
+/**
+ * @brief ld_bulk_get_succeeded Returns amount of entries written successfully, in dry run mode amount of reported ones.
+ */
+unsigned long ld_bulk_get_succeeded(const ld_bulk_t *bulk)
+{
+    return bulk->succeeded;
+}
+
+/**
+ * @brief ld_bulk_get_failed Returns amount of entries which have failed.
+ */
+unsigned long ld_bulk_get_failed(const ld_bulk_t *bulk)
+{
+    return bulk->failures;
+}
@@ -0,0 +1,93 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_BULK_H
+#define LIBDOMAIN_BULK_H
+
+#include "common.h"
+#include "connection.h"
+
+#include <stdbool.h>
+
+/**
+ * Bulk operation applies the same modify, move or delete to every entry matching the search. Entries are passed
+ * to the write scheduler as search results arrive, next page of results is requested only once the backlog of
+ * writes drops to the window, so search and writes overlap and memory use stays bounded.
+ */
+
+typedef struct ld_bulk_s ld_bulk_t;
+
+enum LdapBulkOperation
+{
+    LD_BULK_MODIFY = 1,
+    LD_BULK_MOVE   = 2,
+    LD_BULK_DELETE = 3,
+};
+
+/*!
+ * @brief ld_bulk_template_t - Operation applied to every matching entry.
+ */
+typedef struct ld_bulk_template_s
+{
+    enum LdapBulkOperation operation;   //!< Operation to apply.
+    LDAPMod **mods;                     //!< Modifications of LD_BULK_MODIFY.
+    const char *new_superior;           //!< New parent of LD_BULK_MOVE, entries keep their RDN.
+} ld_bulk_template_t;
+
+/**
+ * @brief bulk_progress_callback_fn Callback fired once result of the entry is known.
+ *
+ * In dry run mode it is fired for every matching entry with RETURN_CODE_SUCCESS and nothing is written.
+ * @param[in] dn                DN of the entry.
+ * @param[in] result_code       LDAP result code of the request.
+ */
+typedef void (*bulk_progress_callback_fn)(ld_bulk_t *bulk,
+                                          const char *dn,
+                                          enum OperationReturnCode rc,
+                                          int result_code,
+                                          void *user_data);
+
+/**
+ * @brief bulk_complete_callback_fn Callback fired once search and all writes have completed.
+ *
+ * Return code is RETURN_CODE_SUCCESS only if search and all writes have succeeded.
+ * Bulk operation is released once callback returns.
+ */
+typedef void (*bulk_complete_callback_fn)(ld_bulk_t *bulk,
+                                          enum OperationReturnCode rc,
+                                          void *user_data);
+
+enum OperationReturnCode ld_bulk_apply(TALLOC_CTX *ctx,
+                                       struct ldap_connection_ctx_t *connection,
+                                       const char *base_dn,
+                                       int scope,
+                                       const char *filter,
+                                       const ld_bulk_template_t *template,
+                                       unsigned int window,
+                                       bool dry_run,
+                                       bulk_progress_callback_fn progress_callback,
+                                       bulk_complete_callback_fn complete_callback,
+                                       void *user_data);
+
+unsigned long ld_bulk_get_matched(const ld_bulk_t *bulk);
+unsigned long ld_bulk_get_succeeded(const ld_bulk_t *bulk);
+unsigned long ld_bulk_get_failed(const ld_bulk_t *bulk);
+
+#endif //LIBDOMAIN_BULK_H
@@ -0,0 +1,355 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "compare.h"
+#include "domain.h"
+
+#include "helper_p.h"
+
+#include <string.h>
+
+static char *COMPARE_NO_ATTRIBUTES[] = { LDAP_NO_ATTRS, NULL };
+
+/*!
+ * @brief compare_request_t - Compare or existence probe in flight.
+ */
+typedef struct compare_request_s
+{
+    struct ldap_connection_ctx_t *connection;   //!< Connection request has been sent through.
+    char *dn;                                   //!< DN of the entry.
+    int msgid;                                  //!< Message id of the request.
+    bool in_progress;                           //!< Request has been sent and its result has not arrived yet.
+
+    compare_callback_fn callback;               //!< Callback to call with the answer.
+    void *user_data;                            //!< User data passed to callback.
+} compare_request_t;
+
+static int compare_request_destructor(TALLOC_CTX *ctx)
+{
+    compare_request_t *request = talloc_get_type_abort(ctx, compare_request_t);
+
+    if (request->in_progress)
+    {
+        connection_cancel_read_request(request->connection, request->msgid);
+        ldap_abandon_ext(request->connection->ldap, request->msgid, NULL, NULL);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief compare_request_new Creates request for the entry.
+ * @return
+ *        - Valid pointer to request on success.
+ *        - NULL on failure.
+ */
+static compare_request_t *compare_request_new(TALLOC_CTX *ctx,
+                                              struct ldap_connection_ctx_t *connection,
+                                              const char *dn,
+                                              compare_callback_fn callback,
+                                              void *user_data)
+{
+    compare_request_t *request = NULL;
+
+    ld_talloc_zero_e(request, error_exit, "compare_request_new - out of memory - unable to create request!\n",
+                     ctx, compare_request_t);
+
+    talloc_set_destructor((void*)request, compare_request_destructor);
+
+    ld_talloc_strdup(request->dn, error_exit, request, dn);
+    request->connection = connection;
+    request->msgid = -1;
+    request->callback = callback;
+    request->user_data = user_data;
+
+    return request;
+
+    error_exit:
+        talloc_free(request);
+        return NULL;
+}
+
+/**
+ * @brief compare_request_finish Passes the answer to callback and frees request.
+ */
+static void compare_request_finish(compare_request_t *request, bool result, enum OperationReturnCode rc)
+{
+    request->in_progress = false;
+
+    if (request->callback)
+    {
+        request->callback(request->dn, result, rc, request->user_data);
+    }
+
+    talloc_free(request);
+}
+
+/**
+ * @brief compare_request_register Registers sent request with connection.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode compare_request_register(compare_request_t *request,
+                                                         int msgid,
+                                                         operation_callback_fn on_read_operation)
+{
+    struct ldap_connection_ctx_t *connection = request->connection;
+
+    if (connection_add_read_request(connection, msgid, on_read_operation, request) != RETURN_CODE_SUCCESS)
+    {
+        ldap_abandon_ext(connection->ldap, msgid, NULL, NULL);
+        return RETURN_CODE_FAILURE;
+    }
+
+    request->msgid = msgid;
+    request->in_progress = true;
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief compare_on_read This callback is called when result of compare arrives.
+ * @param[in] rc                 Return code of ldap_result.
+ * @param[in] message            Message received from ldap.
+ * @param[in] connection         Connection to work with.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode compare_on_read(int rc, LDAPMessage *message, struct ldap_connection_ctx_t *connection)
+{
+    compare_request_t *request = connection->request_user_data;
+    int error_code = LDAP_OTHER;
+    char *diagnostic_message = NULL;
+
+    if (!request)
+    {
+        ld_error("compare_on_read - request is missing!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (rc == LDAP_RES_COMPARE)
+    {
+        ldap_parse_result(connection->ldap, message, &error_code, NULL, &diagnostic_message, NULL, NULL, false);
+    }
+
+    switch (error_code)
+    {
+    case LDAP_COMPARE_TRUE:
+        ldap_memfree(diagnostic_message);
+        compare_request_finish(request, true, RETURN_CODE_SUCCESS);
+        return RETURN_CODE_SUCCESS;
+
+    // Entry without any value of the attribute does not have the value either.
+    case LDAP_COMPARE_FALSE:
+    case LDAP_NO_SUCH_ATTRIBUTE:
+        ldap_memfree(diagnostic_message);
+        compare_request_finish(request, false, RETURN_CODE_SUCCESS);
+        return RETURN_CODE_SUCCESS;
+
+    default:
+        ld_error("Compare of %s has failed: %s %s\n", request->dn, ldap_err2string(error_code),
+                 diagnostic_message ? diagnostic_message : "");
+        ldap_memfree(diagnostic_message);
+        compare_request_finish(request, false, RETURN_CODE_FAILURE);
+        return RETURN_CODE_FAILURE;
+    }
+}
+
+/**
+ * @brief exists_on_read This callback is called when result of existence probe arrives.
+ * @param[in] rc                 Return code of ldap_result.
+ * @param[in] message            Message received from ldap.
+ * @param[in] connection         Connection to work with.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode exists_on_read(int rc, LDAPMessage *message, struct ldap_connection_ctx_t *connection)
+{
+    compare_request_t *request = connection->request_user_data;
+    int error_code = LDAP_OTHER;
+    char *diagnostic_message = NULL;
+    bool found = false;
+
+    (void)(rc);
+
+    if (!request)
+    {
+        ld_error("exists_on_read - request is missing!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    for (LDAPMessage *current = ldap_first_message(connection->ldap, message);
+         current != NULL;
+         current = ldap_next_message(connection->ldap, current))
+    {
+        switch (ldap_msgtype(current))
+        {
+        case LDAP_RES_SEARCH_ENTRY:
+            found = true;
+            break;
+
+        case LDAP_RES_SEARCH_RESULT:
+            ldap_parse_result(connection->ldap, current, &error_code, NULL, &diagnostic_message, NULL, NULL, false);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    switch (error_code)
+    {
+    case LDAP_SUCCESS:
+    case LDAP_NO_SUCH_OBJECT:
+        ldap_memfree(diagnostic_message);
+        compare_request_finish(request, found && error_code == LDAP_SUCCESS, RETURN_CODE_SUCCESS);
+        return RETURN_CODE_SUCCESS;
+
+    default:
+        ld_error("Existence probe of %s has failed: %s %s\n", request->dn, ldap_err2string(error_code),
+                 diagnostic_message ? diagnostic_message : "");
+        ldap_memfree(diagnostic_message);
+        compare_request_finish(request, false, RETURN_CODE_FAILURE);
+        return RETURN_CODE_FAILURE;
+    }
+}
+
+/**
+ * @brief ld_compare Checks whether entry has the value of the attribute.
+ *
+ * Value is matched by the server with equality matching rule of the attribute. Entry without the attribute
+ * is reported as not having the value, missing entry is a failure.
+ * @param[in] ctx                  Talloc ctx the request is allocated on, freeing it cancels the request.
+ * @param[in] connection           Connection to work with, should be in LDAP_CONNECTION_STATE_RUN state.
+ * @param[in] dn                   DN of the entry.
+ * @param[in] attribute            Attribute to compare, e.g. member.
+ * @param[in] value                Value to look for.
+ * @param[in] callback             Callback to call with the answer.
+ * @param[in] user_data            User data passed to callback.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_compare(TALLOC_CTX *ctx,
+                                    struct ldap_connection_ctx_t *connection,
+                                    const char *dn,
+                                    const char *attribute,
+                                    const char *value,
+                                    compare_callback_fn callback,
+                                    void *user_data)
+{
+    if (!connection || !dn || !attribute || !value || !callback)
+    {
+        ld_error("ld_compare - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    compare_request_t *request = compare_request_new(ctx, connection, dn, callback, user_data);
+    if (!request)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    struct berval assertion = { strlen(value), (char*)value };
+    int msgid = 0;
+
+    int rc = ldap_compare_ext(connection->ldap, dn, attribute, &assertion, NULL, NULL, &msgid);
+    if (rc != LDAP_SUCCESS)
+    {
+        ld_error("Unable to create compare request: %s\n", ldap_err2string(rc));
+        goto error_exit;
+    }
+
+    if (compare_request_register(request, msgid, compare_on_read) != RETURN_CODE_SUCCESS)
+    {
+        goto error_exit;
+    }
+
+    return RETURN_CODE_SUCCESS;
+
+    error_exit:
+        talloc_free(request);
+        return RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief ld_entry_exists Checks whether entry exists.
+ *
+ * Base search requests no attributes, so the server answers with the DN only.
+ * @param[in] ctx                  Talloc ctx the request is allocated on, freeing it cancels the request.
+ * @param[in] connection           Connection to work with, should be in LDAP_CONNECTION_STATE_RUN state.
+ * @param[in] dn                   DN of the entry.
+ * @param[in] callback             Callback to call with the answer.
+ * @param[in] user_data            User data passed to callback.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_entry_exists(TALLOC_CTX *ctx,
+                                         struct ldap_connection_ctx_t *connection,
+                                         const char *dn,
+                                         compare_callback_fn callback,
+                                         void *user_data)
+{
+    if (!connection || !dn || !callback)
+    {
+        ld_error("ld_entry_exists - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    compare_request_t *request = compare_request_new(ctx, connection, dn, callback, user_data);
+    if (!request)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    int msgid = 0;
+
+    int rc = ldap_search_ext(connection->ldap,
+                             dn,
+                             LDAP_SCOPE_BASE,
+                             "(objectClass=*)",
+                             COMPARE_NO_ATTRIBUTES,
+                             0,
+                             NULL,
+                             NULL,
+                             NULL,
+                             1,
+                             &msgid);
+    if (rc != LDAP_SUCCESS)
+    {
+        ld_error("Unable to create existence probe: %s\n", ldap_err2string(rc));
+        goto error_exit;
+    }
+
+    if (compare_request_register(request, msgid, exists_on_read) != RETURN_CODE_SUCCESS)
+    {
+        goto error_exit;
+    }
+
+    return RETURN_CODE_SUCCESS;
+
+    error_exit:
+        talloc_free(request);
+        return RETURN_CODE_FAILURE;
+}
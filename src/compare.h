@@ -0,0 +1,56 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+#ifndef LIBDOMAIN_COMPARE_H
+#define LIBDOMAIN_COMPARE_H
+
+#include "common.h"
+#include "connection.h"
+
+#include <stdbool.h>
+
+/**
+ * Compare and existence probe answer yes or no questions about a single entry with one small request each.
+ * Entries are never constructed, callback receives the answer only.
+ */
+
+/**
+ * @brief compare_callback_fn Callback fired once the answer has arrived.
+ *
+ * Result is meaningful only if return code is RETURN_CODE_SUCCESS.
+ * @param[in] dn                DN of the entry as it has been passed.
+ * @param[in] result            Entry has the value, or entry exists for existence probe.
+ */
+typedef void (*compare_callback_fn)(const char *dn, bool result, enum OperationReturnCode rc, void *user_data);
+
+enum OperationReturnCode ld_compare(TALLOC_CTX *ctx,
+                                    struct ldap_connection_ctx_t *connection,
+                                    const char *dn,
+                                    const char *attribute,
+                                    const char *value,
+                                    compare_callback_fn callback,
+                                    void *user_data);
+
+enum OperationReturnCode ld_entry_exists(TALLOC_CTX *ctx,
+                                         struct ldap_connection_ctx_t *connection,
+                                         const char *dn,
+                                         compare_callback_fn callback,
+                                         void *user_data);
+
+#endif //LIBDOMAIN_COMPARE_H
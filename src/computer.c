@@ -71,6 +71,39 @@ enum OperationReturnCode ld_add_computer(LDHandle *handle,
     return rc;
 }
 
+/**
+ * @brief ld_add_computers Creates computers.
+ *
+ * Requests are pipelined, callback may be called before function returns.
+ * @param[in] handle      Pointer to libdomain session handle.
+ * @param[in] computers   Computers to create.
+ * @param[in] n_computers Amount of computers.
+ * @param[in] defaults    Attributes shared by all computers, may be NULL.
+ * @param[in] parent      Container of the computers, NULL for base DN.
+ * @param[in] callback    Callback to report results of computers to.
+ * @param[in] user_data   User data passed to callback.
+ * @return
+ *        - RETURN_CODE_SUCCESS if creation has been started.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_add_computers(LDHandle *handle,
+                                          const ld_batch_item_t *computers,
+                                          int n_computers,
+                                          LDAPAttribute_t **defaults,
+                                          const char *parent,
+                                          batch_complete_callback_fn callback,
+                                          void *user_data)
+{
+    const char *dn = handle ? handle->global_config->base_dn : NULL;
+
+    if (parent && strlen(parent) > 0)
+    {
+        dn = parent;
+    }
+
+    return ld_batch_add_entries(handle, computers, n_computers, defaults, dn, "cn", 0, callback, user_data);
+}
+
 /**
  * @brief ld_del_computer Deletes computer
  * @param[in] handle      Pointer to libdomain session handle.
@@ -21,10 +21,18 @@
 #ifndef LIB_DOMAIN_COMPUTER_H
 #define LIB_DOMAIN_COMPUTER_H
 
+#include "batch.h"
 #include "common.h"
 #include "domain.h"
 
 enum OperationReturnCode ld_add_computer(LDHandle *handle, const char *name, LDAPAttribute_t **attrs, const char *parent);
+enum OperationReturnCode ld_add_computers(LDHandle *handle,
+                                          const ld_batch_item_t *computers,
+                                          int n_computers,
+                                          LDAPAttribute_t **defaults,
+                                          const char *parent,
+                                          batch_complete_callback_fn callback,
+                                          void *user_data);
 enum OperationReturnCode ld_del_computer(LDHandle *handle, const char *name, const char *parent);
 enum OperationReturnCode ld_mod_computer(LDHandle *handle, const char *name, const char *parent, LDAPAttribute_t **computer_attrs);
 enum OperationReturnCode ld_rename_computer(LDHandle *handle, const char *old_name, const char *new_name, const char *parent);
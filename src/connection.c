@@ -108,6 +108,8 @@ static void ldap_requests_init(struct ldap_request_t* requests, int size)
         requests[i].msgid = -1;
         requests[i].on_read_operation = NULL;
         requests[i].on_write_operation = NULL;
+        requests[i].user_data = NULL;
+        requests[i].stream = false;
         memset(&requests[i].node, 0, sizeof(struct Queue_Node_s));
     }
 }
@@ -284,6 +286,8 @@ enum OperationReturnCode connection_configure(struct ldap_global_context_t *glob
 
     connection->directory_type = LDAP_TYPE_UNINITIALIZED;
 
+    ld_talloc_zero_e(connection->rootdse, error_exit, "Error - out of memory - unable to allocate memory for ld_rootdse_t", global_ctx->talloc_ctx, ld_rootdse_t);
+
     connection->schema = ldap_schema_new(global_ctx->talloc_ctx);
 
     connection->callqueue = request_queue_new(global_ctx->talloc_ctx, MAX_REQUESTS);
@@ -592,6 +596,25 @@ void connection_optional_transition_on_error(struct ldap_connection_ctx_t* conne
     }
 }
 
+/**
+ * @brief connection_fail_request Calls callback of the request with LDAP_RES_ANY, result of the request will never
+ * arrive.
+ * @param[in] connection          Connection request has been sent through.
+ * @param[in] request             Request to fail.
+ */
+static void connection_fail_request(struct ldap_connection_ctx_t *connection, struct ldap_request_t *request)
+{
+    if (!request->on_read_operation)
+    {
+        return;
+    }
+
+    connection->msgid = request->msgid;
+    connection->request_user_data = request->user_data;
+    request->on_read_operation(LDAP_RES_ANY, NULL, connection);
+    connection->request_user_data = NULL;
+}
+
 /**
  * @brief connection_on_read This callback is performed on read operation.
  * @param ctx [in] event context
@@ -613,25 +636,45 @@ void connection_on_read(verto_ctx *ctx, verto_ev *ev)
     struct ldap_request_t pending_requests[MAX_REQUESTS];
     int n_pending_requests = 0;
 
+    // Lets connection_cancel_read_request reach requests deferred during this pass.
+    connection->deferred_requests = pending_requests;
+    connection->n_deferred_requests = &n_pending_requests;
+
     while (!request_queue_empty(connection->callqueue) && (top = request_queue_pop(connection->callqueue)) != NULL)
     {
         struct ldap_request_t* request = container_of(top, struct ldap_request_t, node);
 
+        if (request->msgid < 0)
+        {
+            // Request has been cancelled with connection_cancel_read_request.
+            continue;
+        }
+
         ld_info("Processing message #%d\n", request->msgid);
 
-        rc = ldap_result(connection->ldap, request->msgid, LDAP_MSG_ALL, &timeout, &result_message);
+        rc = ldap_result(connection->ldap, request->msgid, request->stream ? LDAP_MSG_RECEIVED : LDAP_MSG_ALL,
+                         &timeout, &result_message);
         switch (rc)
         {
         case LDAP_RES_ANY:
-            get_ldap_option(connection->ldap, LDAP_OPT_RESULT_CODE, (void*)&error_code);
-            get_ldap_option(connection->ldap, LDAP_OPT_DIAGNOSTIC_MESSAGE, (void*)&diagnostic_message);
+            // Remaining requests still have to be processed, so failure to read options does not abort the pass.
+            ldap_get_option(connection->ldap, LDAP_OPT_RESULT_CODE, (void*)&error_code);
+            ldap_get_option(connection->ldap, LDAP_OPT_DIAGNOSTIC_MESSAGE, (void*)&diagnostic_message);
             ld_error("Error - ldap_result failed - code: %d %s %s\n", error_code, ldap_err2string(error_code), diagnostic_message);
             ldap_memfree(diagnostic_message);
+            diagnostic_message = NULL;
             ldap_msgfree(result_message);
+
+            // Request is dropped, callback has to learn that result will never arrive.
+            connection_fail_request(connection, request);
+
             connection_optional_transition_on_error(connection);
             break;
         case LDAP_RES_UNSOLICITED:
-            ld_warning("Warning - Pending message with id %d!\n", request->msgid);
+            if (!request->stream)
+            {
+                ld_warning("Warning - Pending message with id %d!\n", request->msgid);
+            }
             ldap_msgfree(result_message);
 
             pending_requests[n_pending_requests] = *request;
@@ -640,13 +683,26 @@ void connection_on_read(verto_ctx *ctx, verto_ev *ev)
             break;
         default:
             connection->msgid = request->msgid;
+            connection->request_user_data = request->user_data;
             error_code = request->on_read_operation ? request->on_read_operation(rc, result_message, connection)
                                                     : RETURN_CODE_FAILURE;
             ldap_msgfree(result_message);
+            connection->request_user_data = NULL;
+
+            if (request->stream && error_code == RETURN_CODE_OPERATION_IN_PROGRESS)
+            {
+                pending_requests[n_pending_requests] = *request;
+                ++n_pending_requests;
+            }
             break;
         };
     }
 
+    connection->deferred_requests = NULL;
+    connection->n_deferred_requests = NULL;
+
+    int n_used_requests = connection->n_read_requests;
+
     connection->n_read_requests = 0;
 
     if (n_pending_requests > 0)
@@ -659,8 +715,160 @@ void connection_on_read(verto_ctx *ctx, verto_ev *ev)
         connection->n_read_requests = n_pending_requests;
     }
 
-    error_exit:
-        return;
+    // Slots are reused by requests that do not set these fields.
+    for (int i = n_pending_requests; i < n_used_requests; ++i)
+    {
+        connection->read_requests[i].user_data = NULL;
+        connection->read_requests[i].stream = false;
+    }
+}
+
+/**
+ * @brief connection_add_request Registers request which result will be handled by connection_on_read.
+ * @param[in] connection         Connection to work with.
+ * @param[in] msgid              Message id of the request.
+ * @param[in] on_read_operation  Callback to call once result of the request arrives.
+ * @param[in] user_data          Data available to callback through connection->request_user_data.
+ * @param[in] stream             Deliver messages as they arrive instead of waiting for the whole result.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode connection_add_request(struct ldap_connection_ctx_t *connection,
+                                                       int msgid,
+                                                       operation_callback_fn on_read_operation,
+                                                       void *user_data,
+                                                       bool stream)
+{
+    if (connection->n_read_requests + 1 >= MAX_REQUESTS)
+    {
+        ld_error("Maximum amount of read requests exceeded for connection %p.\n", (void*)connection);
+
+        return RETURN_CODE_FAILURE;
+    }
+
+    struct ldap_request_t* request = &connection->read_requests[connection->n_read_requests];
+    request->msgid = msgid;
+    request->on_read_operation = on_read_operation;
+    request->user_data = user_data;
+    request->stream = stream;
+    ++connection->n_read_requests;
+
+    return request_queue_push(connection->callqueue, &request->node) == OPERATION_SUCCESS
+            ? RETURN_CODE_SUCCESS
+            : RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief connection_add_read_request Registers request which result will be handled by connection_on_read.
+ * @param[in] connection              Connection to work with.
+ * @param[in] msgid                   Message id of the request.
+ * @param[in] on_read_operation       Callback to call once result of the request arrives.
+ * @param[in] user_data               Data available to callback through connection->request_user_data.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode connection_add_read_request(struct ldap_connection_ctx_t *connection,
+                                                     int msgid,
+                                                     operation_callback_fn on_read_operation,
+                                                     void *user_data)
+{
+    return connection_add_request(connection, msgid, on_read_operation, user_data, false);
+}
+
+/**
+ * @brief connection_add_stream_request Registers request which messages are passed to callback as they arrive.
+ *
+ * Callback receives every portion of received messages and should return RETURN_CODE_OPERATION_IN_PROGRESS
+ * to keep receiving messages, any other return code removes request from connection.
+ * @param[in] connection                Connection to work with.
+ * @param[in] msgid                     Message id of the request.
+ * @param[in] on_read_operation         Callback to call once messages of the request arrive.
+ * @param[in] user_data                 Data available to callback through connection->request_user_data.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode connection_add_stream_request(struct ldap_connection_ctx_t *connection,
+                                                       int msgid,
+                                                       operation_callback_fn on_read_operation,
+                                                       void *user_data)
+{
+    return connection_add_request(connection, msgid, on_read_operation, user_data, true);
+}
+
+/**
+ * @brief connection_cancel_read_request Removes request from connection, callback of the request will not be called.
+ * @param[in] connection                 Connection to work with.
+ * @param[in] msgid                      Message id of the request.
+ */
+void connection_cancel_read_request(struct ldap_connection_ctx_t *connection, int msgid)
+{
+    for (int i = 0; i < connection->n_read_requests; ++i)
+    {
+        if (connection->read_requests[i].msgid == msgid)
+        {
+            connection->read_requests[i].msgid = -1;
+            connection->read_requests[i].user_data = NULL;
+        }
+    }
+
+    for (int i = 0; connection->deferred_requests && i < *connection->n_deferred_requests; ++i)
+    {
+        if (connection->deferred_requests[i].msgid == msgid)
+        {
+            connection->deferred_requests[i].msgid = -1;
+            connection->deferred_requests[i].user_data = NULL;
+        }
+    }
+}
+
+/**
+ * @brief connection_fail_read_requests Completes every pending request of the connection with LDAP_RES_ANY.
+ *
+ * Called when connection is lost, results of pending requests will never arrive. Requests sent by callbacks
+ * are failed as well.
+ * @param[in] connection                Connection to work with.
+ */
+void connection_fail_read_requests(struct ldap_connection_ctx_t *connection)
+{
+    struct ldap_request_t failed_requests[MAX_REQUESTS];
+    int n_failed_requests = 0;
+    struct Queue_Node_s* top = NULL;
+
+    while (connection->callqueue && !request_queue_empty(connection->callqueue))
+    {
+        n_failed_requests = 0;
+
+        while ((top = request_queue_pop(connection->callqueue)) != NULL)
+        {
+            failed_requests[n_failed_requests] = *container_of(top, struct ldap_request_t, node);
+            ++n_failed_requests;
+        }
+
+        for (int i = 0; i < connection->n_read_requests; ++i)
+        {
+            connection->read_requests[i].user_data = NULL;
+            connection->read_requests[i].stream = false;
+        }
+        connection->n_read_requests = 0;
+
+        // Lets connection_cancel_read_request reach requests which have not been failed yet.
+        connection->deferred_requests = failed_requests;
+        connection->n_deferred_requests = &n_failed_requests;
+
+        for (int i = 0; i < n_failed_requests; ++i)
+        {
+            if (failed_requests[i].msgid >= 0)
+            {
+                connection_fail_request(connection, &failed_requests[i]);
+            }
+        }
+
+        connection->deferred_requests = NULL;
+        connection->n_deferred_requests = NULL;
+    }
 }
 
 /**
@@ -720,6 +928,10 @@ enum OperationReturnCode connection_close(struct ldap_connection_ctx_t *connecti
     
     ld_talloc_free(connection->ldap_defaults, error_exit);
 
+    // Root DSE is read again once connection is configured for reconnect.
+    talloc_free(connection->rootdse);
+    connection->rootdse = NULL;
+
     return RETURN_CODE_SUCCESS;
 
     error_exit:
@@ -38,6 +38,16 @@ enum BindType
 
 typedef struct ldap_schema_t ldap_schema_t;
 
+typedef struct ld_rootdse_s ld_rootdse_t;
+
+typedef struct ld_subscription_s ld_subscription_t;
+
+typedef struct ld_sync_s ld_sync_t;
+
+typedef struct ld_entry_cache_s ld_entry_cache_t;
+
+typedef struct ld_membership_cache_s ld_membership_cache_t;
+
 typedef struct ldap_sasl_options_t
 {
     char *mechanism;                   //!< Sasl mechanism to use.
@@ -121,6 +131,10 @@ typedef struct ldap_request_t
     operation_callback_fn on_read_operation;  //!<
     operation_callback_fn on_write_operation; //!<
 
+    void *user_data;                          //!< Data passed to callback through ldap_connection_ctx_t::request_user_data.
+    bool stream;                              //!< Deliver messages as they arrive, request stays queued while callback
+                                              //!< returns RETURN_CODE_OPERATION_IN_PROGRESS.
+
     struct Queue_Node_s node;                 //!<
 } ldap_request_t;
 
@@ -147,9 +161,20 @@ typedef struct ldap_connection_ctx_t
     int bind_type;                                              //!<
     int directory_type;                                         //!<
     int msgid;                                                  //!<
+    void *request_user_data;                                    //!< User data of the request being processed by on_read_operation.
 
     ldap_schema_t* schema;
 
+    ld_rootdse_t *rootdse;                                      //!< Root DSE of the directory, reset on every connection_configure.
+
+    ld_subscription_t *subscriptions;                           //!< Change subscriptions, survive reconnects.
+
+    ld_sync_t *syncs;                                           //!< Running synchronization cycles, failed when connection is lost.
+
+    ld_entry_cache_t *entry_cache;                              //!< Entry cache invalidated by write operations.
+
+    ld_membership_cache_t *membership_cache;                    //!< Group sets invalidated by write operations.
+
     const char *rmech;                                          //!<
 
     struct request_queue* callqueue;                            //!<
@@ -162,6 +187,9 @@ typedef struct ldap_connection_ctx_t
     int n_read_requests;                                        //!<
     int n_write_requests;                                       //!<
 
+    struct ldap_request_t *deferred_requests;                   //!< Requests deferred by connection_on_read in progress.
+    int *n_deferred_requests;                                   //!< Amount of deferred requests.
+
     int n_search_requests;                                      //!<
 
     int n_reconnect_attempts;                                   //!<
@@ -181,6 +209,16 @@ enum OperationReturnCode connection_start_tls(struct ldap_connection_ctx_t *conn
 enum OperationReturnCode connection_sasl_bind(struct ldap_connection_ctx_t *connection);
 enum OperationReturnCode connection_ldap_bind(struct ldap_connection_ctx_t *connection);
 enum OperationReturnCode connection_close(struct ldap_connection_ctx_t *connection);
+enum OperationReturnCode connection_add_read_request(struct ldap_connection_ctx_t *connection,
+                                                     int msgid,
+                                                     operation_callback_fn on_read_operation,
+                                                     void *user_data);
+enum OperationReturnCode connection_add_stream_request(struct ldap_connection_ctx_t *connection,
+                                                       int msgid,
+                                                       operation_callback_fn on_read_operation,
+                                                       void *user_data);
+void connection_cancel_read_request(struct ldap_connection_ctx_t *connection, int msgid);
+void connection_fail_read_requests(struct ldap_connection_ctx_t *connection);
 
 // Operation handlers.
 void connection_on_read(verto_ctx *ctx, verto_ev *ev);
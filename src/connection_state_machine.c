@@ -20,9 +20,11 @@
 
 #include "connection_state_machine.h"
 #include "directory.h"
+#include "directory_sync.h"
 #include "domain.h"
 #include "domain_p.h"
 #include "schema.h"
+#include "subscription.h"
 
 #define number_of_elements(x)  (sizeof(x) / sizeof((x)[0]))
 
@@ -182,9 +184,13 @@ enum OperationReturnCode csm_next_state(struct state_machine_ctx_t *ctx)
     case LDAP_CONNECTION_STATE_RUN:
         // TODO: Await signals to either close or transition to error state.
         ctx->ctx->n_reconnect_attempts = 0;
+        subscription_restore_all(ctx->ctx);
         break;
 
     case LDAP_CONNECTION_STATE_ERROR:
+        subscription_suspend_all(ctx->ctx);
+        sync_abort_all(ctx->ctx);
+        connection_fail_read_requests(ctx->ctx);
         connection_close(ctx->ctx);
 
         if (ctx->ctx->n_reconnect_attempts < MAX_RECONNECT_ATTEMPTS)
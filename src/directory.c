@@ -21,7 +21,45 @@
 #include "directory.h"
 #include "entry.h"
 
-static char* LDAP_DIRECTORY_ATTRS[] = { "*", NULL };
+#include "helper_p.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <strings.h>
+
+static char* LDAP_DIRECTORY_ATTRS[] = { LDAP_ALL_USER_ATTRIBUTES, LDAP_ALL_OPERATIONAL_ATTRIBUTES, NULL };
+
+static const char* ACTIVE_DIRECTORY_CAPABILITY_OID = "1.2.840.113556.1.4.800";
+
+typedef struct capability_oid_t
+{
+    const char *oid;          //!< OID advertised by the server.
+    unsigned int capability;  //!< Corresponding LdapDirectoryCapability bit.
+} capability_oid_t;
+
+static const capability_oid_t capability_oids[] =
+{
+    { "1.2.840.113556.1.4.319",     LDAP_CAPABILITY_PAGED_RESULTS },
+    { "1.2.840.113556.1.4.473",     LDAP_CAPABILITY_SERVER_SIDE_SORT },
+    { "2.16.840.1.113730.3.4.9",    LDAP_CAPABILITY_VLV },
+    { "1.2.840.113556.1.4.1504",    LDAP_CAPABILITY_ASQ },
+    { "1.2.840.113556.1.4.805",     LDAP_CAPABILITY_TREE_DELETE },
+    { "1.3.6.1.4.1.4203.1.9.1.1",   LDAP_CAPABILITY_CONTENT_SYNC },
+    { "1.2.840.113556.1.4.841",     LDAP_CAPABILITY_DIRSYNC },
+    { "2.16.840.1.113730.3.4.3",    LDAP_CAPABILITY_PERSISTENT_SEARCH },
+    { "1.2.840.113556.1.4.528",     LDAP_CAPABILITY_CHANGE_NOTIFICATION },
+    { "1.2.840.113556.1.4.1781",    LDAP_CAPABILITY_FAST_BIND },
+    { "1.2.840.113556.1.4.417",     LDAP_CAPABILITY_SHOW_DELETED },
+    { "1.2.840.113556.1.4.1413",    LDAP_CAPABILITY_PERMISSIVE_MODIFY },
+    { "1.3.6.1.4.1.4203.1.11.3",    LDAP_CAPABILITY_WHOAMI },
+    { "1.3.6.1.4.1.1466.20037",     LDAP_CAPABILITY_START_TLS },
+    { "2.16.840.1.113730.3.4.2",    LDAP_CAPABILITY_MANAGE_DSA_IT },
+    { "1.2.840.113556.1.4.802",     LDAP_CAPABILITY_RANGE_RETRIEVAL },
+    { "1.3.6.1.1.12",               LDAP_CAPABILITY_ASSERTION },
+    { "1.2.840.113556.1.4.1941",    LDAP_CAPABILITY_MATCHING_RULE_IN_CHAIN },
+};
+
+#define number_of_elements(x)  (sizeof(x) / sizeof((x)[0]))
 
 /**
  * @brief directory_get_type Request LDAP type from service.
@@ -57,40 +95,247 @@ enum OperationReturnCode directory_get_type(struct ldap_connection_ctx_t *connec
     request_queue_push(connection->callqueue, &request->node);
 
     return RETURN_CODE_SUCCESS;
+}
 
+/**
+ * @brief directory_copy_values Copies attribute values into NULL terminated array of strings.
+ * @param[in] talloc_ctx         Talloc context to allocate array with.
+ * @param[in] values             Values received from LDAP.
+ * @return
+ *        - NULL terminated array of values on success.
+ *        - NULL on failure.
+ */
+static char **directory_copy_values(TALLOC_CTX *talloc_ctx, struct berval **values)
+{
+    char **result = NULL;
+    int count = ldap_count_values_len(values);
 
-    return RETURN_CODE_FAILURE;
+    ld_talloc_zero_array(result, error_exit, talloc_ctx, char*, count + 1);
+
+    for (int i = 0; i < count; ++i)
+    {
+        ld_talloc_strndup(result[i], error_exit, result, values[i]->bv_val, values[i]->bv_len);
+    }
+
+    return result;
+
+error_exit:
+    talloc_free(result);
+    return NULL;
 }
 
 /**
- * @brief directory_process_attribute
- * @param[in] attribute_name
- * @param[in] connection
+ * @brief directory_contains_value Checks whether NULL terminated array contains value, ignoring case.
+ * @param[in] values                Array to search in.
+ * @param[in] value                 Value to search for.
  * @return
- *        - true if directory type is recognized.
- *        - false if we have not detected directory type yet.
+ *        - true if value is present.
+ *        - false otherwise.
+ */
+static bool directory_contains_value(char **values, const char *value)
+{
+    if (!values || !value)
+    {
+        return false;
+    }
+
+    for (char **current = values; *current != NULL; ++current)
+    {
+        if (strcasecmp(*current, value) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief directory_update_capabilities Translates advertised OIDs into capability bit mask.
+ * @param[in] rootdse                   Root DSE to update.
+ */
+static void directory_update_capabilities(ld_rootdse_t *rootdse)
+{
+    rootdse->capabilities = LDAP_CAPABILITY_NONE;
+
+    for (size_t i = 0; i < number_of_elements(capability_oids); ++i)
+    {
+        if (directory_contains_value(rootdse->supported_controls, capability_oids[i].oid)
+         || directory_contains_value(rootdse->supported_extensions, capability_oids[i].oid)
+         || directory_contains_value(rootdse->supported_features, capability_oids[i].oid)
+         || directory_contains_value(rootdse->supported_capabilities, capability_oids[i].oid))
+        {
+            rootdse->capabilities |= capability_oids[i].capability;
+        }
+    }
+
+    if (directory_contains_value(rootdse->supported_capabilities, ACTIVE_DIRECTORY_CAPABILITY_OID))
+    {
+        // Active Directory supports range retrieval and in-chain matching rule without advertising them as controls.
+        rootdse->capabilities |= LDAP_CAPABILITY_RANGE_RETRIEVAL | LDAP_CAPABILITY_MATCHING_RULE_IN_CHAIN;
+    }
+}
+
+/**
+ * @brief directory_process_attribute Stores root DSE attribute in typed record.
+ * @param[in] attribute_name          Name of the attribute.
+ * @param[in] values                  Values of the attribute.
+ * @param[in] rootdse                 Root DSE to fill.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode directory_process_attribute(const char* attribute_name,
+                                                            struct berval **values,
+                                                            ld_rootdse_t *rootdse)
+{
+    static const struct
+    {
+        const char *name;
+        size_t offset;
+    } multi_valued[] =
+    {
+        { "supportedControl",         offsetof(ld_rootdse_t, supported_controls) },
+        { "supportedExtension",       offsetof(ld_rootdse_t, supported_extensions) },
+        { "supportedFeatures",        offsetof(ld_rootdse_t, supported_features) },
+        { "supportedCapabilities",    offsetof(ld_rootdse_t, supported_capabilities) },
+        { "supportedSASLMechanisms",  offsetof(ld_rootdse_t, supported_sasl_mechanisms) },
+        { "supportedLDAPVersion",     offsetof(ld_rootdse_t, supported_ldap_versions) },
+        { "namingContexts",           offsetof(ld_rootdse_t, naming_contexts) },
+    };
+
+    static const struct
+    {
+        const char *name;
+        size_t offset;
+    } single_valued[] =
+    {
+        { "defaultNamingContext",       offsetof(ld_rootdse_t, default_naming_context) },
+        { "schemaNamingContext",        offsetof(ld_rootdse_t, schema_naming_context) },
+        { "configurationNamingContext", offsetof(ld_rootdse_t, configuration_naming_context) },
+        { "rootDomainNamingContext",    offsetof(ld_rootdse_t, root_domain_naming_context) },
+        { "subschemaSubentry",          offsetof(ld_rootdse_t, subschema_subentry) },
+        { "dnsHostName",                offsetof(ld_rootdse_t, dns_host_name) },
+        { "vendorName",                 offsetof(ld_rootdse_t, vendor_name) },
+        { "vendorVersion",              offsetof(ld_rootdse_t, vendor_version) },
+    };
+
+    if (!values || !values[0])
+    {
+        return RETURN_CODE_SUCCESS;
+    }
+
+    for (size_t i = 0; i < number_of_elements(multi_valued); ++i)
+    {
+        if (strcasecmp(attribute_name, multi_valued[i].name) == 0)
+        {
+            char ***field = (char ***)((char *)rootdse + multi_valued[i].offset);
+            talloc_free(*field);
+            *field = directory_copy_values(rootdse, values);
+            return *field ? RETURN_CODE_SUCCESS : RETURN_CODE_FAILURE;
+        }
+    }
+
+    for (size_t i = 0; i < number_of_elements(single_valued); ++i)
+    {
+        if (strcasecmp(attribute_name, single_valued[i].name) == 0)
+        {
+            char **field = (char **)((char *)rootdse + single_valued[i].offset);
+            talloc_free(*field);
+            *field = talloc_strndup(rootdse, values[0]->bv_val, values[0]->bv_len);
+            return *field ? RETURN_CODE_SUCCESS : RETURN_CODE_FAILURE;
+        }
+    }
+
+    if (strcasecmp(attribute_name, "highestCommittedUSN") == 0)
+    {
+        char *value = talloc_strndup(rootdse, values[0]->bv_val, values[0]->bv_len);
+        if (!value)
+        {
+            return RETURN_CODE_FAILURE;
+        }
+        rootdse->highest_committed_usn = strtoull(value, NULL, 10);
+        talloc_free(value);
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief directory_detect_type Detects directory type from attributes present in root DSE.
+ * @param[in] message           Root DSE entry.
+ * @param[in] connection        Connection to work with.
  */
-bool directory_process_attribute(const char* attribute_name, struct ldap_connection_ctx_t *connection)
+static void directory_detect_type(LDAPMessage *message, struct ldap_connection_ctx_t *connection)
 {
-    if (strcmp(attribute_name, "isGlobalCatalogReady") == 0)
+    struct berval **values = ldap_get_values_len(connection->ldap, message, "isGlobalCatalogReady");
+
+    if (values || directory_contains_value(connection->rootdse->supported_capabilities, ACTIVE_DIRECTORY_CAPABILITY_OID))
     {
         connection->directory_type = LDAP_TYPE_ACTIVE_DIRECTORY;
 
         ld_info("Directory type is Active Directory\n");
+    }
+    else
+    {
+        values = ldap_get_values_len(connection->ldap, message, "objectClass");
 
-        return true;
+        if (values)
+        {
+            connection->directory_type = LDAP_TYPE_OPENLDAP;
+
+            ld_info("Directory type is OpenLDAP\n");
+        }
     }
 
-    if (strcmp(attribute_name, "objectClass") == 0)
+    if (values)
     {
-        connection->directory_type = LDAP_TYPE_OPENLDAP;
+        ldap_value_free_len(values);
+    }
+}
 
-        ld_info("Directory type is OpenLDAP\n");
+/**
+ * @brief directory_parse_entry Parses root DSE entry into connection's root DSE record.
+ * @param[in] message           Root DSE entry.
+ * @param[in] connection        Connection to work with.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode directory_parse_entry(LDAPMessage *message, struct ldap_connection_ctx_t *connection)
+{
+    BerElement *ber_element = NULL;
+    enum OperationReturnCode rc = RETURN_CODE_SUCCESS;
+
+    char *attribute = ldap_first_attribute(connection->ldap, message, &ber_element);
+    while (attribute != NULL && rc == RETURN_CODE_SUCCESS)
+    {
+        struct berval **values = ldap_get_values_len(connection->ldap, message, attribute);
 
-        return true;
+        rc = directory_process_attribute(attribute, values, connection->rootdse);
+
+        ldap_value_free_len(values);
+        ldap_memfree(attribute);
+        attribute = ldap_next_attribute(connection->ldap, message, ber_element);
+    }
+    if (attribute)
+    {
+        ldap_memfree(attribute);
     }
+    ber_free(ber_element, 0);
 
-    return false;
+    if (rc != RETURN_CODE_SUCCESS)
+    {
+        ld_error("Error - out of memory - unable to store root DSE attributes\n");
+        return rc;
+    }
+
+    directory_update_capabilities(connection->rootdse);
+    connection->rootdse->loaded = true;
+
+    directory_detect_type(message, connection);
+
+    return RETURN_CODE_SUCCESS;
 }
 
 /**
@@ -104,9 +349,6 @@ bool directory_process_attribute(const char* attribute_name, struct ldap_connect
  */
 enum OperationReturnCode directory_parse_result(int rc, LDAPMessage *message, struct ldap_connection_ctx_t *connection)
 {
-    char *attribute   = NULL;
-    BerElement *ber_element = NULL;
-
     int error_code = 0;
     char *diagnostic_message = NULL;
 
@@ -117,18 +359,11 @@ enum OperationReturnCode directory_parse_result(int rc, LDAPMessage *message, st
     {
         while (message)
         {
-            attribute = ldap_first_attribute(connection->ldap, message, &ber_element);
-            while (attribute != NULL)
+            if (ldap_msgtype(message) == LDAP_RES_SEARCH_ENTRY
+             && directory_parse_entry(message, connection) != RETURN_CODE_SUCCESS)
             {
-                if (directory_process_attribute(attribute, connection))
-                {
-                    ldap_memfree(attribute);
-                    break;
-                }
-                ldap_memfree(attribute);
-                attribute = ldap_next_attribute(connection->ldap, message, ber_element);
-            };
-            ber_free(ber_element, 0);
+                return RETURN_CODE_FAILURE;
+            }
 
             message = ldap_next_message(connection->ldap, message);
         }
@@ -161,3 +396,80 @@ enum OperationReturnCode directory_parse_result(int rc, LDAPMessage *message, st
 
     return RETURN_CODE_FAILURE;
 }
+
+/**
+ * @brief directory_get_rootdse Returns root DSE record received during directory detection.
+ * @param[in] connection        Connection to work with.
+ * @return
+ *        - Root DSE record if root DSE has been loaded.
+ *        - NULL otherwise.
+ */
+const ld_rootdse_t *directory_get_rootdse(const struct ldap_connection_ctx_t *connection)
+{
+    if (!connection || !connection->rootdse || !connection->rootdse->loaded)
+    {
+        return NULL;
+    }
+
+    return connection->rootdse;
+}
+
+/**
+ * @brief directory_has_capability Checks whether server advertised all requested capabilities.
+ * @param[in] connection           Connection to work with.
+ * @param[in] capabilities         Bit mask of LdapDirectoryCapability values.
+ * @return
+ *        - true if every requested capability is supported.
+ *        - false otherwise or if root DSE has not been loaded yet.
+ */
+bool directory_has_capability(const struct ldap_connection_ctx_t *connection, unsigned int capabilities)
+{
+    const ld_rootdse_t *rootdse = directory_get_rootdse(connection);
+
+    return rootdse && (rootdse->capabilities & capabilities) == capabilities;
+}
+
+/**
+ * @brief directory_supports_control Checks whether server advertised control in supportedControl.
+ * @param[in] connection             Connection to work with.
+ * @param[in] oid                    OID of the control.
+ * @return
+ *        - true if control is supported.
+ *        - false otherwise or if root DSE has not been loaded yet.
+ */
+bool directory_supports_control(const struct ldap_connection_ctx_t *connection, const char *oid)
+{
+    const ld_rootdse_t *rootdse = directory_get_rootdse(connection);
+
+    return rootdse && directory_contains_value(rootdse->supported_controls, oid);
+}
+
+/**
+ * @brief directory_supports_extension Checks whether server advertised extended operation in supportedExtension.
+ * @param[in] connection               Connection to work with.
+ * @param[in] oid                      OID of the extended operation.
+ * @return
+ *        - true if extended operation is supported.
+ *        - false otherwise or if root DSE has not been loaded yet.
+ */
+bool directory_supports_extension(const struct ldap_connection_ctx_t *connection, const char *oid)
+{
+    const ld_rootdse_t *rootdse = directory_get_rootdse(connection);
+
+    return rootdse && directory_contains_value(rootdse->supported_extensions, oid);
+}
+
+/**
+ * @brief directory_supports_sasl_mechanism Checks whether server advertised SASL mechanism.
+ * @param[in] connection                    Connection to work with.
+ * @param[in] mechanism                     Name of the mechanism, e.g. GSSAPI.
+ * @return
+ *        - true if mechanism is supported.
+ *        - false otherwise or if root DSE has not been loaded yet.
+ */
+bool directory_supports_sasl_mechanism(const struct ldap_connection_ctx_t *connection, const char *mechanism)
+{
+    const ld_rootdse_t *rootdse = directory_get_rootdse(connection);
+
+    return rootdse && directory_contains_value(rootdse->supported_sasl_mechanisms, mechanism);
+}
@@ -32,7 +32,72 @@ enum LdapDirectoryType
     LDAP_TYPE_FREE_IPA         =  3              //!< We've been working with FreeIPA.
 };
 
+/**
+ * @brief LdapDirectoryCapability Features advertised by the server in the rootDSE.
+ *
+ * Every value is a bit in ld_rootdse_t::capabilities, so several features may be tested at once.
+ */
+enum LdapDirectoryCapability
+{
+    LDAP_CAPABILITY_NONE                = 0,         //!< No capabilities detected.
+    LDAP_CAPABILITY_PAGED_RESULTS       = 1 << 0,    //!< Simple paged results control (RFC 2696).
+    LDAP_CAPABILITY_SERVER_SIDE_SORT    = 1 << 1,    //!< Server side sort control (RFC 2891).
+    LDAP_CAPABILITY_VLV                 = 1 << 2,    //!< Virtual list view control.
+    LDAP_CAPABILITY_ASQ                 = 1 << 3,    //!< Attribute scoped query control.
+    LDAP_CAPABILITY_TREE_DELETE         = 1 << 4,    //!< Tree delete control.
+    LDAP_CAPABILITY_CONTENT_SYNC        = 1 << 5,    //!< Content synchronization control (RFC 4533).
+    LDAP_CAPABILITY_DIRSYNC             = 1 << 6,    //!< Active Directory DirSync control.
+    LDAP_CAPABILITY_PERSISTENT_SEARCH   = 1 << 7,    //!< Persistent search control.
+    LDAP_CAPABILITY_CHANGE_NOTIFICATION = 1 << 8,    //!< Active Directory change notification control.
+    LDAP_CAPABILITY_FAST_BIND           = 1 << 9,    //!< Active Directory fast concurrent bind extended operation.
+    LDAP_CAPABILITY_SHOW_DELETED        = 1 << 10,   //!< Show deleted objects control.
+    LDAP_CAPABILITY_PERMISSIVE_MODIFY   = 1 << 11,   //!< Permissive modify control.
+    LDAP_CAPABILITY_WHOAMI              = 1 << 12,   //!< "Who am I?" extended operation (RFC 4532).
+    LDAP_CAPABILITY_START_TLS           = 1 << 13,   //!< StartTLS extended operation (RFC 4511).
+    LDAP_CAPABILITY_MANAGE_DSA_IT       = 1 << 14,   //!< ManageDsaIT control (RFC 3296).
+    LDAP_CAPABILITY_RANGE_RETRIEVAL     = 1 << 15,   //!< Active Directory incremental attribute value retrieval.
+    LDAP_CAPABILITY_ASSERTION           = 1 << 16,   //!< Assertion control (RFC 4528).
+    LDAP_CAPABILITY_MATCHING_RULE_IN_CHAIN = 1 << 17 //!< Active Directory LDAP_MATCHING_RULE_IN_CHAIN support.
+};
+
+/**
+ * @brief ld_rootdse_t Typed representation of the root DSE of the directory we are connected to.
+ *
+ * Every array is NULL terminated and may be NULL if the server did not return the attribute.
+ */
+typedef struct ld_rootdse_s
+{
+    char **supported_controls;                   //!< OIDs of supportedControl values.
+    char **supported_extensions;                 //!< OIDs of supportedExtension values.
+    char **supported_features;                   //!< OIDs of supportedFeatures values.
+    char **supported_capabilities;               //!< OIDs of supportedCapabilities values (Active Directory).
+    char **supported_sasl_mechanisms;            //!< Names of supportedSASLMechanisms values.
+    char **supported_ldap_versions;              //!< Values of supportedLDAPVersion.
+    char **naming_contexts;                      //!< Values of namingContexts.
+
+    char *default_naming_context;                //!< Value of defaultNamingContext.
+    char *schema_naming_context;                 //!< Value of schemaNamingContext.
+    char *configuration_naming_context;          //!< Value of configurationNamingContext.
+    char *root_domain_naming_context;            //!< Value of rootDomainNamingContext.
+    char *subschema_subentry;                    //!< Value of subschemaSubentry.
+    char *dns_host_name;                         //!< Value of dnsHostName.
+    char *vendor_name;                           //!< Value of vendorName.
+    char *vendor_version;                        //!< Value of vendorVersion.
+
+    unsigned long long highest_committed_usn;    //!< Value of highestCommittedUSN, 0 if not present.
+
+    unsigned int capabilities;                   //!< Bit mask of LdapDirectoryCapability values.
+
+    bool loaded;                                 //!< True when the root DSE has been received and parsed.
+} ld_rootdse_t;
+
 enum OperationReturnCode directory_get_type(struct ldap_connection_ctx_t *connection);
 enum OperationReturnCode directory_parse_result(int rc, LDAPMessage *message, struct ldap_connection_ctx_t *connection);
 
+const ld_rootdse_t *directory_get_rootdse(const struct ldap_connection_ctx_t *connection);
+bool directory_has_capability(const struct ldap_connection_ctx_t *connection, unsigned int capabilities);
+bool directory_supports_control(const struct ldap_connection_ctx_t *connection, const char *oid);
+bool directory_supports_extension(const struct ldap_connection_ctx_t *connection, const char *oid);
+bool directory_supports_sasl_mechanism(const struct ldap_connection_ctx_t *connection, const char *mechanism);
+
 #endif //LIBDOMAIN_DIRECTORY_H
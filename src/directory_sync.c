@@ -0,0 +1,1956 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "directory_sync.h"
+#include "connection_state_machine.h"
+#include "directory.h"
+#include "entry.h"
+#include "entry_p.h"
+
+#include "helper_p.h"
+
+#include <glib-2.0/glib.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define LD_SYNC_UUID_LENGTH 16
+#define LD_SYNC_UUID_STRING_LENGTH (LD_SYNC_UUID_LENGTH * 2 + 1)
+
+#define LD_SYNC_PAGE_SIZE 500
+
+#define number_of_elements(x)  (sizeof(x) / sizeof((x)[0]))
+
+#define LD_DIRSYNC_OBJECT_SECURITY       0x00000001
+#define LD_DIRSYNC_ANCESTORS_FIRST_ORDER 0x00000800
+#define LD_DIRSYNC_MAX_BYTES             0x00100000
+
+#define LD_SYNC_JOURNAL_MIN_RECORDS 1024
+
+static const char *SYNC_STATE_HEADER = "# libdomain synchronization state";
+
+/*!
+ * @brief ld_sync_object_t - Object known to be present in synchronized subtree.
+ */
+typedef struct ld_sync_object_s
+{
+    char *dn;                                //!< Last known DN of the object.
+    unsigned int generation;                 //!< Synchronization cycle the object has been reported in.
+} ld_sync_object_t;
+
+/*!
+ * @brief ld_sync_t - Incremental synchronization session.
+ */
+struct ld_sync_s
+{
+    char *base_dn;                           //!< Base of the synchronized subtree.
+    int scope;                               //!< Scope of the synchronized subtree.
+    char *filter;                            //!< Filter selecting synchronized objects.
+    char **attrs;                            //!< Attributes to synchronize, NULL for all user attributes.
+    char *state_file;                        //!< File to persist cookie and object table to, may be NULL.
+
+    enum LdapSyncMode requested_mode;        //!< Mode requested by user.
+    enum LdapSyncMode mode;                  //!< Mode that is used for current cookie.
+
+    struct berval cookie;                    //!< Content synchronization or DirSync cookie.
+    struct berval page_cookie;               //!< Paged results cookie of uSNChanged polling.
+    char *server;                            //!< Host name of the server uSNChanged values belong to.
+    unsigned long long highest_usn;          //!< Highest uSNChanged that has been processed.
+    unsigned long long pending_usn;          //!< Highest uSNChanged seen during current cycle.
+
+    GHashTable *objects;                     //!< Objects indexed by hexadecimal entryUUID or objectGUID.
+    unsigned int generation;                 //!< Number of current synchronization cycle.
+    GHashTable *changed_objects;             //!< UUIDs of objects added, renamed or forgotten since state was saved.
+    unsigned long journal_records;           //!< Records appended to state file since it has been rewritten.
+    bool rewrite_state;                      //!< State file has to be rewritten instead of appended to.
+
+    bool full_refresh;                       //!< Objects not reported during current cycle have been deleted.
+    bool in_progress;                        //!< Synchronization cycle is running.
+    struct ldap_connection_ctx_t *connection; //!< Connection the running cycle uses.
+    int msgid;                               //!< Message id of the search in flight.
+    ld_sync_t *next;                         //!< Next running cycle of the connection.
+
+    sync_change_callback_fn on_change;       //!< Change callback.
+    sync_complete_callback_fn on_complete;   //!< Cycle completion callback.
+    void *user_data;                         //!< User data passed to callbacks.
+};
+
+static void sync_object_free(gpointer data)
+{
+    ld_sync_object_t *object = data;
+
+    if (object)
+    {
+        g_free(object->dn);
+        g_free(object);
+    }
+}
+
+/**
+ * @brief sync_link Adds session to running cycles of the connection.
+ */
+static void sync_link(struct ldap_connection_ctx_t *connection, ld_sync_t *sync)
+{
+    sync->connection = connection;
+    sync->next = connection->syncs;
+    connection->syncs = sync;
+}
+
+/**
+ * @brief sync_unlink Removes session from running cycles of its connection.
+ */
+static void sync_unlink(ld_sync_t *sync)
+{
+    if (!sync->connection)
+    {
+        return;
+    }
+
+    for (ld_sync_t **current = &sync->connection->syncs; *current != NULL; current = &(*current)->next)
+    {
+        if (*current == sync)
+        {
+            *current = sync->next;
+            break;
+        }
+    }
+
+    sync->connection = NULL;
+    sync->next = NULL;
+}
+
+static int ld_sync_destructor(TALLOC_CTX *ctx)
+{
+    ld_sync_t *sync = talloc_get_type_abort(ctx, ld_sync_t);
+
+    if (sync->in_progress && sync->connection)
+    {
+        connection_cancel_read_request(sync->connection, sync->msgid);
+        ldap_abandon_ext(sync->connection->ldap, sync->msgid, NULL, NULL);
+    }
+
+    sync_unlink(sync);
+
+    if (sync->objects)
+    {
+        g_hash_table_destroy(sync->objects);
+        sync->objects = NULL;
+    }
+
+    if (sync->changed_objects)
+    {
+        g_hash_table_destroy(sync->changed_objects);
+        sync->changed_objects = NULL;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief sync_mark_changed Remembers that object has to be written to state file.
+ * @param[in] sync          Synchronization session.
+ * @param[in] uuid          Hexadecimal UUID of the object.
+ */
+static void sync_mark_changed(ld_sync_t *sync, const char *uuid)
+{
+    if (sync->changed_objects && !g_hash_table_contains(sync->changed_objects, uuid))
+    {
+        g_hash_table_add(sync->changed_objects, g_strdup(uuid));
+    }
+}
+
+/**
+ * @brief sync_forget_objects Drops object table, state file will be rewritten on next save.
+ * @param[in] sync          Synchronization session.
+ */
+static void sync_forget_objects(ld_sync_t *sync)
+{
+    g_hash_table_remove_all(sync->objects);
+
+    if (sync->changed_objects)
+    {
+        g_hash_table_remove_all(sync->changed_objects);
+    }
+
+    sync->rewrite_state = true;
+}
+
+/**
+ * @brief sync_uuid_to_string Converts binary UUID or GUID into hexadecimal string.
+ * @param[in] uuid            Binary value.
+ * @param[out] output         Buffer of LD_SYNC_UUID_STRING_LENGTH bytes.
+ * @return
+ *        - true on success.
+ *        - false if value is not a valid UUID.
+ */
+static bool sync_uuid_to_string(const struct berval *uuid, char *output)
+{
+    if (!uuid || !uuid->bv_val || uuid->bv_len != LD_SYNC_UUID_LENGTH)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < LD_SYNC_UUID_LENGTH; ++i)
+    {
+        snprintf(output + i * 2, 3, "%02x", (unsigned char)uuid->bv_val[i]);
+    }
+
+    return true;
+}
+
+/**
+ * @brief sync_set_berval Replaces contents of berval with a copy of another berval.
+ * @param[in] ctx         Talloc context to allocate copy with.
+ * @param[out] target     Berval to update.
+ * @param[in] source      Berval to copy, NULL or empty value clears target.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode sync_set_berval(TALLOC_CTX *ctx, struct berval *target, const struct berval *source)
+{
+    talloc_free(target->bv_val);
+    target->bv_val = NULL;
+    target->bv_len = 0;
+
+    if (!source || !source->bv_val || source->bv_len == 0)
+    {
+        return RETURN_CODE_SUCCESS;
+    }
+
+    target->bv_val = talloc_memdup(ctx, source->bv_val, source->bv_len);
+    if (!target->bv_val)
+    {
+        ld_error("sync_set_berval - out of memory - unable to copy cookie!\n");
+        return RETURN_CODE_FAILURE;
+    }
+    target->bv_len = source->bv_len;
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief sync_write_cookie Writes cookie of synchronization session in text form.
+ * @param[in] sync         Synchronization session.
+ * @param[in] file         Stream to write to.
+ * @return Amount of written records.
+ */
+static unsigned long sync_write_cookie(const ld_sync_t *sync, FILE *file)
+{
+    unsigned long records = 3;
+
+    fprintf(file, "mode %d\n", sync->mode);
+    fprintf(file, "usn %llu\n", sync->highest_usn);
+
+    if (sync->server)
+    {
+        fprintf(file, "server %s\n", sync->server);
+        ++records;
+    }
+
+    // Empty cookie is written as well, so it replaces cookie appended to state file earlier.
+    gchar *encoded_cookie = g_base64_encode((const guchar *)sync->cookie.bv_val, sync->cookie.bv_len);
+    fprintf(file, "cookie %s\n", encoded_cookie);
+    g_free(encoded_cookie);
+
+    return records;
+}
+
+/**
+ * @brief sync_write_state Writes cookie and object table of synchronization session in text form.
+ * @param[in] sync         Synchronization session.
+ * @param[in] file         Stream to write to.
+ */
+static void sync_write_state(const ld_sync_t *sync, FILE *file)
+{
+    fprintf(file, "%s\n", SYNC_STATE_HEADER);
+
+    sync_write_cookie(sync, file);
+
+    GHashTableIter iter;
+    gpointer key = NULL, value = NULL;
+    g_hash_table_iter_init(&iter, sync->objects);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+        fprintf(file, "object %s %s\n", (const char *)key, ((ld_sync_object_t *)value)->dn);
+    }
+}
+
+/**
+ * @brief sync_rewrite_state Replaces state file with cookie and whole object table of synchronization session.
+ * @param[in] sync           Synchronization session.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode sync_rewrite_state(ld_sync_t *sync)
+{
+    char *temporary_file = NULL;
+    ld_talloc_asprintf(temporary_file, error_exit, sync, "%s.tmp", sync->state_file);
+
+    FILE *file = fopen(temporary_file, "w");
+    if (!file)
+    {
+        ld_error("sync_rewrite_state - unable to open %s: %s\n", temporary_file, strerror(errno));
+        goto error_exit;
+    }
+
+    sync_write_state(sync, file);
+
+    if (fclose(file) != 0 || rename(temporary_file, sync->state_file) != 0)
+    {
+        ld_error("sync_rewrite_state - unable to write %s: %s\n", sync->state_file, strerror(errno));
+        goto error_exit;
+    }
+
+    talloc_free(temporary_file);
+
+    g_hash_table_remove_all(sync->changed_objects);
+    sync->journal_records = 0;
+    sync->rewrite_state = false;
+
+    return RETURN_CODE_SUCCESS;
+
+    error_exit:
+        if (temporary_file)
+        {
+            unlink(temporary_file);
+            talloc_free(temporary_file);
+        }
+        return RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief sync_append_state Appends cookie and objects changed since last save to state file.
+ *
+ * Records are appended as a journal group which is ignored on load unless its commit line has been written.
+ * @param[in] sync           Synchronization session.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode sync_append_state(ld_sync_t *sync)
+{
+    FILE *file = fopen(sync->state_file, "a");
+    if (!file)
+    {
+        ld_error("sync_append_state - unable to open %s: %s\n", sync->state_file, strerror(errno));
+        return RETURN_CODE_FAILURE;
+    }
+
+    fprintf(file, "journal\n");
+
+    GHashTableIter iter;
+    gpointer key = NULL;
+    g_hash_table_iter_init(&iter, sync->changed_objects);
+    while (g_hash_table_iter_next(&iter, &key, NULL))
+    {
+        ld_sync_object_t *object = g_hash_table_lookup(sync->objects, key);
+
+        if (object)
+        {
+            fprintf(file, "object %s %s\n", (const char *)key, object->dn);
+        }
+        else
+        {
+            fprintf(file, "forget %s\n", (const char *)key);
+        }
+    }
+
+    unsigned long records = g_hash_table_size(sync->changed_objects) + sync_write_cookie(sync, file);
+
+    fprintf(file, "commit\n");
+
+    if (fclose(file) != 0)
+    {
+        ld_error("sync_append_state - unable to write %s: %s\n", sync->state_file, strerror(errno));
+        return RETURN_CODE_FAILURE;
+    }
+
+    g_hash_table_remove_all(sync->changed_objects);
+    sync->journal_records += records;
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief sync_save_state Persists cookie and object table of synchronization session.
+ *
+ * Only objects changed since last save are appended to state file, file is rewritten once appended records
+ * outnumber objects in the table.
+ * @param[in] sync        Synchronization session.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode sync_save_state(ld_sync_t *sync)
+{
+    if (!sync->state_file)
+    {
+        return RETURN_CODE_SUCCESS;
+    }
+
+    bool compact = sync->journal_records >= LD_SYNC_JOURNAL_MIN_RECORDS
+                   && sync->journal_records > g_hash_table_size(sync->objects);
+
+    if (!sync->rewrite_state && !compact)
+    {
+        if (sync_append_state(sync) == RETURN_CODE_SUCCESS)
+        {
+            return RETURN_CODE_SUCCESS;
+        }
+
+        // Partially appended group may end with incomplete line, nothing can be appended after it.
+        sync->rewrite_state = true;
+    }
+
+    return sync_rewrite_state(sync);
+}
+
+/**
+ * @brief sync_apply_state_line Applies single line of state written by sync_write_state or sync_append_state.
+ * @param[in] sync              Synchronization session.
+ * @param[in] line              Line without trailing newline.
+ * @param[in] source            Name of the source used in messages.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode sync_apply_state_line(ld_sync_t *sync, char *line, const char *source)
+{
+    enum OperationReturnCode rc = RETURN_CODE_SUCCESS;
+
+    if (strncmp(line, "mode ", 5) == 0)
+    {
+        sync->mode = (enum LdapSyncMode)atoi(line + 5);
+    }
+    else if (strncmp(line, "usn ", 4) == 0)
+    {
+        sync->highest_usn = strtoull(line + 4, NULL, 10);
+    }
+    else if (strncmp(line, "server ", 7) == 0)
+    {
+        talloc_free(sync->server);
+        sync->server = talloc_strdup(sync, line + 7);
+        rc = sync->server ? RETURN_CODE_SUCCESS : RETURN_CODE_FAILURE;
+    }
+    else if (strncmp(line, "cookie ", 7) == 0)
+    {
+        gsize decoded_length = 0;
+        guchar *decoded_cookie = g_base64_decode(line + 7, &decoded_length);
+        struct berval cookie = { decoded_length, (char *)decoded_cookie };
+        rc = sync_set_berval(sync, &sync->cookie, &cookie);
+        g_free(decoded_cookie);
+    }
+    else if (strncmp(line, "object ", 7) == 0)
+    {
+        char *uuid = line + 7;
+        char *dn = strchr(uuid, ' ');
+        if (!dn)
+        {
+            ld_warning("sync_apply_state_line - malformed object line in %s\n", source);
+            return RETURN_CODE_SUCCESS;
+        }
+        *dn++ = '\0';
+
+        ld_sync_object_t *object = g_new0(ld_sync_object_t, 1);
+        object->dn = g_strdup(dn);
+        g_hash_table_replace(sync->objects, g_strdup(uuid), object);
+    }
+    else if (strncmp(line, "forget ", 7) == 0)
+    {
+        g_hash_table_remove(sync->objects, line + 7);
+    }
+
+    return rc;
+}
+
+/**
+ * @brief sync_read_state Reads cookie and object table written by sync_write_state and sync_append_state.
+ *
+ * Lines of journal group are applied once its commit line is read, group interrupted by failed write is dropped.
+ * @param[in] sync        Synchronization session.
+ * @param[in] file        Stream to read from.
+ * @param[in] source      Name of the source used in messages.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode sync_read_state(ld_sync_t *sync, FILE *file, const char *source)
+{
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t length = 0;
+    enum OperationReturnCode rc = RETURN_CODE_SUCCESS;
+    GPtrArray *journal = NULL;
+
+    while (rc == RETURN_CODE_SUCCESS && (length = getline(&line, &line_size, file)) != -1)
+    {
+        if (length > 0 && line[length - 1] == '\n')
+        {
+            line[--length] = '\0';
+        }
+
+        if (line[0] == '#' || length == 0)
+        {
+            continue;
+        }
+
+        if (strcmp(line, "journal") == 0)
+        {
+            if (journal)
+            {
+                ld_warning("sync_read_state - incomplete journal group in %s has been dropped\n", source);
+                g_ptr_array_free(journal, TRUE);
+                sync->rewrite_state = true;
+            }
+            journal = g_ptr_array_new_with_free_func(g_free);
+        }
+        else if (strcmp(line, "commit") == 0 && journal)
+        {
+            for (guint i = 0; rc == RETURN_CODE_SUCCESS && i < journal->len; ++i)
+            {
+                rc = sync_apply_state_line(sync, g_ptr_array_index(journal, i), source);
+            }
+            sync->journal_records += journal->len;
+
+            g_ptr_array_free(journal, TRUE);
+            journal = NULL;
+        }
+        else if (journal)
+        {
+            g_ptr_array_add(journal, g_strdup(line));
+        }
+        else
+        {
+            rc = sync_apply_state_line(sync, line, source);
+        }
+    }
+
+    if (journal)
+    {
+        ld_warning("sync_read_state - incomplete journal group in %s has been dropped\n", source);
+        g_ptr_array_free(journal, TRUE);
+        sync->rewrite_state = true;
+    }
+
+    free(line);
+
+    if (rc != RETURN_CODE_SUCCESS)
+    {
+        ld_error("sync_read_state - unable to load %s\n", source);
+    }
+
+    return rc;
+}
+
+/**
+ * @brief sync_load_state Loads cookie and object table persisted by sync_save_state.
+ * @param[in] sync        Synchronization session.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success or if there is no saved state.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode sync_load_state(ld_sync_t *sync)
+{
+    if (!sync->state_file)
+    {
+        return RETURN_CODE_SUCCESS;
+    }
+
+    FILE *file = fopen(sync->state_file, "r");
+    if (!file)
+    {
+        sync->rewrite_state = true;
+        return errno == ENOENT ? RETURN_CODE_SUCCESS : RETURN_CODE_FAILURE;
+    }
+
+    enum OperationReturnCode rc = sync_read_state(sync, file, sync->state_file);
+
+    fclose(file);
+
+    return rc;
+}
+
+/**
+ * @brief ld_sync_new Creates new incremental synchronization session.
+ * @param[in] ctx        Talloc context to use.
+ * @param[in] base_dn    Base of the synchronized subtree.
+ * @param[in] scope      Scope of the synchronized subtree.
+ * @param[in] filter     Filter selecting synchronized objects.
+ * @param[in] attrs      NULL terminated list of attributes to synchronize, NULL for all user attributes.
+ * @param[in] state_file File to keep cookie in between runs, NULL to keep it in memory only.
+ * @return
+ *        - Valid pointer to ld_sync_t on success.
+ *        - NULL on failure.
+ */
+ld_sync_t *ld_sync_new(TALLOC_CTX *ctx,
+                       const char *base_dn,
+                       int scope,
+                       const char *filter,
+                       char **attrs,
+                       const char *state_file)
+{
+    ld_sync_t *sync = NULL;
+
+    if (!base_dn || !filter)
+    {
+        ld_error("ld_sync_new - invalid parameters!\n");
+        return NULL;
+    }
+
+    ld_talloc_zero_e(sync, error_exit, "ld_sync_new - out of memory - unable to create synchronization session!\n", ctx, ld_sync_t);
+
+    ld_talloc_strdup(sync->base_dn, error_exit, sync, base_dn);
+    ld_talloc_strdup(sync->filter, error_exit, sync, filter);
+    sync->scope = scope;
+
+    if (attrs)
+    {
+        int attrs_count = 0;
+        while (attrs[attrs_count])
+        {
+            ++attrs_count;
+        }
+
+        ld_talloc_zero_array(sync->attrs, error_exit, sync, char*, attrs_count + 1);
+
+        for (int i = 0; i < attrs_count; ++i)
+        {
+            ld_talloc_strdup(sync->attrs[i], error_exit, sync->attrs, attrs[i]);
+        }
+    }
+
+    if (state_file)
+    {
+        ld_talloc_strdup(sync->state_file, error_exit, sync, state_file);
+    }
+
+    sync->objects = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, sync_object_free);
+    if (!sync->objects)
+    {
+        ld_error("ld_sync_new - out of memory - unable to create object table!\n");
+        goto error_exit;
+    }
+
+    if (sync->state_file)
+    {
+        sync->changed_objects = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        if (!sync->changed_objects)
+        {
+            ld_error("ld_sync_new - out of memory - unable to create object table!\n");
+            goto error_exit;
+        }
+    }
+
+    talloc_set_destructor((void*)sync, ld_sync_destructor);
+
+    if (sync_load_state(sync) != RETURN_CODE_SUCCESS)
+    {
+        goto error_exit;
+    }
+
+    return sync;
+
+    error_exit:
+        talloc_free(sync);
+        return NULL;
+}
+
+/**
+ * @brief ld_sync_set_mode Sets synchronization mechanism, LD_SYNC_MODE_AUTO selects it using root DSE.
+ * @param[in] sync         Synchronization session.
+ * @param[in] mode         Mode to use.
+ */
+void ld_sync_set_mode(ld_sync_t *sync, enum LdapSyncMode mode)
+{
+    if (sync)
+    {
+        sync->requested_mode = mode;
+    }
+}
+
+/**
+ * @brief ld_sync_get_mode Returns synchronization mechanism used by the session.
+ * @param[in] sync         Synchronization session.
+ * @return Mode in use, LD_SYNC_MODE_AUTO if no cycle has been run yet.
+ */
+enum LdapSyncMode ld_sync_get_mode(const ld_sync_t *sync)
+{
+    return sync ? sync->mode : LD_SYNC_MODE_AUTO;
+}
+
+/**
+ * @brief ld_sync_set_callbacks Installs callbacks of synchronization session.
+ * @param[in] sync              Synchronization session.
+ * @param[in] on_change         Callback fired for every detected change.
+ * @param[in] on_complete       Callback fired when synchronization cycle completes, may be NULL.
+ * @param[in] user_data         Data passed to callbacks.
+ */
+void ld_sync_set_callbacks(ld_sync_t *sync,
+                           sync_change_callback_fn on_change,
+                           sync_complete_callback_fn on_complete,
+                           void *user_data)
+{
+    if (sync)
+    {
+        sync->on_change = on_change;
+        sync->on_complete = on_complete;
+        sync->user_data = user_data;
+    }
+}
+
+/**
+ * @brief sync_clear_cookie Drops cookie of synchronization session.
+ * @param[in] sync          Synchronization session.
+ */
+static void sync_clear_cookie(ld_sync_t *sync)
+{
+    sync_set_berval(sync, &sync->cookie, NULL);
+    sync_set_berval(sync, &sync->page_cookie, NULL);
+    sync->highest_usn = 0;
+    sync->pending_usn = 0;
+}
+
+/**
+ * @brief ld_sync_reset Drops cookie, next cycle will perform full refresh.
+ * @param[in] sync      Synchronization session.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_sync_reset(ld_sync_t *sync)
+{
+    if (!sync || sync->in_progress)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    sync_clear_cookie(sync);
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief ld_sync_in_progress Checks whether synchronization cycle is running.
+ * @param[in] sync            Synchronization session.
+ * @return
+ *        - true if cycle is running.
+ *        - false otherwise.
+ */
+bool ld_sync_in_progress(const ld_sync_t *sync)
+{
+    return sync && sync->in_progress;
+}
+
+/**
+ * @brief ld_sync_get_object_count Returns amount of objects known to be present in synchronized subtree.
+ * @param[in] sync                 Synchronization session.
+ * @return Amount of objects.
+ */
+unsigned int ld_sync_get_object_count(const ld_sync_t *sync)
+{
+    return sync ? g_hash_table_size(sync->objects) : 0;
+}
+
+/**
+ * @brief ld_sync_export_state Serializes cookie and object table of synchronization session.
+ *
+ * State has the format of the state file and can be stored together with data synchronized by the session.
+ * @param[in] ctx              Talloc ctx to allocate state with.
+ * @param[in] sync             Synchronization session.
+ * @param[out] length          Length of the state.
+ * @return
+ *        - State of the session.
+ *        - NULL on failure.
+ */
+char *ld_sync_export_state(TALLOC_CTX *ctx, const ld_sync_t *sync, size_t *length)
+{
+    char *buffer = NULL;
+    size_t size = 0;
+
+    if (!sync || !length)
+    {
+        ld_error("ld_sync_export_state - invalid synchronization session!\n");
+        return NULL;
+    }
+
+    FILE *file = open_memstream(&buffer, &size);
+    if (!file)
+    {
+        ld_error("ld_sync_export_state - out of memory - unable to serialize state!\n");
+        return NULL;
+    }
+
+    sync_write_state(sync, file);
+
+    if (fclose(file) != 0)
+    {
+        ld_error("ld_sync_export_state - out of memory - unable to serialize state!\n");
+        free(buffer);
+        return NULL;
+    }
+
+    char *result = talloc_memdup(ctx, buffer, size + 1);
+    free(buffer);
+
+    if (!result)
+    {
+        ld_error("ld_sync_export_state - out of memory - unable to serialize state!\n");
+        return NULL;
+    }
+
+    *length = size;
+
+    return result;
+}
+
+/**
+ * @brief ld_sync_import_state Replaces cookie and object table with state produced by ld_sync_export_state.
+ *
+ * Next cycle continues incremental synchronization from the imported cookie.
+ * @param[in] sync             Synchronization session.
+ * @param[in] state            State to import.
+ * @param[in] length           Length of the state.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_sync_import_state(ld_sync_t *sync, const char *state, size_t length)
+{
+    if (!sync || !state || sync->in_progress)
+    {
+        ld_error("ld_sync_import_state - invalid synchronization session or state!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (length == 0)
+    {
+        return ld_sync_reset(sync);
+    }
+
+    FILE *file = fmemopen((void *)state, length, "r");
+    if (!file)
+    {
+        ld_error("ld_sync_import_state - unable to read state: %s\n", strerror(errno));
+        return RETURN_CODE_FAILURE;
+    }
+
+    sync_clear_cookie(sync);
+    sync_forget_objects(sync);
+
+    enum OperationReturnCode rc = sync_read_state(sync, file, "imported state");
+
+    fclose(file);
+
+    if (rc != RETURN_CODE_SUCCESS)
+    {
+        sync_clear_cookie(sync);
+        sync_forget_objects(sync);
+        return rc;
+    }
+
+    sync->journal_records = 0;
+
+    return sync_save_state(sync);
+}
+
+/**
+ * @brief sync_select_mode Selects synchronization mechanism supported by the server.
+ * @param[in] connection   Connection to work with.
+ * @param[in] sync         Synchronization session.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE if server supports none of the mechanisms.
+ */
+static enum OperationReturnCode sync_select_mode(struct ldap_connection_ctx_t *connection, ld_sync_t *sync)
+{
+    const ld_rootdse_t *rootdse = directory_get_rootdse(connection);
+    enum LdapSyncMode mode = sync->requested_mode;
+
+    if (mode == LD_SYNC_MODE_AUTO)
+    {
+        if (directory_has_capability(connection, LDAP_CAPABILITY_CONTENT_SYNC))
+        {
+            mode = LD_SYNC_MODE_CONTENT_SYNC;
+        }
+        else if (directory_has_capability(connection, LDAP_CAPABILITY_DIRSYNC)
+                 && (sync->mode == LD_SYNC_MODE_AUTO || sync->mode == LD_SYNC_MODE_DIRSYNC))
+        {
+            mode = LD_SYNC_MODE_DIRSYNC;
+        }
+        else if (rootdse && rootdse->highest_committed_usn > 0)
+        {
+            mode = LD_SYNC_MODE_USN_POLLING;
+        }
+        else
+        {
+            ld_error("sync_select_mode - server does not support incremental synchronization!\n");
+            return RETURN_CODE_FAILURE;
+        }
+    }
+
+    if (mode != sync->mode)
+    {
+        ld_info("Using synchronization mode %d\n", mode);
+
+        sync->mode = mode;
+        sync_clear_cookie(sync);
+    }
+
+    if (mode == LD_SYNC_MODE_USN_POLLING)
+    {
+        const char *server = rootdse && rootdse->dns_host_name ? rootdse->dns_host_name : "";
+
+        if (!sync->server || strcasecmp(sync->server, server) != 0)
+        {
+            // uSNChanged values are local to domain controller, cookie from another one is meaningless.
+            sync_clear_cookie(sync);
+            talloc_free(sync->server);
+            sync->server = talloc_strdup(sync, server);
+        }
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief sync_create_attributes Creates list of requested attributes including ones required by the mode.
+ * @param[in] ctx                Talloc context to use.
+ * @param[in] sync               Synchronization session.
+ * @return
+ *        - NULL terminated list of attributes on success.
+ *        - NULL on failure.
+ */
+static char **sync_create_attributes(TALLOC_CTX *ctx, ld_sync_t *sync)
+{
+    static char *ACTIVE_DIRECTORY_ATTRIBUTES[] = { "objectGUID", "isDeleted", "uSNChanged", "lastKnownParent", NULL };
+    static char *ALL_USER_ATTRIBUTES[] = { LDAP_ALL_USER_ATTRIBUTES, NULL };
+
+    char **user_attributes = sync->attrs ? sync->attrs : ALL_USER_ATTRIBUTES;
+    char **result = NULL;
+    int count = 0;
+
+    while (user_attributes[count])
+    {
+        ++count;
+    }
+
+    ld_talloc_zero_array(result, error_exit, ctx, char*, count + number_of_elements(ACTIVE_DIRECTORY_ATTRIBUTES));
+
+    for (int i = 0; i < count; ++i)
+    {
+        result[i] = user_attributes[i];
+    }
+
+    if (sync->mode != LD_SYNC_MODE_CONTENT_SYNC)
+    {
+        for (int i = 0; ACTIVE_DIRECTORY_ATTRIBUTES[i]; ++i)
+        {
+            result[count++] = ACTIVE_DIRECTORY_ATTRIBUTES[i];
+        }
+    }
+
+    return result;
+
+    error_exit:
+        return NULL;
+}
+
+/**
+ * @brief sync_create_control Creates request control for the current mode.
+ * @param[in] connection      Connection to work with.
+ * @param[in] sync            Synchronization session.
+ * @param[out] control        Created control.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode sync_create_control(struct ldap_connection_ctx_t *connection,
+                                                    ld_sync_t *sync,
+                                                    LDAPControl **control)
+{
+    struct berval value = { 0, NULL };
+    BerElement *ber = NULL;
+    int rc = LDAP_SUCCESS;
+
+    switch (sync->mode)
+    {
+    case LD_SYNC_MODE_CONTENT_SYNC:
+        ber = ber_alloc_t(LBER_USE_DER);
+        if (!ber)
+        {
+            goto error_exit;
+        }
+
+        if (sync->cookie.bv_len > 0)
+        {
+            rc = ber_printf(ber, "{eO}", LDAP_SYNC_REFRESH_ONLY, &sync->cookie);
+        }
+        else
+        {
+            rc = ber_printf(ber, "{e}", LDAP_SYNC_REFRESH_ONLY);
+        }
+
+        if (rc == -1 || ber_flatten2(ber, &value, 0) == -1)
+        {
+            goto error_exit;
+        }
+
+        rc = ldap_control_create(LDAP_CONTROL_SYNC, 1, &value, 1, control);
+        break;
+    case LD_SYNC_MODE_DIRSYNC:
+        ber = ber_alloc_t(LBER_USE_DER);
+        if (!ber)
+        {
+            goto error_exit;
+        }
+
+        rc = ber_printf(ber, "{iio}",
+                        LD_DIRSYNC_OBJECT_SECURITY | LD_DIRSYNC_ANCESTORS_FIRST_ORDER,
+                        LD_DIRSYNC_MAX_BYTES,
+                        sync->cookie.bv_val ? sync->cookie.bv_val : "",
+                        sync->cookie.bv_len);
+
+        if (rc == -1 || ber_flatten2(ber, &value, 0) == -1)
+        {
+            goto error_exit;
+        }
+
+        rc = ldap_control_create(LDAP_CONTROL_X_DIRSYNC, 1, &value, 1, control);
+        break;
+    case LD_SYNC_MODE_USN_POLLING:
+        rc = ldap_create_page_control(connection->ldap, LD_SYNC_PAGE_SIZE, &sync->page_cookie, 0, control);
+        break;
+    default:
+        goto error_exit;
+    }
+
+    if (ber)
+    {
+        ber_free(ber, 1);
+    }
+
+    return rc == LDAP_SUCCESS ? RETURN_CODE_SUCCESS : RETURN_CODE_FAILURE;
+
+    error_exit:
+        if (ber)
+        {
+            ber_free(ber, 1);
+        }
+        return RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief sync_search Issues next search request of the synchronization cycle.
+ * @param[in] connection Connection to work with.
+ * @param[in] sync       Synchronization session.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode sync_search(struct ldap_connection_ctx_t *connection, ld_sync_t *sync)
+{
+    TALLOC_CTX *talloc_ctx = talloc_new(NULL);
+    LDAPControl *controls[3] = { NULL, NULL, NULL };
+    const char *search_base = sync->base_dn;
+    const char *filter = sync->filter;
+    int scope = sync->scope;
+    int msgid = 0;
+
+    if (!talloc_ctx)
+    {
+        ld_error("sync_search - out of memory!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    char **attrs = sync_create_attributes(talloc_ctx, sync);
+    if (!attrs)
+    {
+        goto error_exit;
+    }
+
+    if (sync_create_control(connection, sync, &controls[0]) != RETURN_CODE_SUCCESS)
+    {
+        ld_error("sync_search - unable to create synchronization control!\n");
+        goto error_exit;
+    }
+
+    if (sync->mode == LD_SYNC_MODE_DIRSYNC)
+    {
+        // DirSync works only on the root of naming context, results are narrowed down on our side.
+        const ld_rootdse_t *rootdse = directory_get_rootdse(connection);
+        if (rootdse && rootdse->default_naming_context)
+        {
+            search_base = rootdse->default_naming_context;
+            scope = LDAP_SCOPE_SUBTREE;
+        }
+    }
+    else if (sync->mode == LD_SYNC_MODE_USN_POLLING && sync->highest_usn > 0)
+    {
+        // Tombstones are moved to CN=Deleted Objects and moved objects may leave synchronized subtree,
+        // so changes are searched in the whole naming context and narrowed down on our side.
+        const ld_rootdse_t *rootdse = directory_get_rootdse(connection);
+        if (rootdse && rootdse->default_naming_context)
+        {
+            search_base = rootdse->default_naming_context;
+            scope = LDAP_SCOPE_SUBTREE;
+        }
+
+        // Tombstones keep only few attributes, so they are matched by isDeleted instead of user filter.
+        ld_talloc_asprintf(filter, error_exit, talloc_ctx,
+                           "(&(uSNChanged>=%llu)(|%s(isDeleted=TRUE)))", sync->highest_usn + 1, sync->filter);
+
+        if (ldap_control_create(LDAP_CONTROL_X_SHOW_DELETED, 0, NULL, 0, &controls[1]) != LDAP_SUCCESS)
+        {
+            goto error_exit;
+        }
+    }
+
+    int rc = ldap_search_ext(connection->ldap,
+                             search_base,
+                             scope,
+                             filter,
+                             attrs,
+                             0,
+                             controls,
+                             NULL,
+                             NULL,
+                             LDAP_NO_LIMIT,
+                             &msgid);
+    if (rc != LDAP_SUCCESS)
+    {
+        ld_error("Unable to create synchronization request: %s\n", ldap_err2string(rc));
+        goto error_exit;
+    }
+
+    ldap_control_free(controls[0]);
+    ldap_control_free(controls[1]);
+    talloc_free(talloc_ctx);
+
+    if (connection_add_read_request(connection, msgid, ld_sync_on_read, sync) != RETURN_CODE_SUCCESS)
+    {
+        ldap_abandon_ext(connection->ldap, msgid, NULL, NULL);
+        return RETURN_CODE_FAILURE;
+    }
+
+    sync->msgid = msgid;
+
+    return RETURN_CODE_SUCCESS;
+
+    error_exit:
+        if (controls[0])
+        {
+            ldap_control_free(controls[0]);
+        }
+        if (controls[1])
+        {
+            ldap_control_free(controls[1]);
+        }
+        talloc_free(talloc_ctx);
+        return RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief ld_sync_refresh Starts synchronization cycle which reports changes since previous cycle.
+ * @param[in] connection  Connection to work with, should be in LDAP_CONNECTION_STATE_RUN state.
+ * @param[in] sync        Synchronization session.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_OPERATION_IN_PROGRESS if previous cycle has not completed yet.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_sync_refresh(struct ldap_connection_ctx_t *connection, ld_sync_t *sync)
+{
+    if (!connection || !sync)
+    {
+        ld_error("ld_sync_refresh - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (sync->in_progress)
+    {
+        return RETURN_CODE_OPERATION_IN_PROGRESS;
+    }
+
+    if (connection->state_machine && connection->state_machine->state != LDAP_CONNECTION_STATE_RUN)
+    {
+        ld_error("ld_sync_refresh - connection is not ready!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (sync_select_mode(connection, sync) != RETURN_CODE_SUCCESS)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    ++sync->generation;
+    sync->full_refresh = sync->mode == LD_SYNC_MODE_USN_POLLING ? sync->highest_usn == 0 : sync->cookie.bv_len == 0;
+    sync->pending_usn = sync->highest_usn;
+    sync_set_berval(sync, &sync->page_cookie, NULL);
+
+    if (sync_search(connection, sync) != RETURN_CODE_SUCCESS)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    sync->in_progress = true;
+    sync_link(connection, sync);
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief sync_dn_in_scope Checks whether DN belongs to synchronized subtree.
+ * @param[in] sync         Synchronization session.
+ * @param[in] dn           DN to check.
+ * @return
+ *        - true if DN is in scope.
+ *        - false otherwise.
+ */
+static bool sync_dn_in_scope(ld_sync_t *sync, const char *dn)
+{
+    size_t dn_length = strlen(dn);
+    size_t base_length = strlen(sync->base_dn);
+
+    if (dn_length == base_length)
+    {
+        return sync->scope != LDAP_SCOPE_ONELEVEL && strcasecmp(dn, sync->base_dn) == 0;
+    }
+
+    if (dn_length < base_length + 2 || sync->scope == LDAP_SCOPE_BASE)
+    {
+        return false;
+    }
+
+    size_t offset = dn_length - base_length;
+    if (dn[offset - 1] != ',' || strcasecmp(dn + offset, sync->base_dn) != 0)
+    {
+        return false;
+    }
+
+    if (sync->scope == LDAP_SCOPE_ONELEVEL)
+    {
+        for (size_t i = 0; i < offset - 1; ++i)
+        {
+            if (dn[i] == '\\')
+            {
+                ++i;
+            }
+            else if (dn[i] == ',')
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief sync_parent_in_scope Checks whether children of the DN belong to synchronized subtree.
+ * @param[in] sync             Synchronization session.
+ * @param[in] parent           DN of the parent.
+ * @return
+ *        - true if children of the DN are in scope.
+ *        - false otherwise.
+ */
+static bool sync_parent_in_scope(ld_sync_t *sync, const char *parent)
+{
+    switch (sync->scope)
+    {
+    case LDAP_SCOPE_ONELEVEL:
+        return strcasecmp(parent, sync->base_dn) == 0;
+    case LDAP_SCOPE_SUBTREE:
+        return strcasecmp(parent, sync->base_dn) == 0 || sync_dn_in_scope(sync, parent);
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief sync_notify Fires change callback.
+ */
+static enum OperationReturnCode sync_notify(struct ldap_connection_ctx_t *connection,
+                                            ld_sync_t *sync,
+                                            enum LdapSyncChangeType change,
+                                            const char *dn,
+                                            const char *old_dn,
+                                            ld_entry_t *entry)
+{
+    if (!sync->on_change)
+    {
+        return RETURN_CODE_SUCCESS;
+    }
+
+    return sync->on_change(connection, change, dn, old_dn, entry, sync->user_data);
+}
+
+/**
+ * @brief sync_process_delete Reports deletion of the object and forgets about it.
+ * @param[in] connection      Connection to work with.
+ * @param[in] sync            Synchronization session.
+ * @param[in] uuid            Hexadecimal UUID of the object.
+ */
+static void sync_process_delete(struct ldap_connection_ctx_t *connection, ld_sync_t *sync, const char *uuid)
+{
+    ld_sync_object_t *object = g_hash_table_lookup(sync->objects, uuid);
+
+    if (!object)
+    {
+        return;
+    }
+
+    sync_notify(connection, sync, LD_SYNC_CHANGE_DELETE, object->dn, NULL, NULL);
+
+    g_hash_table_remove(sync->objects, uuid);
+    sync_mark_changed(sync, uuid);
+}
+
+/**
+ * @brief sync_process_present Marks object as still present in synchronized subtree.
+ * @param[in] sync             Synchronization session.
+ * @param[in] uuid             Hexadecimal UUID of the object.
+ */
+static void sync_process_present(ld_sync_t *sync, const char *uuid)
+{
+    ld_sync_object_t *object = g_hash_table_lookup(sync->objects, uuid);
+
+    if (object)
+    {
+        object->generation = sync->generation;
+    }
+}
+
+/**
+ * @brief sync_process_update Reports addition, modification or rename of the object.
+ * @param[in] connection      Connection to work with.
+ * @param[in] sync            Synchronization session.
+ * @param[in] uuid            Hexadecimal UUID of the object.
+ * @param[in] entry           Entry received from server.
+ */
+static void sync_process_update(struct ldap_connection_ctx_t *connection,
+                                ld_sync_t *sync,
+                                const char *uuid,
+                                ld_entry_t *entry)
+{
+    const char *dn = entry->dn;
+    ld_sync_object_t *object = g_hash_table_lookup(sync->objects, uuid);
+
+    if (!sync_dn_in_scope(sync, dn))
+    {
+        // Object has been moved out of synchronized subtree or never belonged to it.
+        sync_process_delete(connection, sync, uuid);
+        return;
+    }
+
+    if (!object)
+    {
+        object = g_new0(ld_sync_object_t, 1);
+        object->dn = g_strdup(dn);
+        object->generation = sync->generation;
+        g_hash_table_replace(sync->objects, g_strdup(uuid), object);
+        sync_mark_changed(sync, uuid);
+
+        sync_notify(connection, sync, LD_SYNC_CHANGE_ADD, dn, NULL, entry);
+        return;
+    }
+
+    object->generation = sync->generation;
+
+    if (strcasecmp(object->dn, dn) != 0)
+    {
+        char *old_dn = object->dn;
+        object->dn = g_strdup(dn);
+        sync_mark_changed(sync, uuid);
+
+        sync_notify(connection, sync, LD_SYNC_CHANGE_RENAME, dn, old_dn, entry);
+
+        g_free(old_dn);
+        return;
+    }
+
+    sync_notify(connection, sync, LD_SYNC_CHANGE_MODIFY, dn, NULL, entry);
+}
+
+/**
+ * @brief sync_process_entry Processes single search entry of the synchronization cycle.
+ * @param[in] connection     Connection to work with.
+ * @param[in] sync           Synchronization session.
+ * @param[in] message        Search entry message.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode sync_process_entry(struct ldap_connection_ctx_t *connection,
+                                                   ld_sync_t *sync,
+                                                   LDAPMessage *message)
+{
+    char uuid[LD_SYNC_UUID_STRING_LENGTH] = { 0 };
+    int state = LDAP_SYNC_ADD;
+
+    if (sync->mode == LD_SYNC_MODE_CONTENT_SYNC)
+    {
+        LDAPControl **controls = NULL;
+        struct berval entry_uuid = { 0, NULL };
+        struct berval cookie = { 0, NULL };
+
+        if (ldap_get_entry_controls(connection->ldap, message, &controls) != LDAP_SUCCESS)
+        {
+            return RETURN_CODE_FAILURE;
+        }
+
+        LDAPControl *control = ldap_control_find(LDAP_CONTROL_SYNC_STATE, controls, NULL);
+        BerElement *ber = control ? ber_init(&control->ldctl_value) : NULL;
+        ber_len_t length = 0;
+
+        if (!ber || ber_scanf(ber, "{em", &state, &entry_uuid) == LBER_ERROR
+            || !sync_uuid_to_string(&entry_uuid, uuid))
+        {
+            ld_warning("sync_process_entry - entry without valid sync state control!\n");
+
+            if (ber)
+            {
+                ber_free(ber, 1);
+            }
+            ldap_controls_free(controls);
+            return RETURN_CODE_SUCCESS;
+        }
+
+        if (ber_peek_tag(ber, &length) == LDAP_TAG_SYNC_COOKIE && ber_scanf(ber, "m", &cookie) != LBER_ERROR)
+        {
+            sync_set_berval(sync, &sync->cookie, &cookie);
+        }
+
+        ber_free(ber, 1);
+        ldap_controls_free(controls);
+    }
+    else
+    {
+        struct berval **values = ldap_get_values_len(connection->ldap, message, "objectGUID");
+        bool valid = values && sync_uuid_to_string(values[0], uuid);
+        ldap_value_free_len(values);
+
+        if (!valid)
+        {
+            ld_warning("sync_process_entry - entry without objectGUID!\n");
+            return RETURN_CODE_SUCCESS;
+        }
+
+        values = ldap_get_values_len(connection->ldap, message, "isDeleted");
+        if (values && values[0] && strncasecmp(values[0]->bv_val, "TRUE", values[0]->bv_len) == 0)
+        {
+            state = LDAP_SYNC_DELETE;
+        }
+        ldap_value_free_len(values);
+
+        if (state == LDAP_SYNC_DELETE && !g_hash_table_contains(sync->objects, uuid))
+        {
+            // Tombstones of the whole naming context are returned, only ones deleted from synchronized
+            // subtree are of interest. Known objects are reported regardless of their last parent.
+            values = ldap_get_values_len(connection->ldap, message, "lastKnownParent");
+            char *parent = values && values[0] ? g_strndup(values[0]->bv_val, values[0]->bv_len) : NULL;
+            bool in_scope = parent && sync_parent_in_scope(sync, parent);
+            g_free(parent);
+            ldap_value_free_len(values);
+
+            if (!in_scope)
+            {
+                return RETURN_CODE_SUCCESS;
+            }
+        }
+
+        values = ldap_get_values_len(connection->ldap, message, "uSNChanged");
+        if (values && values[0])
+        {
+            char usn[32] = { 0 };
+            memcpy(usn, values[0]->bv_val, values[0]->bv_len < sizeof(usn) - 1 ? values[0]->bv_len : sizeof(usn) - 1);
+
+            unsigned long long value = strtoull(usn, NULL, 10);
+            if (value > sync->pending_usn)
+            {
+                sync->pending_usn = value;
+            }
+        }
+        ldap_value_free_len(values);
+    }
+
+    switch (state)
+    {
+    case LDAP_SYNC_PRESENT:
+        sync_process_present(sync, uuid);
+        break;
+    case LDAP_SYNC_DELETE:
+        sync_process_delete(connection, sync, uuid);
+        break;
+    default:
+    {
+        ld_entry_t *entry = ld_entry_from_message(sync, connection->ldap, message);
+        if (!entry)
+        {
+            ld_error("sync_process_entry - out of memory - unable to create entry!\n");
+            return RETURN_CODE_FAILURE;
+        }
+
+        sync_process_update(connection, sync, uuid, entry);
+
+        // Callback may have taken the entry with talloc_steal().
+        if (talloc_parent(entry) == sync)
+        {
+            talloc_free(entry);
+        }
+    }
+        break;
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief sync_process_uuid_set Processes syncIdSet of the content synchronization.
+ * @param[in] connection        Connection to work with.
+ * @param[in] sync              Synchronization session.
+ * @param[in] ber               BER element positioned at syncIdSet.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode sync_process_uuid_set(struct ldap_connection_ctx_t *connection,
+                                                      ld_sync_t *sync,
+                                                      BerElement *ber)
+{
+    struct berval cookie = { 0, NULL };
+    struct berval *uuids = NULL;
+    ber_len_t length = 0;
+    ber_int_t refresh_deletes = 0;
+
+    if (ber_scanf(ber, "{") == LBER_ERROR)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (ber_peek_tag(ber, &length) == LDAP_TAG_SYNC_COOKIE && ber_scanf(ber, "m", &cookie) != LBER_ERROR)
+    {
+        sync_set_berval(sync, &sync->cookie, &cookie);
+    }
+
+    if (ber_peek_tag(ber, &length) == LDAP_TAG_REFRESHDELETES)
+    {
+        ber_scanf(ber, "b", &refresh_deletes);
+    }
+
+    if (ber_scanf(ber, "[W]}", &uuids) == LBER_ERROR)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    for (int i = 0; uuids && uuids[i].bv_val; ++i)
+    {
+        char uuid[LD_SYNC_UUID_STRING_LENGTH] = { 0 };
+
+        if (!sync_uuid_to_string(&uuids[i], uuid))
+        {
+            continue;
+        }
+
+        if (refresh_deletes)
+        {
+            sync_process_delete(connection, sync, uuid);
+        }
+        else
+        {
+            sync_process_present(sync, uuid);
+        }
+    }
+
+    ber_bvarray_free(uuids);
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief sync_process_intermediate Processes Sync Info message of the content synchronization.
+ * @param[in] connection            Connection to work with.
+ * @param[in] sync                  Synchronization session.
+ * @param[in] message               Intermediate message.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode sync_process_intermediate(struct ldap_connection_ctx_t *connection,
+                                                          ld_sync_t *sync,
+                                                          LDAPMessage *message)
+{
+    char *oid = NULL;
+    struct berval *data = NULL;
+    struct berval cookie = { 0, NULL };
+    ber_len_t length = 0;
+    enum OperationReturnCode rc = RETURN_CODE_SUCCESS;
+
+    if (ldap_parse_intermediate(connection->ldap, message, &oid, &data, NULL, 0) != LDAP_SUCCESS)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (!oid || strcmp(oid, LDAP_SYNC_INFO) != 0 || !data)
+    {
+        goto exit;
+    }
+
+    BerElement *ber = ber_init(data);
+    if (!ber)
+    {
+        rc = RETURN_CODE_FAILURE;
+        goto exit;
+    }
+
+    switch (ber_peek_tag(ber, &length))
+    {
+    case LDAP_TAG_SYNC_NEW_COOKIE:
+        if (ber_scanf(ber, "m", &cookie) != LBER_ERROR)
+        {
+            rc = sync_set_berval(sync, &sync->cookie, &cookie);
+        }
+        break;
+    case LDAP_TAG_SYNC_REFRESH_PRESENT:
+        // Present phase, objects that have not been mentioned are gone.
+        sync->full_refresh = true;
+        // fall through
+    case LDAP_TAG_SYNC_REFRESH_DELETE:
+        if (ber_scanf(ber, "{") != LBER_ERROR
+            && ber_peek_tag(ber, &length) == LDAP_TAG_SYNC_COOKIE
+            && ber_scanf(ber, "m", &cookie) != LBER_ERROR)
+        {
+            rc = sync_set_berval(sync, &sync->cookie, &cookie);
+        }
+        break;
+    case LDAP_TAG_SYNC_ID_SET:
+        rc = sync_process_uuid_set(connection, sync, ber);
+        break;
+    default:
+        ld_warning("sync_process_intermediate - unknown sync info message!\n");
+        break;
+    }
+
+    ber_free(ber, 1);
+
+    exit:
+        ldap_memfree(oid);
+        if (data)
+        {
+            ber_bvfree(data);
+        }
+        return rc;
+}
+
+/**
+ * @brief sync_sweep Reports deletion of objects that have not been seen during full refresh.
+ * @param[in] connection Connection to work with.
+ * @param[in] sync       Synchronization session.
+ */
+static void sync_sweep(struct ldap_connection_ctx_t *connection, ld_sync_t *sync)
+{
+    GHashTableIter iter;
+    gpointer key = NULL, value = NULL;
+
+    g_hash_table_iter_init(&iter, sync->objects);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+        ld_sync_object_t *object = value;
+
+        if (object->generation != sync->generation)
+        {
+            sync_notify(connection, sync, LD_SYNC_CHANGE_DELETE, object->dn, NULL, NULL);
+            sync_mark_changed(sync, key);
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+}
+
+/**
+ * @brief sync_finish Completes synchronization cycle.
+ * @param[in] connection Connection to work with.
+ * @param[in] sync       Synchronization session.
+ * @param[in] rc         Result of the cycle.
+ * @return Result of the cycle.
+ */
+static enum OperationReturnCode sync_finish(struct ldap_connection_ctx_t *connection,
+                                            ld_sync_t *sync,
+                                            enum OperationReturnCode rc)
+{
+    if (rc == RETURN_CODE_SUCCESS)
+    {
+        if (sync->full_refresh)
+        {
+            sync_sweep(connection, sync);
+        }
+
+        sync->highest_usn = sync->pending_usn;
+
+        if (sync_save_state(sync) != RETURN_CODE_SUCCESS)
+        {
+            ld_warning("sync_finish - unable to save synchronization state!\n");
+        }
+    }
+
+    sync->in_progress = false;
+    sync_unlink(sync);
+
+    if (sync->on_complete)
+    {
+        sync->on_complete(connection, sync, rc, sync->user_data);
+    }
+
+    return rc;
+}
+
+/**
+ * @brief sync_abort_all Fails running synchronization cycles of the connection.
+ *
+ * Called when connection is lost, requests of the cycles are gone and their results will never arrive.
+ * Changes received so far have been reported, cookie is kept, so the next cycle continues from it.
+ * @param[in] connection Connection to work with.
+ */
+void sync_abort_all(struct ldap_connection_ctx_t *connection)
+{
+    // Cycles can not be started again until connection is back in LDAP_CONNECTION_STATE_RUN state.
+    ld_sync_t *running = connection->syncs;
+    connection->syncs = NULL;
+
+    while (running)
+    {
+        ld_sync_t *sync = running;
+        running = sync->next;
+
+        connection_cancel_read_request(connection, sync->msgid);
+
+        sync->connection = NULL;
+        sync->next = NULL;
+        sync->in_progress = false;
+
+        if (sync->on_complete)
+        {
+            sync->on_complete(connection, sync, RETURN_CODE_FAILURE, sync->user_data);
+        }
+    }
+}
+
+/**
+ * @brief sync_process_result Processes search result of the synchronization request.
+ * @param[in] connection      Connection to work with.
+ * @param[in] sync            Synchronization session.
+ * @param[in] message         Search result message.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode sync_process_result(struct ldap_connection_ctx_t *connection,
+                                                    ld_sync_t *sync,
+                                                    LDAPMessage *message)
+{
+    int error_code = 0;
+    char *diagnostic_message = NULL;
+    LDAPControl **controls = NULL;
+    LDAPControl *control = NULL;
+    BerElement *ber = NULL;
+    struct berval cookie = { 0, NULL };
+    ber_len_t length = 0;
+    bool more_results = false;
+
+    if (ldap_parse_result(connection->ldap, message, &error_code, NULL, &diagnostic_message, NULL, &controls, 0)
+        != LDAP_SUCCESS)
+    {
+        return sync_finish(connection, sync, RETURN_CODE_FAILURE);
+    }
+
+    if (error_code == LDAP_SYNC_REFRESH_REQUIRED && sync->mode == LD_SYNC_MODE_CONTENT_SYNC)
+    {
+        ld_info("Server requested full refresh of synchronized subtree\n");
+
+        ldap_memfree(diagnostic_message);
+        ldap_controls_free(controls);
+
+        sync_set_berval(sync, &sync->cookie, NULL);
+        sync->full_refresh = true;
+
+        return sync_search(connection, sync) == RETURN_CODE_SUCCESS
+                ? RETURN_CODE_SUCCESS
+                : sync_finish(connection, sync, RETURN_CODE_FAILURE);
+    }
+
+    if (error_code != LDAP_SUCCESS)
+    {
+        ld_error("Synchronization request failed: %s %s\n", ldap_err2string(error_code),
+                 diagnostic_message ? diagnostic_message : "");
+
+        ldap_memfree(diagnostic_message);
+        ldap_controls_free(controls);
+
+        if (sync->mode == LD_SYNC_MODE_DIRSYNC && sync->requested_mode == LD_SYNC_MODE_AUTO)
+        {
+            // DirSync requires replication rights, uSNChanged polling works with plain read access.
+            ld_info("Falling back to uSNChanged polling\n");
+
+            sync->mode = LD_SYNC_MODE_USN_POLLING;
+            sync_clear_cookie(sync);
+            sync->full_refresh = true;
+
+            return sync_search(connection, sync) == RETURN_CODE_SUCCESS
+                    ? RETURN_CODE_SUCCESS
+                    : sync_finish(connection, sync, RETURN_CODE_FAILURE);
+        }
+
+        return sync_finish(connection, sync, RETURN_CODE_FAILURE);
+    }
+
+    ldap_memfree(diagnostic_message);
+
+    switch (sync->mode)
+    {
+    case LD_SYNC_MODE_CONTENT_SYNC:
+        control = ldap_control_find(LDAP_CONTROL_SYNC_DONE, controls, NULL);
+        if (control && (ber = ber_init(&control->ldctl_value)) != NULL)
+        {
+            ber_int_t refresh_deletes = 0;
+
+            if (ber_scanf(ber, "{") != LBER_ERROR)
+            {
+                if (ber_peek_tag(ber, &length) == LDAP_TAG_SYNC_COOKIE && ber_scanf(ber, "m", &cookie) != LBER_ERROR)
+                {
+                    sync_set_berval(sync, &sync->cookie, &cookie);
+                }
+                if (ber_peek_tag(ber, &length) == LDAP_TAG_REFRESHDELETES)
+                {
+                    ber_scanf(ber, "b", &refresh_deletes);
+                }
+            }
+
+            if (!refresh_deletes)
+            {
+                sync->full_refresh = true;
+            }
+        }
+        break;
+    case LD_SYNC_MODE_DIRSYNC:
+        control = ldap_control_find(LDAP_CONTROL_X_DIRSYNC, controls, NULL);
+        if (control && (ber = ber_init(&control->ldctl_value)) != NULL)
+        {
+            ber_int_t more = 0;
+            ber_int_t unused = 0;
+
+            if (ber_scanf(ber, "{iim}", &more, &unused, &cookie) != LBER_ERROR)
+            {
+                sync_set_berval(sync, &sync->cookie, &cookie);
+                more_results = more != 0;
+            }
+        }
+        break;
+    case LD_SYNC_MODE_USN_POLLING:
+        control = ldap_control_find(LDAP_CONTROL_PAGEDRESULTS, controls, NULL);
+        if (control)
+        {
+            ber_int_t count = 0;
+
+            if (ldap_parse_pageresponse_control(connection->ldap, control, &count, &cookie) == LDAP_SUCCESS)
+            {
+                sync_set_berval(sync, &sync->page_cookie, &cookie);
+                more_results = cookie.bv_len > 0;
+                ber_memfree(cookie.bv_val);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (ber)
+    {
+        ber_free(ber, 1);
+    }
+    ldap_controls_free(controls);
+
+    if (more_results)
+    {
+        return sync_search(connection, sync) == RETURN_CODE_SUCCESS
+                ? RETURN_CODE_SUCCESS
+                : sync_finish(connection, sync, RETURN_CODE_FAILURE);
+    }
+
+    return sync_finish(connection, sync, RETURN_CODE_SUCCESS);
+}
+
+/**
+ * @brief ld_sync_on_read This callback is called upon completion of synchronization request.
+ * @param[in] rc           Return code of ldap_result.
+ * @param[in] message      Message received from ldap.
+ * @param[in] connection   Connection to work with.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_sync_on_read(int rc, LDAPMessage *message, struct ldap_connection_ctx_t *connection)
+{
+    ld_sync_t *sync = connection->request_user_data;
+
+    if (!sync)
+    {
+        ld_error("ld_sync_on_read - synchronization session is missing!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (rc == LDAP_RES_ANY)
+    {
+        return sync_finish(connection, sync, RETURN_CODE_FAILURE);
+    }
+
+    for (LDAPMessage *current = ldap_first_message(connection->ldap, message);
+         current != NULL;
+         current = ldap_next_message(connection->ldap, current))
+    {
+        switch (ldap_msgtype(current))
+        {
+        case LDAP_RES_SEARCH_ENTRY:
+            if (sync_process_entry(connection, sync, current) != RETURN_CODE_SUCCESS)
+            {
+                return sync_finish(connection, sync, RETURN_CODE_FAILURE);
+            }
+            break;
+        case LDAP_RES_INTERMEDIATE:
+            if (sync_process_intermediate(connection, sync, current) != RETURN_CODE_SUCCESS)
+            {
+                return sync_finish(connection, sync, RETURN_CODE_FAILURE);
+            }
+            break;
+        case LDAP_RES_SEARCH_REFERENCE:
+            ld_info("Received search referral but not following it!");
+            break;
+        case LDAP_RES_SEARCH_RESULT:
+            return sync_process_result(connection, sync, current);
+        default:
+            break;
+        }
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
@@ -0,0 +1,94 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_DIRECTORY_SYNC_H
+#define LIBDOMAIN_DIRECTORY_SYNC_H
+
+#include "common.h"
+#include "connection.h"
+
+#include <stdbool.h>
+
+enum LdapSyncMode
+{
+    LD_SYNC_MODE_AUTO         = 0,      //!< Select best mechanism advertised in root DSE.
+    LD_SYNC_MODE_CONTENT_SYNC = 1,      //!< RFC 4533 content synchronization in refreshOnly mode.
+    LD_SYNC_MODE_DIRSYNC      = 2,      //!< Active Directory DirSync control.
+    LD_SYNC_MODE_USN_POLLING  = 3,      //!< Active Directory uSNChanged polling.
+};
+
+enum LdapSyncChangeType
+{
+    LD_SYNC_CHANGE_ADD    = 1,          //!< Entry appeared in synchronized subtree.
+    LD_SYNC_CHANGE_MODIFY = 2,          //!< Entry has been modified.
+    LD_SYNC_CHANGE_DELETE = 3,          //!< Entry has been removed from synchronized subtree.
+    LD_SYNC_CHANGE_RENAME = 4,          //!< Entry has been renamed or moved, entry may be modified as well.
+};
+
+/**
+ * @brief sync_change_callback_fn Callback fired for every change detected during synchronization.
+ *
+ * Entry is NULL for LD_SYNC_CHANGE_DELETE and is freed after callback returns, use talloc_steal() to keep it.
+ * For DirSync entry contains only attributes that have been changed.
+ * Old DN is set only for LD_SYNC_CHANGE_RENAME.
+ */
+typedef enum OperationReturnCode (*sync_change_callback_fn)(struct ldap_connection_ctx_t *connection,
+                                                            enum LdapSyncChangeType change,
+                                                            const char *dn,
+                                                            const char *old_dn,
+                                                            ld_entry_t *entry,
+                                                            void *user_data);
+
+/**
+ * @brief sync_complete_callback_fn Callback fired when synchronization cycle started by ld_sync_refresh completes.
+ */
+typedef void (*sync_complete_callback_fn)(struct ldap_connection_ctx_t *connection,
+                                          ld_sync_t *sync,
+                                          enum OperationReturnCode rc,
+                                          void *user_data);
+
+ld_sync_t *ld_sync_new(TALLOC_CTX *ctx,
+                       const char *base_dn,
+                       int scope,
+                       const char *filter,
+                       char **attrs,
+                       const char *state_file);
+
+void ld_sync_set_mode(ld_sync_t *sync, enum LdapSyncMode mode);
+enum LdapSyncMode ld_sync_get_mode(const ld_sync_t *sync);
+
+void ld_sync_set_callbacks(ld_sync_t *sync,
+                           sync_change_callback_fn on_change,
+                           sync_complete_callback_fn on_complete,
+                           void *user_data);
+
+enum OperationReturnCode ld_sync_refresh(struct ldap_connection_ctx_t *connection, ld_sync_t *sync);
+enum OperationReturnCode ld_sync_on_read(int rc, LDAPMessage *message, struct ldap_connection_ctx_t *connection);
+
+void sync_abort_all(struct ldap_connection_ctx_t *connection);
+
+enum OperationReturnCode ld_sync_reset(ld_sync_t *sync);
+bool ld_sync_in_progress(const ld_sync_t *sync);
+unsigned int ld_sync_get_object_count(const ld_sync_t *sync);
+
+char *ld_sync_export_state(TALLOC_CTX *ctx, const ld_sync_t *sync, size_t *length);
+enum OperationReturnCode ld_sync_import_state(ld_sync_t *sync, const char *state, size_t length);
+
+#endif //LIBDOMAIN_DIRECTORY_SYNC_H
@@ -0,0 +1,607 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "dn.h"
+#include "common.h"
+#include "schema.h"
+
+#include "helper_p.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib-2.0/glib.h>
+
+#define number_of_elements(x)  (sizeof(x) / sizeof((x)[0]))
+
+enum
+{
+    DN_INITIAL_AVAS = 16,
+    DN_MAX_TYPE_LENGTH = 128,
+};
+
+static const uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+static const uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+/*!
+ * @brief ld_dn_t - Parsed distinguished name.
+ */
+struct ld_dn_s
+{
+    char *dn;                           //!< Copy of the parsed DN, spans of AVAs point into it.
+    ld_dn_ava_t *avas;                  //!< Attribute types and values.
+    unsigned int n_avas;                //!< Amount of AVAs.
+    unsigned int n_rdns;                //!< Amount of RDNs.
+    char *normalized;                   //!< Canonical form of DN.
+    size_t *rdn_offsets;                //!< Offsets of RDNs in canonical form.
+    uint64_t hash;                      //!< Hash of canonical form.
+};
+
+/*!
+ * @brief Attribute type names and OIDs resolved when schema is not available.
+ */
+static const struct
+{
+    const char *alias;
+    const char *name;
+} ATTRIBUTE_TYPES[] =
+{
+    { "2.5.4.3", "cn" },
+    { "commonName", "cn" },
+    { "2.5.4.4", "sn" },
+    { "surname", "sn" },
+    { "2.5.4.5", "serialnumber" },
+    { "2.5.4.6", "c" },
+    { "countryName", "c" },
+    { "2.5.4.7", "l" },
+    { "localityName", "l" },
+    { "2.5.4.8", "st" },
+    { "stateOrProvinceName", "st" },
+    { "2.5.4.9", "street" },
+    { "streetAddress", "street" },
+    { "2.5.4.10", "o" },
+    { "organizationName", "o" },
+    { "2.5.4.11", "ou" },
+    { "organizationalUnitName", "ou" },
+    { "2.5.4.12", "title" },
+    { "2.5.4.42", "givenname" },
+    { "0.9.2342.19200300.100.1.1", "uid" },
+    { "userid", "uid" },
+    { "0.9.2342.19200300.100.1.25", "dc" },
+    { "domainComponent", "dc" },
+};
+
+int parse_distinguished_name(const char *const in, const size_t len, ld_dn_ava_t *avas, const int max_avas);
+
+/**
+ * @brief ld_dn_hash_string Calculates FNV-1a hash of canonical DN.
+ * @param[in] normalized     Canonical DN.
+ * @param[in] len            Length of canonical DN.
+ * @return Hash of DN.
+ */
+uint64_t ld_dn_hash_string(const char *normalized, size_t len)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        hash ^= (unsigned char)normalized[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief dn_append_type Appends canonical form of attribute type.
+ * @param[in] out        String to append to.
+ * @param[in] ava        AVA to take type from.
+ * @param[in] schema     Schema to resolve OIDs and aliases with, may be NULL.
+ */
+static void dn_append_type(GString *out, const ld_dn_ava_t *ava, const ldap_schema_t *schema)
+{
+    char type[DN_MAX_TYPE_LENGTH];
+    const char *name = type;
+    size_t len = ava->type_len;
+    const char *start = ava->type;
+
+    if (len > 4 && g_ascii_strncasecmp(start, "OID.", 4) == 0)
+    {
+        start += 4;
+        len -= 4;
+    }
+
+    if (len >= sizeof(type))
+    {
+        g_string_append_len(out, start, len);
+        return;
+    }
+
+    memcpy(type, start, len);
+    type[len] = '\0';
+
+    LDAPAttributeType *attribute_type = NULL;
+    if (schema)
+    {
+        attribute_type = g_ascii_isdigit(type[0])
+                ? ldap_schema_get_attributetype_by_oid(schema, type)
+                : ldap_schema_get_attributetype_by_name(schema, type);
+    }
+
+    if (attribute_type && attribute_type->at_names && attribute_type->at_names[0])
+    {
+        name = attribute_type->at_names[0];
+    }
+    else
+    {
+        for (size_t i = 0; i < number_of_elements(ATTRIBUTE_TYPES); ++i)
+        {
+            if (g_ascii_strcasecmp(ATTRIBUTE_TYPES[i].alias, type) == 0)
+            {
+                name = ATTRIBUTE_TYPES[i].name;
+                break;
+            }
+        }
+    }
+
+    for (const char *current = name; *current; ++current)
+    {
+        g_string_append_c(out, g_ascii_tolower(*current));
+    }
+}
+
+/**
+ * @brief dn_append_value Appends canonical form of attribute value.
+ *
+ * Value is unescaped, case folded, insignificant spaces are removed and special characters are escaped as hex pairs,
+ * so separators never appear inside of canonical values.
+ * @param[in] out         String to append to.
+ * @param[in] ava         AVA to take value from.
+ */
+static void dn_append_value(GString *out, const ld_dn_ava_t *ava)
+{
+    if (ava->hex)
+    {
+        for (size_t i = 0; i < ava->value_len; ++i)
+        {
+            g_string_append_c(out, g_ascii_tolower(ava->value[i]));
+        }
+        return;
+    }
+
+    GString *raw = g_string_sized_new(ava->value_len);
+
+    for (size_t i = 0; i < ava->value_len; ++i)
+    {
+        if (ava->value[i] == '\\' && i + 1 < ava->value_len)
+        {
+            if (i + 2 < ava->value_len && g_ascii_isxdigit(ava->value[i + 1]) && g_ascii_isxdigit(ava->value[i + 2]))
+            {
+                g_string_append_c(raw, (char)(g_ascii_xdigit_value(ava->value[i + 1]) * 16
+                                              + g_ascii_xdigit_value(ava->value[i + 2])));
+                i += 2;
+            }
+            else
+            {
+                g_string_append_c(raw, ava->value[++i]);
+            }
+        }
+        else
+        {
+            g_string_append_c(raw, ava->value[i]);
+        }
+    }
+
+    gchar *folded = NULL;
+    if (g_utf8_validate(raw->str, raw->len, NULL))
+    {
+        folded = g_utf8_casefold(raw->str, raw->len);
+    }
+    else
+    {
+        folded = g_ascii_strdown(raw->str, raw->len);
+    }
+    g_string_free(raw, TRUE);
+
+    const char *current = folded;
+    while (*current == ' ')
+    {
+        ++current;
+    }
+
+    bool first = true;
+    while (*current)
+    {
+        unsigned char symbol = (unsigned char)*current++;
+
+        if (symbol == ' ')
+        {
+            while (*current == ' ')
+            {
+                ++current;
+            }
+            if (*current == '\0')
+            {
+                break;
+            }
+        }
+
+        if (strchr(",+\"\\<>;=", symbol) || symbol < 0x20 || symbol == 0x7f || (first && symbol == '#'))
+        {
+            g_string_append_printf(out, "\\%02x", symbol);
+        }
+        else
+        {
+            g_string_append_c(out, symbol);
+        }
+
+        first = false;
+    }
+
+    g_free(folded);
+}
+
+/**
+ * @brief dn_compare_strings Compares strings for sorting of AVAs in multi-valued RDN.
+ */
+static gint dn_compare_strings(gconstpointer first, gconstpointer second)
+{
+    return strcmp(*(const char* const*)first, *(const char* const*)second);
+}
+
+/**
+ * @brief dn_normalize Builds canonical form of parsed DN.
+ * @param[in] result    DN to work with.
+ * @param[in] schema    Schema to resolve OIDs and aliases with, may be NULL.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode dn_normalize(ld_dn_t *result, const ldap_schema_t *schema)
+{
+    GString *out = g_string_sized_new(strlen(result->dn));
+    GString *ava_out = g_string_new(NULL);
+    GPtrArray *rdn_avas = g_ptr_array_new_with_free_func(g_free);
+
+    ld_talloc_array(result->rdn_offsets, error_exit, result, size_t, result->n_rdns + 1);
+
+    unsigned int ava_index = 0;
+    for (unsigned int rdn = 0; rdn < result->n_rdns; ++rdn)
+    {
+        if (rdn > 0)
+        {
+            g_string_append_c(out, ',');
+        }
+        result->rdn_offsets[rdn] = out->len;
+
+        g_ptr_array_set_size(rdn_avas, 0);
+
+        for (; ava_index < result->n_avas && result->avas[ava_index].rdn == rdn; ++ava_index)
+        {
+            g_string_truncate(ava_out, 0);
+            dn_append_type(ava_out, &result->avas[ava_index], schema);
+            g_string_append_c(ava_out, '=');
+            dn_append_value(ava_out, &result->avas[ava_index]);
+
+            g_ptr_array_add(rdn_avas, g_strndup(ava_out->str, ava_out->len));
+        }
+
+        // Order of AVAs in multi-valued RDN is not significant.
+        g_ptr_array_sort(rdn_avas, dn_compare_strings);
+
+        for (guint i = 0; i < rdn_avas->len; ++i)
+        {
+            if (i > 0)
+            {
+                g_string_append_c(out, '+');
+            }
+            g_string_append(out, g_ptr_array_index(rdn_avas, i));
+        }
+    }
+    result->rdn_offsets[result->n_rdns] = out->len;
+
+    ld_talloc_strndup(result->normalized, error_exit, result, out->str, out->len);
+    result->hash = ld_dn_hash_string(out->str, out->len);
+
+    g_ptr_array_free(rdn_avas, TRUE);
+    g_string_free(ava_out, TRUE);
+    g_string_free(out, TRUE);
+
+    return RETURN_CODE_SUCCESS;
+
+    error_exit:
+        g_ptr_array_free(rdn_avas, TRUE);
+        g_string_free(ava_out, TRUE);
+        g_string_free(out, TRUE);
+
+        return RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief ld_dn_parse Parses DN and builds its canonical form.
+ *
+ * Canonical form has lower cased attribute types with OIDs and aliases resolved to names, case folded values
+ * without insignificant spaces and all special characters escaped as hex pairs.
+ * @param[in] ctx      Talloc ctx to use.
+ * @param[in] dn       DN to parse.
+ * @param[in] schema   Schema to resolve attribute types with, NULL to resolve only well known attribute types.
+ * @return
+ *        - Parsed DN.
+ *        - NULL if DN is invalid or on failure.
+ */
+ld_dn_t *ld_dn_parse(TALLOC_CTX *ctx, const char *dn, const ldap_schema_t *schema)
+{
+    ld_dn_ava_t avas[DN_INITIAL_AVAS];
+    ld_dn_t *result = NULL;
+
+    if (!dn)
+    {
+        ld_error("ld_dn_parse - invalid DN!\n");
+        return NULL;
+    }
+
+    ld_talloc_zero_e(result, error_exit, "ld_dn_parse - out of memory - unable to create DN!\n", ctx, ld_dn_t);
+    ld_talloc_strdup(result->dn, error_exit, result, dn);
+
+    size_t length = strlen(result->dn);
+    int count = parse_distinguished_name(result->dn, length, avas, DN_INITIAL_AVAS);
+    if (count < 0)
+    {
+        ld_error("ld_dn_parse - invalid DN: %s\n", dn);
+        goto error_exit;
+    }
+
+    ld_talloc_array(result->avas, error_exit, result, ld_dn_ava_t, count > 0 ? count : 1);
+
+    if (count > DN_INITIAL_AVAS)
+    {
+        parse_distinguished_name(result->dn, length, result->avas, count);
+    }
+    else
+    {
+        memcpy(result->avas, avas, count * sizeof(ld_dn_ava_t));
+    }
+
+    result->n_avas = count;
+    result->n_rdns = count > 0 ? result->avas[count - 1].rdn + 1 : 0;
+
+    if (dn_normalize(result, schema) != RETURN_CODE_SUCCESS)
+    {
+        goto error_exit;
+    }
+
+    return result;
+
+    error_exit:
+        talloc_free(result);
+        return NULL;
+}
+
+/**
+ * @brief ld_dn_normalize Returns canonical form of DN.
+ * @param[in] ctx         Talloc ctx to use.
+ * @param[in] dn          DN to normalize.
+ * @return
+ *        - Canonical form of DN.
+ *        - NULL if DN is invalid or on failure.
+ */
+char *ld_dn_normalize(TALLOC_CTX *ctx, const char *dn)
+{
+    ld_dn_t *parsed = ld_dn_parse(ctx, dn, NULL);
+    if (!parsed)
+    {
+        return NULL;
+    }
+
+    char *result = talloc_steal(ctx, parsed->normalized);
+
+    talloc_free(parsed);
+
+    return result;
+}
+
+/**
+ * @brief ld_dn_escape_value Escapes string to be used as RDN value according to RFC 4514.
+ *
+ * ld_*_entry functions put names into DN as is, names which may contain special characters should be escaped with
+ * this function first.
+ * @param[in] ctx            Talloc ctx to use.
+ * @param[in] value          Value to escape.
+ * @return
+ *        - Escaped value.
+ *        - NULL on failure.
+ */
+char *ld_dn_escape_value(TALLOC_CTX *ctx, const char *value)
+{
+    if (!value)
+    {
+        ld_error("ld_dn_escape_value - invalid value!\n");
+        return NULL;
+    }
+
+    size_t length = strlen(value);
+    char *result = talloc_array(ctx, char, length * 3 + 1);
+    if (!result)
+    {
+        ld_error("ld_dn_escape_value - out of memory - unable to escape value!\n");
+        return NULL;
+    }
+
+    char *out = result;
+    for (size_t i = 0; i < length; ++i)
+    {
+        unsigned char symbol = (unsigned char)value[i];
+
+        if (symbol < 0x20 || symbol == 0x7f)
+        {
+            out += sprintf(out, "\\%02X", symbol);
+            continue;
+        }
+
+        if (strchr(",+\"\\<>;", symbol)
+            || (i == 0 && (symbol == '#' || symbol == ' '))
+            || (i == length - 1 && symbol == ' '))
+        {
+            *out++ = '\\';
+        }
+        *out++ = symbol;
+    }
+    *out = '\0';
+
+    return result;
+}
+
+/**
+ * @brief ld_dn_get_string Returns DN as it has been parsed.
+ */
+const char *ld_dn_get_string(const ld_dn_t *dn)
+{
+    return dn ? dn->dn : NULL;
+}
+
+/**
+ * @brief ld_dn_get_normalized Returns canonical form of DN.
+ */
+const char *ld_dn_get_normalized(const ld_dn_t *dn)
+{
+    return dn ? dn->normalized : NULL;
+}
+
+/**
+ * @brief ld_dn_get_hash Returns hash of canonical form of DN.
+ */
+uint64_t ld_dn_get_hash(const ld_dn_t *dn)
+{
+    return dn ? dn->hash : 0;
+}
+
+/**
+ * @brief ld_dn_get_rdn_count Returns amount of RDNs in DN.
+ */
+unsigned int ld_dn_get_rdn_count(const ld_dn_t *dn)
+{
+    return dn ? dn->n_rdns : 0;
+}
+
+/**
+ * @brief ld_dn_get_ava_count Returns amount of attribute types and values in DN.
+ */
+unsigned int ld_dn_get_ava_count(const ld_dn_t *dn)
+{
+    return dn ? dn->n_avas : 0;
+}
+
+/**
+ * @brief ld_dn_get_ava Returns attribute type and value by index.
+ * @param[in] dn        DN to work with.
+ * @param[in] index     Index of AVA, AVAs are ordered from leftmost RDN to rightmost.
+ * @return
+ *        - AVA, spans point into string returned by ld_dn_get_string.
+ *        - NULL if index is out of range.
+ */
+const ld_dn_ava_t *ld_dn_get_ava(const ld_dn_t *dn, unsigned int index)
+{
+    return dn && index < dn->n_avas ? &dn->avas[index] : NULL;
+}
+
+/**
+ * @brief ld_dn_get_parent Returns parent of DN.
+ * @param[in] ctx          Talloc ctx to use.
+ * @param[in] dn           DN to work with.
+ * @return
+ *        - Parent DN, empty DN for single RDN.
+ *        - NULL if DN is empty or on failure.
+ */
+ld_dn_t *ld_dn_get_parent(TALLOC_CTX *ctx, const ld_dn_t *dn)
+{
+    if (!dn || dn->n_rdns == 0)
+    {
+        return NULL;
+    }
+
+    for (unsigned int i = 0; i < dn->n_avas; ++i)
+    {
+        if (dn->avas[i].rdn == 1)
+        {
+            return ld_dn_parse(ctx, dn->avas[i].type, NULL);
+        }
+    }
+
+    return ld_dn_parse(ctx, "", NULL);
+}
+
+/**
+ * @brief ld_dn_equal Checks if DNs are equal.
+ */
+bool ld_dn_equal(const ld_dn_t *first, const ld_dn_t *second)
+{
+    if (!first || !second)
+    {
+        return false;
+    }
+
+    return first->hash == second->hash && strcmp(first->normalized, second->normalized) == 0;
+}
+
+/**
+ * @brief ld_dn_is_descendant Checks if DN is located in subtree of ancestor.
+ * @param[in] dn               DN to check.
+ * @param[in] ancestor         Root of the subtree.
+ * @return
+ *        - true if DN is descendant of ancestor.
+ *        - false if DN is ancestor itself or is not in its subtree.
+ */
+bool ld_dn_is_descendant(const ld_dn_t *dn, const ld_dn_t *ancestor)
+{
+    if (!dn || !ancestor || dn->n_rdns <= ancestor->n_rdns)
+    {
+        return false;
+    }
+
+    size_t offset = dn->rdn_offsets[dn->n_rdns - ancestor->n_rdns];
+
+    return strcmp(dn->normalized + offset, ancestor->normalized) == 0;
+}
+
+/**
+ * @brief ld_dn_is_parent Checks if DN is immediate child of parent.
+ */
+bool ld_dn_is_parent(const ld_dn_t *parent, const ld_dn_t *dn)
+{
+    return parent && dn && dn->n_rdns == parent->n_rdns + 1 && ld_dn_is_descendant(dn, parent);
+}
+
+/**
+ * @brief ld_dn_hash_func Hash function for GHashTable keyed by ld_dn_t.
+ */
+unsigned int ld_dn_hash_func(const void *dn)
+{
+    uint64_t hash = ((const ld_dn_t*)dn)->hash;
+
+    return (unsigned int)(hash ^ (hash >> 32));
+}
+
+/**
+ * @brief ld_dn_equal_func Equality function for GHashTable keyed by ld_dn_t.
+ */
+int ld_dn_equal_func(const void *first, const void *second)
+{
+    return ld_dn_equal(first, second);
+}
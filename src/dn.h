@@ -0,0 +1,68 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_DN_H
+#define LIBDOMAIN_DN_H
+
+#include <talloc.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*!
+ * @brief ld_dn_ava_t - Attribute type and value of the RDN, spans point into parsed string.
+ */
+typedef struct ld_dn_ava_s
+{
+    const char *type;                   //!< Attribute type as it appears in DN, not NULL terminated.
+    size_t type_len;                    //!< Length of attribute type.
+    const char *value;                  //!< Attribute value with escaping as it appears in DN, not NULL terminated.
+    size_t value_len;                   //!< Length of attribute value.
+    unsigned int rdn;                   //!< Index of RDN the AVA belongs to, 0 is the leftmost RDN.
+    bool hex;                           //!< Value is in #hexstring form.
+} ld_dn_ava_t;
+
+typedef struct ld_dn_s ld_dn_t;
+
+typedef struct ldap_schema_t ldap_schema_t;
+
+ld_dn_t *ld_dn_parse(TALLOC_CTX *ctx, const char *dn, const ldap_schema_t *schema);
+char *ld_dn_normalize(TALLOC_CTX *ctx, const char *dn);
+char *ld_dn_escape_value(TALLOC_CTX *ctx, const char *value);
+
+const char *ld_dn_get_string(const ld_dn_t *dn);
+const char *ld_dn_get_normalized(const ld_dn_t *dn);
+uint64_t ld_dn_get_hash(const ld_dn_t *dn);
+unsigned int ld_dn_get_rdn_count(const ld_dn_t *dn);
+unsigned int ld_dn_get_ava_count(const ld_dn_t *dn);
+const ld_dn_ava_t *ld_dn_get_ava(const ld_dn_t *dn, unsigned int index);
+
+ld_dn_t *ld_dn_get_parent(TALLOC_CTX *ctx, const ld_dn_t *dn);
+bool ld_dn_equal(const ld_dn_t *first, const ld_dn_t *second);
+bool ld_dn_is_descendant(const ld_dn_t *dn, const ld_dn_t *ancestor);
+bool ld_dn_is_parent(const ld_dn_t *parent, const ld_dn_t *dn);
+
+uint64_t ld_dn_hash_string(const char *normalized, size_t len);
+
+unsigned int ld_dn_hash_func(const void *dn);
+int ld_dn_equal_func(const void *first, const void *second);
+
+#endif //LIBDOMAIN_DN_H
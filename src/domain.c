@@ -24,6 +24,7 @@
 #include "connection.h"
 #include "connection_state_machine.h"
 #include "entry.h"
+#include "entry_diff.h"
 
 #include <stdio.h>
 
@@ -593,7 +594,7 @@ static LDAPMod ** fill_attributes(LDAPAttribute_t **entry_attrs, TALLOC_CTX *tal
 /**
  * @brief ld_add_entry    Creates the entry.
  * @param[in] handle      Pointer to libdomain session handle.
- * @param[in] name        Name of the entry.
+ * @param[in] name        Name of the entry, used as is.
  * @param[in] parent      Parent container that holds the entry.
  * @param[in] entry_attrs List of the attributes to create entry with.
  * @return
@@ -642,7 +643,7 @@ enum OperationReturnCode ld_add_entry(LDHandle *handle, const char *name, const
 /**
  * @brief ld_del_entry Deletes entry.
  * @param[in] handle   Pointer to libdomain session handle.
- * @param[in] name     Name of the entry.
+ * @param[in] name     Name of the entry, used as is.
  * @param[in] parent   Parent container that holds the entry.
  * @param[in] prefix   Prefix of the entry.
  * @return
@@ -686,7 +687,7 @@ enum OperationReturnCode ld_del_entry(LDHandle *handle, const char *name, const
 /**
  * @brief ld_mod_entry    Modifies the entry.
  * @param[in] handle      Pointer to libdomain session handle.
- * @param[in] name        Name of the entry.
+ * @param[in] name        Name of the entry, used as is.
  * @param[in] parent      Parent container that holds the entry.
  * @param[in] entry_attrs List of the attributes to modify.
  * @return
@@ -732,11 +733,60 @@ enum OperationReturnCode ld_mod_entry(LDHandle *handle, const char *name, const
         return RETURN_CODE_FAILURE;
 }
 
+/**
+ * @brief ld_mod_entry_diff Modifies only attribute values of the entry which differ from desired ones.
+ *
+ * Unlike ld_mod_entry nothing is sent when entry is already in sync.
+ * @param[in] handle      Pointer to libdomain session handle.
+ * @param[in] name        Name of the entry, used as is.
+ * @param[in] parent      Parent container that holds the entry.
+ * @param[in] prefix      Prefix for entry type.
+ * @param[in] entry_attrs List of the attributes in desired state.
+ * @param[in] baseline    Current state of the entry, when NULL it is read from server.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_mod_entry_diff(LDHandle *handle, const char *name, const char *parent, const char *prefix,
+                                           LDAPAttribute_t **entry_attrs, ld_entry_t *baseline)
+{
+    const char* entry_name = NULL;
+    const char* entry_parent = NULL;
+
+    enum OperationReturnCode rc = RETURN_CODE_FAILURE;
+
+    check_handle(handle, "ld_mod_entry_diff");
+
+    check_string(name, entry_name, "ld_mod_entry_diff");
+    check_string(parent, entry_parent, "ld_mod_entry_diff");
+
+    TALLOC_CTX *talloc_ctx = NULL;
+    ld_talloc_new(talloc_ctx, error_exit, NULL);
+
+    const char* dn;
+    ld_talloc_asprintf(dn, error_exit, talloc_ctx,"%s=%s,%s", prefix, entry_name, entry_parent);
+
+    rc = ld_entry_sync(handle->connection_ctx, dn, entry_attrs, baseline);
+
+    ld_talloc_free(talloc_ctx, error_exit);
+
+    return rc;
+
+    error_exit:
+        if (talloc_ctx)
+        {
+            talloc_free(talloc_ctx);
+            talloc_ctx = NULL;
+        }
+
+        return RETURN_CODE_FAILURE;
+}
+
 /**
  * @brief ld_rename_entry Renames the entry.
  * @param[in] handle      Pointer to libdomain session handle.
- * @param[in] old_name    Old name of the entry.
- * @param[in] new_name    New name of the entry.
+ * @param[in] old_name    Old name of the entry, used as is.
+ * @param[in] new_name    New name of the entry, used as is.
  * @param[in] parent      Parent container that holds the entry.
  * @param[in] prefix      Prefix for entry type.
  * @return
@@ -808,7 +858,7 @@ void ld_install_error_handler(LDHandle *handle, error_callback_fn callback)
 /**
  * @brief ld_mod_entry_attrs Modifies list of attributes using supplied operation.
  * @param[in] handle         Pointer to libdomain session handle.
- * @param[in] name           Name of the entry.
+ * @param[in] name           Name of the entry, used as is.
  * @param[in] parent         Parent container that holds the entry.
  * @param[in] prefix         Prefix of the entry.
  * @param[in] entry_attrs    List of the attributes to modify.
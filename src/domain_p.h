@@ -80,6 +80,8 @@ typedef struct ldhandle
         attrs[index]->values[1] = NULL; \
     }
 
+typedef struct ld_entry_s ld_entry_t;
+
 enum OperationReturnCode ld_add_entry(
     LDHandle *handle, const char *name, const char *parent, const char *prefix, LDAPAttribute_t **entry_attrs);
 enum OperationReturnCode ld_del_entry(LDHandle *handle, const char *name, const char *parent, const char *prefix);
@@ -90,6 +92,9 @@ enum OperationReturnCode ld_rename_entry(
 enum OperationReturnCode ld_mod_entry_attrs(
         LDHandle *handle, const char *name, const char *parent, const char *prefix, LDAPAttribute_t **entry_attrs,
         int opcode);
+enum OperationReturnCode ld_mod_entry_diff(
+        LDHandle *handle, const char *name, const char *parent, const char *prefix, LDAPAttribute_t **entry_attrs,
+        ld_entry_t *baseline);
 
 typedef struct LDAPAttribute_s LDAPAttribute_t;
 
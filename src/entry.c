@@ -20,9 +20,12 @@
 
 #include "entry.h"
 #include "entry_p.h"
+#include "entry_cache.h"
+#include "membership.h"
 #include "connection.h"
 #include "domain.h"
 #include "domain_p.h"
+#include "range_retrieval_p.h"
 
 /**
  * @brief add This function wraps ldap_add_ext function associating it with connection.
@@ -50,6 +53,7 @@ enum OperationReturnCode add(struct ldap_connection_ctx_t* connection, const cha
     struct ldap_request_t* request = &connection->read_requests[connection->n_read_requests];
     request->msgid = msgid;
     request->on_read_operation = add_on_read;
+    request->user_data = entry_cache_track_write(connection, dn, membership_mods_affect(attrs));
     ++connection->n_read_requests;
     request_queue_push(connection->callqueue, &request->node);
 
@@ -81,6 +85,8 @@ enum OperationReturnCode add_on_read(int rc, LDAPMessage *message, struct ldap_c
         ldap_memfree(diagnostic_message);
         ldap_memfree(dn);
 
+        entry_cache_complete_write(connection, error_code == LDAP_SUCCESS, false);
+
         switch (error_code)
         {
         case LDAP_SUCCESS:
@@ -98,6 +104,8 @@ enum OperationReturnCode add_on_read(int rc, LDAPMessage *message, struct ldap_c
         break;
     default:
     {
+        entry_cache_complete_write(connection, false, false);
+
         ldap_get_option(connection->ldap, LDAP_OPT_RESULT_CODE, (void*)&error_code);
         ldap_get_option(connection->ldap, LDAP_OPT_DIAGNOSTIC_MESSAGE, (void*)&diagnostic_message);
         ld_error("ldap_result failed: %s\n", diagnostic_message);
@@ -370,7 +378,9 @@ enum OperationReturnCode search_on_read(int rc, LDAPMessage *message, struct lda
 
                 entries[entry_index] = NULL;
 
-                int rc = connection->search_requests[i].on_search_operation(connection, entries, connection->search_requests[i].user_data);
+                // Attributes returned with range option are completed before entries reach the callback.
+                int rc = range_complete_entries(connection, entries, connection->search_requests[i].on_search_operation,
+                                                connection->search_requests[i].user_data);
 
                 connection_remove_search_request(connection, i);
 
@@ -429,6 +439,7 @@ enum OperationReturnCode modify(struct ldap_connection_ctx_t* connection, const
     struct ldap_request_t* request = &connection->read_requests[connection->n_read_requests];
     request->msgid = msgid;
     request->on_read_operation = modify_on_read;
+    request->user_data = entry_cache_track_write(connection, dn, membership_mods_affect(attrs));
     ++connection->n_read_requests;
     request_queue_push(connection->callqueue, &request->node);
 
@@ -460,6 +471,8 @@ enum OperationReturnCode modify_on_read(int rc, LDAPMessage *message, struct lda
         ldap_memfree(diagnostic_message);
         ldap_memfree(dn);
 
+        entry_cache_complete_write(connection, error_code == LDAP_SUCCESS, false);
+
         switch (error_code)
         {
         case LDAP_SUCCESS:
@@ -477,6 +490,8 @@ enum OperationReturnCode modify_on_read(int rc, LDAPMessage *message, struct lda
         break;
     default:
     {
+        entry_cache_complete_write(connection, false, false);
+
         ldap_get_option(connection->ldap, LDAP_OPT_RESULT_CODE, (void*)&error_code);
         ldap_get_option(connection->ldap, LDAP_OPT_DIAGNOSTIC_MESSAGE, (void*)&diagnostic_message);
         ld_error("ldap_result failed: %s\n", diagnostic_message);
@@ -518,6 +533,7 @@ enum OperationReturnCode ld_delete(struct ldap_connection_ctx_t* connection, con
     struct ldap_request_t* request = &connection->read_requests[connection->n_read_requests];
     request->msgid = msgid;
     request->on_read_operation = delete_on_read;
+    request->user_data = entry_cache_track_write(connection, dn, false);
     ++connection->n_read_requests;
     request_queue_push(connection->callqueue, &request->node);
 
@@ -549,6 +565,8 @@ enum OperationReturnCode delete_on_read(int rc, LDAPMessage *message, struct lda
         ldap_memfree(diagnostic_message);
         ldap_memfree(dn);
 
+        entry_cache_complete_write(connection, error_code == LDAP_SUCCESS, false);
+
         switch (error_code)
         {
         case LDAP_SUCCESS:
@@ -565,6 +583,8 @@ enum OperationReturnCode delete_on_read(int rc, LDAPMessage *message, struct lda
         break;
     default:
     {
+        entry_cache_complete_write(connection, false, false);
+
         ldap_get_option(connection->ldap, LDAP_OPT_RESULT_CODE, (void*)&error_code);
         ldap_get_option(connection->ldap, LDAP_OPT_DIAGNOSTIC_MESSAGE, (void*)&diagnostic_message);
         ld_error("ldap_result failed: %s\n", diagnostic_message);
@@ -673,6 +693,7 @@ enum OperationReturnCode ld_rename(struct ldap_connection_ctx_t *connection, con
     struct ldap_request_t* request = &connection->read_requests[connection->n_read_requests];
     request->msgid = msgid;
     request->on_read_operation = rename_on_read;
+    request->user_data = entry_cache_track_write(connection, olddn, false);
     ++connection->n_read_requests;
     request_queue_push(connection->callqueue, &request->node);
 
@@ -704,6 +725,8 @@ enum OperationReturnCode rename_on_read(int rc, LDAPMessage *message, ldap_conne
         ldap_memfree(diagnostic_message);
         ldap_memfree(dn);
 
+        entry_cache_complete_write(connection, error_code == LDAP_SUCCESS, true);
+
         switch (error_code)
         {
         case LDAP_SUCCESS:
@@ -720,6 +743,8 @@ enum OperationReturnCode rename_on_read(int rc, LDAPMessage *message, ldap_conne
         break;
     default:
     {
+        entry_cache_complete_write(connection, false, false);
+
         ldap_get_option(connection->ldap, LDAP_OPT_RESULT_CODE, (void*)&error_code);
         ldap_get_option(connection->ldap, LDAP_OPT_DIAGNOSTIC_MESSAGE, (void*)&diagnostic_message);
         ld_error("ldap_result failed: %s\n", diagnostic_message);
@@ -746,6 +771,29 @@ static int ld_entry_destructor(TALLOC_CTX *ctx)
     return 0;
 }
 
+/**
+ * @brief entry_attribute_hash Hashes attribute name ignoring case.
+ */
+static guint entry_attribute_hash(gconstpointer name)
+{
+    guint hash = 5381;
+
+    for (const char *current = name; *current != '\0'; ++current)
+    {
+        hash = hash * 33 + (guint)g_ascii_tolower(*current);
+    }
+
+    return hash;
+}
+
+/**
+ * @brief entry_attribute_equal Compares attribute names ignoring case.
+ */
+static gboolean entry_attribute_equal(gconstpointer first, gconstpointer second)
+{
+    return g_ascii_strcasecmp(first, second) == 0;
+}
+
 /**
  * @brief ld_entry_new Creates new ld_entry_t;
  * @param[in] ctx      Talloc ctx to use.
@@ -775,7 +823,8 @@ ld_entry_t* ld_entry_new(TALLOC_CTX *ctx, const char* dn)
     result->dn = NULL;
     ld_talloc_strdup_e(result->dn, error_exit, "ld_entry_new - out of memory - unable to create new ld_entry_t!\n", result, dn);
 
-    result->attributes = g_hash_table_new(g_str_hash, g_str_equal);
+    // Attribute names are case insensitive, table resolves case once instead of every caller.
+    result->attributes = g_hash_table_new(entry_attribute_hash, entry_attribute_equal);
 
     if (!result->attributes)
     {
@@ -796,6 +845,75 @@ ld_entry_t* ld_entry_new(TALLOC_CTX *ctx, const char* dn)
         return NULL;
 }
 
+/**
+ * @brief ld_entry_from_message Creates new ld_entry_t from search entry message.
+ * @param[in] ctx               Talloc ctx to use.
+ * @param[in] ldap              LDAP handle message belongs to.
+ * @param[in] message           Message of LDAP_RES_SEARCH_ENTRY type.
+ * @return
+ *        - Valid pointer to ld_entry_t, attributes are allocated as children of the entry.
+ *        - NULL on error.
+ */
+ld_entry_t *ld_entry_from_message(TALLOC_CTX *ctx, LDAP *ldap, LDAPMessage *message)
+{
+    BerElement *ber_element = NULL;
+    struct berval **values = NULL;
+    char *attribute = NULL;
+
+    char* dn = ldap_get_dn(ldap, message);
+    ld_entry_t* result = ld_entry_new(ctx, dn ? dn : "");
+    ldap_memfree(dn);
+
+    if (!result)
+    {
+        return NULL;
+    }
+
+    attribute = ldap_first_attribute(ldap, message, &ber_element);
+    while (attribute != NULL)
+    {
+        LDAPAttribute_t* ld_attribute = NULL;
+
+        ld_talloc_zero(ld_attribute, error_exit, result, LDAPAttribute_t);
+        ld_talloc_strdup(ld_attribute->name, error_exit, ld_attribute, attribute);
+
+        values = ldap_get_values_len(ldap, message, attribute);
+        int values_count = ldap_count_values_len(values);
+
+        ld_talloc_array(ld_attribute->values, error_exit, ld_attribute, char*, values_count + 1);
+
+        for (int values_index = 0; values_index < values_count; values_index++)
+        {
+            ld_talloc_strndup(ld_attribute->values[values_index], error_exit, ld_attribute->values,
+                              values[values_index]->bv_val, values[values_index]->bv_len);
+        }
+        ld_attribute->values[values_count] = NULL;
+        ldap_value_free_len(values);
+        values = NULL;
+
+        ld_entry_add_attribute(result, ld_attribute);
+
+        ldap_memfree(attribute);
+        attribute = ldap_next_attribute(ldap, message, ber_element);
+    }
+    ber_free(ber_element, 0);
+
+    return result;
+
+    error_exit:
+        if (values)
+        {
+            ldap_value_free_len(values);
+        }
+        if (attribute)
+        {
+            ldap_memfree(attribute);
+        }
+        ber_free(ber_element, 0);
+        talloc_free(result);
+        return NULL;
+}
+
 /**
  * @brief ld_entry_add_attribute Adds attribute to entry.
  * @param[in] entry              Entry to use.
@@ -835,7 +953,7 @@ enum OperationReturnCode ld_entry_add_attribute(ld_entry_t* entry, const LDAPAtt
 /**
  * @brief ld_entry_get_attribute Gets attribute from entry.
  * @param[in] entry              Entry to use.
- * @param[in] name_or_oid        Name of attribute.
+ * @param[in] name_or_oid        Name of attribute, compared case insensitively.
  * @return
  *        - NULL - if attribute not found.
  *        - Pointer to LDAPAttribute_t if attribute was found.
@@ -964,3 +1082,144 @@ LDAPAttribute_t **ld_entry_get_attributes(ld_entry_t *entry)
         }
         return NULL;
 }
+
+static void entry_append_uint32(GByteArray *buffer, uint32_t value)
+{
+    g_byte_array_append(buffer, (const guint8 *)&value, sizeof(value));
+}
+
+static void entry_append_string(GByteArray *buffer, const char *value)
+{
+    g_byte_array_append(buffer, (const guint8 *)value, strlen(value) + 1);
+}
+
+/**
+ * @brief entry_serialize Appends entry to buffer in form read by entry_deserialize.
+ *
+ * Entry is stored as the DN and the amount of attributes followed by the attributes. Every attribute is
+ * its name and the amount of values followed by the values. Strings are zero terminated, numbers are
+ * stored in host byte order, so records must not leave the host.
+ * @param[in] entry            Entry to serialize.
+ * @param[in] buffer           Buffer to append entry to.
+ */
+void entry_serialize(const ld_entry_t *entry, GByteArray *buffer)
+{
+    GHashTableIter iter;
+    gpointer value = NULL;
+
+    entry_append_string(buffer, entry->dn);
+    entry_append_uint32(buffer, g_hash_table_size(entry->attributes));
+
+    g_hash_table_iter_init(&iter, entry->attributes);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        LDAPAttribute_t *attribute = value;
+        uint32_t count = 0;
+
+        while (attribute->values && attribute->values[count])
+        {
+            ++count;
+        }
+
+        entry_append_string(buffer, attribute->name);
+        entry_append_uint32(buffer, count);
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            entry_append_string(buffer, attribute->values[i]);
+        }
+    }
+}
+
+static const char *entry_read_string(const char **cursor, const char *end)
+{
+    const char *result = *cursor;
+    const char *terminator = result < end ? memchr(result, '\0', end - result) : NULL;
+
+    if (!terminator)
+    {
+        return NULL;
+    }
+
+    *cursor = terminator + 1;
+
+    return result;
+}
+
+static bool entry_read_uint32(const char **cursor, const char *end, uint32_t *value)
+{
+    if (end - *cursor < (ptrdiff_t)sizeof(uint32_t))
+    {
+        return false;
+    }
+
+    memcpy(value, *cursor, sizeof(uint32_t));
+    *cursor += sizeof(uint32_t);
+
+    return true;
+}
+
+/**
+ * @brief entry_deserialize Creates entry from data produced by entry_serialize.
+ * @param[in] ctx             Talloc ctx to use.
+ * @param[in] data            Serialized entry, it does not have to be aligned.
+ * @param[in] length          Length of serialized entry.
+ * @return
+ *        - Entry, attributes are allocated as children of the entry.
+ *        - NULL if data is malformed or on failure.
+ */
+ld_entry_t *entry_deserialize(TALLOC_CTX *ctx, const char *data, size_t length)
+{
+    const char *cursor = data;
+    const char *end = data + length;
+    uint32_t attribute_count = 0;
+
+    const char *dn = entry_read_string(&cursor, end);
+
+    if (!dn || !entry_read_uint32(&cursor, end, &attribute_count))
+    {
+        return NULL;
+    }
+
+    ld_entry_t *result = ld_entry_new(ctx, dn);
+    if (!result)
+    {
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < attribute_count; ++i)
+    {
+        uint32_t value_count = 0;
+        const char *name = entry_read_string(&cursor, end);
+
+        if (!name || !entry_read_uint32(&cursor, end, &value_count) || value_count > (size_t)(end - cursor))
+        {
+            goto error_exit;
+        }
+
+        LDAPAttribute_t *attribute = NULL;
+        ld_talloc_zero(attribute, error_exit, result, LDAPAttribute_t);
+        ld_talloc_strdup(attribute->name, error_exit, attribute, name);
+        ld_talloc_array(attribute->values, error_exit, attribute, char*, value_count + 1);
+
+        for (uint32_t j = 0; j < value_count; ++j)
+        {
+            const char *value = entry_read_string(&cursor, end);
+            if (!value)
+            {
+                goto error_exit;
+            }
+
+            ld_talloc_strdup(attribute->values[j], error_exit, attribute->values, value);
+        }
+        attribute->values[value_count] = NULL;
+
+        ld_entry_add_attribute(result, attribute);
+    }
+
+    return result;
+
+    error_exit:
+        talloc_free(result);
+        return NULL;
+}
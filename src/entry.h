@@ -53,6 +53,7 @@ enum OperationReturnCode whoami(struct ldap_connection_ctx_t *connection);
 enum OperationReturnCode whoami_on_read(int rc, LDAPMessage *message, struct ldap_connection_ctx_t *connection);
 
 ld_entry_t *ld_entry_new(TALLOC_CTX* ctx, const char *dn);
+ld_entry_t *ld_entry_from_message(TALLOC_CTX* ctx, LDAP *ldap, LDAPMessage *message);
 const char *ld_entry_get_dn(ld_entry_t *entry);
 enum OperationReturnCode ld_entry_add_attribute(ld_entry_t *entry, const LDAPAttribute_t* attr);
 LDAPAttribute_t *ld_entry_get_attribute(ld_entry_t *entry, const char* name_or_oid);
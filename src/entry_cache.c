@@ -0,0 +1,959 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "entry_cache.h"
+#include "dn.h"
+#include "entry.h"
+#include "entry_p.h"
+
+#include "domain.h"
+#include "domain_p.h"
+#include "membership.h"
+
+#include <string.h>
+
+#include <glib-2.0/glib.h>
+
+static const char *UUID_ATTRIBUTES[] = { "entryUUID", "objectGUID", NULL };
+
+static char *DEFAULT_CACHE_ATTRIBUTES[] = { LDAP_ALL_USER_ATTRIBUTES, "entryUUID", NULL };
+
+/*!
+ * @brief entry_cache_item_t - Cached entry.
+ */
+typedef struct entry_cache_item_s
+{
+    char *key;                                  //!< Normalized DN of the entry.
+    char *uuid;                                 //!< entryUUID or objectGUID of the entry, may be NULL.
+    ld_entry_t *entry;                          //!< Cached entry, child of the item.
+    gint64 expires;                             //!< Monotonic time entry expires at, 0 if it never expires.
+    size_t size;                                //!< Memory used by the entry.
+    GList link;                                 //!< Link in the LRU list.
+} entry_cache_item_t;
+
+/*!
+ * @brief ld_entry_cache_t - LRU cache of directory entries.
+ */
+struct ld_entry_cache_s
+{
+    GHashTable *by_dn;                          //!< Normalized DN to entry_cache_item_t.
+    GHashTable *by_uuid;                        //!< UUID to entry_cache_item_t.
+    GHashTable *by_value;                       //!< Attribute to index of case folded values, built on first lookup.
+    GQueue lru;                                 //!< Items ordered from most to least recently used.
+
+    unsigned int max_entries;                   //!< Maximum amount of entries, 0 for unlimited.
+    size_t max_memory;                          //!< Maximum amount of memory used by entries, 0 for unlimited.
+    gint64 ttl;                                 //!< Time to live of entries in microseconds, 0 for unlimited.
+    char **attrs;                               //!< Attributes requested by ld_entry_cache_get.
+
+    size_t memory;                              //!< Memory used by entries.
+    unsigned long hits;                         //!< Amount of successful lookups.
+    unsigned long misses;                       //!< Amount of failed lookups.
+    unsigned long generation;                   //!< Incremented on every invalidation.
+
+    struct ldap_connection_ctx_t *connection;   //!< Connection cache is attached to.
+    ld_shared_cache_t *shared;                  //!< Cache shared between processes consulted on miss, may be NULL.
+};
+
+/*!
+ * @brief entry_cache_request_t - Read-through request started by ld_entry_cache_get.
+ */
+typedef struct entry_cache_request_s
+{
+    ld_entry_cache_t *cache;                    //!< Cache to fill.
+    unsigned long generation;                   //!< Generation of the cache at the moment request was sent.
+    search_callback_fn callback;                //!< User callback.
+    void *user_data;                            //!< User data passed to callback.
+} entry_cache_request_t;
+
+/**
+ * @brief entry_cache_adopt Makes all attributes of the entry children of the entry.
+ *
+ * Entries created by search_on_read keep their attributes on the handle's context.
+ * @param[in] entry          Entry to work with.
+ */
+static void entry_cache_adopt(ld_entry_t *entry)
+{
+    GHashTableIter iterator;
+    gpointer value = NULL;
+
+    g_hash_table_iter_init(&iterator, entry->attributes);
+    while (g_hash_table_iter_next(&iterator, NULL, &value))
+    {
+        LDAPAttribute_t *attribute = value;
+
+        talloc_steal(entry, attribute);
+        talloc_steal(attribute, attribute->name);
+
+        if (attribute->values)
+        {
+            talloc_steal(attribute, attribute->values);
+
+            for (char **current = attribute->values; *current != NULL; ++current)
+            {
+                talloc_steal(attribute->values, *current);
+            }
+        }
+    }
+}
+
+/**
+ * @brief entry_cache_index_item Adds item to or removes it from index of attribute values.
+ * @param[in] index          Case folded value to GPtrArray of entry_cache_item_t.
+ * @param[in] attribute      Indexed attribute.
+ * @param[in] item           Item to work with.
+ * @param[in] add            Add item if true, remove it otherwise.
+ */
+static void entry_cache_index_item(GHashTable *index, const char *attribute, entry_cache_item_t *item, bool add)
+{
+    LDAPAttribute_t *values = ld_entry_get_attribute(item->entry, attribute);
+    if (!values || !values->values)
+    {
+        return;
+    }
+
+    for (char **value = values->values; *value != NULL; ++value)
+    {
+        char *key = g_utf8_casefold(*value, -1);
+        GPtrArray *items = g_hash_table_lookup(index, key);
+
+        if (add && !items)
+        {
+            items = g_ptr_array_new();
+            g_hash_table_insert(index, key, items);
+            key = NULL;
+        }
+
+        if (add)
+        {
+            guint i = 0;
+            while (i < items->len && g_ptr_array_index(items, i) != item)
+            {
+                ++i;
+            }
+
+            // Values equal after case folding refer to the item once.
+            if (i == items->len)
+            {
+                g_ptr_array_add(items, item);
+            }
+        }
+        else if (items && g_ptr_array_remove(items, item) && items->len == 0)
+        {
+            g_hash_table_remove(index, key);
+        }
+
+        g_free(key);
+    }
+}
+
+/**
+ * @brief entry_cache_index_all Adds item to or removes it from all indexes of attribute values.
+ * @param[in] cache          Cache to work with.
+ * @param[in] item           Item to work with.
+ * @param[in] add            Add item if true, remove it otherwise.
+ */
+static void entry_cache_index_all(ld_entry_cache_t *cache, entry_cache_item_t *item, bool add)
+{
+    GHashTableIter iterator;
+    gpointer key = NULL, value = NULL;
+
+    g_hash_table_iter_init(&iterator, cache->by_value);
+    while (g_hash_table_iter_next(&iterator, &key, &value))
+    {
+        entry_cache_index_item(value, key, item, add);
+    }
+}
+
+/**
+ * @brief entry_cache_remove Removes item from cache and releases its entry.
+ * @param[in] cache          Cache to work with.
+ * @param[in] item           Item to remove.
+ */
+static void entry_cache_remove(ld_entry_cache_t *cache, entry_cache_item_t *item)
+{
+    g_hash_table_remove(cache->by_dn, item->key);
+
+    if (item->uuid && g_hash_table_lookup(cache->by_uuid, item->uuid) == item)
+    {
+        g_hash_table_remove(cache->by_uuid, item->uuid);
+    }
+
+    entry_cache_index_all(cache, item, false);
+
+    g_queue_unlink(&cache->lru, &item->link);
+    cache->memory -= item->size;
+
+    // Entries referenced by users are moved to the user's context.
+    talloc_free(item);
+}
+
+/**
+ * @brief entry_cache_evict Removes least recently used items until cache fits into limits.
+ * @param[in] cache         Cache to work with.
+ */
+static void entry_cache_evict(ld_entry_cache_t *cache)
+{
+    gint64 now = g_get_monotonic_time();
+
+    // Most recently inserted entry is kept even if it does not fit into limits alone.
+    while (cache->lru.tail && cache->lru.tail != cache->lru.head)
+    {
+        entry_cache_item_t *item = cache->lru.tail->data;
+
+        bool over_limit = (cache->max_entries && cache->lru.length > cache->max_entries)
+                       || (cache->max_memory && cache->memory > cache->max_memory);
+        bool expired = item->expires && item->expires <= now;
+
+        if (!over_limit && !expired)
+        {
+            break;
+        }
+
+        entry_cache_remove(cache, item);
+    }
+}
+
+/**
+ * @brief entry_cache_find Finds fresh item and marks it as most recently used.
+ * @param[in] cache        Cache to work with.
+ * @param[in] table        Table to search in.
+ * @param[in] key          Key of the item.
+ * @return
+ *        - Item on hit.
+ *        - NULL on miss.
+ */
+static entry_cache_item_t *entry_cache_find(ld_entry_cache_t *cache, GHashTable *table, const char *key)
+{
+    entry_cache_item_t *item = g_hash_table_lookup(table, key);
+
+    if (item && item->expires && item->expires <= g_get_monotonic_time())
+    {
+        entry_cache_remove(cache, item);
+        item = NULL;
+    }
+
+    if (!item)
+    {
+        ++cache->misses;
+        return NULL;
+    }
+
+    ++cache->hits;
+
+    g_queue_unlink(&cache->lru, &item->link);
+    g_queue_push_head_link(&cache->lru, &item->link);
+
+    return item;
+}
+
+/**
+ * @brief entry_cache_find_shared Finds fresh item, on miss copies entry from shared cache.
+ * @param[in] cache               Cache to work with.
+ * @param[in] key                 Normalized DN of the entry.
+ * @param[in] dn                  DN of the entry.
+ * @return
+ *        - Item on hit.
+ *        - NULL on miss.
+ */
+static entry_cache_item_t *entry_cache_find_shared(ld_entry_cache_t *cache, const char *key, const char *dn)
+{
+    entry_cache_item_t *item = entry_cache_find(cache, cache->by_dn, key);
+
+    if (item || !cache->shared)
+    {
+        return item;
+    }
+
+    ld_entry_t *entry = ld_shared_cache_lookup(cache->shared, cache, dn);
+    if (!entry)
+    {
+        return NULL;
+    }
+
+    if (ld_entry_cache_insert(cache, entry) != RETURN_CODE_SUCCESS)
+    {
+        talloc_free(entry);
+        return NULL;
+    }
+
+    return g_hash_table_lookup(cache->by_dn, key);
+}
+
+static int entry_cache_destructor(TALLOC_CTX *ctx)
+{
+    ld_entry_cache_t *cache = talloc_get_type_abort(ctx, ld_entry_cache_t);
+
+    if (cache->connection && cache->connection->entry_cache == cache)
+    {
+        cache->connection->entry_cache = NULL;
+    }
+
+    g_hash_table_destroy(cache->by_dn);
+    g_hash_table_destroy(cache->by_uuid);
+    g_hash_table_destroy(cache->by_value);
+
+    return 0;
+}
+
+/**
+ * @brief ld_entry_cache_new Creates new entry cache.
+ * @param[in] ctx            Talloc ctx to use.
+ * @param[in] max_entries    Maximum amount of cached entries, 0 for unlimited.
+ * @param[in] max_memory     Maximum amount of memory in bytes used by cached entries, 0 for unlimited.
+ * @param[in] ttl            Time to live of cached entries in seconds, 0 for unlimited.
+ * @param[in] attrs          Attributes requested by ld_entry_cache_get, NULL for all user attributes and entryUUID.
+ * @return
+ *        - Valid pointer to cache on success.
+ *        - NULL on failure.
+ */
+ld_entry_cache_t *ld_entry_cache_new(TALLOC_CTX *ctx,
+                                     unsigned int max_entries,
+                                     size_t max_memory,
+                                     unsigned int ttl,
+                                     char **attrs)
+{
+    ld_entry_cache_t *cache = NULL;
+
+    ld_talloc_zero_e(cache, error_exit, "ld_entry_cache_new - out of memory - unable to create cache!\n",
+                     ctx, ld_entry_cache_t);
+
+    cache->by_dn = g_hash_table_new(g_str_hash, g_str_equal);
+    cache->by_uuid = g_hash_table_new(g_str_hash, g_str_equal);
+    cache->by_value = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_hash_table_destroy);
+    g_queue_init(&cache->lru);
+
+    talloc_set_destructor((void*)cache, entry_cache_destructor);
+
+    cache->max_entries = max_entries;
+    cache->max_memory = max_memory;
+    cache->ttl = (gint64)ttl * G_USEC_PER_SEC;
+
+    if (!attrs)
+    {
+        attrs = DEFAULT_CACHE_ATTRIBUTES;
+    }
+
+    int attrs_count = 0;
+    while (attrs[attrs_count])
+    {
+        ++attrs_count;
+    }
+
+    ld_talloc_zero_array(cache->attrs, error_exit, cache, char*, attrs_count + 1);
+
+    for (int i = 0; i < attrs_count; ++i)
+    {
+        ld_talloc_strdup(cache->attrs[i], error_exit, cache->attrs, attrs[i]);
+    }
+
+    return cache;
+
+    error_exit:
+        talloc_free(cache);
+        return NULL;
+}
+
+/**
+ * @brief ld_entry_cache_attach Attaches cache to connection.
+ *
+ * Successful modify, ld_delete and ld_rename operations performed on the connection invalidate cached entries.
+ * @param[in] connection        Connection to work with.
+ * @param[in] cache             Cache to attach, NULL to detach current cache.
+ */
+void ld_entry_cache_attach(struct ldap_connection_ctx_t *connection, ld_entry_cache_t *cache)
+{
+    if (!connection)
+    {
+        ld_error("ld_entry_cache_attach - invalid connection!\n");
+        return;
+    }
+
+    if (connection->entry_cache)
+    {
+        connection->entry_cache->connection = NULL;
+    }
+
+    connection->entry_cache = cache;
+
+    if (cache)
+    {
+        cache->connection = connection;
+    }
+}
+
+/**
+ * @brief ld_entry_cache_set_shared Sets cache shared between processes on the host.
+ *
+ * Local misses are looked up in the shared cache before the server. When the process is the writer of
+ * the shared cache, entries fetched by ld_entry_cache_get are published to it. Invalidations are forwarded.
+ * @param[in] cache                 Cache to work with.
+ * @param[in] shared                Shared cache, NULL to stop using current one. Caller keeps ownership.
+ */
+void ld_entry_cache_set_shared(ld_entry_cache_t *cache, ld_shared_cache_t *shared)
+{
+    if (!cache)
+    {
+        ld_error("ld_entry_cache_set_shared - invalid cache!\n");
+        return;
+    }
+
+    cache->shared = shared;
+}
+
+/**
+ * @brief ld_entry_cache_insert Adds entry to cache replacing previous copy.
+ *
+ * Cache takes ownership of the entry and its attributes.
+ * @param[in] cache             Cache to work with.
+ * @param[in] entry             Entry to add.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_entry_cache_insert(ld_entry_cache_t *cache, ld_entry_t *entry)
+{
+    entry_cache_item_t *item = NULL;
+
+    if (!cache || !entry || !entry->dn)
+    {
+        ld_error("ld_entry_cache_insert - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    ld_talloc_zero(item, error_exit, cache, entry_cache_item_t);
+
+    item->key = ld_dn_normalize(item, entry->dn);
+    if (!item->key)
+    {
+        goto error_exit;
+    }
+
+    for (const char **name = UUID_ATTRIBUTES; *name != NULL; ++name)
+    {
+        LDAPAttribute_t *attribute = ld_entry_get_attribute(entry, *name);
+        if (attribute && attribute->values && attribute->values[0])
+        {
+            ld_talloc_strdup(item->uuid, error_exit, item, attribute->values[0]);
+            break;
+        }
+    }
+
+    entry_cache_item_t *previous = g_hash_table_lookup(cache->by_dn, item->key);
+    if (previous)
+    {
+        entry_cache_remove(cache, previous);
+    }
+
+    entry_cache_adopt(entry);
+    item->entry = talloc_steal(item, entry);
+    item->size = talloc_total_size(entry);
+    item->expires = cache->ttl ? g_get_monotonic_time() + cache->ttl : 0;
+    item->link.data = item;
+
+    g_hash_table_insert(cache->by_dn, item->key, item);
+    if (item->uuid)
+    {
+        g_hash_table_insert(cache->by_uuid, item->uuid, item);
+    }
+    g_queue_push_head_link(&cache->lru, &item->link);
+    cache->memory += item->size;
+    entry_cache_index_all(cache, item, true);
+
+    entry_cache_evict(cache);
+
+    return RETURN_CODE_SUCCESS;
+
+    error_exit:
+        talloc_free(item);
+        return RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief ld_entry_cache_lookup Looks up entry by DN.
+ * @param[in] cache             Cache to work with.
+ * @param[in] ctx               Talloc ctx that will hold reference to the entry.
+ * @param[in] dn                DN of the entry.
+ * @return
+ *        - Shared entry, release it with talloc_unlink(ctx, entry).
+ *        - NULL if entry is not cached or has expired.
+ */
+ld_entry_t *ld_entry_cache_lookup(ld_entry_cache_t *cache, TALLOC_CTX *ctx, const char *dn)
+{
+    if (!cache || !ctx || !dn)
+    {
+        ld_error("ld_entry_cache_lookup - invalid parameters!\n");
+        return NULL;
+    }
+
+    char *key = ld_dn_normalize(cache, dn);
+    if (!key)
+    {
+        return NULL;
+    }
+
+    entry_cache_item_t *item = entry_cache_find_shared(cache, key, dn);
+
+    talloc_free(key);
+
+    return item ? talloc_reference(ctx, item->entry) : NULL;
+}
+
+/**
+ * @brief ld_entry_cache_lookup_by_uuid Looks up entry by entryUUID or objectGUID value.
+ * @param[in] cache                     Cache to work with.
+ * @param[in] ctx                       Talloc ctx that will hold reference to the entry.
+ * @param[in] uuid                      Value of the attribute as it is stored in entry.
+ * @return
+ *        - Shared entry, release it with talloc_unlink(ctx, entry).
+ *        - NULL if entry is not cached or has expired.
+ */
+ld_entry_t *ld_entry_cache_lookup_by_uuid(ld_entry_cache_t *cache, TALLOC_CTX *ctx, const char *uuid)
+{
+    if (!cache || !ctx || !uuid)
+    {
+        ld_error("ld_entry_cache_lookup_by_uuid - invalid parameters!\n");
+        return NULL;
+    }
+
+    entry_cache_item_t *item = entry_cache_find(cache, cache->by_uuid, uuid);
+
+    return item ? talloc_reference(ctx, item->entry) : NULL;
+}
+
+/**
+ * @brief ld_entry_cache_foreach Calls callback for every fresh entry in the cache.
+ *
+ * Cache must not be modified by the callback. Order of entries and hit statistics are not changed.
+ * @param[in] cache              Cache to work with.
+ * @param[in] callback           Callback to call, entry is valid only during the call.
+ * @param[in] user_data          User data passed to callback.
+ */
+void ld_entry_cache_foreach(ld_entry_cache_t *cache, entry_cache_foreach_fn callback, void *user_data)
+{
+    if (!cache || !callback)
+    {
+        ld_error("ld_entry_cache_foreach - invalid parameters!\n");
+        return;
+    }
+
+    gint64 now = g_get_monotonic_time();
+
+    for (GList *current = cache->lru.head; current != NULL; current = current->next)
+    {
+        entry_cache_item_t *item = current->data;
+
+        if (!item->expires || item->expires > now)
+        {
+            callback(item->entry, user_data);
+        }
+    }
+}
+
+/**
+ * @brief ld_entry_cache_foreach_by_value Calls callback for every fresh entry having the value of the attribute.
+ *
+ * Values are compared case insensitively. Attribute is indexed on first lookup and stays indexed while cache exists,
+ * so following lookups do not depend on amount of cached entries. Cache must not be modified by the callback.
+ * Order of entries and hit statistics are not changed.
+ * @param[in] cache                       Cache to work with.
+ * @param[in] attribute                   Attribute to look value up in.
+ * @param[in] value                       Value of the attribute.
+ * @param[in] callback                    Callback to call, entry is valid only during the call.
+ * @param[in] user_data                   User data passed to callback.
+ */
+void ld_entry_cache_foreach_by_value(ld_entry_cache_t *cache,
+                                     const char *attribute,
+                                     const char *value,
+                                     entry_cache_foreach_fn callback,
+                                     void *user_data)
+{
+    if (!cache || !attribute || !value || !callback)
+    {
+        ld_error("ld_entry_cache_foreach_by_value - invalid parameters!\n");
+        return;
+    }
+
+    GHashTable *index = g_hash_table_lookup(cache->by_value, attribute);
+    if (!index)
+    {
+        index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_ptr_array_unref);
+        g_hash_table_insert(cache->by_value, g_strdup(attribute), index);
+
+        for (GList *current = cache->lru.head; current != NULL; current = current->next)
+        {
+            entry_cache_index_item(index, attribute, current->data, true);
+        }
+    }
+
+    char *key = g_utf8_casefold(value, -1);
+    GPtrArray *items = g_hash_table_lookup(index, key);
+    g_free(key);
+
+    gint64 now = g_get_monotonic_time();
+
+    for (guint i = 0; items && i < items->len; ++i)
+    {
+        entry_cache_item_t *item = g_ptr_array_index(items, i);
+
+        if (!item->expires || item->expires > now)
+        {
+            callback(item->entry, user_data);
+        }
+    }
+}
+
+/**
+ * @brief entry_cache_on_search Fills cache with entries received by ld_entry_cache_get.
+ * @param[in] connection        Connection to work with.
+ * @param[in] entries           Received entries.
+ * @param[in] user_data         Read-through request.
+ * @return Return code of user callback.
+ */
+static enum OperationReturnCode entry_cache_on_search(struct ldap_connection_ctx_t *connection,
+                                                      ld_entry_t **entries,
+                                                      void *user_data)
+{
+    entry_cache_request_t *request = user_data;
+    ld_entry_cache_t *cache = request->cache;
+    int count = 0;
+
+    for (int i = 0; entries[i] != NULL; ++i)
+    {
+        // Search result message is reported as entry without DN.
+        if (!entries[i]->dn || entries[i]->dn[0] == '\0')
+        {
+            talloc_free(entries[i]);
+            continue;
+        }
+
+        entries[count++] = entries[i];
+    }
+
+    entries[count] = NULL;
+
+    for (int i = 0; i < count; ++i)
+    {
+        ld_entry_t *entry = entries[i];
+        bool fresh = cache->generation == request->generation;
+
+        if (fresh && ld_shared_cache_is_writer(cache->shared))
+        {
+            ld_shared_cache_publish(cache->shared, entry);
+        }
+
+        // Entries fetched before invalidation may already be stale.
+        if (!fresh || ld_entry_cache_insert(cache, entry) != RETURN_CODE_SUCCESS)
+        {
+            entry_cache_adopt(entry);
+            talloc_steal(request, entry);
+        }
+
+        // Keeps entry alive if it is evicted by insertion of the next one.
+        entries[i] = talloc_reference(request, entry);
+    }
+
+    enum OperationReturnCode rc = request->callback(connection, entries, request->user_data);
+
+    talloc_free(entries);
+    talloc_free(request);
+
+    return rc;
+}
+
+/**
+ * @brief ld_entry_cache_get Reads entry through the cache attached to the connection.
+ *
+ * On hit callback is called immediately, otherwise entry is requested from server and cached.
+ * Entries passed to callback are shared and released after callback returns, use talloc_reference() to keep them.
+ * @param[in] connection     Connection to work with.
+ * @param[in] dn             DN of the entry.
+ * @param[in] callback       Callback to call with found entry.
+ * @param[in] user_data      User data passed to callback.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_entry_cache_get(struct ldap_connection_ctx_t *connection,
+                                            const char *dn,
+                                            search_callback_fn callback,
+                                            void *user_data)
+{
+    entry_cache_request_t *request = NULL;
+
+    if (!connection || !connection->entry_cache || !dn || !callback)
+    {
+        ld_error("ld_entry_cache_get - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    ld_entry_cache_t *cache = connection->entry_cache;
+
+    char *key = ld_dn_normalize(cache, dn);
+    if (!key)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    entry_cache_item_t *item = entry_cache_find_shared(cache, key, dn);
+
+    talloc_free(key);
+
+    if (item)
+    {
+        ld_entry_t *entries[2] = { talloc_reference(cache, item->entry), NULL };
+
+        callback(connection, entries, user_data);
+
+        talloc_unlink(cache, entries[0]);
+
+        return RETURN_CODE_SUCCESS;
+    }
+
+    ld_talloc_zero(request, error_exit, cache, entry_cache_request_t);
+    request->cache = cache;
+    request->generation = cache->generation;
+    request->callback = callback;
+    request->user_data = user_data;
+
+    if (search(connection, dn, LDAP_SCOPE_BASE, NULL, cache->attrs, false, entry_cache_on_search, request)
+        != RETURN_CODE_SUCCESS)
+    {
+        goto error_exit;
+    }
+
+    return RETURN_CODE_SUCCESS;
+
+    error_exit:
+        talloc_free(request);
+        return RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief ld_entry_cache_invalidate Removes entry from cache.
+ * @param[in] cache                 Cache to work with.
+ * @param[in] dn                    DN of the entry.
+ * @param[in] subtree               Remove all descendants of the entry as well.
+ */
+void ld_entry_cache_invalidate(ld_entry_cache_t *cache, const char *dn, bool subtree)
+{
+    if (!cache || !dn)
+    {
+        return;
+    }
+
+    ++cache->generation;
+
+    ld_shared_cache_invalidate(cache->shared, dn, subtree);
+
+    char *key = ld_dn_normalize(cache, dn);
+    if (!key)
+    {
+        // Entry can not be located reliably, drop everything rather than serve stale copy.
+        ld_entry_cache_clear(cache);
+        return;
+    }
+
+    entry_cache_item_t *item = g_hash_table_lookup(cache->by_dn, key);
+    if (item)
+    {
+        entry_cache_remove(cache, item);
+    }
+
+    if (subtree)
+    {
+        size_t key_length = strlen(key);
+        GList *current = cache->lru.head;
+
+        while (current)
+        {
+            GList *next = current->next;
+            entry_cache_item_t *descendant = current->data;
+            size_t length = strlen(descendant->key);
+
+            // Separators are escaped inside of canonical values, so comma always starts RDN.
+            if (length > key_length + 1
+                && descendant->key[length - key_length - 1] == ','
+                && strcmp(descendant->key + length - key_length, key) == 0)
+            {
+                entry_cache_remove(cache, descendant);
+            }
+
+            current = next;
+        }
+    }
+
+    talloc_free(key);
+}
+
+/**
+ * @brief ld_entry_cache_clear Removes all entries from cache.
+ * @param[in] cache            Cache to work with.
+ */
+void ld_entry_cache_clear(ld_entry_cache_t *cache)
+{
+    if (!cache)
+    {
+        return;
+    }
+
+    ++cache->generation;
+
+    while (cache->lru.head)
+    {
+        entry_cache_remove(cache, cache->lru.head->data);
+    }
+}
+
+/**
+ * @brief ld_entry_cache_count Returns amount of cached entries.
+ */
+unsigned int ld_entry_cache_count(const ld_entry_cache_t *cache)
+{
+    return cache ? cache->lru.length : 0;
+}
+
+/**
+ * @brief ld_entry_cache_memory Returns amount of memory used by cached entries.
+ */
+size_t ld_entry_cache_memory(const ld_entry_cache_t *cache)
+{
+    return cache ? cache->memory : 0;
+}
+
+/**
+ * @brief ld_entry_cache_hits Returns amount of successful lookups.
+ */
+unsigned long ld_entry_cache_hits(const ld_entry_cache_t *cache)
+{
+    return cache ? cache->hits : 0;
+}
+
+/**
+ * @brief ld_entry_cache_misses Returns amount of failed lookups.
+ */
+unsigned long ld_entry_cache_misses(const ld_entry_cache_t *cache)
+{
+    return cache ? cache->misses : 0;
+}
+
+/*!
+ * @brief entry_cache_write_t - Write request tracked to invalidate caches on completion.
+ */
+typedef struct entry_cache_write_s
+{
+    char *dn;                                   //!< DN of the entry.
+    bool membership;                            //!< Request changes attributes holding group members.
+} entry_cache_write_t;
+
+/**
+ * @brief entry_cache_track_write Remembers DN of the entry changed by write request.
+ * @param[in] connection          Connection request is sent through.
+ * @param[in] dn                  DN of the entry.
+ * @param[in] membership          Request changes attributes holding group members.
+ * @return
+ *        - Tracked write to store in ldap_request_t::user_data, allocated on the connection.
+ *        - NULL if connection has no cache attached.
+ */
+void *entry_cache_track_write(struct ldap_connection_ctx_t *connection, const char *dn, bool membership)
+{
+    if ((!connection->entry_cache && !connection->membership_cache) || !dn)
+    {
+        return NULL;
+    }
+
+    // Requests dropped without calling their callback do not leak tracked writes past the connection.
+    entry_cache_write_t *write = talloc_zero(connection, entry_cache_write_t);
+    if (!write)
+    {
+        return NULL;
+    }
+
+    write->dn = talloc_strdup(write, dn);
+    write->membership = membership;
+
+    if (!write->dn)
+    {
+        talloc_free(write);
+        return NULL;
+    }
+
+    return write;
+}
+
+/**
+ * @brief entry_cache_invalidate_write Drops cached data affected by successful write to the entry.
+ *
+ * Every write path calls it, so entry and membership caches stay consistent with each other.
+ * @param[in] connection               Connection write has been completed on.
+ * @param[in] dn                       DN of the changed entry.
+ * @param[in] subtree                  Entry's descendants have been changed as well.
+ * @param[in] membership               Write changes attributes holding group members.
+ */
+void entry_cache_invalidate_write(struct ldap_connection_ctx_t *connection, const char *dn, bool subtree,
+                                  bool membership)
+{
+    if (!connection || !dn)
+    {
+        return;
+    }
+
+    if (connection->entry_cache)
+    {
+        ld_entry_cache_invalidate(connection->entry_cache, dn, subtree);
+    }
+
+    if (connection->membership_cache)
+    {
+        // New members of the group may be anywhere, their group sets do not mention the group yet.
+        if (membership)
+        {
+            ld_membership_cache_clear(connection->membership_cache);
+        }
+        else
+        {
+            ld_membership_cache_invalidate(connection->membership_cache, dn, subtree);
+        }
+    }
+}
+
+/**
+ * @brief entry_cache_complete_write Invalidates entry changed by completed write request.
+ * @param[in] connection             Connection request has been completed on.
+ * @param[in] success                Request has succeeded.
+ * @param[in] subtree                Entry's descendants have been changed as well.
+ */
+void entry_cache_complete_write(struct ldap_connection_ctx_t *connection, bool success, bool subtree)
+{
+    entry_cache_write_t *write = connection->request_user_data;
+
+    if (!write)
+    {
+        return;
+    }
+
+    if (success)
+    {
+        entry_cache_invalidate_write(connection, write->dn, subtree, write->membership);
+    }
+
+    talloc_free(write);
+    connection->request_user_data = NULL;
+}
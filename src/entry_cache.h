@@ -0,0 +1,76 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_ENTRY_CACHE_H
+#define LIBDOMAIN_ENTRY_CACHE_H
+
+#include "common.h"
+#include "connection.h"
+#include "shared_cache.h"
+
+#include <stdbool.h>
+
+/**
+ * Entries handed out by the cache are shared, they must be treated as read only and released with
+ * talloc_unlink(ctx, entry) or by freeing ctx. Released entries stay valid after they have been evicted.
+ */
+
+ld_entry_cache_t *ld_entry_cache_new(TALLOC_CTX *ctx,
+                                     unsigned int max_entries,
+                                     size_t max_memory,
+                                     unsigned int ttl,
+                                     char **attrs);
+
+void ld_entry_cache_attach(struct ldap_connection_ctx_t *connection, ld_entry_cache_t *cache);
+void ld_entry_cache_set_shared(ld_entry_cache_t *cache, ld_shared_cache_t *shared);
+
+enum OperationReturnCode ld_entry_cache_insert(ld_entry_cache_t *cache, ld_entry_t *entry);
+
+ld_entry_t *ld_entry_cache_lookup(ld_entry_cache_t *cache, TALLOC_CTX *ctx, const char *dn);
+ld_entry_t *ld_entry_cache_lookup_by_uuid(ld_entry_cache_t *cache, TALLOC_CTX *ctx, const char *uuid);
+
+typedef void (*entry_cache_foreach_fn)(ld_entry_t *entry, void *user_data);
+
+void ld_entry_cache_foreach(ld_entry_cache_t *cache, entry_cache_foreach_fn callback, void *user_data);
+void ld_entry_cache_foreach_by_value(ld_entry_cache_t *cache,
+                                     const char *attribute,
+                                     const char *value,
+                                     entry_cache_foreach_fn callback,
+                                     void *user_data);
+
+enum OperationReturnCode ld_entry_cache_get(struct ldap_connection_ctx_t *connection,
+                                            const char *dn,
+                                            search_callback_fn callback,
+                                            void *user_data);
+
+void ld_entry_cache_invalidate(ld_entry_cache_t *cache, const char *dn, bool subtree);
+void ld_entry_cache_clear(ld_entry_cache_t *cache);
+
+unsigned int ld_entry_cache_count(const ld_entry_cache_t *cache);
+size_t ld_entry_cache_memory(const ld_entry_cache_t *cache);
+unsigned long ld_entry_cache_hits(const ld_entry_cache_t *cache);
+unsigned long ld_entry_cache_misses(const ld_entry_cache_t *cache);
+
+void *entry_cache_track_write(struct ldap_connection_ctx_t *connection, const char *dn, bool membership);
+void entry_cache_complete_write(struct ldap_connection_ctx_t *connection, bool success, bool subtree);
+void entry_cache_invalidate_write(struct ldap_connection_ctx_t *connection, const char *dn, bool subtree,
+                                  bool membership);
+
+#endif //LIBDOMAIN_ENTRY_CACHE_H
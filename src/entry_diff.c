@@ -0,0 +1,443 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "entry_diff.h"
+#include "domain.h"
+#include "domain_p.h"
+#include "entry.h"
+#include "entry_p.h"
+#include "filter_match_p.h"
+
+#include "helper_p.h"
+
+#include <string.h>
+
+#include <glib-2.0/glib.h>
+
+/*!
+ * @brief entry_sync_t - Synchronization waiting for current state of the entry.
+ */
+typedef struct entry_sync_s
+{
+    char *dn;                                   //!< DN of the entry.
+    LDAPAttribute_t **desired;                  //!< Desired state of attributes.
+} entry_sync_t;
+
+/**
+ * @brief entry_diff_key Returns value attribute values are compared by.
+ *
+ * Values invalid for the matching rule are compared as is.
+ */
+static char *entry_diff_key(TALLOC_CTX *ctx, const ldap_schema_t *schema, enum FilterRule rule, const char *value)
+{
+    char *result = filter_normalize_key(ctx, schema, rule, value, true);
+
+    return result ? result : talloc_strdup(ctx, value);
+}
+
+/**
+ * @brief entry_diff_mod Creates modification of the attribute.
+ * @param[in] ctx        Talloc ctx to use.
+ * @param[in] mod_op     Operation e.g. LDAP_MOD_REPLACE.
+ * @param[in] name       Name of the attribute.
+ * @param[in] values     Values of modification, NULL or empty array for none.
+ * @return
+ *        - Modification.
+ *        - NULL on failure.
+ */
+static LDAPMod *entry_diff_mod(TALLOC_CTX *ctx, int mod_op, const char *name, GPtrArray *values)
+{
+    LDAPMod *result = NULL;
+
+    ld_talloc_zero(result, error_exit, ctx, LDAPMod);
+    result->mod_op = mod_op;
+    ld_talloc_strdup(result->mod_type, error_exit, result, name);
+
+    if (values && values->len > 0)
+    {
+        ld_talloc_array(result->mod_values, error_exit, result, char*, values->len + 1);
+        for (guint i = 0; i < values->len; ++i)
+        {
+            ld_talloc_strdup(result->mod_values[i], error_exit, result->mod_values, g_ptr_array_index(values, i));
+        }
+        result->mod_values[values->len] = NULL;
+    }
+
+    return result;
+
+    error_exit:
+        talloc_free(result);
+        return NULL;
+}
+
+/**
+ * @brief entry_diff_attribute Appends modifications turning current values of attribute into desired ones.
+ *
+ * Single replace is used when no current value is kept or when it is not larger than separate delete and add.
+ * @param[in] ctx              Talloc ctx to allocate modifications on.
+ * @param[in] schema           Schema to resolve matching rule with, may be NULL.
+ * @param[in] current          Current state of attribute, NULL if attribute is absent.
+ * @param[in] desired          Desired state of attribute.
+ * @param[in] mods             Array to append modifications to.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode entry_diff_attribute(TALLOC_CTX *ctx, const ldap_schema_t *schema,
+                                                     const LDAPAttribute_t *current, const LDAPAttribute_t *desired,
+                                                     GPtrArray *mods)
+{
+    enum OperationReturnCode rc = RETURN_CODE_FAILURE;
+    enum FilterRule rule = filter_attribute_rule(schema, desired->name);
+    TALLOC_CTX *keys = talloc_new(NULL);
+    GHashTable *current_values = g_hash_table_new(g_str_hash, g_str_equal);
+    GHashTable *desired_values = g_hash_table_new(g_str_hash, g_str_equal);
+    GPtrArray *wanted = g_ptr_array_new();
+    GPtrArray *added = g_ptr_array_new();
+    GPtrArray *removed = g_ptr_array_new();
+    LDAPMod *mod = NULL;
+
+    if (!keys)
+    {
+        ld_error("entry_diff_attribute - out of memory - unable to compare values!\n");
+        goto exit;
+    }
+
+    for (int i = 0; current && current->values && current->values[i]; ++i)
+    {
+        char *key = entry_diff_key(keys, schema, rule, current->values[i]);
+        if (!key)
+        {
+            ld_error("entry_diff_attribute - out of memory - unable to compare values!\n");
+            goto exit;
+        }
+        g_hash_table_insert(current_values, key, current->values[i]);
+    }
+
+    for (int i = 0; desired->values && desired->values[i]; ++i)
+    {
+        char *key = entry_diff_key(keys, schema, rule, desired->values[i]);
+        if (!key)
+        {
+            ld_error("entry_diff_attribute - out of memory - unable to compare values!\n");
+            goto exit;
+        }
+        if (g_hash_table_contains(desired_values, key))
+        {
+            continue;
+        }
+
+        g_hash_table_insert(desired_values, key, desired->values[i]);
+        g_ptr_array_add(wanted, desired->values[i]);
+
+        if (!g_hash_table_contains(current_values, key))
+        {
+            g_ptr_array_add(added, desired->values[i]);
+        }
+    }
+
+    GHashTableIter iter;
+    gpointer key = NULL;
+    gpointer value = NULL;
+
+    g_hash_table_iter_init(&iter, current_values);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+        if (!g_hash_table_contains(desired_values, key))
+        {
+            g_ptr_array_add(removed, value);
+        }
+    }
+
+    guint current_count = g_hash_table_size(current_values);
+
+    if (added->len == 0 && removed->len == 0)
+    {
+        rc = RETURN_CODE_SUCCESS;
+        goto exit;
+    }
+
+    if (wanted->len == 0)
+    {
+        mod = entry_diff_mod(ctx, LDAP_MOD_DELETE, desired->name, NULL);
+    }
+    else if (removed->len == current_count || added->len + removed->len >= wanted->len)
+    {
+        mod = entry_diff_mod(ctx, LDAP_MOD_REPLACE, desired->name, wanted);
+    }
+    else
+    {
+        if (removed->len > 0)
+        {
+            if (!(mod = entry_diff_mod(ctx, LDAP_MOD_DELETE, desired->name, removed)))
+            {
+                goto exit;
+            }
+            g_ptr_array_add(mods, mod);
+            mod = NULL;
+        }
+
+        if (added->len == 0)
+        {
+            rc = RETURN_CODE_SUCCESS;
+            goto exit;
+        }
+
+        mod = entry_diff_mod(ctx, LDAP_MOD_ADD, desired->name, added);
+    }
+
+    if (mod)
+    {
+        g_ptr_array_add(mods, mod);
+        rc = RETURN_CODE_SUCCESS;
+    }
+
+    exit:
+        g_ptr_array_free(removed, TRUE);
+        g_ptr_array_free(added, TRUE);
+        g_ptr_array_free(wanted, TRUE);
+        g_hash_table_destroy(desired_values);
+        g_hash_table_destroy(current_values);
+        talloc_free(keys);
+
+        return rc;
+}
+
+/**
+ * @brief ld_entry_diff Computes minimal modification turning the entry into desired state.
+ *
+ * Attributes absent from desired state are left untouched, attribute with empty list of values is removed.
+ * Attribute absent from baseline is replaced, so baseline may hold only part of attributes e.g. cached entry.
+ * @param[in] ctx         Talloc ctx to use.
+ * @param[in] schema      Schema to resolve equality matching rules with, may be NULL.
+ * @param[in] baseline    Current state of the entry, NULL if unknown.
+ * @param[in] desired     NULL terminated list of attributes in desired state.
+ * @return
+ *        - NULL terminated list of modifications, empty if entry is in sync.
+ *        - NULL on failure.
+ */
+LDAPMod **ld_entry_diff(TALLOC_CTX *ctx,
+                        const ldap_schema_t *schema,
+                        ld_entry_t *baseline,
+                        LDAPAttribute_t **desired)
+{
+    LDAPMod **result = NULL;
+    TALLOC_CTX *talloc_ctx = NULL;
+    GHashTable *current = NULL;
+    GPtrArray *mods = NULL;
+
+    if (!desired)
+    {
+        ld_error("ld_entry_diff - invalid parameters!\n");
+        return NULL;
+    }
+
+    // Server may return names in different case than requested.
+    current = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    if (baseline && baseline->attributes)
+    {
+        GHashTableIter iter;
+        gpointer key = NULL;
+        gpointer value = NULL;
+
+        g_hash_table_iter_init(&iter, baseline->attributes);
+        while (g_hash_table_iter_next(&iter, &key, &value))
+        {
+            g_hash_table_insert(current, g_ascii_strdown(key, -1), value);
+        }
+    }
+
+    mods = g_ptr_array_new();
+
+    ld_talloc_new(talloc_ctx, error_exit, NULL);
+
+    for (int i = 0; desired[i]; ++i)
+    {
+        if (!desired[i]->name)
+        {
+            ld_error("ld_entry_diff - attribute without name!\n");
+            goto error_exit;
+        }
+
+        char *name = g_ascii_strdown(desired[i]->name, -1);
+        const LDAPAttribute_t *attribute = g_hash_table_lookup(current, name);
+        g_free(name);
+
+        if (entry_diff_attribute(talloc_ctx, schema, attribute, desired[i], mods) != RETURN_CODE_SUCCESS)
+        {
+            goto error_exit;
+        }
+    }
+
+    ld_talloc_array_e(result, error_exit, "ld_entry_diff - out of memory - unable to create modifications!\n",
+                      ctx, LDAPMod*, mods->len + 1);
+
+    for (guint i = 0; i < mods->len; ++i)
+    {
+        result[i] = talloc_steal(result, g_ptr_array_index(mods, i));
+    }
+    result[mods->len] = NULL;
+
+    talloc_free(talloc_ctx);
+    g_ptr_array_free(mods, TRUE);
+    g_hash_table_destroy(current);
+
+    return result;
+
+    error_exit:
+        talloc_free(talloc_ctx);
+        if (mods)
+        {
+            g_ptr_array_free(mods, TRUE);
+        }
+        g_hash_table_destroy(current);
+
+        return NULL;
+}
+
+/**
+ * @brief entry_sync_apply Sends modification turning the entry into desired state, sends nothing if it is in sync.
+ */
+static enum OperationReturnCode entry_sync_apply(struct ldap_connection_ctx_t *connection, const char *dn,
+                                                 LDAPAttribute_t **desired, ld_entry_t *baseline)
+{
+    LDAPMod **mods = ld_entry_diff(NULL, connection->schema, baseline, desired);
+    if (!mods)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    enum OperationReturnCode rc = RETURN_CODE_SUCCESS;
+
+    if (mods[0])
+    {
+        rc = modify(connection, dn, mods);
+    }
+    else
+    {
+        ld_info("Entry %s is already in sync\n", dn);
+    }
+
+    talloc_free(mods);
+
+    return rc;
+}
+
+static enum OperationReturnCode entry_sync_on_search(struct ldap_connection_ctx_t *connection,
+                                                     ld_entry_t **entries,
+                                                     void *user_data)
+{
+    entry_sync_t *sync = talloc_get_type_abort(user_data, entry_sync_t);
+    enum OperationReturnCode rc = RETURN_CODE_FAILURE;
+
+    if (entries && entries[0])
+    {
+        rc = entry_sync_apply(connection, sync->dn, sync->desired, entries[0]);
+    }
+    else
+    {
+        ld_error("entry_sync_on_search - entry %s was not found!\n", sync->dn);
+    }
+
+    talloc_free(sync);
+
+    return rc;
+}
+
+/**
+ * @brief ld_entry_sync Modifies only attribute values which differ from desired state.
+ *
+ * When baseline is not provided current values of desired attributes are read from server first.
+ * @param[in] connection  Connection to work with.
+ * @param[in] dn          DN of the entry.
+ * @param[in] desired     NULL terminated list of attributes in desired state.
+ * @param[in] baseline    Current state of the entry e.g. entry from ld_entry_cache_lookup, may be NULL.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_entry_sync(struct ldap_connection_ctx_t *connection,
+                                       const char *dn,
+                                       LDAPAttribute_t **desired,
+                                       ld_entry_t *baseline)
+{
+    entry_sync_t *sync = NULL;
+    char **attrs = NULL;
+    int count = 0;
+
+    if (!connection || !dn || !desired)
+    {
+        ld_error("ld_entry_sync - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (baseline)
+    {
+        return entry_sync_apply(connection, dn, desired, baseline);
+    }
+
+    while (desired[count])
+    {
+        ++count;
+    }
+
+    if (count == 0)
+    {
+        return RETURN_CODE_SUCCESS;
+    }
+
+    ld_talloc_zero_e(sync, error_exit, "ld_entry_sync - out of memory - unable to create synchronization!\n",
+                     connection->handle->talloc_ctx, entry_sync_t);
+    ld_talloc_strdup(sync->dn, error_exit, sync, dn);
+
+    ld_talloc_zero_array(sync->desired, error_exit, sync, LDAPAttribute_t*, count + 1);
+    ld_talloc_zero_array(attrs, error_exit, sync, char*, count + 1);
+
+    for (int i = 0; i < count; ++i)
+    {
+        int values_count = 0;
+        while (desired[i]->values && desired[i]->values[values_count])
+        {
+            ++values_count;
+        }
+
+        ld_talloc_zero(sync->desired[i], error_exit, sync->desired, LDAPAttribute_t);
+        ld_talloc_strdup(sync->desired[i]->name, error_exit, sync->desired[i], desired[i]->name);
+        ld_talloc_zero_array(sync->desired[i]->values, error_exit, sync->desired[i], char*, values_count + 1);
+        for (int j = 0; j < values_count; ++j)
+        {
+            ld_talloc_strdup(sync->desired[i]->values[j], error_exit, sync->desired[i]->values, desired[i]->values[j]);
+        }
+
+        attrs[i] = sync->desired[i]->name;
+    }
+
+    if (search(connection, dn, LDAP_SCOPE_BASE, NULL, attrs, false, entry_sync_on_search, sync)
+        != RETURN_CODE_SUCCESS)
+    {
+        goto error_exit;
+    }
+
+    return RETURN_CODE_SUCCESS;
+
+    error_exit:
+        talloc_free(sync);
+        return RETURN_CODE_FAILURE;
+}
@@ -0,0 +1,46 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_ENTRY_DIFF_H
+#define LIBDOMAIN_ENTRY_DIFF_H
+
+#include "common.h"
+#include "connection.h"
+#include "schema.h"
+
+typedef struct LDAPAttribute_s LDAPAttribute_t;
+
+/**
+ * Entry diff compares desired state of attributes with current state of the entry and produces minimal
+ * modification. Values are compared with equality matching rules of attributes, attributes absent from
+ * desired state are left untouched, attribute with empty list of values is removed.
+ */
+
+LDAPMod **ld_entry_diff(TALLOC_CTX *ctx,
+                        const ldap_schema_t *schema,
+                        ld_entry_t *baseline,
+                        LDAPAttribute_t **desired);
+
+enum OperationReturnCode ld_entry_sync(struct ldap_connection_ctx_t *connection,
+                                       const char *dn,
+                                       LDAPAttribute_t **desired,
+                                       ld_entry_t *baseline);
+
+#endif //LIBDOMAIN_ENTRY_DIFF_H
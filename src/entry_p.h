@@ -33,4 +33,7 @@ typedef struct ld_entry_s
 
 void connection_remove_search_request(struct ldap_connection_ctx_t *connection, int index);
 
+void entry_serialize(const ld_entry_t *entry, GByteArray *buffer);
+ld_entry_t *entry_deserialize(TALLOC_CTX *ctx, const char *data, size_t length);
+
 #endif //LIBDOMAIN_ENTRY_PRIVATE_H
@@ -0,0 +1,887 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "export.h"
+#include "directory.h"
+#include "domain.h"
+#include "entry_p.h"
+
+#include "helper_p.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib-2.0/glib.h>
+
+#define EXPORT_BUFFER_SIZE (64 * 1024)
+#define EXPORT_PAGE_SIZE 1000
+#define EXPORT_LDIF_LINE_WIDTH 76
+#define EXPORT_CSV_BASE64_PREFIX "{base64}"
+
+/*!
+ * @brief export_search_t - Search streamed into the export by ld_export_search.
+ */
+typedef struct export_search_s
+{
+    char *base_dn;                              //!< Base of the search.
+    int scope;                                  //!< Scope of the search.
+    char *filter;                               //!< Filter of the search.
+    bool paged;                                 //!< Results are requested page by page.
+    struct berval cookie;                       //!< Paged results cookie of the next page.
+
+    export_complete_callback_fn callback;       //!< Completion callback.
+    void *user_data;                            //!< User data passed to callback.
+} export_search_t;
+
+/*!
+ * @brief ld_export_t - Writer of entries.
+ */
+struct ld_export_s
+{
+    int fd;                                     //!< Descriptor output is written to.
+    enum LdapExportFormat format;               //!< Output format.
+    char **attrs;                               //!< Requested attributes, NULL for all user attributes.
+    int n_attrs;                                //!< Amount of requested attributes.
+
+    char *buffer;                               //!< Output not written yet.
+    size_t length;                              //!< Length of the output in buffer.
+    bool failed;                                //!< Write has failed, nothing is written any more.
+    unsigned long count;                        //!< Amount of written entries.
+
+    GString *line;                              //!< Line being formatted.
+    GString **columns;                          //!< CSV fields of the current entry, DN first.
+    bool first_attribute;                       //!< No attribute of the current JSON object has been written yet.
+
+    export_search_t *search;                    //!< Active search, NULL if there is none.
+};
+
+static int export_destructor(TALLOC_CTX *ctx)
+{
+    ld_export_t *exporter = talloc_get_type_abort(ctx, ld_export_t);
+
+    g_string_free(exporter->line, TRUE);
+
+    for (int i = 0; exporter->columns && i <= exporter->n_attrs; ++i)
+    {
+        g_string_free(exporter->columns[i], TRUE);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief export_write_fd Writes data to the descriptor.
+ */
+static void export_write_fd(ld_export_t *exporter, const char *data, size_t length)
+{
+    while (length > 0 && !exporter->failed)
+    {
+        ssize_t written = write(exporter->fd, data, length);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            ld_error("export_write_fd - unable to write output: %s\n", strerror(errno));
+            exporter->failed = true;
+            return;
+        }
+
+        data += written;
+        length -= written;
+    }
+}
+
+/**
+ * @brief export_write Appends data to the output buffer, writes buffer out when it is full.
+ */
+static void export_write(ld_export_t *exporter, const char *data, size_t length)
+{
+    if (exporter->length + length > EXPORT_BUFFER_SIZE)
+    {
+        export_write_fd(exporter, exporter->buffer, exporter->length);
+        exporter->length = 0;
+    }
+
+    if (length >= EXPORT_BUFFER_SIZE)
+    {
+        export_write_fd(exporter, data, length);
+        return;
+    }
+
+    memcpy(exporter->buffer + exporter->length, data, length);
+    exporter->length += length;
+}
+
+static void export_puts(ld_export_t *exporter, const char *data)
+{
+    export_write(exporter, data, strlen(data));
+}
+
+/**
+ * @brief export_is_safe_string Checks whether value may be written to LDIF as is.
+ */
+static bool export_is_safe_string(const char *value, size_t length)
+{
+    if (length == 0)
+    {
+        return true;
+    }
+
+    if (value[0] == ' ' || value[0] == ':' || value[0] == '<' || value[length - 1] == ' ')
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < length; ++i)
+    {
+        unsigned char c = value[i];
+        if (c == '\0' || c == '\n' || c == '\r' || c >= 0x80)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief export_is_text Checks whether value is valid UTF-8 text.
+ */
+static bool export_is_text(const char *value, size_t length)
+{
+    return memchr(value, '\0', length) == NULL && g_utf8_validate(value, length, NULL);
+}
+
+/**
+ * @brief export_ldif_line Writes line of LDIF record folding it into lines of EXPORT_LDIF_LINE_WIDTH characters.
+ */
+static void export_ldif_line(ld_export_t *exporter, const char *name, const char *value, size_t length)
+{
+    GString *line = exporter->line;
+
+    g_string_assign(line, name);
+    g_string_append_c(line, ':');
+
+    if (export_is_safe_string(value, length))
+    {
+        if (length > 0)
+        {
+            g_string_append_c(line, ' ');
+            g_string_append_len(line, value, length);
+        }
+    }
+    else
+    {
+        gchar *encoded = g_base64_encode((const guchar *)value, length);
+        g_string_append(line, ": ");
+        g_string_append(line, encoded);
+        g_free(encoded);
+    }
+
+    size_t position = MIN(line->len, EXPORT_LDIF_LINE_WIDTH);
+    export_write(exporter, line->str, position);
+
+    while (position < line->len)
+    {
+        size_t chunk = MIN(line->len - position, EXPORT_LDIF_LINE_WIDTH - 1);
+        export_write(exporter, "\n ", 2);
+        export_write(exporter, line->str + position, chunk);
+        position += chunk;
+    }
+
+    export_write(exporter, "\n", 1);
+}
+
+/**
+ * @brief export_json_string Writes value as JSON string.
+ */
+static void export_json_string(ld_export_t *exporter, const char *value, size_t length)
+{
+    GString *line = exporter->line;
+
+    g_string_assign(line, "\"");
+
+    for (size_t i = 0; i < length; ++i)
+    {
+        unsigned char c = value[i];
+        switch (c)
+        {
+        case '"':
+            g_string_append(line, "\\\"");
+            break;
+        case '\\':
+            g_string_append(line, "\\\\");
+            break;
+        case '\n':
+            g_string_append(line, "\\n");
+            break;
+        case '\r':
+            g_string_append(line, "\\r");
+            break;
+        case '\t':
+            g_string_append(line, "\\t");
+            break;
+        default:
+            if (c < 0x20)
+            {
+                g_string_append_printf(line, "\\u%04x", c);
+            }
+            else
+            {
+                g_string_append_c(line, c);
+            }
+            break;
+        }
+    }
+
+    g_string_append_c(line, '"');
+
+    export_write(exporter, line->str, line->len);
+}
+
+/**
+ * @brief export_csv_field Writes CSV field quoting it when needed.
+ */
+static void export_csv_field(ld_export_t *exporter, const GString *field)
+{
+    if (strpbrk(field->str, ",\"\r\n") == NULL
+        && (field->len == 0 || (field->str[0] != ' ' && field->str[field->len - 1] != ' ')))
+    {
+        export_write(exporter, field->str, field->len);
+        return;
+    }
+
+    GString *line = exporter->line;
+
+    g_string_assign(line, "\"");
+    for (size_t i = 0; i < field->len; ++i)
+    {
+        if (field->str[i] == '"')
+        {
+            g_string_append_c(line, '"');
+        }
+        g_string_append_c(line, field->str[i]);
+    }
+    g_string_append_c(line, '"');
+
+    export_write(exporter, line->str, line->len);
+}
+
+/**
+ * @brief export_begin Starts writing of the entry.
+ */
+static void export_begin(ld_export_t *exporter, const char *dn)
+{
+    switch (exporter->format)
+    {
+    case LD_EXPORT_LDIF:
+        export_ldif_line(exporter, "dn", dn, strlen(dn));
+        break;
+    case LD_EXPORT_JSON_LINES:
+        export_puts(exporter, "{\"dn\":");
+        export_json_string(exporter, dn, strlen(dn));
+        export_puts(exporter, ",\"attributes\":{");
+        exporter->first_attribute = true;
+        break;
+    case LD_EXPORT_CSV:
+        for (int i = 0; i <= exporter->n_attrs; ++i)
+        {
+            g_string_truncate(exporter->columns[i], 0);
+        }
+        g_string_assign(exporter->columns[0], dn);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief export_attribute Writes values of the attribute of the current entry.
+ */
+static void export_attribute(ld_export_t *exporter, const char *name, struct berval **values)
+{
+    switch (exporter->format)
+    {
+    case LD_EXPORT_LDIF:
+        for (int i = 0; values && values[i]; ++i)
+        {
+            export_ldif_line(exporter, name, values[i]->bv_val, values[i]->bv_len);
+        }
+        break;
+    case LD_EXPORT_JSON_LINES:
+        if (!exporter->first_attribute)
+        {
+            export_write(exporter, ",", 1);
+        }
+        exporter->first_attribute = false;
+
+        export_json_string(exporter, name, strlen(name));
+        export_write(exporter, ":[", 2);
+
+        for (int i = 0; values && values[i]; ++i)
+        {
+            if (i > 0)
+            {
+                export_write(exporter, ",", 1);
+            }
+
+            if (export_is_text(values[i]->bv_val, values[i]->bv_len))
+            {
+                export_json_string(exporter, values[i]->bv_val, values[i]->bv_len);
+            }
+            else
+            {
+                gchar *encoded = g_base64_encode((const guchar *)values[i]->bv_val, values[i]->bv_len);
+                export_puts(exporter, "{\"base64\":\"");
+                export_puts(exporter, encoded);
+                export_puts(exporter, "\"}");
+                g_free(encoded);
+            }
+        }
+
+        export_write(exporter, "]", 1);
+        break;
+    case LD_EXPORT_CSV:
+        for (int column = 0; column < exporter->n_attrs; ++column)
+        {
+            if (g_ascii_strcasecmp(exporter->attrs[column], name) != 0)
+            {
+                continue;
+            }
+
+            GString *field = exporter->columns[column + 1];
+
+            for (int i = 0; values && values[i]; ++i)
+            {
+                if (field->len > 0)
+                {
+                    g_string_append_c(field, '\n');
+                }
+
+                if (export_is_text(values[i]->bv_val, values[i]->bv_len))
+                {
+                    g_string_append_len(field, values[i]->bv_val, values[i]->bv_len);
+                }
+                else
+                {
+                    gchar *encoded = g_base64_encode((const guchar *)values[i]->bv_val, values[i]->bv_len);
+                    g_string_append(field, EXPORT_CSV_BASE64_PREFIX);
+                    g_string_append(field, encoded);
+                    g_free(encoded);
+                }
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief export_end Completes writing of the entry.
+ */
+static enum OperationReturnCode export_end(ld_export_t *exporter)
+{
+    switch (exporter->format)
+    {
+    case LD_EXPORT_LDIF:
+        export_write(exporter, "\n", 1);
+        break;
+    case LD_EXPORT_JSON_LINES:
+        export_write(exporter, "}}\n", 3);
+        break;
+    case LD_EXPORT_CSV:
+        for (int i = 0; i <= exporter->n_attrs; ++i)
+        {
+            if (i > 0)
+            {
+                export_write(exporter, ",", 1);
+            }
+            export_csv_field(exporter, exporter->columns[i]);
+        }
+        export_write(exporter, "\r\n", 2);
+        break;
+    default:
+        break;
+    }
+
+    ++exporter->count;
+
+    return exporter->failed ? RETURN_CODE_FAILURE : RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief ld_export_new Creates writer of entries.
+ *
+ * LDIF output starts with version line, CSV output starts with header row.
+ * @param[in] ctx           Talloc ctx to use.
+ * @param[in] fd            Descriptor to write output to, it is not closed by export.
+ * @param[in] format        Output format.
+ * @param[in] attrs         Attributes to request, NULL for all user attributes. Required for CSV and define
+ *                          its columns.
+ * @return
+ *        - Export.
+ *        - NULL on failure.
+ */
+ld_export_t *ld_export_new(TALLOC_CTX *ctx, int fd, enum LdapExportFormat format, char **attrs)
+{
+    ld_export_t *result = NULL;
+
+    if (fd < 0 || format < LD_EXPORT_LDIF || format > LD_EXPORT_CSV || (format == LD_EXPORT_CSV && !attrs))
+    {
+        ld_error("ld_export_new - invalid parameters!\n");
+        return NULL;
+    }
+
+    ld_talloc_zero_e(result, error_exit, "ld_export_new - out of memory - unable to create export!\n",
+                     ctx, ld_export_t);
+
+    result->line = g_string_new(NULL);
+    talloc_set_destructor((void*)result, export_destructor);
+
+    result->fd = fd;
+    result->format = format;
+
+    ld_talloc_array(result->buffer, error_exit, result, char, EXPORT_BUFFER_SIZE);
+
+    if (attrs)
+    {
+        while (attrs[result->n_attrs])
+        {
+            ++result->n_attrs;
+        }
+
+        ld_talloc_zero_array(result->attrs, error_exit, result, char*, result->n_attrs + 1);
+        for (int i = 0; i < result->n_attrs; ++i)
+        {
+            ld_talloc_strdup(result->attrs[i], error_exit, result->attrs, attrs[i]);
+        }
+    }
+
+    switch (format)
+    {
+    case LD_EXPORT_LDIF:
+        export_puts(result, "version: 1\n\n");
+        break;
+    case LD_EXPORT_CSV:
+    {
+        ld_talloc_zero_array(result->columns, error_exit, result, GString*, result->n_attrs + 1);
+
+        result->columns[0] = g_string_new("dn");
+        for (int i = 0; i < result->n_attrs; ++i)
+        {
+            result->columns[i + 1] = g_string_new(result->attrs[i]);
+        }
+
+        // Header row is written as a regular row, it is not counted as entry.
+        export_end(result);
+        result->count = 0;
+    }
+        break;
+    default:
+        break;
+    }
+
+    return result;
+
+    error_exit:
+        talloc_free(result);
+        return NULL;
+}
+
+/**
+ * @brief ld_export_entry Writes the entry.
+ *
+ * In LDIF and JSON Lines all attributes of the entry are written, in CSV only selected ones.
+ * @param[in] exporter      Export to work with.
+ * @param[in] entry         Entry to write.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_export_entry(ld_export_t *exporter, ld_entry_t *entry)
+{
+    if (!exporter || !entry || !entry->dn)
+    {
+        ld_error("ld_export_entry - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    export_begin(exporter, entry->dn);
+
+    GHashTableIter iter;
+    gpointer key = NULL;
+    gpointer value = NULL;
+
+    g_hash_table_iter_init(&iter, entry->attributes);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+        LDAPAttribute_t *attribute = value;
+        int count = 0;
+
+        while (attribute->values && attribute->values[count])
+        {
+            ++count;
+        }
+
+        struct berval *bervals = g_new0(struct berval, count);
+        struct berval **values = g_new0(struct berval*, count + 1);
+
+        for (int i = 0; i < count; ++i)
+        {
+            bervals[i].bv_val = attribute->values[i];
+            bervals[i].bv_len = strlen(attribute->values[i]);
+            values[i] = &bervals[i];
+        }
+
+        export_attribute(exporter, attribute->name, values);
+
+        g_free(values);
+        g_free(bervals);
+    }
+
+    return export_end(exporter);
+}
+
+/**
+ * @brief ld_export_message Writes entry of search result message without converting it into ld_entry_t.
+ * @param[in] exporter      Export to work with.
+ * @param[in] ldap          LDAP handle message belongs to.
+ * @param[in] message       Message of LDAP_RES_SEARCH_ENTRY type.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_export_message(ld_export_t *exporter, LDAP *ldap, LDAPMessage *message)
+{
+    BerElement *ber_element = NULL;
+
+    if (!exporter || !ldap || !message)
+    {
+        ld_error("ld_export_message - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    char *dn = ldap_get_dn(ldap, message);
+    if (!dn)
+    {
+        ld_error("ld_export_message - unable to get DN of the entry!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    export_begin(exporter, dn);
+    ldap_memfree(dn);
+
+    for (char *attribute = ldap_first_attribute(ldap, message, &ber_element);
+         attribute != NULL;
+         attribute = ldap_next_attribute(ldap, message, ber_element))
+    {
+        struct berval **values = ldap_get_values_len(ldap, message, attribute);
+
+        export_attribute(exporter, attribute, values);
+
+        ldap_value_free_len(values);
+        ldap_memfree(attribute);
+    }
+
+    ber_free(ber_element, 0);
+
+    return export_end(exporter);
+}
+
+/**
+ * @brief ld_export_flush Writes buffered output.
+ * @param[in] exporter     Export to work with.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE if some of writes has failed.
+ */
+enum OperationReturnCode ld_export_flush(ld_export_t *exporter)
+{
+    if (!exporter)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    export_write_fd(exporter, exporter->buffer, exporter->length);
+    exporter->length = 0;
+
+    return exporter->failed ? RETURN_CODE_FAILURE : RETURN_CODE_SUCCESS;
+}
+
+static enum OperationReturnCode export_on_read(int rc, LDAPMessage *message, struct ldap_connection_ctx_t *connection);
+
+/**
+ * @brief export_search_send Sends request for the next page of search results.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode export_search_send(struct ldap_connection_ctx_t *connection, ld_export_t *exporter)
+{
+    export_search_t *search = exporter->search;
+    LDAPControl *controls[2] = { NULL, NULL };
+    int msgid = 0;
+
+    if (search->paged && ldap_create_page_control(connection->ldap, EXPORT_PAGE_SIZE, &search->cookie, 0,
+                                                  &controls[0]) != LDAP_SUCCESS)
+    {
+        ld_error("export_search_send - unable to create paged results control!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    int rc = ldap_search_ext(connection->ldap,
+                             search->base_dn,
+                             search->scope,
+                             search->filter,
+                             exporter->attrs,
+                             0,
+                             controls,
+                             NULL,
+                             NULL,
+                             LDAP_NO_LIMIT,
+                             &msgid);
+
+    if (controls[0])
+    {
+        ldap_control_free(controls[0]);
+    }
+
+    if (rc != LDAP_SUCCESS)
+    {
+        ld_error("Unable to create export search request: %s\n", ldap_err2string(rc));
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (connection_add_stream_request(connection, msgid, export_on_read, exporter) != RETURN_CODE_SUCCESS)
+    {
+        ldap_abandon_ext(connection->ldap, msgid, NULL, NULL);
+        return RETURN_CODE_FAILURE;
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief export_search_finish Completes search, flushes output and calls completion callback.
+ * @return RETURN_CODE_SUCCESS to remove request from connection.
+ */
+static enum OperationReturnCode export_search_finish(struct ldap_connection_ctx_t *connection,
+                                                     ld_export_t *exporter,
+                                                     enum OperationReturnCode rc)
+{
+    export_search_t *search = exporter->search;
+    export_complete_callback_fn callback = search->callback;
+    void *user_data = search->user_data;
+
+    exporter->search = NULL;
+    talloc_free(search);
+
+    if (ld_export_flush(exporter) != RETURN_CODE_SUCCESS)
+    {
+        rc = RETURN_CODE_FAILURE;
+    }
+
+    // Callback may free the export.
+    callback(connection, exporter, rc, user_data);
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief export_search_result Processes search result, requests next page if there is one.
+ * @return RETURN_CODE_SUCCESS to remove request from connection.
+ */
+static enum OperationReturnCode export_search_result(struct ldap_connection_ctx_t *connection,
+                                                     ld_export_t *exporter,
+                                                     LDAPMessage *message)
+{
+    export_search_t *search = exporter->search;
+    int error_code = 0;
+    char *diagnostic_message = NULL;
+    LDAPControl **controls = NULL;
+    bool more_results = false;
+
+    if (ldap_parse_result(connection->ldap, message, &error_code, NULL, &diagnostic_message, NULL, &controls, 0)
+        != LDAP_SUCCESS)
+    {
+        return export_search_finish(connection, exporter, RETURN_CODE_FAILURE);
+    }
+
+    if (error_code != LDAP_SUCCESS)
+    {
+        ld_error("Export search request failed: %s %s\n", ldap_err2string(error_code),
+                 diagnostic_message ? diagnostic_message : "");
+
+        ldap_memfree(diagnostic_message);
+        ldap_controls_free(controls);
+
+        return export_search_finish(connection, exporter, RETURN_CODE_FAILURE);
+    }
+
+    ldap_memfree(diagnostic_message);
+
+    LDAPControl *control = search->paged ? ldap_control_find(LDAP_CONTROL_PAGEDRESULTS, controls, NULL) : NULL;
+    if (control)
+    {
+        ber_int_t count = 0;
+        struct berval cookie = { 0, NULL };
+
+        if (ldap_parse_pageresponse_control(connection->ldap, control, &count, &cookie) == LDAP_SUCCESS)
+        {
+            talloc_free(search->cookie.bv_val);
+            search->cookie.bv_val = cookie.bv_len > 0 ? talloc_memdup(search, cookie.bv_val, cookie.bv_len) : NULL;
+            search->cookie.bv_len = search->cookie.bv_val ? cookie.bv_len : 0;
+            more_results = search->cookie.bv_len > 0;
+            ber_memfree(cookie.bv_val);
+        }
+    }
+
+    ldap_controls_free(controls);
+
+    if (more_results && !exporter->failed)
+    {
+        return export_search_send(connection, exporter) == RETURN_CODE_SUCCESS
+                ? RETURN_CODE_SUCCESS
+                : export_search_finish(connection, exporter, RETURN_CODE_FAILURE);
+    }
+
+    return export_search_finish(connection, exporter, exporter->failed ? RETURN_CODE_FAILURE : RETURN_CODE_SUCCESS);
+}
+
+/**
+ * @brief export_on_read This callback is called when messages of export search arrive.
+ * @param[in] rc            Return code of ldap_result.
+ * @param[in] message       Message received from ldap.
+ * @param[in] connection    Connection to work with.
+ * @return
+ *        - RETURN_CODE_OPERATION_IN_PROGRESS while results are being received.
+ *        - RETURN_CODE_SUCCESS when request has been completed.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode export_on_read(int rc, LDAPMessage *message, struct ldap_connection_ctx_t *connection)
+{
+    ld_export_t *exporter = connection->request_user_data;
+
+    if (!exporter || !exporter->search)
+    {
+        ld_error("export_on_read - export is missing!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (rc == LDAP_RES_ANY)
+    {
+        return export_search_finish(connection, exporter, RETURN_CODE_FAILURE);
+    }
+
+    for (LDAPMessage *current = ldap_first_message(connection->ldap, message);
+         current != NULL;
+         current = ldap_next_message(connection->ldap, current))
+    {
+        switch (ldap_msgtype(current))
+        {
+        case LDAP_RES_SEARCH_ENTRY:
+            ld_export_message(exporter, connection->ldap, current);
+            break;
+        case LDAP_RES_SEARCH_REFERENCE:
+            ld_info("Received search referral but not following it!");
+            break;
+        case LDAP_RES_SEARCH_RESULT:
+            return export_search_result(connection, exporter, current);
+        default:
+            break;
+        }
+    }
+
+    return RETURN_CODE_OPERATION_IN_PROGRESS;
+}
+
+/**
+ * @brief ld_export_search Writes entries of the search as they arrive.
+ *
+ * Results are requested page by page when server supports paged results, so size limit of the server does
+ * not apply. Attributes passed to ld_export_new are requested.
+ * @param[in] connection   Connection to work with, should be in LDAP_CONNECTION_STATE_RUN state.
+ * @param[in] exporter     Export to write entries to.
+ * @param[in] base_dn      Base of the search.
+ * @param[in] scope        Scope of the search.
+ * @param[in] filter       Filter of the search.
+ * @param[in] callback     Callback to call once all entries have been written.
+ * @param[in] user_data    User data passed to callback.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_OPERATION_IN_PROGRESS if export already runs a search.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_export_search(struct ldap_connection_ctx_t *connection,
+                                          ld_export_t *exporter,
+                                          const char *base_dn,
+                                          int scope,
+                                          const char *filter,
+                                          export_complete_callback_fn callback,
+                                          void *user_data)
+{
+    export_search_t *search = NULL;
+
+    if (!connection || !exporter || !base_dn || !filter || !callback)
+    {
+        ld_error("ld_export_search - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (exporter->search)
+    {
+        return RETURN_CODE_OPERATION_IN_PROGRESS;
+    }
+
+    ld_talloc_zero(search, error_exit, exporter, export_search_t);
+    ld_talloc_strdup(search->base_dn, error_exit, search, base_dn);
+    ld_talloc_strdup(search->filter, error_exit, search, filter);
+    search->scope = scope;
+    search->paged = directory_has_capability(connection, LDAP_CAPABILITY_PAGED_RESULTS);
+    search->callback = callback;
+    search->user_data = user_data;
+
+    exporter->search = search;
+
+    if (export_search_send(connection, exporter) != RETURN_CODE_SUCCESS)
+    {
+        exporter->search = NULL;
+        goto error_exit;
+    }
+
+    return RETURN_CODE_SUCCESS;
+
+    error_exit:
+        talloc_free(search);
+        return RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief ld_export_get_count Returns amount of written entries.
+ */
+unsigned long ld_export_get_count(const ld_export_t *exporter)
+{
+    return exporter ? exporter->count : 0;
+}
@@ -0,0 +1,70 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_EXPORT_H
+#define LIBDOMAIN_EXPORT_H
+
+#include "common.h"
+#include "connection.h"
+
+#include <stdbool.h>
+
+/**
+ * Export writes entries in LDIF, JSON Lines or CSV through a buffered writer. Entries of ld_export_search are
+ * written straight from messages of the response stream and released right away, so memory use does not depend
+ * on amount of exported entries. Binary values are base64 encoded.
+ */
+
+enum LdapExportFormat
+{
+    LD_EXPORT_LDIF       = 1,           //!< RFC 2849 content records.
+    LD_EXPORT_JSON_LINES = 2,           //!< One JSON object per line, binary values as {"base64": "..."}.
+    LD_EXPORT_CSV        = 3,           //!< DN and selected attributes, values of multi-valued attributes on separate lines.
+};
+
+typedef struct ld_export_s ld_export_t;
+
+/**
+ * @brief export_complete_callback_fn Callback fired when search started by ld_export_search completes.
+ *
+ * Buffered output is flushed before callback is called.
+ */
+typedef void (*export_complete_callback_fn)(struct ldap_connection_ctx_t *connection,
+                                            ld_export_t *exporter,
+                                            enum OperationReturnCode rc,
+                                            void *user_data);
+
+ld_export_t *ld_export_new(TALLOC_CTX *ctx, int fd, enum LdapExportFormat format, char **attrs);
+
+enum OperationReturnCode ld_export_entry(ld_export_t *exporter, ld_entry_t *entry);
+enum OperationReturnCode ld_export_message(ld_export_t *exporter, LDAP *ldap, LDAPMessage *message);
+enum OperationReturnCode ld_export_flush(ld_export_t *exporter);
+
+enum OperationReturnCode ld_export_search(struct ldap_connection_ctx_t *connection,
+                                          ld_export_t *exporter,
+                                          const char *base_dn,
+                                          int scope,
+                                          const char *filter,
+                                          export_complete_callback_fn callback,
+                                          void *user_data);
+
+unsigned long ld_export_get_count(const ld_export_t *exporter);
+
+#endif //LIBDOMAIN_EXPORT_H
@@ -0,0 +1,1263 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "filter.h"
+#include "filter_p.h"
+
+#include "helper_p.h"
+
+#include <string.h>
+
+#include <glib-2.0/glib.h>
+
+enum
+{
+    FILTER_INITIAL_BUFFER_SIZE = 256,
+    FILTER_MAX_DEPTH = 256,
+};
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+/*!
+ * @brief filter_segment_t - Part of compiled template, literal text followed by optional parameter.
+ */
+typedef struct filter_segment_s
+{
+    char *literal;                      //!< Literal text of the filter.
+    size_t literal_len;                 //!< Length of literal text.
+    int parameter;                      //!< Index of parameter following the literal, -1 for the last segment.
+} filter_segment_t;
+
+/*!
+ * @brief ld_filter_template_t - Filter parsed once and rendered with different values.
+ */
+struct ld_filter_template_s
+{
+    ld_filter_t *filter;                //!< Parsed template.
+    filter_segment_t *segments;         //!< Compiled segments of template.
+    unsigned int n_segments;            //!< Amount of segments.
+    unsigned int n_parameters;          //!< Amount of parameters.
+    char *buffer;                       //!< Buffer reused between renderings.
+    size_t buffer_size;                 //!< Allocated size of buffer.
+};
+
+/*!
+ * @brief filter_parser_t - State of the filter parser.
+ */
+typedef struct filter_parser_s
+{
+    const char *in;                     //!< Filter being parsed.
+    const char *p;                      //!< Current position.
+    const char *end;                    //!< End of filter.
+    bool parameters;                    //!< Values consisting of single '?' are template parameters.
+    unsigned int n_parameters;          //!< Amount of parameters found.
+    const char *error;                  //!< Description of the parse error.
+} filter_parser_t;
+
+/*!
+ * @brief filter_writer_t - Growing buffer filters are written to.
+ */
+typedef struct filter_writer_s
+{
+    TALLOC_CTX *ctx;                    //!< Parent of the buffer and segments.
+    char *data;                         //!< Buffer.
+    size_t len;                         //!< Length of written data.
+    size_t size;                        //!< Allocated size of buffer.
+    bool compile;                       //!< Parameters split written data into segments.
+    filter_segment_t *segments;         //!< Compiled segments.
+    unsigned int n_segments;            //!< Amount of compiled segments.
+    bool failed;                        //!< Memory allocation failed.
+} filter_writer_t;
+
+static void filter_writer_reserve(filter_writer_t *writer, size_t len)
+{
+    if (writer->failed || writer->len + len < writer->size)
+    {
+        return;
+    }
+
+    size_t size = writer->size ? writer->size : FILTER_INITIAL_BUFFER_SIZE;
+    while (size <= writer->len + len)
+    {
+        size *= 2;
+    }
+
+    char *data = talloc_realloc(writer->ctx, writer->data, char, size);
+    if (!data)
+    {
+        ld_error("filter_writer_reserve - out of memory - unable to grow filter buffer!\n");
+        writer->failed = true;
+        return;
+    }
+
+    writer->data = data;
+    writer->size = size;
+}
+
+static void filter_writer_append(filter_writer_t *writer, const char *value, size_t len)
+{
+    filter_writer_reserve(writer, len);
+    if (writer->failed)
+    {
+        return;
+    }
+
+    memcpy(writer->data + writer->len, value, len);
+    writer->len += len;
+    writer->data[writer->len] = '\0';
+}
+
+static void filter_writer_append_string(filter_writer_t *writer, const char *value)
+{
+    filter_writer_append(writer, value, strlen(value));
+}
+
+static void filter_writer_append_escaped(filter_writer_t *writer, const char *value, size_t len)
+{
+    filter_writer_reserve(writer, len * 3);
+    if (writer->failed)
+    {
+        return;
+    }
+
+    char *out = writer->data + writer->len;
+    for (size_t i = 0; i < len; ++i)
+    {
+        unsigned char symbol = (unsigned char)value[i];
+
+        if (symbol == '*' || symbol == '(' || symbol == ')' || symbol == '\\' || symbol < 0x20 || symbol == 0x7f)
+        {
+            *out++ = '\\';
+            *out++ = HEX_DIGITS[symbol >> 4];
+            *out++ = HEX_DIGITS[symbol & 0x0f];
+            continue;
+        }
+
+        *out++ = symbol;
+    }
+
+    writer->len = out - writer->data;
+    writer->data[writer->len] = '\0';
+}
+
+/**
+ * @brief filter_writer_end_segment Moves written text into compiled segment followed by parameter.
+ * @param[in] writer                Writer to take text from.
+ * @param[in] parameter             Index of parameter following the text, -1 for the last segment.
+ */
+static void filter_writer_end_segment(filter_writer_t *writer, int parameter)
+{
+    if (writer->failed)
+    {
+        return;
+    }
+
+    filter_segment_t *segments = talloc_realloc(writer->ctx, writer->segments, filter_segment_t,
+                                                writer->n_segments + 1);
+    if (!segments)
+    {
+        ld_error("filter_writer_end_segment - out of memory - unable to compile template!\n");
+        writer->failed = true;
+        return;
+    }
+    writer->segments = segments;
+
+    filter_segment_t *segment = &segments[writer->n_segments];
+    segment->literal = talloc_strndup(segments, writer->data ? writer->data : "", writer->len);
+    segment->literal_len = writer->len;
+    segment->parameter = parameter;
+    if (!segment->literal)
+    {
+        ld_error("filter_writer_end_segment - out of memory - unable to compile template!\n");
+        writer->failed = true;
+        return;
+    }
+
+    ++writer->n_segments;
+    writer->len = 0;
+}
+
+static void filter_write_value(filter_writer_t *writer, const ld_filter_value_t *value)
+{
+    if (writer->compile && value->parameter >= 0)
+    {
+        filter_writer_end_segment(writer, value->parameter);
+        return;
+    }
+
+    filter_writer_append_escaped(writer, value->data, value->len);
+}
+
+static void filter_write(filter_writer_t *writer, const ld_filter_t *filter)
+{
+    filter_writer_append(writer, "(", 1);
+
+    switch (filter->type)
+    {
+    case LD_FILTER_AND:
+    case LD_FILTER_OR:
+    case LD_FILTER_NOT:
+        filter_writer_append_string(writer, filter->type == LD_FILTER_AND ? "&"
+                                          : filter->type == LD_FILTER_OR ? "|" : "!");
+        for (unsigned int i = 0; i < filter->n_children; ++i)
+        {
+            filter_write(writer, filter->children[i]);
+        }
+        break;
+    case LD_FILTER_EQUALITY:
+        filter_writer_append_string(writer, filter->attribute);
+        filter_writer_append(writer, "=", 1);
+        filter_write_value(writer, &filter->value);
+        break;
+    case LD_FILTER_GREATER_OR_EQUAL:
+        filter_writer_append_string(writer, filter->attribute);
+        filter_writer_append(writer, ">=", 2);
+        filter_write_value(writer, &filter->value);
+        break;
+    case LD_FILTER_LESS_OR_EQUAL:
+        filter_writer_append_string(writer, filter->attribute);
+        filter_writer_append(writer, "<=", 2);
+        filter_write_value(writer, &filter->value);
+        break;
+    case LD_FILTER_APPROX:
+        filter_writer_append_string(writer, filter->attribute);
+        filter_writer_append(writer, "~=", 2);
+        filter_write_value(writer, &filter->value);
+        break;
+    case LD_FILTER_PRESENT:
+        filter_writer_append_string(writer, filter->attribute);
+        filter_writer_append(writer, "=*", 2);
+        break;
+    case LD_FILTER_SUBSTRINGS:
+        filter_writer_append_string(writer, filter->attribute);
+        filter_writer_append(writer, "=", 1);
+        if (filter->initial)
+        {
+            filter_write_value(writer, filter->initial);
+        }
+        filter_writer_append(writer, "*", 1);
+        for (unsigned int i = 0; i < filter->n_any; ++i)
+        {
+            filter_write_value(writer, &filter->any[i]);
+            filter_writer_append(writer, "*", 1);
+        }
+        if (filter->final)
+        {
+            filter_write_value(writer, filter->final);
+        }
+        break;
+    case LD_FILTER_EXTENSIBLE:
+        if (filter->attribute)
+        {
+            filter_writer_append_string(writer, filter->attribute);
+        }
+        if (filter->dn_attributes)
+        {
+            filter_writer_append(writer, ":dn", 3);
+        }
+        if (filter->matching_rule)
+        {
+            filter_writer_append(writer, ":", 1);
+            filter_writer_append_string(writer, filter->matching_rule);
+        }
+        filter_writer_append(writer, ":=", 2);
+        filter_write_value(writer, &filter->value);
+        break;
+    }
+
+    filter_writer_append(writer, ")", 1);
+}
+
+static bool filter_is_attribute_char(char symbol)
+{
+    return g_ascii_isalnum(symbol) || symbol == '-' || symbol == '.' || symbol == ';';
+}
+
+static bool filter_is_valid_attribute(const char *attribute)
+{
+    if (!attribute || !g_ascii_isalnum(*attribute))
+    {
+        return false;
+    }
+
+    for (const char *p = attribute; *p; ++p)
+    {
+        if (!filter_is_attribute_char(*p))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void *filter_parse_error(filter_parser_t *parser, const char *error)
+{
+    if (!parser->error)
+    {
+        parser->error = error;
+    }
+
+    return NULL;
+}
+
+static void filter_skip_spaces(filter_parser_t *parser)
+{
+    while (parser->p < parser->end && *parser->p == ' ')
+    {
+        ++parser->p;
+    }
+}
+
+static bool filter_parse_value(filter_parser_t *parser, TALLOC_CTX *ctx, ld_filter_value_t *value, bool substrings)
+{
+    const char *start = parser->p;
+    const char *p = parser->p;
+    size_t len = 0;
+
+    while (p < parser->end && *p != ')' && !(substrings && *p == '*'))
+    {
+        if (*p == '(' || *p == '*')
+        {
+            parser->p = p;
+            filter_parse_error(parser, "unescaped special character in value");
+            return false;
+        }
+
+        if (*p == '\\')
+        {
+            if (parser->end - p < 3 || !g_ascii_isxdigit(p[1]) || !g_ascii_isxdigit(p[2]))
+            {
+                parser->p = p;
+                filter_parse_error(parser, "invalid escape sequence in value");
+                return false;
+            }
+            p += 3;
+        }
+        else
+        {
+            ++p;
+        }
+        ++len;
+    }
+
+    value->data = talloc_array(ctx, char, len + 1);
+    if (!value->data)
+    {
+        filter_parse_error(parser, "out of memory");
+        return false;
+    }
+
+    char *out = value->data;
+    for (const char *in = start; in < p; ++out)
+    {
+        if (*in == '\\')
+        {
+            *out = (char)((g_ascii_xdigit_value(in[1]) << 4) | g_ascii_xdigit_value(in[2]));
+            in += 3;
+        }
+        else
+        {
+            *out = *in++;
+        }
+    }
+    *out = '\0';
+
+    value->len = len;
+    value->parameter = parser->parameters && p - start == 1 && *start == '?' ? (int)parser->n_parameters++ : -1;
+
+    parser->p = p;
+
+    return true;
+}
+
+static bool filter_value_is_empty(const ld_filter_value_t *value)
+{
+    return value->len == 0 && value->parameter < 0;
+}
+
+static ld_filter_value_t *filter_copy_value(TALLOC_CTX *ctx, const ld_filter_value_t *value)
+{
+    ld_filter_value_t *result = talloc(ctx, ld_filter_value_t);
+    if (result)
+    {
+        *result = *value;
+        talloc_steal(result, value->data);
+    }
+
+    return result;
+}
+
+static ld_filter_t *filter_parse_substrings(filter_parser_t *parser, ld_filter_t *result)
+{
+    ld_filter_value_t *parts = NULL;
+    unsigned int n_parts = 0;
+
+    do
+    {
+        if (n_parts > 0)
+        {
+            ++parser->p;
+        }
+
+        ld_filter_value_t *new_parts = talloc_realloc(result, parts, ld_filter_value_t, n_parts + 1);
+        if (!new_parts)
+        {
+            return filter_parse_error(parser, "out of memory");
+        }
+        parts = new_parts;
+
+        if (!filter_parse_value(parser, parts, &parts[n_parts], true))
+        {
+            return NULL;
+        }
+        ++n_parts;
+    }
+    while (parser->p < parser->end && *parser->p == '*');
+
+    if (n_parts == 1)
+    {
+        result->type = LD_FILTER_EQUALITY;
+        result->value = parts[0];
+        talloc_steal(result, parts[0].data);
+        talloc_free(parts);
+        return result;
+    }
+
+    if (n_parts == 2 && filter_value_is_empty(&parts[0]) && filter_value_is_empty(&parts[1]))
+    {
+        result->type = LD_FILTER_PRESENT;
+        talloc_free(parts);
+        return result;
+    }
+
+    result->type = LD_FILTER_SUBSTRINGS;
+
+    if (!filter_value_is_empty(&parts[0]) && !(result->initial = filter_copy_value(result, &parts[0])))
+    {
+        return filter_parse_error(parser, "out of memory");
+    }
+
+    if (!filter_value_is_empty(&parts[n_parts - 1])
+        && !(result->final = filter_copy_value(result, &parts[n_parts - 1])))
+    {
+        return filter_parse_error(parser, "out of memory");
+    }
+
+    result->any = parts;
+    for (unsigned int i = 1; i < n_parts - 1; ++i)
+    {
+        if (!filter_value_is_empty(&parts[i]))
+        {
+            parts[result->n_any++] = parts[i];
+        }
+    }
+
+    return result;
+}
+
+static ld_filter_t *filter_parse_extensible(filter_parser_t *parser, ld_filter_t *result)
+{
+    result->type = LD_FILTER_EXTENSIBLE;
+
+    if (parser->end - parser->p > 3 && g_ascii_strncasecmp(parser->p, ":dn", 3) == 0 && parser->p[3] == ':')
+    {
+        result->dn_attributes = true;
+        parser->p += 3;
+    }
+
+    if (parser->end - parser->p > 1 && parser->p[1] != '=')
+    {
+        const char *rule = ++parser->p;
+        while (parser->p < parser->end && filter_is_attribute_char(*parser->p))
+        {
+            ++parser->p;
+        }
+
+        if (parser->p == rule)
+        {
+            return filter_parse_error(parser, "missing matching rule");
+        }
+
+        result->matching_rule = talloc_strndup(result, rule, parser->p - rule);
+        if (!result->matching_rule)
+        {
+            return filter_parse_error(parser, "out of memory");
+        }
+    }
+
+    if (parser->end - parser->p < 2 || parser->p[0] != ':' || parser->p[1] != '=')
+    {
+        return filter_parse_error(parser, "expected ':='");
+    }
+    parser->p += 2;
+
+    if (!result->attribute && !result->matching_rule)
+    {
+        return filter_parse_error(parser, "extensible match requires attribute or matching rule");
+    }
+
+    return filter_parse_value(parser, result, &result->value, false) ? result : NULL;
+}
+
+static ld_filter_t *filter_parse_item(filter_parser_t *parser, TALLOC_CTX *ctx)
+{
+    ld_filter_t *result = talloc_zero(ctx, ld_filter_t);
+    if (!result)
+    {
+        return filter_parse_error(parser, "out of memory");
+    }
+    result->value.parameter = -1;
+
+    const char *attribute = parser->p;
+    while (parser->p < parser->end && filter_is_attribute_char(*parser->p))
+    {
+        ++parser->p;
+    }
+
+    if (parser->p > attribute)
+    {
+        result->attribute = talloc_strndup(result, attribute, parser->p - attribute);
+        if (!result->attribute)
+        {
+            filter_parse_error(parser, "out of memory");
+            goto error_exit;
+        }
+    }
+
+    ld_filter_t *item = NULL;
+
+    if (parser->p < parser->end && *parser->p == ':')
+    {
+        item = filter_parse_extensible(parser, result);
+    }
+    else if (!result->attribute)
+    {
+        filter_parse_error(parser, "missing attribute description");
+    }
+    else if (parser->p < parser->end && *parser->p == '=')
+    {
+        ++parser->p;
+        item = filter_parse_substrings(parser, result);
+    }
+    else if (parser->end - parser->p >= 2 && parser->p[1] == '=' && strchr("~<>", parser->p[0]))
+    {
+        result->type = parser->p[0] == '~' ? LD_FILTER_APPROX
+                     : parser->p[0] == '<' ? LD_FILTER_LESS_OR_EQUAL : LD_FILTER_GREATER_OR_EQUAL;
+        parser->p += 2;
+        item = filter_parse_value(parser, result, &result->value, false) ? result : NULL;
+    }
+    else
+    {
+        filter_parse_error(parser, "unknown filter type");
+    }
+
+    if (item)
+    {
+        return item;
+    }
+
+    error_exit:
+        talloc_free(result);
+        return NULL;
+}
+
+static bool filter_append_child(ld_filter_t *parent, ld_filter_t *child)
+{
+    ld_filter_t **children = talloc_realloc(parent, parent->children, ld_filter_t*, parent->n_children + 1);
+    if (!children)
+    {
+        return false;
+    }
+
+    children[parent->n_children++] = talloc_steal(parent, child);
+    parent->children = children;
+
+    return true;
+}
+
+static ld_filter_t *filter_parse_filter(filter_parser_t *parser, TALLOC_CTX *ctx, unsigned int depth)
+{
+    ld_filter_t *result = NULL;
+
+    if (depth > FILTER_MAX_DEPTH)
+    {
+        return filter_parse_error(parser, "filter is nested too deep");
+    }
+
+    if (parser->p >= parser->end || *parser->p != '(')
+    {
+        return filter_parse_error(parser, "expected '('");
+    }
+    ++parser->p;
+    filter_skip_spaces(parser);
+
+    if (parser->p < parser->end && (*parser->p == '&' || *parser->p == '|' || *parser->p == '!'))
+    {
+        result = talloc_zero(ctx, ld_filter_t);
+        if (!result)
+        {
+            return filter_parse_error(parser, "out of memory");
+        }
+        result->type = *parser->p == '&' ? LD_FILTER_AND : *parser->p == '|' ? LD_FILTER_OR : LD_FILTER_NOT;
+        result->value.parameter = -1;
+        ++parser->p;
+        filter_skip_spaces(parser);
+
+        while (parser->p < parser->end && *parser->p == '(')
+        {
+            ld_filter_t *child = filter_parse_filter(parser, result, depth + 1);
+            if (!child)
+            {
+                goto error_exit;
+            }
+
+            if (!filter_append_child(result, child))
+            {
+                filter_parse_error(parser, "out of memory");
+                goto error_exit;
+            }
+            filter_skip_spaces(parser);
+        }
+
+        if (result->type == LD_FILTER_NOT && result->n_children != 1)
+        {
+            filter_parse_error(parser, "negation requires exactly one filter");
+            goto error_exit;
+        }
+    }
+    else
+    {
+        result = filter_parse_item(parser, ctx);
+        if (!result)
+        {
+            return NULL;
+        }
+    }
+
+    if (parser->p >= parser->end || *parser->p != ')')
+    {
+        filter_parse_error(parser, "expected ')'");
+        goto error_exit;
+    }
+    ++parser->p;
+
+    return result;
+
+    error_exit:
+        talloc_free(result);
+        return NULL;
+}
+
+static ld_filter_t *filter_parse(TALLOC_CTX *ctx, const char *filter, bool parameters, unsigned int *n_parameters)
+{
+    if (!filter)
+    {
+        ld_error("ld_filter_parse - invalid filter!\n");
+        return NULL;
+    }
+
+    filter_parser_t parser = { .in = filter, .p = filter, .end = filter + strlen(filter), .parameters = parameters };
+    ld_filter_t *result = NULL;
+
+    filter_skip_spaces(&parser);
+
+    result = parser.p < parser.end && *parser.p == '('
+           ? filter_parse_filter(&parser, ctx, 0)
+           : filter_parse_item(&parser, ctx);
+
+    if (result)
+    {
+        filter_skip_spaces(&parser);
+        if (parser.p != parser.end)
+        {
+            filter_parse_error(&parser, "unexpected characters after filter");
+            talloc_free(result);
+            result = NULL;
+        }
+    }
+
+    if (!result)
+    {
+        ld_error("ld_filter_parse - %s at position %ld in filter: %s\n",
+                 parser.error ? parser.error : "invalid filter", (long)(parser.p - parser.in), filter);
+        return NULL;
+    }
+
+    if (n_parameters)
+    {
+        *n_parameters = parser.n_parameters;
+    }
+
+    return result;
+}
+
+/**
+ * @brief ld_filter_parse Parses filter string in RFC 4515 format into filter tree.
+ *
+ * Outer parentheses may be omitted for simple filters. Values are unescaped.
+ * @param[in] ctx          Talloc ctx to use.
+ * @param[in] filter       Filter to parse.
+ * @return
+ *        - Filter tree.
+ *        - NULL if filter is invalid or on failure.
+ */
+ld_filter_t *ld_filter_parse(TALLOC_CTX *ctx, const char *filter)
+{
+    return filter_parse(ctx, filter, false, NULL);
+}
+
+/**
+ * @brief ld_filter_validate Checks syntax of the filter before it is sent to the server.
+ * @param[in] filter          Filter to check.
+ * @return
+ *        - true if filter is valid.
+ *        - false otherwise.
+ */
+bool ld_filter_validate(const char *filter)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    if (!ctx)
+    {
+        ld_error("ld_filter_validate - out of memory!\n");
+        return false;
+    }
+
+    bool result = filter_parse(ctx, filter, false, NULL) != NULL;
+
+    talloc_free(ctx);
+
+    return result;
+}
+
+/**
+ * @brief ld_filter_to_string Renders filter tree as a string with all values escaped.
+ * @param[in] ctx              Talloc ctx to use.
+ * @param[in] filter           Filter to render.
+ * @return
+ *        - Filter string.
+ *        - NULL on failure.
+ */
+char *ld_filter_to_string(TALLOC_CTX *ctx, const ld_filter_t *filter)
+{
+    if (!filter)
+    {
+        ld_error("ld_filter_to_string - invalid filter!\n");
+        return NULL;
+    }
+
+    filter_writer_t writer = { .ctx = ctx };
+
+    filter_write(&writer, filter);
+
+    if (writer.failed)
+    {
+        talloc_free(writer.data);
+        return NULL;
+    }
+
+    return writer.data;
+}
+
+/**
+ * @brief ld_filter_escape_value Escapes value to be used in filter according to RFC 4515.
+ *
+ * Asterisk, parentheses, backslash and control characters are replaced with hex pairs.
+ * @param[in] ctx                Talloc ctx to use.
+ * @param[in] value              Value to escape, may contain zero bytes.
+ * @param[in] len                Length of value.
+ * @return
+ *        - Escaped value.
+ *        - NULL on failure.
+ */
+char *ld_filter_escape_value(TALLOC_CTX *ctx, const char *value, size_t len)
+{
+    if (!value)
+    {
+        ld_error("ld_filter_escape_value - invalid value!\n");
+        return NULL;
+    }
+
+    filter_writer_t writer = { .ctx = ctx };
+
+    filter_writer_reserve(&writer, 0);
+    filter_writer_append_escaped(&writer, value, len);
+
+    if (writer.failed)
+    {
+        talloc_free(writer.data);
+        return NULL;
+    }
+
+    return writer.data;
+}
+
+static ld_filter_t *filter_new(TALLOC_CTX *ctx, enum LdapFilterType type, const char *attribute)
+{
+    ld_filter_t *result = NULL;
+
+    if (attribute && !filter_is_valid_attribute(attribute))
+    {
+        ld_error("ld_filter_new - invalid attribute description: %s\n", attribute);
+        return NULL;
+    }
+
+    ld_talloc_zero_e(result, error_exit, "ld_filter_new - out of memory - unable to create filter!\n",
+                     ctx, ld_filter_t);
+    result->type = type;
+    result->value.parameter = -1;
+
+    if (attribute)
+    {
+        ld_talloc_strdup(result->attribute, error_exit, result, attribute);
+    }
+
+    return result;
+
+    error_exit:
+        talloc_free(result);
+        return NULL;
+}
+
+static bool filter_set_value(TALLOC_CTX *ctx, ld_filter_value_t *result, const char *value)
+{
+    result->data = talloc_strdup(ctx, value);
+    result->len = strlen(value);
+    result->parameter = -1;
+
+    return result->data != NULL;
+}
+
+static ld_filter_t *filter_new_simple(TALLOC_CTX *ctx, enum LdapFilterType type, const char *attribute,
+                                      const char *value)
+{
+    if (!attribute || !value)
+    {
+        ld_error("ld_filter_new - invalid attribute or value!\n");
+        return NULL;
+    }
+
+    ld_filter_t *result = filter_new(ctx, type, attribute);
+    if (result && !filter_set_value(result, &result->value, value))
+    {
+        ld_error("ld_filter_new - out of memory - unable to create filter!\n");
+        talloc_free(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+/**
+ * @brief ld_filter_new_and Creates filter which matches when all of its children match.
+ * @param[in] ctx            Talloc ctx to use.
+ * @return
+ *        - Filter, children are added with ld_filter_add.
+ *        - NULL on failure.
+ */
+ld_filter_t *ld_filter_new_and(TALLOC_CTX *ctx)
+{
+    return filter_new(ctx, LD_FILTER_AND, NULL);
+}
+
+/**
+ * @brief ld_filter_new_or Creates filter which matches when any of its children matches.
+ * @param[in] ctx           Talloc ctx to use.
+ * @return
+ *        - Filter, children are added with ld_filter_add.
+ *        - NULL on failure.
+ */
+ld_filter_t *ld_filter_new_or(TALLOC_CTX *ctx)
+{
+    return filter_new(ctx, LD_FILTER_OR, NULL);
+}
+
+/**
+ * @brief ld_filter_new_not Creates negation of the filter.
+ * @param[in] ctx            Talloc ctx to use.
+ * @param[in] child          Filter to negate, filter takes ownership of it. May be NULL to add it later.
+ * @return
+ *        - Filter.
+ *        - NULL on failure.
+ */
+ld_filter_t *ld_filter_new_not(TALLOC_CTX *ctx, ld_filter_t *child)
+{
+    ld_filter_t *result = filter_new(ctx, LD_FILTER_NOT, NULL);
+
+    if (result && child && ld_filter_add(result, child) != RETURN_CODE_SUCCESS)
+    {
+        talloc_free(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+/**
+ * @brief ld_filter_new_equality Creates (attribute=value) filter.
+ * @param[in] ctx                 Talloc ctx to use.
+ * @param[in] attribute           Attribute description.
+ * @param[in] value               Unescaped value.
+ * @return
+ *        - Filter.
+ *        - NULL on failure.
+ */
+ld_filter_t *ld_filter_new_equality(TALLOC_CTX *ctx, const char *attribute, const char *value)
+{
+    return filter_new_simple(ctx, LD_FILTER_EQUALITY, attribute, value);
+}
+
+/**
+ * @brief ld_filter_new_greater_or_equal Creates (attribute>=value) filter.
+ * @param[in] ctx                         Talloc ctx to use.
+ * @param[in] attribute                   Attribute description.
+ * @param[in] value                       Unescaped value.
+ * @return
+ *        - Filter.
+ *        - NULL on failure.
+ */
+ld_filter_t *ld_filter_new_greater_or_equal(TALLOC_CTX *ctx, const char *attribute, const char *value)
+{
+    return filter_new_simple(ctx, LD_FILTER_GREATER_OR_EQUAL, attribute, value);
+}
+
+/**
+ * @brief ld_filter_new_less_or_equal Creates (attribute<=value) filter.
+ * @param[in] ctx                      Talloc ctx to use.
+ * @param[in] attribute                Attribute description.
+ * @param[in] value                    Unescaped value.
+ * @return
+ *        - Filter.
+ *        - NULL on failure.
+ */
+ld_filter_t *ld_filter_new_less_or_equal(TALLOC_CTX *ctx, const char *attribute, const char *value)
+{
+    return filter_new_simple(ctx, LD_FILTER_LESS_OR_EQUAL, attribute, value);
+}
+
+/**
+ * @brief ld_filter_new_approx Creates (attribute~=value) filter.
+ * @param[in] ctx               Talloc ctx to use.
+ * @param[in] attribute         Attribute description.
+ * @param[in] value             Unescaped value.
+ * @return
+ *        - Filter.
+ *        - NULL on failure.
+ */
+ld_filter_t *ld_filter_new_approx(TALLOC_CTX *ctx, const char *attribute, const char *value)
+{
+    return filter_new_simple(ctx, LD_FILTER_APPROX, attribute, value);
+}
+
+/**
+ * @brief ld_filter_new_present Creates (attribute=*) filter.
+ * @param[in] ctx                Talloc ctx to use.
+ * @param[in] attribute          Attribute description.
+ * @return
+ *        - Filter.
+ *        - NULL on failure.
+ */
+ld_filter_t *ld_filter_new_present(TALLOC_CTX *ctx, const char *attribute)
+{
+    if (!attribute)
+    {
+        ld_error("ld_filter_new_present - invalid attribute!\n");
+        return NULL;
+    }
+
+    return filter_new(ctx, LD_FILTER_PRESENT, attribute);
+}
+
+/**
+ * @brief ld_filter_new_substrings Creates (attribute=initial*any*final) filter.
+ * @param[in] ctx                   Talloc ctx to use.
+ * @param[in] attribute             Attribute description.
+ * @param[in] initial               Unescaped initial substring, may be NULL.
+ * @param[in] any                   NULL terminated array of unescaped substrings, may be NULL.
+ * @param[in] final                 Unescaped final substring, may be NULL.
+ * @return
+ *        - Filter.
+ *        - NULL on failure.
+ */
+ld_filter_t *ld_filter_new_substrings(TALLOC_CTX *ctx, const char *attribute, const char *initial,
+                                      const char **any, const char *final)
+{
+    if (!attribute)
+    {
+        ld_error("ld_filter_new_substrings - invalid attribute!\n");
+        return NULL;
+    }
+
+    ld_filter_t *result = filter_new(ctx, LD_FILTER_SUBSTRINGS, attribute);
+    if (!result)
+    {
+        return NULL;
+    }
+
+    if (initial && *initial)
+    {
+        ld_talloc(result->initial, error_exit, result, ld_filter_value_t);
+        if (!filter_set_value(result->initial, result->initial, initial))
+        {
+            goto error_exit;
+        }
+    }
+
+    unsigned int n_any = 0;
+    while (any && any[n_any])
+    {
+        ++n_any;
+    }
+
+    ld_talloc_array(result->any, error_exit, result, ld_filter_value_t, n_any > 0 ? n_any : 1);
+    for (unsigned int i = 0; i < n_any; ++i)
+    {
+        if (*any[i])
+        {
+            if (!filter_set_value(result->any, &result->any[result->n_any++], any[i]))
+            {
+                goto error_exit;
+            }
+        }
+    }
+
+    if (final && *final)
+    {
+        ld_talloc(result->final, error_exit, result, ld_filter_value_t);
+        if (!filter_set_value(result->final, result->final, final))
+        {
+            goto error_exit;
+        }
+    }
+
+    if (!result->initial && !result->n_any && !result->final)
+    {
+        result->type = LD_FILTER_PRESENT;
+    }
+
+    return result;
+
+    error_exit:
+        ld_error("ld_filter_new_substrings - out of memory - unable to create filter!\n");
+        talloc_free(result);
+        return NULL;
+}
+
+/**
+ * @brief ld_filter_new_extensible Creates (attribute:dn:matching_rule:=value) filter.
+ * @param[in] ctx                   Talloc ctx to use.
+ * @param[in] attribute             Attribute description, may be NULL if matching rule is set.
+ * @param[in] matching_rule         Matching rule OID or name, may be NULL if attribute is set.
+ * @param[in] dn_attributes         Match attributes of entry's DN too.
+ * @param[in] value                 Unescaped value.
+ * @return
+ *        - Filter.
+ *        - NULL on failure.
+ */
+ld_filter_t *ld_filter_new_extensible(TALLOC_CTX *ctx, const char *attribute, const char *matching_rule,
+                                      bool dn_attributes, const char *value)
+{
+    if ((!attribute && !matching_rule) || !value)
+    {
+        ld_error("ld_filter_new_extensible - invalid attribute, matching rule or value!\n");
+        return NULL;
+    }
+
+    if (matching_rule && !filter_is_valid_attribute(matching_rule))
+    {
+        ld_error("ld_filter_new_extensible - invalid matching rule: %s\n", matching_rule);
+        return NULL;
+    }
+
+    ld_filter_t *result = filter_new(ctx, LD_FILTER_EXTENSIBLE, attribute);
+    if (!result)
+    {
+        return NULL;
+    }
+
+    result->dn_attributes = dn_attributes;
+
+    if (matching_rule)
+    {
+        ld_talloc_strdup(result->matching_rule, error_exit, result, matching_rule);
+    }
+
+    if (!filter_set_value(result, &result->value, value))
+    {
+        goto error_exit;
+    }
+
+    return result;
+
+    error_exit:
+        ld_error("ld_filter_new_extensible - out of memory - unable to create filter!\n");
+        talloc_free(result);
+        return NULL;
+}
+
+/**
+ * @brief ld_filter_add Adds child to AND, OR or NOT filter.
+ * @param[in] parent     Filter to add child to.
+ * @param[in] child      Child to add, parent takes ownership of it.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_filter_add(ld_filter_t *parent, ld_filter_t *child)
+{
+    if (!parent || !child || parent == child)
+    {
+        ld_error("ld_filter_add - invalid filter!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (parent->type != LD_FILTER_AND && parent->type != LD_FILTER_OR
+        && !(parent->type == LD_FILTER_NOT && parent->n_children == 0))
+    {
+        ld_error("ld_filter_add - filter can't have more children!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (!filter_append_child(parent, child))
+    {
+        ld_error("ld_filter_add - out of memory - unable to add filter!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief ld_filter_get_type Returns type of the filter.
+ */
+enum LdapFilterType ld_filter_get_type(const ld_filter_t *filter)
+{
+    return filter->type;
+}
+
+/**
+ * @brief ld_filter_template_new Parses filter template and compiles it for rendering.
+ *
+ * Every value consisting of single '?' is a parameter, parameters are numbered from left to right.
+ * Literal question mark is written as \3f.
+ * @param[in] ctx                 Talloc ctx to use.
+ * @param[in] filter              Filter template, e.g. (&(objectClass=user)(sAMAccountName=?)).
+ * @return
+ *        - Compiled template.
+ *        - NULL if template is invalid or on failure.
+ */
+ld_filter_template_t *ld_filter_template_new(TALLOC_CTX *ctx, const char *filter)
+{
+    ld_filter_template_t *result = NULL;
+
+    ld_talloc_zero_e(result, error_exit, "ld_filter_template_new - out of memory - unable to create template!\n",
+                     ctx, ld_filter_template_t);
+
+    result->filter = filter_parse(result, filter, true, &result->n_parameters);
+    if (!result->filter)
+    {
+        goto error_exit;
+    }
+
+    filter_writer_t writer = { .ctx = result, .compile = true };
+
+    filter_write(&writer, result->filter);
+    filter_writer_end_segment(&writer, -1);
+
+    if (writer.failed)
+    {
+        goto error_exit;
+    }
+
+    result->segments = writer.segments;
+    result->n_segments = writer.n_segments;
+    result->buffer = writer.data;
+    result->buffer_size = writer.size;
+
+    return result;
+
+    error_exit:
+        talloc_free(result);
+        return NULL;
+}
+
+/**
+ * @brief ld_filter_template_get_parameter_count Returns amount of parameters in template.
+ */
+unsigned int ld_filter_template_get_parameter_count(const ld_filter_template_t *filter_template)
+{
+    return filter_template->n_parameters;
+}
+
+/**
+ * @brief ld_filter_template_get_filter Returns parsed template, parameters have empty values in it.
+ */
+const ld_filter_t *ld_filter_template_get_filter(const ld_filter_template_t *filter_template)
+{
+    return filter_template->filter;
+}
+
+/**
+ * @brief ld_filter_template_render Renders template with escaped values of parameters.
+ *
+ * Result is written into buffer of the template which is reused between calls.
+ * @param[in] filter_template       Template to render.
+ * @param[in] values                Unescaped values of parameters, array must hold value for every parameter.
+ * @return
+ *        - Filter string, valid until next call or until template is freed.
+ *        - NULL on failure.
+ */
+const char *ld_filter_template_render(ld_filter_template_t *filter_template, const char *const *values)
+{
+    if (!filter_template || (filter_template->n_parameters > 0 && !values))
+    {
+        ld_error("ld_filter_template_render - invalid template or values!\n");
+        return NULL;
+    }
+
+    filter_writer_t writer = { .ctx = filter_template,
+                               .data = filter_template->buffer,
+                               .size = filter_template->buffer_size };
+
+    for (unsigned int i = 0; i < filter_template->n_segments; ++i)
+    {
+        const filter_segment_t *segment = &filter_template->segments[i];
+
+        filter_writer_append(&writer, segment->literal, segment->literal_len);
+
+        if (segment->parameter >= 0)
+        {
+            const char *value = values[segment->parameter];
+            if (!value)
+            {
+                ld_error("ld_filter_template_render - missing value of parameter %d!\n", segment->parameter);
+                writer.failed = true;
+                break;
+            }
+
+            filter_writer_append_escaped(&writer, value, strlen(value));
+        }
+    }
+
+    filter_template->buffer = writer.data;
+    filter_template->buffer_size = writer.size;
+
+    return writer.failed ? NULL : writer.data;
+}
@@ -0,0 +1,72 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_FILTER_H
+#define LIBDOMAIN_FILTER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+enum LdapFilterType
+{
+    LD_FILTER_AND               = 0,    //!< All of the child filters match.
+    LD_FILTER_OR                = 1,    //!< Any of the child filters matches.
+    LD_FILTER_NOT               = 2,    //!< Child filter does not match.
+    LD_FILTER_EQUALITY          = 3,    //!< (attribute=value)
+    LD_FILTER_SUBSTRINGS        = 4,    //!< (attribute=initial*any*final)
+    LD_FILTER_GREATER_OR_EQUAL  = 5,    //!< (attribute>=value)
+    LD_FILTER_LESS_OR_EQUAL     = 6,    //!< (attribute<=value)
+    LD_FILTER_PRESENT           = 7,    //!< (attribute=*)
+    LD_FILTER_APPROX            = 8,    //!< (attribute~=value)
+    LD_FILTER_EXTENSIBLE        = 9,    //!< (attribute:dn:rule:=value)
+};
+
+typedef struct ld_filter_s ld_filter_t;
+typedef struct ld_filter_template_s ld_filter_template_t;
+
+ld_filter_t *ld_filter_parse(TALLOC_CTX *ctx, const char *filter);
+bool ld_filter_validate(const char *filter);
+char *ld_filter_to_string(TALLOC_CTX *ctx, const ld_filter_t *filter);
+char *ld_filter_escape_value(TALLOC_CTX *ctx, const char *value, size_t len);
+
+ld_filter_t *ld_filter_new_and(TALLOC_CTX *ctx);
+ld_filter_t *ld_filter_new_or(TALLOC_CTX *ctx);
+ld_filter_t *ld_filter_new_not(TALLOC_CTX *ctx, ld_filter_t *child);
+ld_filter_t *ld_filter_new_equality(TALLOC_CTX *ctx, const char *attribute, const char *value);
+ld_filter_t *ld_filter_new_greater_or_equal(TALLOC_CTX *ctx, const char *attribute, const char *value);
+ld_filter_t *ld_filter_new_less_or_equal(TALLOC_CTX *ctx, const char *attribute, const char *value);
+ld_filter_t *ld_filter_new_approx(TALLOC_CTX *ctx, const char *attribute, const char *value);
+ld_filter_t *ld_filter_new_present(TALLOC_CTX *ctx, const char *attribute);
+ld_filter_t *ld_filter_new_substrings(TALLOC_CTX *ctx, const char *attribute, const char *initial,
+                                      const char **any, const char *final);
+ld_filter_t *ld_filter_new_extensible(TALLOC_CTX *ctx, const char *attribute, const char *matching_rule,
+                                      bool dn_attributes, const char *value);
+enum OperationReturnCode ld_filter_add(ld_filter_t *parent, ld_filter_t *child);
+
+enum LdapFilterType ld_filter_get_type(const ld_filter_t *filter);
+
+ld_filter_template_t *ld_filter_template_new(TALLOC_CTX *ctx, const char *filter);
+unsigned int ld_filter_template_get_parameter_count(const ld_filter_template_t *filter_template);
+const ld_filter_t *ld_filter_template_get_filter(const ld_filter_template_t *filter_template);
+const char *ld_filter_template_render(ld_filter_template_t *filter_template, const char *const *values);
+
+#endif //LIBDOMAIN_FILTER_H
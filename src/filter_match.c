@@ -0,0 +1,1461 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "filter_match.h"
+#include "filter_match_p.h"
+#include "filter_p.h"
+
+#include "dn.h"
+#include "domain.h"
+#include "entry.h"
+#include "entry_p.h"
+#include "schema.h"
+
+#include "helper_p.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib-2.0/glib.h>
+
+#define number_of_elements(x)  (sizeof(x) / sizeof((x)[0]))
+
+enum
+{
+    FILTER_STACK_BUFFER_SIZE = 256,
+    FILTER_MAX_SUPERTYPES = 16,
+};
+
+static const int64_t USEC_PER_SECOND = 1000000;
+
+enum FilterOpcode
+{
+    FILTER_OP_AND,
+    FILTER_OP_OR,
+    FILTER_OP_NOT,
+    FILTER_OP_EQUALITY,
+    FILTER_OP_GREATER_OR_EQUAL,
+    FILTER_OP_LESS_OR_EQUAL,
+    FILTER_OP_SUBSTRINGS,
+    FILTER_OP_PRESENT,
+    FILTER_OP_BITWISE_AND,
+    FILTER_OP_BITWISE_OR,
+    FILTER_OP_UNDEFINED,
+};
+
+/*!
+ * @brief Matching rules by name and OID.
+ */
+static const struct
+{
+    const char *name;
+    enum FilterRule rule;
+} MATCHING_RULES[] =
+{
+    { "2.5.13.0", FILTER_RULE_OID },
+    { "objectIdentifierMatch", FILTER_RULE_OID },
+    { "2.5.13.1", FILTER_RULE_DN },
+    { "distinguishedNameMatch", FILTER_RULE_DN },
+    { "2.5.13.2", FILTER_RULE_CASE_IGNORE },
+    { "caseIgnoreMatch", FILTER_RULE_CASE_IGNORE },
+    { "2.5.13.3", FILTER_RULE_CASE_IGNORE },
+    { "caseIgnoreOrderingMatch", FILTER_RULE_CASE_IGNORE },
+    { "2.5.13.4", FILTER_RULE_CASE_IGNORE },
+    { "caseIgnoreSubstringsMatch", FILTER_RULE_CASE_IGNORE },
+    { "2.5.13.5", FILTER_RULE_CASE_EXACT },
+    { "caseExactMatch", FILTER_RULE_CASE_EXACT },
+    { "2.5.13.6", FILTER_RULE_CASE_EXACT },
+    { "caseExactOrderingMatch", FILTER_RULE_CASE_EXACT },
+    { "2.5.13.7", FILTER_RULE_CASE_EXACT },
+    { "caseExactSubstringsMatch", FILTER_RULE_CASE_EXACT },
+    { "2.5.13.8", FILTER_RULE_NUMERIC_STRING },
+    { "numericStringMatch", FILTER_RULE_NUMERIC_STRING },
+    { "2.5.13.9", FILTER_RULE_NUMERIC_STRING },
+    { "numericStringOrderingMatch", FILTER_RULE_NUMERIC_STRING },
+    { "2.5.13.10", FILTER_RULE_NUMERIC_STRING },
+    { "numericStringSubstringsMatch", FILTER_RULE_NUMERIC_STRING },
+    { "2.5.13.13", FILTER_RULE_CASE_IGNORE },
+    { "booleanMatch", FILTER_RULE_CASE_IGNORE },
+    { "2.5.13.14", FILTER_RULE_INTEGER },
+    { "integerMatch", FILTER_RULE_INTEGER },
+    { "2.5.13.15", FILTER_RULE_INTEGER },
+    { "integerOrderingMatch", FILTER_RULE_INTEGER },
+    { "2.5.13.17", FILTER_RULE_OCTET_STRING },
+    { "octetStringMatch", FILTER_RULE_OCTET_STRING },
+    { "2.5.13.18", FILTER_RULE_OCTET_STRING },
+    { "octetStringOrderingMatch", FILTER_RULE_OCTET_STRING },
+    { "2.5.13.27", FILTER_RULE_GENERALIZED_TIME },
+    { "generalizedTimeMatch", FILTER_RULE_GENERALIZED_TIME },
+    { "2.5.13.28", FILTER_RULE_GENERALIZED_TIME },
+    { "generalizedTimeOrderingMatch", FILTER_RULE_GENERALIZED_TIME },
+    { "1.3.6.1.4.1.1466.109.114.1", FILTER_RULE_CASE_EXACT },
+    { "caseExactIA5Match", FILTER_RULE_CASE_EXACT },
+    { "1.3.6.1.4.1.1466.109.114.2", FILTER_RULE_CASE_IGNORE },
+    { "caseIgnoreIA5Match", FILTER_RULE_CASE_IGNORE },
+    { "1.3.6.1.4.1.1466.109.114.3", FILTER_RULE_CASE_IGNORE },
+    { "caseIgnoreIA5SubstringsMatch", FILTER_RULE_CASE_IGNORE },
+};
+
+/*!
+ * @brief Matching rules used for attribute syntaxes when attribute type has no rule.
+ */
+static const struct
+{
+    const char *oid;
+    enum FilterRule rule;
+} SYNTAX_RULES[] =
+{
+    { "1.3.6.1.4.1.1466.115.121.1.7", FILTER_RULE_CASE_IGNORE },
+    { "1.3.6.1.4.1.1466.115.121.1.12", FILTER_RULE_DN },
+    { "1.3.6.1.4.1.1466.115.121.1.15", FILTER_RULE_CASE_IGNORE },
+    { "1.3.6.1.4.1.1466.115.121.1.24", FILTER_RULE_GENERALIZED_TIME },
+    { "1.3.6.1.4.1.1466.115.121.1.26", FILTER_RULE_CASE_IGNORE },
+    { "1.3.6.1.4.1.1466.115.121.1.27", FILTER_RULE_INTEGER },
+    { "1.3.6.1.4.1.1466.115.121.1.36", FILTER_RULE_NUMERIC_STRING },
+    { "1.3.6.1.4.1.1466.115.121.1.38", FILTER_RULE_OID },
+    { "1.3.6.1.4.1.1466.115.121.1.40", FILTER_RULE_OCTET_STRING },
+    { "1.3.6.1.4.1.1466.115.121.1.44", FILTER_RULE_CASE_IGNORE },
+    { "1.3.6.1.4.1.1466.115.121.1.53", FILTER_RULE_UTC_TIME },
+    { "1.2.840.113556.1.4.905", FILTER_RULE_CASE_IGNORE },
+    { "1.2.840.113556.1.4.906", FILTER_RULE_INTEGER },
+    { "1.2.840.113556.1.4.907", FILTER_RULE_OCTET_STRING },
+    { "1.2.840.113556.1.4.1362", FILTER_RULE_CASE_EXACT },
+};
+
+/*!
+ * @brief Matching rules of well known attributes used when schema is not available.
+ */
+static const struct
+{
+    const char *name;
+    enum FilterRule rule;
+} ATTRIBUTE_RULES[] =
+{
+    { "objectClass", FILTER_RULE_OID },
+    { "structuralObjectClass", FILTER_RULE_OID },
+    { "distinguishedName", FILTER_RULE_DN },
+    { "member", FILTER_RULE_DN },
+    { "memberOf", FILTER_RULE_DN },
+    { "uniqueMember", FILTER_RULE_DN },
+    { "manager", FILTER_RULE_DN },
+    { "owner", FILTER_RULE_DN },
+    { "seeAlso", FILTER_RULE_DN },
+    { "creatorsName", FILTER_RULE_DN },
+    { "modifiersName", FILTER_RULE_DN },
+    { "uidNumber", FILTER_RULE_INTEGER },
+    { "gidNumber", FILTER_RULE_INTEGER },
+    { "userAccountControl", FILTER_RULE_INTEGER },
+    { "groupType", FILTER_RULE_INTEGER },
+    { "sAMAccountType", FILTER_RULE_INTEGER },
+    { "primaryGroupID", FILTER_RULE_INTEGER },
+    { "instanceType", FILTER_RULE_INTEGER },
+    { "systemFlags", FILTER_RULE_INTEGER },
+    { "badPwdCount", FILTER_RULE_INTEGER },
+    { "logonCount", FILTER_RULE_INTEGER },
+    { "pwdLastSet", FILTER_RULE_INTEGER },
+    { "lastLogon", FILTER_RULE_INTEGER },
+    { "lastLogonTimestamp", FILTER_RULE_INTEGER },
+    { "accountExpires", FILTER_RULE_INTEGER },
+    { "uSNCreated", FILTER_RULE_INTEGER },
+    { "uSNChanged", FILTER_RULE_INTEGER },
+    { "createTimestamp", FILTER_RULE_GENERALIZED_TIME },
+    { "modifyTimestamp", FILTER_RULE_GENERALIZED_TIME },
+    { "whenCreated", FILTER_RULE_GENERALIZED_TIME },
+    { "whenChanged", FILTER_RULE_GENERALIZED_TIME },
+    { "objectGUID", FILTER_RULE_OCTET_STRING },
+    { "objectSid", FILTER_RULE_OCTET_STRING },
+    { "userPassword", FILTER_RULE_OCTET_STRING },
+};
+
+static const char BITWISE_AND_RULE[] = "1.2.840.113556.1.4.803";
+static const char BITWISE_OR_RULE[] = "1.2.840.113556.1.4.804";
+
+/*!
+ * @brief filter_assertion_t - Assertion value prepared for matching.
+ */
+typedef struct filter_assertion_s
+{
+    char *data;                         //!< Normalized value.
+    size_t len;                         //!< Length of normalized value.
+    int64_t number;                     //!< Value of time and bitwise assertions.
+    const char *oid;                    //!< OID object identifier assertion resolves to, may be NULL.
+    bool numeric_oid;                   //!< Object identifier assertion is written as OID.
+} filter_assertion_t;
+
+/*!
+ * @brief filter_instruction_t - Instruction of compiled filter.
+ *
+ * Instructions are stored in prefix order, children of AND, OR and NOT follow their parent.
+ */
+typedef struct filter_instruction_s
+{
+    enum FilterOpcode opcode;           //!< Operation to perform.
+    enum FilterRule rule;               //!< Matching rule of attribute values.
+    unsigned int end;                   //!< Index of the instruction following the subtree of this one.
+    char **names;                       //!< NULL terminated names and OID of attribute.
+    filter_assertion_t assertion;       //!< Assertion value.
+    filter_assertion_t *initial;        //!< Initial substring, may be NULL.
+    filter_assertion_t *any;            //!< Any substrings.
+    unsigned int n_any;                 //!< Amount of any substrings.
+    filter_assertion_t *final;          //!< Final substring, may be NULL.
+} filter_instruction_t;
+
+/*!
+ * @brief ld_filter_program_t - Filter compiled for evaluation against entries.
+ */
+struct ld_filter_program_s
+{
+    filter_instruction_t *instructions; //!< Instructions of program.
+    unsigned int n_instructions;        //!< Amount of instructions.
+    const ldap_schema_t *schema;        //!< Schema used to resolve object identifiers, may be NULL.
+};
+
+/*!
+ * @brief filter_buffer_t - Normalized value, short values are stored on stack.
+ */
+typedef struct filter_buffer_s
+{
+    char stack[FILTER_STACK_BUFFER_SIZE];
+    char *heap;
+    const char *data;
+    size_t len;
+} filter_buffer_t;
+
+static char *filter_buffer_reserve(filter_buffer_t *buffer, size_t size)
+{
+    if (size <= sizeof(buffer->stack))
+    {
+        return buffer->stack;
+    }
+
+    buffer->heap = g_malloc(size);
+
+    return buffer->heap;
+}
+
+static void filter_buffer_release(filter_buffer_t *buffer)
+{
+    g_free(buffer->heap);
+    buffer->heap = NULL;
+}
+
+/**
+ * @brief filter_prepare_string Folds case and removes insignificant spaces.
+ * @param[in] in                String to prepare.
+ * @param[out] out              Buffer of at least strlen(in) + 1 bytes.
+ * @param[in] fold              Fold ASCII case.
+ * @param[in] trim              Remove leading and trailing spaces, inner runs of spaces are always collapsed.
+ * @return Length of prepared string.
+ */
+static size_t filter_prepare_string(const char *in, char *out, bool fold, bool trim)
+{
+    char *o = out;
+    bool space = false;
+
+    for (const char *p = in; *p; ++p)
+    {
+        if (*p == ' ')
+        {
+            space = true;
+            continue;
+        }
+
+        if (space && (o > out || !trim))
+        {
+            *o++ = ' ';
+        }
+        space = false;
+
+        *o++ = fold ? g_ascii_tolower(*p) : *p;
+    }
+
+    if (space && !trim)
+    {
+        *o++ = ' ';
+    }
+    *o = '\0';
+
+    return o - out;
+}
+
+static bool filter_normalize_integer(const char *value, filter_buffer_t *buffer)
+{
+    const char *p = value;
+    bool negative = false;
+
+    while (*p == ' ')
+    {
+        ++p;
+    }
+
+    if (*p == '-' || *p == '+')
+    {
+        negative = *p++ == '-';
+    }
+
+    if (!g_ascii_isdigit(*p))
+    {
+        return false;
+    }
+
+    while (*p == '0' && g_ascii_isdigit(p[1]))
+    {
+        ++p;
+    }
+
+    const char *digits = p;
+    while (g_ascii_isdigit(*p))
+    {
+        ++p;
+    }
+    size_t n_digits = p - digits;
+
+    while (*p == ' ')
+    {
+        ++p;
+    }
+
+    if (*p)
+    {
+        return false;
+    }
+
+    if (n_digits == 1 && *digits == '0')
+    {
+        negative = false;
+    }
+
+    char *out = filter_buffer_reserve(buffer, n_digits + 2);
+    buffer->data = out;
+    if (negative)
+    {
+        *out++ = '-';
+    }
+    memcpy(out, digits, n_digits);
+    out[n_digits] = '\0';
+    buffer->len = n_digits + (negative ? 1 : 0);
+
+    return true;
+}
+
+/**
+ * @brief filter_compare_integers Compares integers in canonical form.
+ */
+static int filter_compare_integers(const char *first, size_t first_len, const char *second, size_t second_len)
+{
+    bool negative = *first == '-';
+
+    if (negative != (*second == '-'))
+    {
+        return negative ? -1 : 1;
+    }
+
+    int result = first_len != second_len ? (first_len < second_len ? -1 : 1) : memcmp(first, second, first_len);
+
+    return negative ? -result : result;
+}
+
+/**
+ * @brief filter_normalize Converts value into form compared by matching rule.
+ * @param[in] rule          Matching rule.
+ * @param[in] value         Value to convert.
+ * @param[in] trim          Remove leading and trailing spaces, false for substrings.
+ * @param[out] buffer       Buffer to store result to, must be released with filter_buffer_release.
+ * @return
+ *        - true on success.
+ *        - false if value is invalid for the rule.
+ */
+static bool filter_normalize(enum FilterRule rule, const char *value, bool trim, filter_buffer_t *buffer)
+{
+    buffer->heap = NULL;
+
+    switch (rule)
+    {
+    case FILTER_RULE_CASE_IGNORE:
+    case FILTER_RULE_CASE_EXACT:
+    case FILTER_RULE_OID:
+    {
+        const char *source = value;
+        char *folded = NULL;
+        size_t len = 0;
+
+        for (const char *p = value; *p; ++p, ++len)
+        {
+            if ((unsigned char)*p >= 0x80 && rule == FILTER_RULE_CASE_IGNORE && !folded)
+            {
+                folded = g_utf8_casefold(value, -1);
+                if (folded)
+                {
+                    source = folded;
+                    len = strlen(folded);
+                }
+                break;
+            }
+        }
+
+        char *out = filter_buffer_reserve(buffer, len + 1);
+        buffer->len = filter_prepare_string(source, out, rule != FILTER_RULE_CASE_EXACT, trim);
+        buffer->data = out;
+        g_free(folded);
+        return true;
+    }
+    case FILTER_RULE_NUMERIC_STRING:
+    {
+        char *out = filter_buffer_reserve(buffer, strlen(value) + 1);
+        char *o = out;
+        for (const char *p = value; *p; ++p)
+        {
+            if (*p != ' ')
+            {
+                *o++ = *p;
+            }
+        }
+        *o = '\0';
+        buffer->data = out;
+        buffer->len = o - out;
+        return true;
+    }
+    case FILTER_RULE_INTEGER:
+        return filter_normalize_integer(value, buffer);
+    case FILTER_RULE_DN:
+    {
+        char *normalized = ld_dn_normalize(NULL, value);
+        if (!normalized)
+        {
+            return false;
+        }
+        buffer->len = strlen(normalized);
+        char *out = filter_buffer_reserve(buffer, buffer->len + 1);
+        memcpy(out, normalized, buffer->len + 1);
+        buffer->data = out;
+        talloc_free(normalized);
+        return true;
+    }
+    default:
+        buffer->data = value;
+        buffer->len = strlen(value);
+        return true;
+    }
+}
+
+static bool filter_read_digits(const char **p, int count, int *result)
+{
+    *result = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (!g_ascii_isdigit((*p)[i]))
+        {
+            return false;
+        }
+        *result = *result * 10 + ((*p)[i] - '0');
+    }
+    *p += count;
+
+    return true;
+}
+
+static int64_t filter_days_from_civil(int64_t year, int month, int day)
+{
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t year_of_era = year - era * 400;
+    int64_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+
+    return era * 146097 + day_of_era - 719468;
+}
+
+/**
+ * @brief filter_parse_time Converts GeneralizedTime or UTCTime to microseconds since epoch.
+ * @param[in] value          Time to convert.
+ * @param[in] utc            Value is UTCTime with two digit year.
+ * @param[out] result        Microseconds since epoch in UTC.
+ * @return
+ *        - true on success.
+ *        - false if value is invalid.
+ */
+static bool filter_parse_time(const char *value, bool utc, int64_t *result)
+{
+    const char *p = value;
+    int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+    int64_t unit = 3600 * USEC_PER_SECOND;
+
+    if (!filter_read_digits(&p, utc ? 2 : 4, &year)
+        || !filter_read_digits(&p, 2, &month)
+        || !filter_read_digits(&p, 2, &day)
+        || !filter_read_digits(&p, 2, &hour))
+    {
+        return false;
+    }
+
+    if (utc)
+    {
+        year += year < 50 ? 2000 : 1900;
+    }
+
+    if (filter_read_digits(&p, 2, &minute))
+    {
+        unit = 60 * USEC_PER_SECOND;
+        if (filter_read_digits(&p, 2, &second))
+        {
+            unit = USEC_PER_SECOND;
+        }
+    }
+
+    if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60)
+    {
+        return false;
+    }
+
+    int64_t fraction = 0;
+    if (!utc && (*p == '.' || *p == ','))
+    {
+        int64_t scale = unit;
+        ++p;
+        if (!g_ascii_isdigit(*p))
+        {
+            return false;
+        }
+        while (g_ascii_isdigit(*p))
+        {
+            scale /= 10;
+            fraction += (*p++ - '0') * scale;
+        }
+    }
+
+    int64_t offset = 0;
+    if (*p == 'Z')
+    {
+        ++p;
+    }
+    else if (*p == '+' || *p == '-')
+    {
+        int sign = *p++ == '-' ? -1 : 1;
+        int offset_hours = 0, offset_minutes = 0;
+        if (!filter_read_digits(&p, 2, &offset_hours))
+        {
+            return false;
+        }
+        filter_read_digits(&p, 2, &offset_minutes);
+        offset = sign * (offset_hours * 3600 + offset_minutes * 60) * USEC_PER_SECOND;
+    }
+
+    if (*p)
+    {
+        return false;
+    }
+
+    int64_t seconds = filter_days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    *result = seconds * USEC_PER_SECOND + fraction - offset;
+
+    return true;
+}
+
+static bool filter_parse_number(const char *value, int64_t *result)
+{
+    char *end = NULL;
+
+    errno = 0;
+    *result = strtoll(value, &end, 10);
+
+    return errno == 0 && end != value && *end == '\0';
+}
+
+/**
+ * @brief filter_rule_by_name Returns rule implementing matching rule given by name or OID.
+ * @return Rule, FILTER_RULE_NONE if matching rule is not supported.
+ */
+enum FilterRule filter_rule_by_name(const char *name)
+{
+    if (!name)
+    {
+        return FILTER_RULE_NONE;
+    }
+
+    for (size_t i = 0; i < number_of_elements(MATCHING_RULES); ++i)
+    {
+        if (g_ascii_strcasecmp(name, MATCHING_RULES[i].name) == 0)
+        {
+            return MATCHING_RULES[i].rule;
+        }
+    }
+
+    return FILTER_RULE_NONE;
+}
+
+static enum FilterRule filter_rule_by_syntax(const char *oid)
+{
+    if (!oid)
+    {
+        return FILTER_RULE_NONE;
+    }
+
+    for (size_t i = 0; i < number_of_elements(SYNTAX_RULES); ++i)
+    {
+        if (strcmp(oid, SYNTAX_RULES[i].oid) == 0)
+        {
+            return SYNTAX_RULES[i].rule;
+        }
+    }
+
+    return FILTER_RULE_NONE;
+}
+
+static bool filter_names_contain(char **names, const char *name)
+{
+    for (int i = 0; names && names[i]; ++i)
+    {
+        if (g_ascii_strcasecmp(names[i], name) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static LDAPAttributeType *filter_find_attribute_type(const ldap_schema_t *schema, const char *name)
+{
+    if (!schema || !name)
+    {
+        return NULL;
+    }
+
+    LDAPAttributeType *result = ldap_schema_get_attributetype_by_name(schema, name);
+    if (!result)
+    {
+        result = ldap_schema_get_attributetype_by_oid(schema, name);
+    }
+
+    if (!result)
+    {
+        LDAPAttributeType **types = ldap_schema_attribute_types(schema);
+        for (int i = 0; types && types[i] && !result; ++i)
+        {
+            if (filter_names_contain(types[i]->at_names, name))
+            {
+                result = types[i];
+            }
+        }
+        talloc_free(types);
+    }
+
+    return result;
+}
+
+static const char *filter_find_objectclass_oid(const ldap_schema_t *schema, const char *name)
+{
+    LDAPObjectClass *result = ldap_schema_get_objectclass_by_name(schema, name);
+
+    if (!result)
+    {
+        LDAPObjectClass **classes = ldap_schema_object_classes(schema);
+        for (int i = 0; classes && classes[i] && !result; ++i)
+        {
+            if (filter_names_contain(classes[i]->oc_names, name))
+            {
+                result = classes[i];
+            }
+        }
+        talloc_free(classes);
+    }
+
+    return result ? result->oc_oid : NULL;
+}
+
+/**
+ * @brief filter_resolve_rule Selects matching rule for the attribute.
+ *
+ * Rule of the operation is taken from attribute type or its supertypes, then equality rule and syntax are tried.
+ * Well known attributes are resolved without schema, other attributes are compared ignoring case.
+ */
+static enum FilterRule filter_resolve_rule(const LDAPAttributeType *type, const ldap_schema_t *schema,
+                                           const char *attribute, enum FilterOpcode opcode)
+{
+    enum FilterRule rule = FILTER_RULE_NONE;
+
+    for (int depth = 0; type && depth < FILTER_MAX_SUPERTYPES; ++depth)
+    {
+        const char *specific = opcode == FILTER_OP_SUBSTRINGS ? type->at_substr_oid
+                             : opcode == FILTER_OP_EQUALITY ? type->at_equality_oid : type->at_ordering_oid;
+
+        if ((rule = filter_rule_by_name(specific)) != FILTER_RULE_NONE
+            || (rule = filter_rule_by_name(type->at_equality_oid)) != FILTER_RULE_NONE
+            || (rule = filter_rule_by_syntax(type->at_syntax_oid)) != FILTER_RULE_NONE)
+        {
+            return rule;
+        }
+
+        type = filter_find_attribute_type(schema, type->at_sup_oid);
+    }
+
+    for (size_t i = 0; i < number_of_elements(ATTRIBUTE_RULES); ++i)
+    {
+        if (g_ascii_strcasecmp(attribute, ATTRIBUTE_RULES[i].name) == 0)
+        {
+            return ATTRIBUTE_RULES[i].rule;
+        }
+    }
+
+    return FILTER_RULE_CASE_IGNORE;
+}
+
+static bool filter_rule_supports(enum FilterRule rule, enum FilterOpcode opcode)
+{
+    switch (opcode)
+    {
+    case FILTER_OP_GREATER_OR_EQUAL:
+    case FILTER_OP_LESS_OR_EQUAL:
+        return rule != FILTER_RULE_DN && rule != FILTER_RULE_OID;
+    case FILTER_OP_SUBSTRINGS:
+        return rule == FILTER_RULE_CASE_IGNORE || rule == FILTER_RULE_CASE_EXACT
+            || rule == FILTER_RULE_NUMERIC_STRING || rule == FILTER_RULE_OCTET_STRING;
+    default:
+        return rule != FILTER_RULE_NONE;
+    }
+}
+
+/**
+ * @brief filter_compile_names Collects names the attribute may have in entries.
+ *
+ * Entries look attributes up ignoring case, so names differing only in case are collected once.
+ */
+static bool filter_compile_names(ld_filter_program_t *program, filter_instruction_t *instruction,
+                                 const char *attribute, const LDAPAttributeType *type)
+{
+    unsigned int count = 1;
+    while (type && type->at_names && type->at_names[count - 1])
+    {
+        ++count;
+    }
+
+    instruction->names = talloc_zero_array(program, char*, count + 2);
+    if (!instruction->names)
+    {
+        return false;
+    }
+
+    unsigned int index = 0;
+    instruction->names[index++] = talloc_strdup(instruction->names, attribute);
+    for (unsigned int i = 0; type && type->at_names && type->at_names[i]; ++i)
+    {
+        if (g_ascii_strcasecmp(type->at_names[i], attribute) != 0)
+        {
+            instruction->names[index++] = talloc_strdup(instruction->names, type->at_names[i]);
+        }
+    }
+    if (type && type->at_oid && g_ascii_strcasecmp(type->at_oid, attribute) != 0)
+    {
+        instruction->names[index++] = talloc_strdup(instruction->names, type->at_oid);
+    }
+
+    for (unsigned int i = 0; i < index; ++i)
+    {
+        if (!instruction->names[i])
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief filter_compile_assertion Normalizes assertion value with the matching rule.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_MISSING_ATTRIBUTE if value is invalid for the rule.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode filter_compile_assertion(ld_filter_program_t *program, enum FilterRule rule,
+                                                         const ld_filter_value_t *value, bool trim,
+                                                         filter_assertion_t *assertion)
+{
+    filter_buffer_t buffer;
+
+    memset(assertion, 0, sizeof(*assertion));
+
+    if (rule == FILTER_RULE_GENERALIZED_TIME || rule == FILTER_RULE_UTC_TIME)
+    {
+        return filter_parse_time(value->data, rule == FILTER_RULE_UTC_TIME, &assertion->number)
+                ? RETURN_CODE_SUCCESS
+                : RETURN_CODE_MISSING_ATTRIBUTE;
+    }
+
+    if (!filter_normalize(rule, value->data, trim, &buffer))
+    {
+        return RETURN_CODE_MISSING_ATTRIBUTE;
+    }
+
+    assertion->data = talloc_strndup(program, buffer.data, buffer.len);
+    assertion->len = buffer.len;
+    filter_buffer_release(&buffer);
+
+    if (!assertion->data)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (rule == FILTER_RULE_OID)
+    {
+        assertion->numeric_oid = g_ascii_isdigit(*assertion->data);
+        assertion->oid = assertion->numeric_oid ? assertion->data
+                       : program->schema ? filter_find_objectclass_oid(program->schema, value->data) : NULL;
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+static enum OperationReturnCode filter_compile_substrings(ld_filter_program_t *program,
+                                                          filter_instruction_t *instruction,
+                                                          const ld_filter_t *filter)
+{
+    enum OperationReturnCode rc = RETURN_CODE_SUCCESS;
+
+    if (filter->initial)
+    {
+        ld_talloc(instruction->initial, error_exit, program, filter_assertion_t);
+        rc = filter_compile_assertion(program, instruction->rule, filter->initial, false, instruction->initial);
+    }
+
+    if (rc == RETURN_CODE_SUCCESS && filter->final)
+    {
+        ld_talloc(instruction->final, error_exit, program, filter_assertion_t);
+        rc = filter_compile_assertion(program, instruction->rule, filter->final, false, instruction->final);
+    }
+
+    if (rc == RETURN_CODE_SUCCESS && filter->n_any > 0)
+    {
+        ld_talloc_array(instruction->any, error_exit, program, filter_assertion_t, filter->n_any);
+        for (unsigned int i = 0; i < filter->n_any && rc == RETURN_CODE_SUCCESS; ++i)
+        {
+            rc = filter_compile_assertion(program, instruction->rule, &filter->any[i], false, &instruction->any[i]);
+            ++instruction->n_any;
+        }
+    }
+
+    return rc;
+
+    error_exit:
+        return RETURN_CODE_FAILURE;
+}
+
+static bool filter_compile_item(ld_filter_program_t *program, filter_instruction_t *instruction,
+                                const ld_filter_t *filter, enum FilterOpcode opcode)
+{
+    char attribute[FILTER_STACK_BUFFER_SIZE];
+
+    // Options like ;binary are not part of the attribute type.
+    size_t len = strcspn(filter->attribute, ";");
+    if (len >= sizeof(attribute))
+    {
+        len = sizeof(attribute) - 1;
+    }
+    memcpy(attribute, filter->attribute, len);
+    attribute[len] = '\0';
+
+    LDAPAttributeType *type = filter_find_attribute_type(program->schema, attribute);
+
+    if (!filter_compile_names(program, instruction, filter->attribute, type))
+    {
+        return false;
+    }
+
+    instruction->opcode = opcode;
+
+    if (opcode == FILTER_OP_PRESENT)
+    {
+        return true;
+    }
+
+    if (filter->type == LD_FILTER_EXTENSIBLE && filter->matching_rule)
+    {
+        if (strcmp(filter->matching_rule, BITWISE_AND_RULE) == 0
+            || strcmp(filter->matching_rule, BITWISE_OR_RULE) == 0)
+        {
+            instruction->opcode = strcmp(filter->matching_rule, BITWISE_AND_RULE) == 0
+                                ? FILTER_OP_BITWISE_AND : FILTER_OP_BITWISE_OR;
+            instruction->rule = FILTER_RULE_INTEGER;
+            if (!filter_parse_number(filter->value.data, &instruction->assertion.number))
+            {
+                instruction->opcode = FILTER_OP_UNDEFINED;
+            }
+            return true;
+        }
+
+        instruction->rule = filter_rule_by_name(filter->matching_rule);
+    }
+    else
+    {
+        instruction->rule = filter_resolve_rule(type, program->schema, attribute, opcode);
+    }
+
+    if (!filter_rule_supports(instruction->rule, opcode))
+    {
+        instruction->opcode = FILTER_OP_UNDEFINED;
+        return true;
+    }
+
+    enum OperationReturnCode rc = opcode == FILTER_OP_SUBSTRINGS
+                                ? filter_compile_substrings(program, instruction, filter)
+                                : filter_compile_assertion(program, instruction->rule, &filter->value, true,
+                                                           &instruction->assertion);
+    if (rc == RETURN_CODE_MISSING_ATTRIBUTE)
+    {
+        instruction->opcode = FILTER_OP_UNDEFINED;
+    }
+
+    return rc != RETURN_CODE_FAILURE;
+}
+
+static bool filter_compile_node(ld_filter_program_t *program, const ld_filter_t *filter)
+{
+    filter_instruction_t *instruction = &program->instructions[program->n_instructions++];
+    bool result = true;
+
+    memset(instruction, 0, sizeof(*instruction));
+
+    switch (filter->type)
+    {
+    case LD_FILTER_AND:
+    case LD_FILTER_OR:
+    case LD_FILTER_NOT:
+        instruction->opcode = filter->type == LD_FILTER_AND ? FILTER_OP_AND
+                            : filter->type == LD_FILTER_OR ? FILTER_OP_OR : FILTER_OP_NOT;
+        for (unsigned int i = 0; i < filter->n_children && result; ++i)
+        {
+            result = filter_compile_node(program, filter->children[i]);
+        }
+        break;
+    case LD_FILTER_EQUALITY:
+    case LD_FILTER_APPROX:
+        result = filter_compile_item(program, instruction, filter, FILTER_OP_EQUALITY);
+        break;
+    case LD_FILTER_GREATER_OR_EQUAL:
+        result = filter_compile_item(program, instruction, filter, FILTER_OP_GREATER_OR_EQUAL);
+        break;
+    case LD_FILTER_LESS_OR_EQUAL:
+        result = filter_compile_item(program, instruction, filter, FILTER_OP_LESS_OR_EQUAL);
+        break;
+    case LD_FILTER_SUBSTRINGS:
+        result = filter_compile_item(program, instruction, filter, FILTER_OP_SUBSTRINGS);
+        break;
+    case LD_FILTER_PRESENT:
+        result = filter_compile_item(program, instruction, filter, FILTER_OP_PRESENT);
+        break;
+    case LD_FILTER_EXTENSIBLE:
+        // Matching values of all attributes is not supported.
+        if (filter->attribute)
+        {
+            result = filter_compile_item(program, instruction, filter, FILTER_OP_EQUALITY);
+        }
+        else
+        {
+            instruction->opcode = FILTER_OP_UNDEFINED;
+        }
+        break;
+    }
+
+    instruction->end = program->n_instructions;
+
+    return result;
+}
+
+static unsigned int filter_count_nodes(const ld_filter_t *filter)
+{
+    unsigned int result = 1;
+
+    for (unsigned int i = 0; i < filter->n_children; ++i)
+    {
+        result += filter_count_nodes(filter->children[i]);
+    }
+
+    return result;
+}
+
+static enum FilterRule filter_attribute_rule_for(const ldap_schema_t *schema, const char *attribute,
+                                                 enum FilterOpcode opcode)
+{
+    char type_name[FILTER_STACK_BUFFER_SIZE];
+
+    size_t len = strcspn(attribute, ";");
+    if (len >= sizeof(type_name))
+    {
+        len = sizeof(type_name) - 1;
+    }
+    memcpy(type_name, attribute, len);
+    type_name[len] = '\0';
+
+    return filter_resolve_rule(filter_find_attribute_type(schema, type_name), schema, type_name, opcode);
+}
+
+/**
+ * @brief filter_attribute_rule Returns equality matching rule of the attribute.
+ * @param[in] schema            Schema to resolve rule with, may be NULL.
+ * @param[in] attribute         Attribute description.
+ * @return Matching rule.
+ */
+enum FilterRule filter_attribute_rule(const ldap_schema_t *schema, const char *attribute)
+{
+    return filter_attribute_rule_for(schema, attribute, FILTER_OP_EQUALITY);
+}
+
+/**
+ * @brief filter_ordering_rule Returns ordering matching rule of the attribute.
+ * @param[in] schema           Schema to resolve rule with, may be NULL.
+ * @param[in] attribute        Attribute description.
+ * @return Matching rule, equality rule if attribute has no ordering rule.
+ */
+enum FilterRule filter_ordering_rule(const ldap_schema_t *schema, const char *attribute)
+{
+    return filter_attribute_rule_for(schema, attribute, FILTER_OP_LESS_OR_EQUAL);
+}
+
+/**
+ * @brief filter_normalize_key Converts value into key equal for all values the matching rule considers equal.
+ *
+ * Times are converted into fixed width hex numbers so keys of times sort in time order,
+ * object identifiers are resolved into OIDs when schema is available.
+ * @param[in] ctx              Talloc ctx to use.
+ * @param[in] schema           Schema to resolve object identifiers with, may be NULL.
+ * @param[in] rule             Matching rule.
+ * @param[in] value            Value to convert.
+ * @param[in] trim             Remove leading and trailing spaces, false for substrings.
+ * @return
+ *        - Key.
+ *        - NULL if value is invalid for the rule or on failure.
+ */
+char *filter_normalize_key(TALLOC_CTX *ctx, const ldap_schema_t *schema, enum FilterRule rule,
+                           const char *value, bool trim)
+{
+    filter_buffer_t buffer;
+    int64_t number = 0;
+
+    if (rule == FILTER_RULE_GENERALIZED_TIME || rule == FILTER_RULE_UTC_TIME)
+    {
+        if (!filter_parse_time(value, rule == FILTER_RULE_UTC_TIME, &number))
+        {
+            return NULL;
+        }
+        return talloc_asprintf(ctx, "%016" PRIx64, (uint64_t)number ^ UINT64_C(0x8000000000000000));
+    }
+
+    if (rule == FILTER_RULE_OID && schema && !g_ascii_isdigit(*value))
+    {
+        const char *oid = filter_find_objectclass_oid(schema, value);
+        if (oid)
+        {
+            return talloc_strdup(ctx, oid);
+        }
+    }
+
+    if (!filter_normalize(rule, value, trim, &buffer))
+    {
+        return NULL;
+    }
+
+    char *result = talloc_strndup(ctx, buffer.data, buffer.len);
+    filter_buffer_release(&buffer);
+
+    return result;
+}
+
+/**
+ * @brief filter_compare_keys Compares keys created by filter_normalize_key in order of the matching rule.
+ */
+int filter_compare_keys(enum FilterRule rule, const char *first, const char *second)
+{
+    if (rule == FILTER_RULE_INTEGER)
+    {
+        return filter_compare_integers(first, strlen(first), second, strlen(second));
+    }
+
+    return strcmp(first, second);
+}
+
+/**
+ * @brief ld_filter_compile Compiles filter into program evaluated against entries.
+ *
+ * Matching rules are resolved once per attribute from the schema, assertion values are normalized
+ * during compilation. Attribute values in DN of entry are not matched by extensible match.
+ * @param[in] ctx            Talloc ctx to use.
+ * @param[in] filter         Filter to compile.
+ * @param[in] schema         Schema to resolve matching rules with, may be NULL. Schema must outlive the program.
+ * @return
+ *        - Compiled program.
+ *        - NULL on failure.
+ */
+ld_filter_program_t *ld_filter_compile(TALLOC_CTX *ctx, const ld_filter_t *filter, const ldap_schema_t *schema)
+{
+    ld_filter_program_t *result = NULL;
+
+    if (!filter)
+    {
+        ld_error("ld_filter_compile - invalid filter!\n");
+        return NULL;
+    }
+
+    ld_talloc_zero_e(result, error_exit, "ld_filter_compile - out of memory - unable to create program!\n",
+                     ctx, ld_filter_program_t);
+    result->schema = schema;
+
+    ld_talloc_array_e(result->instructions, error_exit,
+                      "ld_filter_compile - out of memory - unable to create program!\n",
+                      result, filter_instruction_t, filter_count_nodes(filter));
+
+    if (!filter_compile_node(result, filter))
+    {
+        ld_error("ld_filter_compile - out of memory - unable to compile filter!\n");
+        goto error_exit;
+    }
+
+    return result;
+
+    error_exit:
+        talloc_free(result);
+        return NULL;
+}
+
+/**
+ * @brief ld_filter_compile_string Parses and compiles filter.
+ * @param[in] ctx                   Talloc ctx to use.
+ * @param[in] filter                Filter in RFC 4515 format.
+ * @param[in] schema                Schema to resolve matching rules with, may be NULL.
+ * @return
+ *        - Compiled program.
+ *        - NULL if filter is invalid or on failure.
+ */
+ld_filter_program_t *ld_filter_compile_string(TALLOC_CTX *ctx, const char *filter, const ldap_schema_t *schema)
+{
+    ld_filter_t *parsed = ld_filter_parse(ctx, filter);
+    if (!parsed)
+    {
+        return NULL;
+    }
+
+    ld_filter_program_t *result = ld_filter_compile(ctx, parsed, schema);
+
+    talloc_free(parsed);
+
+    return result;
+}
+
+/**
+ * @brief filter_find_attribute Finds attribute of the entry by any of its names or OID.
+ *
+ * Case is resolved by attribute table of the entry and aliases are collected at compile time,
+ * so lookup costs one hash lookup per name.
+ */
+static LDAPAttribute_t *filter_find_attribute(const filter_instruction_t *instruction, ld_entry_t *entry)
+{
+    for (int i = 0; instruction->names[i]; ++i)
+    {
+        LDAPAttribute_t *attribute = g_hash_table_lookup(entry->attributes, instruction->names[i]);
+        if (attribute)
+        {
+            return attribute;
+        }
+    }
+
+    return NULL;
+}
+
+static const char *filter_find(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len)
+{
+    if (needle_len == 0)
+    {
+        return haystack;
+    }
+
+    const char *end = haystack + haystack_len;
+    for (const char *p = haystack; p + needle_len <= end; ++p)
+    {
+        p = memchr(p, *needle, (end - p) - needle_len + 1);
+        if (!p)
+        {
+            return NULL;
+        }
+        if (memcmp(p, needle, needle_len) == 0)
+        {
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+static bool filter_match_substrings(const filter_instruction_t *instruction, const char *value, size_t len)
+{
+    const char *p = value;
+    const char *end = value + len;
+
+    if (instruction->initial)
+    {
+        if (instruction->initial->len > len || memcmp(value, instruction->initial->data, instruction->initial->len))
+        {
+            return false;
+        }
+        p += instruction->initial->len;
+    }
+
+    if (instruction->final)
+    {
+        if (instruction->final->len > (size_t)(end - p)
+            || memcmp(end - instruction->final->len, instruction->final->data, instruction->final->len))
+        {
+            return false;
+        }
+        end -= instruction->final->len;
+    }
+
+    for (unsigned int i = 0; i < instruction->n_any; ++i)
+    {
+        p = filter_find(p, end - p, instruction->any[i].data, instruction->any[i].len);
+        if (!p)
+        {
+            return false;
+        }
+        p += instruction->any[i].len;
+    }
+
+    return true;
+}
+
+static int filter_compare(enum FilterRule rule, const char *value, size_t len, const filter_assertion_t *assertion)
+{
+    if (rule == FILTER_RULE_INTEGER)
+    {
+        return filter_compare_integers(value, len, assertion->data, assertion->len);
+    }
+
+    int result = memcmp(value, assertion->data, len < assertion->len ? len : assertion->len);
+    if (result != 0)
+    {
+        return result;
+    }
+
+    return len < assertion->len ? -1 : len > assertion->len ? 1 : 0;
+}
+
+static enum LdapFilterMatchResult filter_match_oid(const ld_filter_program_t *program,
+                                                   const filter_instruction_t *instruction,
+                                                   const char *value)
+{
+    const filter_assertion_t *assertion = &instruction->assertion;
+
+    if (g_ascii_strcasecmp(value, assertion->data) == 0)
+    {
+        return LD_FILTER_MATCH_TRUE;
+    }
+
+    if (!assertion->oid)
+    {
+        return LD_FILTER_MATCH_FALSE;
+    }
+
+    if (g_ascii_isdigit(*value))
+    {
+        return strcmp(value, assertion->oid) == 0 ? LD_FILTER_MATCH_TRUE : LD_FILTER_MATCH_FALSE;
+    }
+
+    if (assertion->numeric_oid && program->schema)
+    {
+        const char *oid = filter_find_objectclass_oid(program->schema, value);
+        return oid && strcmp(oid, assertion->oid) == 0 ? LD_FILTER_MATCH_TRUE : LD_FILTER_MATCH_FALSE;
+    }
+
+    return LD_FILTER_MATCH_FALSE;
+}
+
+static enum LdapFilterMatchResult filter_match_value(const ld_filter_program_t *program,
+                                                     const filter_instruction_t *instruction,
+                                                     const char *value)
+{
+    const filter_assertion_t *assertion = &instruction->assertion;
+    int64_t number = 0;
+    int compare = 0;
+
+    switch (instruction->opcode)
+    {
+    case FILTER_OP_BITWISE_AND:
+    case FILTER_OP_BITWISE_OR:
+        if (!filter_parse_number(value, &number))
+        {
+            return LD_FILTER_MATCH_UNDEFINED;
+        }
+        return (instruction->opcode == FILTER_OP_BITWISE_AND
+                ? (number & assertion->number) == assertion->number
+                : (number & assertion->number) != 0) ? LD_FILTER_MATCH_TRUE : LD_FILTER_MATCH_FALSE;
+    default:
+        break;
+    }
+
+    if (instruction->rule == FILTER_RULE_GENERALIZED_TIME || instruction->rule == FILTER_RULE_UTC_TIME)
+    {
+        if (!filter_parse_time(value, instruction->rule == FILTER_RULE_UTC_TIME, &number))
+        {
+            return LD_FILTER_MATCH_UNDEFINED;
+        }
+        compare = number < assertion->number ? -1 : number > assertion->number ? 1 : 0;
+    }
+    else if (instruction->rule == FILTER_RULE_OID)
+    {
+        return filter_match_oid(program, instruction, value);
+    }
+    else if (instruction->rule == FILTER_RULE_DN && g_ascii_strcasecmp(value, assertion->data) == 0)
+    {
+        return LD_FILTER_MATCH_TRUE;
+    }
+    else
+    {
+        filter_buffer_t buffer;
+        bool result = false;
+
+        if (!filter_normalize(instruction->rule, value, true, &buffer))
+        {
+            return LD_FILTER_MATCH_UNDEFINED;
+        }
+
+        if (instruction->opcode == FILTER_OP_SUBSTRINGS)
+        {
+            result = filter_match_substrings(instruction, buffer.data, buffer.len);
+            filter_buffer_release(&buffer);
+            return result ? LD_FILTER_MATCH_TRUE : LD_FILTER_MATCH_FALSE;
+        }
+
+        compare = filter_compare(instruction->rule, buffer.data, buffer.len, assertion);
+        filter_buffer_release(&buffer);
+    }
+
+    switch (instruction->opcode)
+    {
+    case FILTER_OP_EQUALITY:
+        return compare == 0 ? LD_FILTER_MATCH_TRUE : LD_FILTER_MATCH_FALSE;
+    case FILTER_OP_GREATER_OR_EQUAL:
+        return compare >= 0 ? LD_FILTER_MATCH_TRUE : LD_FILTER_MATCH_FALSE;
+    case FILTER_OP_LESS_OR_EQUAL:
+        return compare <= 0 ? LD_FILTER_MATCH_TRUE : LD_FILTER_MATCH_FALSE;
+    default:
+        return LD_FILTER_MATCH_UNDEFINED;
+    }
+}
+
+static enum LdapFilterMatchResult filter_execute(const ld_filter_program_t *program, unsigned int pc,
+                                                 ld_entry_t *entry)
+{
+    const filter_instruction_t *instruction = &program->instructions[pc];
+    enum LdapFilterMatchResult result = LD_FILTER_MATCH_FALSE;
+
+    switch (instruction->opcode)
+    {
+    case FILTER_OP_AND:
+    case FILTER_OP_OR:
+    {
+        // FALSE decides AND, TRUE decides OR, remaining children are skipped.
+        enum LdapFilterMatchResult decisive = instruction->opcode == FILTER_OP_AND
+                                            ? LD_FILTER_MATCH_FALSE : LD_FILTER_MATCH_TRUE;
+        result = instruction->opcode == FILTER_OP_AND ? LD_FILTER_MATCH_TRUE : LD_FILTER_MATCH_FALSE;
+
+        for (unsigned int child = pc + 1; child < instruction->end; child = program->instructions[child].end)
+        {
+            enum LdapFilterMatchResult child_result = filter_execute(program, child, entry);
+            if (child_result == decisive)
+            {
+                return decisive;
+            }
+            if (child_result == LD_FILTER_MATCH_UNDEFINED)
+            {
+                result = LD_FILTER_MATCH_UNDEFINED;
+            }
+        }
+        return result;
+    }
+    case FILTER_OP_NOT:
+        result = filter_execute(program, pc + 1, entry);
+        return result == LD_FILTER_MATCH_UNDEFINED ? result
+             : result == LD_FILTER_MATCH_TRUE ? LD_FILTER_MATCH_FALSE : LD_FILTER_MATCH_TRUE;
+    case FILTER_OP_UNDEFINED:
+        return LD_FILTER_MATCH_UNDEFINED;
+    default:
+        break;
+    }
+
+    LDAPAttribute_t *attribute = filter_find_attribute(instruction, entry);
+    if (!attribute || !attribute->values || !attribute->values[0])
+    {
+        return LD_FILTER_MATCH_FALSE;
+    }
+
+    if (instruction->opcode == FILTER_OP_PRESENT)
+    {
+        return LD_FILTER_MATCH_TRUE;
+    }
+
+    for (int i = 0; attribute->values[i]; ++i)
+    {
+        enum LdapFilterMatchResult value_result = filter_match_value(program, instruction, attribute->values[i]);
+        if (value_result == LD_FILTER_MATCH_TRUE)
+        {
+            return LD_FILTER_MATCH_TRUE;
+        }
+        if (value_result == LD_FILTER_MATCH_UNDEFINED)
+        {
+            result = LD_FILTER_MATCH_UNDEFINED;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief ld_filter_evaluate Evaluates compiled filter against entry using three-valued logic of RFC 4511.
+ * @param[in] program         Compiled filter.
+ * @param[in] entry           Entry to evaluate.
+ * @return
+ *        - LD_FILTER_MATCH_TRUE if entry matches.
+ *        - LD_FILTER_MATCH_FALSE if entry does not match.
+ *        - LD_FILTER_MATCH_UNDEFINED if filter can't be evaluated for the entry.
+ */
+enum LdapFilterMatchResult ld_filter_evaluate(const ld_filter_program_t *program, ld_entry_t *entry)
+{
+    if (!program || !entry || !entry->attributes)
+    {
+        ld_error("ld_filter_evaluate - invalid program or entry!\n");
+        return LD_FILTER_MATCH_UNDEFINED;
+    }
+
+    return filter_execute(program, 0, entry);
+}
+
+/**
+ * @brief ld_filter_match Checks if entry would be returned by search with the filter.
+ * @param[in] program      Compiled filter.
+ * @param[in] entry        Entry to check.
+ * @return
+ *        - true if filter evaluates to TRUE.
+ *        - false otherwise.
+ */
+bool ld_filter_match(const ld_filter_program_t *program, ld_entry_t *entry)
+{
+    return ld_filter_evaluate(program, entry) == LD_FILTER_MATCH_TRUE;
+}
@@ -0,0 +1,45 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_FILTER_MATCH_H
+#define LIBDOMAIN_FILTER_MATCH_H
+
+#include "filter.h"
+
+#include <stdbool.h>
+
+enum LdapFilterMatchResult
+{
+    LD_FILTER_MATCH_FALSE       = 0,    //!< Entry does not match the filter.
+    LD_FILTER_MATCH_TRUE        = 1,    //!< Entry matches the filter.
+    LD_FILTER_MATCH_UNDEFINED   = 2,    //!< Filter can't be evaluated for the entry, e.g. matching rule is unknown.
+};
+
+typedef struct ld_entry_s ld_entry_t;
+typedef struct ldap_schema_t ldap_schema_t;
+typedef struct ld_filter_program_s ld_filter_program_t;
+
+ld_filter_program_t *ld_filter_compile(TALLOC_CTX *ctx, const ld_filter_t *filter, const ldap_schema_t *schema);
+ld_filter_program_t *ld_filter_compile_string(TALLOC_CTX *ctx, const char *filter, const ldap_schema_t *schema);
+
+enum LdapFilterMatchResult ld_filter_evaluate(const ld_filter_program_t *program, ld_entry_t *entry);
+bool ld_filter_match(const ld_filter_program_t *program, ld_entry_t *entry);
+
+#endif //LIBDOMAIN_FILTER_MATCH_H
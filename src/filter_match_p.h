@@ -0,0 +1,50 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_FILTER_MATCH_PRIVATE_H
+#define LIBDOMAIN_FILTER_MATCH_PRIVATE_H
+
+#include "filter_match.h"
+
+/*!
+ * @brief FilterRule - Matching rules supported by the filter matcher.
+ */
+enum FilterRule
+{
+    FILTER_RULE_NONE,
+    FILTER_RULE_CASE_IGNORE,
+    FILTER_RULE_CASE_EXACT,
+    FILTER_RULE_NUMERIC_STRING,
+    FILTER_RULE_INTEGER,
+    FILTER_RULE_OCTET_STRING,
+    FILTER_RULE_DN,
+    FILTER_RULE_OID,
+    FILTER_RULE_GENERALIZED_TIME,
+    FILTER_RULE_UTC_TIME,
+};
+
+enum FilterRule filter_rule_by_name(const char *name);
+enum FilterRule filter_attribute_rule(const ldap_schema_t *schema, const char *attribute);
+enum FilterRule filter_ordering_rule(const ldap_schema_t *schema, const char *attribute);
+char *filter_normalize_key(TALLOC_CTX *ctx, const ldap_schema_t *schema, enum FilterRule rule,
+                           const char *value, bool trim);
+int filter_compare_keys(enum FilterRule rule, const char *first, const char *second);
+
+#endif //LIBDOMAIN_FILTER_MATCH_PRIVATE_H
@@ -0,0 +1,54 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_FILTER_PRIVATE_H
+#define LIBDOMAIN_FILTER_PRIVATE_H
+
+#include "filter.h"
+
+/*!
+ * @brief ld_filter_value_t - Assertion value of the filter.
+ */
+typedef struct ld_filter_value_s
+{
+    char *data;                         //!< Unescaped value, NULL terminated.
+    size_t len;                         //!< Length of value, value may contain zero bytes.
+    int parameter;                      //!< Index of template parameter in place of the value, -1 for literal values.
+} ld_filter_value_t;
+
+/*!
+ * @brief ld_filter_t - Node of the filter tree.
+ */
+struct ld_filter_s
+{
+    enum LdapFilterType type;           //!< Type of the node.
+    char *attribute;                    //!< Attribute description, may be NULL for extensible match.
+    char *matching_rule;                //!< Matching rule of extensible match, may be NULL.
+    bool dn_attributes;                 //!< Extensible match includes DN attributes.
+    ld_filter_value_t value;            //!< Value of equality, ordering, approximate and extensible match.
+    ld_filter_value_t *initial;         //!< Initial substring, may be NULL.
+    ld_filter_value_t *any;             //!< Array of any substrings.
+    unsigned int n_any;                 //!< Amount of any substrings.
+    ld_filter_value_t *final;           //!< Final substring, may be NULL.
+    struct ld_filter_s **children;      //!< Child filters of AND, OR and NOT.
+    unsigned int n_children;            //!< Amount of child filters.
+};
+
+#endif //LIBDOMAIN_FILTER_PRIVATE_H
@@ -21,11 +21,19 @@
 #include "group.h"
 #include "common.h"
 #include "directory.h"
+#include "dn.h"
 #include "domain_p.h"
 #include "entry.h"
+#include "entry_cache.h"
+#include "range_retrieval.h"
+
+#include <glib-2.0/glib.h>
 
 #include <string.h>
 
+#define GROUP_MEMBERS_CHUNK_SIZE 5000
+#define GROUP_PERMISSIVE_MODIFY_OID "1.2.840.113556.1.4.1413"
+
 enum GroupAttributeIndex
 {
     OBJECT_CLASS = 0,
@@ -62,6 +70,39 @@ enum OperationReturnCode ld_add_group(LDHandle *handle,
     return rc;
 }
 
+/**
+ * @brief ld_add_groups Creates groups.
+ *
+ * Requests are pipelined, callback may be called before function returns.
+ * @param[in] handle    Pointer to libdomain session handle.
+ * @param[in] groups    Groups to create.
+ * @param[in] n_groups  Amount of groups.
+ * @param[in] defaults  Attributes shared by all groups, may be NULL.
+ * @param[in] parent    Container of the groups, NULL for base DN.
+ * @param[in] callback  Callback to report results of groups to.
+ * @param[in] user_data User data passed to callback.
+ * @return
+ *        - RETURN_CODE_SUCCESS if creation has been started.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_add_groups(LDHandle *handle,
+                                       const ld_batch_item_t *groups,
+                                       int n_groups,
+                                       LDAPAttribute_t **defaults,
+                                       const char *parent,
+                                       batch_complete_callback_fn callback,
+                                       void *user_data)
+{
+    const char *dn = handle ? handle->global_config->base_dn : NULL;
+
+    if (parent && strlen(parent) > 0)
+    {
+        dn = parent;
+    }
+
+    return ld_batch_add_entries(handle, groups, n_groups, defaults, dn, "cn", 0, callback, user_data);
+}
+
 /**
  * @brief ld_del_group     Deletes the group.
  * @param[in] handle       Pointer to libdomain session handle.
@@ -107,29 +148,42 @@ enum OperationReturnCode ld_rename_group(LDHandle *handle, const char *old_name,
     return ld_rename_entry(handle, old_name, new_name, parent ? parent : handle ? handle->global_config->base_dn : NULL, "cn");
 }
 
-static enum OperationReturnCode group_member_modify(LDHandle *handle, const char *group_dn, const char *user_dn,
-                                                    char mod_operation)
+/**
+ * @brief group_member_attribute Returns attribute holding members of the group.
+ * @param[in] handle             Pointer to libdomain session handle.
+ * @return
+ *        - Name of the attribute.
+ *        - NULL if membership modification is not supported by the directory.
+ */
+static const char *group_member_attribute(LDHandle *handle)
 {
-    const char *this_group_dn = NULL;
-    const char *this_user_dn = NULL;
-    const char *member;
-
     switch (handle->connection_ctx->directory_type)
     {
     case LDAP_TYPE_OPENLDAP:
-        member = "memberuid";
-        break;
+        return "memberuid";
     case LDAP_TYPE_ACTIVE_DIRECTORY:
-        member = "member";
-        break;
+        return "member";
     case LDAP_TYPE_FREE_IPA:
         ld_info("User addition or deletion from group is not implemented in free ipa.\n");
     default:
-        return RETURN_CODE_FAILURE;
+        return NULL;
     }
+}
+
+static enum OperationReturnCode group_member_modify(LDHandle *handle, const char *group_dn, const char *user_dn,
+                                                    char mod_operation)
+{
+    const char *this_group_dn = NULL;
+    const char *this_user_dn = NULL;
 
     check_handle(handle, "group_member_modify");
 
+    const char *member = group_member_attribute(handle);
+    if (!member)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
     check_string(group_dn, this_group_dn, "group_member_modify");
 
     check_string(user_dn, this_user_dn, "group_member_modify");
@@ -201,3 +255,533 @@ enum OperationReturnCode ld_group_remove_user(LDHandle *handle, const char *grou
     return group_member_modify(handle, group_name, user_name, LDAP_MOD_DELETE);
 }
 
+/**
+ * @brief ld_group_has_user Checks whether user is a direct member of the group with a single compare request.
+ * @param[in] handle               Pointer to libdomain session handle.
+ * @param[in] group_name           Name of the group.
+ * @param[in] user_name            Name of the user, the same value ld_group_add_user accepts.
+ * @param[in] callback             Callback to call with the answer.
+ * @param[in] user_data            User data passed to callback.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_group_has_user(LDHandle *handle,
+                                           const char *group_name,
+                                           const char *user_name,
+                                           compare_callback_fn callback,
+                                           void *user_data)
+{
+    check_handle(handle, "ld_group_has_user");
+
+    const char *member = group_member_attribute(handle);
+    if (!member)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    return ld_compare(handle->talloc_ctx, handle->connection_ctx, group_name, member, user_name, callback, user_data);
+}
+
+
+enum GroupMembersMode
+{
+    GROUP_MEMBERS_ADD     = 0,
+    GROUP_MEMBERS_REMOVE  = 1,
+    GROUP_MEMBERS_REPLACE = 2,
+};
+
+/*!
+ * @brief group_members_t - Bulk modification of group membership.
+ */
+typedef struct group_members_s
+{
+    LDHandle *handle;                                       //!< Session handle.
+    char *group_dn;                                         //!< Group to modify.
+    const char *attribute;                                  //!< Attribute holding members.
+    bool dn_values;                                         //!< Members are DNs compared in normalized form.
+    enum GroupMembersMode mode;                             //!< Requested modification.
+    bool diff;                                              //!< Current membership is read to send only changes.
+
+    GPtrArray *members;                                     //!< Requested members without duplicates in given order.
+    GHashTable *wanted;                                     //!< Requested members by comparison key.
+    GHashTable *current;                                    //!< Current members by comparison key.
+
+    group_members_chunk_callback_fn chunk_callback;         //!< Callback to report results of chunks to.
+    group_members_complete_callback_fn complete_callback;   //!< Callback to call on completion.
+    void *user_data;                                        //!< User data passed to callbacks.
+
+    int pending;                                            //!< Amount of chunks in flight.
+    bool failed;                                            //!< Some of chunks have failed.
+} group_members_t;
+
+/*!
+ * @brief group_chunk_t - Single modify request of bulk modification.
+ */
+typedef struct group_chunk_s
+{
+    group_members_t *members;                               //!< Modification chunk belongs to.
+    int mod_operation;                                      //!< LDAP_MOD_ADD or LDAP_MOD_DELETE.
+    char **values;                                          //!< Members sent by the chunk.
+} group_chunk_t;
+
+static int group_members_destructor(TALLOC_CTX *ctx)
+{
+    group_members_t *members = talloc_get_type_abort(ctx, group_members_t);
+
+    g_ptr_array_free(members->members, TRUE);
+    g_hash_table_destroy(members->wanted);
+    if (members->current)
+    {
+        g_hash_table_destroy(members->current);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief group_member_key Returns value members are compared by.
+ */
+static char *group_member_key(TALLOC_CTX *ctx, const group_members_t *members, const char *value)
+{
+    char *result = members->dn_values ? ld_dn_normalize(ctx, value) : NULL;
+
+    return result ? result : talloc_strdup(ctx, value);
+}
+
+/**
+ * @brief group_members_finish Calls completion callback and releases modification.
+ */
+static void group_members_finish(group_members_t *members)
+{
+    if (members->complete_callback)
+    {
+        members->complete_callback(members->handle, members->group_dn,
+                                   members->failed ? RETURN_CODE_FAILURE : RETURN_CODE_SUCCESS,
+                                   members->user_data);
+    }
+
+    talloc_free(members);
+}
+
+/**
+ * @brief group_chunk_complete Reports result of the chunk, completes modification after the last one.
+ */
+static void group_chunk_complete(group_chunk_t *chunk, enum OperationReturnCode rc)
+{
+    group_members_t *members = chunk->members;
+
+    if (rc != RETURN_CODE_SUCCESS)
+    {
+        members->failed = true;
+    }
+
+    if (members->chunk_callback)
+    {
+        members->chunk_callback(members->handle, members->group_dn, chunk->mod_operation, chunk->values, rc,
+                                members->user_data);
+    }
+
+    talloc_free(chunk);
+
+    if (--members->pending == 0)
+    {
+        group_members_finish(members);
+    }
+}
+
+/**
+ * @brief group_members_on_modify This callback is called when result of modify request of the chunk arrives.
+ * @param[in] rc                  Return code of ldap_result.
+ * @param[in] message             Message received from ldap.
+ * @param[in] connection          Connection to work with.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode group_members_on_modify(int rc, LDAPMessage *message,
+                                                        struct ldap_connection_ctx_t *connection)
+{
+    group_chunk_t *chunk = connection->request_user_data;
+    int error_code = LDAP_OTHER;
+    char *diagnostic_message = NULL;
+
+    if (!chunk)
+    {
+        ld_error("group_members_on_modify - chunk is missing!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (rc == LDAP_RES_MODIFY)
+    {
+        ldap_parse_result(connection->ldap, message, &error_code, NULL, &diagnostic_message, NULL, NULL, false);
+    }
+
+    if (error_code != LDAP_SUCCESS)
+    {
+        ld_error("Unable to modify members of %s: %s %s\n", chunk->members->group_dn, ldap_err2string(error_code),
+                 diagnostic_message ? diagnostic_message : "");
+    }
+    else
+    {
+        entry_cache_invalidate_write(connection, chunk->members->group_dn, false, true);
+    }
+
+    ldap_memfree(diagnostic_message);
+
+    enum OperationReturnCode result = error_code == LDAP_SUCCESS ? RETURN_CODE_SUCCESS : RETURN_CODE_FAILURE;
+
+    group_chunk_complete(chunk, result);
+
+    return result;
+}
+
+/**
+ * @brief group_members_send_chunk Sends single modify request with up to GROUP_MEMBERS_CHUNK_SIZE members.
+ * @param[in] members              Modification to work with.
+ * @param[in] mod_operation        LDAP_MOD_ADD or LDAP_MOD_DELETE.
+ * @param[in] values               Members to send.
+ * @param[in] count                Amount of members to send.
+ */
+static void group_members_send_chunk(group_members_t *members, int mod_operation, char **values, guint count)
+{
+    struct ldap_connection_ctx_t *connection = members->handle->connection_ctx;
+    group_chunk_t *chunk = NULL;
+    LDAPMod modification;
+    LDAPMod *modifications[] = { &modification, NULL };
+    LDAPControl permissive_modify = { GROUP_PERMISSIVE_MODIFY_OID, { 0, NULL }, 0 };
+    LDAPControl *controls[] = { &permissive_modify, NULL };
+    int msgid = 0;
+
+    ld_talloc_zero_e(chunk, error_exit, "group_members_send_chunk - out of memory - unable to create chunk!\n",
+                     members, group_chunk_t);
+    chunk->members = members;
+    chunk->mod_operation = mod_operation;
+
+    ld_talloc_array(chunk->values, error_exit, chunk, char*, count + 1);
+    memcpy(chunk->values, values, count * sizeof(char*));
+    chunk->values[count] = NULL;
+
+    ++members->pending;
+
+    modification.mod_op = mod_operation;
+    modification.mod_type = (char *)members->attribute;
+    modification.mod_values = chunk->values;
+
+    // Without diff members may already be present or absent, permissive modify keeps it from failing the chunk.
+    bool permissive = !members->diff && directory_has_capability(connection, LDAP_CAPABILITY_PERMISSIVE_MODIFY);
+
+    int rc = ldap_modify_ext(connection->ldap, members->group_dn, modifications, permissive ? controls : NULL,
+                             NULL, &msgid);
+    if (rc != LDAP_SUCCESS)
+    {
+        ld_error("Unable to create modify request: %s\n", ldap_err2string(rc));
+        group_chunk_complete(chunk, RETURN_CODE_FAILURE);
+        return;
+    }
+
+    if (connection_add_read_request(connection, msgid, group_members_on_modify, chunk) != RETURN_CODE_SUCCESS)
+    {
+        ldap_abandon_ext(connection->ldap, msgid, NULL, NULL);
+        group_chunk_complete(chunk, RETURN_CODE_FAILURE);
+    }
+
+    return;
+
+    error_exit:
+        talloc_free(chunk);
+        members->failed = true;
+}
+
+/**
+ * @brief group_members_send Splits members into chunks and sends them.
+ */
+static void group_members_send(group_members_t *members, int mod_operation, GPtrArray *values)
+{
+    for (guint i = 0; i < values->len; i += GROUP_MEMBERS_CHUNK_SIZE)
+    {
+        group_members_send_chunk(members, mod_operation, (char **)values->pdata + i,
+                                 MIN(values->len - i, GROUP_MEMBERS_CHUNK_SIZE));
+    }
+}
+
+/**
+ * @brief group_members_apply Computes members to add and remove and sends them.
+ *
+ * Completion callback is called right away when there is nothing to send.
+ */
+static void group_members_apply(group_members_t *members)
+{
+    GPtrArray *added = g_ptr_array_new();
+    GPtrArray *removed = g_ptr_array_new();
+
+    for (guint i = 0; i < members->members->len; ++i)
+    {
+        char *key = g_ptr_array_index(members->members, i);
+        bool present = members->current && g_hash_table_contains(members->current, key);
+
+        if (members->mode == GROUP_MEMBERS_REMOVE)
+        {
+            if (!members->current || present)
+            {
+                g_ptr_array_add(removed, g_hash_table_lookup(members->wanted, key));
+            }
+        }
+        else if (!present)
+        {
+            g_ptr_array_add(added, g_hash_table_lookup(members->wanted, key));
+        }
+    }
+
+    if (members->mode == GROUP_MEMBERS_REPLACE)
+    {
+        GHashTableIter iter;
+        gpointer key = NULL;
+        gpointer value = NULL;
+
+        g_hash_table_iter_init(&iter, members->current);
+        while (g_hash_table_iter_next(&iter, &key, &value))
+        {
+            if (!g_hash_table_contains(members->wanted, key))
+            {
+                g_ptr_array_add(removed, value);
+            }
+        }
+    }
+
+    // Keeps modification from being completed while chunks are being sent.
+    ++members->pending;
+
+    group_members_send(members, LDAP_MOD_ADD, added);
+    group_members_send(members, LDAP_MOD_DELETE, removed);
+
+    g_ptr_array_free(added, TRUE);
+    g_ptr_array_free(removed, TRUE);
+
+    if (--members->pending == 0)
+    {
+        group_members_finish(members);
+    }
+}
+
+static enum OperationReturnCode group_members_on_current(struct ldap_connection_ctx_t *connection,
+                                                         const char *dn,
+                                                         const char *attribute,
+                                                         char **values,
+                                                         void *user_data)
+{
+    (void)(connection);
+    (void)(dn);
+    (void)(attribute);
+
+    group_members_t *members = user_data;
+
+    for (int i = 0; values[i]; ++i)
+    {
+        char *key = group_member_key(members, members, values[i]);
+        char *value = talloc_strdup(members, values[i]);
+
+        if (!key || !value)
+        {
+            ld_error("group_members_on_current - out of memory - unable to store member!\n");
+            return RETURN_CODE_FAILURE;
+        }
+
+        g_hash_table_insert(members->current, key, value);
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+static void group_members_on_current_complete(struct ldap_connection_ctx_t *connection,
+                                              ld_range_t *range,
+                                              enum OperationReturnCode rc,
+                                              void *user_data)
+{
+    (void)(connection);
+    (void)(range);
+
+    group_members_t *members = user_data;
+
+    if (rc != RETURN_CODE_SUCCESS)
+    {
+        ld_error("Unable to read members of %s!\n", members->group_dn);
+        members->failed = true;
+        group_members_finish(members);
+        return;
+    }
+
+    group_members_apply(members);
+}
+
+/**
+ * @brief group_members_modify Starts bulk modification of group membership.
+ * @return
+ *        - RETURN_CODE_SUCCESS if modification has been started, complete_callback will be called.
+ *        - RETURN_CODE_FAILURE on failure, callbacks are not called.
+ */
+static enum OperationReturnCode group_members_modify(LDHandle *handle,
+                                                     const char *group_name,
+                                                     char **user_names,
+                                                     enum GroupMembersMode mode,
+                                                     bool diff,
+                                                     group_members_chunk_callback_fn chunk_callback,
+                                                     group_members_complete_callback_fn complete_callback,
+                                                     void *user_data)
+{
+    const char *this_group_dn = NULL;
+    group_members_t *members = NULL;
+
+    check_handle(handle, "group_members_modify");
+
+    check_string(group_name, this_group_dn, "group_members_modify");
+
+    if (!user_names || (mode != GROUP_MEMBERS_REPLACE && !user_names[0]))
+    {
+        ld_error("group_members_modify - empty list of members!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    const char *attribute = group_member_attribute(handle);
+    if (!attribute)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    ld_talloc_zero_e(members, error_exit, "group_members_modify - out of memory - unable to create modification!\n",
+                     handle->talloc_ctx, group_members_t);
+
+    members->members = g_ptr_array_new();
+    members->wanted = g_hash_table_new(g_str_hash, g_str_equal);
+    members->current = g_hash_table_new(g_str_hash, g_str_equal);
+    talloc_set_destructor((void*)members, group_members_destructor);
+
+    members->handle = handle;
+    ld_talloc_strdup(members->group_dn, error_exit, members, this_group_dn);
+    members->attribute = attribute;
+    members->dn_values = handle->connection_ctx->directory_type == LDAP_TYPE_ACTIVE_DIRECTORY;
+    members->mode = mode;
+    members->diff = diff || mode == GROUP_MEMBERS_REPLACE;
+    members->chunk_callback = chunk_callback;
+    members->complete_callback = complete_callback;
+    members->user_data = user_data;
+
+    for (int i = 0; user_names[i]; ++i)
+    {
+        char *key = group_member_key(members, members, user_names[i]);
+        char *value = talloc_strdup(members, user_names[i]);
+
+        if (!key || !value)
+        {
+            ld_error("group_members_modify - out of memory - unable to store member!\n");
+            goto error_exit;
+        }
+
+        if (!g_hash_table_contains(members->wanted, key))
+        {
+            g_hash_table_insert(members->wanted, key, value);
+            g_ptr_array_add(members->members, key);
+        }
+    }
+
+    if (!members->diff)
+    {
+        g_hash_table_destroy(members->current);
+        members->current = NULL;
+
+        group_members_apply(members);
+
+        return RETURN_CODE_SUCCESS;
+    }
+
+    if (!ld_range_retrieve(members, handle->connection_ctx, this_group_dn, attribute, group_members_on_current,
+                           group_members_on_current_complete, members))
+    {
+        goto error_exit;
+    }
+
+    return RETURN_CODE_SUCCESS;
+
+    error_exit:
+        talloc_free(members);
+        return RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief ld_group_add_users Adds users to the group using as few modify requests as possible.
+ *
+ * Members are sent in chunks of up to GROUP_MEMBERS_CHUNK_SIZE values per modify request.
+ * @param[in] handle            Pointer to libdomain session handle.
+ * @param[in] group_name        Name of the group to add users into.
+ * @param[in] user_names        NULL terminated list of users to add.
+ * @param[in] diff              Read current members first and send only users that are not members yet.
+ *                              Without diff users that are already members do not fail the chunk
+ *                              if server supports permissive modify.
+ * @param[in] chunk_callback    Callback to report result of every chunk to, may be NULL.
+ * @param[in] complete_callback Callback to call once all chunks have completed, may be NULL.
+ * @param[in] user_data         User data passed to callbacks.
+ * @return
+ *        - RETURN_CODE_SUCCESS if modification has been started.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_group_add_users(LDHandle *handle,
+                                            const char *group_name,
+                                            char **user_names,
+                                            bool diff,
+                                            group_members_chunk_callback_fn chunk_callback,
+                                            group_members_complete_callback_fn complete_callback,
+                                            void *user_data)
+{
+    return group_members_modify(handle, group_name, user_names, GROUP_MEMBERS_ADD, diff,
+                                chunk_callback, complete_callback, user_data);
+}
+
+/**
+ * @brief ld_group_remove_users Removes users from the group using as few modify requests as possible.
+ * @param[in] handle               Pointer to libdomain session handle.
+ * @param[in] group_name           Name of the group to remove users from.
+ * @param[in] user_names           NULL terminated list of users to remove.
+ * @param[in] diff                 Read current members first and send only users that are members.
+ * @param[in] chunk_callback       Callback to report result of every chunk to, may be NULL.
+ * @param[in] complete_callback    Callback to call once all chunks have completed, may be NULL.
+ * @param[in] user_data            User data passed to callbacks.
+ * @return
+ *        - RETURN_CODE_SUCCESS if modification has been started.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_group_remove_users(LDHandle *handle,
+                                               const char *group_name,
+                                               char **user_names,
+                                               bool diff,
+                                               group_members_chunk_callback_fn chunk_callback,
+                                               group_members_complete_callback_fn complete_callback,
+                                               void *user_data)
+{
+    return group_members_modify(handle, group_name, user_names, GROUP_MEMBERS_REMOVE, diff,
+                                chunk_callback, complete_callback, user_data);
+}
+
+/**
+ * @brief ld_group_set_users Makes the given users the only members of the group.
+ *
+ * Current members are read first, only missing users are added and only extra members are removed.
+ * @param[in] handle            Pointer to libdomain session handle.
+ * @param[in] group_name        Name of the group.
+ * @param[in] user_names        NULL terminated list of users, empty list removes all members.
+ * @param[in] chunk_callback    Callback to report result of every chunk to, may be NULL.
+ * @param[in] complete_callback Callback to call once all chunks have completed, may be NULL.
+ * @param[in] user_data         User data passed to callbacks.
+ * @return
+ *        - RETURN_CODE_SUCCESS if modification has been started.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_group_set_users(LDHandle *handle,
+                                            const char *group_name,
+                                            char **user_names,
+                                            group_members_chunk_callback_fn chunk_callback,
+                                            group_members_complete_callback_fn complete_callback,
+                                            void *user_data)
+{
+    return group_members_modify(handle, group_name, user_names, GROUP_MEMBERS_REPLACE, true,
+                                chunk_callback, complete_callback, user_data);
+}
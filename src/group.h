@@ -21,7 +21,9 @@
 #ifndef LIB_DOMAIN_GROUP_H
 #define LIB_DOMAIN_GROUP_H
 
+#include "batch.h"
 #include "common.h"
+#include "compare.h"
 #include "domain.h"
 
 enum GroupScope
@@ -38,6 +40,13 @@ enum GroupCategory
 };
 
 enum OperationReturnCode ld_add_group(LDHandle *handle, const char *name, LDAPAttribute_t **attributes, const char *parent);
+enum OperationReturnCode ld_add_groups(LDHandle *handle,
+                                       const ld_batch_item_t *groups,
+                                       int n_groups,
+                                       LDAPAttribute_t **defaults,
+                                       const char *parent,
+                                       batch_complete_callback_fn callback,
+                                       void *user_data);
 enum OperationReturnCode ld_del_group(LDHandle *handle, const char *name, const char *parent);
 enum OperationReturnCode ld_mod_group(LDHandle *handle,
                                       const char *name,
@@ -50,5 +59,53 @@ enum OperationReturnCode ld_rename_group(LDHandle *handle,
 
 enum OperationReturnCode ld_group_add_user(LDHandle *handle, const char *group_name, const char *user_name);
 enum OperationReturnCode ld_group_remove_user(LDHandle *handle, const char *group_name, const char *user_name);
+enum OperationReturnCode ld_group_has_user(LDHandle *handle,
+                                           const char *group_name,
+                                           const char *user_name,
+                                           compare_callback_fn callback,
+                                           void *user_data);
+
+/**
+ * @brief group_members_chunk_callback_fn Callback fired with result of every modify request of bulk modification.
+ * @param[in] mod_operation     LDAP_MOD_ADD or LDAP_MOD_DELETE.
+ * @param[in] members           NULL terminated list of members sent by the request.
+ */
+typedef void (*group_members_chunk_callback_fn)(LDHandle *handle,
+                                                const char *group_dn,
+                                                int mod_operation,
+                                                char **members,
+                                                enum OperationReturnCode rc,
+                                                void *user_data);
+
+/**
+ * @brief group_members_complete_callback_fn Callback fired once bulk modification has completed.
+ *
+ * Return code is RETURN_CODE_SUCCESS only if all modify requests have succeeded.
+ */
+typedef void (*group_members_complete_callback_fn)(LDHandle *handle,
+                                                   const char *group_dn,
+                                                   enum OperationReturnCode rc,
+                                                   void *user_data);
+
+enum OperationReturnCode ld_group_add_users(LDHandle *handle,
+                                            const char *group_name,
+                                            char **user_names,
+                                            bool diff,
+                                            group_members_chunk_callback_fn chunk_callback,
+                                            group_members_complete_callback_fn complete_callback,
+                                            void *user_data);
+enum OperationReturnCode ld_group_remove_users(LDHandle *handle,
+                                               const char *group_name,
+                                               char **user_names,
+                                               bool diff,
+                                               group_members_chunk_callback_fn chunk_callback,
+                                               group_members_complete_callback_fn complete_callback,
+                                               void *user_data);
+enum OperationReturnCode ld_group_set_users(LDHandle *handle,
+                                            const char *group_name,
+                                            char **user_names,
+                                            group_members_chunk_callback_fn chunk_callback,
+                                            group_members_complete_callback_fn complete_callback,
+                                            void *user_data);
 
 #endif //LIB_DOMAIN_GROUP_H
@@ -0,0 +1,634 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "ldif.h"
+
+#include "helper_p.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib-2.0/glib.h>
+
+#define LDIF_FILE_URL "file://"
+
+/*!
+ * @brief ld_ldif_reader_t - Incremental reader of LDIF file.
+ */
+struct ld_ldif_reader_s
+{
+    FILE *file;                         //!< File being read.
+    char *line;                         //!< Last read physical line without line terminator.
+    size_t capacity;                    //!< Size of line buffer.
+    size_t length;                      //!< Length of the line.
+    bool has_line;                      //!< Line has been read but not consumed yet.
+    uint64_t line_offset;               //!< Offset of the line in file.
+    uint64_t offset;                    //!< Offset of the first byte not read yet.
+    unsigned long number;               //!< Number of the last returned record.
+    bool first;                         //!< No record has been read yet, version line may come first.
+};
+
+/*!
+ * @brief ldif_mod_t - Modification being collected while record is parsed.
+ */
+typedef struct ldif_mod_s
+{
+    int mod_op;                         //!< Operation of modification.
+    char *type;                         //!< Attribute description.
+    GPtrArray *values;                  //!< Values as struct berval pointers.
+} ldif_mod_t;
+
+static int reader_destructor(TALLOC_CTX *ctx)
+{
+    ld_ldif_reader_t *reader = talloc_get_type_abort(ctx, ld_ldif_reader_t);
+
+    if (reader->file)
+    {
+        fclose(reader->file);
+    }
+    free(reader->line);
+
+    return 0;
+}
+
+static void ldif_mod_free(gpointer data)
+{
+    ldif_mod_t *mod = data;
+
+    g_ptr_array_free(mod->values, TRUE);
+    g_free(mod);
+}
+
+/**
+ * @brief ldif_next_line Makes next physical line available in reader->line.
+ * @return
+ *        - true if line is available.
+ *        - false at the end of file or on read error.
+ */
+static bool ldif_next_line(ld_ldif_reader_t *reader)
+{
+    if (reader->has_line)
+    {
+        return true;
+    }
+
+    ssize_t length = getline(&reader->line, &reader->capacity, reader->file);
+    if (length < 0)
+    {
+        return false;
+    }
+
+    reader->line_offset = reader->offset;
+    reader->offset += length;
+
+    while (length > 0 && (reader->line[length - 1] == '\n' || reader->line[length - 1] == '\r'))
+    {
+        reader->line[--length] = '\0';
+    }
+
+    reader->length = length;
+    reader->has_line = true;
+
+    return true;
+}
+
+/**
+ * @brief ldif_read_logical Consumes current line together with its continuation lines.
+ * @param[in] reader        Reader to work with, current line must be available.
+ * @param[out] out          Unfolded line.
+ */
+static void ldif_read_logical(ld_ldif_reader_t *reader, GString *out)
+{
+    g_string_assign(out, reader->line);
+    reader->has_line = false;
+
+    while (ldif_next_line(reader) && reader->line[0] == ' ')
+    {
+        g_string_append_len(out, reader->line + 1, reader->length - 1);
+        reader->has_line = false;
+    }
+}
+
+/**
+ * @brief ldif_read_lines Reads unfolded lines of the next record skipping comments.
+ * @param[in] reader       Reader to work with.
+ * @param[in] lines        Array to store lines to, empty at the end of file.
+ * @param[out] offset      Offset of the first line of the record.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on read error.
+ */
+static enum OperationReturnCode ldif_read_lines(ld_ldif_reader_t *reader, GPtrArray *lines, uint64_t *offset)
+{
+    GString *line = g_string_new(NULL);
+
+    while (lines->len == 0 && ldif_next_line(reader))
+    {
+        *offset = reader->line_offset;
+
+        while (ldif_next_line(reader) && reader->length > 0)
+        {
+            bool comment = reader->line[0] == '#';
+
+            ldif_read_logical(reader, line);
+
+            if (!comment)
+            {
+                g_ptr_array_add(lines, g_strndup(line->str, line->len));
+            }
+        }
+
+        if (reader->has_line)
+        {
+            reader->has_line = false;
+        }
+
+        if (reader->first && lines->len > 0)
+        {
+            reader->first = false;
+
+            if (g_ascii_strncasecmp(g_ptr_array_index(lines, 0), "version:", strlen("version:")) == 0)
+            {
+                g_ptr_array_remove_index(lines, 0);
+            }
+        }
+    }
+
+    g_string_free(line, TRUE);
+
+    if (ferror(reader->file))
+    {
+        ld_error("ldif_read_lines - unable to read LDIF file: %s\n", strerror(errno));
+        return RETURN_CODE_FAILURE;
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief ldif_parse_line Splits line into attribute description and value.
+ *
+ * Base64 encoded values and values referenced with file URLs are decoded.
+ * @param[in] ctx         Talloc ctx to allocate value on.
+ * @param[in] line        Unfolded line.
+ * @param[out] name       Attribute description.
+ * @param[out] value      Value, always terminated with zero byte.
+ * @return
+ *        - true on success.
+ *        - false if line is invalid.
+ */
+static bool ldif_parse_line(TALLOC_CTX *ctx, const char *line, char **name, struct berval **value)
+{
+    const char *colon = strchr(line, ':');
+    if (!colon || colon == line)
+    {
+        return false;
+    }
+
+    *name = talloc_strndup(ctx, line, colon - line);
+    *value = talloc_zero(ctx, struct berval);
+    if (!*name || !*value)
+    {
+        return false;
+    }
+
+    const char *p = colon + 1;
+    char kind = *p == ':' || *p == '<' ? *p++ : '\0';
+
+    while (*p == ' ')
+    {
+        ++p;
+    }
+
+    gsize length = 0;
+    gchar *data = NULL;
+
+    if (kind == ':')
+    {
+        data = (gchar *)g_base64_decode(p, &length);
+    }
+    else if (kind == '<')
+    {
+        if (g_ascii_strncasecmp(p, LDIF_FILE_URL, strlen(LDIF_FILE_URL)) != 0)
+        {
+            ld_error("ldif_parse_line - only file URLs are supported: %s\n", p);
+            return false;
+        }
+        if (!g_file_get_contents(p + strlen(LDIF_FILE_URL), &data, &length, NULL))
+        {
+            ld_error("ldif_parse_line - unable to read value from %s\n", p);
+            return false;
+        }
+    }
+
+    (*value)->bv_len = data ? length : strlen(p);
+    (*value)->bv_val = talloc_size(*value, (*value)->bv_len + 1);
+    if (!(*value)->bv_val)
+    {
+        g_free(data);
+        return false;
+    }
+
+    memcpy((*value)->bv_val, data ? data : p, (*value)->bv_len);
+    (*value)->bv_val[(*value)->bv_len] = '\0';
+    g_free(data);
+
+    return true;
+}
+
+/**
+ * @brief ldif_find_mod Returns modification of the attribute in added record, creates it when needed.
+ */
+static ldif_mod_t *ldif_find_mod(GPtrArray *mods, int mod_op, const char *type, bool merge)
+{
+    for (guint i = merge ? 0 : mods->len; i < mods->len; ++i)
+    {
+        ldif_mod_t *mod = g_ptr_array_index(mods, mods->len - 1 - i);
+        if (g_ascii_strcasecmp(mod->type, type) == 0)
+        {
+            return mod;
+        }
+    }
+
+    ldif_mod_t *result = g_new0(ldif_mod_t, 1);
+    result->mod_op = mod_op;
+    result->type = (char *)type;
+    result->values = g_ptr_array_new();
+    g_ptr_array_add(mods, result);
+
+    return result;
+}
+
+/**
+ * @brief ldif_build_mods Converts collected modifications into NULL terminated list of LDAPMod.
+ */
+static LDAPMod **ldif_build_mods(TALLOC_CTX *ctx, GPtrArray *mods)
+{
+    LDAPMod **result = NULL;
+
+    ld_talloc_zero_array(result, error_exit, ctx, LDAPMod*, mods->len + 1);
+
+    for (guint i = 0; i < mods->len; ++i)
+    {
+        ldif_mod_t *mod = g_ptr_array_index(mods, i);
+
+        ld_talloc_zero(result[i], error_exit, result, LDAPMod);
+        result[i]->mod_op = mod->mod_op | LDAP_MOD_BVALUES;
+        ld_talloc_strdup(result[i]->mod_type, error_exit, result[i], mod->type);
+
+        if (mod->values->len > 0)
+        {
+            ld_talloc_array(result[i]->mod_bvalues, error_exit, result[i], struct berval*, mod->values->len + 1);
+            for (guint j = 0; j < mod->values->len; ++j)
+            {
+                result[i]->mod_bvalues[j] = talloc_steal(result[i]->mod_bvalues, g_ptr_array_index(mod->values, j));
+            }
+            result[i]->mod_bvalues[mod->values->len] = NULL;
+        }
+    }
+
+    return result;
+
+    error_exit:
+        talloc_free(result);
+        return NULL;
+}
+
+/**
+ * @brief ldif_parse_modify Parses modifications of changetype: modify record.
+ */
+static const char *ldif_parse_modify(TALLOC_CTX *ctx, GPtrArray *lines, guint index, GPtrArray *mods)
+{
+    while (index < lines->len)
+    {
+        char *name = NULL;
+        struct berval *value = NULL;
+        int mod_op = 0;
+
+        if (!ldif_parse_line(ctx, g_ptr_array_index(lines, index++), &name, &value))
+        {
+            return "invalid modification";
+        }
+
+        if (g_ascii_strcasecmp(name, "add") == 0)
+        {
+            mod_op = LDAP_MOD_ADD;
+        }
+        else if (g_ascii_strcasecmp(name, "delete") == 0)
+        {
+            mod_op = LDAP_MOD_DELETE;
+        }
+        else if (g_ascii_strcasecmp(name, "replace") == 0)
+        {
+            mod_op = LDAP_MOD_REPLACE;
+        }
+        else if (g_ascii_strcasecmp(name, "increment") == 0)
+        {
+            mod_op = LDAP_MOD_INCREMENT;
+        }
+        else
+        {
+            return "unknown modification type";
+        }
+
+        ldif_mod_t *mod = ldif_find_mod(mods, mod_op, value->bv_val, false);
+
+        while (index < lines->len && strcmp(g_ptr_array_index(lines, index), "-") != 0)
+        {
+            char *type = NULL;
+            struct berval *attribute_value = NULL;
+
+            if (!ldif_parse_line(ctx, g_ptr_array_index(lines, index++), &type, &attribute_value))
+            {
+                return "invalid attribute value";
+            }
+
+            if (g_ascii_strcasecmp(type, mod->type) != 0)
+            {
+                return "attribute does not match modification";
+            }
+
+            g_ptr_array_add(mod->values, attribute_value);
+        }
+
+        if (index == lines->len)
+        {
+            return "modification is not terminated";
+        }
+
+        if (mod_op == LDAP_MOD_ADD && mod->values->len == 0)
+        {
+            return "modification adds no values";
+        }
+
+        ++index;
+    }
+
+    return mods->len > 0 ? NULL : "record has no modifications";
+}
+
+/**
+ * @brief ldif_parse_record Parses unfolded lines of the record.
+ * @return
+ *        - NULL on success.
+ *        - Description of the error.
+ */
+static const char *ldif_parse_record(ld_ldif_record_t *record, GPtrArray *lines, GPtrArray *mods)
+{
+    char *name = NULL;
+    struct berval *value = NULL;
+    guint index = 0;
+
+    if (!ldif_parse_line(record, g_ptr_array_index(lines, index++), &name, &value)
+        || g_ascii_strcasecmp(name, "dn") != 0)
+    {
+        return "record does not start with dn";
+    }
+    record->dn = value->bv_val;
+
+    record->change_type = LD_LDIF_CHANGE_ADD;
+
+    while (index < lines->len)
+    {
+        if (!ldif_parse_line(record, g_ptr_array_index(lines, index), &name, &value))
+        {
+            return "invalid line";
+        }
+
+        if (g_ascii_strcasecmp(name, "control") == 0)
+        {
+            ++index;
+
+            char **words = g_strsplit(value->bv_val, " ", 3);
+            bool critical = words[0] && words[1] && g_ascii_strcasecmp(words[1], "true") == 0;
+            g_strfreev(words);
+
+            if (critical)
+            {
+                return "critical controls are not supported";
+            }
+            continue;
+        }
+
+        if (g_ascii_strcasecmp(name, "changetype") != 0)
+        {
+            break;
+        }
+
+        ++index;
+
+        if (g_ascii_strcasecmp(value->bv_val, "add") == 0)
+        {
+            record->change_type = LD_LDIF_CHANGE_ADD;
+        }
+        else if (g_ascii_strcasecmp(value->bv_val, "delete") == 0)
+        {
+            record->change_type = LD_LDIF_CHANGE_DELETE;
+        }
+        else if (g_ascii_strcasecmp(value->bv_val, "modify") == 0)
+        {
+            record->change_type = LD_LDIF_CHANGE_MODIFY;
+        }
+        else if (g_ascii_strcasecmp(value->bv_val, "modrdn") == 0 || g_ascii_strcasecmp(value->bv_val, "moddn") == 0)
+        {
+            record->change_type = LD_LDIF_CHANGE_MODRDN;
+        }
+        else
+        {
+            return "unknown change type";
+        }
+        break;
+    }
+
+    switch (record->change_type)
+    {
+    case LD_LDIF_CHANGE_ADD:
+        while (index < lines->len)
+        {
+            if (!ldif_parse_line(record, g_ptr_array_index(lines, index++), &name, &value))
+            {
+                return "invalid attribute value";
+            }
+            g_ptr_array_add(ldif_find_mod(mods, LDAP_MOD_ADD, name, true)->values, value);
+        }
+        return mods->len > 0 ? NULL : "record has no attributes";
+    case LD_LDIF_CHANGE_DELETE:
+        return index == lines->len ? NULL : "deleted record has attributes";
+    case LD_LDIF_CHANGE_MODIFY:
+        return ldif_parse_modify(record, lines, index, mods);
+    case LD_LDIF_CHANGE_MODRDN:
+    {
+        int step = 0;
+        for (; index < lines->len; ++step)
+        {
+            if (!ldif_parse_line(record, g_ptr_array_index(lines, index++), &name, &value))
+            {
+                return "invalid line";
+            }
+
+            if (step == 0 && g_ascii_strcasecmp(name, "newrdn") == 0)
+            {
+                record->new_rdn = value->bv_val;
+            }
+            else if (step == 1 && g_ascii_strcasecmp(name, "deleteoldrdn") == 0
+                     && (strcmp(value->bv_val, "0") == 0 || strcmp(value->bv_val, "1") == 0))
+            {
+                record->delete_old_rdn = value->bv_val[0] == '1';
+            }
+            else if (step == 2 && g_ascii_strcasecmp(name, "newsuperior") == 0)
+            {
+                record->new_superior = value->bv_val;
+            }
+            else
+            {
+                return "invalid rename";
+            }
+        }
+        return step >= 2 ? NULL : "incomplete rename";
+    }
+    default:
+        return "unknown change type";
+    }
+}
+
+/**
+ * @brief ld_ldif_reader_new Opens LDIF file for reading.
+ * @param[in] ctx            Talloc ctx to use.
+ * @param[in] path           Path to the file.
+ * @param[in] offset         Offset of the record to start with, 0 to read from the beginning.
+ * @param[in] number         Number of records before offset, used to number records when reading is resumed.
+ * @return
+ *        - Reader.
+ *        - NULL on failure.
+ */
+ld_ldif_reader_t *ld_ldif_reader_new(TALLOC_CTX *ctx, const char *path, uint64_t offset, unsigned long number)
+{
+    ld_ldif_reader_t *result = NULL;
+
+    if (!path)
+    {
+        ld_error("ld_ldif_reader_new - invalid path!\n");
+        return NULL;
+    }
+
+    ld_talloc_zero_e(result, error_exit, "ld_ldif_reader_new - out of memory - unable to create reader!\n",
+                     ctx, ld_ldif_reader_t);
+    talloc_set_destructor((void*)result, reader_destructor);
+
+    result->file = fopen(path, "r");
+    if (!result->file)
+    {
+        ld_error("ld_ldif_reader_new - unable to open %s: %s\n", path, strerror(errno));
+        goto error_exit;
+    }
+
+    if (offset > 0 && fseeko(result->file, (off_t)offset, SEEK_SET) != 0)
+    {
+        ld_error("ld_ldif_reader_new - unable to seek %s: %s\n", path, strerror(errno));
+        goto error_exit;
+    }
+
+    result->offset = offset;
+    result->number = number;
+    result->first = offset == 0;
+
+    return result;
+
+    error_exit:
+        talloc_free(result);
+        return NULL;
+}
+
+/**
+ * @brief ld_ldif_read Reads next record.
+ *
+ * Invalid records are returned together with RETURN_CODE_FAILURE, reading may continue with the next record.
+ * @param[in] reader    Reader to work with.
+ * @param[in] ctx       Talloc ctx to allocate record on.
+ * @param[out] record   Record, NULL at the end of file or if file can not be read.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success and at the end of file.
+ *        - RETURN_CODE_FAILURE if record is invalid or on failure.
+ */
+enum OperationReturnCode ld_ldif_read(ld_ldif_reader_t *reader, TALLOC_CTX *ctx, ld_ldif_record_t **record)
+{
+    enum OperationReturnCode rc = RETURN_CODE_FAILURE;
+    GPtrArray *lines = g_ptr_array_new_with_free_func(g_free);
+    GPtrArray *mods = g_ptr_array_new_with_free_func(ldif_mod_free);
+    uint64_t offset = 0;
+
+    *record = NULL;
+
+    if (ldif_read_lines(reader, lines, &offset) != RETURN_CODE_SUCCESS)
+    {
+        goto exit;
+    }
+
+    if (lines->len == 0)
+    {
+        rc = RETURN_CODE_SUCCESS;
+        goto exit;
+    }
+
+    ld_talloc_zero_e(*record, exit, "ld_ldif_read - out of memory - unable to create record!\n",
+                     ctx, ld_ldif_record_t);
+    (*record)->number = ++reader->number;
+    (*record)->offset = offset;
+
+    const char *error = ldif_parse_record(*record, lines, mods);
+    if (error)
+    {
+        ld_error("ld_ldif_read - invalid record %lu at offset %" PRIu64 ": %s\n", (*record)->number, offset, error);
+        goto exit;
+    }
+
+    if (mods->len > 0 && !((*record)->mods = ldif_build_mods(*record, mods)))
+    {
+        ld_error("ld_ldif_read - out of memory - unable to create modifications!\n");
+        goto exit;
+    }
+
+    rc = RETURN_CODE_SUCCESS;
+
+    exit:
+        g_ptr_array_free(mods, TRUE);
+        g_ptr_array_free(lines, TRUE);
+
+        return rc;
+}
+
+/**
+ * @brief ld_ldif_reader_get_offset Returns offset reading of the next record starts from.
+ */
+uint64_t ld_ldif_reader_get_offset(const ld_ldif_reader_t *reader)
+{
+    return reader->has_line ? reader->line_offset : reader->offset;
+}
+
+/**
+ * @brief ld_ldif_reader_get_number Returns number of records read so far including records read before offset.
+ */
+unsigned long ld_ldif_reader_get_number(const ld_ldif_reader_t *reader)
+{
+    return reader->number;
+}
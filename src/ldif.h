@@ -0,0 +1,66 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_LDIF_H
+#define LIBDOMAIN_LDIF_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * LDIF reader parses records of RFC 2849 files one at a time. Input is read line by line, so only the record
+ * being parsed is kept in memory. Content records are returned as additions.
+ */
+
+enum LdapLdifChangeType
+{
+    LD_LDIF_CHANGE_ADD    = 1,          //!< Entry is added, mods hold its attributes.
+    LD_LDIF_CHANGE_DELETE = 2,          //!< Entry is deleted.
+    LD_LDIF_CHANGE_MODIFY = 3,          //!< Entry is modified, mods hold modifications.
+    LD_LDIF_CHANGE_MODRDN = 4,          //!< Entry is renamed or moved.
+};
+
+/*!
+ * @brief ld_ldif_record_t - Single record of LDIF file.
+ */
+typedef struct ld_ldif_record_s
+{
+    unsigned long number;               //!< Number of the record in file starting from 1.
+    uint64_t offset;                    //!< Offset of the first line of the record in file.
+    char *dn;                           //!< DN of the entry, NULL if record has no valid DN.
+    enum LdapLdifChangeType change_type; //!< Kind of change.
+    LDAPMod **mods;                     //!< NULL terminated list of modifications with LDAP_MOD_BVALUES set.
+    char *new_rdn;                      //!< New RDN of renamed entry.
+    bool delete_old_rdn;                //!< Remove old RDN values from renamed entry.
+    char *new_superior;                 //!< New parent of moved entry, NULL if entry stays in place.
+} ld_ldif_record_t;
+
+typedef struct ld_ldif_reader_s ld_ldif_reader_t;
+
+ld_ldif_reader_t *ld_ldif_reader_new(TALLOC_CTX *ctx, const char *path, uint64_t offset, unsigned long number);
+
+enum OperationReturnCode ld_ldif_read(ld_ldif_reader_t *reader, TALLOC_CTX *ctx, ld_ldif_record_t **record);
+
+uint64_t ld_ldif_reader_get_offset(const ld_ldif_reader_t *reader);
+unsigned long ld_ldif_reader_get_number(const ld_ldif_reader_t *reader);
+
+#endif //LIBDOMAIN_LDIF_H
@@ -0,0 +1,412 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "ldif_import.h"
+#include "write_scheduler.h"
+
+#include "helper_p.h"
+
+#include <string.h>
+
+#include <glib-2.0/glib.h>
+
+#define LDIF_IMPORT_DEFAULT_WINDOW 64
+#define LDIF_IMPORT_MAX_WINDOW (MAX_REQUESTS / 2)
+
+/*!
+ * @brief ldif_slot_t - Record submitted to the scheduler.
+ */
+typedef struct ldif_slot_s
+{
+    ld_ldif_record_t *record;                   //!< Record sent by the request.
+    unsigned long request_id;                   //!< Id of the scheduler request of the record.
+    bool done;                                  //!< Result of the request has arrived.
+} ldif_slot_t;
+
+/*!
+ * @brief ld_ldif_import_t - Import of LDIF file.
+ */
+struct ld_ldif_import_s
+{
+    struct ldap_connection_ctx_t *connection;   //!< Connection requests are sent through.
+    ld_ldif_reader_t *reader;                   //!< Reader of the file.
+    ld_write_scheduler_t *scheduler;            //!< Scheduler ordering requests of dependent records.
+    bool stop_on_error;                         //!< Stop reading records after the first failure.
+
+    ldif_slot_t *slots;                         //!< Ring of submitted records ordered as in file.
+    unsigned int window;                        //!< Size of the ring.
+    unsigned int head;                          //!< Position of the first record in slots.
+    unsigned int n_slots;                       //!< Amount of submitted records.
+    unsigned long submitted;                    //!< Amount of requests submitted to the scheduler.
+
+    bool eof;                                   //!< Whole file has been read.
+    bool stopping;                              //!< No more records are read.
+    bool filling;                               //!< Records are being read.
+    bool finished;                              //!< Scheduler has been told that no more records follow.
+    bool failed;                                //!< Some of records have failed.
+
+    ld_ldif_checkpoint_t checkpoint;            //!< Position all records before have completed.
+    unsigned long succeeded;                    //!< Amount of succeeded records.
+    unsigned long failures;                     //!< Amount of failed records.
+
+    ldif_record_callback_fn record_callback;    //!< Callback to report results of records to.
+    ldif_complete_callback_fn complete_callback; //!< Callback to call on completion.
+    void *user_data;                            //!< User data passed to callbacks.
+};
+
+static int ldif_import_destructor(TALLOC_CTX *ctx)
+{
+    ld_ldif_import_t *import = talloc_get_type_abort(ctx, ld_ldif_import_t);
+
+    // Import is released before completion, requests in flight are cancelled with the scheduler.
+    talloc_free(import->scheduler);
+
+    return 0;
+}
+
+/**
+ * @brief ldif_import_report Passes result of the record to the callback and updates counters.
+ */
+static void ldif_import_report(ld_ldif_import_t *import, const ld_ldif_record_t *record,
+                               enum OperationReturnCode rc, int result_code)
+{
+    if (rc == RETURN_CODE_SUCCESS)
+    {
+        ++import->succeeded;
+    }
+    else
+    {
+        ++import->failures;
+        import->failed = true;
+        import->stopping = import->stopping || import->stop_on_error;
+    }
+
+    if (import->record_callback)
+    {
+        import->record_callback(import, record, rc, result_code, import->user_data);
+    }
+}
+
+/**
+ * @brief ldif_import_complete_slot Reports result of the record and releases completed records from the ring.
+ */
+static void ldif_import_complete_slot(ld_ldif_import_t *import, ldif_slot_t *slot, enum OperationReturnCode rc,
+                                      int result_code)
+{
+    ldif_import_report(import, slot->record, rc, result_code);
+
+    slot->done = true;
+
+    while (import->n_slots > 0 && import->slots[import->head].done)
+    {
+        ldif_slot_t *head = &import->slots[import->head];
+
+        talloc_free(head->record);
+        head->record = NULL;
+        head->done = false;
+
+        import->head = (import->head + 1) % import->window;
+        --import->n_slots;
+    }
+
+    if (import->n_slots > 0)
+    {
+        import->checkpoint.offset = import->slots[import->head].record->offset;
+        import->checkpoint.number = import->slots[import->head].record->number - 1;
+    }
+    else
+    {
+        import->checkpoint.offset = ld_ldif_reader_get_offset(import->reader);
+        import->checkpoint.number = ld_ldif_reader_get_number(import->reader);
+    }
+}
+
+/**
+ * @brief ldif_import_submit Submits request of the record to the scheduler.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE if request could not be submitted.
+ */
+static enum OperationReturnCode ldif_import_submit(ld_ldif_import_t *import, ld_ldif_record_t *record)
+{
+    switch (record->change_type)
+    {
+    case LD_LDIF_CHANGE_ADD:
+        return ld_write_scheduler_add(import->scheduler, record->dn, record->mods);
+    case LD_LDIF_CHANGE_DELETE:
+        return ld_write_scheduler_delete(import->scheduler, record->dn);
+    case LD_LDIF_CHANGE_MODIFY:
+        return ld_write_scheduler_modify(import->scheduler, record->dn, record->mods);
+    case LD_LDIF_CHANGE_MODRDN:
+        return ld_write_scheduler_rename(import->scheduler, record->dn, record->new_rdn, record->new_superior,
+                                         record->delete_old_rdn);
+    default:
+        return RETURN_CODE_FAILURE;
+    }
+}
+
+/**
+ * @brief ldif_import_send Adds record to the ring and submits its request, completes record with failure if request
+ * can not be submitted.
+ */
+static void ldif_import_send(ld_ldif_import_t *import, ld_ldif_record_t *record)
+{
+    ldif_slot_t *slot = &import->slots[(import->head + import->n_slots) % import->window];
+
+    // Scheduler numbers requests in order of submission, result may arrive before submission returns.
+    slot->record = talloc_steal(import, record);
+    slot->request_id = import->submitted + 1;
+    slot->done = false;
+    ++import->n_slots;
+
+    if (ldif_import_submit(import, record) == RETURN_CODE_SUCCESS)
+    {
+        ++import->submitted;
+        return;
+    }
+
+    ld_error("ldif_import_send - unable to submit record %lu!\n", record->number);
+
+    // Request has not been numbered, record completes right away.
+    slot->request_id = 0;
+    ldif_import_complete_slot(import, slot, RETURN_CODE_FAILURE, LDAP_LOCAL_ERROR);
+}
+
+/**
+ * @brief ldif_import_fill Reads records until the window is full, finishes scheduler once nothing is left.
+ */
+static void ldif_import_fill(ld_ldif_import_t *import)
+{
+    if (import->filling || import->finished)
+    {
+        return;
+    }
+
+    import->filling = true;
+
+    while (!import->eof && !import->stopping && import->n_slots < import->window)
+    {
+        ld_ldif_record_t *record = NULL;
+
+        if (ld_ldif_read(import->reader, import, &record) != RETURN_CODE_SUCCESS)
+        {
+            if (!record)
+            {
+                import->failed = true;
+                import->stopping = true;
+                break;
+            }
+
+            ldif_import_report(import, record, RETURN_CODE_FAILURE, LDAP_DECODING_ERROR);
+            talloc_free(record);
+            continue;
+        }
+
+        if (!record)
+        {
+            import->eof = true;
+            break;
+        }
+
+        ldif_import_send(import, record);
+    }
+
+    import->filling = false;
+
+    if (import->n_slots == 0)
+    {
+        import->checkpoint.offset = ld_ldif_reader_get_offset(import->reader);
+        import->checkpoint.number = ld_ldif_reader_get_number(import->reader);
+    }
+
+    if (import->eof || import->stopping)
+    {
+        import->finished = true;
+
+        // Completion callback of the scheduler completes import, it may be called right away.
+        ld_write_scheduler_finish(import->scheduler);
+    }
+}
+
+/**
+ * @brief ldif_import_on_request This callback is called when result of the record request is known.
+ */
+static void ldif_import_on_request(ld_write_scheduler_t *scheduler, const ld_write_request_t *request,
+                                   enum OperationReturnCode rc, int result_code, void *user_data)
+{
+    (void)(scheduler);
+
+    ld_ldif_import_t *import = user_data;
+
+    if (import->n_slots == 0)
+    {
+        ld_error("ldif_import_on_request - record is missing!\n");
+        return;
+    }
+
+    // Records failed on submission stay in the ring without id until records before them complete.
+    unsigned int position = import->head;
+    while (import->slots[position].request_id != request->id)
+    {
+        position = (position + 1) % import->window;
+
+        if (position == (import->head + import->n_slots) % import->window)
+        {
+            ld_error("ldif_import_on_request - record of request %lu is missing!\n", request->id);
+            return;
+        }
+    }
+
+    ldif_slot_t *slot = &import->slots[position];
+
+    if (rc != RETURN_CODE_SUCCESS)
+    {
+        ld_error("Unable to import record %lu %s: %s%s\n", slot->record->number, slot->record->dn,
+                 ldap_err2string(result_code), request->skipped ? " - depends on failed record" : "");
+    }
+
+    ldif_import_complete_slot(import, slot, rc, result_code);
+    ldif_import_fill(import);
+}
+
+/**
+ * @brief ldif_import_on_complete This callback is called once requests of all submitted records have completed.
+ */
+static void ldif_import_on_complete(ld_write_scheduler_t *scheduler, enum OperationReturnCode rc, void *user_data)
+{
+    (void)(scheduler);
+    (void)(rc);
+
+    ld_ldif_import_t *import = user_data;
+
+    // Scheduler releases itself once callback returns.
+    import->scheduler = NULL;
+
+    if (import->complete_callback)
+    {
+        import->complete_callback(import, import->failed ? RETURN_CODE_FAILURE : RETURN_CODE_SUCCESS,
+                                  import->user_data);
+    }
+
+    talloc_free(import);
+}
+
+/**
+ * @brief ld_ldif_import Starts import of LDIF file.
+ *
+ * Completion callback may be called before function returns, e.g. when file holds no records.
+ * @param[in] ctx                Talloc ctx to use.
+ * @param[in] connection         Connection to send requests through.
+ * @param[in] path               Path to LDIF file.
+ * @param[in] resume             Checkpoint to resume import from, NULL to import whole file.
+ * @param[in] window             Maximum amount of records submitted at once, 0 for default.
+ * @param[in] stop_on_error      Stop reading records after the first failed one.
+ * @param[in] record_callback    Callback to report result of every record to, may be NULL.
+ * @param[in] complete_callback  Callback to call on completion, may be NULL.
+ * @param[in] user_data          User data passed to callbacks.
+ * @return
+ *        - RETURN_CODE_SUCCESS if import has been started.
+ *        - RETURN_CODE_FAILURE on failure, callbacks are not called.
+ */
+enum OperationReturnCode ld_ldif_import(TALLOC_CTX *ctx,
+                                        struct ldap_connection_ctx_t *connection,
+                                        const char *path,
+                                        const ld_ldif_checkpoint_t *resume,
+                                        unsigned int window,
+                                        bool stop_on_error,
+                                        ldif_record_callback_fn record_callback,
+                                        ldif_complete_callback_fn complete_callback,
+                                        void *user_data)
+{
+    ld_ldif_import_t *import = NULL;
+
+    if (!connection || !path)
+    {
+        ld_error("ld_ldif_import - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    ld_talloc_zero_e(import, error_exit, "ld_ldif_import - out of memory - unable to create import!\n",
+                     ctx, ld_ldif_import_t);
+
+    import->connection = connection;
+    import->stop_on_error = stop_on_error;
+    import->window = window == 0 ? LDIF_IMPORT_DEFAULT_WINDOW : MIN(window, LDIF_IMPORT_MAX_WINDOW);
+    import->record_callback = record_callback;
+    import->complete_callback = complete_callback;
+    import->user_data = user_data;
+
+    if (resume)
+    {
+        import->checkpoint = *resume;
+    }
+
+    import->reader = ld_ldif_reader_new(import, path, import->checkpoint.offset, import->checkpoint.number);
+    if (!import->reader)
+    {
+        goto error_exit;
+    }
+
+    ld_talloc_zero_array(import->slots, error_exit, import, ldif_slot_t, import->window);
+
+    // Scheduler releases itself after its completion callback, so it is not owned by import.
+    import->scheduler = ld_write_scheduler_new(NULL, connection, import->window, ldif_import_on_request,
+                                               ldif_import_on_complete, import);
+    if (!import->scheduler)
+    {
+        goto error_exit;
+    }
+
+    talloc_set_destructor((void*)import, ldif_import_destructor);
+
+    ldif_import_fill(import);
+
+    return RETURN_CODE_SUCCESS;
+
+    error_exit:
+        talloc_free(import);
+        return RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief ld_ldif_import_get_checkpoint Returns position import can be resumed from.
+ * @param[in] import                    Import to work with.
+ * @param[out] checkpoint               All records before checkpoint have completed.
+ */
+void ld_ldif_import_get_checkpoint(const ld_ldif_import_t *import, ld_ldif_checkpoint_t *checkpoint)
+{
+    *checkpoint = import->checkpoint;
+}
+
+/**
+ * @brief ld_ldif_import_get_succeeded Returns amount of records applied successfully.
+ */
+unsigned long ld_ldif_import_get_succeeded(const ld_ldif_import_t *import)
+{
+    return import->succeeded;
+}
+
+/**
+ * @brief ld_ldif_import_get_failed Returns amount of failed records including invalid ones.
+ */
+unsigned long ld_ldif_import_get_failed(const ld_ldif_import_t *import)
+{
+    return import->failures;
+}
@@ -0,0 +1,87 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_LDIF_IMPORT_H
+#define LIBDOMAIN_LDIF_IMPORT_H
+
+#include "common.h"
+#include "connection.h"
+#include "ldif.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * LDIF import reads records one at a time and keeps a window of requests in flight on the connection.
+ * Next record is read only when one of requests completes, so memory use does not depend on size of the file.
+ * Requests are submitted to write scheduler, so records wait for earlier records they depend on, e.g. child is
+ * added after its parent and entry is deleted after its children.
+ * Import can be resumed from checkpoint, records after checkpoint may have been applied already.
+ */
+
+typedef struct ld_ldif_import_s ld_ldif_import_t;
+
+/*!
+ * @brief ld_ldif_checkpoint_t - Position import can be resumed from.
+ */
+typedef struct ld_ldif_checkpoint_s
+{
+    uint64_t offset;                    //!< Offset of the first record which has not completed yet.
+    unsigned long number;               //!< Amount of records before offset.
+} ld_ldif_checkpoint_t;
+
+/**
+ * @brief ldif_record_callback_fn Callback fired once result of the record is known.
+ *
+ * Records complete in order of server responses. Invalid records are reported with LDAP_DECODING_ERROR, records
+ * skipped because earlier record they depend on has failed are reported with LDAP_OTHER.
+ * @param[in] result_code       LDAP result code of the request.
+ */
+typedef void (*ldif_record_callback_fn)(ld_ldif_import_t *import,
+                                        const ld_ldif_record_t *record,
+                                        enum OperationReturnCode rc,
+                                        int result_code,
+                                        void *user_data);
+
+/**
+ * @brief ldif_complete_callback_fn Callback fired once import has completed.
+ *
+ * Return code is RETURN_CODE_SUCCESS only if whole file was read and all records have succeeded.
+ * Import is released once callback returns.
+ */
+typedef void (*ldif_complete_callback_fn)(ld_ldif_import_t *import,
+                                          enum OperationReturnCode rc,
+                                          void *user_data);
+
+enum OperationReturnCode ld_ldif_import(TALLOC_CTX *ctx,
+                                        struct ldap_connection_ctx_t *connection,
+                                        const char *path,
+                                        const ld_ldif_checkpoint_t *resume,
+                                        unsigned int window,
+                                        bool stop_on_error,
+                                        ldif_record_callback_fn record_callback,
+                                        ldif_complete_callback_fn complete_callback,
+                                        void *user_data);
+
+void ld_ldif_import_get_checkpoint(const ld_ldif_import_t *import, ld_ldif_checkpoint_t *checkpoint);
+unsigned long ld_ldif_import_get_succeeded(const ld_ldif_import_t *import);
+unsigned long ld_ldif_import_get_failed(const ld_ldif_import_t *import);
+
+#endif //LIBDOMAIN_LDIF_IMPORT_H
@@ -0,0 +1,1129 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "membership.h"
+#include "directory.h"
+#include "dn.h"
+#include "filter.h"
+
+#include "helper_p.h"
+
+#include <string.h>
+
+#include <glib-2.0/glib.h>
+
+#define MEMBERSHIP_PAGE_SIZE 1000
+#define MEMBERSHIP_CHUNK_SIZE 100
+#define MEMBERSHIP_WINDOW 4
+
+static char *MEMBERSHIP_NO_ATTRIBUTES[] = { LDAP_NO_ATTRS, NULL };
+
+/*!
+ * @brief membership_cache_item_t - Groups of the entry.
+ */
+typedef struct membership_cache_item_s
+{
+    char *key;                                  //!< Normalized DN of the entry.
+    GHashTable *groups;                         //!< Normalized DNs of groups.
+    const char **dns;                           //!< DNs of groups as they have been received.
+    int count;                                  //!< Amount of groups.
+    gint64 expires;                             //!< Monotonic time item expires at, 0 if it never expires.
+    GList link;                                 //!< Link in the insertion order list.
+} membership_cache_item_t;
+
+/*!
+ * @brief ld_membership_cache_t - Cache of group sets.
+ */
+struct ld_membership_cache_s
+{
+    GHashTable *by_key;                         //!< Normalized DN of the entry to membership_cache_item_t.
+    GHashTable *group_refs;                     //!< Normalized DN of the group to amount of items containing it.
+    GQueue order;                               //!< Items ordered from newest to oldest.
+
+    unsigned int max_entries;                   //!< Maximum amount of items, 0 for unlimited.
+    gint64 ttl;                                 //!< Time to live of items in microseconds, 0 for unlimited.
+
+    unsigned long hits;                         //!< Amount of successful lookups.
+    unsigned long misses;                       //!< Amount of failed lookups.
+    unsigned long generation;                   //!< Incremented on every invalidation.
+
+    struct ldap_connection_ctx_t *connection;   //!< Connection cache is attached to.
+};
+
+/*!
+ * @brief membership_request_t - Resolution of groups of the entry.
+ */
+typedef struct membership_request_s
+{
+    struct ldap_connection_ctx_t *connection;   //!< Connection to work with.
+    ld_membership_cache_t *cache;               //!< Cache to fill, may be NULL.
+    unsigned long generation;                   //!< Generation of the cache at the moment request was started.
+
+    char *base_dn;                              //!< Base of the searches.
+    char *dn;                                   //!< DN of the entry.
+    char *key;                                  //!< Normalized DN of the entry.
+    char *uid;                                  //!< Value of uid RDN matched against memberUid, may be NULL.
+    char *group_dn;                             //!< Group to check membership in, NULL if all groups are requested.
+    char *group_key;                            //!< Normalized DN of the group.
+
+    bool paged;                                 //!< Search results are requested page by page.
+    GHashTable *groups;                         //!< Normalized DN of found group to its DN.
+    GHashTable *visited;                        //!< Normalized DNs which have been searched for or merged from cache.
+    GPtrArray *frontier;                        //!< DNs of the current level.
+    GPtrArray *next;                            //!< DNs found on the current level.
+    guint position;                             //!< Index of the first frontier DN not sent yet.
+    unsigned int level;                         //!< Nesting level of the frontier, 0 for the entry itself.
+    unsigned int in_flight;                     //!< Amount of searches in flight.
+    bool failed;                                //!< At least one search has failed.
+
+    membership_groups_callback_fn groups_callback; //!< Callback of ld_membership_get_groups.
+    membership_check_callback_fn check_callback;   //!< Callback of ld_membership_is_member.
+    void *user_data;                            //!< User data passed to callbacks.
+} membership_request_t;
+
+/*!
+ * @brief membership_search_t - Search sent on behalf of the request.
+ */
+typedef struct membership_search_s
+{
+    membership_request_t *request;              //!< Request search belongs to.
+    char *filter;                               //!< Filter of the search.
+    struct berval cookie;                       //!< Paged results cookie of the next page.
+    bool closure;                               //!< Found groups are searched for on the next level.
+
+    int msgid;                                  //!< Message id of the current page request.
+    bool in_progress;                           //!< Page has been requested and its result has not arrived yet.
+} membership_search_t;
+
+static int membership_cache_item_destructor(TALLOC_CTX *ctx)
+{
+    membership_cache_item_t *item = talloc_get_type_abort(ctx, membership_cache_item_t);
+
+    g_hash_table_destroy(item->groups);
+
+    return 0;
+}
+
+/**
+ * @brief membership_cache_remove Removes item from cache.
+ */
+static void membership_cache_remove(ld_membership_cache_t *cache, membership_cache_item_t *item)
+{
+    GHashTableIter iterator;
+    gpointer key = NULL;
+
+    g_hash_table_iter_init(&iterator, item->groups);
+    while (g_hash_table_iter_next(&iterator, &key, NULL))
+    {
+        guint refs = GPOINTER_TO_UINT(g_hash_table_lookup(cache->group_refs, key));
+
+        if (refs <= 1)
+        {
+            g_hash_table_remove(cache->group_refs, key);
+        }
+        else
+        {
+            g_hash_table_insert(cache->group_refs, g_strdup(key), GUINT_TO_POINTER(refs - 1));
+        }
+    }
+
+    g_hash_table_remove(cache->by_key, item->key);
+    g_queue_unlink(&cache->order, &item->link);
+
+    talloc_free(item);
+}
+
+/**
+ * @brief membership_cache_find Finds fresh item.
+ * @return
+ *        - Item on hit.
+ *        - NULL on miss.
+ */
+static membership_cache_item_t *membership_cache_find(ld_membership_cache_t *cache, const char *key)
+{
+    membership_cache_item_t *item = g_hash_table_lookup(cache->by_key, key);
+
+    if (item && item->expires && item->expires <= g_get_monotonic_time())
+    {
+        membership_cache_remove(cache, item);
+        item = NULL;
+    }
+
+    return item;
+}
+
+/**
+ * @brief membership_cache_insert Stores groups of the entry replacing previous ones.
+ * @param[in] cache               Cache to work with.
+ * @param[in] key                 Normalized DN of the entry.
+ * @param[in] groups              Normalized DNs of groups to their DNs.
+ */
+static void membership_cache_insert(ld_membership_cache_t *cache, const char *key, GHashTable *groups)
+{
+    membership_cache_item_t *item = membership_cache_find(cache, key);
+    if (item)
+    {
+        membership_cache_remove(cache, item);
+    }
+
+    item = talloc_zero(cache, membership_cache_item_t);
+    if (!item)
+    {
+        ld_error("membership_cache_insert - out of memory - unable to create item!\n");
+        return;
+    }
+
+    item->groups = g_hash_table_new(g_str_hash, g_str_equal);
+    talloc_set_destructor((void*)item, membership_cache_item_destructor);
+
+    item->key = talloc_strdup(item, key);
+    item->dns = talloc_zero_array(item, const char*, g_hash_table_size(groups) + 1);
+    if (!item->key || !item->dns)
+    {
+        ld_error("membership_cache_insert - out of memory - unable to create item!\n");
+        talloc_free(item);
+        return;
+    }
+
+    GHashTableIter iterator;
+    gpointer group_key = NULL;
+    gpointer group_dn = NULL;
+
+    g_hash_table_iter_init(&iterator, groups);
+    while (g_hash_table_iter_next(&iterator, &group_key, &group_dn))
+    {
+        char *stored_key = talloc_strdup(item, group_key);
+        char *stored_dn = talloc_strdup(item, group_dn);
+        if (!stored_key || !stored_dn)
+        {
+            ld_error("membership_cache_insert - out of memory - unable to create item!\n");
+            talloc_free(item);
+            return;
+        }
+
+        g_hash_table_add(item->groups, stored_key);
+        item->dns[item->count++] = stored_dn;
+    }
+
+    // References are counted once item is complete, so failed item does not have to be unwound.
+    g_hash_table_iter_init(&iterator, item->groups);
+    while (g_hash_table_iter_next(&iterator, &group_key, NULL))
+    {
+        guint refs = GPOINTER_TO_UINT(g_hash_table_lookup(cache->group_refs, group_key));
+        g_hash_table_insert(cache->group_refs, g_strdup(group_key), GUINT_TO_POINTER(refs + 1));
+    }
+
+    item->expires = cache->ttl ? g_get_monotonic_time() + cache->ttl : 0;
+    item->link.data = item;
+
+    g_hash_table_insert(cache->by_key, item->key, item);
+    g_queue_push_head_link(&cache->order, &item->link);
+
+    while (cache->max_entries && cache->order.length > cache->max_entries)
+    {
+        membership_cache_remove(cache, cache->order.tail->data);
+    }
+}
+
+static int membership_cache_destructor(TALLOC_CTX *ctx)
+{
+    ld_membership_cache_t *cache = talloc_get_type_abort(ctx, ld_membership_cache_t);
+
+    if (cache->connection && cache->connection->membership_cache == cache)
+    {
+        cache->connection->membership_cache = NULL;
+    }
+
+    g_hash_table_destroy(cache->by_key);
+    g_hash_table_destroy(cache->group_refs);
+
+    return 0;
+}
+
+/**
+ * @brief ld_membership_cache_new Creates new membership cache.
+ * @param[in] ctx                 Talloc ctx to use.
+ * @param[in] max_entries         Maximum amount of cached group sets, 0 for unlimited.
+ * @param[in] ttl                 Time to live of group sets in seconds, 0 for unlimited.
+ * @return
+ *        - Valid pointer to cache on success.
+ *        - NULL on failure.
+ */
+ld_membership_cache_t *ld_membership_cache_new(TALLOC_CTX *ctx, unsigned int max_entries, unsigned int ttl)
+{
+    ld_membership_cache_t *cache = NULL;
+
+    ld_talloc_zero_e(cache, error_exit, "ld_membership_cache_new - out of memory - unable to create cache!\n",
+                     ctx, ld_membership_cache_t);
+
+    cache->by_key = g_hash_table_new(g_str_hash, g_str_equal);
+    cache->group_refs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_queue_init(&cache->order);
+
+    talloc_set_destructor((void*)cache, membership_cache_destructor);
+
+    cache->max_entries = max_entries;
+    cache->ttl = (gint64)ttl * G_USEC_PER_SEC;
+
+    return cache;
+
+    error_exit:
+        return NULL;
+}
+
+/**
+ * @brief ld_membership_cache_attach Attaches cache to connection.
+ *
+ * Successful write operations performed on the connection invalidate cached group sets.
+ * @param[in] connection             Connection to work with.
+ * @param[in] cache                  Cache to attach, NULL to detach current cache.
+ */
+void ld_membership_cache_attach(struct ldap_connection_ctx_t *connection, ld_membership_cache_t *cache)
+{
+    if (!connection)
+    {
+        ld_error("ld_membership_cache_attach - invalid connection!\n");
+        return;
+    }
+
+    if (connection->membership_cache)
+    {
+        connection->membership_cache->connection = NULL;
+    }
+
+    connection->membership_cache = cache;
+
+    if (cache)
+    {
+        cache->connection = connection;
+    }
+}
+
+/**
+ * @brief ld_membership_cache_lookup Checks membership using cached groups of the entry only.
+ * @param[in] cache                  Cache to work with.
+ * @param[in] dn                     DN of the entry.
+ * @param[in] group_dn               DN of the group.
+ * @param[out] is_member             Entry is a direct or nested member of the group.
+ * @return
+ *        - true if groups of the entry are cached.
+ *        - false otherwise, is_member is not changed.
+ */
+bool ld_membership_cache_lookup(ld_membership_cache_t *cache, const char *dn, const char *group_dn, bool *is_member)
+{
+    if (!cache || !dn || !group_dn || !is_member)
+    {
+        ld_error("ld_membership_cache_lookup - invalid parameters!\n");
+        return false;
+    }
+
+    char *key = ld_dn_normalize(NULL, dn);
+    char *group_key = ld_dn_normalize(key, group_dn);
+    membership_cache_item_t *item = key && group_key ? membership_cache_find(cache, key) : NULL;
+
+    if (item)
+    {
+        ++cache->hits;
+        *is_member = g_hash_table_contains(item->groups, group_key);
+    }
+    else
+    {
+        ++cache->misses;
+    }
+
+    talloc_free(key);
+
+    return item != NULL;
+}
+
+/**
+ * @brief ld_membership_cache_invalidate Drops group sets which may be affected by change of the entry.
+ *
+ * Change of a group may change nested membership of any entry, so all group sets are dropped.
+ * Change of any other entry drops only its own group set.
+ * @param[in] cache                      Cache to work with.
+ * @param[in] dn                         DN of the changed entry.
+ * @param[in] subtree                    Entry's descendants have been changed as well.
+ */
+void ld_membership_cache_invalidate(ld_membership_cache_t *cache, const char *dn, bool subtree)
+{
+    if (!cache || !dn)
+    {
+        ld_error("ld_membership_cache_invalidate - invalid parameters!\n");
+        return;
+    }
+
+    ++cache->generation;
+
+    char *key = ld_dn_normalize(NULL, dn);
+
+    if (!key || subtree || g_hash_table_contains(cache->group_refs, key))
+    {
+        ld_membership_cache_clear(cache);
+    }
+    else
+    {
+        membership_cache_item_t *item = g_hash_table_lookup(cache->by_key, key);
+        if (item)
+        {
+            membership_cache_remove(cache, item);
+        }
+    }
+
+    talloc_free(key);
+}
+
+/**
+ * @brief ld_membership_cache_clear Drops all group sets.
+ */
+void ld_membership_cache_clear(ld_membership_cache_t *cache)
+{
+    if (!cache)
+    {
+        return;
+    }
+
+    ++cache->generation;
+
+    while (cache->order.head)
+    {
+        membership_cache_remove(cache, cache->order.head->data);
+    }
+}
+
+/**
+ * @brief ld_membership_cache_count Returns amount of cached group sets.
+ */
+unsigned int ld_membership_cache_count(const ld_membership_cache_t *cache)
+{
+    return cache ? cache->order.length : 0;
+}
+
+/**
+ * @brief ld_membership_cache_hits Returns amount of successful lookups.
+ */
+unsigned long ld_membership_cache_hits(const ld_membership_cache_t *cache)
+{
+    return cache ? cache->hits : 0;
+}
+
+/**
+ * @brief ld_membership_cache_misses Returns amount of failed lookups.
+ */
+unsigned long ld_membership_cache_misses(const ld_membership_cache_t *cache)
+{
+    return cache ? cache->misses : 0;
+}
+
+/**
+ * @brief membership_mods_affect Checks whether modifications change attributes holding group members.
+ * @param[in] mods               NULL terminated modifications, may be NULL.
+ * @return
+ *        - true if member, uniqueMember or memberUid is changed.
+ *        - false otherwise.
+ */
+bool membership_mods_affect(LDAPMod **mods)
+{
+    for (int i = 0; mods && mods[i] != NULL; ++i)
+    {
+        const char *type = mods[i]->mod_type;
+
+        if (type && (strcasecmp(type, "member") == 0
+                     || strcasecmp(type, "uniqueMember") == 0
+                     || strcasecmp(type, "memberUid") == 0))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int membership_request_destructor(TALLOC_CTX *ctx)
+{
+    membership_request_t *request = talloc_get_type_abort(ctx, membership_request_t);
+
+    g_hash_table_destroy(request->groups);
+    g_hash_table_destroy(request->visited);
+    g_ptr_array_free(request->frontier, TRUE);
+    g_ptr_array_free(request->next, TRUE);
+
+    return 0;
+}
+
+static int membership_search_destructor(TALLOC_CTX *ctx)
+{
+    membership_search_t *search = talloc_get_type_abort(ctx, membership_search_t);
+    struct ldap_connection_ctx_t *connection = search->request->connection;
+
+    // Request is released before all of its searches have completed.
+    if (search->in_progress)
+    {
+        connection_cancel_read_request(connection, search->msgid);
+        ldap_abandon_ext(connection->ldap, search->msgid, NULL, NULL);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief membership_respond Passes groups to the callback of the request.
+ * @param[in] request        Request to work with.
+ * @param[in] groups         Normalized DNs of groups.
+ * @param[in] dns            DNs of groups.
+ * @param[in] count          Amount of groups.
+ * @param[in] rc             Return code passed to callback.
+ */
+static void membership_respond(membership_request_t *request, GHashTable *groups, const char **dns, int count,
+                               enum OperationReturnCode rc)
+{
+    if (request->groups_callback)
+    {
+        request->groups_callback(request->dn, dns, rc == RETURN_CODE_SUCCESS ? count : 0, rc, request->user_data);
+    }
+
+    if (request->check_callback)
+    {
+        bool is_member = rc == RETURN_CODE_SUCCESS && g_hash_table_contains(groups, request->group_key);
+
+        request->check_callback(request->dn, request->group_dn, is_member, rc, request->user_data);
+    }
+}
+
+/**
+ * @brief membership_complete Stores found groups in the cache, passes them to callback and releases request.
+ */
+static void membership_complete(membership_request_t *request)
+{
+    enum OperationReturnCode rc = request->failed ? RETURN_CODE_FAILURE : RETURN_CODE_SUCCESS;
+    guint count = g_hash_table_size(request->groups);
+    const char **dns = talloc_zero_array(request, const char*, count + 1);
+
+    if (!dns)
+    {
+        ld_error("membership_complete - out of memory - unable to create groups!\n");
+        rc = RETURN_CODE_FAILURE;
+    }
+    else
+    {
+        GHashTableIter iterator;
+        gpointer value = NULL;
+        int index = 0;
+
+        g_hash_table_iter_init(&iterator, request->groups);
+        while (g_hash_table_iter_next(&iterator, NULL, &value))
+        {
+            dns[index++] = value;
+        }
+    }
+
+    // Groups found while cache has been invalidated may already be stale.
+    if (rc == RETURN_CODE_SUCCESS && request->cache && request->connection->membership_cache == request->cache
+        && request->cache->generation == request->generation)
+    {
+        membership_cache_insert(request->cache, request->key, request->groups);
+    }
+
+    membership_respond(request, request->groups, dns, count, rc);
+
+    talloc_free(request);
+}
+
+/**
+ * @brief membership_add_group Records group found by search.
+ * @param[in] request          Request to work with.
+ * @param[in] dn               DN of the group.
+ * @param[in] closure          Groups of the group have to be searched for.
+ */
+static void membership_add_group(membership_request_t *request, const char *dn, bool closure)
+{
+    char *key = ld_dn_normalize(NULL, dn);
+    if (!key)
+    {
+        ld_error("membership_add_group - invalid DN %s!\n", dn);
+        request->failed = true;
+        return;
+    }
+
+    if (!g_hash_table_contains(request->groups, key))
+    {
+        g_hash_table_insert(request->groups, g_strdup(key), g_strdup(dn));
+    }
+
+    if (closure && !g_hash_table_contains(request->visited, key))
+    {
+        g_hash_table_add(request->visited, g_strdup(key));
+
+        membership_cache_item_t *item = request->cache ? membership_cache_find(request->cache, key) : NULL;
+
+        if (item)
+        {
+            // Groups of the group are known, they need not be searched for.
+            for (int i = 0; i < item->count; ++i)
+            {
+                char *group_key = ld_dn_normalize(NULL, item->dns[i]);
+                if (group_key)
+                {
+                    g_hash_table_add(request->visited, g_strdup(group_key));
+                    if (!g_hash_table_contains(request->groups, group_key))
+                    {
+                        g_hash_table_insert(request->groups, g_strdup(group_key), g_strdup(item->dns[i]));
+                    }
+                    talloc_free(group_key);
+                }
+            }
+        }
+        else
+        {
+            g_ptr_array_add(request->next, g_strdup(dn));
+        }
+    }
+
+    talloc_free(key);
+}
+
+static enum OperationReturnCode membership_on_read(int rc, LDAPMessage *message,
+                                                   struct ldap_connection_ctx_t *connection);
+
+/**
+ * @brief membership_search_send Sends search or request for the next page of its results.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode membership_search_send(membership_search_t *search)
+{
+    membership_request_t *request = search->request;
+    struct ldap_connection_ctx_t *connection = request->connection;
+    LDAPControl *controls[2] = { NULL, NULL };
+    int msgid = 0;
+
+    if (request->paged
+        && ldap_create_page_control(connection->ldap, MEMBERSHIP_PAGE_SIZE, &search->cookie, 0,
+                                    &controls[0]) != LDAP_SUCCESS)
+    {
+        ld_error("membership_search_send - unable to create paged results control!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    int rc = ldap_search_ext(connection->ldap,
+                             request->base_dn,
+                             LDAP_SCOPE_SUBTREE,
+                             search->filter,
+                             MEMBERSHIP_NO_ATTRIBUTES,
+                             0,
+                             controls,
+                             NULL,
+                             NULL,
+                             LDAP_NO_LIMIT,
+                             &msgid);
+
+    if (controls[0])
+    {
+        ldap_control_free(controls[0]);
+    }
+
+    if (rc != LDAP_SUCCESS)
+    {
+        ld_error("Unable to create membership search request: %s\n", ldap_err2string(rc));
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (connection_add_stream_request(connection, msgid, membership_on_read, search) != RETURN_CODE_SUCCESS)
+    {
+        ldap_abandon_ext(connection->ldap, msgid, NULL, NULL);
+        return RETURN_CODE_FAILURE;
+    }
+
+    search->msgid = msgid;
+    search->in_progress = true;
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief membership_search_new Creates and sends new search of the request.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode membership_search_new(membership_request_t *request, char *filter, bool closure)
+{
+    membership_search_t *search = talloc_zero(request, membership_search_t);
+    if (!search)
+    {
+        ld_error("membership_search_new - out of memory - unable to create search!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    talloc_set_destructor((void*)search, membership_search_destructor);
+
+    search->request = request;
+    search->filter = talloc_steal(search, filter);
+    search->closure = closure;
+    search->msgid = -1;
+
+    if (membership_search_send(search) != RETURN_CODE_SUCCESS)
+    {
+        talloc_free(search);
+        return RETURN_CODE_FAILURE;
+    }
+
+    ++request->in_flight;
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief membership_closure_filter Creates filter matching groups which directly contain frontier entries.
+ * @return
+ *        - Filter on success.
+ *        - NULL on failure.
+ */
+static char *membership_closure_filter(membership_request_t *request, guint first, guint count)
+{
+    GString *values = g_string_new(NULL);
+    char *filter = NULL;
+
+    for (guint i = first; i < first + count; ++i)
+    {
+        const char *dn = g_ptr_array_index(request->frontier, i);
+
+        char *escaped = ld_filter_escape_value(request, dn, strlen(dn));
+        if (!escaped)
+        {
+            g_string_free(values, TRUE);
+            return NULL;
+        }
+
+        g_string_append_printf(values, "(member=%s)(uniqueMember=%s)", escaped, escaped);
+        talloc_free(escaped);
+    }
+
+    // posixGroup lists names of users instead of DNs, they can only be direct members.
+    if (request->uid && request->level == 0)
+    {
+        char *escaped = ld_filter_escape_value(request, request->uid, strlen(request->uid));
+        if (!escaped)
+        {
+            g_string_free(values, TRUE);
+            return NULL;
+        }
+
+        g_string_append_printf(values, "(memberUid=%s)", escaped);
+        talloc_free(escaped);
+    }
+
+    filter = talloc_asprintf(request, "(|%s)", values->str);
+    g_string_free(values, TRUE);
+
+    if (!filter)
+    {
+        ld_error("membership_closure_filter - out of memory - unable to create filter!\n");
+    }
+
+    return filter;
+}
+
+/**
+ * @brief membership_dispatch Sends searches for the current level, moves to the next level once it is done.
+ *
+ * Request is completed once no new groups have been found.
+ */
+static void membership_dispatch(membership_request_t *request)
+{
+    while (!request->failed && request->in_flight < MEMBERSHIP_WINDOW && request->position < request->frontier->len)
+    {
+        guint count = MIN(MEMBERSHIP_CHUNK_SIZE, request->frontier->len - request->position);
+        char *filter = membership_closure_filter(request, request->position, count);
+
+        if (!filter || membership_search_new(request, filter, true) != RETURN_CODE_SUCCESS)
+        {
+            request->failed = true;
+            break;
+        }
+
+        request->position += count;
+    }
+
+    if (request->in_flight > 0)
+    {
+        return;
+    }
+
+    if (!request->failed && request->position >= request->frontier->len && request->next->len > 0)
+    {
+        GPtrArray *frontier = request->frontier;
+
+        g_ptr_array_set_size(frontier, 0);
+        request->frontier = request->next;
+        request->next = frontier;
+        request->position = 0;
+        ++request->level;
+
+        membership_dispatch(request);
+        return;
+    }
+
+    if (request->failed || request->position >= request->frontier->len)
+    {
+        membership_complete(request);
+    }
+}
+
+/**
+ * @brief membership_search_result Processes result of the search, requests next page or finishes the search.
+ */
+static void membership_search_result(membership_search_t *search, LDAPMessage *message)
+{
+    membership_request_t *request = search->request;
+    LDAP *ldap = request->connection->ldap;
+    int error_code = LDAP_OTHER;
+    char *diagnostic_message = NULL;
+    LDAPControl **controls = NULL;
+
+    search->in_progress = false;
+
+    if (message)
+    {
+        ldap_parse_result(ldap, message, &error_code, NULL, &diagnostic_message, NULL, &controls, 0);
+    }
+
+    if (error_code != LDAP_SUCCESS)
+    {
+        ld_error("Membership search request failed: %s %s\n", ldap_err2string(error_code),
+                 diagnostic_message ? diagnostic_message : "");
+        request->failed = true;
+    }
+
+    ldap_memfree(diagnostic_message);
+
+    LDAPControl *control = request->paged && error_code == LDAP_SUCCESS
+            ? ldap_control_find(LDAP_CONTROL_PAGEDRESULTS, controls, NULL)
+            : NULL;
+
+    if (control)
+    {
+        ber_int_t count = 0;
+        struct berval cookie = { 0, NULL };
+
+        if (ldap_parse_pageresponse_control(ldap, control, &count, &cookie) == LDAP_SUCCESS)
+        {
+            talloc_free(search->cookie.bv_val);
+            search->cookie.bv_val = cookie.bv_len > 0 ? talloc_memdup(search, cookie.bv_val, cookie.bv_len) : NULL;
+            search->cookie.bv_len = search->cookie.bv_val ? cookie.bv_len : 0;
+            ber_memfree(cookie.bv_val);
+        }
+    }
+
+    ldap_controls_free(controls);
+
+    if (control && search->cookie.bv_len > 0 && !request->failed)
+    {
+        if (membership_search_send(search) == RETURN_CODE_SUCCESS)
+        {
+            return;
+        }
+
+        request->failed = true;
+    }
+
+    talloc_free(search);
+    --request->in_flight;
+
+    // Request may be released here.
+    membership_dispatch(request);
+}
+
+/**
+ * @brief membership_on_read This callback is called when results of membership search arrive.
+ * @param[in] rc            Return code of ldap_result.
+ * @param[in] message       Message received from ldap.
+ * @param[in] connection    Connection to work with.
+ * @return
+ *        - RETURN_CODE_OPERATION_IN_PROGRESS while results are being received.
+ *        - RETURN_CODE_SUCCESS when request has been completed.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode membership_on_read(int rc, LDAPMessage *message,
+                                                   struct ldap_connection_ctx_t *connection)
+{
+    membership_search_t *search = connection->request_user_data;
+
+    if (!search)
+    {
+        ld_error("membership_on_read - search is missing!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (rc == LDAP_RES_ANY)
+    {
+        membership_search_result(search, NULL);
+        return RETURN_CODE_SUCCESS;
+    }
+
+    for (LDAPMessage *current = ldap_first_message(connection->ldap, message);
+         current != NULL;
+         current = ldap_next_message(connection->ldap, current))
+    {
+        switch (ldap_msgtype(current))
+        {
+        case LDAP_RES_SEARCH_ENTRY:
+        {
+            char *dn = ldap_get_dn(connection->ldap, current);
+            if (dn)
+            {
+                membership_add_group(search->request, dn, search->closure);
+                ldap_memfree(dn);
+            }
+        }
+            break;
+        case LDAP_RES_SEARCH_REFERENCE:
+            ld_info("Received search referral but not following it!");
+            break;
+        case LDAP_RES_SEARCH_RESULT:
+            membership_search_result(search, current);
+            return RETURN_CODE_SUCCESS;
+        default:
+            break;
+        }
+    }
+
+    return RETURN_CODE_OPERATION_IN_PROGRESS;
+}
+
+/**
+ * @brief membership_get_uid Returns value of uid RDN of the entry.
+ * @return
+ *        - Unescaped value allocated on request.
+ *        - NULL if first RDN of the entry is not uid.
+ */
+static char *membership_get_uid(membership_request_t *request)
+{
+    char *uid = NULL;
+    ld_dn_t *parsed = ld_dn_parse(NULL, request->dn, NULL);
+
+    const ld_dn_ava_t *ava = parsed && ld_dn_get_ava_count(parsed) > 0 ? ld_dn_get_ava(parsed, 0) : NULL;
+
+    if (ava && ava->rdn == 0 && ava->type_len == 3 && strncasecmp(ava->type, "uid", 3) == 0
+        && memchr(ava->value, '\\', ava->value_len) == NULL)
+    {
+        uid = talloc_strndup(request, ava->value, ava->value_len);
+    }
+
+    talloc_free(parsed);
+
+    return uid;
+}
+
+/**
+ * @brief membership_start Serves request from cache or starts searches.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success, callback may have been called.
+ *        - RETURN_CODE_FAILURE on failure, request is released and callback is not called.
+ */
+static enum OperationReturnCode membership_start(membership_request_t *request)
+{
+    ld_membership_cache_t *cache = request->cache;
+    membership_cache_item_t *item = cache ? membership_cache_find(cache, request->key) : NULL;
+
+    if (cache)
+    {
+        if (item)
+        {
+            ++cache->hits;
+        }
+        else
+        {
+            ++cache->misses;
+        }
+    }
+
+    if (item)
+    {
+        membership_respond(request, item->groups, item->dns, item->count, RETURN_CODE_SUCCESS);
+        talloc_free(request);
+        return RETURN_CODE_SUCCESS;
+    }
+
+    g_hash_table_add(request->visited, g_strdup(request->key));
+
+    if (directory_has_capability(request->connection, LDAP_CAPABILITY_MATCHING_RULE_IN_CHAIN))
+    {
+        char *escaped = ld_filter_escape_value(request, request->dn, strlen(request->dn));
+        char *filter = escaped ? talloc_asprintf(request, "(member:1.2.840.113556.1.4.1941:=%s)", escaped) : NULL;
+
+        if (!filter || membership_search_new(request, filter, false) != RETURN_CODE_SUCCESS)
+        {
+            talloc_free(request);
+            return RETURN_CODE_FAILURE;
+        }
+
+        return RETURN_CODE_SUCCESS;
+    }
+
+    request->uid = membership_get_uid(request);
+    g_ptr_array_add(request->frontier, g_strdup(request->dn));
+
+    char *filter = membership_closure_filter(request, 0, 1);
+
+    if (!filter || membership_search_new(request, filter, true) != RETURN_CODE_SUCCESS)
+    {
+        talloc_free(request);
+        return RETURN_CODE_FAILURE;
+    }
+
+    request->position = 1;
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief membership_request_new Creates request for groups of the entry.
+ * @return
+ *        - Request on success.
+ *        - NULL on failure.
+ */
+static membership_request_t *membership_request_new(TALLOC_CTX *ctx,
+                                                    struct ldap_connection_ctx_t *connection,
+                                                    const char *base_dn,
+                                                    const char *dn,
+                                                    void *user_data)
+{
+    membership_request_t *request = NULL;
+
+    ld_talloc_zero_e(request, error_exit, "membership_request_new - out of memory - unable to create request!\n",
+                     ctx, membership_request_t);
+
+    request->groups = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    request->visited = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    request->frontier = g_ptr_array_new_with_free_func(g_free);
+    request->next = g_ptr_array_new_with_free_func(g_free);
+    talloc_set_destructor((void*)request, membership_request_destructor);
+
+    request->connection = connection;
+    request->cache = connection->membership_cache;
+    request->generation = request->cache ? request->cache->generation : 0;
+    request->paged = directory_has_capability(connection, LDAP_CAPABILITY_PAGED_RESULTS);
+    request->user_data = user_data;
+
+    ld_talloc_strdup(request->base_dn, error_exit, request, base_dn);
+    ld_talloc_strdup(request->dn, error_exit, request, dn);
+
+    request->key = ld_dn_normalize(request, dn);
+    if (!request->key)
+    {
+        ld_error("membership_request_new - invalid DN %s!\n", dn);
+        goto error_exit;
+    }
+
+    return request;
+
+    error_exit:
+        talloc_free(request);
+        return NULL;
+}
+
+/**
+ * @brief ld_membership_get_groups Finds all groups entry is a direct or nested member of.
+ *
+ * Callback is called before function returns if groups are cached.
+ * @param[in] ctx                  Talloc ctx to use.
+ * @param[in] connection           Connection to work with, should be in LDAP_CONNECTION_STATE_RUN state.
+ * @param[in] base_dn              Base of the group searches.
+ * @param[in] dn                   DN of the entry.
+ * @param[in] callback             Callback to pass groups to.
+ * @param[in] user_data            User data passed to callback.
+ * @return
+ *        - RETURN_CODE_SUCCESS if groups have been passed to callback or searches have been started.
+ *        - RETURN_CODE_FAILURE on failure, callback is not called.
+ */
+enum OperationReturnCode ld_membership_get_groups(TALLOC_CTX *ctx,
+                                                  struct ldap_connection_ctx_t *connection,
+                                                  const char *base_dn,
+                                                  const char *dn,
+                                                  membership_groups_callback_fn callback,
+                                                  void *user_data)
+{
+    if (!connection || !base_dn || !dn || !callback)
+    {
+        ld_error("ld_membership_get_groups - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    membership_request_t *request = membership_request_new(ctx, connection, base_dn, dn, user_data);
+    if (!request)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    request->groups_callback = callback;
+
+    return membership_start(request);
+}
+
+/**
+ * @brief ld_membership_is_member Checks whether entry is a direct or nested member of the group.
+ *
+ * Callback is called before function returns if groups of the entry are cached.
+ * @param[in] ctx                 Talloc ctx to use.
+ * @param[in] connection          Connection to work with, should be in LDAP_CONNECTION_STATE_RUN state.
+ * @param[in] base_dn             Base of the group searches.
+ * @param[in] dn                  DN of the entry.
+ * @param[in] group_dn            DN of the group.
+ * @param[in] callback            Callback to pass result to.
+ * @param[in] user_data           User data passed to callback.
+ * @return
+ *        - RETURN_CODE_SUCCESS if result has been passed to callback or searches have been started.
+ *        - RETURN_CODE_FAILURE on failure, callback is not called.
+ */
+enum OperationReturnCode ld_membership_is_member(TALLOC_CTX *ctx,
+                                                 struct ldap_connection_ctx_t *connection,
+                                                 const char *base_dn,
+                                                 const char *dn,
+                                                 const char *group_dn,
+                                                 membership_check_callback_fn callback,
+                                                 void *user_data)
+{
+    if (!connection || !base_dn || !dn || !group_dn || !callback)
+    {
+        ld_error("ld_membership_is_member - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    membership_request_t *request = membership_request_new(ctx, connection, base_dn, dn, user_data);
+    if (!request)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    request->check_callback = callback;
+    request->group_dn = talloc_strdup(request, group_dn);
+    request->group_key = ld_dn_normalize(request, group_dn);
+
+    if (!request->group_dn || !request->group_key)
+    {
+        ld_error("ld_membership_is_member - invalid group DN %s!\n", group_dn);
+        talloc_free(request);
+        return RETURN_CODE_FAILURE;
+    }
+
+    return membership_start(request);
+}
@@ -0,0 +1,85 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_MEMBERSHIP_H
+#define LIBDOMAIN_MEMBERSHIP_H
+
+#include "common.h"
+#include "connection.h"
+
+#include <stdbool.h>
+
+/**
+ * Transitive group membership. Directories supporting LDAP_MATCHING_RULE_IN_CHAIN are asked for all groups of
+ * the entry with a single search, otherwise closure over member, uniqueMember and memberUid is computed level by
+ * level. Group sets are kept in the membership cache of the connection if one is attached.
+ */
+
+/**
+ * @brief membership_groups_callback_fn Callback fired once groups of the entry are known.
+ * @param[in] dn                DN of the entry.
+ * @param[in] groups            DNs of groups entry is a direct or nested member of, valid only during the call.
+ */
+typedef void (*membership_groups_callback_fn)(const char *dn,
+                                              const char **groups,
+                                              int n_groups,
+                                              enum OperationReturnCode rc,
+                                              void *user_data);
+
+/**
+ * @brief membership_check_callback_fn Callback fired once membership of the entry in the group is known.
+ */
+typedef void (*membership_check_callback_fn)(const char *dn,
+                                             const char *group_dn,
+                                             bool is_member,
+                                             enum OperationReturnCode rc,
+                                             void *user_data);
+
+ld_membership_cache_t *ld_membership_cache_new(TALLOC_CTX *ctx, unsigned int max_entries, unsigned int ttl);
+
+void ld_membership_cache_attach(struct ldap_connection_ctx_t *connection, ld_membership_cache_t *cache);
+
+bool ld_membership_cache_lookup(ld_membership_cache_t *cache, const char *dn, const char *group_dn, bool *is_member);
+
+void ld_membership_cache_invalidate(ld_membership_cache_t *cache, const char *dn, bool subtree);
+void ld_membership_cache_clear(ld_membership_cache_t *cache);
+
+unsigned int ld_membership_cache_count(const ld_membership_cache_t *cache);
+unsigned long ld_membership_cache_hits(const ld_membership_cache_t *cache);
+unsigned long ld_membership_cache_misses(const ld_membership_cache_t *cache);
+
+bool membership_mods_affect(LDAPMod **mods);
+
+enum OperationReturnCode ld_membership_get_groups(TALLOC_CTX *ctx,
+                                                  struct ldap_connection_ctx_t *connection,
+                                                  const char *base_dn,
+                                                  const char *dn,
+                                                  membership_groups_callback_fn callback,
+                                                  void *user_data);
+
+enum OperationReturnCode ld_membership_is_member(TALLOC_CTX *ctx,
+                                                 struct ldap_connection_ctx_t *connection,
+                                                 const char *base_dn,
+                                                 const char *dn,
+                                                 const char *group_dn,
+                                                 membership_check_callback_fn callback,
+                                                 void *user_data);
+
+#endif //LIBDOMAIN_MEMBERSHIP_H
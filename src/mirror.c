@@ -0,0 +1,1204 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "mirror.h"
+#include "mirror_p.h"
+
+#include "dn.h"
+#include "domain.h"
+#include "entry.h"
+#include "entry_p.h"
+#include "filter.h"
+#include "filter_match.h"
+#include "filter_match_p.h"
+#include "filter_p.h"
+
+#include "helper_p.h"
+
+#include <string.h>
+
+#include <glib-2.0/glib.h>
+
+static int mirror_node_destructor(TALLOC_CTX *ctx)
+{
+    mirror_node_t *node = ctx;
+
+    if (node->children)
+    {
+        g_hash_table_destroy(node->children);
+    }
+
+    return 0;
+}
+
+static int mirror_index_destructor(TALLOC_CTX *ctx)
+{
+    mirror_index_t *index = ctx;
+
+    g_hash_table_destroy(index->postings);
+    if (index->sorted)
+    {
+        g_ptr_array_free(index->sorted, TRUE);
+    }
+
+    return 0;
+}
+
+static int mirror_destructor(TALLOC_CTX *ctx)
+{
+    ld_mirror_t *mirror = ctx;
+
+    g_array_free(mirror->records, TRUE);
+    g_array_free(mirror->free_ids, TRUE);
+    g_hash_table_destroy(mirror->indexes);
+
+    return 0;
+}
+
+void mirror_posting_free(gpointer data)
+{
+    g_array_free(data, TRUE);
+}
+
+static mirror_node_t *mirror_node_new(TALLOC_CTX *ctx, mirror_node_t *parent, const char *rdn)
+{
+    mirror_node_t *result = talloc_zero(ctx, mirror_node_t);
+    if (!result)
+    {
+        return NULL;
+    }
+
+    result->rdn = talloc_strdup(result, rdn);
+    if (!result->rdn)
+    {
+        talloc_free(result);
+        return NULL;
+    }
+
+    result->parent = parent;
+    result->depth = parent ? parent->depth + 1 : 0;
+    result->id = -1;
+    talloc_set_destructor(result, mirror_node_destructor);
+
+    if (parent)
+    {
+        if (!parent->children)
+        {
+            parent->children = g_hash_table_new(g_str_hash, g_str_equal);
+        }
+        g_hash_table_insert(parent->children, result->rdn, result);
+    }
+
+    return result;
+}
+
+/**
+ * @brief mirror_find_node Walks DN tree from the rightmost RDN of canonical DN.
+ * @param[in] mirror       Mirror to search in.
+ * @param[in] normalized   Canonical DN, separators are the only unescaped commas in it.
+ * @param[in] create       Create missing nodes.
+ * @return
+ *        - Node of the DN.
+ *        - NULL if node does not exist or on failure.
+ */
+static mirror_node_t *mirror_find_node(ld_mirror_t *mirror, const char *normalized, bool create)
+{
+    mirror_node_t *node = mirror->root;
+    char *copy = g_strdup(normalized);
+    size_t end = strlen(copy);
+
+    while (node && end > 0)
+    {
+        size_t start = end;
+        while (start > 0 && copy[start - 1] != ',')
+        {
+            --start;
+        }
+        copy[end] = '\0';
+
+        const char *rdn = copy + start;
+        mirror_node_t *child = node->children ? g_hash_table_lookup(node->children, rdn) : NULL;
+
+        node = child ? child : create ? mirror_node_new(node, node, rdn) : NULL;
+        end = start > 0 ? start - 1 : 0;
+    }
+
+    g_free(copy);
+
+    return node;
+}
+
+/**
+ * @brief mirror_prune Removes nodes which have neither entry nor children.
+ */
+static void mirror_prune(ld_mirror_t *mirror, mirror_node_t *node)
+{
+    while (node != mirror->root && node->id < 0 && (!node->children || g_hash_table_size(node->children) == 0))
+    {
+        mirror_node_t *parent = node->parent;
+
+        g_hash_table_remove(parent->children, node->rdn);
+        talloc_free(node);
+
+        node = parent;
+    }
+}
+
+static LDAPAttribute_t *mirror_find_attribute(ld_entry_t *entry, const char *name)
+{
+    LDAPAttribute_t *result = g_hash_table_lookup(entry->attributes, name);
+    if (result)
+    {
+        return result;
+    }
+
+    GHashTableIter iter;
+    gpointer key = NULL;
+    gpointer value = NULL;
+
+    g_hash_table_iter_init(&iter, entry->attributes);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+        if (g_ascii_strcasecmp(key, name) == 0)
+        {
+            return value;
+        }
+    }
+
+    return NULL;
+}
+
+static guint mirror_posting_position(GArray *posting, guint id, bool *found)
+{
+    guint low = 0;
+    guint high = posting->len;
+
+    while (low < high)
+    {
+        guint middle = low + (high - low) / 2;
+        if (g_array_index(posting, guint, middle) < id)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    *found = low < posting->len && g_array_index(posting, guint, low) == id;
+
+    return low;
+}
+
+/**
+ * @brief mirror_update_index Adds values of the entry to index or removes them from it.
+ * @param[in] mirror           Mirror index belongs to.
+ * @param[in] index            Index to update.
+ * @param[in] id               Identifier of the entry.
+ * @param[in] entry            Entry to take values from.
+ * @param[in] add              Add values if true, remove otherwise.
+ */
+static void mirror_update_index(ld_mirror_t *mirror, mirror_index_t *index, guint id, ld_entry_t *entry, bool add)
+{
+    LDAPAttribute_t *attribute = mirror_find_attribute(entry, index->attribute);
+
+    for (int i = 0; attribute && attribute->values && attribute->values[i]; ++i)
+    {
+        char *key = filter_normalize_key(NULL, mirror->schema, index->rule, attribute->values[i], true);
+        if (!key)
+        {
+            continue;
+        }
+
+        bool found = false;
+        GArray *posting = g_hash_table_lookup(index->postings, key);
+
+        if (add)
+        {
+            if (!posting)
+            {
+                posting = g_array_new(FALSE, FALSE, sizeof(guint));
+                g_hash_table_insert(index->postings, g_strdup(key), posting);
+                index->dirty = true;
+            }
+
+            guint position = mirror_posting_position(posting, id, &found);
+            if (!found)
+            {
+                g_array_insert_val(posting, position, id);
+            }
+        }
+        else if (posting)
+        {
+            guint position = mirror_posting_position(posting, id, &found);
+            if (found)
+            {
+                g_array_remove_index(posting, position);
+            }
+
+            if (posting->len == 0)
+            {
+                g_hash_table_remove(index->postings, key);
+                index->dirty = true;
+            }
+        }
+
+        talloc_free(key);
+    }
+}
+
+static void mirror_update_indexes(ld_mirror_t *mirror, guint id, ld_entry_t *entry, bool add)
+{
+    GHashTableIter iter;
+    gpointer value = NULL;
+
+    g_hash_table_iter_init(&iter, mirror->indexes);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        mirror_update_index(mirror, value, id, entry, add);
+    }
+}
+
+/**
+ * @brief ld_mirror_new Creates empty mirror.
+ * @param[in] ctx       Talloc ctx to use.
+ * @param[in] schema    Schema to resolve matching rules with, may be NULL. Schema must outlive the mirror.
+ * @return
+ *        - Mirror.
+ *        - NULL on failure.
+ */
+ld_mirror_t *ld_mirror_new(TALLOC_CTX *ctx, const ldap_schema_t *schema)
+{
+    ld_mirror_t *result = NULL;
+
+    ld_talloc_zero_e(result, error_exit, "ld_mirror_new - out of memory - unable to create mirror!\n",
+                     ctx, ld_mirror_t);
+
+    result->schema = schema;
+    result->records = g_array_new(FALSE, TRUE, sizeof(mirror_record_t));
+    result->free_ids = g_array_new(FALSE, FALSE, sizeof(guint));
+    result->indexes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    talloc_set_destructor(result, mirror_destructor);
+
+    result->root = mirror_node_new(result, NULL, "");
+    if (!result->root)
+    {
+        ld_error("ld_mirror_new - out of memory - unable to create mirror!\n");
+        goto error_exit;
+    }
+
+    return result;
+
+    error_exit:
+        talloc_free(result);
+        return NULL;
+}
+
+static mirror_index_t *mirror_find_index(ld_mirror_t *mirror, const char *attribute)
+{
+    if (!attribute || g_hash_table_size(mirror->indexes) == 0)
+    {
+        return NULL;
+    }
+
+    char *name = g_ascii_strdown(attribute, -1);
+    mirror_index_t *result = g_hash_table_lookup(mirror->indexes, name);
+    g_free(name);
+
+    return result;
+}
+
+/**
+ * @brief mirror_index_new Creates empty index and registers it in mirror.
+ * @param[in] mirror       Mirror to add index to.
+ * @param[in] attribute    Attribute to index.
+ * @param[in] type         Type of the index.
+ * @return
+ *        - Index.
+ *        - NULL on failure.
+ */
+mirror_index_t *mirror_index_new(ld_mirror_t *mirror, const char *attribute, enum LdapMirrorIndexType type)
+{
+    mirror_index_t *result = NULL;
+
+    ld_talloc_zero_e(result, error_exit, "mirror_index_new - out of memory - unable to create index!\n",
+                     mirror, mirror_index_t);
+    ld_talloc_strdup(result->attribute, error_exit, result, attribute);
+
+    result->type = type;
+    result->rule = filter_attribute_rule(mirror->schema, attribute);
+    result->postings = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, mirror_posting_free);
+    result->sorted = type == LD_MIRROR_INDEX_ORDERED ? g_ptr_array_new() : NULL;
+    result->dirty = true;
+    talloc_set_destructor(result, mirror_index_destructor);
+
+    g_hash_table_insert(mirror->indexes, g_ascii_strdown(attribute, -1), result);
+
+    return result;
+
+    error_exit:
+        talloc_free(result);
+        return NULL;
+}
+
+/**
+ * @brief ld_mirror_add_index Indexes values of the attribute, existing entries are indexed immediately.
+ * @param[in] mirror          Mirror to add index to.
+ * @param[in] attribute       Attribute to index.
+ * @param[in] type            Type of the index.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_mirror_add_index(ld_mirror_t *mirror,
+                                             const char *attribute,
+                                             enum LdapMirrorIndexType type)
+{
+    if (!mirror || !attribute)
+    {
+        ld_error("ld_mirror_add_index - invalid mirror or attribute!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (mirror_find_index(mirror, attribute))
+    {
+        return RETURN_CODE_SUCCESS;
+    }
+
+    mirror_index_t *index = mirror_index_new(mirror, attribute, type);
+    if (!index)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    for (guint id = 0; id < mirror->records->len; ++id)
+    {
+        mirror_record_t *record = &g_array_index(mirror->records, mirror_record_t, id);
+        if (record->entry)
+        {
+            mirror_update_index(mirror, index, id, record->entry, true);
+        }
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief ld_mirror_set_partial_updates Sets whether modifications carry only changed attributes.
+ *
+ * DirSync reports only changed attributes, with partial updates attributes of modified entry
+ * are merged into stored entry instead of replacing it.
+ * @param[in] mirror                    Mirror to configure.
+ * @param[in] partial_updates           Merge modifications into stored entries.
+ */
+void ld_mirror_set_partial_updates(ld_mirror_t *mirror, bool partial_updates)
+{
+    if (!mirror)
+    {
+        ld_error("ld_mirror_set_partial_updates - invalid mirror!\n");
+        return;
+    }
+
+    mirror->partial_updates = partial_updates;
+}
+
+/**
+ * @brief mirror_take Removes entry from DN tree and indexes, entry is still owned by mirror.
+ * @return
+ *        - Removed entry.
+ *        - NULL if there is no entry with the DN.
+ */
+static ld_entry_t *mirror_take(ld_mirror_t *mirror, const char *dn)
+{
+    char *normalized = ld_dn_normalize(NULL, dn);
+    if (!normalized)
+    {
+        return NULL;
+    }
+
+    mirror_node_t *node = mirror_find_node(mirror, normalized, false);
+    talloc_free(normalized);
+
+    if (!node || node->id < 0)
+    {
+        return NULL;
+    }
+
+    guint id = (guint)node->id;
+    mirror_record_t *record = &g_array_index(mirror->records, mirror_record_t, id);
+    ld_entry_t *entry = record->entry;
+
+    mirror_update_indexes(mirror, id, entry, false);
+
+    record->entry = NULL;
+    record->node = NULL;
+    g_array_append_val(mirror->free_ids, id);
+
+    node->id = -1;
+    --mirror->count;
+    mirror_prune(mirror, node);
+
+    return entry;
+}
+
+/**
+ * @brief mirror_insert Stores entry owned by mirror, entry with the same DN is replaced.
+ * @param[in] mirror    Mirror to store entry in.
+ * @param[in] entry     Entry which is a child of the mirror, entry is freed on failure.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode mirror_insert(ld_mirror_t *mirror, ld_entry_t *entry)
+{
+    char *normalized = ld_dn_normalize(NULL, entry->dn);
+    if (!normalized)
+    {
+        talloc_unlink(mirror, entry);
+        return RETURN_CODE_FAILURE;
+    }
+
+    mirror_node_t *node = mirror_find_node(mirror, normalized, true);
+    talloc_free(normalized);
+
+    if (!node)
+    {
+        ld_error("mirror_insert - out of memory - unable to store entry!\n");
+        talloc_unlink(mirror, entry);
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (node->id >= 0)
+    {
+        mirror_record_t *record = &g_array_index(mirror->records, mirror_record_t, node->id);
+        ld_entry_t *previous = record->entry;
+
+        mirror_update_indexes(mirror, (guint)node->id, previous, false);
+        record->entry = entry;
+        mirror_update_indexes(mirror, (guint)node->id, entry, true);
+
+        talloc_unlink(mirror, previous);
+        return RETURN_CODE_SUCCESS;
+    }
+
+    guint id = 0;
+    if (mirror->free_ids->len > 0)
+    {
+        id = g_array_index(mirror->free_ids, guint, mirror->free_ids->len - 1);
+        g_array_set_size(mirror->free_ids, mirror->free_ids->len - 1);
+    }
+    else
+    {
+        id = mirror->records->len;
+        g_array_set_size(mirror->records, id + 1);
+    }
+
+    mirror_record_t *record = &g_array_index(mirror->records, mirror_record_t, id);
+    record->entry = entry;
+    record->node = node;
+    node->id = id;
+    ++mirror->count;
+
+    mirror_update_indexes(mirror, id, entry, true);
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief mirror_merge Moves attributes of update into entry replacing attributes with the same name.
+ */
+static void mirror_merge(ld_entry_t *entry, ld_entry_t *update)
+{
+    GHashTableIter iter;
+    gpointer value = NULL;
+
+    g_hash_table_iter_init(&iter, update->attributes);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        LDAPAttribute_t *attribute = value;
+        LDAPAttribute_t *previous = mirror_find_attribute(entry, attribute->name);
+
+        if (previous)
+        {
+            g_hash_table_remove(entry->attributes, previous->name);
+            if (talloc_parent(previous) == entry)
+            {
+                talloc_free(previous);
+            }
+        }
+
+        talloc_steal(entry, attribute);
+        g_hash_table_insert(entry->attributes, attribute->name, attribute);
+    }
+    g_hash_table_remove_all(update->attributes);
+
+    char *dn = talloc_strdup(entry, update->dn);
+    if (dn)
+    {
+        talloc_free(entry->dn);
+        entry->dn = dn;
+    }
+}
+
+static enum OperationReturnCode mirror_put(ld_mirror_t *mirror, ld_entry_t *entry, const char *old_dn, bool merge)
+{
+    talloc_steal(mirror, entry);
+
+    ld_entry_t *previous = old_dn || merge ? mirror_take(mirror, old_dn ? old_dn : entry->dn) : NULL;
+
+    if (previous && merge)
+    {
+        mirror_merge(previous, entry);
+        talloc_free(entry);
+        entry = previous;
+    }
+    else if (previous)
+    {
+        talloc_unlink(mirror, previous);
+    }
+
+    return mirror_insert(mirror, entry);
+}
+
+/**
+ * @brief ld_mirror_put Stores entry in mirror replacing entry with the same DN.
+ * @param[in] mirror     Mirror to store entry in.
+ * @param[in] entry      Entry to store, mirror takes ownership of it.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_mirror_put(ld_mirror_t *mirror, ld_entry_t *entry)
+{
+    if (!mirror || !entry)
+    {
+        ld_error("ld_mirror_put - invalid mirror or entry!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    return mirror_put(mirror, entry, NULL, false);
+}
+
+/**
+ * @brief ld_mirror_remove Removes entry from mirror.
+ * @param[in] mirror        Mirror to remove entry from.
+ * @param[in] dn            DN of the entry.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE if there is no such entry.
+ */
+enum OperationReturnCode ld_mirror_remove(ld_mirror_t *mirror, const char *dn)
+{
+    if (!mirror || !dn)
+    {
+        ld_error("ld_mirror_remove - invalid mirror or DN!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    ld_entry_t *entry = mirror_take(mirror, dn);
+    if (!entry)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    talloc_unlink(mirror, entry);
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief ld_mirror_sync_change Applies change reported by directory synchronization to the mirror.
+ *
+ * Function matches sync_change_callback_fn and expects mirror as user data.
+ * @param[in] connection           Connection synchronization runs on.
+ * @param[in] change               Type of the change.
+ * @param[in] dn                   DN of the entry.
+ * @param[in] old_dn               Previous DN of renamed entry.
+ * @param[in] entry                Entry received from server, mirror takes it.
+ * @param[in] user_data            Mirror.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_mirror_sync_change(struct ldap_connection_ctx_t *connection,
+                                               enum LdapSyncChangeType change,
+                                               const char *dn,
+                                               const char *old_dn,
+                                               ld_entry_t *entry,
+                                               void *user_data)
+{
+    (void)(connection);
+
+    ld_mirror_t *mirror = user_data;
+
+    if (!mirror)
+    {
+        ld_error("ld_mirror_sync_change - invalid mirror!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    switch (change)
+    {
+    case LD_SYNC_CHANGE_DELETE:
+        ld_mirror_remove(mirror, dn);
+        return RETURN_CODE_SUCCESS;
+    case LD_SYNC_CHANGE_ADD:
+    case LD_SYNC_CHANGE_MODIFY:
+    case LD_SYNC_CHANGE_RENAME:
+        if (!entry)
+        {
+            return RETURN_CODE_SUCCESS;
+        }
+        return mirror_put(mirror, entry, change == LD_SYNC_CHANGE_RENAME ? old_dn : NULL,
+                          change != LD_SYNC_CHANGE_ADD && mirror->partial_updates);
+    }
+
+    return RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief ld_mirror_lookup Finds entry by DN.
+ * @param[in] mirror        Mirror to search in.
+ * @param[in] ctx           Talloc ctx reference to the entry is attached to, release it with talloc_unlink.
+ * @param[in] dn            DN of the entry.
+ * @return
+ *        - Entry.
+ *        - NULL if there is no such entry.
+ */
+ld_entry_t *ld_mirror_lookup(ld_mirror_t *mirror, TALLOC_CTX *ctx, const char *dn)
+{
+    if (!mirror || !dn)
+    {
+        ld_error("ld_mirror_lookup - invalid mirror or DN!\n");
+        return NULL;
+    }
+
+    char *normalized = ld_dn_normalize(NULL, dn);
+    if (!normalized)
+    {
+        return NULL;
+    }
+
+    mirror_node_t *node = mirror_find_node(mirror, normalized, false);
+    talloc_free(normalized);
+
+    if (!node || node->id < 0)
+    {
+        return NULL;
+    }
+
+    ld_entry_t *entry = g_array_index(mirror->records, mirror_record_t, node->id).entry;
+
+    return talloc_reference(ctx, entry) ? entry : NULL;
+}
+
+static gint mirror_compare_ids(gconstpointer first, gconstpointer second)
+{
+    guint a = *(const guint *)first;
+    guint b = *(const guint *)second;
+
+    return a < b ? -1 : a > b ? 1 : 0;
+}
+
+static GArray *mirror_copy_posting(GArray *posting)
+{
+    GArray *result = g_array_sized_new(FALSE, FALSE, sizeof(guint), posting ? posting->len : 0);
+
+    if (posting)
+    {
+        g_array_append_vals(result, posting->data, posting->len);
+    }
+
+    return result;
+}
+
+/**
+ * @brief mirror_sort_unique Sorts identifiers collected from several postings and removes duplicates.
+ */
+static void mirror_sort_unique(GArray *ids)
+{
+    if (ids->len < 2)
+    {
+        return;
+    }
+
+    g_array_sort(ids, mirror_compare_ids);
+
+    guint out = 1;
+    for (guint i = 1; i < ids->len; ++i)
+    {
+        if (g_array_index(ids, guint, i) != g_array_index(ids, guint, out - 1))
+        {
+            g_array_index(ids, guint, out++) = g_array_index(ids, guint, i);
+        }
+    }
+    g_array_set_size(ids, out);
+}
+
+static GArray *mirror_intersect(GArray *first, GArray *second)
+{
+    GArray *result = g_array_sized_new(FALSE, FALSE, sizeof(guint), MIN(first->len, second->len));
+    guint i = 0;
+    guint j = 0;
+
+    while (i < first->len && j < second->len)
+    {
+        guint a = g_array_index(first, guint, i);
+        guint b = g_array_index(second, guint, j);
+
+        if (a == b)
+        {
+            g_array_append_val(result, a);
+            ++i;
+            ++j;
+        }
+        else if (a < b)
+        {
+            ++i;
+        }
+        else
+        {
+            ++j;
+        }
+    }
+
+    g_array_free(first, TRUE);
+    g_array_free(second, TRUE);
+
+    return result;
+}
+
+static gint mirror_compare_keys(gconstpointer first, gconstpointer second, gpointer user_data)
+{
+    const mirror_index_t *index = user_data;
+
+    return filter_compare_keys(index->rule, *(const char * const *)first, *(const char * const *)second);
+}
+
+static GPtrArray *mirror_sorted_keys(mirror_index_t *index)
+{
+    if (index->dirty)
+    {
+        GHashTableIter iter;
+        gpointer key = NULL;
+
+        g_ptr_array_set_size(index->sorted, 0);
+        g_hash_table_iter_init(&iter, index->postings);
+        while (g_hash_table_iter_next(&iter, &key, NULL))
+        {
+            g_ptr_array_add(index->sorted, key);
+        }
+        g_ptr_array_sort_with_data(index->sorted, mirror_compare_keys, index);
+
+        index->dirty = false;
+    }
+
+    return index->sorted;
+}
+
+/**
+ * @brief mirror_lower_bound Finds first key which is not less than the value.
+ */
+static guint mirror_lower_bound(mirror_index_t *index, GPtrArray *keys, const char *value, bool prefix)
+{
+    guint low = 0;
+    guint high = keys->len;
+
+    while (low < high)
+    {
+        guint middle = low + (high - low) / 2;
+        const char *key = g_ptr_array_index(keys, middle);
+        int compare = prefix ? strcmp(key, value) : filter_compare_keys(index->rule, key, value);
+
+        if (compare < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+static GArray *mirror_collect_range(mirror_index_t *index, guint start, guint end)
+{
+    GPtrArray *keys = index->sorted;
+    GArray *result = g_array_new(FALSE, FALSE, sizeof(guint));
+
+    for (guint i = start; i < end; ++i)
+    {
+        GArray *posting = g_hash_table_lookup(index->postings, g_ptr_array_index(keys, i));
+        g_array_append_vals(result, posting->data, posting->len);
+    }
+    mirror_sort_unique(result);
+
+    return result;
+}
+
+static GArray *mirror_plan_item(ld_mirror_t *mirror, const ld_filter_t *filter)
+{
+    mirror_index_t *index = mirror_find_index(mirror, filter->attribute);
+    GArray *result = NULL;
+
+    if (!index)
+    {
+        return NULL;
+    }
+
+    switch (filter->type)
+    {
+    case LD_FILTER_EQUALITY:
+    case LD_FILTER_APPROX:
+    {
+        char *key = filter_normalize_key(NULL, mirror->schema, index->rule, filter->value.data, true);
+        result = mirror_copy_posting(key ? g_hash_table_lookup(index->postings, key) : NULL);
+        talloc_free(key);
+        return result;
+    }
+    case LD_FILTER_PRESENT:
+    {
+        GHashTableIter iter;
+        gpointer value = NULL;
+
+        result = g_array_new(FALSE, FALSE, sizeof(guint));
+        g_hash_table_iter_init(&iter, index->postings);
+        while (g_hash_table_iter_next(&iter, NULL, &value))
+        {
+            g_array_append_vals(result, ((GArray *)value)->data, ((GArray *)value)->len);
+        }
+        mirror_sort_unique(result);
+        return result;
+    }
+    case LD_FILTER_GREATER_OR_EQUAL:
+    case LD_FILTER_LESS_OR_EQUAL:
+    {
+        if (index->type != LD_MIRROR_INDEX_ORDERED || index->rule == FILTER_RULE_DN || index->rule == FILTER_RULE_OID)
+        {
+            return NULL;
+        }
+
+        char *key = filter_normalize_key(NULL, mirror->schema, index->rule, filter->value.data, true);
+        if (!key)
+        {
+            return g_array_new(FALSE, FALSE, sizeof(guint));
+        }
+
+        GPtrArray *keys = mirror_sorted_keys(index);
+        guint bound = mirror_lower_bound(index, keys, key, false);
+
+        if (filter->type == LD_FILTER_GREATER_OR_EQUAL)
+        {
+            result = mirror_collect_range(index, bound, keys->len);
+        }
+        else
+        {
+            // Include the key equal to assertion value.
+            if (bound < keys->len && filter_compare_keys(index->rule, g_ptr_array_index(keys, bound), key) == 0)
+            {
+                ++bound;
+            }
+            result = mirror_collect_range(index, 0, bound);
+        }
+
+        talloc_free(key);
+        return result;
+    }
+    case LD_FILTER_SUBSTRINGS:
+    {
+        if (index->type != LD_MIRROR_INDEX_ORDERED || !filter->initial
+            || (index->rule != FILTER_RULE_CASE_IGNORE && index->rule != FILTER_RULE_CASE_EXACT
+                && index->rule != FILTER_RULE_NUMERIC_STRING && index->rule != FILTER_RULE_OCTET_STRING))
+        {
+            return NULL;
+        }
+
+        char *prefix = filter_normalize_key(NULL, mirror->schema, index->rule, filter->initial->data, false);
+        if (!prefix)
+        {
+            return NULL;
+        }
+
+        // Keys of string rules are sorted by strcmp, keys with common prefix are adjacent.
+        GPtrArray *keys = mirror_sorted_keys(index);
+        size_t prefix_len = strlen(prefix);
+        guint start = mirror_lower_bound(index, keys, prefix, true);
+        guint end = start;
+        while (end < keys->len && strncmp(g_ptr_array_index(keys, end), prefix, prefix_len) == 0)
+        {
+            ++end;
+        }
+
+        talloc_free(prefix);
+        return mirror_collect_range(index, start, end);
+    }
+    default:
+        return NULL;
+    }
+}
+
+/**
+ * @brief mirror_plan Selects candidate entries for the filter with indexes.
+ * @return
+ *        - Sorted identifiers of entries which may match the filter.
+ *        - NULL if filter can't be answered with indexes and all entries must be checked.
+ */
+static GArray *mirror_plan(ld_mirror_t *mirror, const ld_filter_t *filter)
+{
+    GArray *result = NULL;
+
+    switch (filter->type)
+    {
+    case LD_FILTER_AND:
+        for (unsigned int i = 0; i < filter->n_children; ++i)
+        {
+            GArray *candidates = mirror_plan(mirror, filter->children[i]);
+            if (candidates)
+            {
+                result = result ? mirror_intersect(result, candidates) : candidates;
+            }
+        }
+        return result;
+    case LD_FILTER_OR:
+        result = g_array_new(FALSE, FALSE, sizeof(guint));
+        for (unsigned int i = 0; i < filter->n_children; ++i)
+        {
+            GArray *candidates = mirror_plan(mirror, filter->children[i]);
+            if (!candidates)
+            {
+                g_array_free(result, TRUE);
+                return NULL;
+            }
+            g_array_append_vals(result, candidates->data, candidates->len);
+            g_array_free(candidates, TRUE);
+        }
+        mirror_sort_unique(result);
+        return result;
+    case LD_FILTER_NOT:
+        return NULL;
+    default:
+        return mirror_plan_item(mirror, filter);
+    }
+}
+
+static bool mirror_in_scope(const mirror_node_t *node, const mirror_node_t *base, int scope)
+{
+    switch (scope)
+    {
+    case LDAP_SCOPE_BASE:
+        return node == base;
+    case LDAP_SCOPE_ONELEVEL:
+        return node->parent == base;
+    default:
+        while (node && node->depth > base->depth)
+        {
+            node = node->parent;
+        }
+        return node == base;
+    }
+}
+
+/*!
+ * @brief mirror_search_t - State of the search.
+ */
+typedef struct mirror_search_s
+{
+    ld_mirror_t *mirror;                //!< Mirror to search in.
+    const ld_filter_program_t *program; //!< Compiled filter.
+    GPtrArray *entries;                 //!< Matching entries.
+    guint sizelimit;                    //!< Maximum amount of entries, 0 if unlimited.
+} mirror_search_t;
+
+static bool mirror_search_check(mirror_search_t *search, gint64 id)
+{
+    if (id < 0)
+    {
+        return true;
+    }
+
+    ld_entry_t *entry = g_array_index(search->mirror->records, mirror_record_t, id).entry;
+    if (ld_filter_match(search->program, entry))
+    {
+        g_ptr_array_add(search->entries, entry);
+    }
+
+    return !search->sizelimit || search->entries->len < search->sizelimit;
+}
+
+static bool mirror_search_subtree(mirror_search_t *search, mirror_node_t *node)
+{
+    if (!mirror_search_check(search, node->id))
+    {
+        return false;
+    }
+
+    if (node->children)
+    {
+        GHashTableIter iter;
+        gpointer value = NULL;
+
+        g_hash_table_iter_init(&iter, node->children);
+        while (g_hash_table_iter_next(&iter, NULL, &value))
+        {
+            if (!mirror_search_subtree(search, value))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief ld_mirror_search Searches entries of the mirror like search() does on the server.
+ *
+ * Equality, presence, ordering and initial substring assertions on indexed attributes select candidate
+ * entries, candidates of AND are intersected. Candidates are checked against the whole filter,
+ * without usable index entries in scope are scanned.
+ * @param[in] mirror        Mirror to search in.
+ * @param[in] ctx           Talloc ctx to allocate result with, result holds references to entries.
+ * @param[in] base_dn       Base of the search.
+ * @param[in] scope         LDAP_SCOPE_BASE, LDAP_SCOPE_ONELEVEL or LDAP_SCOPE_SUBTREE.
+ * @param[in] filter        Filter of the search.
+ * @param[in] sizelimit     Maximum amount of entries to return, 0 if unlimited.
+ * @param[out] count        Amount of entries found, may be NULL.
+ * @return
+ *        - NULL terminated array of entries.
+ *        - NULL if filter is invalid or on failure.
+ */
+ld_entry_t **ld_mirror_search(ld_mirror_t *mirror,
+                              TALLOC_CTX *ctx,
+                              const char *base_dn,
+                              int scope,
+                              const char *filter,
+                              int sizelimit,
+                              unsigned int *count)
+{
+    ld_entry_t **result = NULL;
+    GArray *candidates = NULL;
+    mirror_search_t search = { .mirror = mirror, .sizelimit = sizelimit > 0 ? (guint)sizelimit : 0 };
+
+    if (!mirror || !filter)
+    {
+        ld_error("ld_mirror_search - invalid mirror or filter!\n");
+        return NULL;
+    }
+
+    TALLOC_CTX *tmp = talloc_new(NULL);
+    if (!tmp)
+    {
+        ld_error("ld_mirror_search - out of memory!\n");
+        return NULL;
+    }
+
+    ld_filter_t *parsed = ld_filter_parse(tmp, filter);
+    search.program = parsed ? ld_filter_compile(tmp, parsed, mirror->schema) : NULL;
+    char *normalized = ld_dn_normalize(tmp, base_dn ? base_dn : "");
+
+    if (!search.program || !normalized)
+    {
+        goto error_exit;
+    }
+
+    search.entries = g_ptr_array_new();
+
+    mirror_node_t *base = mirror_find_node(mirror, normalized, false);
+    if (base)
+    {
+        candidates = scope == LDAP_SCOPE_BASE ? NULL : mirror_plan(mirror, parsed);
+
+        if (scope == LDAP_SCOPE_BASE)
+        {
+            mirror_search_check(&search, base->id);
+        }
+        else if (candidates)
+        {
+            for (guint i = 0; i < candidates->len; ++i)
+            {
+                const mirror_record_t *record = &g_array_index(mirror->records, mirror_record_t,
+                                                               g_array_index(candidates, guint, i));
+                if (mirror_in_scope(record->node, base, scope)
+                    && !mirror_search_check(&search, g_array_index(candidates, guint, i)))
+                {
+                    break;
+                }
+            }
+            g_array_free(candidates, TRUE);
+        }
+        else if (scope == LDAP_SCOPE_ONELEVEL && base->children)
+        {
+            GHashTableIter iter;
+            gpointer value = NULL;
+
+            g_hash_table_iter_init(&iter, base->children);
+            while (g_hash_table_iter_next(&iter, NULL, &value)
+                   && mirror_search_check(&search, ((mirror_node_t *)value)->id))
+            {
+            }
+        }
+        else if (scope != LDAP_SCOPE_ONELEVEL)
+        {
+            mirror_search_subtree(&search, base);
+        }
+    }
+
+    ld_talloc_array(result, error_exit, ctx, ld_entry_t*, search.entries->len + 1);
+    for (guint i = 0; i < search.entries->len; ++i)
+    {
+        result[i] = g_ptr_array_index(search.entries, i);
+        if (!talloc_reference(result, result[i]))
+        {
+            ld_error("ld_mirror_search - out of memory - unable to reference entry!\n");
+            goto error_exit;
+        }
+    }
+    result[search.entries->len] = NULL;
+
+    if (count)
+    {
+        *count = search.entries->len;
+    }
+
+    g_ptr_array_free(search.entries, TRUE);
+    talloc_free(tmp);
+
+    return result;
+
+    error_exit:
+        if (search.entries)
+        {
+            g_ptr_array_free(search.entries, TRUE);
+        }
+        talloc_free(result);
+        talloc_free(tmp);
+        return NULL;
+}
+
+/**
+ * @brief ld_mirror_count Returns amount of entries in mirror.
+ */
+unsigned int ld_mirror_count(const ld_mirror_t *mirror)
+{
+    return mirror ? mirror->count : 0;
+}
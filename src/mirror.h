@@ -0,0 +1,68 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_MIRROR_H
+#define LIBDOMAIN_MIRROR_H
+
+#include "common.h"
+#include "directory_sync.h"
+
+#include <stdbool.h>
+
+enum LdapMirrorIndexType
+{
+    LD_MIRROR_INDEX_EQUALITY = 1,       //!< Hash index answering equality and presence assertions.
+    LD_MIRROR_INDEX_ORDERED  = 2,       //!< Sorted index answering ordering and initial substring assertions too.
+};
+
+typedef struct ld_mirror_s ld_mirror_t;
+typedef struct ldap_schema_t ldap_schema_t;
+
+ld_mirror_t *ld_mirror_new(TALLOC_CTX *ctx, const ldap_schema_t *schema);
+
+enum OperationReturnCode ld_mirror_add_index(ld_mirror_t *mirror,
+                                             const char *attribute,
+                                             enum LdapMirrorIndexType type);
+void ld_mirror_set_partial_updates(ld_mirror_t *mirror, bool partial_updates);
+
+enum OperationReturnCode ld_mirror_put(ld_mirror_t *mirror, ld_entry_t *entry);
+enum OperationReturnCode ld_mirror_remove(ld_mirror_t *mirror, const char *dn);
+enum OperationReturnCode ld_mirror_sync_change(struct ldap_connection_ctx_t *connection,
+                                               enum LdapSyncChangeType change,
+                                               const char *dn,
+                                               const char *old_dn,
+                                               ld_entry_t *entry,
+                                               void *user_data);
+
+ld_entry_t *ld_mirror_lookup(ld_mirror_t *mirror, TALLOC_CTX *ctx, const char *dn);
+ld_entry_t **ld_mirror_search(ld_mirror_t *mirror,
+                              TALLOC_CTX *ctx,
+                              const char *base_dn,
+                              int scope,
+                              const char *filter,
+                              int sizelimit,
+                              unsigned int *count);
+
+unsigned int ld_mirror_count(const ld_mirror_t *mirror);
+
+enum OperationReturnCode ld_mirror_save(ld_mirror_t *mirror, ld_sync_t *sync, const char *path);
+ld_mirror_t *ld_mirror_load(TALLOC_CTX *ctx, const ldap_schema_t *schema, const char *path, ld_sync_t *sync);
+
+#endif //LIBDOMAIN_MIRROR_H
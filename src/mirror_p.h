@@ -0,0 +1,83 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_MIRROR_PRIVATE_H
+#define LIBDOMAIN_MIRROR_PRIVATE_H
+
+#include "mirror.h"
+#include "filter_match_p.h"
+
+#include <glib-2.0/glib.h>
+
+typedef struct mirror_node_s mirror_node_t;
+
+/*!
+ * @brief mirror_node_t - Node of the DN tree, one node per RDN.
+ */
+struct mirror_node_s
+{
+    char *rdn;                          //!< Canonical RDN of the node.
+    mirror_node_t *parent;              //!< Parent node, NULL for the root.
+    GHashTable *children;               //!< Child nodes by canonical RDN, NULL if node has no children yet.
+    unsigned int depth;                 //!< Amount of RDNs in DN of the node.
+    gint64 id;                          //!< Identifier of the entry stored at the node, -1 if there is none.
+};
+
+/*!
+ * @brief mirror_record_t - Slot of the entry table.
+ */
+typedef struct mirror_record_s
+{
+    ld_entry_t *entry;                  //!< Entry, NULL if slot is free.
+    mirror_node_t *node;                //!< Node of the entry in DN tree.
+} mirror_record_t;
+
+/*!
+ * @brief mirror_index_t - Index of attribute values.
+ */
+typedef struct mirror_index_s
+{
+    char *attribute;                    //!< Indexed attribute.
+    enum LdapMirrorIndexType type;      //!< Type of the index.
+    enum FilterRule rule;               //!< Equality matching rule of the attribute.
+    GHashTable *postings;               //!< Sorted arrays of entry identifiers by normalized value.
+    GPtrArray *sorted;                  //!< Normalized values in order of matching rule, ordered index only.
+    bool dirty;                         //!< Values have been added or removed since values were sorted.
+} mirror_index_t;
+
+/*!
+ * @brief ld_mirror_t - Local copy of directory entries with indexes.
+ */
+struct ld_mirror_s
+{
+    const ldap_schema_t *schema;        //!< Schema used to resolve matching rules, may be NULL.
+    mirror_node_t *root;                //!< Root of DN tree.
+    GArray *records;                    //!< Entries by identifier.
+    GArray *free_ids;                   //!< Identifiers of free slots.
+    unsigned int count;                 //!< Amount of entries.
+    GHashTable *indexes;                //!< Indexes by lower cased attribute name.
+    bool partial_updates;               //!< Modifications carry only changed attributes.
+};
+
+void mirror_posting_free(gpointer data);
+enum OperationReturnCode mirror_insert(ld_mirror_t *mirror, ld_entry_t *entry);
+mirror_index_t *mirror_index_new(ld_mirror_t *mirror, const char *attribute, enum LdapMirrorIndexType type);
+
+#endif //LIBDOMAIN_MIRROR_PRIVATE_H
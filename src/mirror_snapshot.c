@@ -0,0 +1,761 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "mirror.h"
+#include "mirror_p.h"
+
+#include "directory_sync.h"
+#include "domain.h"
+#include "entry.h"
+#include "entry_p.h"
+
+#include "helper_p.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib-2.0/glib.h>
+
+#define MIRROR_SNAPSHOT_MAGIC "LDMIRROR"
+#define MIRROR_SNAPSHOT_VERSION 1
+#define MIRROR_SNAPSHOT_BYTE_ORDER 0x01020304
+#define MIRROR_SNAPSHOT_ALIGNMENT 8
+
+#define MIRROR_SNAPSHOT_PARTIAL_UPDATES 0x00000001
+
+/*!
+ * @brief snapshot_section_t - Location of the table in snapshot file.
+ */
+typedef struct snapshot_section_s
+{
+    uint64_t offset;                    //!< Offset of the table from the start of the file.
+    uint64_t count;                     //!< Amount of elements, bytes for string arena and state.
+} snapshot_section_t;
+
+/*!
+ * @brief snapshot_header_t - Header of snapshot file.
+ *
+ * Snapshot is a set of tables which refer to each other by element numbers and to strings by offsets
+ * in the string arena. All numbers are in host byte order, every table is aligned to 8 bytes,
+ * so tables can be read directly from the file mapped into memory.
+ */
+typedef struct snapshot_header_s
+{
+    char magic[8];                      //!< MIRROR_SNAPSHOT_MAGIC without terminating zero.
+    uint32_t version;                   //!< Version of the format.
+    uint32_t byte_order;                //!< MIRROR_SNAPSHOT_BYTE_ORDER as written by host.
+    uint64_t file_size;                 //!< Size of the file, protects against truncation.
+    uint32_t flags;                     //!< Mirror settings.
+    uint32_t reserved;                  //!< Always zero.
+    snapshot_section_t strings;         //!< Arena of zero terminated strings, every string is stored once.
+    snapshot_section_t names;           //!< Interned attribute names, offsets in string arena.
+    snapshot_section_t entries;         //!< Entries, snapshot_entry_t.
+    snapshot_section_t attributes;      //!< Attributes of entries, snapshot_attribute_t.
+    snapshot_section_t values;          //!< Attribute values, offsets in string arena.
+    snapshot_section_t indexes;         //!< Indexes, snapshot_index_t.
+    snapshot_section_t keys;            //!< Normalized values of indexes, snapshot_key_t.
+    snapshot_section_t ids;             //!< Posting lists, numbers of entries.
+    snapshot_section_t state;           //!< State of synchronization session, see ld_sync_export_state.
+} snapshot_header_t;
+
+typedef struct snapshot_entry_s
+{
+    uint64_t dn;                        //!< Offset of DN in string arena.
+    uint64_t first_attribute;           //!< Number of the first attribute.
+    uint64_t attribute_count;           //!< Amount of attributes.
+} snapshot_entry_t;
+
+typedef struct snapshot_attribute_s
+{
+    uint64_t name;                      //!< Number of interned name.
+    uint64_t first_value;               //!< Number of the first value.
+    uint64_t value_count;               //!< Amount of values.
+} snapshot_attribute_t;
+
+typedef struct snapshot_index_s
+{
+    uint64_t attribute;                 //!< Offset of attribute name in string arena.
+    uint32_t type;                      //!< LdapMirrorIndexType.
+    uint32_t rule;                      //!< Matching rule keys have been normalized with.
+    uint64_t first_key;                 //!< Number of the first key.
+    uint64_t key_count;                 //!< Amount of keys.
+} snapshot_index_t;
+
+typedef struct snapshot_key_s
+{
+    uint64_t key;                       //!< Offset of normalized value in string arena.
+    uint64_t first_id;                  //!< Number of the first element of posting list.
+    uint64_t id_count;                  //!< Length of posting list.
+} snapshot_key_t;
+
+/*!
+ * @brief snapshot_writer_t - Tables of snapshot being built.
+ */
+typedef struct snapshot_writer_s
+{
+    GByteArray *strings;
+    GHashTable *string_offsets;         //!< Offsets of strings already stored in arena.
+    GArray *names;
+    GHashTable *name_numbers;           //!< Numbers of interned attribute names.
+    GArray *entries;
+    GArray *attributes;
+    GArray *values;
+    GArray *indexes;
+    GArray *keys;
+    GArray *ids;
+} snapshot_writer_t;
+
+static uint64_t snapshot_intern_string(snapshot_writer_t *writer, const char *value)
+{
+    gpointer offset = NULL;
+
+    if (g_hash_table_lookup_extended(writer->string_offsets, value, NULL, &offset))
+    {
+        return (uint64_t)GPOINTER_TO_SIZE(offset);
+    }
+
+    uint64_t result = writer->strings->len;
+    g_byte_array_append(writer->strings, (const guint8 *)value, strlen(value) + 1);
+    g_hash_table_insert(writer->string_offsets, g_strdup(value), GSIZE_TO_POINTER(result));
+
+    return result;
+}
+
+static uint64_t snapshot_intern_name(snapshot_writer_t *writer, const char *name)
+{
+    gpointer number = NULL;
+
+    if (g_hash_table_lookup_extended(writer->name_numbers, name, NULL, &number))
+    {
+        return (uint64_t)GPOINTER_TO_SIZE(number);
+    }
+
+    uint64_t result = writer->names->len;
+    uint64_t offset = snapshot_intern_string(writer, name);
+    g_array_append_val(writer->names, offset);
+    g_hash_table_insert(writer->name_numbers, g_strdup(name), GSIZE_TO_POINTER(result));
+
+    return result;
+}
+
+static void snapshot_writer_free(snapshot_writer_t *writer)
+{
+    g_byte_array_free(writer->strings, TRUE);
+    g_hash_table_destroy(writer->string_offsets);
+    g_array_free(writer->names, TRUE);
+    g_hash_table_destroy(writer->name_numbers);
+    g_array_free(writer->entries, TRUE);
+    g_array_free(writer->attributes, TRUE);
+    g_array_free(writer->values, TRUE);
+    g_array_free(writer->indexes, TRUE);
+    g_array_free(writer->keys, TRUE);
+    g_array_free(writer->ids, TRUE);
+}
+
+/**
+ * @brief snapshot_collect Fills tables of the snapshot with entries and indexes of the mirror.
+ * @param[in] mirror       Mirror to take entries from.
+ * @param[in] writer       Tables to fill.
+ */
+static void snapshot_collect(ld_mirror_t *mirror, snapshot_writer_t *writer)
+{
+    // Entries are numbered in the order of identifiers, so posting lists stay sorted after renumbering.
+    guint *numbers = g_new0(guint, mirror->records->len + 1);
+
+    for (guint id = 0; id < mirror->records->len; ++id)
+    {
+        ld_entry_t *entry = g_array_index(mirror->records, mirror_record_t, id).entry;
+        if (!entry)
+        {
+            continue;
+        }
+
+        numbers[id] = writer->entries->len;
+
+        snapshot_entry_t record = { snapshot_intern_string(writer, entry->dn), writer->attributes->len, 0 };
+
+        GHashTableIter iter;
+        gpointer value = NULL;
+
+        g_hash_table_iter_init(&iter, entry->attributes);
+        while (g_hash_table_iter_next(&iter, NULL, &value))
+        {
+            LDAPAttribute_t *attribute = value;
+            snapshot_attribute_t item = { snapshot_intern_name(writer, attribute->name), writer->values->len, 0 };
+
+            for (int i = 0; attribute->values && attribute->values[i]; ++i)
+            {
+                uint64_t offset = snapshot_intern_string(writer, attribute->values[i]);
+                g_array_append_val(writer->values, offset);
+                ++item.value_count;
+            }
+
+            g_array_append_val(writer->attributes, item);
+            ++record.attribute_count;
+        }
+
+        g_array_append_val(writer->entries, record);
+    }
+
+    GHashTableIter iter;
+    gpointer value = NULL;
+
+    g_hash_table_iter_init(&iter, mirror->indexes);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        mirror_index_t *index = value;
+        snapshot_index_t item = { snapshot_intern_string(writer, index->attribute), index->type, index->rule,
+                                  writer->keys->len, 0 };
+
+        GHashTableIter posting_iter;
+        gpointer key = NULL;
+        gpointer posting = NULL;
+
+        g_hash_table_iter_init(&posting_iter, index->postings);
+        while (g_hash_table_iter_next(&posting_iter, &key, &posting))
+        {
+            GArray *identifiers = posting;
+            snapshot_key_t record = { snapshot_intern_string(writer, key), writer->ids->len, identifiers->len };
+
+            for (guint i = 0; i < identifiers->len; ++i)
+            {
+                uint32_t number = numbers[g_array_index(identifiers, guint, i)];
+                g_array_append_val(writer->ids, number);
+            }
+
+            g_array_append_val(writer->keys, record);
+            ++item.key_count;
+        }
+
+        g_array_append_val(writer->indexes, item);
+    }
+
+    g_free(numbers);
+}
+
+static bool snapshot_write_section(FILE *file, snapshot_section_t *section, uint64_t *offset,
+                                   const void *data, uint64_t count, size_t element_size)
+{
+    static const char padding[MIRROR_SNAPSHOT_ALIGNMENT] = { 0 };
+    uint64_t size = count * element_size;
+    uint64_t aligned = (size + MIRROR_SNAPSHOT_ALIGNMENT - 1) & ~(uint64_t)(MIRROR_SNAPSHOT_ALIGNMENT - 1);
+
+    section->offset = *offset;
+    section->count = count;
+    *offset += aligned;
+
+    if (!file)
+    {
+        return true;
+    }
+
+    return (size == 0 || fwrite(data, 1, size, file) == size)
+           && (aligned == size || fwrite(padding, 1, aligned - size, file) == aligned - size);
+}
+
+/**
+ * @brief snapshot_write_sections Lays out tables after the header and writes them when file is given.
+ * @param[in] file           File to write to, NULL to compute layout only.
+ * @param[in] header         Header to fill with locations of tables.
+ * @param[in] writer         Tables to write.
+ * @param[in] state          Synchronization state, may be NULL.
+ * @param[in] state_length   Length of synchronization state.
+ * @return
+ *        - true on success.
+ *        - false on write error.
+ */
+static bool snapshot_write_sections(FILE *file, snapshot_header_t *header, snapshot_writer_t *writer,
+                                    const char *state, size_t state_length)
+{
+    uint64_t offset = sizeof(snapshot_header_t);
+
+    bool result = snapshot_write_section(file, &header->strings, &offset, writer->strings->data,
+                                         writer->strings->len, 1)
+               && snapshot_write_section(file, &header->names, &offset, writer->names->data,
+                                         writer->names->len, sizeof(uint64_t))
+               && snapshot_write_section(file, &header->entries, &offset, writer->entries->data,
+                                         writer->entries->len, sizeof(snapshot_entry_t))
+               && snapshot_write_section(file, &header->attributes, &offset, writer->attributes->data,
+                                         writer->attributes->len, sizeof(snapshot_attribute_t))
+               && snapshot_write_section(file, &header->values, &offset, writer->values->data,
+                                         writer->values->len, sizeof(uint64_t))
+               && snapshot_write_section(file, &header->indexes, &offset, writer->indexes->data,
+                                         writer->indexes->len, sizeof(snapshot_index_t))
+               && snapshot_write_section(file, &header->keys, &offset, writer->keys->data,
+                                         writer->keys->len, sizeof(snapshot_key_t))
+               && snapshot_write_section(file, &header->ids, &offset, writer->ids->data,
+                                         writer->ids->len, sizeof(uint32_t))
+               && snapshot_write_section(file, &header->state, &offset, state, state_length, 1);
+
+    header->file_size = offset;
+
+    return result;
+}
+
+/**
+ * @brief ld_mirror_save Writes snapshot of the mirror to file.
+ *
+ * Snapshot holds entries, indexes and state of synchronization session the mirror is fed by,
+ * so after restart ld_mirror_load restores both and synchronization continues incrementally.
+ * File is replaced atomically.
+ * @param[in] mirror       Mirror to save.
+ * @param[in] sync         Synchronization session feeding the mirror, may be NULL.
+ * @param[in] path         File to write snapshot to.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_mirror_save(ld_mirror_t *mirror, ld_sync_t *sync, const char *path)
+{
+    char *temporary_file = NULL;
+    char *state = NULL;
+    size_t state_length = 0;
+    FILE *file = NULL;
+
+    if (!mirror || !path)
+    {
+        ld_error("ld_mirror_save - invalid mirror or path!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (sync && ld_sync_in_progress(sync))
+    {
+        ld_error("ld_mirror_save - synchronization cycle is running, cookie does not match mirror!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    snapshot_writer_t writer =
+    {
+        .strings = g_byte_array_new(),
+        .string_offsets = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL),
+        .names = g_array_new(FALSE, FALSE, sizeof(uint64_t)),
+        .name_numbers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL),
+        .entries = g_array_new(FALSE, FALSE, sizeof(snapshot_entry_t)),
+        .attributes = g_array_new(FALSE, FALSE, sizeof(snapshot_attribute_t)),
+        .values = g_array_new(FALSE, FALSE, sizeof(uint64_t)),
+        .indexes = g_array_new(FALSE, FALSE, sizeof(snapshot_index_t)),
+        .keys = g_array_new(FALSE, FALSE, sizeof(snapshot_key_t)),
+        .ids = g_array_new(FALSE, FALSE, sizeof(uint32_t)),
+    };
+
+    // Offset 0 is the empty string, so arena is never empty.
+    snapshot_intern_string(&writer, "");
+    snapshot_collect(mirror, &writer);
+
+    if (sync)
+    {
+        state = ld_sync_export_state(NULL, sync, &state_length);
+        if (!state)
+        {
+            goto error_exit;
+        }
+    }
+
+    snapshot_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MIRROR_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = MIRROR_SNAPSHOT_VERSION;
+    header.byte_order = MIRROR_SNAPSHOT_BYTE_ORDER;
+    header.flags = mirror->partial_updates ? MIRROR_SNAPSHOT_PARTIAL_UPDATES : 0;
+    snapshot_write_sections(NULL, &header, &writer, state, state_length);
+
+    ld_talloc_asprintf(temporary_file, error_exit, NULL, "%s.tmp", path);
+
+    file = fopen(temporary_file, "w");
+    if (!file)
+    {
+        ld_error("ld_mirror_save - unable to open %s: %s\n", temporary_file, strerror(errno));
+        goto error_exit;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1
+        || !snapshot_write_sections(file, &header, &writer, state, state_length))
+    {
+        ld_error("ld_mirror_save - unable to write %s: %s\n", temporary_file, strerror(errno));
+        goto error_exit;
+    }
+
+    int rc = fclose(file);
+    file = NULL;
+
+    if (rc != 0 || rename(temporary_file, path) != 0)
+    {
+        ld_error("ld_mirror_save - unable to write %s: %s\n", path, strerror(errno));
+        goto error_exit;
+    }
+
+    snapshot_writer_free(&writer);
+    talloc_free(temporary_file);
+    talloc_free(state);
+
+    return RETURN_CODE_SUCCESS;
+
+    error_exit:
+        if (file)
+        {
+            fclose(file);
+        }
+        if (temporary_file)
+        {
+            unlink(temporary_file);
+            talloc_free(temporary_file);
+        }
+        snapshot_writer_free(&writer);
+        talloc_free(state);
+        return RETURN_CODE_FAILURE;
+}
+
+/*!
+ * @brief snapshot_reader_t - Snapshot mapped into memory.
+ */
+typedef struct snapshot_reader_s
+{
+    const char *data;                   //!< Start of the mapping.
+    const snapshot_header_t *header;    //!< Header of the snapshot.
+    const char *strings;                //!< String arena.
+    const uint64_t *names;              //!< Interned attribute names.
+    const snapshot_entry_t *entries;    //!< Entries.
+    const snapshot_attribute_t *attributes;
+    const uint64_t *values;
+    const snapshot_index_t *indexes;
+    const snapshot_key_t *keys;
+    const uint32_t *ids;
+} snapshot_reader_t;
+
+static bool snapshot_check_section(const snapshot_header_t *header, const snapshot_section_t *section,
+                                   size_t element_size)
+{
+    return section->offset % MIRROR_SNAPSHOT_ALIGNMENT == 0
+           && section->offset >= sizeof(snapshot_header_t)
+           && section->offset <= header->file_size
+           && section->count <= (header->file_size - section->offset) / element_size;
+}
+
+static bool snapshot_check_range(uint64_t first, uint64_t count, uint64_t total)
+{
+    return first <= total && count <= total - first;
+}
+
+static const char *snapshot_string(const snapshot_reader_t *reader, uint64_t offset)
+{
+    return offset < reader->header->strings.count ? reader->strings + offset : NULL;
+}
+
+/**
+ * @brief snapshot_open_reader Validates header of mapped snapshot and locates its tables.
+ * @param[in] reader       Reader to initialize.
+ * @param[in] data         Mapped file.
+ * @param[in] size         Size of the file.
+ * @return
+ *        - true if snapshot is usable.
+ *        - false otherwise.
+ */
+static bool snapshot_open_reader(snapshot_reader_t *reader, const char *data, size_t size)
+{
+    const snapshot_header_t *header = (const snapshot_header_t *)data;
+
+    if (size < sizeof(snapshot_header_t)
+        || memcmp(header->magic, MIRROR_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0
+        || header->version != MIRROR_SNAPSHOT_VERSION
+        || header->byte_order != MIRROR_SNAPSHOT_BYTE_ORDER
+        || header->file_size != size)
+    {
+        return false;
+    }
+
+    if (!snapshot_check_section(header, &header->strings, 1)
+        || !snapshot_check_section(header, &header->names, sizeof(uint64_t))
+        || !snapshot_check_section(header, &header->entries, sizeof(snapshot_entry_t))
+        || !snapshot_check_section(header, &header->attributes, sizeof(snapshot_attribute_t))
+        || !snapshot_check_section(header, &header->values, sizeof(uint64_t))
+        || !snapshot_check_section(header, &header->indexes, sizeof(snapshot_index_t))
+        || !snapshot_check_section(header, &header->keys, sizeof(snapshot_key_t))
+        || !snapshot_check_section(header, &header->ids, sizeof(uint32_t))
+        || !snapshot_check_section(header, &header->state, 1))
+    {
+        return false;
+    }
+
+    // Every string offset is then guaranteed to reach a terminating zero inside the arena.
+    if (header->strings.count == 0 || data[header->strings.offset + header->strings.count - 1] != '\0')
+    {
+        return false;
+    }
+
+    reader->data = data;
+    reader->header = header;
+    reader->strings = data + header->strings.offset;
+    reader->names = (const uint64_t *)(data + header->names.offset);
+    reader->entries = (const snapshot_entry_t *)(data + header->entries.offset);
+    reader->attributes = (const snapshot_attribute_t *)(data + header->attributes.offset);
+    reader->values = (const uint64_t *)(data + header->values.offset);
+    reader->indexes = (const snapshot_index_t *)(data + header->indexes.offset);
+    reader->keys = (const snapshot_key_t *)(data + header->keys.offset);
+    reader->ids = (const uint32_t *)(data + header->ids.offset);
+
+    return true;
+}
+
+/**
+ * @brief snapshot_load_entry Creates entry described by snapshot.
+ * @param[in] ctx          Talloc ctx to create entry on.
+ * @param[in] reader       Snapshot.
+ * @param[in] record       Entry in the snapshot.
+ * @return
+ *        - Entry.
+ *        - NULL if record is corrupted or on failure.
+ */
+static ld_entry_t *snapshot_load_entry(TALLOC_CTX *ctx, const snapshot_reader_t *reader,
+                                       const snapshot_entry_t *record)
+{
+    const snapshot_header_t *header = reader->header;
+    const char *dn = snapshot_string(reader, record->dn);
+
+    if (!dn || !snapshot_check_range(record->first_attribute, record->attribute_count, header->attributes.count))
+    {
+        return NULL;
+    }
+
+    ld_entry_t *result = ld_entry_new(ctx, dn);
+    if (!result)
+    {
+        return NULL;
+    }
+
+    for (uint64_t i = 0; i < record->attribute_count; ++i)
+    {
+        const snapshot_attribute_t *item = &reader->attributes[record->first_attribute + i];
+        const char *name = item->name < header->names.count ? snapshot_string(reader, reader->names[item->name])
+                                                            : NULL;
+
+        if (!name || !snapshot_check_range(item->first_value, item->value_count, header->values.count))
+        {
+            goto error_exit;
+        }
+
+        LDAPAttribute_t *attribute = NULL;
+        ld_talloc_zero(attribute, error_exit, result, LDAPAttribute_t);
+        ld_talloc_strdup(attribute->name, error_exit, attribute, name);
+        ld_talloc_array(attribute->values, error_exit, attribute, char*, item->value_count + 1);
+
+        for (uint64_t j = 0; j < item->value_count; ++j)
+        {
+            const char *value = snapshot_string(reader, reader->values[item->first_value + j]);
+            if (!value)
+            {
+                goto error_exit;
+            }
+
+            ld_talloc_strdup(attribute->values[j], error_exit, attribute->values, value);
+        }
+        attribute->values[item->value_count] = NULL;
+
+        ld_entry_add_attribute(result, attribute);
+    }
+
+    return result;
+
+    error_exit:
+        talloc_free(result);
+        return NULL;
+}
+
+/**
+ * @brief snapshot_load_index Restores index without normalizing values again.
+ * @param[in] mirror       Mirror with entries numbered as in snapshot.
+ * @param[in] reader       Snapshot.
+ * @param[in] record       Index in the snapshot.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE if record is corrupted or on failure.
+ */
+static enum OperationReturnCode snapshot_load_index(ld_mirror_t *mirror, const snapshot_reader_t *reader,
+                                                    const snapshot_index_t *record)
+{
+    const snapshot_header_t *header = reader->header;
+    const char *attribute = snapshot_string(reader, record->attribute);
+    enum LdapMirrorIndexType type = record->type == LD_MIRROR_INDEX_ORDERED ? LD_MIRROR_INDEX_ORDERED
+                                                                            : LD_MIRROR_INDEX_EQUALITY;
+
+    if (!attribute || !snapshot_check_range(record->first_key, record->key_count, header->keys.count))
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    // Keys depend on matching rule, when schema resolves another rule values are indexed again.
+    if (filter_attribute_rule(mirror->schema, attribute) != (enum FilterRule)record->rule)
+    {
+        return ld_mirror_add_index(mirror, attribute, type);
+    }
+
+    mirror_index_t *index = mirror_index_new(mirror, attribute, type);
+    if (!index)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    for (uint64_t i = 0; i < record->key_count; ++i)
+    {
+        const snapshot_key_t *item = &reader->keys[record->first_key + i];
+        const char *key = snapshot_string(reader, item->key);
+
+        if (!key || item->id_count == 0 || !snapshot_check_range(item->first_id, item->id_count, header->ids.count))
+        {
+            return RETURN_CODE_FAILURE;
+        }
+
+        const uint32_t *ids = reader->ids + item->first_id;
+        for (uint64_t j = 0; j < item->id_count; ++j)
+        {
+            if (ids[j] >= mirror->records->len || (j > 0 && ids[j] <= ids[j - 1]))
+            {
+                return RETURN_CODE_FAILURE;
+            }
+        }
+
+        GArray *posting = g_array_sized_new(FALSE, FALSE, sizeof(guint), item->id_count);
+        g_array_append_vals(posting, ids, item->id_count);
+        g_hash_table_insert(index->postings, g_strdup(key), posting);
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief ld_mirror_load Restores mirror from snapshot written by ld_mirror_save.
+ *
+ * Tables are read directly from the mapped file, values are not parsed and index keys are not normalized again.
+ * Entries and posting lists are still copied into the mirror, which does not refer to the file once loaded.
+ * When snapshot holds synchronization state it is imported into the session, otherwise session is reset.
+ * @param[in] ctx          Talloc ctx to use.
+ * @param[in] schema       Schema to resolve matching rules with, may be NULL.
+ * @param[in] path         File to read snapshot from.
+ * @param[in] sync         Synchronization session to restore state of, may be NULL.
+ * @return
+ *        - Mirror.
+ *        - NULL if there is no usable snapshot or on failure, full synchronization is required then.
+ */
+ld_mirror_t *ld_mirror_load(TALLOC_CTX *ctx, const ldap_schema_t *schema, const char *path, ld_sync_t *sync)
+{
+    ld_mirror_t *result = NULL;
+    void *data = MAP_FAILED;
+    size_t size = 0;
+    snapshot_reader_t reader;
+
+    if (!path)
+    {
+        ld_error("ld_mirror_load - invalid path!\n");
+        return NULL;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        if (errno != ENOENT)
+        {
+            ld_error("ld_mirror_load - unable to open %s: %s\n", path, strerror(errno));
+        }
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(snapshot_header_t))
+    {
+        ld_error("ld_mirror_load - %s is not a mirror snapshot!\n", path);
+        goto error_exit;
+    }
+
+    size = (size_t)st.st_size;
+    data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        ld_error("ld_mirror_load - unable to map %s: %s\n", path, strerror(errno));
+        goto error_exit;
+    }
+
+    if (!snapshot_open_reader(&reader, data, size))
+    {
+        ld_error("ld_mirror_load - %s is not a valid mirror snapshot!\n", path);
+        goto error_exit;
+    }
+
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    result = ld_mirror_new(ctx, schema);
+    if (!result)
+    {
+        goto error_exit;
+    }
+
+    result->partial_updates = (reader.header->flags & MIRROR_SNAPSHOT_PARTIAL_UPDATES) != 0;
+
+    for (uint64_t i = 0; i < reader.header->entries.count; ++i)
+    {
+        ld_entry_t *entry = snapshot_load_entry(result, &reader, &reader.entries[i]);
+
+        // Posting lists refer to entries by number, every entry must get identifier equal to its number.
+        if (!entry || mirror_insert(result, entry) != RETURN_CODE_SUCCESS || result->count != i + 1)
+        {
+            ld_error("ld_mirror_load - %s is corrupted!\n", path);
+            goto error_exit;
+        }
+    }
+
+    for (uint64_t i = 0; i < reader.header->indexes.count; ++i)
+    {
+        if (snapshot_load_index(result, &reader, &reader.indexes[i]) != RETURN_CODE_SUCCESS)
+        {
+            ld_error("ld_mirror_load - %s is corrupted!\n", path);
+            goto error_exit;
+        }
+    }
+
+    if (sync)
+    {
+        enum OperationReturnCode rc = reader.header->state.count > 0
+            ? ld_sync_import_state(sync, reader.data + reader.header->state.offset, reader.header->state.count)
+            : ld_sync_reset(sync);
+
+        if (rc != RETURN_CODE_SUCCESS)
+        {
+            goto error_exit;
+        }
+    }
+
+    munmap(data, size);
+    close(fd);
+
+    return result;
+
+    error_exit:
+        if (data != MAP_FAILED)
+        {
+            munmap(data, size);
+        }
+        close(fd);
+        talloc_free(result);
+        return NULL;
+}
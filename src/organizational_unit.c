@@ -57,6 +57,39 @@ enum OperationReturnCode ld_add_ou(LDHandle *handle,
     return rc;
 }
 
+/**
+ * @brief ld_add_ous    Creates OUs.
+ *
+ * Requests are pipelined, callback may be called before function returns.
+ * @param[in] handle    Pointer to libdomain session handle.
+ * @param[in] ous       OUs to create.
+ * @param[in] n_ous     Amount of OUs.
+ * @param[in] defaults  Attributes shared by all OUs, may be NULL.
+ * @param[in] parent    Container of the OUs, NULL for base DN.
+ * @param[in] callback  Callback to report results of OUs to.
+ * @param[in] user_data User data passed to callback.
+ * @return
+ *        - RETURN_CODE_SUCCESS if creation has been started.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_add_ous(LDHandle *handle,
+                                    const ld_batch_item_t *ous,
+                                    int n_ous,
+                                    LDAPAttribute_t **defaults,
+                                    const char *parent,
+                                    batch_complete_callback_fn callback,
+                                    void *user_data)
+{
+    const char *dn = handle ? handle->global_config->base_dn : NULL;
+
+    if (parent && strlen(parent) > 0)
+    {
+        dn = parent;
+    }
+
+    return ld_batch_add_entries(handle, ous, n_ous, defaults, dn, "ou", 0, callback, user_data);
+}
+
 /**
  * @brief ld_del_ou   Deletes the OU.
  * @param[in] handle      Pointer to libdomain session handle.
@@ -71,6 +104,57 @@ enum OperationReturnCode ld_del_ou(LDHandle *handle, const char *name, const cha
     return ld_del_entry(handle, name, parent ? parent : handle ? handle->global_config->base_dn : NULL, "ou");
 }
 
+/**
+ * @brief ld_del_ou_recursive Deletes the OU together with everything it contains.
+ *
+ * Callbacks may be called before function returns.
+ * @param[in] handle            Pointer to libdomain session handle.
+ * @param[in] name              Name of the OU, used as is.
+ * @param[in] parent            Parent container that holds the OU.
+ * @param[in] progress_callback Callback to report result of every delete to, may be NULL.
+ * @param[in] complete_callback Callback to call on completion, may be NULL.
+ * @param[in] user_data         User data passed to callbacks.
+ * @return
+ *        - RETURN_CODE_SUCCESS if delete has been started.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_del_ou_recursive(LDHandle *handle,
+                                             const char *name,
+                                             const char *parent,
+                                             subtree_delete_progress_callback_fn progress_callback,
+                                             subtree_delete_complete_callback_fn complete_callback,
+                                             void *user_data)
+{
+    const char* ou_name = NULL;
+    const char* ou_parent = NULL;
+    const char* dn = NULL;
+    TALLOC_CTX *talloc_ctx = NULL;
+
+    check_handle(handle, "ld_del_ou_recursive");
+
+    check_string(name, ou_name, "ld_del_ou_recursive");
+    ou_parent = parent && strlen(parent) > 0 ? parent : handle->global_config->base_dn;
+
+    ld_talloc_new(talloc_ctx, error_exit, NULL);
+
+    ld_talloc_asprintf(dn, error_exit, talloc_ctx, "ou=%s,%s", ou_name, ou_parent);
+
+    enum OperationReturnCode rc = ld_subtree_delete(handle->talloc_ctx, handle->connection_ctx, dn, 0,
+                                                    progress_callback, complete_callback, user_data);
+
+    talloc_free(talloc_ctx);
+
+    return rc;
+
+    error_exit:
+        if (talloc_ctx)
+        {
+            talloc_free(talloc_ctx);
+        }
+
+        return RETURN_CODE_FAILURE;
+}
+
 /**
  * @brief ld_mod_ou    Modifies the OU.
  * @param[in] handle       Pointer to libdomain session handle.
@@ -21,11 +21,26 @@
 #ifndef LIB_DOMAIN_ORGANIZATIONAL_UNIT_H
 #define LIB_DOMAIN_ORGANIZATIONAL_UNIT_H
 
+#include "batch.h"
 #include "common.h"
 #include "domain.h"
+#include "subtree_delete.h"
 
 enum OperationReturnCode ld_add_ou(LDHandle *handle, const char *name, LDAPAttribute_t **ou_attrs, const char *parent);
+enum OperationReturnCode ld_add_ous(LDHandle *handle,
+                                    const ld_batch_item_t *ous,
+                                    int n_ous,
+                                    LDAPAttribute_t **defaults,
+                                    const char *parent,
+                                    batch_complete_callback_fn callback,
+                                    void *user_data);
 enum OperationReturnCode ld_del_ou(LDHandle *handle, const char *name, const char *parent);
+enum OperationReturnCode ld_del_ou_recursive(LDHandle *handle,
+                                             const char *name,
+                                             const char *parent,
+                                             subtree_delete_progress_callback_fn progress_callback,
+                                             subtree_delete_complete_callback_fn complete_callback,
+                                             void *user_data);
 enum OperationReturnCode ld_mod_ou(LDHandle *handle, const char *name, const char *parent, LDAPAttribute_t **ou_attrs);
 enum OperationReturnCode ld_rename_ou(LDHandle *handle, const char *old_name, const char *new_name, const char *parent);
 #endif //LIB_DOMAIN_ORGANIZATIONAL_UNIT_H
@@ -0,0 +1,171 @@
+#include "../dn.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+%%{
+    machine parse_distinguished_name;
+
+    action type_start
+    {
+        if (next_rdn)
+        {
+            ++rdn;
+            next_rdn = false;
+        }
+        type_start = fpc;
+    }
+
+    action type_end
+    {
+        type_end = fpc;
+    }
+
+    action value_reset
+    {
+        value_start = fpc + 1;
+        hex = false;
+    }
+
+    action value_start
+    {
+        value_start = fpc;
+    }
+
+    action value_hex
+    {
+        hex = true;
+    }
+
+    action ava_end
+    {
+        const char *value_end = fpc;
+
+        // Trailing spaces are insignificant unless they are escaped.
+        while (value_end > value_start && value_end[-1] == ' ')
+        {
+            const char *escape = value_end - 1;
+            while (escape > value_start && escape[-1] == '\\')
+            {
+                --escape;
+            }
+            if (((value_end - 1) - escape) % 2 == 1)
+            {
+                break;
+            }
+            --value_end;
+        }
+
+        if (count < max_avas)
+        {
+            avas[count].type = type_start;
+            avas[count].type_len = type_end - type_start;
+            avas[count].value = value_start;
+            avas[count].value_len = value_end - value_start;
+            avas[count].rdn = rdn;
+            avas[count].hex = hex;
+        }
+        ++count;
+    }
+
+    action rdn_end
+    {
+        next_rdn = true;
+    }
+
+    ALPHA = 0x41..0x5a | 0x61..0x7a;
+    LDIGIT = 0x31..0x39;
+    DIGIT = "0" | LDIGIT;
+    HEX = DIGIT | 0x41..0x46 | 0x61..0x66;
+    PLUS = "+";
+    COMMA = ",";
+    HYPHEN = "-";
+    DOT = ".";
+    EQUALS = "=";
+    SPACE = " ";
+    ESC = "\\";
+    SHARP = "#";
+    DQUOTE = "\"";
+    SEMI = ";";
+    LANGLE = "<";
+    RANGLE = ">";
+
+    UTF1 = 0x00..0x7f;
+    UTF0 = 0x80..0xbf;
+    UTF2 = 0xc2..0xdf UTF0;
+    UTF3 = ( 0xe0 0xa0..0xbf UTF0 ) | ( 0xe1..0xec UTF0{2} ) | ( 0xed 0x80..0x9f UTF0 ) | ( 0xee..0xef UTF0{2} );
+    UTF4 = ( 0xf0 0x90..0xbf UTF0{2} ) | ( 0xf1..0xf3 UTF0{3} ) | ( 0xf4 0x80..0x8f UTF0{2} );
+    UTFMB = UTF2 | UTF3 | UTF4;
+    UTF8 = UTF1 | UTFMB;
+
+    ws = SPACE*;
+    escaped = DQUOTE | PLUS | COMMA | SEMI | LANGLE | RANGLE;
+    special = escaped | SPACE | SHARP | EQUALS;
+    hexpair = HEX HEX;
+    pair = ESC ( ESC | special | hexpair );
+
+    valuechar = UTF8 - ( 0x00 | escaped | ESC );
+    leadvaluechar = valuechar - ( SPACE | SHARP );
+    stringvalue = ( leadvaluechar | pair ) ( valuechar | pair )*;
+    hexstring = SHARP hexpair+;
+
+    keystring = ALPHA ( ALPHA | DIGIT | HYPHEN )*;
+    number = DIGIT | ( LDIGIT DIGIT+ );
+    numericoid = number ( DOT number )+;
+
+    attributeType = ( ( "OID."i )? numericoid | keystring ) >type_start %type_end;
+    attributeValue = ( hexstring %value_hex | stringvalue ) >value_start;
+    attributeTypeAndValue = attributeType ws EQUALS @value_reset ws attributeValue? %ava_end;
+    relativeDistinguishedName = attributeTypeAndValue ( PLUS ws attributeTypeAndValue )*;
+    distinguishedName = ws ( relativeDistinguishedName ( ( COMMA | SEMI ) @rdn_end ws relativeDistinguishedName )* )?;
+
+    main := distinguishedName;
+}%%
+
+%%write data;
+
+/**
+ * @brief parse_distinguished_name Splits DN into attribute types and values without copying.
+ *
+ * Spaces around separators are accepted, values keep their escaping.
+ * @param[in] in                   DN to parse.
+ * @param[in] len                  Length of DN.
+ * @param[out] avas                Array to store AVAs to.
+ * @param[in] max_avas             Size of the array, when DN has more AVAs only first max_avas are stored.
+ * @return
+ *        - Total amount of AVAs in DN.
+ *        - -1 if DN is invalid.
+ */
+int parse_distinguished_name(const char *const in, const size_t len, ld_dn_ava_t *avas, const int max_avas)
+{
+    if (!in)
+    {
+        return -1;
+    }
+
+    const char *p = in;
+    const char *const pe = in + len;
+    const char *const eof = pe;
+    int cs = 0;
+
+    const char *type_start = in;
+    const char *type_end = in;
+    const char *value_start = in;
+    unsigned int rdn = 0;
+    bool next_rdn = false;
+    bool hex = false;
+    int count = 0;
+
+    %%{
+        write init;
+        write exec;
+    }%%
+
+    if (cs < parse_distinguished_name_first_final)
+    {
+        return -1;
+    }
+
+    return count;
+}
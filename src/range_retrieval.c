@@ -0,0 +1,847 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "range_retrieval.h"
+#include "range_retrieval_p.h"
+#include "directory.h"
+#include "domain.h"
+#include "entry.h"
+#include "entry_p.h"
+
+#include "helper_p.h"
+
+#include <glib-2.0/glib.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RANGE_PIPELINE_DEPTH 4
+#define RANGE_OPTION ";range="
+
+/*!
+ * @brief range_slot_t - Request for a portion of values.
+ */
+typedef struct range_slot_s
+{
+    int msgid;                                  //!< Message id of the request, -1 once result has arrived.
+    unsigned int low;                           //!< Index of the first requested value.
+    unsigned int high;                          //!< Index of the last requested value, RANGE_END for all remaining.
+    bool received;                              //!< Result of the request has arrived.
+    bool failed;                                //!< Request has failed.
+    unsigned int received_high;                 //!< Index of the last returned value, RANGE_END if it was the last one.
+    char **values;                              //!< Returned values, NULL if there are none.
+} range_slot_t;
+
+/*!
+ * @brief ld_range_t - Retrieval of all values of a single attribute.
+ */
+struct ld_range_s
+{
+    struct ldap_connection_ctx_t *connection;   //!< Connection requests are sent through.
+    char *dn;                                   //!< Entry to retrieve values of.
+    char *attribute;                            //!< Attribute description without range option.
+    bool ranged;                                //!< Server supports range retrieval.
+
+    unsigned int page_size;                     //!< Amount of values server returns per request, 0 if unknown.
+    unsigned int next_low;                      //!< Index of the first value not requested yet.
+    unsigned int count;                         //!< Amount of values passed to callback.
+
+    range_slot_t slots[RANGE_PIPELINE_DEPTH];   //!< Requests in flight ordered by index of the first value.
+    int head;                                   //!< Position of the first request in slots.
+    int n_slots;                                //!< Amount of requests in flight.
+
+    range_values_callback_fn values_callback;   //!< Callback to pass values to.
+    range_complete_callback_fn complete_callback; //!< Callback to call on completion.
+    void *user_data;                            //!< User data passed to callbacks.
+};
+
+/*!
+ * @brief range_entries_t - Search results waiting for values of ranged attributes.
+ */
+typedef struct range_entries_s
+{
+    ld_entry_t **entries;                       //!< Entries of the search.
+    search_callback_fn callback;                //!< Search callback to pass entries to.
+    void *user_data;                            //!< User data of the search callback.
+    int pending;                                //!< Amount of attributes still being retrieved.
+} range_entries_t;
+
+/*!
+ * @brief range_target_t - Attribute of the search result values are appended to.
+ */
+typedef struct range_target_s
+{
+    range_entries_t *entries;                   //!< Search results attribute belongs to.
+    ld_entry_t *entry;                          //!< Entry attribute belongs to.
+    LDAPAttribute_t *attribute;                 //!< Attribute to append values to.
+} range_target_t;
+
+/**
+ * @brief range_parse_description Splits attribute description into attribute and range option.
+ * @param[in] ctx              Talloc ctx to allocate name with.
+ * @param[in] description      Attribute description, e.g. member;range=0-1499.
+ * @param[out] name            Description without range option.
+ * @param[out] low             Index of the first value, 0 if there is no range option.
+ * @param[out] high            Index of the last value, RANGE_END for * or if there is no range option.
+ * @return
+ *        - true on success.
+ *        - false if range option is invalid or on failure.
+ */
+bool range_parse_description(TALLOC_CTX *ctx, const char *description, char **name,
+                             unsigned int *low, unsigned int *high)
+{
+    const char *option = NULL;
+    char *end = NULL;
+
+    *name = NULL;
+    *low = 0;
+    *high = RANGE_END;
+
+    for (const char *current = strchr(description, ';'); current; current = strchr(current + 1, ';'))
+    {
+        if (g_ascii_strncasecmp(current, RANGE_OPTION, strlen(RANGE_OPTION)) == 0)
+        {
+            option = current;
+            break;
+        }
+    }
+
+    if (!option)
+    {
+        *name = talloc_strdup(ctx, description);
+        return *name != NULL;
+    }
+
+    const char *value = option + strlen(RANGE_OPTION);
+    if (!g_ascii_isdigit(*value))
+    {
+        return false;
+    }
+
+    errno = 0;
+    unsigned long number = strtoul(value, &end, 10);
+    if (errno != 0 || number >= RANGE_END || *end != '-')
+    {
+        return false;
+    }
+    *low = (unsigned int)number;
+
+    value = end + 1;
+    if (*value == '*')
+    {
+        end = (char *)value + 1;
+    }
+    else
+    {
+        if (!g_ascii_isdigit(*value))
+        {
+            return false;
+        }
+
+        number = strtoul(value, &end, 10);
+        if (errno != 0 || number >= RANGE_END || number < *low)
+        {
+            return false;
+        }
+        *high = (unsigned int)number;
+    }
+
+    if (*end != '\0' && *end != ';')
+    {
+        return false;
+    }
+
+    *name = talloc_asprintf(ctx, "%.*s%s", (int)(option - description), description, end);
+
+    return *name != NULL;
+}
+
+static range_slot_t *range_slot(ld_range_t *range, int index)
+{
+    return &range->slots[(range->head + index) % RANGE_PIPELINE_DEPTH];
+}
+
+/**
+ * @brief range_cancel Cancels requests starting from the given one.
+ * @param[in] range    Range to work with.
+ * @param[in] from     Index of the first request to cancel.
+ */
+static void range_cancel(ld_range_t *range, int from)
+{
+    for (int i = from; i < range->n_slots; ++i)
+    {
+        range_slot_t *slot = range_slot(range, i);
+
+        if (!slot->received && slot->msgid >= 0)
+        {
+            connection_cancel_read_request(range->connection, slot->msgid);
+            ldap_abandon_ext(range->connection->ldap, slot->msgid, NULL, NULL);
+        }
+
+        talloc_free(slot->values);
+        memset(slot, 0, sizeof(*slot));
+    }
+
+    range->n_slots = from;
+}
+
+static int range_destructor(TALLOC_CTX *ctx)
+{
+    ld_range_t *range = talloc_get_type_abort(ctx, ld_range_t);
+
+    range_cancel(range, 0);
+
+    return 0;
+}
+
+/**
+ * @brief range_send Sends request for values from low to high.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode range_send(ld_range_t *range, unsigned int low, unsigned int high)
+{
+    char *description = NULL;
+    int msgid = 0;
+
+    if (!range->ranged)
+    {
+        description = talloc_strdup(range, range->attribute);
+    }
+    else if (high == RANGE_END)
+    {
+        description = talloc_asprintf(range, "%s" RANGE_OPTION "%u-*", range->attribute, low);
+    }
+    else
+    {
+        description = talloc_asprintf(range, "%s" RANGE_OPTION "%u-%u", range->attribute, low, high);
+    }
+
+    if (!description)
+    {
+        ld_error("range_send - out of memory - unable to create attribute description!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    char *attrs[] = { description, NULL };
+
+    int rc = ldap_search_ext(range->connection->ldap,
+                             range->dn,
+                             LDAP_SCOPE_BASE,
+                             "(objectClass=*)",
+                             attrs,
+                             0,
+                             NULL,
+                             NULL,
+                             NULL,
+                             LDAP_NO_LIMIT,
+                             &msgid);
+
+    talloc_free(description);
+
+    if (rc != LDAP_SUCCESS)
+    {
+        ld_error("Unable to create range retrieval request: %s\n", ldap_err2string(rc));
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (connection_add_read_request(range->connection, msgid, ld_range_on_read, range) != RETURN_CODE_SUCCESS)
+    {
+        ldap_abandon_ext(range->connection->ldap, msgid, NULL, NULL);
+        return RETURN_CODE_FAILURE;
+    }
+
+    range_slot_t *slot = range_slot(range, range->n_slots++);
+    memset(slot, 0, sizeof(*slot));
+    slot->msgid = msgid;
+    slot->low = low;
+    slot->high = high;
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief range_fill Sends requests for following portions until pipeline is full.
+ *
+ * Until server tells its page size only one request asking for all values is sent.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode range_fill(ld_range_t *range)
+{
+    if (!range->ranged || range->page_size == 0)
+    {
+        return range->n_slots == 0 ? range_send(range, range->next_low, RANGE_END) : RETURN_CODE_SUCCESS;
+    }
+
+    while (range->n_slots < RANGE_PIPELINE_DEPTH && range->next_low != RANGE_END)
+    {
+        unsigned int high = range->next_low > RANGE_END - range->page_size
+                          ? RANGE_END
+                          : range->next_low + range->page_size - 1;
+
+        if (range_send(range, range->next_low, high) != RETURN_CODE_SUCCESS)
+        {
+            return RETURN_CODE_FAILURE;
+        }
+
+        range->next_low = high == RANGE_END ? RANGE_END : high + 1;
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief range_finish Cancels outstanding requests and calls completion callback.
+ *
+ * Range may be freed by callback, so it must not be accessed afterwards.
+ */
+static void range_finish(ld_range_t *range, enum OperationReturnCode rc)
+{
+    range_cancel(range, 0);
+
+    range->complete_callback(range->connection, range, rc, range->user_data);
+}
+
+/**
+ * @brief range_deliver Passes values of received portions to callback in order and sends further requests.
+ *
+ * Range may be freed by completion callback, so it must not be accessed afterwards.
+ */
+static void range_deliver(ld_range_t *range)
+{
+    while (range->n_slots > 0 && range_slot(range, 0)->received)
+    {
+        range_slot_t slot = *range_slot(range, 0);
+
+        memset(range_slot(range, 0), 0, sizeof(slot));
+        range->head = (range->head + 1) % RANGE_PIPELINE_DEPTH;
+        --range->n_slots;
+
+        if (slot.failed)
+        {
+            talloc_free(slot.values);
+            range_finish(range, RETURN_CODE_FAILURE);
+            return;
+        }
+
+        if (slot.values && slot.values[0])
+        {
+            range->count += talloc_array_length(slot.values) - 1;
+
+            enum OperationReturnCode rc = range->values_callback(range->connection, range->dn, range->attribute,
+                                                                 slot.values, range->user_data);
+            talloc_free(slot.values);
+
+            if (rc != RETURN_CODE_SUCCESS)
+            {
+                range_finish(range, RETURN_CODE_FAILURE);
+                return;
+            }
+        }
+        else
+        {
+            talloc_free(slot.values);
+        }
+
+        if (slot.received_high == RANGE_END)
+        {
+            range_finish(range, RETURN_CODE_SUCCESS);
+            return;
+        }
+
+        if (slot.received_high != slot.high)
+        {
+            // Server returned a different portion than requested, requests sent after it are misaligned.
+            range->page_size = slot.received_high - slot.low + 1;
+            range->next_low = slot.received_high + 1;
+            range_cancel(range, 0);
+        }
+    }
+
+    if (range_fill(range) != RETURN_CODE_SUCCESS)
+    {
+        range_finish(range, RETURN_CODE_FAILURE);
+    }
+}
+
+/**
+ * @brief range_parse_response Stores values returned for the request.
+ * @param[in] range            Range to work with.
+ * @param[in] slot             Request result belongs to.
+ * @param[in] message          Result of the request.
+ */
+static void range_parse_response(ld_range_t *range, range_slot_t *slot, LDAPMessage *message)
+{
+    LDAP *ldap = range->connection->ldap;
+
+    // Server omits attribute once there are no values left.
+    slot->received_high = RANGE_END;
+
+    for (LDAPMessage *current = ldap_first_message(ldap, message);
+         current != NULL;
+         current = ldap_next_message(ldap, current))
+    {
+        switch (ldap_msgtype(current))
+        {
+        case LDAP_RES_SEARCH_ENTRY:
+        {
+            BerElement *ber_element = NULL;
+
+            for (char *attribute = ldap_first_attribute(ldap, current, &ber_element);
+                 attribute != NULL;
+                 attribute = ldap_next_attribute(ldap, current, ber_element))
+            {
+                char *name = NULL;
+                unsigned int low = 0;
+                unsigned int high = RANGE_END;
+
+                if (range_parse_description(NULL, attribute, &name, &low, &high)
+                    && g_ascii_strcasecmp(name, range->attribute) == 0)
+                {
+                    struct berval **values = ldap_get_values_len(ldap, current, attribute);
+                    int values_count = ldap_count_values_len(values);
+
+                    talloc_free(slot->values);
+                    slot->values = talloc_array(range, char*, values_count + 1);
+                    for (int i = 0; slot->values && i < values_count; ++i)
+                    {
+                        slot->values[i] = talloc_strndup(slot->values, values[i]->bv_val, values[i]->bv_len);
+                        slot->failed = slot->failed || !slot->values[i];
+                    }
+
+                    if (slot->values)
+                    {
+                        slot->values[values_count] = NULL;
+                    }
+                    else
+                    {
+                        ld_error("range_parse_response - out of memory - unable to store values!\n");
+                        slot->failed = true;
+                    }
+
+                    if (low != slot->low)
+                    {
+                        ld_error("range_parse_response - server returned values from %u instead of %u!\n",
+                                 low, slot->low);
+                        slot->failed = true;
+                    }
+
+                    slot->received_high = high;
+                    ldap_value_free_len(values);
+                }
+
+                talloc_free(name);
+                ldap_memfree(attribute);
+            }
+
+            ber_free(ber_element, 0);
+        }
+            break;
+        case LDAP_RES_SEARCH_RESULT:
+        {
+            int error_code = 0;
+            char *diagnostic_message = NULL;
+
+            if (ldap_parse_result(ldap, current, &error_code, NULL, &diagnostic_message, NULL, NULL, 0)
+                != LDAP_SUCCESS || error_code != LDAP_SUCCESS)
+            {
+                ld_error("Range retrieval request failed: %s %s\n", ldap_err2string(error_code),
+                         diagnostic_message ? diagnostic_message : "");
+                slot->failed = true;
+            }
+
+            ldap_memfree(diagnostic_message);
+        }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/**
+ * @brief ld_range_on_read This callback is called when result of range retrieval request arrives.
+ * @param[in] rc            Return code of ldap_result.
+ * @param[in] message       Message received from ldap.
+ * @param[in] connection    Connection to work with.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_range_on_read(int rc, LDAPMessage *message, struct ldap_connection_ctx_t *connection)
+{
+    ld_range_t *range = connection->request_user_data;
+    range_slot_t *slot = NULL;
+
+    if (!range)
+    {
+        ld_error("ld_range_on_read - range is missing!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    for (int i = 0; i < range->n_slots && !slot; ++i)
+    {
+        if (range_slot(range, i)->msgid == connection->msgid && !range_slot(range, i)->received)
+        {
+            slot = range_slot(range, i);
+        }
+    }
+
+    if (!slot)
+    {
+        return RETURN_CODE_SUCCESS;
+    }
+
+    slot->received = true;
+    slot->msgid = -1;
+
+    if (rc == LDAP_RES_ANY)
+    {
+        slot->failed = true;
+    }
+    else
+    {
+        range_parse_response(range, slot, message);
+    }
+
+    range_deliver(range);
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief range_start Starts retrieval of values beginning with the given one.
+ * @return
+ *        - Valid pointer to range on success.
+ *        - NULL on failure.
+ */
+static ld_range_t *range_start(TALLOC_CTX *ctx,
+                               struct ldap_connection_ctx_t *connection,
+                               const char *dn,
+                               const char *attribute,
+                               unsigned int low,
+                               unsigned int page_size,
+                               range_values_callback_fn values_callback,
+                               range_complete_callback_fn complete_callback,
+                               void *user_data)
+{
+    ld_range_t *range = NULL;
+
+    ld_talloc_zero_e(range, error_exit, "range_start - out of memory - unable to create range!\n", ctx, ld_range_t);
+    talloc_set_destructor((void*)range, range_destructor);
+
+    range->connection = connection;
+    ld_talloc_strdup(range->dn, error_exit, range, dn);
+    ld_talloc_strdup(range->attribute, error_exit, range, attribute);
+    range->ranged = directory_has_capability(connection, LDAP_CAPABILITY_RANGE_RETRIEVAL);
+    range->next_low = low;
+    range->page_size = page_size;
+    range->values_callback = values_callback;
+    range->complete_callback = complete_callback;
+    range->user_data = user_data;
+
+    if (range_fill(range) != RETURN_CODE_SUCCESS)
+    {
+        goto error_exit;
+    }
+
+    return range;
+
+    error_exit:
+        talloc_free(range);
+        return NULL;
+}
+
+/**
+ * @brief ld_range_retrieve Retrieves all values of the attribute, however many of them the entry has.
+ *
+ * Portions of values are requested several at a time once server tells its page size and are passed
+ * to values_callback in order. When server does not support range retrieval values are requested at once.
+ * @param[in] ctx                Talloc ctx to use, freeing the range cancels retrieval.
+ * @param[in] connection         Connection to work with, should be in LDAP_CONNECTION_STATE_RUN state.
+ * @param[in] dn                 Entry to retrieve values of.
+ * @param[in] attribute          Attribute description without range option, e.g. member.
+ * @param[in] values_callback    Callback to pass values to.
+ * @param[in] complete_callback  Callback to call once all values have been passed or retrieval has failed.
+ * @param[in] user_data          User data passed to callbacks.
+ * @return
+ *        - Valid pointer to range on success.
+ *        - NULL on failure, callbacks are not called.
+ */
+ld_range_t *ld_range_retrieve(TALLOC_CTX *ctx,
+                              struct ldap_connection_ctx_t *connection,
+                              const char *dn,
+                              const char *attribute,
+                              range_values_callback_fn values_callback,
+                              range_complete_callback_fn complete_callback,
+                              void *user_data)
+{
+    if (!connection || !dn || !attribute || !values_callback || !complete_callback)
+    {
+        ld_error("ld_range_retrieve - invalid parameters!\n");
+        return NULL;
+    }
+
+    return range_start(ctx, connection, dn, attribute, 0, 0, values_callback, complete_callback, user_data);
+}
+
+/**
+ * @brief ld_range_get_count Returns amount of values passed to callback so far.
+ */
+unsigned int ld_range_get_count(const ld_range_t *range)
+{
+    return range ? range->count : 0;
+}
+
+/**
+ * @brief range_append_values Moves values to the end of attribute values.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode range_append_values(LDAPAttribute_t *attribute, char **values)
+{
+    size_t count = 0;
+    size_t added = 0;
+
+    while (attribute->values && attribute->values[count])
+    {
+        ++count;
+    }
+
+    while (values && values[added])
+    {
+        ++added;
+    }
+
+    char **result = talloc_realloc(attribute, attribute->values, char*, count + added + 1);
+    if (!result)
+    {
+        ld_error("range_append_values - out of memory - unable to append values!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    for (size_t i = 0; i < added; ++i)
+    {
+        result[count + i] = talloc_steal(result, values[i]);
+    }
+    result[count + added] = NULL;
+
+    attribute->values = result;
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief range_rename_attribute Stores attribute in entry under the new name.
+ */
+static void range_rename_attribute(ld_entry_t *entry, LDAPAttribute_t *attribute, char *name)
+{
+    g_hash_table_steal(entry->attributes, attribute->name);
+
+    talloc_free(attribute->name);
+    attribute->name = talloc_steal(attribute, name);
+
+    g_hash_table_insert(entry->attributes, attribute->name, attribute);
+}
+
+static enum OperationReturnCode range_entries_on_values(struct ldap_connection_ctx_t *connection,
+                                                        const char *dn,
+                                                        const char *attribute,
+                                                        char **values,
+                                                        void *user_data)
+{
+    (void)(connection);
+    (void)(dn);
+    (void)(attribute);
+
+    range_target_t *target = user_data;
+
+    return range_append_values(target->attribute, values);
+}
+
+static void range_entries_on_complete(struct ldap_connection_ctx_t *connection,
+                                      ld_range_t *range,
+                                      enum OperationReturnCode rc,
+                                      void *user_data)
+{
+    (void)(range);
+
+    range_target_t *target = user_data;
+    range_entries_t *entries = target->entries;
+
+    if (rc != RETURN_CODE_SUCCESS)
+    {
+        // Keep range option so caller can tell values are incomplete, as without range retrieval.
+        size_t count = talloc_array_length(target->attribute->values);
+        char *name = talloc_asprintf(target->attribute, "%s" RANGE_OPTION "0-%zu",
+                                     target->attribute->name, count > 2 ? count - 2 : 0);
+
+        ld_error("Unable to retrieve all values of %s of %s!\n", target->attribute->name, target->entry->dn);
+
+        if (name)
+        {
+            range_rename_attribute(target->entry, target->attribute, name);
+        }
+    }
+
+    if (--entries->pending == 0)
+    {
+        entries->callback(connection, entries->entries, entries->user_data);
+        talloc_free(entries);
+    }
+}
+
+/**
+ * @brief range_complete_entry Renames ranged attributes of the entry and starts retrieval of remaining values.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode range_complete_entry(struct ldap_connection_ctx_t *connection,
+                                                     range_entries_t *entries,
+                                                     ld_entry_t *entry)
+{
+    GPtrArray *ranged = g_ptr_array_new();
+    GHashTableIter iter;
+    gpointer key = NULL;
+    gpointer value = NULL;
+
+    g_hash_table_iter_init(&iter, entry->attributes);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+        if (strchr(key, ';'))
+        {
+            g_ptr_array_add(ranged, value);
+        }
+    }
+
+    for (guint i = 0; i < ranged->len; ++i)
+    {
+        LDAPAttribute_t *attribute = g_ptr_array_index(ranged, i);
+        char *name = NULL;
+        unsigned int low = 0;
+        unsigned int high = RANGE_END;
+
+        if (!range_parse_description(attribute, attribute->name, &name, &low, &high)
+            || strcmp(name, attribute->name) == 0)
+        {
+            talloc_free(name);
+            continue;
+        }
+
+        LDAPAttribute_t *existing = g_hash_table_lookup(entry->attributes, name);
+        if (existing)
+        {
+            g_hash_table_steal(entry->attributes, attribute->name);
+            range_append_values(existing, attribute->values);
+            talloc_free(attribute->values);
+            talloc_free(attribute->name);
+            talloc_free(attribute);
+            attribute = existing;
+        }
+        else
+        {
+            range_rename_attribute(entry, attribute, name);
+        }
+
+        if (high == RANGE_END)
+        {
+            continue;
+        }
+
+        range_target_t *target = talloc_zero(entries, range_target_t);
+        if (!target)
+        {
+            ld_error("range_complete_entry - out of memory - unable to create target!\n");
+            g_ptr_array_free(ranged, TRUE);
+            return RETURN_CODE_FAILURE;
+        }
+
+        target->entries = entries;
+        target->entry = entry;
+        target->attribute = attribute;
+
+        ++entries->pending;
+
+        if (!range_start(target, connection, entry->dn, attribute->name, high + 1, high - low + 1,
+                         range_entries_on_values, range_entries_on_complete, target))
+        {
+            range_entries_on_complete(connection, NULL, RETURN_CODE_FAILURE, target);
+        }
+    }
+
+    g_ptr_array_free(ranged, TRUE);
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief range_complete_entries Retrieves remaining values of ranged attributes before passing entries to callback.
+ *
+ * Attributes returned with range option, e.g. member;range=0-1499, are stored under the name without it.
+ * When all values have been returned callback is called right away.
+ * @param[in] connection   Connection to work with.
+ * @param[in] entries      Entries of the search result.
+ * @param[in] callback     Search callback.
+ * @param[in] user_data    User data of the search callback.
+ * @return
+ *        - Return code of callback if it has been called right away.
+ *        - RETURN_CODE_SUCCESS if values are being retrieved.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode range_complete_entries(struct ldap_connection_ctx_t *connection,
+                                                ld_entry_t **entries,
+                                                search_callback_fn callback,
+                                                void *user_data)
+{
+    range_entries_t *result = NULL;
+
+    ld_talloc_zero_e(result, error_exit, "range_complete_entries - out of memory - unable to create entries!\n",
+                     NULL, range_entries_t);
+
+    result->entries = entries;
+    result->callback = callback;
+    result->user_data = user_data;
+
+    // Keeps callback from being called while retrievals are being started.
+    result->pending = 1;
+
+    for (int i = 0; entries && entries[i]; ++i)
+    {
+        range_complete_entry(connection, result, entries[i]);
+    }
+
+    if (--result->pending > 0)
+    {
+        return RETURN_CODE_SUCCESS;
+    }
+
+    talloc_free(result);
+
+    return callback(connection, entries, user_data);
+
+    error_exit:
+        return callback(connection, entries, user_data);
+}
@@ -0,0 +1,70 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+#ifndef LIBDOMAIN_RANGE_RETRIEVAL_H
+#define LIBDOMAIN_RANGE_RETRIEVAL_H
+
+#include "common.h"
+#include "connection.h"
+
+#include <stdbool.h>
+
+/**
+ * Active Directory returns at most MaxValRange values of an attribute per request and marks the returned
+ * portion with range option, e.g. member;range=0-1499. Range retrieval requests the remaining portions,
+ * several of them at once, and passes values to the caller in order under the attribute name without
+ * the range option.
+ */
+
+typedef struct ld_range_s ld_range_t;
+
+/**
+ * @brief range_values_callback_fn Callback fired for every portion of values in order.
+ *
+ * Values are released once callback returns. Returning anything but RETURN_CODE_SUCCESS stops the retrieval.
+ */
+typedef enum OperationReturnCode (*range_values_callback_fn)(struct ldap_connection_ctx_t *connection,
+                                                             const char *dn,
+                                                             const char *attribute,
+                                                             char **values,
+                                                             void *user_data);
+
+/**
+ * @brief range_complete_callback_fn Callback fired once all values have been passed or retrieval has failed.
+ *
+ * Range may be freed inside the callback.
+ */
+typedef void (*range_complete_callback_fn)(struct ldap_connection_ctx_t *connection,
+                                           ld_range_t *range,
+                                           enum OperationReturnCode rc,
+                                           void *user_data);
+
+ld_range_t *ld_range_retrieve(TALLOC_CTX *ctx,
+                              struct ldap_connection_ctx_t *connection,
+                              const char *dn,
+                              const char *attribute,
+                              range_values_callback_fn values_callback,
+                              range_complete_callback_fn complete_callback,
+                              void *user_data);
+
+unsigned int ld_range_get_count(const ld_range_t *range);
+
+enum OperationReturnCode ld_range_on_read(int rc, LDAPMessage *message, struct ldap_connection_ctx_t *connection);
+
+#endif //LIBDOMAIN_RANGE_RETRIEVAL_H
@@ -0,0 +1,35 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+#ifndef LIBDOMAIN_RANGE_RETRIEVAL_PRIVATE_H
+#define LIBDOMAIN_RANGE_RETRIEVAL_PRIVATE_H
+
+#include "range_retrieval.h"
+
+#define RANGE_END ((unsigned int)-1)
+
+bool range_parse_description(TALLOC_CTX *ctx, const char *description, char **name,
+                             unsigned int *low, unsigned int *high);
+
+enum OperationReturnCode range_complete_entries(struct ldap_connection_ctx_t *connection,
+                                                ld_entry_t **entries,
+                                                search_callback_fn callback,
+                                                void *user_data);
+
+#endif //LIBDOMAIN_RANGE_RETRIEVAL_PRIVATE_H
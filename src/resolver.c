@@ -0,0 +1,588 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "resolver.h"
+#include "dn.h"
+#include "domain.h"
+#include "entry.h"
+#include "entry_cache.h"
+#include "filter.h"
+#include "filter_match.h"
+
+#include "helper_p.h"
+
+#include <string.h>
+
+#include <glib-2.0/glib.h>
+
+#define RESOLVER_MAX_VALUES 500
+#define RESOLVER_MAX_FILTER_LENGTH 16384
+#define RESOLVER_DEFAULT_WINDOW 4
+#define RESOLVER_MAX_WINDOW 64
+
+/*!
+ * @brief resolver_name_t - Distinct name to resolve.
+ */
+typedef struct resolver_name_s
+{
+    const char *name;                           //!< Name as it has been passed first.
+    char *dn;                                   //!< DN of the entry, NULL if entry has not been found yet.
+    bool ambiguous;                             //!< More than one entry has the name.
+    bool failed;                                //!< Search for the name has failed.
+} resolver_name_t;
+
+/*!
+ * @brief resolver_t - Resolution of names.
+ */
+typedef struct resolver_s
+{
+    struct ldap_connection_ctx_t *connection;   //!< Connection to work with.
+
+    char *base_dn;                              //!< Base of the searches.
+    char *attribute;                            //!< Attribute holding names.
+    char *filter;                               //!< Filter combined with every chunk, may be NULL.
+    ld_dn_t *base;                              //!< Parsed base, cached entries have to be located under it.
+    ld_filter_program_t *program;               //!< Compiled filter cached entries have to match, may be NULL.
+    resolver_name_t *cached_item;               //!< Name looked up in the entry cache.
+    char *attrs[2];                             //!< Attributes requested by searches.
+
+    const char **names;                         //!< Names as they have been passed.
+    int n_names;                                //!< Amount of names.
+    resolver_name_t **items;                    //!< Distinct name of every passed name.
+    GHashTable *by_key;                         //!< Case folded name to resolver_name_t.
+    GPtrArray *pending;                         //!< Names that have to be searched for.
+    guint next;                                 //!< Index of the first pending name not sent yet.
+
+    unsigned int window;                        //!< Maximum amount of searches in flight.
+    unsigned int in_flight;                     //!< Amount of searches in flight.
+    bool failed;                                //!< At least one search has failed.
+
+    resolve_complete_callback_fn callback;      //!< Callback to call on completion.
+    void *user_data;                            //!< User data passed to callback.
+} resolver_t;
+
+/*!
+ * @brief resolver_chunk_t - Names sent in one search.
+ */
+typedef struct resolver_chunk_s
+{
+    resolver_t *resolver;                       //!< Resolver chunk belongs to.
+    guint first;                                //!< Index of the first pending name of the chunk.
+    guint count;                                //!< Amount of names in the chunk.
+} resolver_chunk_t;
+
+static int resolver_destructor(TALLOC_CTX *ctx)
+{
+    resolver_t *resolver = talloc_get_type_abort(ctx, resolver_t);
+
+    g_hash_table_destroy(resolver->by_key);
+    g_ptr_array_free(resolver->pending, TRUE);
+
+    return 0;
+}
+
+/**
+ * @brief resolver_store Records entry found for the value.
+ * @param[in] resolver   Resolver to work with.
+ * @param[in] value      Value of the attribute.
+ * @param[in] len        Length of the value.
+ * @param[in] dn         DN of the entry.
+ */
+static void resolver_store(resolver_t *resolver, const char *value, size_t len, const char *dn)
+{
+    char *key = g_utf8_casefold(value, len);
+    resolver_name_t *item = g_hash_table_lookup(resolver->by_key, key);
+    g_free(key);
+
+    if (!item)
+    {
+        return;
+    }
+
+    if (!item->dn)
+    {
+        item->dn = talloc_strdup(item, dn);
+    }
+    else if (strcasecmp(item->dn, dn) != 0)
+    {
+        item->ambiguous = true;
+    }
+}
+
+/**
+ * @brief resolver_on_cached Resolves name using entry of the entry cache having it as value of the attribute.
+ *
+ * Entry is used only if search would have returned it, i.e. it is located under the base and matches the filter.
+ */
+static void resolver_on_cached(ld_entry_t *entry, void *user_data)
+{
+    resolver_t *resolver = user_data;
+    resolver_name_t *item = resolver->cached_item;
+    const char *dn = ld_entry_get_dn(entry);
+
+    if (item->dn || !dn)
+    {
+        return;
+    }
+
+    ld_dn_t *parsed = ld_dn_parse(NULL, dn, resolver->connection->schema);
+    bool in_base = parsed && (ld_dn_equal(parsed, resolver->base) || ld_dn_is_descendant(parsed, resolver->base));
+    talloc_free(parsed);
+
+    if (!in_base || (resolver->program && !ld_filter_match(resolver->program, entry)))
+    {
+        return;
+    }
+
+    item->dn = talloc_strdup(item, dn);
+}
+
+/**
+ * @brief resolver_complete Passes results to the callback and releases resolver.
+ */
+static void resolver_complete(resolver_t *resolver)
+{
+    ld_resolve_result_t *results = NULL;
+    enum OperationReturnCode rc = resolver->failed ? RETURN_CODE_FAILURE : RETURN_CODE_SUCCESS;
+
+    if (resolver->n_names > 0)
+    {
+        results = talloc_zero_array(resolver, ld_resolve_result_t, resolver->n_names);
+        if (!results)
+        {
+            ld_error("resolver_complete - out of memory - unable to create results!\n");
+            rc = RETURN_CODE_FAILURE;
+        }
+    }
+
+    for (int i = 0; results && i < resolver->n_names; ++i)
+    {
+        resolver_name_t *item = resolver->items[i];
+
+        results[i].name = resolver->names[i];
+        results[i].dn = item ? item->dn : NULL;
+        results[i].ambiguous = item ? item->ambiguous : false;
+        results[i].rc = item && item->failed ? RETURN_CODE_FAILURE : RETURN_CODE_SUCCESS;
+    }
+
+    if (resolver->callback)
+    {
+        resolver->callback(results, results ? resolver->n_names : 0, rc, resolver->user_data);
+    }
+
+    talloc_free(resolver);
+}
+
+/**
+ * @brief resolver_fail_names Marks pending names as failed.
+ */
+static void resolver_fail_names(resolver_t *resolver, guint first, guint count)
+{
+    for (guint i = first; i < first + count && i < resolver->pending->len; ++i)
+    {
+        resolver_name_t *item = g_ptr_array_index(resolver->pending, i);
+        item->failed = true;
+    }
+
+    resolver->failed = true;
+}
+
+static enum OperationReturnCode resolver_on_read(int rc, LDAPMessage *message,
+                                                 struct ldap_connection_ctx_t *connection);
+
+/**
+ * @brief resolver_send Sends search for the next chunk of pending names.
+ *
+ * Chunk is limited both by amount of values and by length of the filter.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode resolver_send(resolver_t *resolver)
+{
+    struct ldap_connection_ctx_t *connection = resolver->connection;
+    resolver_chunk_t *chunk = NULL;
+    GString *values = NULL;
+    char *filter = NULL;
+    int msgid = 0;
+
+    ld_talloc_zero(chunk, error_exit, resolver, resolver_chunk_t);
+
+    chunk->resolver = resolver;
+    chunk->first = resolver->next;
+
+    values = g_string_new(NULL);
+
+    while (resolver->next < resolver->pending->len && chunk->count < RESOLVER_MAX_VALUES)
+    {
+        resolver_name_t *item = g_ptr_array_index(resolver->pending, resolver->next);
+
+        char *escaped = ld_filter_escape_value(chunk, item->name, strlen(item->name));
+        if (!escaped)
+        {
+            goto error_exit;
+        }
+
+        size_t length = strlen(resolver->attribute) + strlen(escaped) + 3;
+        if (chunk->count > 0 && values->len + length > RESOLVER_MAX_FILTER_LENGTH)
+        {
+            break;
+        }
+
+        g_string_append_printf(values, "(%s=%s)", resolver->attribute, escaped);
+        talloc_free(escaped);
+
+        ++chunk->count;
+        ++resolver->next;
+    }
+
+    if (resolver->filter)
+    {
+        ld_talloc_asprintf(filter, error_exit, chunk, "(&%s(|%s))", resolver->filter, values->str);
+    }
+    else
+    {
+        ld_talloc_asprintf(filter, error_exit, chunk, "(|%s)", values->str);
+    }
+
+    g_string_free(values, TRUE);
+    values = NULL;
+
+    int rc = ldap_search_ext(connection->ldap,
+                             resolver->base_dn,
+                             LDAP_SCOPE_SUBTREE,
+                             filter,
+                             resolver->attrs,
+                             0,
+                             NULL,
+                             NULL,
+                             NULL,
+                             LDAP_NO_LIMIT,
+                             &msgid);
+
+    if (rc != LDAP_SUCCESS)
+    {
+        ld_error("Unable to create resolve request: %s\n", ldap_err2string(rc));
+        goto error_exit;
+    }
+
+    if (connection_add_stream_request(connection, msgid, resolver_on_read, chunk) != RETURN_CODE_SUCCESS)
+    {
+        ldap_abandon_ext(connection->ldap, msgid, NULL, NULL);
+        goto error_exit;
+    }
+
+    talloc_free(filter);
+
+    ++resolver->in_flight;
+
+    return RETURN_CODE_SUCCESS;
+
+    error_exit:
+        if (values)
+        {
+            g_string_free(values, TRUE);
+        }
+
+        if (chunk)
+        {
+            resolver->next = chunk->first + chunk->count;
+            resolver_fail_names(resolver, chunk->first, chunk->count);
+            talloc_free(chunk);
+        }
+
+        return RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief resolver_dispatch Sends searches while window allows, completes resolver once all searches are done.
+ */
+static void resolver_dispatch(resolver_t *resolver)
+{
+    while (resolver->in_flight < resolver->window && resolver->next < resolver->pending->len)
+    {
+        if (resolver_send(resolver) != RETURN_CODE_SUCCESS)
+        {
+            // Connection is unlikely to accept other searches, remaining names are failed too.
+            resolver_fail_names(resolver, resolver->next, resolver->pending->len - resolver->next);
+            resolver->next = resolver->pending->len;
+        }
+    }
+
+    if (resolver->in_flight == 0 && resolver->next >= resolver->pending->len)
+    {
+        resolver_complete(resolver);
+    }
+}
+
+/**
+ * @brief resolver_chunk_done Releases completed chunk and sends next one.
+ */
+static void resolver_chunk_done(resolver_chunk_t *chunk, bool failed)
+{
+    resolver_t *resolver = chunk->resolver;
+
+    if (failed)
+    {
+        resolver_fail_names(resolver, chunk->first, chunk->count);
+    }
+
+    talloc_free(chunk);
+
+    --resolver->in_flight;
+
+    // Resolver may be released here.
+    resolver_dispatch(resolver);
+}
+
+/**
+ * @brief resolver_on_read This callback is called when search results of the chunk arrive.
+ * @param[in] rc            Return code of ldap_result.
+ * @param[in] message       Message received from ldap.
+ * @param[in] connection    Connection to work with.
+ * @return
+ *        - RETURN_CODE_OPERATION_IN_PROGRESS while results are being received.
+ *        - RETURN_CODE_SUCCESS when request has been completed.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode resolver_on_read(int rc, LDAPMessage *message,
+                                                 struct ldap_connection_ctx_t *connection)
+{
+    resolver_chunk_t *chunk = connection->request_user_data;
+
+    if (!chunk)
+    {
+        ld_error("resolver_on_read - chunk is missing!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (rc == LDAP_RES_ANY)
+    {
+        resolver_chunk_done(chunk, true);
+        return RETURN_CODE_SUCCESS;
+    }
+
+    resolver_t *resolver = chunk->resolver;
+
+    for (LDAPMessage *current = ldap_first_message(connection->ldap, message);
+         current != NULL;
+         current = ldap_next_message(connection->ldap, current))
+    {
+        switch (ldap_msgtype(current))
+        {
+        case LDAP_RES_SEARCH_ENTRY:
+        {
+            char *dn = ldap_get_dn(connection->ldap, current);
+            struct berval **values = ldap_get_values_len(connection->ldap, current, resolver->attribute);
+
+            for (int i = 0; dn && values && values[i] != NULL; ++i)
+            {
+                resolver_store(resolver, values[i]->bv_val, values[i]->bv_len, dn);
+            }
+
+            ldap_value_free_len(values);
+            ldap_memfree(dn);
+        }
+            break;
+        case LDAP_RES_SEARCH_REFERENCE:
+            ld_info("Received search referral but not following it!");
+            break;
+        case LDAP_RES_SEARCH_RESULT:
+        {
+            int error_code = 0;
+            char *diagnostic_message = NULL;
+
+            if (ldap_parse_result(connection->ldap, current, &error_code, NULL, &diagnostic_message, NULL, NULL, 0)
+                != LDAP_SUCCESS)
+            {
+                error_code = LDAP_OTHER;
+            }
+
+            if (error_code != LDAP_SUCCESS)
+            {
+                ld_error("Resolve request failed: %s %s\n", ldap_err2string(error_code),
+                         diagnostic_message ? diagnostic_message : "");
+            }
+
+            ldap_memfree(diagnostic_message);
+
+            resolver_chunk_done(chunk, error_code != LDAP_SUCCESS);
+        }
+            return RETURN_CODE_SUCCESS;
+        default:
+            break;
+        }
+    }
+
+    return RETURN_CODE_OPERATION_IN_PROGRESS;
+}
+
+/**
+ * @brief ld_resolve_names Finds DNs of entries by values of the attribute.
+ *
+ * Names are matched case insensitively, every distinct name is searched for once. Names found in the entry cache
+ * of the connection in entries under the base matching the filter are not searched for, ambiguity of such names
+ * is not detected.
+ * Callback may be called before function returns.
+ * @param[in] ctx               Talloc ctx to use.
+ * @param[in] connection        Connection to work with, should be in LDAP_CONNECTION_STATE_RUN state.
+ * @param[in] base_dn           Base of the searches.
+ * @param[in] attribute         Attribute holding names, e.g. sAMAccountName or uid.
+ * @param[in] names             Names to resolve.
+ * @param[in] n_names           Amount of names.
+ * @param[in] filter            Filter entries have to match, e.g. (objectClass=user), may be NULL.
+ * @param[in] window            Maximum amount of searches in flight, 0 for default.
+ * @param[in] callback          Callback to pass results to.
+ * @param[in] user_data         User data passed to callback.
+ * @return
+ *        - RETURN_CODE_SUCCESS if resolution has been started.
+ *        - RETURN_CODE_FAILURE on failure, callback is not called.
+ */
+enum OperationReturnCode ld_resolve_names(TALLOC_CTX *ctx,
+                                          struct ldap_connection_ctx_t *connection,
+                                          const char *base_dn,
+                                          const char *attribute,
+                                          const char **names,
+                                          int n_names,
+                                          const char *filter,
+                                          unsigned int window,
+                                          resolve_complete_callback_fn callback,
+                                          void *user_data)
+{
+    resolver_t *resolver = NULL;
+
+    if (!connection || !base_dn || !attribute || strlen(attribute) == 0 || (!names && n_names > 0) || n_names < 0
+        || !callback)
+    {
+        ld_error("ld_resolve_names - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    for (int i = 0; i < n_names; ++i)
+    {
+        if (!names[i])
+        {
+            ld_error("ld_resolve_names - invalid parameters!\n");
+            return RETURN_CODE_FAILURE;
+        }
+    }
+
+    ld_talloc_zero_e(resolver, error_exit, "ld_resolve_names - out of memory - unable to create resolver!\n",
+                     ctx, resolver_t);
+
+    resolver->by_key = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    resolver->pending = g_ptr_array_new();
+    talloc_set_destructor((void*)resolver, resolver_destructor);
+
+    resolver->connection = connection;
+    resolver->names = names;
+    resolver->n_names = n_names;
+    resolver->window = window == 0 ? RESOLVER_DEFAULT_WINDOW : MIN(window, RESOLVER_MAX_WINDOW);
+    resolver->callback = callback;
+    resolver->user_data = user_data;
+
+    ld_talloc_strdup(resolver->base_dn, error_exit, resolver, base_dn);
+    ld_talloc_strdup(resolver->attribute, error_exit, resolver, attribute);
+    if (filter && strlen(filter) > 0)
+    {
+        ld_talloc_strdup(resolver->filter, error_exit, resolver, filter);
+    }
+    resolver->attrs[0] = resolver->attribute;
+    resolver->attrs[1] = NULL;
+
+    if (n_names > 0)
+    {
+        ld_talloc_zero_array(resolver->items, error_exit, resolver, resolver_name_t*, n_names);
+    }
+
+    for (int i = 0; i < n_names; ++i)
+    {
+        // Empty name can not be matched, it is reported as missing.
+        if (strlen(names[i]) == 0)
+        {
+            continue;
+        }
+
+        char *key = g_utf8_casefold(names[i], -1);
+        resolver_name_t *item = g_hash_table_lookup(resolver->by_key, key);
+
+        if (!item)
+        {
+            item = talloc_zero(resolver, resolver_name_t);
+            if (!item)
+            {
+                g_free(key);
+                ld_error("ld_resolve_names - out of memory - unable to create name!\n");
+                goto error_exit;
+            }
+
+            item->name = names[i];
+            g_hash_table_insert(resolver->by_key, key, item);
+        }
+        else
+        {
+            g_free(key);
+        }
+
+        resolver->items[i] = item;
+    }
+
+    // Cached entries are checked against base and filter, entries filter can't be evaluated for are searched for.
+    if (connection->entry_cache)
+    {
+        resolver->base = ld_dn_parse(resolver, base_dn, connection->schema);
+        if (resolver->filter)
+        {
+            resolver->program = ld_filter_compile_string(resolver, resolver->filter, connection->schema);
+        }
+    }
+
+    bool use_cache = resolver->base && (!resolver->filter || resolver->program);
+
+    GHashTableIter iterator;
+    gpointer value = NULL;
+
+    g_hash_table_iter_init(&iterator, resolver->by_key);
+    while (g_hash_table_iter_next(&iterator, NULL, &value))
+    {
+        resolver_name_t *item = value;
+
+        if (use_cache)
+        {
+            resolver->cached_item = item;
+            ld_entry_cache_foreach_by_value(connection->entry_cache, resolver->attribute, item->name,
+                                            resolver_on_cached, resolver);
+        }
+
+        if (!item->dn)
+        {
+            g_ptr_array_add(resolver->pending, item);
+        }
+    }
+
+    // Resolver may be released here.
+    resolver_dispatch(resolver);
+
+    return RETURN_CODE_SUCCESS;
+
+    error_exit:
+        talloc_free(resolver);
+        return RETURN_CODE_FAILURE;
+}
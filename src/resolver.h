@@ -0,0 +1,68 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_RESOLVER_H
+#define LIBDOMAIN_RESOLVER_H
+
+#include "common.h"
+#include "connection.h"
+
+#include <stdbool.h>
+
+/**
+ * Resolver turns many attribute values such as sAMAccountName or uid into DNs. Values are packed into OR filters
+ * sized to stay within server filter limits and the resulting searches run concurrently. Entries of the entry cache
+ * of the connection are consulted first.
+ */
+
+/*!
+ * @brief ld_resolve_result_t - Result of the name.
+ */
+typedef struct ld_resolve_result_s
+{
+    const char *name;                   //!< Name as it has been passed.
+    const char *dn;                     //!< DN of the entry, NULL if no entry has this name.
+    bool ambiguous;                     //!< More than one entry has this name, dn holds one of them.
+    enum OperationReturnCode rc;        //!< RETURN_CODE_FAILURE if search for the name has failed.
+} ld_resolve_result_t;
+
+/**
+ * @brief resolve_complete_callback_fn Callback fired once all names have been resolved.
+ *
+ * Return code is RETURN_CODE_SUCCESS only if all searches have succeeded, names without entries are not failures.
+ * @param[in] results           Results in order of names, valid only during the call.
+ */
+typedef void (*resolve_complete_callback_fn)(const ld_resolve_result_t *results,
+                                             int n_names,
+                                             enum OperationReturnCode rc,
+                                             void *user_data);
+
+enum OperationReturnCode ld_resolve_names(TALLOC_CTX *ctx,
+                                          struct ldap_connection_ctx_t *connection,
+                                          const char *base_dn,
+                                          const char *attribute,
+                                          const char **names,
+                                          int n_names,
+                                          const char *filter,
+                                          unsigned int window,
+                                          resolve_complete_callback_fn callback,
+                                          void *user_data);
+
+#endif //LIBDOMAIN_RESOLVER_H
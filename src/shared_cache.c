@@ -0,0 +1,1105 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "shared_cache.h"
+#include "dn.h"
+#include "domain.h"
+#include "entry.h"
+#include "entry_p.h"
+
+#include "helper_p.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib-2.0/glib.h>
+
+#define SHARED_CACHE_MAGIC "LDSHCACH"
+#define SHARED_CACHE_VERSION 1
+#define SHARED_CACHE_MIN_SLOTS 64
+#define SHARED_CACHE_BYTES_PER_SLOT 1024
+#define SHARED_CACHE_MAX_RETRIES 64
+
+enum SharedCacheSlotState
+{
+    SHARED_CACHE_SLOT_EMPTY   = 0,
+    SHARED_CACHE_SLOT_USED    = 1,
+    SHARED_CACHE_SLOT_DELETED = 2,
+};
+
+/*!
+ * @brief shared_cache_header_t - Header of shared memory segment.
+ *
+ * Header is followed by the table of slots and the arena with entry records. Records are referred to by
+ * offsets from the start of the arena, so segment may be mapped at any address.
+ */
+typedef struct shared_cache_header_s
+{
+    char magic[8];                      //!< SHARED_CACHE_MAGIC, written last when segment is initialized.
+    uint32_t version;                   //!< Version of the layout.
+    uint32_t slot_count;                //!< Amount of slots, power of two.
+    uint64_t size;                      //!< Size of the segment.
+    uint64_t arena_offset;              //!< Offset of the arena from the start of the segment.
+    uint64_t arena_size;                //!< Size of the arena.
+    uint64_t generation;                //!< Odd while writer rebuilds the segment.
+    uint64_t arena_used;                //!< Bytes of the arena occupied by records, dead records included.
+    uint32_t entry_count;               //!< Amount of live entries.
+    uint32_t occupied;                  //!< Amount of used and deleted slots.
+    uint32_t retired;                   //!< Segment has been replaced, readers must open it again.
+    uint32_t reserved;                  //!< Always zero.
+} shared_cache_header_t;
+
+/*!
+ * @brief shared_cache_slot_t - Slot of open addressing hash table, protected by its own sequence lock.
+ */
+typedef struct shared_cache_slot_s
+{
+    uint32_t sequence;                  //!< Odd while writer changes the slot.
+    uint32_t state;                     //!< SharedCacheSlotState.
+    uint64_t hash;                      //!< Hash of canonical DN.
+    uint64_t offset;                    //!< Offset of the record in the arena.
+    uint64_t length;                    //!< Length of the record.
+    int64_t published;                  //!< Monotonic time record has been published at.
+    int64_t expires;                    //!< Monotonic time record expires at, 0 if it never expires.
+} shared_cache_slot_t;
+
+/*!
+ * @brief ld_shared_cache_t - Handle of shared cache segment.
+ */
+struct ld_shared_cache_s
+{
+    char *name;                         //!< Name of POSIX shared memory object.
+    bool writer;                        //!< Handle belongs to the writer process.
+    bool partial_updates;               //!< Modifications reported by synchronization carry only changed attributes.
+    gint64 ttl;                         //!< Time to live of published entries in microseconds, 0 for unlimited.
+
+    int fd;                             //!< Descriptor of shared memory object, -1 if segment is not mapped.
+    void *segment;                      //!< Mapping of the segment.
+    size_t size;                        //!< Size of the mapping.
+    shared_cache_header_t *header;      //!< Header of the segment.
+    shared_cache_slot_t *slots;         //!< Slots of the segment.
+    char *arena;                        //!< Arena of the segment.
+
+    gint64 cleared;                     //!< Reader ignores records published before this time.
+    GHashTable *invalidated;            //!< Reader ignores records of these DNs published before stored time.
+    GHashTable *invalidated_subtrees;   //!< Same for records of subtrees.
+};
+
+static void shared_cache_unmap(ld_shared_cache_t *cache)
+{
+    if (cache->segment)
+    {
+        munmap(cache->segment, cache->size);
+    }
+
+    if (cache->fd >= 0)
+    {
+        close(cache->fd);
+    }
+
+    cache->fd = -1;
+    cache->segment = NULL;
+    cache->size = 0;
+    cache->header = NULL;
+    cache->slots = NULL;
+    cache->arena = NULL;
+}
+
+static int shared_cache_destructor(TALLOC_CTX *ctx)
+{
+    ld_shared_cache_t *cache = ctx;
+
+    shared_cache_unmap(cache);
+    g_hash_table_destroy(cache->invalidated);
+    g_hash_table_destroy(cache->invalidated_subtrees);
+
+    return 0;
+}
+
+static uint64_t shared_cache_arena_offset(uint32_t slot_count)
+{
+    return (sizeof(shared_cache_header_t) + (uint64_t)slot_count * sizeof(shared_cache_slot_t) + 7) & ~(uint64_t)7;
+}
+
+static bool shared_cache_check_layout(const shared_cache_header_t *header, size_t size)
+{
+    if (memcmp(header->magic, SHARED_CACHE_MAGIC, sizeof(header->magic)) != 0)
+    {
+        return false;
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return header->version == SHARED_CACHE_VERSION
+           && header->size == size
+           && header->slot_count >= SHARED_CACHE_MIN_SLOTS
+           && (header->slot_count & (header->slot_count - 1)) == 0
+           && header->arena_offset == shared_cache_arena_offset(header->slot_count)
+           && header->arena_offset <= size
+           && header->arena_size <= size - header->arena_offset;
+}
+
+static void shared_cache_set_mapping(ld_shared_cache_t *cache, int fd, void *segment, size_t size)
+{
+    cache->fd = fd;
+    cache->segment = segment;
+    cache->size = size;
+    cache->header = segment;
+    cache->slots = (shared_cache_slot_t *)((char *)segment + sizeof(shared_cache_header_t));
+    cache->arena = (char *)segment + cache->header->arena_offset;
+}
+
+/**
+ * @brief shared_cache_map_reader Maps segment created by the writer, segment replaced by the writer is mapped again.
+ * @param[in] cache               Reader handle.
+ * @return
+ *        - true if segment is mapped.
+ *        - false if segment does not exist yet or is not initialized.
+ */
+static bool shared_cache_map_reader(ld_shared_cache_t *cache)
+{
+    if (cache->header)
+    {
+        if (!__atomic_load_n(&cache->header->retired, __ATOMIC_ACQUIRE))
+        {
+            return true;
+        }
+
+        shared_cache_unmap(cache);
+    }
+
+    int fd = shm_open(cache->name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(shared_cache_header_t))
+    {
+        close(fd);
+        return false;
+    }
+
+    void *segment = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (segment == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+
+    if (!shared_cache_check_layout(segment, (size_t)st.st_size))
+    {
+        munmap(segment, (size_t)st.st_size);
+        close(fd);
+        return false;
+    }
+
+    shared_cache_set_mapping(cache, fd, segment, (size_t)st.st_size);
+
+    return true;
+}
+
+static ld_shared_cache_t *shared_cache_new(TALLOC_CTX *ctx, const char *name, bool writer)
+{
+    ld_shared_cache_t *result = NULL;
+
+    ld_talloc_zero_e(result, error_exit, "shared_cache_new - out of memory - unable to create shared cache!\n",
+                     ctx, ld_shared_cache_t);
+
+    // POSIX shared memory object names start with a slash.
+    ld_talloc_asprintf(result->name, error_exit, result, "%s%s", name[0] == '/' ? "" : "/", name);
+
+    result->writer = writer;
+    result->fd = -1;
+    result->invalidated = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    result->invalidated_subtrees = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    talloc_set_destructor(result, shared_cache_destructor);
+
+    return result;
+
+    error_exit:
+        talloc_free(result);
+        return NULL;
+}
+
+static void shared_cache_begin_rebuild(shared_cache_header_t *header)
+{
+    __atomic_store_n(&header->generation, header->generation + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void shared_cache_end_rebuild(shared_cache_header_t *header)
+{
+    __atomic_store_n(&header->generation, header->generation + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief shared_cache_reset Removes all records, must be called by the writer.
+ */
+static void shared_cache_reset(ld_shared_cache_t *cache)
+{
+    shared_cache_header_t *header = cache->header;
+
+    shared_cache_begin_rebuild(header);
+
+    memset(cache->slots, 0, (size_t)header->slot_count * sizeof(shared_cache_slot_t));
+    header->arena_used = 0;
+    header->occupied = 0;
+    __atomic_store_n(&header->entry_count, 0, __ATOMIC_RELAXED);
+
+    shared_cache_end_rebuild(header);
+}
+
+/**
+ * @brief shared_cache_retire Tells readers of existing segment to open the new one and removes its name.
+ */
+static void shared_cache_retire(const char *name, int fd)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(shared_cache_header_t))
+    {
+        void *segment = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (segment != MAP_FAILED)
+        {
+            __atomic_store_n(&((shared_cache_header_t *)segment)->retired, 1, __ATOMIC_RELEASE);
+            munmap(segment, (size_t)st.st_size);
+        }
+    }
+
+    shm_unlink(name);
+}
+
+/**
+ * @brief ld_shared_cache_create Creates shared cache segment and makes the process its only writer.
+ *
+ * Existing segment of the same size is reused and emptied. Segment of another size is retired,
+ * its readers switch to the new segment on their next lookup.
+ * @param[in] ctx          Talloc ctx to use.
+ * @param[in] name         Name of the segment, e.g. "libdomain-cache".
+ * @param[in] size         Size of the segment in bytes.
+ * @param[in] ttl          Time to live of published entries in seconds, 0 for unlimited.
+ * @return
+ *        - Writer handle.
+ *        - NULL if another process is the writer or on failure.
+ */
+ld_shared_cache_t *ld_shared_cache_create(TALLOC_CTX *ctx, const char *name, size_t size, unsigned int ttl)
+{
+    if (!name || name[0] == '\0')
+    {
+        ld_error("ld_shared_cache_create - invalid name!\n");
+        return NULL;
+    }
+
+    uint32_t slot_count = SHARED_CACHE_MIN_SLOTS;
+    while (slot_count < UINT32_MAX / 2 && (uint64_t)slot_count * 2 * SHARED_CACHE_BYTES_PER_SLOT <= size)
+    {
+        slot_count *= 2;
+    }
+
+    uint64_t arena_offset = shared_cache_arena_offset(slot_count);
+    if (size <= arena_offset)
+    {
+        ld_error("ld_shared_cache_create - size %zu is too small!\n", size);
+        return NULL;
+    }
+
+    ld_shared_cache_t *result = shared_cache_new(ctx, name, true);
+    if (!result)
+    {
+        return NULL;
+    }
+
+    result->ttl = (gint64)ttl * G_USEC_PER_SEC;
+
+    int fd = shm_open(result->name, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        ld_error("ld_shared_cache_create - unable to open %s: %s\n", result->name, strerror(errno));
+        goto error_exit;
+    }
+
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0)
+    {
+        ld_error("ld_shared_cache_create - %s already has a writer!\n", result->name);
+        close(fd);
+        goto error_exit;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        goto error_exit;
+    }
+
+    if (st.st_size != 0 && (size_t)st.st_size != size)
+    {
+        // Shrinking the object would crash readers that still map it.
+        shared_cache_retire(result->name, fd);
+        close(fd);
+
+        fd = shm_open(result->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd < 0 || flock(fd, LOCK_EX | LOCK_NB) != 0)
+        {
+            ld_error("ld_shared_cache_create - unable to recreate %s: %s\n", result->name, strerror(errno));
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            goto error_exit;
+        }
+        st.st_size = 0;
+    }
+
+    if (st.st_size == 0 && ftruncate(fd, (off_t)size) != 0)
+    {
+        ld_error("ld_shared_cache_create - unable to resize %s: %s\n", result->name, strerror(errno));
+        close(fd);
+        goto error_exit;
+    }
+
+    void *segment = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (segment == MAP_FAILED)
+    {
+        ld_error("ld_shared_cache_create - unable to map %s: %s\n", result->name, strerror(errno));
+        close(fd);
+        goto error_exit;
+    }
+
+    shared_cache_header_t *header = segment;
+
+    if (shared_cache_check_layout(header, size) && header->slot_count == slot_count)
+    {
+        shared_cache_set_mapping(result, fd, segment, size);
+        shared_cache_reset(result);
+        return result;
+    }
+
+    // Hide the header from readers while it is being written.
+    memset(header->magic, 0, sizeof(header->magic));
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    header->version = SHARED_CACHE_VERSION;
+    header->slot_count = slot_count;
+    header->size = size;
+    header->arena_offset = arena_offset;
+    header->arena_size = size - arena_offset;
+    header->generation = header->generation & 1 ? header->generation + 1 : header->generation;
+    header->retired = 0;
+    header->reserved = 0;
+
+    shared_cache_set_mapping(result, fd, segment, size);
+    shared_cache_reset(result);
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(header->magic, SHARED_CACHE_MAGIC, sizeof(header->magic));
+
+    return result;
+
+    error_exit:
+        talloc_free(result);
+        return NULL;
+}
+
+/**
+ * @brief ld_shared_cache_open Creates reader handle of shared cache segment.
+ *
+ * Segment is mapped on first lookup, so readers may start before the writer.
+ * @param[in] ctx          Talloc ctx to use.
+ * @param[in] name         Name of the segment.
+ * @return
+ *        - Reader handle.
+ *        - NULL on failure.
+ */
+ld_shared_cache_t *ld_shared_cache_open(TALLOC_CTX *ctx, const char *name)
+{
+    if (!name || name[0] == '\0')
+    {
+        ld_error("ld_shared_cache_open - invalid name!\n");
+        return NULL;
+    }
+
+    ld_shared_cache_t *result = shared_cache_new(ctx, name, false);
+    if (result)
+    {
+        shared_cache_map_reader(result);
+    }
+
+    return result;
+}
+
+/**
+ * @brief ld_shared_cache_unlink Removes shared cache segment, processes that map it keep their mappings.
+ * @param[in] name                Name of the segment.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_shared_cache_unlink(const char *name)
+{
+    if (!name || name[0] == '\0')
+    {
+        ld_error("ld_shared_cache_unlink - invalid name!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    char *path = g_strdup_printf("%s%s", name[0] == '/' ? "" : "/", name);
+    int rc = shm_unlink(path);
+    g_free(path);
+
+    return rc == 0 ? RETURN_CODE_SUCCESS : RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief ld_shared_cache_is_writer Checks whether handle has been created by ld_shared_cache_create.
+ */
+bool ld_shared_cache_is_writer(const ld_shared_cache_t *cache)
+{
+    return cache && cache->writer;
+}
+
+/**
+ * @brief ld_shared_cache_set_partial_updates Sets whether modifications carry only changed attributes.
+ * @param[in] cache                          Writer handle.
+ * @param[in] partial_updates                Merge modifications into published entries.
+ */
+void ld_shared_cache_set_partial_updates(ld_shared_cache_t *cache, bool partial_updates)
+{
+    if (!cache)
+    {
+        ld_error("ld_shared_cache_set_partial_updates - invalid cache!\n");
+        return;
+    }
+
+    cache->partial_updates = partial_updates;
+}
+
+/**
+ * @brief shared_cache_encode Serializes entry into record, record is the canonical DN followed by the entry.
+ */
+static GByteArray *shared_cache_encode(ld_entry_t *entry, const char *key)
+{
+    GByteArray *result = g_byte_array_new();
+
+    g_byte_array_append(result, (const guint8 *)key, strlen(key) + 1);
+    entry_serialize(entry, result);
+
+    return result;
+}
+
+/**
+ * @brief shared_cache_decode Creates entry from record produced by shared_cache_encode.
+ * @return
+ *        - Entry.
+ *        - NULL if record is malformed or on failure.
+ */
+static ld_entry_t *shared_cache_decode(TALLOC_CTX *ctx, const char *record, size_t length)
+{
+    const char *key_end = memchr(record, '\0', length);
+
+    if (!key_end)
+    {
+        return NULL;
+    }
+
+    return entry_deserialize(ctx, key_end + 1, length - (key_end + 1 - record));
+}
+
+/**
+ * @brief shared_cache_set_slot Changes slot under its sequence lock, must be called by the writer.
+ */
+static void shared_cache_set_slot(shared_cache_slot_t *slot, uint32_t state, uint64_t hash, uint64_t offset,
+                                  uint64_t length, int64_t published, int64_t expires)
+{
+    uint32_t sequence = slot->sequence;
+
+    __atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    __atomic_store_n(&slot->state, state, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->hash, hash, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->offset, offset, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->length, length, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->published, published, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->expires, expires, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief shared_cache_find_slot Finds slot of the record, must be called by the writer.
+ * @param[in] cache               Writer handle.
+ * @param[in] key                 Canonical DN.
+ * @param[in] hash                Hash of canonical DN.
+ * @param[out] free_slot          First slot the record can be stored to, may be NULL.
+ * @return
+ *        - Slot holding record of the DN.
+ *        - NULL if there is no such record.
+ */
+static shared_cache_slot_t *shared_cache_find_slot(ld_shared_cache_t *cache, const char *key, uint64_t hash,
+                                                   shared_cache_slot_t **free_slot)
+{
+    uint32_t mask = cache->header->slot_count - 1;
+    shared_cache_slot_t *available = NULL;
+
+    for (uint32_t i = 0, index = hash & mask; i <= mask; ++i, index = (index + 1) & mask)
+    {
+        shared_cache_slot_t *slot = &cache->slots[index];
+
+        if (slot->state == SHARED_CACHE_SLOT_EMPTY)
+        {
+            available = available ? available : slot;
+            break;
+        }
+
+        if (slot->state == SHARED_CACHE_SLOT_DELETED)
+        {
+            available = available ? available : slot;
+        }
+        else if (slot->hash == hash && strcmp(cache->arena + slot->offset, key) == 0)
+        {
+            return slot;
+        }
+    }
+
+    if (free_slot)
+    {
+        *free_slot = available;
+    }
+
+    return NULL;
+}
+
+static void shared_cache_remove_slot(ld_shared_cache_t *cache, shared_cache_slot_t *slot)
+{
+    shared_cache_set_slot(slot, SHARED_CACHE_SLOT_DELETED, 0, 0, 0, 0, 0);
+    __atomic_store_n(&cache->header->entry_count, cache->header->entry_count - 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief shared_cache_compact Drops dead and expired records and deleted slots, must be called by the writer.
+ *
+ * Readers copying a record while the segment is rebuilt notice changed generation and retry.
+ */
+static void shared_cache_compact(ld_shared_cache_t *cache)
+{
+    shared_cache_header_t *header = cache->header;
+    gint64 now = g_get_monotonic_time();
+    GByteArray *records = g_byte_array_new();
+    GArray *slots = g_array_new(FALSE, FALSE, sizeof(shared_cache_slot_t));
+
+    for (uint32_t i = 0; i < header->slot_count; ++i)
+    {
+        shared_cache_slot_t slot = cache->slots[i];
+
+        if (slot.state == SHARED_CACHE_SLOT_USED && (slot.expires == 0 || slot.expires > now))
+        {
+            slot.offset = records->len;
+            g_byte_array_append(records, (const guint8 *)cache->arena + cache->slots[i].offset, slot.length);
+            g_array_append_val(slots, slot);
+        }
+    }
+
+    shared_cache_begin_rebuild(header);
+
+    memset(cache->slots, 0, (size_t)header->slot_count * sizeof(shared_cache_slot_t));
+    memcpy(cache->arena, records->data, records->len);
+
+    uint32_t mask = header->slot_count - 1;
+    for (guint i = 0; i < slots->len; ++i)
+    {
+        shared_cache_slot_t *slot = &g_array_index(slots, shared_cache_slot_t, i);
+        uint32_t index = slot->hash & mask;
+
+        while (cache->slots[index].state != SHARED_CACHE_SLOT_EMPTY)
+        {
+            index = (index + 1) & mask;
+        }
+
+        slot->sequence = 0;
+        cache->slots[index] = *slot;
+    }
+
+    header->arena_used = records->len;
+    header->occupied = slots->len;
+    __atomic_store_n(&header->entry_count, slots->len, __ATOMIC_RELAXED);
+
+    shared_cache_end_rebuild(header);
+
+    g_byte_array_free(records, TRUE);
+    g_array_free(slots, TRUE);
+}
+
+/**
+ * @brief shared_cache_store Stores record of the entry, must be called by the writer.
+ */
+static enum OperationReturnCode shared_cache_store(ld_shared_cache_t *cache, ld_entry_t *entry, const char *key)
+{
+    shared_cache_header_t *header = cache->header;
+    uint64_t hash = ld_dn_hash_string(key, strlen(key));
+    GByteArray *record = shared_cache_encode(entry, key);
+    enum OperationReturnCode rc = RETURN_CODE_FAILURE;
+
+    // Slots are kept at most three quarters full so probing stays short.
+    if (header->arena_size - header->arena_used < record->len || (header->occupied + 1) * 4ull > header->slot_count * 3ull)
+    {
+        shared_cache_compact(cache);
+    }
+
+    shared_cache_slot_t *free_slot = NULL;
+    shared_cache_slot_t *slot = shared_cache_find_slot(cache, key, hash, &free_slot);
+
+    if (header->arena_size - header->arena_used < record->len
+        || (!slot && (!free_slot || (header->occupied + 1) * 4ull > header->slot_count * 3ull)))
+    {
+        ld_error("shared_cache_store - shared cache %s is full!\n", cache->name);
+        goto exit;
+    }
+
+    uint64_t offset = header->arena_used;
+    memcpy(cache->arena + offset, record->data, record->len);
+    header->arena_used += record->len;
+
+    gint64 now = g_get_monotonic_time();
+
+    if (!slot)
+    {
+        slot = free_slot;
+        if (slot->state == SHARED_CACHE_SLOT_EMPTY)
+        {
+            ++header->occupied;
+        }
+        __atomic_store_n(&header->entry_count, header->entry_count + 1, __ATOMIC_RELAXED);
+    }
+
+    shared_cache_set_slot(slot, SHARED_CACHE_SLOT_USED, hash, offset, record->len, now,
+                          cache->ttl ? now + cache->ttl : 0);
+    rc = RETURN_CODE_SUCCESS;
+
+    exit:
+        g_byte_array_free(record, TRUE);
+        return rc;
+}
+
+/**
+ * @brief ld_shared_cache_publish Publishes copy of the entry to all processes, replaces previous copy.
+ * @param[in] cache                 Writer handle.
+ * @param[in] entry                 Entry to publish, caller keeps ownership.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE if handle is not a writer, entry does not fit or on failure.
+ */
+enum OperationReturnCode ld_shared_cache_publish(ld_shared_cache_t *cache, ld_entry_t *entry)
+{
+    if (!cache || !entry || !entry->dn)
+    {
+        ld_error("ld_shared_cache_publish - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (!cache->writer)
+    {
+        ld_error("ld_shared_cache_publish - %s is opened read only!\n", cache->name);
+        return RETURN_CODE_FAILURE;
+    }
+
+    char *key = ld_dn_normalize(NULL, entry->dn);
+    if (!key)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    enum OperationReturnCode rc = shared_cache_store(cache, entry, key);
+
+    talloc_free(key);
+
+    return rc;
+}
+
+/**
+ * @brief shared_cache_invalidated Checks whether record has been invalidated by this reader.
+ */
+static bool shared_cache_invalidated(ld_shared_cache_t *cache, const char *key, gint64 published)
+{
+    if (published <= cache->cleared)
+    {
+        return true;
+    }
+
+    gint64 *time = g_hash_table_lookup(cache->invalidated, key);
+    if (time && published <= *time)
+    {
+        return true;
+    }
+
+    if (g_hash_table_size(cache->invalidated_subtrees) == 0)
+    {
+        return false;
+    }
+
+    // Separators are escaped inside of canonical values, so comma always starts RDN.
+    for (const char *suffix = key; suffix; suffix = strchr(suffix, ','), suffix = suffix ? suffix + 1 : NULL)
+    {
+        time = g_hash_table_lookup(cache->invalidated_subtrees, suffix);
+        if (time && published <= *time)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief shared_cache_read Copies record of the DN out of the segment.
+ * @param[in] cache          Handle with mapped segment.
+ * @param[in] key            Canonical DN.
+ * @param[out] published     Time record has been published at.
+ * @param[out] expires       Time record expires at.
+ * @return
+ *        - Copy of the record, free it with g_byte_array_free.
+ *        - NULL if there is no record or it kept changing while it has been read.
+ */
+static GByteArray *shared_cache_read(ld_shared_cache_t *cache, const char *key, gint64 *published, gint64 *expires)
+{
+    shared_cache_header_t *header = cache->header;
+    uint64_t hash = ld_dn_hash_string(key, strlen(key));
+    uint32_t mask = header->slot_count - 1;
+    GByteArray *record = g_byte_array_new();
+
+    for (int attempt = 0; attempt < SHARED_CACHE_MAX_RETRIES; ++attempt)
+    {
+        uint64_t generation = __atomic_load_n(&header->generation, __ATOMIC_ACQUIRE);
+        if (generation & 1)
+        {
+            sched_yield();
+            continue;
+        }
+
+        bool consistent = true;
+        bool found = false;
+
+        for (uint32_t i = 0, index = hash & mask; i <= mask && consistent && !found; ++i, index = (index + 1) & mask)
+        {
+            shared_cache_slot_t *slot = &cache->slots[index];
+
+            uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+            uint32_t state = __atomic_load_n(&slot->state, __ATOMIC_RELAXED);
+            uint64_t slot_hash = __atomic_load_n(&slot->hash, __ATOMIC_RELAXED);
+            uint64_t offset = __atomic_load_n(&slot->offset, __ATOMIC_RELAXED);
+            uint64_t length = __atomic_load_n(&slot->length, __ATOMIC_RELAXED);
+            *published = __atomic_load_n(&slot->published, __ATOMIC_RELAXED);
+            *expires = __atomic_load_n(&slot->expires, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+            if ((sequence & 1) || __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != sequence)
+            {
+                consistent = false;
+                break;
+            }
+
+            if (state == SHARED_CACHE_SLOT_EMPTY)
+            {
+                break;
+            }
+
+            if (state != SHARED_CACHE_SLOT_USED || slot_hash != hash)
+            {
+                continue;
+            }
+
+            // Torn values are detected below, until then they only must not point outside of the arena.
+            if (offset > header->arena_size || length > header->arena_size - offset)
+            {
+                consistent = false;
+                break;
+            }
+
+            g_byte_array_set_size(record, (guint)length);
+            memcpy(record->data, cache->arena + offset, length);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+            if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != sequence
+                || __atomic_load_n(&header->generation, __ATOMIC_RELAXED) != generation)
+            {
+                consistent = false;
+                break;
+            }
+
+            found = memchr(record->data, '\0', record->len) && strcmp((const char *)record->data, key) == 0;
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (consistent && __atomic_load_n(&header->generation, __ATOMIC_RELAXED) == generation)
+        {
+            if (found)
+            {
+                return record;
+            }
+            break;
+        }
+    }
+
+    g_byte_array_free(record, TRUE);
+
+    return NULL;
+}
+
+/**
+ * @brief ld_shared_cache_lookup Looks up entry by DN.
+ * @param[in] cache             Handle of the segment.
+ * @param[in] ctx               Talloc ctx to allocate entry with.
+ * @param[in] dn                DN of the entry.
+ * @return
+ *        - Private copy of the entry.
+ *        - NULL if entry is not published, has expired or has been invalidated by this process.
+ */
+ld_entry_t *ld_shared_cache_lookup(ld_shared_cache_t *cache, TALLOC_CTX *ctx, const char *dn)
+{
+    if (!cache || !dn)
+    {
+        ld_error("ld_shared_cache_lookup - invalid parameters!\n");
+        return NULL;
+    }
+
+    if (!cache->writer && !shared_cache_map_reader(cache))
+    {
+        return NULL;
+    }
+
+    char *key = ld_dn_normalize(NULL, dn);
+    if (!key)
+    {
+        return NULL;
+    }
+
+    ld_entry_t *result = NULL;
+    gint64 published = 0;
+    gint64 expires = 0;
+    GByteArray *record = shared_cache_read(cache, key, &published, &expires);
+
+    if (record && (expires == 0 || expires > g_get_monotonic_time()) && !shared_cache_invalidated(cache, key, published))
+    {
+        result = shared_cache_decode(ctx, (const char *)record->data, record->len);
+    }
+
+    if (record)
+    {
+        g_byte_array_free(record, TRUE);
+    }
+    talloc_free(key);
+
+    return result;
+}
+
+/**
+ * @brief ld_shared_cache_invalidate Drops entry after it has been changed by this process.
+ *
+ * Writer removes entry from the segment. Reader can't change the segment, it ignores copies published
+ * before the invalidation until the writer publishes a fresh one.
+ * @param[in] cache                  Handle of the segment.
+ * @param[in] dn                     DN of the entry.
+ * @param[in] subtree                Drop all descendants of the entry as well.
+ */
+void ld_shared_cache_invalidate(ld_shared_cache_t *cache, const char *dn, bool subtree)
+{
+    if (!cache || !dn)
+    {
+        return;
+    }
+
+    char *key = ld_dn_normalize(NULL, dn);
+    if (!key)
+    {
+        // Entry can not be located reliably, drop everything rather than serve stale copy.
+        ld_shared_cache_clear(cache);
+        return;
+    }
+
+    if (!cache->writer)
+    {
+        gint64 *time = g_new(gint64, 1);
+        *time = g_get_monotonic_time();
+        g_hash_table_replace(subtree ? cache->invalidated_subtrees : cache->invalidated, g_strdup(key), time);
+        talloc_free(key);
+        return;
+    }
+
+    shared_cache_slot_t *slot = shared_cache_find_slot(cache, key, ld_dn_hash_string(key, strlen(key)), NULL);
+    if (slot)
+    {
+        shared_cache_remove_slot(cache, slot);
+    }
+
+    if (subtree)
+    {
+        size_t key_length = strlen(key);
+
+        for (uint32_t i = 0; i < cache->header->slot_count; ++i)
+        {
+            shared_cache_slot_t *descendant = &cache->slots[i];
+
+            if (descendant->state != SHARED_CACHE_SLOT_USED)
+            {
+                continue;
+            }
+
+            const char *descendant_key = cache->arena + descendant->offset;
+            size_t length = strlen(descendant_key);
+
+            if (length > key_length + 1
+                && descendant_key[length - key_length - 1] == ','
+                && strcmp(descendant_key + length - key_length, key) == 0)
+            {
+                shared_cache_remove_slot(cache, descendant);
+            }
+        }
+    }
+
+    talloc_free(key);
+}
+
+/**
+ * @brief ld_shared_cache_clear Drops all entries, reader only stops using entries published so far.
+ * @param[in] cache             Handle of the segment.
+ */
+void ld_shared_cache_clear(ld_shared_cache_t *cache)
+{
+    if (!cache)
+    {
+        return;
+    }
+
+    if (cache->writer)
+    {
+        shared_cache_reset(cache);
+        return;
+    }
+
+    cache->cleared = g_get_monotonic_time();
+    g_hash_table_remove_all(cache->invalidated);
+    g_hash_table_remove_all(cache->invalidated_subtrees);
+}
+
+/**
+ * @brief shared_cache_merge Publishes published entry with attributes of partial update replaced.
+ */
+static enum OperationReturnCode shared_cache_merge(ld_shared_cache_t *cache, ld_entry_t *update)
+{
+    ld_entry_t *entry = ld_shared_cache_lookup(cache, NULL, update->dn);
+    if (!entry)
+    {
+        // Entry with only changed attributes must not be served as complete one.
+        ld_shared_cache_invalidate(cache, update->dn, false);
+        return RETURN_CODE_SUCCESS;
+    }
+
+    GHashTableIter iter;
+    gpointer value = NULL;
+
+    g_hash_table_iter_init(&iter, update->attributes);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        LDAPAttribute_t *attribute = value;
+        g_hash_table_replace(entry->attributes, attribute->name, attribute);
+    }
+
+    enum OperationReturnCode rc = ld_shared_cache_publish(cache, entry);
+
+    talloc_free(entry);
+
+    return rc;
+}
+
+/**
+ * @brief ld_shared_cache_sync_change Applies change reported by directory synchronization to the segment.
+ *
+ * Function matches sync_change_callback_fn and expects writer handle as user data.
+ * @param[in] connection           Connection synchronization runs on.
+ * @param[in] change               Type of the change.
+ * @param[in] dn                   DN of the entry.
+ * @param[in] old_dn               Previous DN of renamed entry.
+ * @param[in] entry                Entry received from server, it is copied to the segment.
+ * @param[in] user_data            Writer handle.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_shared_cache_sync_change(struct ldap_connection_ctx_t *connection,
+                                                     enum LdapSyncChangeType change,
+                                                     const char *dn,
+                                                     const char *old_dn,
+                                                     ld_entry_t *entry,
+                                                     void *user_data)
+{
+    (void)(connection);
+
+    ld_shared_cache_t *cache = user_data;
+
+    if (!cache || !cache->writer)
+    {
+        ld_error("ld_shared_cache_sync_change - invalid writer handle!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    switch (change)
+    {
+    case LD_SYNC_CHANGE_DELETE:
+        ld_shared_cache_invalidate(cache, dn, false);
+        return RETURN_CODE_SUCCESS;
+    case LD_SYNC_CHANGE_RENAME:
+        // DNs of descendants have changed as well.
+        ld_shared_cache_invalidate(cache, old_dn, true);
+        return entry && !cache->partial_updates ? ld_shared_cache_publish(cache, entry) : RETURN_CODE_SUCCESS;
+    case LD_SYNC_CHANGE_MODIFY:
+        if (entry && cache->partial_updates)
+        {
+            return shared_cache_merge(cache, entry);
+        }
+        // fall through
+    case LD_SYNC_CHANGE_ADD:
+        return entry ? ld_shared_cache_publish(cache, entry) : RETURN_CODE_SUCCESS;
+    }
+
+    return RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief ld_shared_cache_count Returns amount of entries in the segment, expired ones included.
+ */
+unsigned int ld_shared_cache_count(ld_shared_cache_t *cache)
+{
+    if (!cache || (!cache->writer && !shared_cache_map_reader(cache)))
+    {
+        return 0;
+    }
+
+    return __atomic_load_n(&cache->header->entry_count, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,59 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_SHARED_CACHE_H
+#define LIBDOMAIN_SHARED_CACHE_H
+
+#include "common.h"
+#include "directory_sync.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Shared cache is a POSIX shared memory segment with entries that is filled by a single writer process
+ * and read by any amount of processes on the same host. Readers never lock, they copy entries out of
+ * the segment and retry when the writer has changed them during the copy.
+ */
+
+typedef struct ld_shared_cache_s ld_shared_cache_t;
+
+ld_shared_cache_t *ld_shared_cache_create(TALLOC_CTX *ctx, const char *name, size_t size, unsigned int ttl);
+ld_shared_cache_t *ld_shared_cache_open(TALLOC_CTX *ctx, const char *name);
+enum OperationReturnCode ld_shared_cache_unlink(const char *name);
+
+bool ld_shared_cache_is_writer(const ld_shared_cache_t *cache);
+void ld_shared_cache_set_partial_updates(ld_shared_cache_t *cache, bool partial_updates);
+
+enum OperationReturnCode ld_shared_cache_publish(ld_shared_cache_t *cache, ld_entry_t *entry);
+ld_entry_t *ld_shared_cache_lookup(ld_shared_cache_t *cache, TALLOC_CTX *ctx, const char *dn);
+void ld_shared_cache_invalidate(ld_shared_cache_t *cache, const char *dn, bool subtree);
+void ld_shared_cache_clear(ld_shared_cache_t *cache);
+
+enum OperationReturnCode ld_shared_cache_sync_change(struct ldap_connection_ctx_t *connection,
+                                                     enum LdapSyncChangeType change,
+                                                     const char *dn,
+                                                     const char *old_dn,
+                                                     ld_entry_t *entry,
+                                                     void *user_data);
+
+unsigned int ld_shared_cache_count(ld_shared_cache_t *cache);
+
+#endif //LIBDOMAIN_SHARED_CACHE_H
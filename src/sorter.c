@@ -0,0 +1,1210 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "sorter.h"
+#include "directory.h"
+#include "entry.h"
+#include "entry_p.h"
+#include "filter_match_p.h"
+#include "domain.h"
+
+#include "helper_p.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib-2.0/glib.h>
+
+#define SORTER_DEFAULT_MEMORY_BUDGET (64 * 1024 * 1024)
+#define SORTER_MIN_MEMORY_BUDGET (64 * 1024)
+#define SORTER_MAX_FAN_IN 64
+#define SORTER_PAGE_SIZE 1000
+
+#define SORTER_VALUE_PRESENT 0x01
+#define SORTER_VALUE_MISSING 0xff
+#define SORTER_INTEGER_NEGATIVE 0x01
+#define SORTER_INTEGER_POSITIVE 0x02
+
+/*!
+ * @brief sorter_key_t - Attribute entries are sorted by.
+ */
+typedef struct sorter_key_s
+{
+    char *attribute;                            //!< Attribute description.
+    enum FilterRule rule;                       //!< Ordering rule of the attribute.
+    bool reverse;                               //!< Sort in descending order.
+} sorter_key_t;
+
+/*!
+ * @brief sorter_record_t - Serialized entry preceded by its sort key, records are compared by keys only.
+ */
+typedef struct sorter_record_s
+{
+    uint32_t key_length;                        //!< Length of the sort key.
+    uint32_t payload_length;                    //!< Length of the serialized entry.
+    unsigned char data[];                       //!< Sort key followed by the serialized entry.
+} sorter_record_t;
+
+/*!
+ * @brief sorter_merge_t - K-way merge of sorted runs.
+ */
+typedef struct sorter_merge_s
+{
+    FILE **inputs;                              //!< Runs to merge.
+    sorter_record_t **heads;                    //!< Smallest unread record of every run, NULL when run is exhausted.
+    guint *heap;                                //!< Indexes of runs ordered by their heads.
+    guint count;                                //!< Amount of runs.
+    guint heap_size;                            //!< Amount of runs with unread records.
+} sorter_merge_t;
+
+/*!
+ * @brief sorter_search_t - Search streamed into the sorter by ld_sorter_search.
+ */
+typedef struct sorter_search_s
+{
+    char *base_dn;                              //!< Base of the search.
+    int scope;                                  //!< Scope of the search.
+    char *filter;                               //!< Filter of the search.
+    char **attrs;                               //!< Attributes to return.
+    bool paged;                                 //!< Results are requested page by page.
+    struct berval cookie;                       //!< Paged results cookie of the next page.
+
+    int msgid;                                  //!< Message id of the active request, -1 if there is none.
+    struct ldap_connection_ctx_t *connection;   //!< Connection request has been sent through.
+
+    sorter_complete_callback_fn callback;       //!< Completion callback.
+    void *user_data;                            //!< User data passed to callback.
+} sorter_search_t;
+
+/*!
+ * @brief ld_sorter_t - External sort of entries.
+ */
+struct ld_sorter_s
+{
+    const ldap_schema_t *schema;                //!< Schema ordering rules are resolved with, may be NULL.
+    sorter_key_t *keys;                         //!< Sort keys.
+    int n_keys;                                 //!< Amount of sort keys.
+    bool locale;                                //!< Strings are ordered by collation rules of current locale.
+
+    size_t memory_budget;                       //!< Memory records may occupy before they are spilled.
+    char *temp_dir;                             //!< Directory of temporary files.
+
+    GPtrArray *records;                         //!< Records kept in memory.
+    size_t memory;                              //!< Memory used by records kept in memory.
+    guint position;                             //!< Next record to return when runs have not been spilled.
+    GPtrArray *runs;                            //!< Temporary files with sorted runs.
+    sorter_merge_t merge;                       //!< Merge of runs read by ld_sorter_next.
+
+    uint64_t sequence;                          //!< Amount of added entries, keeps sort stable.
+    bool finished;                              //!< ld_sorter_finish has been called.
+    bool failed;                                //!< Entries have been lost because of an error.
+
+    sorter_search_t *search;                    //!< Active search, NULL if there is none.
+};
+
+static void sorter_merge_release(sorter_merge_t *merge)
+{
+    for (guint i = 0; i < merge->count; ++i)
+    {
+        g_free(merge->heads[i]);
+    }
+
+    g_free(merge->inputs);
+    g_free(merge->heads);
+    g_free(merge->heap);
+    memset(merge, 0, sizeof(*merge));
+}
+
+static int sorter_destructor(TALLOC_CTX *ctx)
+{
+    ld_sorter_t *sorter = talloc_get_type_abort(ctx, ld_sorter_t);
+
+    if (sorter->search && sorter->search->msgid >= 0 && sorter->search->connection)
+    {
+        connection_cancel_read_request(sorter->search->connection, sorter->search->msgid);
+        ldap_abandon_ext(sorter->search->connection->ldap, sorter->search->msgid, NULL, NULL);
+    }
+
+    sorter_merge_release(&sorter->merge);
+
+    for (guint i = 0; i < sorter->records->len; ++i)
+    {
+        g_free(g_ptr_array_index(sorter->records, i));
+    }
+    g_ptr_array_free(sorter->records, TRUE);
+
+    for (guint i = 0; i < sorter->runs->len; ++i)
+    {
+        fclose(g_ptr_array_index(sorter->runs, i));
+    }
+    g_ptr_array_free(sorter->runs, TRUE);
+
+    return 0;
+}
+
+/**
+ * @brief sorter_parse_keys Parses space or comma separated list of sort keys.
+ * @param[in] sorter        Sorter to store keys to.
+ * @param[in] sort_keys     Keys in form [-]attribute[:matchingRule].
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE if keys are invalid or on failure.
+ */
+static enum OperationReturnCode sorter_parse_keys(ld_sorter_t *sorter, const char *sort_keys)
+{
+    char **tokens = g_strsplit_set(sort_keys, " ,", -1);
+    enum OperationReturnCode rc = RETURN_CODE_FAILURE;
+    int n_tokens = 0;
+
+    while (tokens[n_tokens])
+    {
+        ++n_tokens;
+    }
+
+    ld_talloc_zero_array(sorter->keys, exit, sorter, sorter_key_t, n_tokens);
+
+    for (int i = 0; i < n_tokens; ++i)
+    {
+        char *token = tokens[i];
+
+        if (*token == '\0')
+        {
+            continue;
+        }
+
+        sorter_key_t *key = &sorter->keys[sorter->n_keys];
+
+        key->reverse = *token == '-';
+        if (key->reverse)
+        {
+            ++token;
+        }
+
+        char *rule = strchr(token, ':');
+        if (rule)
+        {
+            *rule++ = '\0';
+        }
+
+        if (*token == '\0')
+        {
+            goto exit;
+        }
+
+        ld_talloc_strdup(key->attribute, exit, sorter->keys, token);
+
+        key->rule = rule ? filter_rule_by_name(rule) : filter_ordering_rule(sorter->schema, token);
+        if (key->rule == FILTER_RULE_NONE)
+        {
+            ld_error("sorter_parse_keys - unsupported ordering rule %s!\n", rule ? rule : token);
+            goto exit;
+        }
+
+        ++sorter->n_keys;
+    }
+
+    rc = sorter->n_keys > 0 ? RETURN_CODE_SUCCESS : RETURN_CODE_FAILURE;
+
+    exit:
+        g_strfreev(tokens);
+        return rc;
+}
+
+/**
+ * @brief ld_sorter_new Creates sorter of entries.
+ * @param[in] ctx           Talloc ctx to use.
+ * @param[in] schema        Schema to resolve ordering rules with, may be NULL. Schema must outlive the sorter.
+ * @param[in] sort_keys     Space separated sort keys in form [-]attribute[:matchingRule], e.g. "sn -givenName".
+ *                          Minus selects descending order. Entries without the attribute are placed after
+ *                          all other entries in ascending order and before them in descending one.
+ * @param[in] memory_budget Memory in bytes entries may occupy before they are spilled to disk, 0 for default.
+ * @param[in] temp_dir      Directory of temporary files, NULL for default one.
+ * @return
+ *        - Valid pointer to sorter on success.
+ *        - NULL on failure.
+ */
+ld_sorter_t *ld_sorter_new(TALLOC_CTX *ctx,
+                           const ldap_schema_t *schema,
+                           const char *sort_keys,
+                           size_t memory_budget,
+                           const char *temp_dir)
+{
+    ld_sorter_t *sorter = NULL;
+
+    if (!sort_keys)
+    {
+        ld_error("ld_sorter_new - invalid sort keys!\n");
+        return NULL;
+    }
+
+    ld_talloc_zero_e(sorter, error_exit, "ld_sorter_new - out of memory - unable to create sorter!\n",
+                     ctx, ld_sorter_t);
+
+    sorter->records = g_ptr_array_new();
+    sorter->runs = g_ptr_array_new();
+    talloc_set_destructor((void*)sorter, sorter_destructor);
+
+    sorter->schema = schema;
+    sorter->memory_budget = memory_budget == 0 ? SORTER_DEFAULT_MEMORY_BUDGET : MAX(memory_budget,
+                                                                                   SORTER_MIN_MEMORY_BUDGET);
+
+    ld_talloc_strdup(sorter->temp_dir, error_exit, sorter, temp_dir ? temp_dir : g_get_tmp_dir());
+
+    if (sorter_parse_keys(sorter, sort_keys) != RETURN_CODE_SUCCESS)
+    {
+        ld_error("ld_sorter_new - invalid sort keys %s!\n", sort_keys);
+        goto error_exit;
+    }
+
+    return sorter;
+
+    error_exit:
+        talloc_free(sorter);
+        return NULL;
+}
+
+/**
+ * @brief ld_sorter_set_collation Selects whether strings are ordered by collation rules of current locale.
+ *
+ * By default strings are ordered by code points of their normalized form, which does not depend on locale.
+ * @param[in] sorter              Sorter to work with, entries must not have been added yet.
+ * @param[in] locale              Use LC_COLLATE of current locale.
+ */
+void ld_sorter_set_collation(ld_sorter_t *sorter, bool locale)
+{
+    if (!sorter || sorter->sequence > 0)
+    {
+        ld_error("ld_sorter_set_collation - collation can not be changed after entries have been added!\n");
+        return;
+    }
+
+    sorter->locale = locale;
+}
+
+static LDAPAttribute_t *sorter_find_attribute(ld_entry_t *entry, const char *name)
+{
+    LDAPAttribute_t *result = g_hash_table_lookup(entry->attributes, name);
+    if (result)
+    {
+        return result;
+    }
+
+    GHashTableIter iter;
+    gpointer key = NULL;
+    gpointer value = NULL;
+
+    g_hash_table_iter_init(&iter, entry->attributes);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+        if (g_ascii_strcasecmp(key, name) == 0)
+        {
+            return value;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief sorter_append_string Appends string so that memcmp of keys orders strings, zero bytes are escaped.
+ */
+static void sorter_append_string(GByteArray *key, const char *value, size_t length)
+{
+    static const guint8 ESCAPED_ZERO[] = { 0x00, 0xff };
+    static const guint8 TERMINATOR[] = { 0x00, 0x00 };
+
+    for (const char *end = value + length; value < end; )
+    {
+        const char *zero = memchr(value, '\0', end - value);
+        size_t chunk = zero ? (size_t)(zero - value) : (size_t)(end - value);
+
+        g_byte_array_append(key, (const guint8 *)value, chunk);
+        value += chunk;
+
+        if (zero)
+        {
+            g_byte_array_append(key, ESCAPED_ZERO, sizeof(ESCAPED_ZERO));
+            ++value;
+        }
+    }
+
+    g_byte_array_append(key, TERMINATOR, sizeof(TERMINATOR));
+}
+
+/**
+ * @brief sorter_append_integer Appends integer in canonical form so that memcmp of keys orders numbers.
+ *
+ * Sign goes first, then amount of digits and digits, which are inverted for negative numbers.
+ */
+static void sorter_append_integer(GByteArray *key, const char *value)
+{
+    bool negative = *value == '-';
+    const char *digits = negative ? value + 1 : value;
+    size_t length = strlen(digits);
+    guint start = key->len;
+    guint8 header[3] = { negative ? SORTER_INTEGER_NEGATIVE : SORTER_INTEGER_POSITIVE,
+                         (guint8)(MIN(length, 0xffff) >> 8), (guint8)MIN(length, 0xffff) };
+
+    g_byte_array_append(key, header, sizeof(header));
+    g_byte_array_append(key, (const guint8 *)digits, length);
+
+    if (negative)
+    {
+        for (guint i = start + 1; i < key->len; ++i)
+        {
+            key->data[i] = ~key->data[i];
+        }
+    }
+}
+
+/**
+ * @brief sorter_append_value Appends key of a single value according to ordering rule.
+ * @return
+ *        - true on success.
+ *        - false if value is invalid for the rule.
+ */
+static bool sorter_append_value(ld_sorter_t *sorter, const sorter_key_t *sort_key, GByteArray *key, const char *value)
+{
+    char *normalized = filter_normalize_key(NULL, sorter->schema, sort_key->rule, value, true);
+    if (!normalized)
+    {
+        return false;
+    }
+
+    if (sort_key->rule == FILTER_RULE_INTEGER)
+    {
+        sorter_append_integer(key, normalized);
+    }
+    else if (sorter->locale && (sort_key->rule == FILTER_RULE_CASE_IGNORE || sort_key->rule == FILTER_RULE_CASE_EXACT))
+    {
+        gchar *collated = g_utf8_collate_key(normalized, -1);
+        sorter_append_string(key, collated, strlen(collated));
+        g_free(collated);
+    }
+    else
+    {
+        sorter_append_string(key, normalized, strlen(normalized));
+    }
+
+    talloc_free(normalized);
+
+    return true;
+}
+
+static int sorter_compare_bytes(const guint8 *first, size_t first_length, const guint8 *second, size_t second_length)
+{
+    int result = memcmp(first, second, MIN(first_length, second_length));
+
+    if (result != 0 || first_length == second_length)
+    {
+        return result;
+    }
+
+    return first_length < second_length ? -1 : 1;
+}
+
+/**
+ * @brief sorter_build_key Builds binary key of the entry, memcmp of keys orders entries.
+ *
+ * Multi-valued attributes are ordered by their smallest value in ascending order and by their largest value
+ * in descending one. Sequence number of the entry is appended to keep order of equal entries.
+ */
+static GByteArray *sorter_build_key(ld_sorter_t *sorter, ld_entry_t *entry)
+{
+    GByteArray *result = g_byte_array_new();
+    GByteArray *candidate = g_byte_array_new();
+    GByteArray *best = g_byte_array_new();
+
+    for (int i = 0; i < sorter->n_keys; ++i)
+    {
+        const sorter_key_t *sort_key = &sorter->keys[i];
+        LDAPAttribute_t *attribute = sorter_find_attribute(entry, sort_key->attribute);
+        bool found = false;
+
+        g_byte_array_set_size(best, 0);
+
+        for (int j = 0; attribute && attribute->values && attribute->values[j]; ++j)
+        {
+            g_byte_array_set_size(candidate, 0);
+
+            if (!sorter_append_value(sorter, sort_key, candidate, attribute->values[j]))
+            {
+                continue;
+            }
+
+            int order = found ? sorter_compare_bytes(candidate->data, candidate->len, best->data, best->len) : 0;
+
+            if (!found || (sort_key->reverse ? order > 0 : order < 0))
+            {
+                GByteArray *swap = best;
+                best = candidate;
+                candidate = swap;
+                found = true;
+            }
+        }
+
+        guint start = result->len;
+        guint8 marker = found ? SORTER_VALUE_PRESENT : SORTER_VALUE_MISSING;
+
+        g_byte_array_append(result, &marker, 1);
+        g_byte_array_append(result, best->data, found ? best->len : 0);
+
+        if (sort_key->reverse)
+        {
+            for (guint j = start; j < result->len; ++j)
+            {
+                result->data[j] = ~result->data[j];
+            }
+        }
+    }
+
+    guint8 sequence[8];
+    for (int i = 0; i < 8; ++i)
+    {
+        sequence[i] = (guint8)(sorter->sequence >> (56 - 8 * i));
+    }
+    g_byte_array_append(result, sequence, sizeof(sequence));
+
+    g_byte_array_free(candidate, TRUE);
+    g_byte_array_free(best, TRUE);
+
+    return result;
+}
+
+static int sorter_compare_records(const sorter_record_t *first, const sorter_record_t *second)
+{
+    return sorter_compare_bytes(first->data, first->key_length, second->data, second->key_length);
+}
+
+static gint sorter_compare_pointers(gconstpointer first, gconstpointer second)
+{
+    return sorter_compare_records(*(const sorter_record_t * const *)first, *(const sorter_record_t * const *)second);
+}
+
+/**
+ * @brief sorter_create_run Creates temporary file removed as soon as it is closed.
+ */
+static FILE *sorter_create_run(ld_sorter_t *sorter)
+{
+    char *path = talloc_asprintf(NULL, "%s/libdomain-sort-XXXXXX", sorter->temp_dir);
+    if (!path)
+    {
+        return NULL;
+    }
+
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        ld_error("sorter_create_run - unable to create temporary file in %s: %s\n", sorter->temp_dir, strerror(errno));
+        talloc_free(path);
+        return NULL;
+    }
+
+    unlink(path);
+    talloc_free(path);
+
+    FILE *result = fdopen(fd, "w+b");
+    if (!result)
+    {
+        close(fd);
+    }
+
+    return result;
+}
+
+static bool sorter_write_record(FILE *file, const sorter_record_t *record)
+{
+    return fwrite(record, sizeof(*record) + record->key_length + record->payload_length, 1, file) == 1;
+}
+
+/**
+ * @brief sorter_read_record Reads next record of the run.
+ * @param[in] sorter         Sorter to mark as failed if run is damaged.
+ * @param[in] file           Run to read from.
+ * @return
+ *        - Record, free it with g_free.
+ *        - NULL at the end of the run or on failure.
+ */
+static sorter_record_t *sorter_read_record(ld_sorter_t *sorter, FILE *file)
+{
+    sorter_record_t header;
+
+    size_t read = fread(&header, 1, sizeof(header), file);
+    if (read == 0 && feof(file))
+    {
+        return NULL;
+    }
+
+    sorter_record_t *result = read == sizeof(header)
+                            ? g_try_malloc(sizeof(header) + (size_t)header.key_length + header.payload_length)
+                            : NULL;
+
+    if (!result || fread(result->data, (size_t)header.key_length + header.payload_length, 1, file) != 1)
+    {
+        ld_error("sorter_read_record - unable to read temporary file!\n");
+        sorter->failed = true;
+        g_free(result);
+        return NULL;
+    }
+
+    *result = header;
+
+    return result;
+}
+
+/**
+ * @brief sorter_spill Sorts records kept in memory and writes them to new run.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode sorter_spill(ld_sorter_t *sorter)
+{
+    FILE *run = sorter_create_run(sorter);
+    if (!run)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    g_ptr_array_sort(sorter->records, sorter_compare_pointers);
+
+    bool written = true;
+    for (guint i = 0; i < sorter->records->len; ++i)
+    {
+        sorter_record_t *record = g_ptr_array_index(sorter->records, i);
+
+        written = written && sorter_write_record(run, record);
+        g_free(record);
+    }
+
+    g_ptr_array_set_size(sorter->records, 0);
+    sorter->memory = 0;
+
+    if (!written || fflush(run) != 0 || fseek(run, 0, SEEK_SET) != 0)
+    {
+        ld_error("sorter_spill - unable to write temporary file: %s\n", strerror(errno));
+        fclose(run);
+        return RETURN_CODE_FAILURE;
+    }
+
+    g_ptr_array_add(sorter->runs, run);
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief ld_sorter_add Adds copy of the entry to sorter.
+ * @param[in] sorter     Sorter to work with.
+ * @param[in] entry      Entry to add, caller keeps ownership and may free it right away.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_sorter_add(ld_sorter_t *sorter, ld_entry_t *entry)
+{
+    if (!sorter || !entry || !entry->dn)
+    {
+        ld_error("ld_sorter_add - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (sorter->finished)
+    {
+        ld_error("ld_sorter_add - sorter has already been finished!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    GByteArray *key = sorter_build_key(sorter, entry);
+    GByteArray *payload = g_byte_array_new();
+
+    entry_serialize(entry, payload);
+
+    sorter_record_t *record = g_try_malloc(sizeof(sorter_record_t) + key->len + payload->len);
+    if (!record)
+    {
+        ld_error("ld_sorter_add - out of memory - unable to create record!\n");
+        g_byte_array_free(key, TRUE);
+        g_byte_array_free(payload, TRUE);
+        return RETURN_CODE_FAILURE;
+    }
+
+    record->key_length = key->len;
+    record->payload_length = payload->len;
+    memcpy(record->data, key->data, key->len);
+    memcpy(record->data + key->len, payload->data, payload->len);
+
+    g_byte_array_free(key, TRUE);
+    g_byte_array_free(payload, TRUE);
+
+    g_ptr_array_add(sorter->records, record);
+    sorter->memory += sizeof(gpointer) + sizeof(sorter_record_t) + record->key_length + record->payload_length;
+    ++sorter->sequence;
+
+    if (sorter->memory > sorter->memory_budget && sorter_spill(sorter) != RETURN_CODE_SUCCESS)
+    {
+        sorter->failed = true;
+        return RETURN_CODE_FAILURE;
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+static void sorter_heap_sift_down(sorter_merge_t *merge, guint index)
+{
+    while (true)
+    {
+        guint smallest = index;
+        guint left = 2 * index + 1;
+        guint right = left + 1;
+
+        if (left < merge->heap_size
+            && sorter_compare_records(merge->heads[merge->heap[left]], merge->heads[merge->heap[smallest]]) < 0)
+        {
+            smallest = left;
+        }
+        if (right < merge->heap_size
+            && sorter_compare_records(merge->heads[merge->heap[right]], merge->heads[merge->heap[smallest]]) < 0)
+        {
+            smallest = right;
+        }
+
+        if (smallest == index)
+        {
+            return;
+        }
+
+        guint swap = merge->heap[index];
+        merge->heap[index] = merge->heap[smallest];
+        merge->heap[smallest] = swap;
+        index = smallest;
+    }
+}
+
+/**
+ * @brief sorter_merge_start Reads first record of every run and orders runs by them.
+ */
+static void sorter_merge_start(ld_sorter_t *sorter, sorter_merge_t *merge, FILE **inputs, guint count)
+{
+    merge->inputs = g_new(FILE *, count);
+    merge->heads = g_new0(sorter_record_t *, count);
+    merge->heap = g_new(guint, count);
+    merge->count = count;
+    merge->heap_size = 0;
+
+    memcpy(merge->inputs, inputs, count * sizeof(FILE *));
+
+    for (guint i = 0; i < count; ++i)
+    {
+        merge->heads[i] = sorter_read_record(sorter, merge->inputs[i]);
+        if (merge->heads[i])
+        {
+            merge->heap[merge->heap_size++] = i;
+        }
+    }
+
+    for (guint i = merge->heap_size / 2; i-- > 0; )
+    {
+        sorter_heap_sift_down(merge, i);
+    }
+}
+
+/**
+ * @brief sorter_merge_next Returns smallest record of all runs.
+ * @return
+ *        - Record, free it with g_free.
+ *        - NULL when all runs are exhausted.
+ */
+static sorter_record_t *sorter_merge_next(ld_sorter_t *sorter, sorter_merge_t *merge)
+{
+    if (merge->heap_size == 0)
+    {
+        return NULL;
+    }
+
+    guint run = merge->heap[0];
+    sorter_record_t *result = merge->heads[run];
+
+    merge->heads[run] = sorter_read_record(sorter, merge->inputs[run]);
+    if (!merge->heads[run])
+    {
+        merge->heap[0] = merge->heap[--merge->heap_size];
+    }
+
+    sorter_heap_sift_down(merge, 0);
+
+    return result;
+}
+
+/**
+ * @brief sorter_reduce_runs Merges runs until all of them can be merged at once.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode sorter_reduce_runs(ld_sorter_t *sorter)
+{
+    while (sorter->runs->len > SORTER_MAX_FAN_IN)
+    {
+        sorter_merge_t merge;
+        sorter_record_t *record = NULL;
+        bool written = true;
+
+        FILE *output = sorter_create_run(sorter);
+        if (!output)
+        {
+            return RETURN_CODE_FAILURE;
+        }
+
+        memset(&merge, 0, sizeof(merge));
+        sorter_merge_start(sorter, &merge, (FILE **)sorter->runs->pdata, SORTER_MAX_FAN_IN);
+
+        while ((record = sorter_merge_next(sorter, &merge)) != NULL)
+        {
+            written = written && sorter_write_record(output, record);
+            g_free(record);
+        }
+
+        sorter_merge_release(&merge);
+
+        for (guint i = 0; i < SORTER_MAX_FAN_IN; ++i)
+        {
+            fclose(g_ptr_array_index(sorter->runs, i));
+        }
+        g_ptr_array_remove_range(sorter->runs, 0, SORTER_MAX_FAN_IN);
+
+        if (!written || sorter->failed || fflush(output) != 0 || fseek(output, 0, SEEK_SET) != 0)
+        {
+            ld_error("sorter_reduce_runs - unable to write temporary file!\n");
+            fclose(output);
+            return RETURN_CODE_FAILURE;
+        }
+
+        g_ptr_array_add(sorter->runs, output);
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief ld_sorter_finish Completes adding of entries and prepares sorted entries for reading.
+ * @param[in] sorter        Sorter to work with.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE if entries have been lost or on failure.
+ */
+enum OperationReturnCode ld_sorter_finish(ld_sorter_t *sorter)
+{
+    if (!sorter)
+    {
+        ld_error("ld_sorter_finish - invalid sorter!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (sorter->finished)
+    {
+        return sorter->failed ? RETURN_CODE_FAILURE : RETURN_CODE_SUCCESS;
+    }
+
+    sorter->finished = true;
+
+    if (sorter->runs->len == 0)
+    {
+        g_ptr_array_sort(sorter->records, sorter_compare_pointers);
+    }
+    else if ((sorter->records->len > 0 && sorter_spill(sorter) != RETURN_CODE_SUCCESS)
+             || sorter_reduce_runs(sorter) != RETURN_CODE_SUCCESS)
+    {
+        sorter->failed = true;
+    }
+    else
+    {
+        sorter_merge_start(sorter, &sorter->merge, (FILE **)sorter->runs->pdata, sorter->runs->len);
+    }
+
+    return sorter->failed ? RETURN_CODE_FAILURE : RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief ld_sorter_next Returns next entry in sort order.
+ * @param[in] sorter     Finished sorter.
+ * @param[in] ctx        Talloc ctx to allocate entry with.
+ * @return
+ *        - Entry.
+ *        - NULL when all entries have been read or on failure, see ld_sorter_failed.
+ */
+ld_entry_t *ld_sorter_next(ld_sorter_t *sorter, TALLOC_CTX *ctx)
+{
+    sorter_record_t *record = NULL;
+
+    if (!sorter || !sorter->finished)
+    {
+        ld_error("ld_sorter_next - sorter has not been finished!\n");
+        return NULL;
+    }
+
+    if (sorter->runs->len == 0)
+    {
+        if (sorter->position >= sorter->records->len)
+        {
+            return NULL;
+        }
+
+        // Entries are released as they are read.
+        record = g_ptr_array_index(sorter->records, sorter->position);
+        g_ptr_array_index(sorter->records, sorter->position) = NULL;
+        ++sorter->position;
+    }
+    else
+    {
+        record = sorter_merge_next(sorter, &sorter->merge);
+    }
+
+    if (!record)
+    {
+        return NULL;
+    }
+
+    ld_entry_t *result = entry_deserialize(ctx, (const char *)record->data + record->key_length,
+                                           record->payload_length);
+    if (!result)
+    {
+        ld_error("ld_sorter_next - unable to restore entry!\n");
+        sorter->failed = true;
+    }
+
+    g_free(record);
+
+    return result;
+}
+
+/**
+ * @brief ld_sorter_failed Checks whether entries have been lost because of an error.
+ */
+bool ld_sorter_failed(const ld_sorter_t *sorter)
+{
+    return !sorter || sorter->failed;
+}
+
+/**
+ * @brief ld_sorter_get_count Returns amount of added entries.
+ */
+unsigned long ld_sorter_get_count(const ld_sorter_t *sorter)
+{
+    return sorter ? sorter->sequence : 0;
+}
+
+/**
+ * @brief ld_sorter_get_run_count Returns amount of runs spilled to disk.
+ */
+unsigned int ld_sorter_get_run_count(const ld_sorter_t *sorter)
+{
+    return sorter ? sorter->runs->len : 0;
+}
+
+/**
+ * @brief sorter_search_send Sends request for the next page of search results.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode sorter_search_send(struct ldap_connection_ctx_t *connection, ld_sorter_t *sorter)
+{
+    sorter_search_t *search = sorter->search;
+    LDAPControl *controls[2] = { NULL, NULL };
+    int msgid = 0;
+
+    if (search->paged && ldap_create_page_control(connection->ldap, SORTER_PAGE_SIZE, &search->cookie, 0,
+                                                  &controls[0]) != LDAP_SUCCESS)
+    {
+        ld_error("sorter_search_send - unable to create paged results control!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    int rc = ldap_search_ext(connection->ldap,
+                             search->base_dn,
+                             search->scope,
+                             search->filter,
+                             search->attrs,
+                             0,
+                             controls,
+                             NULL,
+                             NULL,
+                             LDAP_NO_LIMIT,
+                             &msgid);
+
+    if (controls[0])
+    {
+        ldap_control_free(controls[0]);
+    }
+
+    if (rc != LDAP_SUCCESS)
+    {
+        ld_error("Unable to create sorted search request: %s\n", ldap_err2string(rc));
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (connection_add_stream_request(connection, msgid, ld_sorter_on_read, sorter) != RETURN_CODE_SUCCESS)
+    {
+        ldap_abandon_ext(connection->ldap, msgid, NULL, NULL);
+        return RETURN_CODE_FAILURE;
+    }
+
+    search->msgid = msgid;
+    search->connection = connection;
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief ld_sorter_search Streams search results into the sorter and finishes it.
+ *
+ * Entries are added to the sorter as they arrive and released right away. Results are requested page by
+ * page when server supports paged results, so size limit of the server does not apply.
+ * @param[in] connection   Connection to work with, should be in LDAP_CONNECTION_STATE_RUN state.
+ * @param[in] sorter       Sorter entries have not been added to yet.
+ * @param[in] base_dn      Base of the search.
+ * @param[in] scope        Scope of the search.
+ * @param[in] filter       Filter of the search.
+ * @param[in] attrs        Attributes to return, NULL for all user attributes.
+ * @param[in] callback     Callback to call once all entries have been added.
+ * @param[in] user_data    User data passed to callback.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_OPERATION_IN_PROGRESS if sorter already runs a search.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_sorter_search(struct ldap_connection_ctx_t *connection,
+                                          ld_sorter_t *sorter,
+                                          const char *base_dn,
+                                          int scope,
+                                          const char *filter,
+                                          char **attrs,
+                                          sorter_complete_callback_fn callback,
+                                          void *user_data)
+{
+    sorter_search_t *search = NULL;
+
+    if (!connection || !sorter || !base_dn || !filter || !callback)
+    {
+        ld_error("ld_sorter_search - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (sorter->search)
+    {
+        return RETURN_CODE_OPERATION_IN_PROGRESS;
+    }
+
+    if (sorter->finished)
+    {
+        ld_error("ld_sorter_search - sorter has already been finished!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    ld_talloc_zero(search, error_exit, sorter, sorter_search_t);
+    ld_talloc_strdup(search->base_dn, error_exit, search, base_dn);
+    ld_talloc_strdup(search->filter, error_exit, search, filter);
+    search->scope = scope;
+    search->paged = directory_has_capability(connection, LDAP_CAPABILITY_PAGED_RESULTS);
+    search->msgid = -1;
+    search->callback = callback;
+    search->user_data = user_data;
+
+    if (attrs)
+    {
+        int attrs_count = 0;
+        while (attrs[attrs_count])
+        {
+            ++attrs_count;
+        }
+
+        ld_talloc_zero_array(search->attrs, error_exit, search, char*, attrs_count + 1);
+
+        for (int i = 0; i < attrs_count; ++i)
+        {
+            ld_talloc_strdup(search->attrs[i], error_exit, search->attrs, attrs[i]);
+        }
+    }
+
+    sorter->search = search;
+
+    if (sorter_search_send(connection, sorter) != RETURN_CODE_SUCCESS)
+    {
+        sorter->search = NULL;
+        goto error_exit;
+    }
+
+    return RETURN_CODE_SUCCESS;
+
+    error_exit:
+        talloc_free(search);
+        return RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief sorter_search_finish Completes search, finishes sorter and calls completion callback.
+ * @return RETURN_CODE_SUCCESS to remove request from connection.
+ */
+static enum OperationReturnCode sorter_search_finish(struct ldap_connection_ctx_t *connection,
+                                                     ld_sorter_t *sorter,
+                                                     enum OperationReturnCode rc)
+{
+    sorter_search_t *search = sorter->search;
+    sorter_complete_callback_fn callback = search->callback;
+    void *user_data = search->user_data;
+
+    sorter->search = NULL;
+    talloc_free(search);
+
+    if (ld_sorter_finish(sorter) != RETURN_CODE_SUCCESS)
+    {
+        rc = RETURN_CODE_FAILURE;
+    }
+
+    // Callback may free the sorter.
+    callback(connection, sorter, rc, user_data);
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief sorter_search_result Processes search result, requests next page if there is one.
+ * @return RETURN_CODE_SUCCESS to remove request from connection.
+ */
+static enum OperationReturnCode sorter_search_result(struct ldap_connection_ctx_t *connection,
+                                                     ld_sorter_t *sorter,
+                                                     LDAPMessage *message)
+{
+    sorter_search_t *search = sorter->search;
+    int error_code = 0;
+    char *diagnostic_message = NULL;
+    LDAPControl **controls = NULL;
+    bool more_results = false;
+
+    search->msgid = -1;
+    search->connection = NULL;
+
+    if (ldap_parse_result(connection->ldap, message, &error_code, NULL, &diagnostic_message, NULL, &controls, 0)
+        != LDAP_SUCCESS)
+    {
+        return sorter_search_finish(connection, sorter, RETURN_CODE_FAILURE);
+    }
+
+    if (error_code != LDAP_SUCCESS)
+    {
+        ld_error("Sorted search request failed: %s %s\n", ldap_err2string(error_code),
+                 diagnostic_message ? diagnostic_message : "");
+
+        ldap_memfree(diagnostic_message);
+        ldap_controls_free(controls);
+
+        return sorter_search_finish(connection, sorter, RETURN_CODE_FAILURE);
+    }
+
+    ldap_memfree(diagnostic_message);
+
+    LDAPControl *control = search->paged ? ldap_control_find(LDAP_CONTROL_PAGEDRESULTS, controls, NULL) : NULL;
+    if (control)
+    {
+        ber_int_t count = 0;
+        struct berval cookie = { 0, NULL };
+
+        if (ldap_parse_pageresponse_control(connection->ldap, control, &count, &cookie) == LDAP_SUCCESS)
+        {
+            talloc_free(search->cookie.bv_val);
+            search->cookie.bv_val = cookie.bv_len > 0 ? talloc_memdup(search, cookie.bv_val, cookie.bv_len) : NULL;
+            search->cookie.bv_len = search->cookie.bv_val ? cookie.bv_len : 0;
+            more_results = search->cookie.bv_len > 0;
+            ber_memfree(cookie.bv_val);
+        }
+    }
+
+    ldap_controls_free(controls);
+
+    if (more_results)
+    {
+        return sorter_search_send(connection, sorter) == RETURN_CODE_SUCCESS
+                ? RETURN_CODE_SUCCESS
+                : sorter_search_finish(connection, sorter, RETURN_CODE_FAILURE);
+    }
+
+    return sorter_search_finish(connection, sorter, sorter->failed ? RETURN_CODE_FAILURE : RETURN_CODE_SUCCESS);
+}
+
+/**
+ * @brief ld_sorter_on_read This callback is called when messages of sorted search arrive.
+ * @param[in] rc            Return code of ldap_result.
+ * @param[in] message       Message received from ldap.
+ * @param[in] connection    Connection to work with.
+ * @return
+ *        - RETURN_CODE_OPERATION_IN_PROGRESS while results are being received.
+ *        - RETURN_CODE_SUCCESS when request has been completed.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_sorter_on_read(int rc, LDAPMessage *message, struct ldap_connection_ctx_t *connection)
+{
+    ld_sorter_t *sorter = connection->request_user_data;
+
+    if (!sorter || !sorter->search)
+    {
+        ld_error("ld_sorter_on_read - sorter is missing!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (rc == LDAP_RES_ANY)
+    {
+        return sorter_search_finish(connection, sorter, RETURN_CODE_FAILURE);
+    }
+
+    for (LDAPMessage *current = ldap_first_message(connection->ldap, message);
+         current != NULL;
+         current = ldap_next_message(connection->ldap, current))
+    {
+        switch (ldap_msgtype(current))
+        {
+        case LDAP_RES_SEARCH_ENTRY:
+        {
+            ld_entry_t *entry = ld_entry_from_message(NULL, connection->ldap, current);
+
+            if (!entry || ld_sorter_add(sorter, entry) != RETURN_CODE_SUCCESS)
+            {
+                ld_error("ld_sorter_on_read - unable to add entry!\n");
+                sorter->failed = true;
+            }
+
+            talloc_free(entry);
+        }
+            break;
+        case LDAP_RES_SEARCH_REFERENCE:
+            ld_info("Received search referral but not following it!");
+            break;
+        case LDAP_RES_SEARCH_RESULT:
+            return sorter_search_result(connection, sorter, current);
+        default:
+            break;
+        }
+    }
+
+    return RETURN_CODE_OPERATION_IN_PROGRESS;
+}
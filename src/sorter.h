@@ -0,0 +1,75 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_SORTER_H
+#define LIBDOMAIN_SORTER_H
+
+#include "common.h"
+#include "connection.h"
+#include "schema.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Sorter orders entries on the client when server can not sort them. Entries are serialized together with
+ * binary sort keys, sorted in memory up to the memory budget and spilled to temporary files as sorted runs
+ * beyond it. Runs are merged while sorted entries are read, so only one entry per run is kept in memory.
+ */
+
+typedef struct ld_sorter_s ld_sorter_t;
+
+/**
+ * @brief sorter_complete_callback_fn Callback fired when search started by ld_sorter_search completes.
+ *
+ * On success sorter is finished and sorted entries can be read with ld_sorter_next.
+ */
+typedef void (*sorter_complete_callback_fn)(struct ldap_connection_ctx_t *connection,
+                                            ld_sorter_t *sorter,
+                                            enum OperationReturnCode rc,
+                                            void *user_data);
+
+ld_sorter_t *ld_sorter_new(TALLOC_CTX *ctx,
+                           const ldap_schema_t *schema,
+                           const char *sort_keys,
+                           size_t memory_budget,
+                           const char *temp_dir);
+
+void ld_sorter_set_collation(ld_sorter_t *sorter, bool locale);
+
+enum OperationReturnCode ld_sorter_add(ld_sorter_t *sorter, ld_entry_t *entry);
+enum OperationReturnCode ld_sorter_finish(ld_sorter_t *sorter);
+ld_entry_t *ld_sorter_next(ld_sorter_t *sorter, TALLOC_CTX *ctx);
+
+bool ld_sorter_failed(const ld_sorter_t *sorter);
+unsigned long ld_sorter_get_count(const ld_sorter_t *sorter);
+unsigned int ld_sorter_get_run_count(const ld_sorter_t *sorter);
+
+enum OperationReturnCode ld_sorter_search(struct ldap_connection_ctx_t *connection,
+                                          ld_sorter_t *sorter,
+                                          const char *base_dn,
+                                          int scope,
+                                          const char *filter,
+                                          char **attrs,
+                                          sorter_complete_callback_fn callback,
+                                          void *user_data);
+enum OperationReturnCode ld_sorter_on_read(int rc, LDAPMessage *message, struct ldap_connection_ctx_t *connection);
+
+#endif //LIBDOMAIN_SORTER_H
@@ -0,0 +1,763 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "subscription.h"
+#include "connection_state_machine.h"
+#include "directory.h"
+#include "entry.h"
+#include "filter_match.h"
+
+#include "helper_p.h"
+
+#include <string.h>
+#include <strings.h>
+
+static const char *NOTIFICATION_FILTER = "(objectClass=*)";
+
+/*!
+ * @brief ld_subscription_t - Long-lived subscription to changes of directory entries.
+ */
+struct ld_subscription_s
+{
+    struct ld_subscription_s *next;                //!< Next subscription of the connection.
+
+    char *base_dn;                                 //!< Base of the subtree to watch.
+    int scope;                                     //!< Scope of the subtree to watch.
+    char *filter;                                  //!< Filter selecting watched entries.
+    ld_filter_program_t *program;                  //!< Filter matched on our side when server ignores it.
+    char **attrs;                                  //!< Attributes to return with changed entries.
+    int change_types;                              //!< Bit mask of LdapSubscriptionChangeType to report.
+
+    enum LdapSubscriptionMechanism mechanism;      //!< Mechanism used to receive changes.
+    enum LdapSubscriptionState state;              //!< State of the subscription.
+    int msgid;                                     //!< Message id of the active subscription request.
+
+    struct berval cookie;                          //!< Content synchronization cookie to resume from after reconnect.
+    bool refresh_done;                             //!< Content synchronization has reached persist stage.
+    bool received;                                 //!< Server has sent at least one message for current request.
+
+    bool in_callback;                              //!< Subscription messages are being processed.
+    bool cancelled;                                //!< ld_unsubscribe has been called from callback.
+
+    subscription_callback_fn callback;             //!< Change callback.
+    void *user_data;                               //!< User data passed to callback.
+};
+
+/**
+ * @brief subscription_unlink Removes subscription from the list of connection's subscriptions.
+ * @param[in] connection      Connection to work with.
+ * @param[in] subscription    Subscription to remove.
+ */
+static void subscription_unlink(struct ldap_connection_ctx_t *connection, ld_subscription_t *subscription)
+{
+    for (ld_subscription_t **current = &connection->subscriptions; *current != NULL; current = &(*current)->next)
+    {
+        if (*current == subscription)
+        {
+            *current = subscription->next;
+            subscription->next = NULL;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief subscription_select_mechanism Selects mechanism advertised by the server.
+ * @param[in] connection                 Connection to work with.
+ * @return Mechanism to use, LD_SUBSCRIPTION_MECHANISM_NONE if server does not support any.
+ */
+static enum LdapSubscriptionMechanism subscription_select_mechanism(struct ldap_connection_ctx_t *connection)
+{
+    if (directory_has_capability(connection, LDAP_CAPABILITY_PERSISTENT_SEARCH))
+    {
+        return LD_SUBSCRIPTION_MECHANISM_PERSISTENT_SEARCH;
+    }
+
+    if (directory_has_capability(connection, LDAP_CAPABILITY_CONTENT_SYNC))
+    {
+        return LD_SUBSCRIPTION_MECHANISM_CONTENT_SYNC;
+    }
+
+    if (directory_has_capability(connection, LDAP_CAPABILITY_CHANGE_NOTIFICATION))
+    {
+        return LD_SUBSCRIPTION_MECHANISM_NOTIFICATION;
+    }
+
+    return LD_SUBSCRIPTION_MECHANISM_NONE;
+}
+
+/**
+ * @brief subscription_create_control Creates request control for subscription's mechanism.
+ * @param[in] subscription            Subscription to work with.
+ * @param[out] control                Created control.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode subscription_create_control(ld_subscription_t *subscription, LDAPControl **control)
+{
+    struct berval value = { 0, NULL };
+    BerElement *ber = NULL;
+    int rc = -1;
+
+    if (subscription->mechanism == LD_SUBSCRIPTION_MECHANISM_NOTIFICATION)
+    {
+        return ldap_control_create(LDAP_SERVER_NOTIFICATION_OID, 1, NULL, 0, control) == LDAP_SUCCESS
+                ? RETURN_CODE_SUCCESS
+                : RETURN_CODE_FAILURE;
+    }
+
+    ber = ber_alloc_t(LBER_USE_DER);
+    if (!ber)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (subscription->mechanism == LD_SUBSCRIPTION_MECHANISM_PERSISTENT_SEARCH)
+    {
+        // Report only changes and attach entry change notification to every entry.
+        rc = ber_printf(ber, "{ibb}", subscription->change_types, 1, 1);
+    }
+    else if (subscription->cookie.bv_len > 0)
+    {
+        rc = ber_printf(ber, "{eO}", LDAP_SYNC_REFRESH_AND_PERSIST, &subscription->cookie);
+    }
+    else
+    {
+        rc = ber_printf(ber, "{e}", LDAP_SYNC_REFRESH_AND_PERSIST);
+    }
+
+    if (rc == -1 || ber_flatten2(ber, &value, 0) == -1)
+    {
+        ber_free(ber, 1);
+        return RETURN_CODE_FAILURE;
+    }
+
+    rc = ldap_control_create(subscription->mechanism == LD_SUBSCRIPTION_MECHANISM_PERSISTENT_SEARCH
+                             ? LDAP_CONTROL_PERSIST_REQUEST
+                             : LDAP_CONTROL_SYNC,
+                             1, &value, 1, control);
+
+    ber_free(ber, 1);
+
+    return rc == LDAP_SUCCESS ? RETURN_CODE_SUCCESS : RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief subscription_start Sends subscription request to server.
+ * @param[in] connection     Connection to work with.
+ * @param[in] subscription   Subscription to start.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode subscription_start(struct ldap_connection_ctx_t *connection,
+                                                   ld_subscription_t *subscription)
+{
+    LDAPControl *controls[3] = { NULL, NULL, NULL };
+    const char *filter = subscription->filter;
+    int msgid = 0;
+
+    subscription->mechanism = subscription_select_mechanism(connection);
+
+    if (subscription->mechanism == LD_SUBSCRIPTION_MECHANISM_NONE)
+    {
+        ld_error("subscription_start - server does not support change subscriptions!\n");
+
+        subscription->state = LD_SUBSCRIPTION_STATE_FAILED;
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (subscription->mechanism == LD_SUBSCRIPTION_MECHANISM_NOTIFICATION
+        && strcasecmp(filter, NOTIFICATION_FILTER) != 0)
+    {
+        // Server accepts only (objectClass=*), so entries are matched against caller's filter on our side.
+        if (!subscription->program)
+        {
+            subscription->program = ld_filter_compile_string(subscription, filter, connection->schema);
+        }
+
+        if (!subscription->program)
+        {
+            ld_error("subscription_start - unable to compile filter %s!\n", filter);
+
+            subscription->state = LD_SUBSCRIPTION_STATE_FAILED;
+            return RETURN_CODE_FAILURE;
+        }
+
+        filter = NOTIFICATION_FILTER;
+    }
+
+    if (subscription_create_control(subscription, &controls[0]) != RETURN_CODE_SUCCESS)
+    {
+        ld_error("subscription_start - unable to create subscription control!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    // Without show deleted control Active Directory does not notify about deleted objects.
+    if (subscription->mechanism == LD_SUBSCRIPTION_MECHANISM_NOTIFICATION
+        && ldap_control_create(LDAP_CONTROL_X_SHOW_DELETED, 0, NULL, 0, &controls[1]) != LDAP_SUCCESS)
+    {
+        ld_error("subscription_start - unable to create show deleted control!\n");
+
+        ldap_control_free(controls[0]);
+        return RETURN_CODE_FAILURE;
+    }
+
+    int rc = ldap_search_ext(connection->ldap,
+                             subscription->base_dn,
+                             subscription->scope,
+                             filter,
+                             subscription->attrs,
+                             0,
+                             controls,
+                             NULL,
+                             NULL,
+                             LDAP_NO_LIMIT,
+                             &msgid);
+
+    ldap_control_free(controls[0]);
+    if (controls[1])
+    {
+        ldap_control_free(controls[1]);
+    }
+
+    if (rc != LDAP_SUCCESS)
+    {
+        ld_error("Unable to create subscription request: %s\n", ldap_err2string(rc));
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (connection_add_stream_request(connection, msgid, subscription_on_read, subscription) != RETURN_CODE_SUCCESS)
+    {
+        ldap_abandon_ext(connection->ldap, msgid, NULL, NULL);
+        return RETURN_CODE_FAILURE;
+    }
+
+    subscription->msgid = msgid;
+    subscription->state = LD_SUBSCRIPTION_STATE_ACTIVE;
+    subscription->received = false;
+    // Changes received during refresh stage are reported only when we resume from known cookie.
+    subscription->refresh_done = subscription->cookie.bv_len > 0;
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief ld_subscribe Creates long-lived subscription to changes of entries.
+ *
+ * Subscription is started as soon as connection reaches LDAP_CONNECTION_STATE_RUN state and is re-established
+ * automatically after reconnect. Active Directory limits amount of notification requests per connection (5 by
+ * default) and supports only (objectClass=*) filter, other filters are evaluated on our side, so attributes they
+ * refer to should be requested.
+ * @param[in] connection    Connection to work with.
+ * @param[in] base_dn       Base of the subtree to watch.
+ * @param[in] scope         Scope of the subtree to watch.
+ * @param[in] filter        Filter selecting watched entries.
+ * @param[in] attrs         Attributes to return with changed entries, NULL for all user attributes.
+ * @param[in] change_types  Bit mask of LdapSubscriptionChangeType values to report.
+ * @param[in] callback      Callback to call on every change.
+ * @param[in] user_data     User data passed to callback.
+ * @return
+ *        - Valid pointer to subscription on success.
+ *        - NULL on failure.
+ */
+ld_subscription_t *ld_subscribe(struct ldap_connection_ctx_t *connection,
+                                const char *base_dn,
+                                int scope,
+                                const char *filter,
+                                char **attrs,
+                                int change_types,
+                                subscription_callback_fn callback,
+                                void *user_data)
+{
+    static char *NOTIFICATION_ATTRIBUTES[] = { "isDeleted", NULL };
+
+    ld_subscription_t *subscription = NULL;
+
+    if (!connection || !base_dn || !filter || !callback)
+    {
+        ld_error("ld_subscribe - invalid parameters!\n");
+        return NULL;
+    }
+
+    ld_talloc_zero_e(subscription, error_exit, "ld_subscribe - out of memory - unable to create subscription!\n",
+                     connection, ld_subscription_t);
+
+    ld_talloc_strdup(subscription->base_dn, error_exit, subscription, base_dn);
+    ld_talloc_strdup(subscription->filter, error_exit, subscription, filter);
+    subscription->scope = scope;
+    subscription->change_types = change_types & LD_SUBSCRIPTION_CHANGE_ANY;
+    subscription->callback = callback;
+    subscription->user_data = user_data;
+    subscription->msgid = -1;
+    subscription->state = LD_SUBSCRIPTION_STATE_INACTIVE;
+
+    // Deleted objects are reported by Active Directory as modifications with isDeleted set.
+    int attrs_count = 0;
+    while (attrs && attrs[attrs_count])
+    {
+        ++attrs_count;
+    }
+
+    ld_talloc_zero_array(subscription->attrs, error_exit, subscription, char*, attrs_count + 3);
+
+    for (int i = 0; i < attrs_count; ++i)
+    {
+        ld_talloc_strdup(subscription->attrs[i], error_exit, subscription->attrs, attrs[i]);
+    }
+
+    if (attrs_count == 0)
+    {
+        subscription->attrs[attrs_count++] = LDAP_ALL_USER_ATTRIBUTES;
+    }
+    subscription->attrs[attrs_count] = NOTIFICATION_ATTRIBUTES[0];
+
+    subscription->next = connection->subscriptions;
+    connection->subscriptions = subscription;
+
+    if (connection->state_machine && csm_is_in_state(connection->state_machine, LDAP_CONNECTION_STATE_RUN))
+    {
+        subscription_restore_all(connection);
+    }
+
+    return subscription;
+
+    error_exit:
+        talloc_free(subscription);
+        return NULL;
+}
+
+/**
+ * @brief ld_unsubscribe Cancels subscription and frees it.
+ * @param[in] connection Connection to work with.
+ * @param[in] subscription Subscription to cancel.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_unsubscribe(struct ldap_connection_ctx_t *connection, ld_subscription_t *subscription)
+{
+    if (!connection || !subscription)
+    {
+        ld_error("ld_unsubscribe - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (subscription->state == LD_SUBSCRIPTION_STATE_ACTIVE)
+    {
+        ldap_abandon_ext(connection->ldap, subscription->msgid, NULL, NULL);
+        connection_cancel_read_request(connection, subscription->msgid);
+        subscription->state = LD_SUBSCRIPTION_STATE_INACTIVE;
+    }
+
+    subscription_unlink(connection, subscription);
+
+    if (subscription->in_callback)
+    {
+        // Freed by subscription_on_read once it is done with the subscription.
+        subscription->cancelled = true;
+        return RETURN_CODE_SUCCESS;
+    }
+
+    talloc_free(subscription);
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief ld_subscription_get_state Returns state of the subscription.
+ * @param[in] subscription          Subscription to work with.
+ * @return State of the subscription.
+ */
+enum LdapSubscriptionState ld_subscription_get_state(const ld_subscription_t *subscription)
+{
+    return subscription ? subscription->state : LD_SUBSCRIPTION_STATE_FAILED;
+}
+
+/**
+ * @brief ld_subscription_get_mechanism Returns mechanism used to receive changes.
+ * @param[in] subscription              Subscription to work with.
+ * @return Mechanism, LD_SUBSCRIPTION_MECHANISM_NONE if subscription has not been started yet.
+ */
+enum LdapSubscriptionMechanism ld_subscription_get_mechanism(const ld_subscription_t *subscription)
+{
+    return subscription ? subscription->mechanism : LD_SUBSCRIPTION_MECHANISM_NONE;
+}
+
+/**
+ * @brief subscription_suspend_all Marks all subscriptions of the connection as inactive.
+ *
+ * Called when connection is lost, subscriptions will be re-established by subscription_restore_all.
+ * @param[in] connection           Connection to work with.
+ */
+void subscription_suspend_all(struct ldap_connection_ctx_t *connection)
+{
+    for (ld_subscription_t *current = connection->subscriptions; current != NULL; current = current->next)
+    {
+        if (current->state == LD_SUBSCRIPTION_STATE_ACTIVE)
+        {
+            connection_cancel_read_request(connection, current->msgid);
+
+            current->state = LD_SUBSCRIPTION_STATE_INACTIVE;
+            current->msgid = -1;
+        }
+    }
+}
+
+/**
+ * @brief subscription_restore_all Starts all inactive subscriptions of the connection.
+ * @param[in] connection           Connection to work with, should be in LDAP_CONNECTION_STATE_RUN state.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE if any of subscriptions failed to start.
+ */
+enum OperationReturnCode subscription_restore_all(struct ldap_connection_ctx_t *connection)
+{
+    enum OperationReturnCode rc = RETURN_CODE_SUCCESS;
+
+    for (ld_subscription_t *current = connection->subscriptions; current != NULL; current = current->next)
+    {
+        if (current->state == LD_SUBSCRIPTION_STATE_INACTIVE
+            && subscription_start(connection, current) != RETURN_CODE_SUCCESS)
+        {
+            rc = RETURN_CODE_FAILURE;
+        }
+    }
+
+    return rc;
+}
+
+/**
+ * @brief subscription_parse_sync_info Processes Sync Info message of content synchronization.
+ * @param[in] connection               Connection to work with.
+ * @param[in] subscription             Subscription to work with.
+ * @param[in] message                  Intermediate message.
+ */
+static void subscription_parse_sync_info(struct ldap_connection_ctx_t *connection,
+                                         ld_subscription_t *subscription,
+                                         LDAPMessage *message)
+{
+    char *oid = NULL;
+    struct berval *data = NULL;
+    struct berval cookie = { 0, NULL };
+    ber_len_t length = 0;
+    BerElement *ber = NULL;
+
+    if (ldap_parse_intermediate(connection->ldap, message, &oid, &data, NULL, 0) != LDAP_SUCCESS)
+    {
+        return;
+    }
+
+    if (oid && strcmp(oid, LDAP_SYNC_INFO) == 0 && data && (ber = ber_init(data)) != NULL)
+    {
+        switch (ber_peek_tag(ber, &length))
+        {
+        case LDAP_TAG_SYNC_NEW_COOKIE:
+            if (ber_scanf(ber, "m", &cookie) == LBER_ERROR)
+            {
+                cookie.bv_len = 0;
+            }
+            break;
+        case LDAP_TAG_SYNC_REFRESH_DELETE:
+        case LDAP_TAG_SYNC_REFRESH_PRESENT:
+        {
+            ber_int_t refresh_done = 1;
+
+            if (ber_scanf(ber, "{") != LBER_ERROR)
+            {
+                if (ber_peek_tag(ber, &length) == LDAP_TAG_SYNC_COOKIE && ber_scanf(ber, "m", &cookie) == LBER_ERROR)
+                {
+                    cookie.bv_len = 0;
+                }
+                if (ber_peek_tag(ber, &length) == LDAP_TAG_REFRESHDONE)
+                {
+                    ber_scanf(ber, "b", &refresh_done);
+                }
+            }
+
+            if (refresh_done)
+            {
+                subscription->refresh_done = true;
+            }
+        }
+            break;
+        default:
+            break;
+        }
+
+        if (cookie.bv_len > 0)
+        {
+            talloc_free(subscription->cookie.bv_val);
+            subscription->cookie.bv_val = talloc_memdup(subscription, cookie.bv_val, cookie.bv_len);
+            subscription->cookie.bv_len = subscription->cookie.bv_val ? cookie.bv_len : 0;
+        }
+
+        ber_free(ber, 1);
+    }
+
+    ldap_memfree(oid);
+    if (data)
+    {
+        ber_bvfree(data);
+    }
+}
+
+/**
+ * @brief subscription_get_change Detects kind of the change reported by entry.
+ * @param[in] connection          Connection to work with.
+ * @param[in] subscription        Subscription to work with.
+ * @param[in] message             Search entry message.
+ * @param[out] previous_dn        Previous DN of renamed entry, should be freed with ldap_memfree.
+ * @return Kind of the change, 0 if entry should not be reported.
+ */
+static int subscription_get_change(struct ldap_connection_ctx_t *connection,
+                                   ld_subscription_t *subscription,
+                                   LDAPMessage *message,
+                                   char **previous_dn)
+{
+    LDAPControl **controls = NULL;
+    LDAPControl *control = NULL;
+    BerElement *ber = NULL;
+    ber_len_t length = 0;
+    int change = 0;
+
+    if (subscription->mechanism == LD_SUBSCRIPTION_MECHANISM_NOTIFICATION)
+    {
+        struct berval **values = ldap_get_values_len(connection->ldap, message, "isDeleted");
+        change = values && values[0] && strncasecmp(values[0]->bv_val, "TRUE", values[0]->bv_len) == 0
+                 ? LD_SUBSCRIPTION_CHANGE_DELETE
+                 : LD_SUBSCRIPTION_CHANGE_MODIFY;
+        ldap_value_free_len(values);
+
+        return change;
+    }
+
+    if (ldap_get_entry_controls(connection->ldap, message, &controls) != LDAP_SUCCESS)
+    {
+        return 0;
+    }
+
+    if (subscription->mechanism == LD_SUBSCRIPTION_MECHANISM_PERSISTENT_SEARCH)
+    {
+        control = ldap_control_find(LDAP_CONTROL_PERSIST_ENTRY_CHANGE_NOTICE, controls, NULL);
+        if (control && (ber = ber_init(&control->ldctl_value)) != NULL)
+        {
+            ber_int_t change_type = 0;
+            struct berval dn = { 0, NULL };
+
+            if (ber_scanf(ber, "{e", &change_type) != LBER_ERROR)
+            {
+                change = change_type;
+
+                if (ber_peek_tag(ber, &length) == LBER_OCTETSTRING && ber_scanf(ber, "m", &dn) != LBER_ERROR)
+                {
+                    *previous_dn = ber_strndup(dn.bv_val, dn.bv_len);
+                }
+            }
+        }
+    }
+    else
+    {
+        control = ldap_control_find(LDAP_CONTROL_SYNC_STATE, controls, NULL);
+        if (control && (ber = ber_init(&control->ldctl_value)) != NULL)
+        {
+            ber_int_t state = LDAP_SYNC_PRESENT;
+            struct berval uuid = { 0, NULL };
+
+            if (ber_scanf(ber, "{em", &state, &uuid) != LBER_ERROR && subscription->refresh_done)
+            {
+                switch (state)
+                {
+                case LDAP_SYNC_ADD:
+                    change = LD_SUBSCRIPTION_CHANGE_ADD;
+                    break;
+                case LDAP_SYNC_MODIFY:
+                    change = LD_SUBSCRIPTION_CHANGE_MODIFY;
+                    break;
+                case LDAP_SYNC_DELETE:
+                    change = LD_SUBSCRIPTION_CHANGE_DELETE;
+                    break;
+                default:
+                    break;
+                }
+            }
+        }
+    }
+
+    if (ber)
+    {
+        ber_free(ber, 1);
+    }
+    ldap_controls_free(controls);
+
+    return change;
+}
+
+/**
+ * @brief subscription_process_result Handles end of subscription request.
+ * @param[in] connection              Connection to work with.
+ * @param[in] subscription            Subscription to work with.
+ * @param[in] message                 Search result message.
+ */
+static void subscription_process_result(struct ldap_connection_ctx_t *connection,
+                                        ld_subscription_t *subscription,
+                                        LDAPMessage *message)
+{
+    int error_code = 0;
+    char *diagnostic_message = NULL;
+
+    ldap_parse_result(connection->ldap, message, &error_code, NULL, &diagnostic_message, NULL, NULL, 0);
+
+    ld_warning("Subscription to %s has been terminated by server: %s %s\n", subscription->base_dn,
+               ldap_err2string(error_code), diagnostic_message ? diagnostic_message : "");
+
+    ldap_memfree(diagnostic_message);
+
+    if (error_code == LDAP_SYNC_REFRESH_REQUIRED)
+    {
+        talloc_free(subscription->cookie.bv_val);
+        subscription->cookie.bv_val = NULL;
+        subscription->cookie.bv_len = 0;
+    }
+
+    // Requests rejected right away will be rejected again, do not retry them.
+    subscription->state = subscription->received || error_code == LDAP_SYNC_REFRESH_REQUIRED
+            ? LD_SUBSCRIPTION_STATE_INACTIVE
+            : LD_SUBSCRIPTION_STATE_FAILED;
+    subscription->msgid = -1;
+}
+
+/**
+ * @brief subscription_entry_matches Checks whether changed entry matches filter of the subscription.
+ *
+ * Tombstones keep only few attributes, so deletions can not be matched and are always reported.
+ * @param[in] subscription           Subscription to work with.
+ * @param[in] change                 Kind of the change.
+ * @param[in] entry                  Changed entry.
+ * @return True if entry should be reported.
+ */
+static bool subscription_entry_matches(ld_subscription_t *subscription, int change, ld_entry_t *entry)
+{
+    if (!subscription->program || change == LD_SUBSCRIPTION_CHANGE_DELETE)
+    {
+        return true;
+    }
+
+    return ld_filter_match(subscription->program, entry);
+}
+
+/**
+ * @brief subscription_on_read This callback is called when messages of subscription request arrive.
+ * @param[in] rc               Return code of ldap_result.
+ * @param[in] message          Message received from ldap.
+ * @param[in] connection       Connection to work with.
+ * @return
+ *        - RETURN_CODE_OPERATION_IN_PROGRESS while subscription is active.
+ *        - RETURN_CODE_SUCCESS when subscription request has been completed by server.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode subscription_on_read(int rc, LDAPMessage *message, struct ldap_connection_ctx_t *connection)
+{
+    ld_subscription_t *subscription = connection->request_user_data;
+    enum OperationReturnCode result = RETURN_CODE_OPERATION_IN_PROGRESS;
+
+    if (!subscription)
+    {
+        ld_error("subscription_on_read - subscription is missing!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (rc == LDAP_RES_ANY)
+    {
+        // Request is lost, subscription is started again by subscription_restore_all.
+        subscription->state = LD_SUBSCRIPTION_STATE_INACTIVE;
+        subscription->msgid = -1;
+        return RETURN_CODE_SUCCESS;
+    }
+
+    subscription->in_callback = true;
+
+    for (LDAPMessage *current = ldap_first_message(connection->ldap, message);
+         current != NULL && !subscription->cancelled;
+         current = ldap_next_message(connection->ldap, current))
+    {
+        subscription->received = true;
+
+        switch (ldap_msgtype(current))
+        {
+        case LDAP_RES_SEARCH_ENTRY:
+        {
+            char *previous_dn = NULL;
+            int change = subscription_get_change(connection, subscription, current, &previous_dn);
+
+            if (change & subscription->change_types)
+            {
+                ld_entry_t *entry = ld_entry_from_message(subscription, connection->ldap, current);
+
+                if (entry && !subscription_entry_matches(subscription, change, entry))
+                {
+                    talloc_free(entry);
+                }
+                else if (entry)
+                {
+                    subscription->callback(connection, subscription, change, entry, previous_dn,
+                                           subscription->user_data);
+
+                    // Callback may keep entry by stealing it.
+                    if (talloc_parent(entry) == subscription)
+                    {
+                        talloc_free(entry);
+                    }
+                }
+                else
+                {
+                    ld_error("subscription_on_read - out of memory - unable to create entry!\n");
+                }
+            }
+
+            if (previous_dn)
+            {
+                ber_memfree(previous_dn);
+            }
+        }
+            break;
+        case LDAP_RES_INTERMEDIATE:
+            subscription_parse_sync_info(connection, subscription, current);
+            break;
+        case LDAP_RES_SEARCH_RESULT:
+            subscription_process_result(connection, subscription, current);
+            result = RETURN_CODE_SUCCESS;
+            break;
+        default:
+            break;
+        }
+    }
+
+    subscription->in_callback = false;
+
+    if (subscription->cancelled)
+    {
+        talloc_free(subscription);
+        return RETURN_CODE_SUCCESS;
+    }
+
+    return result;
+}
@@ -0,0 +1,83 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_SUBSCRIPTION_H
+#define LIBDOMAIN_SUBSCRIPTION_H
+
+#include "common.h"
+#include "connection.h"
+
+enum LdapSubscriptionChangeType
+{
+    LD_SUBSCRIPTION_CHANGE_ADD    = 1,      //!< Entry has been added.
+    LD_SUBSCRIPTION_CHANGE_DELETE = 2,      //!< Entry has been deleted.
+    LD_SUBSCRIPTION_CHANGE_MODIFY = 4,      //!< Entry has been modified.
+    LD_SUBSCRIPTION_CHANGE_RENAME = 8,      //!< Entry has been renamed.
+    LD_SUBSCRIPTION_CHANGE_ANY    = 15,     //!< Any of the changes above.
+};
+
+enum LdapSubscriptionMechanism
+{
+    LD_SUBSCRIPTION_MECHANISM_NONE              = 0,    //!< Mechanism has not been selected yet.
+    LD_SUBSCRIPTION_MECHANISM_PERSISTENT_SEARCH = 1,    //!< Persistent search control.
+    LD_SUBSCRIPTION_MECHANISM_CONTENT_SYNC      = 2,    //!< RFC 4533 content synchronization in refreshAndPersist mode.
+    LD_SUBSCRIPTION_MECHANISM_NOTIFICATION      = 3,    //!< Active Directory change notification control.
+};
+
+enum LdapSubscriptionState
+{
+    LD_SUBSCRIPTION_STATE_INACTIVE = 0,     //!< Subscription waits for connection to be established.
+    LD_SUBSCRIPTION_STATE_ACTIVE   = 1,     //!< Subscription request has been sent to server.
+    LD_SUBSCRIPTION_STATE_FAILED   = 2,     //!< Server has rejected subscription, it will not be re-established.
+};
+
+/**
+ * @brief subscription_callback_fn Callback fired for every change reported by server.
+ *
+ * Entry is freed after callback returns, use talloc_steal() to keep it.
+ * Active Directory does not report kind of the change, so additions and renames are reported as modifications.
+ * Previous DN is set only for LD_SUBSCRIPTION_CHANGE_RENAME reported by persistent search.
+ */
+typedef enum OperationReturnCode (*subscription_callback_fn)(struct ldap_connection_ctx_t *connection,
+                                                             ld_subscription_t *subscription,
+                                                             enum LdapSubscriptionChangeType change,
+                                                             ld_entry_t *entry,
+                                                             const char *previous_dn,
+                                                             void *user_data);
+
+ld_subscription_t *ld_subscribe(struct ldap_connection_ctx_t *connection,
+                                const char *base_dn,
+                                int scope,
+                                const char *filter,
+                                char **attrs,
+                                int change_types,
+                                subscription_callback_fn callback,
+                                void *user_data);
+enum OperationReturnCode ld_unsubscribe(struct ldap_connection_ctx_t *connection, ld_subscription_t *subscription);
+
+enum LdapSubscriptionState ld_subscription_get_state(const ld_subscription_t *subscription);
+enum LdapSubscriptionMechanism ld_subscription_get_mechanism(const ld_subscription_t *subscription);
+
+enum OperationReturnCode subscription_on_read(int rc, LDAPMessage *message, struct ldap_connection_ctx_t *connection);
+
+void subscription_suspend_all(struct ldap_connection_ctx_t *connection);
+enum OperationReturnCode subscription_restore_all(struct ldap_connection_ctx_t *connection);
+
+#endif //LIBDOMAIN_SUBSCRIPTION_H
@@ -0,0 +1,579 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "subtree_delete.h"
+#include "directory.h"
+#include "dn.h"
+#include "entry_cache.h"
+#include "write_scheduler.h"
+
+#include "helper_p.h"
+
+#include <string.h>
+
+#include <glib-2.0/glib.h>
+
+#define SUBTREE_DELETE_PAGE_SIZE 1000
+#define SUBTREE_DELETE_MAX_RETRIES 1000
+
+static char *SUBTREE_DELETE_NO_ATTRIBUTES[] = { LDAP_NO_ATTRS, NULL };
+
+/*!
+ * @brief ld_subtree_delete_t - Delete of the subtree.
+ */
+struct ld_subtree_delete_s
+{
+    struct ldap_connection_ctx_t *connection;   //!< Connection to work with.
+    ld_write_scheduler_t *scheduler;            //!< Scheduler of deletes, subtree delete belongs to it.
+
+    char *dn;                                   //!< Root of the subtree.
+    unsigned int root_depth;                    //!< Amount of RDNs in the root DN.
+    unsigned int retries;                       //!< Amount of repeated tree delete requests.
+
+    bool paged;                                 //!< Search results are requested page by page.
+    struct berval cookie;                       //!< Paged results cookie of the next page.
+    GPtrArray *levels;                          //!< DNs of the subtree by depth below the root.
+
+    bool failed;                                //!< Subtree delete has failed before deletes were submitted.
+    unsigned long deleted;                      //!< Amount of deleted entries.
+    unsigned long failures;                     //!< Amount of entries which have not been deleted.
+
+    subtree_delete_progress_callback_fn progress_callback; //!< Callback to report results of deletes to.
+    subtree_delete_complete_callback_fn complete_callback; //!< Callback to call on completion.
+    void *user_data;                            //!< User data passed to callbacks.
+};
+
+static int subtree_delete_destructor(TALLOC_CTX *ctx)
+{
+    ld_subtree_delete_t *subtree_delete = talloc_get_type_abort(ctx, ld_subtree_delete_t);
+
+    g_ptr_array_free(subtree_delete->levels, TRUE);
+
+    return 0;
+}
+
+/**
+ * @brief subtree_delete_finish Completes subtree delete once all submitted deletes complete.
+ */
+static void subtree_delete_finish(ld_subtree_delete_t *subtree_delete, enum OperationReturnCode rc)
+{
+    subtree_delete->failed = subtree_delete->failed || rc != RETURN_CODE_SUCCESS;
+
+    // Completion callback may be called and subtree delete released here.
+    ld_write_scheduler_finish(subtree_delete->scheduler);
+}
+
+/**
+ * @brief subtree_delete_report Updates counters and passes result of the delete to the callback.
+ */
+static void subtree_delete_report(ld_subtree_delete_t *subtree_delete, const char *dn,
+                                  enum OperationReturnCode rc, int result_code)
+{
+    if (rc == RETURN_CODE_SUCCESS)
+    {
+        ++subtree_delete->deleted;
+    }
+    else
+    {
+        ++subtree_delete->failures;
+    }
+
+    if (subtree_delete->progress_callback)
+    {
+        subtree_delete->progress_callback(subtree_delete, dn, rc, result_code, subtree_delete->user_data);
+    }
+}
+
+static void subtree_delete_on_request(ld_write_scheduler_t *scheduler, const ld_write_request_t *request,
+                                      enum OperationReturnCode rc, int result_code, void *user_data)
+{
+    (void)(scheduler);
+
+    subtree_delete_report(user_data, request->dn, rc, result_code);
+}
+
+static void subtree_delete_on_complete(ld_write_scheduler_t *scheduler, enum OperationReturnCode rc, void *user_data)
+{
+    (void)(scheduler);
+
+    ld_subtree_delete_t *subtree_delete = user_data;
+
+    if (subtree_delete->complete_callback)
+    {
+        subtree_delete->complete_callback(subtree_delete,
+                                          subtree_delete->failed || subtree_delete->failures > 0
+                                            ? RETURN_CODE_FAILURE
+                                            : rc,
+                                          subtree_delete->user_data);
+    }
+}
+
+/**
+ * @brief subtree_delete_submit Submits deletes of found entries starting from the deepest level.
+ *
+ * Scheduler makes every delete wait for deletes submitted earlier below it.
+ */
+static void subtree_delete_submit(ld_subtree_delete_t *subtree_delete)
+{
+    for (guint level = subtree_delete->levels->len; level > 0; --level)
+    {
+        GPtrArray *dns = g_ptr_array_index(subtree_delete->levels, level - 1);
+
+        for (guint i = 0; dns && i < dns->len; ++i)
+        {
+            const char *dn = g_ptr_array_index(dns, i);
+
+            if (ld_write_scheduler_delete(subtree_delete->scheduler, dn) != RETURN_CODE_SUCCESS)
+            {
+                subtree_delete_report(subtree_delete, dn, RETURN_CODE_FAILURE, LDAP_PARAM_ERROR);
+            }
+        }
+    }
+
+    g_ptr_array_set_size(subtree_delete->levels, 0);
+
+    subtree_delete_finish(subtree_delete, RETURN_CODE_SUCCESS);
+}
+
+/**
+ * @brief subtree_delete_add_dn Stores DN of the found entry at its level.
+ */
+static void subtree_delete_add_dn(ld_subtree_delete_t *subtree_delete, const char *dn)
+{
+    ld_dn_t *parsed = ld_dn_parse(NULL, dn, NULL);
+    if (!parsed)
+    {
+        ld_error("subtree_delete_add_dn - invalid DN %s!\n", dn);
+        subtree_delete->failed = true;
+        return;
+    }
+
+    unsigned int depth = ld_dn_get_rdn_count(parsed);
+    talloc_free(parsed);
+
+    if (depth < subtree_delete->root_depth)
+    {
+        return;
+    }
+
+    guint level = depth - subtree_delete->root_depth;
+
+    while (subtree_delete->levels->len <= level)
+    {
+        g_ptr_array_add(subtree_delete->levels, g_ptr_array_new_with_free_func(g_free));
+    }
+
+    g_ptr_array_add(g_ptr_array_index(subtree_delete->levels, level), g_strdup(dn));
+}
+
+static enum OperationReturnCode subtree_delete_on_read(int rc, LDAPMessage *message,
+                                                       struct ldap_connection_ctx_t *connection);
+
+/**
+ * @brief subtree_delete_search_send Sends request for the next page of the subtree.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode subtree_delete_search_send(ld_subtree_delete_t *subtree_delete)
+{
+    struct ldap_connection_ctx_t *connection = subtree_delete->connection;
+    LDAPControl *controls[2] = { NULL, NULL };
+    int msgid = 0;
+
+    if (subtree_delete->paged
+        && ldap_create_page_control(connection->ldap, SUBTREE_DELETE_PAGE_SIZE, &subtree_delete->cookie, 0,
+                                    &controls[0]) != LDAP_SUCCESS)
+    {
+        ld_error("subtree_delete_search_send - unable to create paged results control!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    int rc = ldap_search_ext(connection->ldap,
+                             subtree_delete->dn,
+                             LDAP_SCOPE_SUBTREE,
+                             "(objectClass=*)",
+                             SUBTREE_DELETE_NO_ATTRIBUTES,
+                             0,
+                             controls,
+                             NULL,
+                             NULL,
+                             LDAP_NO_LIMIT,
+                             &msgid);
+
+    if (controls[0])
+    {
+        ldap_control_free(controls[0]);
+    }
+
+    if (rc != LDAP_SUCCESS)
+    {
+        ld_error("Unable to create subtree search request: %s\n", ldap_err2string(rc));
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (connection_add_stream_request(connection, msgid, subtree_delete_on_read, subtree_delete) != RETURN_CODE_SUCCESS)
+    {
+        ldap_abandon_ext(connection->ldap, msgid, NULL, NULL);
+        return RETURN_CODE_FAILURE;
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief subtree_delete_search_result Processes search result, requests next page or starts deletes.
+ * @return RETURN_CODE_SUCCESS to remove request from connection.
+ */
+static enum OperationReturnCode subtree_delete_search_result(ld_subtree_delete_t *subtree_delete,
+                                                             LDAPMessage *message)
+{
+    LDAP *ldap = subtree_delete->connection->ldap;
+    int error_code = 0;
+    char *diagnostic_message = NULL;
+    LDAPControl **controls = NULL;
+    bool more_results = false;
+
+    if (ldap_parse_result(ldap, message, &error_code, NULL, &diagnostic_message, NULL, &controls, 0) != LDAP_SUCCESS)
+    {
+        subtree_delete_finish(subtree_delete, RETURN_CODE_FAILURE);
+        return RETURN_CODE_SUCCESS;
+    }
+
+    if (error_code != LDAP_SUCCESS)
+    {
+        ld_error("Subtree search request failed: %s %s\n", ldap_err2string(error_code),
+                 diagnostic_message ? diagnostic_message : "");
+
+        ldap_memfree(diagnostic_message);
+        ldap_controls_free(controls);
+
+        subtree_delete_finish(subtree_delete, RETURN_CODE_FAILURE);
+        return RETURN_CODE_SUCCESS;
+    }
+
+    ldap_memfree(diagnostic_message);
+
+    LDAPControl *control = subtree_delete->paged ? ldap_control_find(LDAP_CONTROL_PAGEDRESULTS, controls, NULL) : NULL;
+    if (control)
+    {
+        ber_int_t count = 0;
+        struct berval cookie = { 0, NULL };
+
+        if (ldap_parse_pageresponse_control(ldap, control, &count, &cookie) == LDAP_SUCCESS)
+        {
+            talloc_free(subtree_delete->cookie.bv_val);
+            subtree_delete->cookie.bv_val = cookie.bv_len > 0
+                    ? talloc_memdup(subtree_delete, cookie.bv_val, cookie.bv_len)
+                    : NULL;
+            subtree_delete->cookie.bv_len = subtree_delete->cookie.bv_val ? cookie.bv_len : 0;
+            more_results = subtree_delete->cookie.bv_len > 0;
+            ber_memfree(cookie.bv_val);
+        }
+    }
+
+    ldap_controls_free(controls);
+
+    if (subtree_delete->failed)
+    {
+        subtree_delete_finish(subtree_delete, RETURN_CODE_FAILURE);
+    }
+    else if (!more_results)
+    {
+        subtree_delete_submit(subtree_delete);
+    }
+    else if (subtree_delete_search_send(subtree_delete) != RETURN_CODE_SUCCESS)
+    {
+        subtree_delete_finish(subtree_delete, RETURN_CODE_FAILURE);
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief subtree_delete_on_read This callback is called when messages of subtree search arrive.
+ * @param[in] rc            Return code of ldap_result.
+ * @param[in] message       Message received from ldap.
+ * @param[in] connection    Connection to work with.
+ * @return
+ *        - RETURN_CODE_OPERATION_IN_PROGRESS while results are being received.
+ *        - RETURN_CODE_SUCCESS when request has been completed.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode subtree_delete_on_read(int rc, LDAPMessage *message,
+                                                       struct ldap_connection_ctx_t *connection)
+{
+    ld_subtree_delete_t *subtree_delete = connection->request_user_data;
+
+    if (!subtree_delete)
+    {
+        ld_error("subtree_delete_on_read - subtree delete is missing!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (rc == LDAP_RES_ANY)
+    {
+        subtree_delete_finish(subtree_delete, RETURN_CODE_FAILURE);
+        return RETURN_CODE_SUCCESS;
+    }
+
+    for (LDAPMessage *current = ldap_first_message(connection->ldap, message);
+         current != NULL;
+         current = ldap_next_message(connection->ldap, current))
+    {
+        switch (ldap_msgtype(current))
+        {
+        case LDAP_RES_SEARCH_ENTRY:
+        {
+            char *dn = ldap_get_dn(connection->ldap, current);
+            if (dn)
+            {
+                subtree_delete_add_dn(subtree_delete, dn);
+                ldap_memfree(dn);
+            }
+        }
+            break;
+        case LDAP_RES_SEARCH_REFERENCE:
+            ld_info("Received search referral but not following it!");
+            break;
+        case LDAP_RES_SEARCH_RESULT:
+            return subtree_delete_search_result(subtree_delete, current);
+        default:
+            break;
+        }
+    }
+
+    return RETURN_CODE_OPERATION_IN_PROGRESS;
+}
+
+static enum OperationReturnCode subtree_delete_on_tree_result(int rc, LDAPMessage *message,
+                                                              struct ldap_connection_ctx_t *connection);
+
+/**
+ * @brief subtree_delete_tree_send Sends delete request with tree delete control.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode subtree_delete_tree_send(ld_subtree_delete_t *subtree_delete)
+{
+    struct ldap_connection_ctx_t *connection = subtree_delete->connection;
+    LDAPControl *controls[2] = { NULL, NULL };
+    int msgid = 0;
+
+    if (ldap_control_create(LDAP_CONTROL_X_TREE_DELETE, 1, NULL, 0, &controls[0]) != LDAP_SUCCESS)
+    {
+        ld_error("subtree_delete_tree_send - unable to create tree delete control!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    int rc = ldap_delete_ext(connection->ldap, subtree_delete->dn, controls, NULL, &msgid);
+
+    ldap_control_free(controls[0]);
+
+    if (rc != LDAP_SUCCESS)
+    {
+        ld_error("Unable to create tree delete request: %s\n", ldap_err2string(rc));
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (connection_add_read_request(connection, msgid, subtree_delete_on_tree_result, subtree_delete)
+        != RETURN_CODE_SUCCESS)
+    {
+        ldap_abandon_ext(connection->ldap, msgid, NULL, NULL);
+        return RETURN_CODE_FAILURE;
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief subtree_delete_on_tree_result This callback is called when result of tree delete arrives.
+ *
+ * Request is repeated while server reports that it has reached its limit, search of the subtree is started
+ * if server has refused the control.
+ * @param[in] rc                 Return code of ldap_result.
+ * @param[in] message            Message received from ldap.
+ * @param[in] connection         Connection to work with.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode subtree_delete_on_tree_result(int rc, LDAPMessage *message,
+                                                              struct ldap_connection_ctx_t *connection)
+{
+    ld_subtree_delete_t *subtree_delete = connection->request_user_data;
+    int error_code = LDAP_OTHER;
+    char *diagnostic_message = NULL;
+
+    if (!subtree_delete)
+    {
+        ld_error("subtree_delete_on_tree_result - subtree delete is missing!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    if (rc == LDAP_RES_DELETE)
+    {
+        ldap_parse_result(connection->ldap, message, &error_code, NULL, &diagnostic_message, NULL, NULL, false);
+    }
+    else if (rc == LDAP_RES_ANY)
+    {
+        // Connection is lost, deleting entries one by one would fail as well.
+        error_code = LDAP_SERVER_DOWN;
+    }
+
+    ldap_memfree(diagnostic_message);
+
+    switch (error_code)
+    {
+    case LDAP_SUCCESS:
+        entry_cache_invalidate_write(connection, subtree_delete->dn, true, false);
+
+        subtree_delete_report(subtree_delete, subtree_delete->dn, RETURN_CODE_SUCCESS, error_code);
+        subtree_delete_finish(subtree_delete, RETURN_CODE_SUCCESS);
+        return RETURN_CODE_SUCCESS;
+
+    case LDAP_ADMINLIMIT_EXCEEDED:
+        if (subtree_delete->retries++ < SUBTREE_DELETE_MAX_RETRIES
+            && subtree_delete_tree_send(subtree_delete) == RETURN_CODE_SUCCESS)
+        {
+            return RETURN_CODE_SUCCESS;
+        }
+        break;
+
+    case LDAP_NO_SUCH_OBJECT:
+    case LDAP_INSUFFICIENT_ACCESS:
+    case LDAP_SERVER_DOWN:
+        break;
+
+    default:
+        ld_info("Tree delete of %s has failed: %s, deleting entries one by one\n", subtree_delete->dn,
+                ldap_err2string(error_code));
+
+        if (subtree_delete_search_send(subtree_delete) == RETURN_CODE_SUCCESS)
+        {
+            return RETURN_CODE_SUCCESS;
+        }
+        break;
+    }
+
+    subtree_delete_report(subtree_delete, subtree_delete->dn, RETURN_CODE_FAILURE, error_code);
+    subtree_delete_finish(subtree_delete, RETURN_CODE_FAILURE);
+
+    return RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief ld_subtree_delete Deletes entry together with all entries below it.
+ *
+ * Completion callback may be called before function returns.
+ * @param[in] ctx                Talloc ctx to use.
+ * @param[in] connection         Connection to work with, should be in LDAP_CONNECTION_STATE_RUN state.
+ * @param[in] dn                 Root of the subtree.
+ * @param[in] window             Maximum amount of deletes in flight, 0 for default.
+ * @param[in] progress_callback  Callback to report result of every delete to, may be NULL.
+ * @param[in] complete_callback  Callback to call on completion, may be NULL.
+ * @param[in] user_data          User data passed to callbacks.
+ * @return
+ *        - RETURN_CODE_SUCCESS if subtree delete has been started.
+ *        - RETURN_CODE_FAILURE on failure, callbacks are not called.
+ */
+enum OperationReturnCode ld_subtree_delete(TALLOC_CTX *ctx,
+                                           struct ldap_connection_ctx_t *connection,
+                                           const char *dn,
+                                           unsigned int window,
+                                           subtree_delete_progress_callback_fn progress_callback,
+                                           subtree_delete_complete_callback_fn complete_callback,
+                                           void *user_data)
+{
+    ld_subtree_delete_t *subtree_delete = NULL;
+    enum OperationReturnCode rc = RETURN_CODE_FAILURE;
+
+    if (!connection || !dn)
+    {
+        ld_error("ld_subtree_delete - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    ld_dn_t *parsed = ld_dn_parse(NULL, dn, NULL);
+    if (!parsed)
+    {
+        ld_error("ld_subtree_delete - invalid DN %s!\n", dn);
+        return RETURN_CODE_FAILURE;
+    }
+
+    unsigned int root_depth = ld_dn_get_rdn_count(parsed);
+    talloc_free(parsed);
+
+    ld_talloc_zero_e(subtree_delete, error_exit, "ld_subtree_delete - out of memory - unable to create subtree delete!\n",
+                     NULL, ld_subtree_delete_t);
+
+    subtree_delete->levels = g_ptr_array_new_with_free_func((GDestroyNotify)g_ptr_array_unref);
+    talloc_set_destructor((void*)subtree_delete, subtree_delete_destructor);
+
+    subtree_delete->connection = connection;
+    subtree_delete->root_depth = root_depth;
+    subtree_delete->paged = directory_has_capability(connection, LDAP_CAPABILITY_PAGED_RESULTS);
+    subtree_delete->progress_callback = progress_callback;
+    subtree_delete->complete_callback = complete_callback;
+    subtree_delete->user_data = user_data;
+
+    ld_talloc_strdup(subtree_delete->dn, error_exit, subtree_delete, dn);
+
+    subtree_delete->scheduler = ld_write_scheduler_new(ctx, connection, window, subtree_delete_on_request,
+                                                       subtree_delete_on_complete, subtree_delete);
+    if (!subtree_delete->scheduler)
+    {
+        goto error_exit;
+    }
+
+    talloc_steal(subtree_delete->scheduler, subtree_delete);
+
+    rc = directory_has_capability(connection, LDAP_CAPABILITY_TREE_DELETE)
+            ? subtree_delete_tree_send(subtree_delete)
+            : subtree_delete_search_send(subtree_delete);
+
+    if (rc != RETURN_CODE_SUCCESS)
+    {
+        talloc_free(subtree_delete->scheduler);
+    }
+
+    return rc;
+
+    error_exit:
+        talloc_free(subtree_delete);
+        return RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief ld_subtree_delete_get_deleted Returns amount of deleted entries, subtree deleted with control counts as one.
+ */
+unsigned long ld_subtree_delete_get_deleted(const ld_subtree_delete_t *subtree_delete)
+{
+    return subtree_delete->deleted;
+}
+
+/**
+ * @brief ld_subtree_delete_get_failed Returns amount of entries which have not been deleted.
+ */
+unsigned long ld_subtree_delete_get_failed(const ld_subtree_delete_t *subtree_delete)
+{
+    return subtree_delete->failures;
+}
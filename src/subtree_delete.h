@@ -0,0 +1,68 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_SUBTREE_DELETE_H
+#define LIBDOMAIN_SUBTREE_DELETE_H
+
+#include "common.h"
+#include "connection.h"
+
+/**
+ * Subtree delete removes entry together with everything below it. Tree delete control is used when directory
+ * supports it, otherwise subtree is searched and entries are deleted deepest first through the write scheduler,
+ * so entries of the same level are deleted in parallel and every container is deleted right after its children.
+ */
+
+typedef struct ld_subtree_delete_s ld_subtree_delete_t;
+
+/**
+ * @brief subtree_delete_progress_callback_fn Callback fired once result of the delete is known.
+ *
+ * With tree delete control it is fired only for the root of the subtree.
+ * @param[in] dn                DN of the deleted entry.
+ * @param[in] result_code       LDAP result code of the request.
+ */
+typedef void (*subtree_delete_progress_callback_fn)(ld_subtree_delete_t *subtree_delete,
+                                                    const char *dn,
+                                                    enum OperationReturnCode rc,
+                                                    int result_code,
+                                                    void *user_data);
+
+/**
+ * @brief subtree_delete_complete_callback_fn Callback fired once subtree delete has completed.
+ *
+ * Subtree delete is released once callback returns.
+ */
+typedef void (*subtree_delete_complete_callback_fn)(ld_subtree_delete_t *subtree_delete,
+                                                    enum OperationReturnCode rc,
+                                                    void *user_data);
+
+enum OperationReturnCode ld_subtree_delete(TALLOC_CTX *ctx,
+                                           struct ldap_connection_ctx_t *connection,
+                                           const char *dn,
+                                           unsigned int window,
+                                           subtree_delete_progress_callback_fn progress_callback,
+                                           subtree_delete_complete_callback_fn complete_callback,
+                                           void *user_data);
+
+unsigned long ld_subtree_delete_get_deleted(const ld_subtree_delete_t *subtree_delete);
+unsigned long ld_subtree_delete_get_failed(const ld_subtree_delete_t *subtree_delete);
+
+#endif //LIBDOMAIN_SUBTREE_DELETE_H
@@ -170,6 +170,57 @@ enum OperationReturnCode ld_add_user(LDHandle *handle, const char *name, LDAPAtt
         return rc;
 }
 
+/**
+ * @brief ld_add_users    Creates users.
+ *
+ * Parent is resolved once and requests are pipelined, callback may be called before function returns.
+ * @param[in] handle          Pointer to libdomain session handle.
+ * @param[in] users           Users to create.
+ * @param[in] n_users         Amount of users.
+ * @param[in] defaults        Attributes shared by all users, may be NULL.
+ * @param[in] parent          Container of the users, NULL for default one.
+ * @param[in] callback        Callback to report results of users to.
+ * @param[in] user_data       User data passed to callback.
+ * @return
+ *        - RETURN_CODE_SUCCESS if creation has been started.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_add_users(LDHandle *handle,
+                                      const ld_batch_item_t *users,
+                                      int n_users,
+                                      LDAPAttribute_t **defaults,
+                                      const char *parent,
+                                      batch_complete_callback_fn callback,
+                                      void *user_data)
+{
+    const char* dn = NULL;
+    enum OperationReturnCode rc = RETURN_CODE_FAILURE;
+    TALLOC_CTX *talloc_ctx = NULL;
+
+    check_handle(handle, "ld_add_users");
+
+    ld_talloc_new(talloc_ctx, error_exit, NULL);
+
+    if (parent && strlen(parent) > 0)
+    {
+        dn = parent;
+    }
+    else
+    {
+        LD_ALLOC_HELPER(dn, create_user_parent, "Unable to create user parent - out of memory", error_exit, talloc_ctx, handle);
+    }
+
+    rc = ld_batch_add_entries(handle, users, n_users, defaults, dn, "cn", 0, callback, user_data);
+
+    error_exit:
+        if (talloc_ctx)
+        {
+            talloc_free(talloc_ctx);
+        }
+
+        return rc;
+}
+
 /**
  * @brief ld_del_user Deletes user.
  * @param[in] handle      Pointer to libdomain session handle.
@@ -21,6 +21,7 @@
 #ifndef LIB_DOMAIN_USER_H
 #define LIB_DOMAIN_USER_H
 
+#include "batch.h"
 #include "common.h"
 #include "domain.h"
 
@@ -28,6 +29,13 @@ enum OperationReturnCode ld_add_user(LDHandle *handle,
                                      const char *name,
                                      LDAPAttribute_t **user_attrs,
                                      const char *parent);
+enum OperationReturnCode ld_add_users(LDHandle *handle,
+                                      const ld_batch_item_t *users,
+                                      int n_users,
+                                      LDAPAttribute_t **defaults,
+                                      const char *parent,
+                                      batch_complete_callback_fn callback,
+                                      void *user_data);
 enum OperationReturnCode ld_del_user(LDHandle *handle, const char *name, const char *parent);
 enum OperationReturnCode ld_mod_user(LDHandle *handle,
                                      const char *name,
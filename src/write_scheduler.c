@@ -0,0 +1,856 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#include "write_scheduler.h"
+#include "dn.h"
+#include "entry_cache.h"
+#include "membership.h"
+
+#include "helper_p.h"
+
+#include <string.h>
+
+#include <glib-2.0/glib.h>
+
+#define WRITE_SCHEDULER_DEFAULT_WINDOW 64
+#define WRITE_SCHEDULER_MAX_WINDOW (MAX_REQUESTS / 2)
+
+/*!
+ * @brief write_node_t - Request with its dependencies.
+ */
+typedef struct write_node_s
+{
+    ld_write_scheduler_t *scheduler;            //!< Scheduler node belongs to.
+    ld_write_request_t request;                 //!< Submitted request.
+
+    char *target;                               //!< Normalized DN of the entry.
+    char *destination;                          //!< Normalized new DN of renamed entry, NULL otherwise.
+
+    unsigned int blockers;                      //!< Amount of unfinished requests node waits for.
+    GPtrArray *dependents;                      //!< Nodes waiting for this node.
+
+    int msgid;                                  //!< Message id of the request.
+    bool in_progress;                           //!< Request has been sent and its result has not arrived yet.
+} write_node_t;
+
+/*!
+ * @brief ld_write_scheduler_t - Scheduler of write requests.
+ */
+struct ld_write_scheduler_s
+{
+    struct ldap_connection_ctx_t *connection;   //!< Connection requests are sent through.
+    unsigned int window;                        //!< Maximum amount of requests in flight.
+    unsigned int in_flight;                     //!< Amount of requests in flight.
+
+    unsigned long submitted;                    //!< Amount of submitted requests.
+    unsigned long pending;                      //!< Amount of requests which have not completed yet.
+
+    GHashTable *last;                           //!< Last unfinished node for every DN.
+    GHashTable *structural;                     //!< Last unfinished add, delete or rename for every DN.
+    GHashTable *subtrees;                       //!< Unfinished nodes below every DN.
+
+    GQueue ready;                               //!< Nodes waiting only for a free slot in the window.
+    GQueue skipped;                             //!< Nodes to report as skipped.
+
+    bool dispatching;                           //!< Nodes are being dispatched.
+    bool finishing;                             //!< No more requests are submitted.
+
+    unsigned long succeeded;                    //!< Amount of succeeded requests.
+    unsigned long failures;                     //!< Amount of failed requests.
+    unsigned long skips;                        //!< Amount of skipped requests.
+
+    write_request_callback_fn request_callback; //!< Callback to report results of requests to.
+    write_complete_callback_fn complete_callback; //!< Callback to call on completion.
+    void *user_data;                            //!< User data passed to callbacks.
+};
+
+static int write_node_destructor(TALLOC_CTX *ctx)
+{
+    write_node_t *node = talloc_get_type_abort(ctx, write_node_t);
+
+    // Scheduler is released with requests in flight, their results must not reach freed nodes.
+    if (node->in_progress)
+    {
+        connection_cancel_read_request(node->scheduler->connection, node->msgid);
+        ldap_abandon_ext(node->scheduler->connection->ldap, node->msgid, NULL, NULL);
+    }
+
+    if (node->dependents)
+    {
+        g_ptr_array_free(node->dependents, TRUE);
+    }
+
+    return 0;
+}
+
+static int write_scheduler_destructor(TALLOC_CTX *ctx)
+{
+    ld_write_scheduler_t *scheduler = talloc_get_type_abort(ctx, ld_write_scheduler_t);
+
+    g_hash_table_destroy(scheduler->last);
+    g_hash_table_destroy(scheduler->structural);
+    g_hash_table_destroy(scheduler->subtrees);
+    g_queue_clear(&scheduler->ready);
+    g_queue_clear(&scheduler->skipped);
+
+    return 0;
+}
+
+/**
+ * @brief write_scheduler_parent Returns parent of normalized DN.
+ *
+ * Special characters of values are escaped as hex pairs in normalized DN, so every comma separates RDNs.
+ * @return
+ *        - Pointer to the parent DN inside of the string.
+ *        - NULL if DN has no parent.
+ */
+static const char *write_scheduler_parent(const char *normalized)
+{
+    const char *separator = strchr(normalized, ',');
+
+    return separator ? separator + 1 : NULL;
+}
+
+/**
+ * @brief write_scheduler_copy_mods Copies modifications into talloc ctx.
+ * @param[in] ctx                   Talloc ctx to use.
+ * @param[in] mods                  NULL terminated list of modifications.
+ * @return
+ *        - Copy of modifications.
+ *        - NULL on failure.
+ */
+LDAPMod **write_scheduler_copy_mods(TALLOC_CTX *ctx, LDAPMod **mods)
+{
+    LDAPMod **result = NULL;
+    int count = 0;
+
+    while (mods[count])
+    {
+        ++count;
+    }
+
+    ld_talloc_zero_array(result, error_exit, ctx, LDAPMod*, count + 1);
+
+    for (int i = 0; i < count; ++i)
+    {
+        int n_values = 0;
+
+        ld_talloc_zero(result[i], error_exit, result, LDAPMod);
+        result[i]->mod_op = mods[i]->mod_op;
+        ld_talloc_strdup(result[i]->mod_type, error_exit, result[i], mods[i]->mod_type);
+
+        if (mods[i]->mod_op & LDAP_MOD_BVALUES)
+        {
+            while (mods[i]->mod_bvalues && mods[i]->mod_bvalues[n_values])
+            {
+                ++n_values;
+            }
+
+            if (!mods[i]->mod_bvalues)
+            {
+                continue;
+            }
+
+            ld_talloc_zero_array(result[i]->mod_bvalues, error_exit, result[i], struct berval*, n_values + 1);
+            for (int j = 0; j < n_values; ++j)
+            {
+                struct berval *value = mods[i]->mod_bvalues[j];
+
+                ld_talloc_zero(result[i]->mod_bvalues[j], error_exit, result[i]->mod_bvalues, struct berval);
+                result[i]->mod_bvalues[j]->bv_len = value->bv_len;
+                result[i]->mod_bvalues[j]->bv_val = talloc_memdup(result[i]->mod_bvalues[j], value->bv_val,
+                                                                  value->bv_len + 1);
+                if (!result[i]->mod_bvalues[j]->bv_val)
+                {
+                    goto error_exit;
+                }
+                result[i]->mod_bvalues[j]->bv_val[value->bv_len] = '\0';
+            }
+        }
+        else
+        {
+            while (mods[i]->mod_values && mods[i]->mod_values[n_values])
+            {
+                ++n_values;
+            }
+
+            if (!mods[i]->mod_values)
+            {
+                continue;
+            }
+
+            ld_talloc_zero_array(result[i]->mod_values, error_exit, result[i], char*, n_values + 1);
+            for (int j = 0; j < n_values; ++j)
+            {
+                ld_talloc_strdup(result[i]->mod_values[j], error_exit, result[i]->mod_values, mods[i]->mod_values[j]);
+            }
+        }
+    }
+
+    return result;
+
+    error_exit:
+        talloc_free(result);
+        return NULL;
+}
+
+/**
+ * @brief write_scheduler_depend Makes node wait for blocker.
+ */
+static void write_scheduler_depend(write_node_t *node, write_node_t *blocker)
+{
+    if (!blocker || blocker == node)
+    {
+        return;
+    }
+
+    g_ptr_array_add(blocker->dependents, node);
+    ++node->blockers;
+}
+
+/**
+ * @brief write_scheduler_depend_on_subtree Makes node wait for all unfinished nodes below DN.
+ */
+static void write_scheduler_depend_on_subtree(ld_write_scheduler_t *scheduler, write_node_t *node, const char *dn)
+{
+    GHashTable *subtree = g_hash_table_lookup(scheduler->subtrees, dn);
+    if (!subtree)
+    {
+        return;
+    }
+
+    GHashTableIter iter;
+    gpointer key = NULL;
+
+    g_hash_table_iter_init(&iter, subtree);
+    while (g_hash_table_iter_next(&iter, &key, NULL))
+    {
+        write_scheduler_depend(node, key);
+    }
+}
+
+/**
+ * @brief write_scheduler_depend_on_ancestors Makes node wait for unfinished adds, deletes and renames of ancestors.
+ */
+static void write_scheduler_depend_on_ancestors(ld_write_scheduler_t *scheduler, write_node_t *node, const char *dn)
+{
+    for (const char *ancestor = write_scheduler_parent(dn); ancestor; ancestor = write_scheduler_parent(ancestor))
+    {
+        write_scheduler_depend(node, g_hash_table_lookup(scheduler->structural, ancestor));
+    }
+}
+
+/**
+ * @brief write_scheduler_register Makes node the last one of DN and adds it to subtrees of ancestors.
+ */
+static void write_scheduler_register(ld_write_scheduler_t *scheduler, write_node_t *node, char *dn)
+{
+    g_hash_table_replace(scheduler->last, dn, node);
+
+    if (node->request.operation != LD_WRITE_MODIFY)
+    {
+        g_hash_table_replace(scheduler->structural, dn, node);
+    }
+
+    for (const char *ancestor = write_scheduler_parent(dn); ancestor; ancestor = write_scheduler_parent(ancestor))
+    {
+        GHashTable *subtree = g_hash_table_lookup(scheduler->subtrees, ancestor);
+        if (!subtree)
+        {
+            subtree = g_hash_table_new(g_direct_hash, g_direct_equal);
+            g_hash_table_insert(scheduler->subtrees, g_strdup(ancestor), subtree);
+        }
+
+        g_hash_table_add(subtree, node);
+    }
+}
+
+/**
+ * @brief write_scheduler_unregister Removes completed node from indexes of DN.
+ */
+static void write_scheduler_unregister(ld_write_scheduler_t *scheduler, write_node_t *node, const char *dn)
+{
+    if (g_hash_table_lookup(scheduler->last, dn) == node)
+    {
+        g_hash_table_remove(scheduler->last, dn);
+    }
+
+    if (g_hash_table_lookup(scheduler->structural, dn) == node)
+    {
+        g_hash_table_remove(scheduler->structural, dn);
+    }
+
+    for (const char *ancestor = write_scheduler_parent(dn); ancestor; ancestor = write_scheduler_parent(ancestor))
+    {
+        GHashTable *subtree = g_hash_table_lookup(scheduler->subtrees, ancestor);
+        if (subtree && g_hash_table_remove(subtree, node) && g_hash_table_size(subtree) == 0)
+        {
+            g_hash_table_remove(scheduler->subtrees, ancestor);
+        }
+    }
+}
+
+/**
+ * @brief write_scheduler_complete Reports result of the request and releases nodes waiting for it.
+ *
+ * Dependents of failed request are queued to be reported as skipped.
+ */
+static void write_scheduler_complete(write_node_t *node, enum OperationReturnCode rc, int result_code)
+{
+    ld_write_scheduler_t *scheduler = node->scheduler;
+
+    write_scheduler_unregister(scheduler, node, node->target);
+    if (node->destination)
+    {
+        write_scheduler_unregister(scheduler, node, node->destination);
+    }
+
+    if (node->request.skipped)
+    {
+        ++scheduler->skips;
+    }
+    else if (rc == RETURN_CODE_SUCCESS)
+    {
+        ++scheduler->succeeded;
+    }
+    else
+    {
+        ++scheduler->failures;
+    }
+
+    if (scheduler->request_callback)
+    {
+        scheduler->request_callback(scheduler, &node->request, rc, result_code, scheduler->user_data);
+    }
+
+    for (guint i = 0; i < node->dependents->len; ++i)
+    {
+        write_node_t *dependent = g_ptr_array_index(node->dependents, i);
+
+        dependent->request.skipped = dependent->request.skipped || rc != RETURN_CODE_SUCCESS;
+
+        if (--dependent->blockers == 0)
+        {
+            g_queue_push_tail(dependent->request.skipped ? &scheduler->skipped : &scheduler->ready, dependent);
+        }
+    }
+
+    --scheduler->pending;
+
+    talloc_free(node);
+}
+
+static enum OperationReturnCode write_scheduler_on_result(int rc, LDAPMessage *message,
+                                                          struct ldap_connection_ctx_t *connection);
+
+/**
+ * @brief write_scheduler_send Sends request of the node, completes node with failure if request can not be sent.
+ */
+static void write_scheduler_send(write_node_t *node)
+{
+    ld_write_scheduler_t *scheduler = node->scheduler;
+    ld_write_request_t *request = &node->request;
+    LDAP *ldap = scheduler->connection->ldap;
+    int msgid = 0;
+    int rc = LDAP_OTHER;
+
+    switch (request->operation)
+    {
+    case LD_WRITE_ADD:
+        rc = ldap_add_ext(ldap, request->dn, request->mods, NULL, NULL, &msgid);
+        break;
+    case LD_WRITE_DELETE:
+        rc = ldap_delete_ext(ldap, request->dn, NULL, NULL, &msgid);
+        break;
+    case LD_WRITE_MODIFY:
+        rc = ldap_modify_ext(ldap, request->dn, request->mods, NULL, NULL, &msgid);
+        break;
+    case LD_WRITE_RENAME:
+        rc = ldap_rename(ldap, request->dn, request->new_rdn, request->new_superior, request->delete_old_rdn,
+                         NULL, NULL, &msgid);
+        break;
+    default:
+        break;
+    }
+
+    if (rc != LDAP_SUCCESS)
+    {
+        ld_error("write_scheduler_send - unable to send request %lu: %s\n", request->id, ldap_err2string(rc));
+        write_scheduler_complete(node, RETURN_CODE_FAILURE, rc);
+        return;
+    }
+
+    if (connection_add_read_request(scheduler->connection, msgid, write_scheduler_on_result, node)
+        != RETURN_CODE_SUCCESS)
+    {
+        ldap_abandon_ext(ldap, msgid, NULL, NULL);
+        write_scheduler_complete(node, RETURN_CODE_FAILURE, LDAP_LOCAL_ERROR);
+        return;
+    }
+
+    node->msgid = msgid;
+    node->in_progress = true;
+
+    ++scheduler->in_flight;
+}
+
+/**
+ * @brief write_scheduler_dispatch Sends ready requests while window has free slots, reports skipped requests.
+ *
+ * Completes scheduler once it is finishing and nothing is left.
+ * @return
+ *        - true if scheduler has been released.
+ *        - false otherwise.
+ */
+static bool write_scheduler_dispatch(ld_write_scheduler_t *scheduler)
+{
+    if (scheduler->dispatching)
+    {
+        return false;
+    }
+
+    scheduler->dispatching = true;
+
+    while (true)
+    {
+        write_node_t *node = g_queue_pop_head(&scheduler->skipped);
+        if (node)
+        {
+            write_scheduler_complete(node, RETURN_CODE_FAILURE, LDAP_OTHER);
+            continue;
+        }
+
+        if (scheduler->in_flight >= scheduler->window || g_queue_is_empty(&scheduler->ready))
+        {
+            break;
+        }
+
+        write_scheduler_send(g_queue_pop_head(&scheduler->ready));
+    }
+
+    scheduler->dispatching = false;
+
+    if (scheduler->finishing && scheduler->pending == 0)
+    {
+        if (scheduler->complete_callback)
+        {
+            scheduler->complete_callback(scheduler,
+                                         scheduler->failures + scheduler->skips > 0
+                                            ? RETURN_CODE_FAILURE
+                                            : RETURN_CODE_SUCCESS,
+                                         scheduler->user_data);
+        }
+
+        talloc_free(scheduler);
+
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief write_scheduler_on_result This callback is called when result of the request arrives.
+ * @param[in] rc                 Return code of ldap_result.
+ * @param[in] message            Message received from ldap.
+ * @param[in] connection         Connection to work with.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode write_scheduler_on_result(int rc, LDAPMessage *message,
+                                                          struct ldap_connection_ctx_t *connection)
+{
+    write_node_t *node = connection->request_user_data;
+    int error_code = LDAP_OTHER;
+    char *diagnostic_message = NULL;
+
+    if (!node)
+    {
+        ld_error("write_scheduler_on_result - request is missing!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    ld_write_scheduler_t *scheduler = node->scheduler;
+    ld_write_request_t *request = &node->request;
+
+    node->in_progress = false;
+
+    if (rc == LDAP_RES_ADD || rc == LDAP_RES_DELETE || rc == LDAP_RES_MODIFY || rc == LDAP_RES_MODDN)
+    {
+        ldap_parse_result(connection->ldap, message, &error_code, NULL, &diagnostic_message, NULL, NULL, false);
+    }
+
+    if (error_code != LDAP_SUCCESS)
+    {
+        ld_error("Write request %lu on %s has failed: %s %s\n", request->id, request->dn,
+                 ldap_err2string(error_code), diagnostic_message ? diagnostic_message : "");
+    }
+    else
+    {
+        entry_cache_invalidate_write(connection, request->dn,
+                                     request->operation == LD_WRITE_DELETE || request->operation == LD_WRITE_RENAME,
+                                     membership_mods_affect(request->mods));
+    }
+
+    ldap_memfree(diagnostic_message);
+
+    enum OperationReturnCode result = error_code == LDAP_SUCCESS ? RETURN_CODE_SUCCESS : RETURN_CODE_FAILURE;
+
+    --scheduler->in_flight;
+
+    write_scheduler_complete(node, result, error_code);
+    write_scheduler_dispatch(scheduler);
+
+    return result;
+}
+
+/**
+ * @brief write_scheduler_submit Computes dependencies of the request and queues it.
+ * @param[in] scheduler          Scheduler to work with.
+ * @param[in] node               Node with filled request.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+static enum OperationReturnCode write_scheduler_submit(ld_write_scheduler_t *scheduler, write_node_t *node)
+{
+    ld_write_request_t *request = &node->request;
+
+    node->target = ld_dn_normalize(node, request->dn);
+    if (!node->target)
+    {
+        ld_error("write_scheduler_submit - invalid DN %s!\n", request->dn);
+        goto error_exit;
+    }
+
+    if (request->operation == LD_WRITE_RENAME)
+    {
+        char *rdn = ld_dn_normalize(node, request->new_rdn);
+        char *superior = request->new_superior
+                ? ld_dn_normalize(node, request->new_superior)
+                : talloc_strdup(node, write_scheduler_parent(node->target) ? write_scheduler_parent(node->target) : "");
+
+        if (!rdn || !superior || strchr(rdn, ',') || rdn[0] == '\0')
+        {
+            ld_error("write_scheduler_submit - invalid new name of %s!\n", request->dn);
+            goto error_exit;
+        }
+
+        node->destination = superior[0] != '\0' ? talloc_asprintf(node, "%s,%s", rdn, superior) : rdn;
+        if (!node->destination)
+        {
+            ld_error("write_scheduler_submit - out of memory - unable to create new DN!\n");
+            goto error_exit;
+        }
+    }
+
+    node->dependents = g_ptr_array_new();
+
+    write_scheduler_depend(node, g_hash_table_lookup(scheduler->last, node->target));
+    write_scheduler_depend_on_ancestors(scheduler, node, node->target);
+
+    if (request->operation == LD_WRITE_DELETE || request->operation == LD_WRITE_RENAME)
+    {
+        write_scheduler_depend_on_subtree(scheduler, node, node->target);
+    }
+
+    if (node->destination)
+    {
+        write_scheduler_depend(node, g_hash_table_lookup(scheduler->last, node->destination));
+        write_scheduler_depend_on_ancestors(scheduler, node, node->destination);
+        write_scheduler_depend_on_subtree(scheduler, node, node->destination);
+    }
+
+    request->id = ++scheduler->submitted;
+    ++scheduler->pending;
+
+    write_scheduler_register(scheduler, node, node->target);
+    if (node->destination)
+    {
+        write_scheduler_register(scheduler, node, node->destination);
+    }
+
+    if (node->blockers == 0)
+    {
+        g_queue_push_tail(&scheduler->ready, node);
+    }
+
+    write_scheduler_dispatch(scheduler);
+
+    return RETURN_CODE_SUCCESS;
+
+    error_exit:
+        talloc_free(node);
+        return RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief write_scheduler_new_node Creates node of the request.
+ * @return
+ *        - Node.
+ *        - NULL on failure.
+ */
+static write_node_t *write_scheduler_new_node(ld_write_scheduler_t *scheduler,
+                                              enum LdapWriteOperation operation,
+                                              const char *dn,
+                                              LDAPMod **mods)
+{
+    write_node_t *node = NULL;
+
+    if (!scheduler || !dn || scheduler->finishing)
+    {
+        ld_error("write_scheduler_new_node - invalid parameters!\n");
+        return NULL;
+    }
+
+    ld_talloc_zero_e(node, error_exit, "write_scheduler_new_node - out of memory - unable to create request!\n",
+                     scheduler, write_node_t);
+    talloc_set_destructor((void*)node, write_node_destructor);
+
+    node->scheduler = scheduler;
+    node->msgid = -1;
+    node->request.operation = operation;
+    ld_talloc_strdup(node->request.dn, error_exit, node, dn);
+
+    if (mods)
+    {
+        node->request.mods = write_scheduler_copy_mods(node, mods);
+        if (!node->request.mods)
+        {
+            ld_error("write_scheduler_new_node - out of memory - unable to copy modifications!\n");
+            goto error_exit;
+        }
+    }
+
+    return node;
+
+    error_exit:
+        talloc_free(node);
+        return NULL;
+}
+
+/**
+ * @brief ld_write_scheduler_new Creates scheduler of write requests.
+ * @param[in] ctx                Talloc ctx to use.
+ * @param[in] connection         Connection to send requests through.
+ * @param[in] window             Maximum amount of requests in flight, 0 for default.
+ * @param[in] request_callback   Callback to report result of every request to, may be NULL.
+ * @param[in] complete_callback  Callback to call on completion, may be NULL.
+ * @param[in] user_data          User data passed to callbacks.
+ * @return
+ *        - Scheduler.
+ *        - NULL on failure.
+ */
+ld_write_scheduler_t *ld_write_scheduler_new(TALLOC_CTX *ctx,
+                                             struct ldap_connection_ctx_t *connection,
+                                             unsigned int window,
+                                             write_request_callback_fn request_callback,
+                                             write_complete_callback_fn complete_callback,
+                                             void *user_data)
+{
+    ld_write_scheduler_t *result = NULL;
+
+    if (!connection)
+    {
+        ld_error("ld_write_scheduler_new - invalid parameters!\n");
+        return NULL;
+    }
+
+    ld_talloc_zero_e(result, error_exit, "ld_write_scheduler_new - out of memory - unable to create scheduler!\n",
+                     ctx, ld_write_scheduler_t);
+
+    result->connection = connection;
+    result->window = window == 0 ? WRITE_SCHEDULER_DEFAULT_WINDOW : MIN(window, WRITE_SCHEDULER_MAX_WINDOW);
+    result->request_callback = request_callback;
+    result->complete_callback = complete_callback;
+    result->user_data = user_data;
+
+    result->last = g_hash_table_new(g_str_hash, g_str_equal);
+    result->structural = g_hash_table_new(g_str_hash, g_str_equal);
+    result->subtrees = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_hash_table_destroy);
+    g_queue_init(&result->ready);
+    g_queue_init(&result->skipped);
+
+    talloc_set_destructor((void*)result, write_scheduler_destructor);
+
+    return result;
+
+    error_exit:
+        return NULL;
+}
+
+/**
+ * @brief ld_write_scheduler_add Submits add request.
+ * @param[in] scheduler          Scheduler to work with.
+ * @param[in] dn                 DN of the entry.
+ * @param[in] attrs              Attributes of the entry, they are copied.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_write_scheduler_add(ld_write_scheduler_t *scheduler, const char *dn, LDAPMod **attrs)
+{
+    if (!attrs)
+    {
+        ld_error("ld_write_scheduler_add - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    write_node_t *node = write_scheduler_new_node(scheduler, LD_WRITE_ADD, dn, attrs);
+
+    return node ? write_scheduler_submit(scheduler, node) : RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief ld_write_scheduler_delete Submits delete request.
+ * @param[in] scheduler          Scheduler to work with.
+ * @param[in] dn                 DN of the entry.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_write_scheduler_delete(ld_write_scheduler_t *scheduler, const char *dn)
+{
+    write_node_t *node = write_scheduler_new_node(scheduler, LD_WRITE_DELETE, dn, NULL);
+
+    return node ? write_scheduler_submit(scheduler, node) : RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief ld_write_scheduler_modify Submits modify request.
+ * @param[in] scheduler          Scheduler to work with.
+ * @param[in] dn                 DN of the entry.
+ * @param[in] mods               Modifications, they are copied.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_write_scheduler_modify(ld_write_scheduler_t *scheduler, const char *dn, LDAPMod **mods)
+{
+    if (!mods)
+    {
+        ld_error("ld_write_scheduler_modify - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    write_node_t *node = write_scheduler_new_node(scheduler, LD_WRITE_MODIFY, dn, mods);
+
+    return node ? write_scheduler_submit(scheduler, node) : RETURN_CODE_FAILURE;
+}
+
+/**
+ * @brief ld_write_scheduler_rename Submits rename request.
+ * @param[in] scheduler          Scheduler to work with.
+ * @param[in] dn                 DN of the entry.
+ * @param[in] new_rdn            New RDN of the entry.
+ * @param[in] new_superior       New parent of the entry, NULL to keep the parent.
+ * @param[in] delete_old_rdn     Remove old RDN values from the entry.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_write_scheduler_rename(ld_write_scheduler_t *scheduler,
+                                                   const char *dn,
+                                                   const char *new_rdn,
+                                                   const char *new_superior,
+                                                   bool delete_old_rdn)
+{
+    if (!new_rdn)
+    {
+        ld_error("ld_write_scheduler_rename - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    write_node_t *node = write_scheduler_new_node(scheduler, LD_WRITE_RENAME, dn, NULL);
+    if (!node)
+    {
+        return RETURN_CODE_FAILURE;
+    }
+
+    node->request.new_rdn = talloc_strdup(node, new_rdn);
+    node->request.new_superior = new_superior ? talloc_strdup(node, new_superior) : NULL;
+    node->request.delete_old_rdn = delete_old_rdn;
+
+    if (!node->request.new_rdn || (new_superior && !node->request.new_superior))
+    {
+        ld_error("ld_write_scheduler_rename - out of memory - unable to create request!\n");
+        talloc_free(node);
+        return RETURN_CODE_FAILURE;
+    }
+
+    return write_scheduler_submit(scheduler, node);
+}
+
+/**
+ * @brief ld_write_scheduler_finish Marks that no more requests will be submitted.
+ *
+ * Completion callback is called once all requests have completed, it may be called before function returns.
+ * @param[in] scheduler          Scheduler to work with.
+ * @return
+ *        - RETURN_CODE_SUCCESS on success.
+ *        - RETURN_CODE_FAILURE on failure.
+ */
+enum OperationReturnCode ld_write_scheduler_finish(ld_write_scheduler_t *scheduler)
+{
+    if (!scheduler || scheduler->finishing)
+    {
+        ld_error("ld_write_scheduler_finish - invalid parameters!\n");
+        return RETURN_CODE_FAILURE;
+    }
+
+    scheduler->finishing = true;
+
+    write_scheduler_dispatch(scheduler);
+
+    return RETURN_CODE_SUCCESS;
+}
+
+/**
+ * @brief ld_write_scheduler_get_succeeded Returns amount of succeeded requests.
+ */
+unsigned long ld_write_scheduler_get_succeeded(const ld_write_scheduler_t *scheduler)
+{
+    return scheduler->succeeded;
+}
+
+/**
+ * @brief ld_write_scheduler_get_failed Returns amount of requests failed on server or not sent.
+ */
+unsigned long ld_write_scheduler_get_failed(const ld_write_scheduler_t *scheduler)
+{
+    return scheduler->failures;
+}
+
+/**
+ * @brief ld_write_scheduler_get_skipped Returns amount of requests skipped because of failed dependencies.
+ */
+unsigned long ld_write_scheduler_get_skipped(const ld_write_scheduler_t *scheduler)
+{
+    return scheduler->skips;
+}
+
+/**
+ * @brief ld_write_scheduler_get_pending Returns amount of submitted requests which have not completed yet.
+ */
+unsigned long ld_write_scheduler_get_pending(const ld_write_scheduler_t *scheduler)
+{
+    return scheduler->pending;
+}
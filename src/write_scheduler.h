@@ -0,0 +1,110 @@
+/***********************************************************************************************************************
+**
+** Copyright (C) 2023 BaseALT Ltd. <org@basealt.ru>
+**
+** This program is free software; you can redistribute it and/or
+** modify it under the terms of the GNU General Public License
+** as published by the Free Software Foundation; either version 2
+** of the License, or (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**
+***********************************************************************************************************************/
+
+#ifndef LIBDOMAIN_WRITE_SCHEDULER_H
+#define LIBDOMAIN_WRITE_SCHEDULER_H
+
+#include "common.h"
+#include "connection.h"
+
+#include <stdbool.h>
+
+/**
+ * Write scheduler sends add, delete, modify and rename requests pipelined on the connection and orders only
+ * requests which depend on each other. Dependencies are inferred from DNs in order of submission:
+ * - requests on the same DN are sent one after another;
+ * - requests on DNs below an added, deleted or renamed entry wait for that request;
+ * - deletes and renames wait for all earlier requests on entries below them;
+ * - renames wait for earlier requests on the new DN.
+ * When request fails all requests depending on it are skipped.
+ */
+
+typedef struct ld_write_scheduler_s ld_write_scheduler_t;
+
+enum LdapWriteOperation
+{
+    LD_WRITE_ADD    = 1,
+    LD_WRITE_DELETE = 2,
+    LD_WRITE_MODIFY = 3,
+    LD_WRITE_RENAME = 4,
+};
+
+/*!
+ * @brief ld_write_request_t - Request submitted to the scheduler.
+ */
+typedef struct ld_write_request_s
+{
+    unsigned long id;                   //!< Number of the request in order of submission, starting with 1.
+    enum LdapWriteOperation operation;  //!< Operation of the request.
+    char *dn;                           //!< DN of the entry.
+    LDAPMod **mods;                     //!< Attributes of added entry or modifications, NULL otherwise.
+    char *new_rdn;                      //!< New RDN of renamed entry.
+    char *new_superior;                 //!< New parent of renamed entry, NULL to keep the parent.
+    bool delete_old_rdn;                //!< Remove old RDN values from renamed entry.
+    bool skipped;                       //!< Request has not been sent because request it depends on has failed.
+} ld_write_request_t;
+
+/**
+ * @brief write_request_callback_fn Callback fired once result of the request is known.
+ *
+ * Skipped requests are reported with RETURN_CODE_FAILURE and LDAP_OTHER result code.
+ * @param[in] result_code       LDAP result code of the request.
+ */
+typedef void (*write_request_callback_fn)(ld_write_scheduler_t *scheduler,
+                                          const ld_write_request_t *request,
+                                          enum OperationReturnCode rc,
+                                          int result_code,
+                                          void *user_data);
+
+/**
+ * @brief write_complete_callback_fn Callback fired once all requests have completed after ld_write_scheduler_finish.
+ *
+ * Return code is RETURN_CODE_SUCCESS only if all requests have succeeded. Scheduler is released once callback returns.
+ */
+typedef void (*write_complete_callback_fn)(ld_write_scheduler_t *scheduler,
+                                           enum OperationReturnCode rc,
+                                           void *user_data);
+
+ld_write_scheduler_t *ld_write_scheduler_new(TALLOC_CTX *ctx,
+                                             struct ldap_connection_ctx_t *connection,
+                                             unsigned int window,
+                                             write_request_callback_fn request_callback,
+                                             write_complete_callback_fn complete_callback,
+                                             void *user_data);
+
+enum OperationReturnCode ld_write_scheduler_add(ld_write_scheduler_t *scheduler, const char *dn, LDAPMod **attrs);
+enum OperationReturnCode ld_write_scheduler_delete(ld_write_scheduler_t *scheduler, const char *dn);
+enum OperationReturnCode ld_write_scheduler_modify(ld_write_scheduler_t *scheduler, const char *dn, LDAPMod **mods);
+enum OperationReturnCode ld_write_scheduler_rename(ld_write_scheduler_t *scheduler,
+                                                   const char *dn,
+                                                   const char *new_rdn,
+                                                   const char *new_superior,
+                                                   bool delete_old_rdn);
+
+enum OperationReturnCode ld_write_scheduler_finish(ld_write_scheduler_t *scheduler);
+
+unsigned long ld_write_scheduler_get_succeeded(const ld_write_scheduler_t *scheduler);
+unsigned long ld_write_scheduler_get_failed(const ld_write_scheduler_t *scheduler);
+unsigned long ld_write_scheduler_get_skipped(const ld_write_scheduler_t *scheduler);
+unsigned long ld_write_scheduler_get_pending(const ld_write_scheduler_t *scheduler);
+
+LDAPMod **write_scheduler_copy_mods(TALLOC_CTX *ctx, LDAPMod **mods);
+
+#endif //LIBDOMAIN_WRITE_SCHEDULER_H
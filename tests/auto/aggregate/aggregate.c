@@ -0,0 +1,152 @@
+#include <cgreen/cgreen.h>
+
+#include <aggregate.h>
+#include <directory.h>
+#include <domain.h>
+#include <talloc.h>
+
+#include <connection_state_machine.h>
+
+#include <test_common.h>
+
+#include <string.h>
+#include <strings.h>
+
+const int LDAP_DEBUG_ANY = -1;
+const int BUFFER_SIZE = 80;
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+const int CONNECTION_UPDATE_INTERVAL = 1000;
+
+static int current_directory_type = LDAP_TYPE_UNKNOWN;
+
+static verto_ctx *test_ctx = NULL;
+
+static unsigned long total_entries = 0;
+
+static const char *get_base_dn()
+{
+    return current_directory_type == LDAP_TYPE_ACTIVE_DIRECTORY
+            ? "DC=domain,DC=alt"
+            : "dc=domain,dc=alt";
+}
+
+static bool is_in_domain(const char *dn)
+{
+    size_t length = strlen(dn);
+    size_t suffix_length = strlen("dc=alt");
+
+    return length >= suffix_length && strcasecmp(dn + length - suffix_length, "dc=alt") == 0;
+}
+
+static void on_grouped_one_level(const ld_aggregate_bucket_t *buckets, int n_buckets, unsigned long total,
+                                 enum OperationReturnCode rc, void *user_data)
+{
+    (void)(user_data);
+
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+
+    // Children of the base share one parent, the base itself.
+    assert_that(n_buckets, is_equal_to(1));
+    assert_that(buckets[0].key, is_not_null);
+    assert_that(strcasecmp(buckets[0].key, get_base_dn()), is_equal_to(0));
+    assert_that(buckets[0].count, is_equal_to(total));
+    assert_that(total, is_greater_than(0));
+
+    verto_break(test_ctx);
+}
+
+static void on_grouped(const ld_aggregate_bucket_t *buckets, int n_buckets, unsigned long total,
+                       enum OperationReturnCode rc, void *user_data)
+{
+    struct ldap_connection_ctx_t *connection = user_data;
+
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(total, is_equal_to(total_entries));
+
+    // Every entry has exactly one parent, so buckets add up to the total.
+    unsigned long counted = 0;
+    bool has_base = false;
+    for (int i = 0; i < n_buckets; ++i)
+    {
+        assert_that(buckets[i].count, is_greater_than(0));
+        counted += buckets[i].count;
+
+        assert_that(buckets[i].key, is_not_null);
+        assert_that(is_in_domain(buckets[i].key), is_true);
+        has_base = has_base || strcasecmp(buckets[i].key, get_base_dn()) == 0;
+
+        if (i > 0)
+        {
+            assert_that(buckets[i].count <= buckets[i - 1].count || !buckets[i].key, is_true);
+        }
+    }
+    assert_that(counted, is_equal_to(total));
+    assert_that(has_base, is_true);
+
+    enum OperationReturnCode grouped_rc = ld_aggregate(connection, connection, get_base_dn(), LDAP_SCOPE_ONELEVEL,
+                                                       "(objectClass=*)", LD_AGGREGATE_BY_PARENT, NULL,
+                                                       on_grouped_one_level, NULL);
+    assert_that(grouped_rc, is_equal_to(RETURN_CODE_SUCCESS));
+}
+
+static void on_count(const ld_aggregate_bucket_t *buckets, int n_buckets, unsigned long total,
+                     enum OperationReturnCode rc, void *user_data)
+{
+    struct ldap_connection_ctx_t *connection = user_data;
+
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(n_buckets, is_equal_to(1));
+    assert_that(buckets[0].key, is_null);
+    assert_that(buckets[0].count, is_equal_to(total));
+    assert_that(total, is_greater_than(0));
+
+    total_entries = total;
+
+    enum OperationReturnCode grouped_rc = ld_aggregate(connection, connection, get_base_dn(), LDAP_SCOPE_SUBTREE,
+                                                       "(objectClass=*)", LD_AGGREGATE_BY_PARENT, NULL,
+                                                       on_grouped, connection);
+    assert_that(grouped_rc, is_equal_to(RETURN_CODE_SUCCESS));
+}
+
+static void connection_on_timeout(verto_ctx *ctx, verto_ev *ev)
+{
+    (void)(ctx);
+
+    struct ldap_connection_ctx_t* connection = verto_get_private(ev);
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_RUN)
+    {
+        verto_del(ev);
+
+        test_ctx = ctx;
+
+        enum OperationReturnCode rc = ld_aggregate(connection, connection, get_base_dn(), LDAP_SCOPE_SUBTREE,
+                                                   "(objectClass=*)", NULL, NULL, on_count, connection);
+        assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    }
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_ERROR)
+    {
+        verto_break(ctx);
+
+        fail_test("Error encountered during bind\n");
+    }
+}
+
+Ensure(Cgreen, aggregate_test)
+{
+    start_test(connection_on_timeout, CONNECTION_UPDATE_INTERVAL, &current_directory_type, false);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, aggregate_test);
+    return run_test_suite(suite, create_text_reporter());
+}
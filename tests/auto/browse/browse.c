@@ -0,0 +1,141 @@
+#include <cgreen/cgreen.h>
+
+#include <browse.h>
+#include <connection.h>
+#include <connection_state_machine.h>
+#include <directory.h>
+#include <entry.h>
+#include <talloc.h>
+
+#include <test_common.h>
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+char* LDAP_BROWSE_ATTRS[] = { "cn", NULL };
+
+const int CONNECTION_UPDATE_INTERVAL = 1000;
+
+static int current_directory_type = LDAP_TYPE_UNKNOWN;
+
+static int n_windows = 0;
+static bool browse_supported = true;
+
+static TALLOC_CTX* talloc_ctx = NULL;
+
+static void browse_callback(struct ldap_connection_ctx_t *connection,
+                            ld_browse_t *browse,
+                            enum OperationReturnCode rc,
+                            ld_entry_t **entries,
+                            void *user_data)
+{
+    (void)(user_data);
+
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(entries[0], is_non_null);
+    assert_that(ld_browse_get_count(browse), is_greater_than(0));
+
+    int count = 0;
+    while (entries[count])
+    {
+        ++count;
+    }
+
+    if (++n_windows == 1)
+    {
+        assert_that(ld_browse_get_position(browse), is_equal_to(1));
+        assert_that(count, is_less_than(4));
+
+        // Second window reuses the view created by the first one.
+        assert_that(ld_browse_seek_value(connection, browse, "a", 1, 1), is_equal_to(RETURN_CODE_SUCCESS));
+        assert_that(ld_browse_seek_value(connection, browse, "a", 1, 1),
+                    is_equal_to(RETURN_CODE_OPERATION_IN_PROGRESS));
+    }
+    else
+    {
+        assert_that(count, is_less_than(4));
+
+        verto_break(connection->base);
+    }
+}
+
+static void connection_on_timeout(verto_ctx *ctx, verto_ev *ev)
+{
+    (void)(ctx);
+
+    struct ldap_connection_ctx_t* connection = verto_get_private(ev);
+
+    csm_next_state(connection->state_machine);
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_RUN)
+    {
+        verto_del(ev);
+
+        char* search_base = "dc=domain,dc=alt";
+
+        switch (current_directory_type)
+        {
+        case LDAP_TYPE_OPENLDAP:
+            search_base = "dc=domain,dc=alt";
+            break;
+        case LDAP_TYPE_ACTIVE_DIRECTORY:
+            search_base = "cn=users,dc=domain,dc=alt";
+            break;
+        default:
+            verto_break(ctx);
+
+            fail_test("Unknown directory type - not implemented!\n");
+
+            return;
+        }
+
+        if (!directory_has_capability(connection, LDAP_CAPABILITY_SERVER_SIDE_SORT | LDAP_CAPABILITY_VLV))
+        {
+            ld_info("Server does not support virtual list views, skipping test\n");
+
+            browse_supported = false;
+            verto_break(ctx);
+            return;
+        }
+
+        talloc_ctx = talloc_new(NULL);
+
+        ld_browse_t *browse = ld_browse_new(talloc_ctx, search_base, LDAP_SCOPE_SUBTREE, "(cn=*)",
+                                            LDAP_BROWSE_ATTRS, "cn");
+        assert_that(browse, is_non_null);
+        assert_that(ld_browse_new(talloc_ctx, search_base, LDAP_SCOPE_SUBTREE, "(cn=*)", NULL, ""), is_null);
+
+        ld_browse_set_callback(browse, browse_callback, NULL);
+
+        assert_that(ld_browse_seek_offset(connection, browse, 1, 0, 2), is_equal_to(RETURN_CODE_SUCCESS));
+        assert_that(ld_browse_in_progress(browse), is_true);
+    }
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_ERROR)
+    {
+        verto_break(ctx);
+
+        fail_test("Error encountered during bind\n");
+    }
+}
+
+Ensure(Cgreen, browse_test) {
+    start_test(connection_on_timeout, CONNECTION_UPDATE_INTERVAL, &current_directory_type, false);
+
+    if (browse_supported)
+    {
+        assert_that(n_windows, is_equal_to(2));
+    }
+
+    talloc_free(talloc_ctx);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, browse_test);
+    return run_test_suite(suite, create_text_reporter());
+}
@@ -0,0 +1,307 @@
+#include <cgreen/cgreen.h>
+
+#include <bulk.h>
+#include <directory.h>
+#include <domain.h>
+#include <talloc.h>
+#include <write_scheduler.h>
+
+#include <connection_state_machine.h>
+
+#include <test_common.h>
+
+#include <stdio.h>
+#include <string.h>
+
+const int LDAP_DEBUG_ANY = -1;
+const int BUFFER_SIZE = 80;
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+const int CONNECTION_UPDATE_INTERVAL = 1000;
+
+#define NUMBER_OF_CHILDREN 5
+
+static int current_directory_type = LDAP_TYPE_UNKNOWN;
+
+static verto_ctx *test_ctx = NULL;
+
+static char *DESCRIPTION_VALUES[] = { "Bulk", NULL };
+static LDAPMod DESCRIPTION = { LDAP_MOD_REPLACE, "description", { DESCRIPTION_VALUES } };
+static LDAPMod *DESCRIPTION_MODS[] = { &DESCRIPTION, NULL };
+
+static char *OBJECT_CLASS_VALUES[] = { "top", "organizationalUnit", NULL };
+static LDAPMod OBJECT_CLASS = { LDAP_MOD_ADD, "objectClass", { OBJECT_CLASS_VALUES } };
+static LDAPMod *OU_ATTRIBUTES[] = { &OBJECT_CLASS, NULL };
+
+static const char *MODIFIED_DESCRIPTION = "Bulk modified";
+
+static int reported = 0;
+
+static struct ldap_connection_ctx_t *test_connection = NULL;
+static char root_dn[256];
+static bool modified[NUMBER_OF_CHILDREN];
+static bool tree_removed = false;
+
+static void on_progress(ld_bulk_t *bulk, const char *dn, enum OperationReturnCode rc, int result_code, void *user_data)
+{
+    (void)(bulk);
+    (void)(user_data);
+
+    assert_that(dn, is_non_null);
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(result_code, is_equal_to(LDAP_SUCCESS));
+
+    ++reported;
+}
+
+static void on_complete(ld_bulk_t *bulk, enum OperationReturnCode rc, void *user_data)
+{
+    (void)(user_data);
+
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(ld_bulk_get_matched(bulk), is_greater_than(0));
+    assert_that(ld_bulk_get_matched(bulk), is_equal_to(reported));
+    assert_that(ld_bulk_get_failed(bulk), is_equal_to(0));
+
+    verto_break(test_ctx);
+}
+
+static void connection_on_timeout(verto_ctx *ctx, verto_ev *ev)
+{
+    (void)(ctx);
+
+    struct ldap_connection_ctx_t* connection = verto_get_private(ev);
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_RUN)
+    {
+        verto_del(ev);
+
+        test_ctx = ctx;
+
+        const char *base_dn = current_directory_type == LDAP_TYPE_ACTIVE_DIRECTORY
+                ? "DC=domain,DC=alt"
+                : "dc=domain,dc=alt";
+
+        ld_bulk_template_t template = { LD_BULK_MODIFY, DESCRIPTION_MODS, NULL };
+
+        // Dry run only reports matching entries, directory is left intact.
+        enum OperationReturnCode rc = ld_bulk_apply(connection, connection, base_dn, LDAP_SCOPE_SUBTREE,
+                                                    "(objectClass=*)", &template, 0, true, on_progress, on_complete,
+                                                    NULL);
+        assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    }
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_ERROR)
+    {
+        verto_break(ctx);
+
+        fail_test("Error encountered during bind\n");
+    }
+}
+
+Ensure(Cgreen, bulk_dry_run_test)
+{
+    start_test(connection_on_timeout, CONNECTION_UPDATE_INTERVAL, &current_directory_type, false);
+}
+
+static void on_tree_request(ld_write_scheduler_t *scheduler, const ld_write_request_t *request,
+                            enum OperationReturnCode rc, int result_code, void *user_data)
+{
+    (void)(scheduler);
+    (void)(request);
+    (void)(user_data);
+
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(result_code, is_equal_to(LDAP_SUCCESS));
+}
+
+static void on_tree_removed(ld_write_scheduler_t *scheduler, enum OperationReturnCode rc, void *user_data)
+{
+    (void)(user_data);
+
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(ld_write_scheduler_get_succeeded(scheduler), is_equal_to(NUMBER_OF_CHILDREN + 1));
+
+    tree_removed = true;
+
+    verto_break(test_ctx);
+}
+
+static void remove_tree(void)
+{
+    char dn[256];
+
+    ld_write_scheduler_t *scheduler = ld_write_scheduler_new(test_connection, test_connection, 0, on_tree_request,
+                                                             on_tree_removed, NULL);
+    assert_that(scheduler, is_non_null);
+
+    for (int i = 0; i < NUMBER_OF_CHILDREN; ++i)
+    {
+        snprintf(dn, sizeof(dn), "ou=bulk_child%d,%s", i, root_dn);
+        assert_that(ld_write_scheduler_delete(scheduler, dn), is_equal_to(RETURN_CODE_SUCCESS));
+    }
+
+    assert_that(ld_write_scheduler_delete(scheduler, root_dn), is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(ld_write_scheduler_finish(scheduler), is_equal_to(RETURN_CODE_SUCCESS));
+}
+
+static void on_verify_progress(ld_bulk_t *bulk, const char *dn, enum OperationReturnCode rc, int result_code,
+                               void *user_data)
+{
+    (void)(bulk);
+    (void)(dn);
+    (void)(rc);
+    (void)(result_code);
+    (void)(user_data);
+}
+
+static void on_verify_complete(ld_bulk_t *bulk, enum OperationReturnCode rc, void *user_data)
+{
+    (void)(user_data);
+
+    // Only entries which got new description match the verification filter.
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(ld_bulk_get_matched(bulk), is_equal_to(NUMBER_OF_CHILDREN));
+
+    remove_tree();
+}
+
+static void on_modify_progress(ld_bulk_t *bulk, const char *dn, enum OperationReturnCode rc, int result_code,
+                               void *user_data)
+{
+    (void)(bulk);
+    (void)(user_data);
+
+    int index = -1;
+
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(result_code, is_equal_to(LDAP_SUCCESS));
+    const char *name = strstr(dn, "bulk_child");
+    assert_that(name, is_non_null);
+    assert_that(name && sscanf(name, "bulk_child%d,", &index) == 1, is_true);
+    assert_that(index >= 0 && index < NUMBER_OF_CHILDREN, is_true);
+
+    if (index >= 0 && index < NUMBER_OF_CHILDREN)
+    {
+        // Every entry is reported exactly once.
+        assert_that(modified[index], is_false);
+        modified[index] = true;
+    }
+}
+
+static void on_modify_complete(ld_bulk_t *bulk, enum OperationReturnCode rc, void *user_data)
+{
+    (void)(user_data);
+
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(ld_bulk_get_matched(bulk), is_equal_to(NUMBER_OF_CHILDREN));
+    assert_that(ld_bulk_get_succeeded(bulk), is_equal_to(NUMBER_OF_CHILDREN));
+    assert_that(ld_bulk_get_failed(bulk), is_equal_to(0));
+
+    for (int i = 0; i < NUMBER_OF_CHILDREN; ++i)
+    {
+        assert_that(modified[i], is_true);
+    }
+
+    char filter[256];
+    snprintf(filter, sizeof(filter), "(&(ou=bulk_child*)(description=%s))", MODIFIED_DESCRIPTION);
+
+    ld_bulk_template_t template = { LD_BULK_MODIFY, DESCRIPTION_MODS, NULL };
+
+    assert_that(ld_bulk_apply(test_connection, test_connection, root_dn, LDAP_SCOPE_ONELEVEL, filter, &template, 0,
+                              true, on_verify_progress, on_verify_complete, NULL),
+                is_equal_to(RETURN_CODE_SUCCESS));
+}
+
+static void on_tree_created(ld_write_scheduler_t *scheduler, enum OperationReturnCode rc, void *user_data)
+{
+    (void)(user_data);
+
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(ld_write_scheduler_get_succeeded(scheduler), is_equal_to(NUMBER_OF_CHILDREN + 1));
+
+    // Template is released right away, bulk operation must keep its own copy of modifications.
+    TALLOC_CTX *template_ctx = talloc_new(NULL);
+
+    char **values = talloc_zero_array(template_ctx, char*, 2);
+    values[0] = talloc_strdup(values, MODIFIED_DESCRIPTION);
+
+    LDAPMod *description = talloc_zero(template_ctx, LDAPMod);
+    description->mod_op = LDAP_MOD_REPLACE;
+    description->mod_type = talloc_strdup(description, "description");
+    description->mod_values = values;
+
+    LDAPMod **mods = talloc_zero_array(template_ctx, LDAPMod*, 2);
+    mods[0] = description;
+
+    ld_bulk_template_t template = { LD_BULK_MODIFY, mods, NULL };
+
+    assert_that(ld_bulk_apply(test_connection, test_connection, root_dn, LDAP_SCOPE_ONELEVEL, "(ou=bulk_child*)",
+                              &template, 2, false, on_modify_progress, on_modify_complete, NULL),
+                is_equal_to(RETURN_CODE_SUCCESS));
+
+    memset(values[0], 'x', strlen(values[0]));
+    talloc_free(template_ctx);
+}
+
+static void connection_on_modify_timeout(verto_ctx *ctx, verto_ev *ev)
+{
+    struct ldap_connection_ctx_t* connection = verto_get_private(ev);
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_RUN)
+    {
+        verto_del(ev);
+
+        test_ctx = ctx;
+        test_connection = connection;
+
+        const char *base_dn = current_directory_type == LDAP_TYPE_ACTIVE_DIRECTORY
+                ? "DC=domain,DC=alt"
+                : "dc=domain,dc=alt";
+
+        snprintf(root_dn, sizeof(root_dn), "ou=test_bulk_modify,%s", base_dn);
+
+        ld_write_scheduler_t *scheduler = ld_write_scheduler_new(connection, connection, 0, on_tree_request,
+                                                                 on_tree_created, NULL);
+        assert_that(scheduler, is_non_null);
+
+        char dn[256];
+
+        assert_that(ld_write_scheduler_add(scheduler, root_dn, OU_ATTRIBUTES), is_equal_to(RETURN_CODE_SUCCESS));
+
+        for (int i = 0; i < NUMBER_OF_CHILDREN; ++i)
+        {
+            snprintf(dn, sizeof(dn), "ou=bulk_child%d,%s", i, root_dn);
+            assert_that(ld_write_scheduler_add(scheduler, dn, OU_ATTRIBUTES), is_equal_to(RETURN_CODE_SUCCESS));
+        }
+
+        assert_that(ld_write_scheduler_finish(scheduler), is_equal_to(RETURN_CODE_SUCCESS));
+    }
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_ERROR)
+    {
+        verto_break(ctx);
+
+        fail_test("Error encountered during bind\n");
+    }
+}
+
+Ensure(Cgreen, bulk_modify_test)
+{
+    start_test(connection_on_modify_timeout, CONNECTION_UPDATE_INTERVAL, &current_directory_type, false);
+
+    assert_that(tree_removed, is_true);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, bulk_dry_run_test);
+    add_test_with_context(suite, Cgreen, bulk_modify_test);
+    return run_test_suite(suite, create_text_reporter());
+}
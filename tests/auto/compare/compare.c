@@ -0,0 +1,94 @@
+#include <cgreen/cgreen.h>
+
+#include <compare.h>
+#include <directory.h>
+#include <domain.h>
+#include <talloc.h>
+
+#include <connection_state_machine.h>
+
+#include <test_common.h>
+
+const int LDAP_DEBUG_ANY = -1;
+const int BUFFER_SIZE = 80;
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+const int CONNECTION_UPDATE_INTERVAL = 1000;
+
+static int current_directory_type = LDAP_TYPE_UNKNOWN;
+
+static verto_ctx *test_ctx = NULL;
+
+static bool EXPECTED_TRUE = true;
+static bool EXPECTED_FALSE = false;
+
+static const int N_QUERIES = 4;
+static int n_answers = 0;
+
+static void on_answer(const char *dn, bool result, enum OperationReturnCode rc, void *user_data)
+{
+    bool *expected = user_data;
+
+    assert_that(dn, is_non_null);
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(result, is_equal_to(*expected));
+
+    if (++n_answers == N_QUERIES)
+    {
+        verto_break(test_ctx);
+    }
+}
+
+static void connection_on_timeout(verto_ctx *ctx, verto_ev *ev)
+{
+    (void)(ctx);
+
+    struct ldap_connection_ctx_t* connection = verto_get_private(ev);
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_RUN)
+    {
+        verto_del(ev);
+
+        test_ctx = ctx;
+
+        const char *base_dn = current_directory_type == LDAP_TYPE_ACTIVE_DIRECTORY
+                ? "DC=domain,DC=alt"
+                : "dc=domain,dc=alt";
+        const char *missing_dn = current_directory_type == LDAP_TYPE_ACTIVE_DIRECTORY
+                ? "CN=no_such_entry,DC=domain,DC=alt"
+                : "cn=no_such_entry,dc=domain,dc=alt";
+
+        assert_that(ld_entry_exists(connection, connection, base_dn, on_answer, &EXPECTED_TRUE),
+                    is_equal_to(RETURN_CODE_SUCCESS));
+        assert_that(ld_entry_exists(connection, connection, missing_dn, on_answer, &EXPECTED_FALSE),
+                    is_equal_to(RETURN_CODE_SUCCESS));
+        assert_that(ld_compare(connection, connection, base_dn, "dc", "DOMAIN", on_answer, &EXPECTED_TRUE),
+                    is_equal_to(RETURN_CODE_SUCCESS));
+        assert_that(ld_compare(connection, connection, base_dn, "dc", "other", on_answer, &EXPECTED_FALSE),
+                    is_equal_to(RETURN_CODE_SUCCESS));
+    }
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_ERROR)
+    {
+        verto_break(ctx);
+
+        fail_test("Error encountered during bind\n");
+    }
+}
+
+Ensure(Cgreen, compare_test)
+{
+    start_test(connection_on_timeout, CONNECTION_UPDATE_INTERVAL, &current_directory_type, false);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, compare_test);
+    return run_test_suite(suite, create_text_reporter());
+}
@@ -158,6 +158,12 @@ Ensure(Cgreen, get_diretory_type_test) {
 
     assert_that(ctx->connection_ctx.ldap_defaults, is_not_null);
 
+    const ld_rootdse_t *rootdse = directory_get_rootdse(&ctx->connection_ctx);
+    assert_that(rootdse, is_not_null);
+    assert_that(rootdse->naming_contexts, is_not_null);
+    assert_that(rootdse->supported_controls, is_not_null);
+    assert_that(directory_has_capability(&ctx->connection_ctx, LDAP_CAPABILITY_PAGED_RESULTS), is_true);
+
     talloc_free(ctx->config.sasl_options);
 
     destroy_context(ctx);
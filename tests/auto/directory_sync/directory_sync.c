@@ -0,0 +1,153 @@
+#include <cgreen/cgreen.h>
+
+#include <connection.h>
+#include <connection_state_machine.h>
+#include <directory.h>
+#include <directory_sync.h>
+#include <entry.h>
+#include <talloc.h>
+#include <unistd.h>
+
+#include <test_common.h>
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+char* LDAP_SYNC_ATTRS[] = { "objectClass", NULL };
+
+const int CONNECTION_UPDATE_INTERVAL = 1000;
+
+static const char *SYNC_STATE_FILE = "directory_sync_test.state";
+
+static int current_directory_type = LDAP_TYPE_UNKNOWN;
+
+static int n_added_entries = 0;
+static int n_completed_cycles = 0;
+
+static TALLOC_CTX* talloc_ctx = NULL;
+
+static enum OperationReturnCode sync_change_callback(struct ldap_connection_ctx_t *connection,
+                                                     enum LdapSyncChangeType change,
+                                                     const char *dn,
+                                                     const char *old_dn,
+                                                     ld_entry_t *entry,
+                                                     void *user_data)
+{
+    (void)(connection);
+    (void)(old_dn);
+    (void)(entry);
+    (void)(user_data);
+
+    ld_info("Change %d of entry %s\n", change, dn);
+
+    if (change == LD_SYNC_CHANGE_ADD)
+    {
+        ++n_added_entries;
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+static void sync_complete_callback(struct ldap_connection_ctx_t *connection,
+                                   ld_sync_t *sync,
+                                   enum OperationReturnCode rc,
+                                   void *user_data)
+{
+    (void)(user_data);
+
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+
+    if (++n_completed_cycles == 1)
+    {
+        assert_that(n_added_entries, is_greater_than(0));
+        assert_that(ld_sync_get_object_count(sync), is_equal_to(n_added_entries));
+
+        // Second cycle must not report entries that have already been synchronized.
+        n_added_entries = 0;
+        assert_that(ld_sync_refresh(connection, sync), is_equal_to(RETURN_CODE_SUCCESS));
+    }
+    else
+    {
+        assert_that(n_added_entries, is_equal_to(0));
+
+        // Object table appended to state file by second cycle has to load into the same table.
+        ld_sync_t *loaded = ld_sync_new(talloc_ctx, "", LDAP_SCOPE_SUBTREE, "(objectClass=*)", NULL, SYNC_STATE_FILE);
+        assert_that(loaded, is_non_null);
+        assert_that(ld_sync_get_object_count(loaded), is_equal_to(ld_sync_get_object_count(sync)));
+        assert_that(ld_sync_get_mode(loaded), is_equal_to(ld_sync_get_mode(sync)));
+
+        verto_break(connection->base);
+    }
+}
+
+static void connection_on_timeout(verto_ctx *ctx, verto_ev *ev)
+{
+    (void)(ctx);
+
+    struct ldap_connection_ctx_t* connection = verto_get_private(ev);
+
+    csm_next_state(connection->state_machine);
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_RUN)
+    {
+        verto_del(ev);
+
+        char* search_base = "dc=domain,dc=alt";
+
+        switch (current_directory_type)
+        {
+        case LDAP_TYPE_OPENLDAP:
+            search_base = "dc=domain,dc=alt";
+            break;
+        case LDAP_TYPE_ACTIVE_DIRECTORY:
+            search_base = "cn=users,dc=domain,dc=alt";
+            break;
+        default:
+            verto_break(ctx);
+
+            fail_test("Unknown directory type - not implemented!\n");
+
+            return;
+        }
+
+        talloc_ctx = talloc_new(NULL);
+
+        unlink(SYNC_STATE_FILE);
+
+        ld_sync_t *sync = ld_sync_new(talloc_ctx, search_base, LDAP_SCOPE_SUBTREE, "(objectClass=*)",
+                                      LDAP_SYNC_ATTRS, SYNC_STATE_FILE);
+        assert_that(sync, is_non_null);
+
+        ld_sync_set_callbacks(sync, sync_change_callback, sync_complete_callback, NULL);
+
+        assert_that(ld_sync_refresh(connection, sync), is_equal_to(RETURN_CODE_SUCCESS));
+        assert_that(ld_sync_get_mode(sync), is_not_equal_to(LD_SYNC_MODE_AUTO));
+    }
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_ERROR)
+    {
+        verto_break(ctx);
+
+        fail_test("Error encountered during bind\n");
+    }
+}
+
+Ensure(Cgreen, directory_sync_test) {
+    start_test(connection_on_timeout, CONNECTION_UPDATE_INTERVAL, &current_directory_type, false);
+
+    assert_that(n_completed_cycles, is_equal_to(2));
+
+    talloc_free(talloc_ctx);
+
+    unlink(SYNC_STATE_FILE);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, directory_sync_test);
+    return run_test_suite(suite, create_text_reporter());
+}
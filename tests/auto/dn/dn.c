@@ -0,0 +1,122 @@
+#include <cgreen/cgreen.h>
+
+#include <dn.h>
+#include <talloc.h>
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+Ensure(Cgreen, parse_splits_dn_into_avas)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+
+    ld_dn_t *dn = ld_dn_parse(ctx, "cn=John\\, Smith+uid=jsmith,ou=Users,dc=domain,dc=alt", NULL);
+    assert_that(dn, is_non_null);
+
+    assert_that(ld_dn_get_rdn_count(dn), is_equal_to(4));
+    assert_that(ld_dn_get_ava_count(dn), is_equal_to(5));
+
+    const ld_dn_ava_t *ava = ld_dn_get_ava(dn, 0);
+    assert_that(ava->rdn, is_equal_to(0));
+    assert_that(ava->type_len, is_equal_to(2));
+    assert_that(ava->value_len, is_equal_to(12));
+    assert_that(strncmp(ava->value, "John\\, Smith", ava->value_len), is_equal_to(0));
+
+    assert_that(ld_dn_get_ava(dn, 1)->rdn, is_equal_to(0));
+    assert_that(ld_dn_get_ava(dn, 2)->rdn, is_equal_to(1));
+    assert_that(ld_dn_get_ava(dn, 5), is_null);
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, parse_rejects_invalid_dn)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+
+    assert_that(ld_dn_parse(ctx, "cn=test,", NULL), is_null);
+    assert_that(ld_dn_parse(ctx, "cn", NULL), is_null);
+    assert_that(ld_dn_parse(ctx, "cn=a,b", NULL), is_null);
+    assert_that(ld_dn_parse(ctx, "cn=a\\", NULL), is_null);
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, normalized_form_is_canonical)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+
+    assert_that(ld_dn_normalize(ctx, "CN=John  Smith , OU=Users,DC=Domain,DC=Alt"),
+                is_equal_to_string("cn=john smith,ou=users,dc=domain,dc=alt"));
+    assert_that(ld_dn_normalize(ctx, "2.5.4.3=test,OID.0.9.2342.19200300.100.1.25=alt"),
+                is_equal_to_string("cn=test,dc=alt"));
+    assert_that(ld_dn_normalize(ctx, "cn=a\\2Cb,dc=alt"), is_equal_to_string("cn=a\\2cb,dc=alt"));
+    assert_that(ld_dn_normalize(ctx, "cn=a\\,b,dc=alt"), is_equal_to_string("cn=a\\2cb,dc=alt"));
+    assert_that(ld_dn_normalize(ctx, "uid=b+cn=a,dc=alt"), is_equal_to_string("cn=a+uid=b,dc=alt"));
+    assert_that(ld_dn_normalize(ctx, ""), is_equal_to_string(""));
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, equal_dns_have_equal_hashes)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+
+    ld_dn_t *first = ld_dn_parse(ctx, "cn=Test,dc=domain,dc=alt", NULL);
+    ld_dn_t *second = ld_dn_parse(ctx, "CN=test, DC=DOMAIN, DC=ALT", NULL);
+    ld_dn_t *third = ld_dn_parse(ctx, "cn=test2,dc=domain,dc=alt", NULL);
+
+    assert_that(ld_dn_equal(first, second), is_true);
+    assert_that(ld_dn_get_hash(first), is_equal_to(ld_dn_get_hash(second)));
+    assert_that(ld_dn_equal(first, third), is_false);
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, ancestors_are_detected)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+
+    ld_dn_t *dn = ld_dn_parse(ctx, "cn=test,ou=Users,dc=domain,dc=alt", NULL);
+    ld_dn_t *users = ld_dn_parse(ctx, "ou=users,dc=domain,dc=alt", NULL);
+    ld_dn_t *domain = ld_dn_parse(ctx, "dc=domain,dc=alt", NULL);
+    ld_dn_t *other = ld_dn_parse(ctx, "ou=otherusers,dc=domain,dc=alt", NULL);
+
+    assert_that(ld_dn_is_descendant(dn, users), is_true);
+    assert_that(ld_dn_is_descendant(dn, domain), is_true);
+    assert_that(ld_dn_is_descendant(dn, other), is_false);
+    assert_that(ld_dn_is_descendant(users, users), is_false);
+
+    assert_that(ld_dn_is_parent(users, dn), is_true);
+    assert_that(ld_dn_is_parent(domain, dn), is_false);
+
+    ld_dn_t *parent = ld_dn_get_parent(ctx, dn);
+    assert_that(ld_dn_equal(parent, users), is_true);
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, escape_value_escapes_special_characters)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+
+    assert_that(ld_dn_escape_value(ctx, "Smith, John"), is_equal_to_string("Smith\\, John"));
+    assert_that(ld_dn_escape_value(ctx, "#1 a+b "), is_equal_to_string("\\#1 a\\+b\\ "));
+    assert_that(ld_dn_escape_value(ctx, "plain"), is_equal_to_string("plain"));
+
+    talloc_free(ctx);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, parse_splits_dn_into_avas);
+    add_test_with_context(suite, Cgreen, parse_rejects_invalid_dn);
+    add_test_with_context(suite, Cgreen, normalized_form_is_canonical);
+    add_test_with_context(suite, Cgreen, equal_dns_have_equal_hashes);
+    add_test_with_context(suite, Cgreen, ancestors_are_detected);
+    add_test_with_context(suite, Cgreen, escape_value_escapes_special_characters);
+    return run_test_suite(suite, create_text_reporter());
+}
@@ -0,0 +1,172 @@
+#include <cgreen/cgreen.h>
+
+#include <domain.h>
+#include <entry.h>
+#include <entry_cache.h>
+#include <entry_p.h>
+#include <talloc.h>
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+static ld_entry_t *create_entry(TALLOC_CTX *ctx, const char *dn, const char *uuid)
+{
+    ld_entry_t *entry = ld_entry_new(ctx, dn);
+
+    if (uuid)
+    {
+        LDAPAttribute_t *attribute = talloc_zero(entry, LDAPAttribute_t);
+        attribute->name = talloc_strdup(attribute, "entryUUID");
+        attribute->values = talloc_array(attribute, char*, 2);
+        attribute->values[0] = talloc_strdup(attribute->values, uuid);
+        attribute->values[1] = NULL;
+
+        ld_entry_add_attribute(entry, attribute);
+    }
+
+    return entry;
+}
+
+Ensure(Cgreen, lookup_ignores_case_and_spaces_in_dn)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    ld_entry_cache_t *cache = ld_entry_cache_new(ctx, 0, 0, 0, NULL);
+
+    ld_entry_t *entry = create_entry(ctx, "cn=Test User,ou=Users,dc=domain,dc=alt", NULL);
+    assert_that(ld_entry_cache_insert(cache, entry), is_equal_to(RETURN_CODE_SUCCESS));
+
+    ld_entry_t *result = ld_entry_cache_lookup(cache, ctx, "CN=test user, OU=users, DC=domain, DC=alt");
+    assert_that(result, is_equal_to(entry));
+    assert_that(ld_entry_cache_lookup(cache, ctx, "cn=other,dc=domain,dc=alt"), is_null);
+
+    assert_that(ld_entry_cache_hits(cache), is_equal_to(1));
+    assert_that(ld_entry_cache_misses(cache), is_equal_to(1));
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, lookup_by_uuid_returns_entry)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    ld_entry_cache_t *cache = ld_entry_cache_new(ctx, 0, 0, 0, NULL);
+
+    ld_entry_t *entry = create_entry(ctx, "cn=test,dc=domain,dc=alt", "0f6a7e3c-4ba8-103d-9a3b-2f1c2d3e4f50");
+    ld_entry_cache_insert(cache, entry);
+
+    assert_that(ld_entry_cache_lookup_by_uuid(cache, ctx, "0f6a7e3c-4ba8-103d-9a3b-2f1c2d3e4f50"),
+                is_equal_to(entry));
+
+    talloc_free(ctx);
+}
+
+static void count_entry(ld_entry_t *entry, void *user_data)
+{
+    (void)(entry);
+
+    ++*(int*)user_data;
+}
+
+Ensure(Cgreen, lookup_by_value_follows_inserts_and_removals)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    ld_entry_cache_t *cache = ld_entry_cache_new(ctx, 0, 0, 0, NULL);
+    int found = 0;
+
+    ld_entry_cache_insert(cache, create_entry(ctx, "cn=first,dc=domain,dc=alt", "0F6A7E3C-AAAA"));
+
+    ld_entry_cache_foreach_by_value(cache, "entryUUID", "0f6a7e3c-aaaa", count_entry, &found);
+    assert_that(found, is_equal_to(1));
+
+    ld_entry_cache_insert(cache, create_entry(ctx, "cn=second,dc=domain,dc=alt", "0f6a7e3c-aaaa"));
+    ld_entry_cache_insert(cache, create_entry(ctx, "cn=third,dc=domain,dc=alt", "0f6a7e3c-bbbb"));
+
+    found = 0;
+    ld_entry_cache_foreach_by_value(cache, "entryUUID", "0f6a7e3c-aaaa", count_entry, &found);
+    assert_that(found, is_equal_to(2));
+
+    ld_entry_cache_invalidate(cache, "cn=first,dc=domain,dc=alt", false);
+
+    found = 0;
+    ld_entry_cache_foreach_by_value(cache, "entryUUID", "0f6a7e3c-aaaa", count_entry, &found);
+    assert_that(found, is_equal_to(1));
+
+    ld_entry_cache_clear(cache);
+
+    found = 0;
+    ld_entry_cache_foreach_by_value(cache, "entryUUID", "0f6a7e3c-bbbb", count_entry, &found);
+    assert_that(found, is_equal_to(0));
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, least_recently_used_entry_is_evicted)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    ld_entry_cache_t *cache = ld_entry_cache_new(ctx, 2, 0, 0, NULL);
+
+    ld_entry_cache_insert(cache, create_entry(ctx, "cn=first,dc=domain,dc=alt", NULL));
+    ld_entry_cache_insert(cache, create_entry(ctx, "cn=second,dc=domain,dc=alt", NULL));
+
+    TALLOC_CTX *references = talloc_new(ctx);
+    ld_entry_t *first = ld_entry_cache_lookup(cache, references, "cn=first,dc=domain,dc=alt");
+    assert_that(first, is_not_null);
+
+    ld_entry_cache_insert(cache, create_entry(ctx, "cn=third,dc=domain,dc=alt", NULL));
+
+    assert_that(ld_entry_cache_count(cache), is_equal_to(2));
+    assert_that(ld_entry_cache_lookup(cache, ctx, "cn=second,dc=domain,dc=alt"), is_null);
+    assert_that(ld_entry_cache_lookup(cache, ctx, "cn=first,dc=domain,dc=alt"), is_equal_to(first));
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, referenced_entry_survives_invalidation)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    ld_entry_cache_t *cache = ld_entry_cache_new(ctx, 0, 0, 0, NULL);
+
+    ld_entry_cache_insert(cache, create_entry(ctx, "cn=test,dc=domain,dc=alt", NULL));
+
+    TALLOC_CTX *references = talloc_new(ctx);
+    ld_entry_t *entry = ld_entry_cache_lookup(cache, references, "cn=test,dc=domain,dc=alt");
+
+    ld_entry_cache_invalidate(cache, "cn=test,dc=domain,dc=alt", false);
+
+    assert_that(ld_entry_cache_count(cache), is_equal_to(0));
+    assert_that(ld_entry_get_dn(entry), is_equal_to_string("cn=test,dc=domain,dc=alt"));
+
+    talloc_unlink(references, entry);
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, subtree_invalidation_removes_descendants)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    ld_entry_cache_t *cache = ld_entry_cache_new(ctx, 0, 0, 0, NULL);
+
+    ld_entry_cache_insert(cache, create_entry(ctx, "ou=users,dc=domain,dc=alt", NULL));
+    ld_entry_cache_insert(cache, create_entry(ctx, "cn=test,ou=users,dc=domain,dc=alt", NULL));
+    ld_entry_cache_insert(cache, create_entry(ctx, "cn=test,ou=otherusers,dc=domain,dc=alt", NULL));
+
+    ld_entry_cache_invalidate(cache, "ou=Users,dc=domain,dc=alt", true);
+
+    assert_that(ld_entry_cache_count(cache), is_equal_to(1));
+    assert_that(ld_entry_cache_lookup(cache, ctx, "cn=test,ou=otherusers,dc=domain,dc=alt"), is_not_null);
+
+    talloc_free(ctx);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, lookup_ignores_case_and_spaces_in_dn);
+    add_test_with_context(suite, Cgreen, lookup_by_uuid_returns_entry);
+    add_test_with_context(suite, Cgreen, lookup_by_value_follows_inserts_and_removals);
+    add_test_with_context(suite, Cgreen, least_recently_used_entry_is_evicted);
+    add_test_with_context(suite, Cgreen, referenced_entry_survives_invalidation);
+    add_test_with_context(suite, Cgreen, subtree_invalidation_removes_descendants);
+    return run_test_suite(suite, create_text_reporter());
+}
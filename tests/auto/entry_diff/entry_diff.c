@@ -0,0 +1,165 @@
+#include <cgreen/cgreen.h>
+
+#include <domain.h>
+#include <entry.h>
+#include <entry_diff.h>
+#include <talloc.h>
+
+#include <string.h>
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+static LDAPAttribute_t *create_attribute(TALLOC_CTX *ctx, const char *name, const char **values)
+{
+    int count = 0;
+    while (values[count])
+    {
+        ++count;
+    }
+
+    LDAPAttribute_t *attribute = talloc_zero(ctx, LDAPAttribute_t);
+    attribute->name = talloc_strdup(attribute, name);
+    attribute->values = talloc_array(attribute, char*, count + 1);
+    for (int i = 0; i < count; ++i)
+    {
+        attribute->values[i] = talloc_strdup(attribute->values, values[i]);
+    }
+    attribute->values[count] = NULL;
+
+    return attribute;
+}
+
+static ld_entry_t *create_group(TALLOC_CTX *ctx)
+{
+    ld_entry_t *entry = ld_entry_new(ctx, "cn=test,ou=groups,dc=domain,dc=alt");
+
+    const char *cn[] = { "test", NULL };
+    const char *description[] = { "Test group", NULL };
+    const char *gid_number[] = { "1000", NULL };
+    const char *member[] = { "cn=first,dc=domain,dc=alt", "cn=second,dc=domain,dc=alt", "cn=third,dc=domain,dc=alt",
+                             "cn=fourth,dc=domain,dc=alt", NULL };
+
+    ld_entry_add_attribute(entry, create_attribute(entry, "cn", cn));
+    ld_entry_add_attribute(entry, create_attribute(entry, "description", description));
+    ld_entry_add_attribute(entry, create_attribute(entry, "gidNumber", gid_number));
+    ld_entry_add_attribute(entry, create_attribute(entry, "member", member));
+
+    return entry;
+}
+
+static int count_mods(LDAPMod **mods)
+{
+    int result = 0;
+    while (mods[result])
+    {
+        ++result;
+    }
+    return result;
+}
+
+static int count_values(LDAPMod *mod)
+{
+    int result = 0;
+    while (mod->mod_values && mod->mod_values[result])
+    {
+        ++result;
+    }
+    return result;
+}
+
+Ensure(Cgreen, entry_in_sync_produces_no_modifications)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    ld_entry_t *baseline = create_group(ctx);
+
+    const char *description[] = { "test group", NULL };
+    const char *gid_number[] = { "01000", NULL };
+    const char *member[] = { "CN=Fourth, DC=domain, DC=alt", "cn=third,dc=domain,dc=alt", "cn=second,dc=domain,dc=alt",
+                             "cn=first,dc=domain,dc=alt", "cn=first,dc=domain,dc=alt", NULL };
+    LDAPAttribute_t *desired[] = { create_attribute(ctx, "Description", description),
+                                   create_attribute(ctx, "gidnumber", gid_number),
+                                   create_attribute(ctx, "member", member),
+                                   NULL };
+
+    LDAPMod **mods = ld_entry_diff(ctx, NULL, baseline, desired);
+    assert_that(mods, is_non_null);
+    assert_that(count_mods(mods), is_equal_to(0));
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, changed_values_produce_minimal_modifications)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    ld_entry_t *baseline = create_group(ctx);
+
+    const char *gid_number[] = { "1001", NULL };
+    const char *member[] = { "cn=first,dc=domain,dc=alt", "cn=second,dc=domain,dc=alt", "cn=third,dc=domain,dc=alt",
+                             "cn=fifth,dc=domain,dc=alt", NULL };
+    LDAPAttribute_t *desired[] = { create_attribute(ctx, "gidNumber", gid_number),
+                                   create_attribute(ctx, "member", member),
+                                   NULL };
+
+    LDAPMod **mods = ld_entry_diff(ctx, NULL, baseline, desired);
+    assert_that(mods, is_non_null);
+    assert_that(count_mods(mods), is_equal_to(3));
+
+    assert_that(mods[0]->mod_op, is_equal_to(LDAP_MOD_REPLACE));
+    assert_that(mods[0]->mod_type, is_equal_to_string("gidNumber"));
+    assert_that(count_values(mods[0]), is_equal_to(1));
+    assert_that(mods[0]->mod_values[0], is_equal_to_string("1001"));
+
+    assert_that(mods[1]->mod_op, is_equal_to(LDAP_MOD_DELETE));
+    assert_that(count_values(mods[1]), is_equal_to(1));
+    assert_that(mods[1]->mod_values[0], is_equal_to_string("cn=fourth,dc=domain,dc=alt"));
+
+    assert_that(mods[2]->mod_op, is_equal_to(LDAP_MOD_ADD));
+    assert_that(count_values(mods[2]), is_equal_to(1));
+    assert_that(mods[2]->mod_values[0], is_equal_to_string("cn=fifth,dc=domain,dc=alt"));
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, missing_and_empty_attributes_are_handled)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    ld_entry_t *baseline = create_group(ctx);
+
+    const char *none[] = { NULL };
+    const char *mail[] = { "test@domain.alt", NULL };
+    LDAPAttribute_t *desired[] = { create_attribute(ctx, "description", none),
+                                   create_attribute(ctx, "mail", mail),
+                                   create_attribute(ctx, "seeAlso", none),
+                                   NULL };
+
+    LDAPMod **mods = ld_entry_diff(ctx, NULL, baseline, desired);
+    assert_that(mods, is_non_null);
+    assert_that(count_mods(mods), is_equal_to(2));
+
+    assert_that(mods[0]->mod_op, is_equal_to(LDAP_MOD_DELETE));
+    assert_that(mods[0]->mod_type, is_equal_to_string("description"));
+    assert_that(mods[0]->mod_values, is_null);
+
+    assert_that(mods[1]->mod_op, is_equal_to(LDAP_MOD_REPLACE));
+    assert_that(mods[1]->mod_type, is_equal_to_string("mail"));
+    assert_that(count_values(mods[1]), is_equal_to(1));
+
+    mods = ld_entry_diff(ctx, NULL, NULL, desired);
+    assert_that(mods, is_non_null);
+    assert_that(count_mods(mods), is_equal_to(1));
+
+    talloc_free(ctx);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, entry_in_sync_produces_no_modifications);
+    add_test_with_context(suite, Cgreen, changed_values_produce_minimal_modifications);
+    add_test_with_context(suite, Cgreen, missing_and_empty_attributes_are_handled);
+    return run_test_suite(suite, create_text_reporter());
+}
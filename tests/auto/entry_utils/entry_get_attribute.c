@@ -39,6 +39,22 @@ Ensure(returns_attribute_when_it_exists)
     talloc_free(ctx);
 }
 
+Ensure(returns_attribute_ignoring_case_of_name)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    const char* dn = "cn=test,dc=domain,dc=alt";
+
+    ld_entry_t* entry = ld_entry_new(ctx, dn);
+
+    LDAPAttribute_t *expected_attribute = talloc(ctx, LDAPAttribute_t);
+    g_hash_table_insert(entry->attributes, "sAMAccountName", expected_attribute);
+
+    LDAPAttribute_t *attribute = ld_entry_get_attribute(entry, "samaccountname");
+    assert_that(attribute, is_equal_to(expected_attribute));
+
+    talloc_free(ctx);
+}
+
 TestSuite*
 entry_get_attribute_suite()
 {
@@ -46,5 +62,6 @@ entry_get_attribute_suite()
     add_test(suite, returns_null_when_entry_is_null);
     add_test(suite, returns_null_when_attribute_does_not_exist);
     add_test(suite, returns_attribute_when_it_exists);
+    add_test(suite, returns_attribute_ignoring_case_of_name);
     return suite;
 }
@@ -0,0 +1,160 @@
+#include <cgreen/cgreen.h>
+
+#include <domain.h>
+#include <entry.h>
+#include <export.h>
+#include <talloc.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+static ld_entry_t *create_entry(TALLOC_CTX *ctx, const char *dn, const char *name, const char **values)
+{
+    int count = 0;
+    while (values[count])
+    {
+        ++count;
+    }
+
+    ld_entry_t *entry = ld_entry_new(ctx, dn);
+
+    LDAPAttribute_t *attribute = talloc_zero(entry, LDAPAttribute_t);
+    attribute->name = talloc_strdup(attribute, name);
+    attribute->values = talloc_array(attribute, char*, count + 1);
+    for (int i = 0; i < count; ++i)
+    {
+        attribute->values[i] = talloc_strdup(attribute->values, values[i]);
+    }
+    attribute->values[count] = NULL;
+
+    ld_entry_add_attribute(entry, attribute);
+
+    return entry;
+}
+
+static char *export_entries(TALLOC_CTX *ctx, enum LdapExportFormat format, char **attrs, ld_entry_t **entries)
+{
+    char path[] = "/tmp/libdomain-export-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    unlink(path);
+
+    ld_export_t *exporter = ld_export_new(ctx, fd, format, attrs);
+    for (int i = 0; exporter && entries[i]; ++i)
+    {
+        ld_export_entry(exporter, entries[i]);
+    }
+
+    if (!exporter || ld_export_flush(exporter) != RETURN_CODE_SUCCESS)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    off_t length = lseek(fd, 0, SEEK_END);
+    char *result = talloc_zero_array(ctx, char, length + 1);
+    if (pread(fd, result, length, 0) != length)
+    {
+        result = NULL;
+    }
+    close(fd);
+
+    return result;
+}
+
+Ensure(Cgreen, ldif_export_encodes_unsafe_values)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+
+    const char *cn[] = { "test", NULL };
+    const char *description[] = { " leading space", "multi\nline", NULL };
+    const char *comment[] = { "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", NULL };
+    ld_entry_t *entries[] = {
+        create_entry(ctx, "cn=test,dc=domain,dc=alt", "cn", cn),
+        create_entry(ctx, "cn=second,dc=domain,dc=alt", "description", description),
+        create_entry(ctx, "cn=third,dc=domain,dc=alt", "comment", comment),
+        NULL
+    };
+
+    char *output = export_entries(ctx, LD_EXPORT_LDIF, NULL, entries);
+    assert_that(output, is_equal_to_string(
+        "version: 1\n"
+        "\n"
+        "dn: cn=test,dc=domain,dc=alt\n"
+        "cn: test\n"
+        "\n"
+        "dn: cn=second,dc=domain,dc=alt\n"
+        "description:: IGxlYWRpbmcgc3BhY2U=\n"
+        "description:: bXVsdGkKbGluZQ==\n"
+        "\n"
+        "dn: cn=third,dc=domain,dc=alt\n"
+        "comment: aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\n"
+        " aaaaaaaaaaaaaaaaaa\n"
+        "\n"));
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, json_lines_export_escapes_strings_and_encodes_binary_values)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+
+    const char *description[] = { "say \"hi\"\t\\", NULL };
+    const char *photo[] = { "\xff\xfe", NULL };
+    ld_entry_t *entries[] = {
+        create_entry(ctx, "cn=test,dc=domain,dc=alt", "description", description),
+        create_entry(ctx, "cn=second,dc=domain,dc=alt", "jpegPhoto", photo),
+        NULL
+    };
+
+    char *output = export_entries(ctx, LD_EXPORT_JSON_LINES, NULL, entries);
+    assert_that(output, is_equal_to_string(
+        "{\"dn\":\"cn=test,dc=domain,dc=alt\",\"attributes\":{\"description\":[\"say \\\"hi\\\"\\t\\\\\"]}}\n"
+        "{\"dn\":\"cn=second,dc=domain,dc=alt\",\"attributes\":{\"jpegPhoto\":[{\"base64\":\"//4=\"}]}}\n"));
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, csv_export_writes_selected_attributes)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+
+    const char *mail[] = { "first@domain.alt", "second@domain.alt", NULL };
+    const char *cn[] = { "Smith, John", NULL };
+    ld_entry_t *entries[] = {
+        create_entry(ctx, "cn=test,dc=domain,dc=alt", "mail", mail),
+        create_entry(ctx, "cn=second,dc=domain,dc=alt", "CN", cn),
+        NULL
+    };
+    char *attrs[] = { "cn", "mail", NULL };
+
+    char *output = export_entries(ctx, LD_EXPORT_CSV, attrs, entries);
+    assert_that(output, is_equal_to_string(
+        "dn,cn,mail\r\n"
+        "\"cn=test,dc=domain,dc=alt\",,\"first@domain.alt\nsecond@domain.alt\"\r\n"
+        "\"cn=second,dc=domain,dc=alt\",\"Smith, John\",\r\n"));
+
+    assert_that(ld_export_new(ctx, 1, LD_EXPORT_CSV, NULL), is_null);
+
+    talloc_free(ctx);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, ldif_export_encodes_unsafe_values);
+    add_test_with_context(suite, Cgreen, json_lines_export_escapes_strings_and_encodes_binary_values);
+    add_test_with_context(suite, Cgreen, csv_export_writes_selected_attributes);
+    return run_test_suite(suite, create_text_reporter());
+}
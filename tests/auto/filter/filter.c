@@ -0,0 +1,128 @@
+#include <cgreen/cgreen.h>
+
+#include <filter.h>
+#include <talloc.h>
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+Ensure(Cgreen, escape_value_escapes_special_characters)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+
+    assert_that(ld_filter_escape_value(ctx, "a*b(c)\\", 7), is_equal_to_string("a\\2ab\\28c\\29\\5c"));
+    assert_that(ld_filter_escape_value(ctx, "a\0b", 3), is_equal_to_string("a\\00b"));
+    assert_that(ld_filter_escape_value(ctx, "plain", 5), is_equal_to_string("plain"));
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, parsed_filter_renders_back)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+
+    const char *filters[] =
+    {
+        "(&(objectClass=user)(|(cn=a*b*c)(!(sn=*)))(uid>=5)(cn:dn:2.5.13.5:=x))",
+        "(cn=a\\2ab)",
+        "(cn=*end)",
+        "(:dn:2.5.13.5:=x)",
+        "(cn~=x)",
+        "(cn<=x)",
+        "(cn=)",
+    };
+
+    for (unsigned int i = 0; i < sizeof(filters) / sizeof(filters[0]); ++i)
+    {
+        ld_filter_t *filter = ld_filter_parse(ctx, filters[i]);
+        assert_that(filter, is_non_null);
+        assert_that(ld_filter_to_string(ctx, filter), is_equal_to_string(filters[i]));
+    }
+
+    assert_that(ld_filter_to_string(ctx, ld_filter_parse(ctx, "cn=test")), is_equal_to_string("(cn=test)"));
+    assert_that(ld_filter_to_string(ctx, ld_filter_parse(ctx, "(& (a=b) (c=d))")), is_equal_to_string("(&(a=b)(c=d))"));
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, invalid_filters_are_rejected)
+{
+    assert_that(ld_filter_validate("(cn=a"), is_false);
+    assert_that(ld_filter_validate("(cn=a(b)"), is_false);
+    assert_that(ld_filter_validate("(&(cn=a)"), is_false);
+    assert_that(ld_filter_validate("cn=a)"), is_false);
+    assert_that(ld_filter_validate("(=a)"), is_false);
+    assert_that(ld_filter_validate("(cn=\\zz)"), is_false);
+    assert_that(ld_filter_validate("(cn~a)"), is_false);
+    assert_that(ld_filter_validate("(!(a=b)(c=d))"), is_false);
+    assert_that(ld_filter_validate("(cn>=a*)"), is_false);
+    assert_that(ld_filter_validate(""), is_false);
+
+    assert_that(ld_filter_validate("(&(objectClass=user)(cn=*))"), is_true);
+}
+
+Ensure(Cgreen, builder_escapes_values)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+
+    const char *any[] = { "mid", NULL };
+
+    ld_filter_t *filter = ld_filter_new_and(ctx);
+    assert_that(ld_filter_add(filter, ld_filter_new_equality(ctx, "objectClass", "user")),
+                is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(ld_filter_add(filter, ld_filter_new_not(ctx, ld_filter_new_equality(ctx, "cn", "J*"))),
+                is_equal_to(RETURN_CODE_SUCCESS));
+    ld_filter_add(filter, ld_filter_new_substrings(ctx, "sn", "a", any, NULL));
+    ld_filter_add(filter, ld_filter_new_present(ctx, "mail"));
+
+    assert_that(ld_filter_to_string(ctx, filter),
+                is_equal_to_string("(&(objectClass=user)(!(cn=J\\2a))(sn=a*mid*)(mail=*))"));
+
+    assert_that(ld_filter_new_equality(ctx, "bad attribute", "x"), is_null);
+    assert_that(ld_filter_add(ld_filter_new_present(ctx, "cn"), ld_filter_new_present(ctx, "sn")),
+                is_equal_to(RETURN_CODE_FAILURE));
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, template_renders_escaped_parameters)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+
+    ld_filter_template_t *filter_template = ld_filter_template_new(ctx, "(&(objectClass=user)(sAMAccountName=?))");
+    assert_that(filter_template, is_non_null);
+    assert_that(ld_filter_template_get_parameter_count(filter_template), is_equal_to(1));
+
+    const char *first[] = { "a(b" };
+    assert_that(ld_filter_template_render(filter_template, first),
+                is_equal_to_string("(&(objectClass=user)(sAMAccountName=a\\28b))"));
+
+    const char *second[] = { "x" };
+    assert_that(ld_filter_template_render(filter_template, second),
+                is_equal_to_string("(&(objectClass=user)(sAMAccountName=x))"));
+
+    ld_filter_template_t *substrings = ld_filter_template_new(ctx, "(|(cn=?*)(sn=*?)(uid=?)(description=what?))");
+    assert_that(ld_filter_template_get_parameter_count(substrings), is_equal_to(3));
+
+    const char *values[] = { "A*", "B", "C" };
+    assert_that(ld_filter_template_render(substrings, values),
+                is_equal_to_string("(|(cn=A\\2a*)(sn=*B)(uid=C)(description=what?))"));
+
+    assert_that(ld_filter_template_new(ctx, "(cn=?"), is_null);
+
+    talloc_free(ctx);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, escape_value_escapes_special_characters);
+    add_test_with_context(suite, Cgreen, parsed_filter_renders_back);
+    add_test_with_context(suite, Cgreen, invalid_filters_are_rejected);
+    add_test_with_context(suite, Cgreen, builder_escapes_values);
+    add_test_with_context(suite, Cgreen, template_renders_escaped_parameters);
+    return run_test_suite(suite, create_text_reporter());
+}
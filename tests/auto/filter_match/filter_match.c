@@ -0,0 +1,104 @@
+#include <cgreen/cgreen.h>
+
+#include <domain.h>
+#include <entry.h>
+#include <filter_match.h>
+#include <talloc.h>
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+static void add_attribute(ld_entry_t *entry, const char *name, const char *first, const char *second)
+{
+    LDAPAttribute_t *attribute = talloc_zero(entry, LDAPAttribute_t);
+    attribute->name = talloc_strdup(attribute, name);
+    attribute->values = talloc_zero_array(attribute, char*, 3);
+    attribute->values[0] = talloc_strdup(attribute->values, first);
+    attribute->values[1] = second ? talloc_strdup(attribute->values, second) : NULL;
+
+    ld_entry_add_attribute(entry, attribute);
+}
+
+static ld_entry_t *create_entry(TALLOC_CTX *ctx)
+{
+    ld_entry_t *entry = ld_entry_new(ctx, "cn=John Smith,ou=Users,dc=domain,dc=alt");
+
+    add_attribute(entry, "objectClass", "person", "user");
+    add_attribute(entry, "cn", "John  Smith", NULL);
+    add_attribute(entry, "sAMAccountName", "jsmith", NULL);
+    add_attribute(entry, "uidNumber", "1005", NULL);
+    add_attribute(entry, "userAccountControl", "514", NULL);
+    add_attribute(entry, "whenCreated", "20230115103000.0Z", NULL);
+    add_attribute(entry, "memberOf", "CN=Admins,CN=Users,DC=domain,DC=alt", NULL);
+
+    return entry;
+}
+
+static enum LdapFilterMatchResult evaluate(TALLOC_CTX *ctx, ld_entry_t *entry, const char *filter)
+{
+    ld_filter_program_t *program = ld_filter_compile_string(ctx, filter, NULL);
+
+    return program ? ld_filter_evaluate(program, entry) : LD_FILTER_MATCH_UNDEFINED;
+}
+
+Ensure(Cgreen, strings_are_matched_ignoring_case_and_spaces)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    ld_entry_t *entry = create_entry(ctx);
+
+    assert_that(evaluate(ctx, entry, "(objectClass=User)"), is_equal_to(LD_FILTER_MATCH_TRUE));
+    assert_that(evaluate(ctx, entry, "(samaccountname=JSMITH)"), is_equal_to(LD_FILTER_MATCH_TRUE));
+    assert_that(evaluate(ctx, entry, "(cn= john smith )"), is_equal_to(LD_FILTER_MATCH_TRUE));
+    assert_that(evaluate(ctx, entry, "(cn=jo*sm*)"), is_equal_to(LD_FILTER_MATCH_TRUE));
+    assert_that(evaluate(ctx, entry, "(cn=*smyth)"), is_equal_to(LD_FILTER_MATCH_FALSE));
+    assert_that(evaluate(ctx, entry, "(cn:caseExactMatch:=john smith)"), is_equal_to(LD_FILTER_MATCH_FALSE));
+    assert_that(evaluate(ctx, entry, "(memberOf=cn=admins,cn=users,dc=domain,dc=alt)"),
+                is_equal_to(LD_FILTER_MATCH_TRUE));
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, integers_and_times_are_ordered)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    ld_entry_t *entry = create_entry(ctx);
+
+    assert_that(evaluate(ctx, entry, "(uidNumber>=999)"), is_equal_to(LD_FILTER_MATCH_TRUE));
+    assert_that(evaluate(ctx, entry, "(uidNumber<=999)"), is_equal_to(LD_FILTER_MATCH_FALSE));
+    assert_that(evaluate(ctx, entry, "(uidNumber=01005)"), is_equal_to(LD_FILTER_MATCH_TRUE));
+    assert_that(evaluate(ctx, entry, "(whenCreated<=20230115102959Z)"), is_equal_to(LD_FILTER_MATCH_FALSE));
+    assert_that(evaluate(ctx, entry, "(whenCreated>=20230115133000+0300)"), is_equal_to(LD_FILTER_MATCH_TRUE));
+    assert_that(evaluate(ctx, entry, "(userAccountControl:1.2.840.113556.1.4.803:=2)"),
+                is_equal_to(LD_FILTER_MATCH_TRUE));
+    assert_that(evaluate(ctx, entry, "(userAccountControl:1.2.840.113556.1.4.803:=16)"),
+                is_equal_to(LD_FILTER_MATCH_FALSE));
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, undefined_results_follow_three_valued_logic)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    ld_entry_t *entry = create_entry(ctx);
+
+    assert_that(evaluate(ctx, entry, "(uidNumber=abc)"), is_equal_to(LD_FILTER_MATCH_UNDEFINED));
+    assert_that(evaluate(ctx, entry, "(!(uidNumber=abc))"), is_equal_to(LD_FILTER_MATCH_UNDEFINED));
+    assert_that(evaluate(ctx, entry, "(|(uidNumber=abc)(cn=john smith))"), is_equal_to(LD_FILTER_MATCH_TRUE));
+    assert_that(evaluate(ctx, entry, "(&(uidNumber=abc)(cn=x))"), is_equal_to(LD_FILTER_MATCH_FALSE));
+    assert_that(evaluate(ctx, entry, "(cn:1.2.3.4:=x)"), is_equal_to(LD_FILTER_MATCH_UNDEFINED));
+    assert_that(evaluate(ctx, entry, "(!(mail=*))"), is_equal_to(LD_FILTER_MATCH_TRUE));
+
+    talloc_free(ctx);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, strings_are_matched_ignoring_case_and_spaces);
+    add_test_with_context(suite, Cgreen, integers_and_times_are_ordered);
+    add_test_with_context(suite, Cgreen, undefined_results_follow_three_valued_logic);
+    return run_test_suite(suite, create_text_reporter());
+}
@@ -0,0 +1,169 @@
+#include <cgreen/cgreen.h>
+
+#include <directory.h>
+#include <domain.h>
+#include <group.h>
+#include <talloc.h>
+
+#include <connection_state_machine.h>
+
+#include <test_common.h>
+
+const int LDAP_DEBUG_ANY = -1;
+const int BUFFER_SIZE = 80;
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+const int CONNECTION_UPDATE_INTERVAL = 1000;
+
+#define number_of_elements(x)  (sizeof(x) / sizeof((x)[0]))
+
+typedef struct testcase_s
+{
+    char* name;
+    char* group_dn;
+    char* user_dns[3];
+    int desired_test_result;
+} testcase_t;
+
+typedef struct current_testcases_s
+{
+    int number_of_testcases;
+    testcase_t* testcases;
+} current_testcases_t;
+
+static testcase_t OPENLDAP_TESTCASES[] =
+{
+    {
+        "Set members of a group in OpenLDAP",
+        "cn=test_mod_group,ou=groups,dc=domain,dc=alt",
+        { "cn=test_mod_user,ou=users,dc=domain,dc=alt", "cn=test_mod_user,ou=users,dc=domain,dc=alt", NULL },
+        RETURN_CODE_SUCCESS
+    }
+};
+
+static const int NUMBER_OF_OPENLDAP_TESTCASES = number_of_elements(OPENLDAP_TESTCASES);
+
+static testcase_t AD_TESTCASES[] =
+{
+    {
+        "Set members of a group in AD",
+        "CN=test_mod_group,CN=Users,DC=domain,DC=alt",
+        { "cn=test mod,cn=users,dc=domain,dc=alt", "CN=Test Mod,CN=Users,DC=domain,DC=alt", NULL },
+        RETURN_CODE_SUCCESS
+    }
+};
+
+static const int NUMBER_OF_AD_TESTCASES = number_of_elements(AD_TESTCASES);
+
+static int current_directory_type = LDAP_TYPE_UNKNOWN;
+
+static int pending_testcases = 0;
+
+static verto_ctx *test_ctx = NULL;
+
+static current_testcases_t get_current_testcases(int directory_type)
+{
+    current_testcases_t result = { .testcases = NULL, .number_of_testcases = 0 };
+
+    switch (directory_type)
+    {
+    case LDAP_TYPE_ACTIVE_DIRECTORY:
+        result.testcases = AD_TESTCASES;
+        result.number_of_testcases = NUMBER_OF_AD_TESTCASES;
+        break;
+    case LDAP_TYPE_OPENLDAP:
+        result.testcases = OPENLDAP_TESTCASES;
+        result.number_of_testcases = NUMBER_OF_OPENLDAP_TESTCASES;
+    default:
+        break;
+    }
+
+    return result;
+}
+
+static void on_members_chunk(LDHandle *handle, const char *group_dn, int mod_operation, char **members,
+                             enum OperationReturnCode rc, void *user_data)
+{
+    (void)(handle);
+    (void)(group_dn);
+    (void)(mod_operation);
+    (void)(user_data);
+
+    assert_that(members, is_non_null);
+    assert_that(members[0], is_non_null);
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+}
+
+static void on_members_complete(LDHandle *handle, const char *group_dn, enum OperationReturnCode rc, void *user_data)
+{
+    (void)(handle);
+    (void)(group_dn);
+
+    testcase_t *testcase = user_data;
+
+    assert_that(rc, is_equal_to(testcase->desired_test_result));
+    test_status((*testcase));
+
+    if (--pending_testcases == 0)
+    {
+        verto_break(test_ctx);
+    }
+}
+
+static void connection_on_timeout(verto_ctx *ctx, verto_ev *ev)
+{
+    (void)(ctx);
+
+    struct ldap_connection_ctx_t* connection = verto_get_private(ev);
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_RUN)
+    {
+        verto_del(ev);
+
+        test_ctx = ctx;
+
+        current_testcases_t current_testcases = get_current_testcases(current_directory_type);
+        pending_testcases = current_testcases.number_of_testcases;
+        for (int test_index = 0; test_index < current_testcases.number_of_testcases; test_index++)
+        {
+            testcase_t *testcase = &current_testcases.testcases[test_index];
+
+            int rc = ld_group_set_users(connection->handle,
+                                        testcase->group_dn,
+                                        testcase->user_dns,
+                                        on_members_chunk,
+                                        on_members_complete,
+                                        testcase);
+            assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+        }
+
+        if (pending_testcases == 0)
+        {
+            verto_break(ctx);
+        }
+    }
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_ERROR)
+    {
+        verto_break(ctx);
+
+        fail_test("Error encountered during bind\n");
+    }
+}
+
+Ensure(Cgreen, group_bulk_members_test)
+{
+    start_test(connection_on_timeout, CONNECTION_UPDATE_INTERVAL, &current_directory_type, false);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, group_bulk_members_test);
+    return run_test_suite(suite, create_text_reporter());
+}
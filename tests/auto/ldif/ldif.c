@@ -0,0 +1,181 @@
+#include <cgreen/cgreen.h>
+
+#include <ldif.h>
+#include <talloc.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+static char *write_ldif(TALLOC_CTX *ctx, const char *content)
+{
+    char *path = talloc_strdup(ctx, "/tmp/libdomain-ldif-XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    size_t length = strlen(content);
+    if (write(fd, content, length) != (ssize_t)length)
+    {
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+
+    return path;
+}
+
+static const char *RECORDS =
+    "version: 1\n"
+    "\n"
+    "# Content record\n"
+    "dn: cn=test,ou=users,\n"
+    " dc=domain,dc=alt\n"
+    "objectClass: top\n"
+    "objectClass: person\n"
+    "cn: test\n"
+    "description:: VGVzdCB1c2Vy\n"
+    "\n"
+    "dn: cn=test,ou=users,dc=domain,dc=alt\r\n"
+    "changetype: modify\r\n"
+    "replace: description\r\n"
+    "description: Changed\r\n"
+    "-\r\n"
+    "delete: telephoneNumber\r\n"
+    "-\r\n"
+    "\r\n"
+    "dn: cn=test,ou=users,dc=domain,dc=alt\n"
+    "changetype: modrdn\n"
+    "newrdn: cn=renamed\n"
+    "deleteoldrdn: 1\n"
+    "newsuperior: ou=groups,dc=domain,dc=alt\n"
+    "\n"
+    "\n"
+    "dn: cn=renamed,ou=groups,dc=domain,dc=alt\n"
+    "changetype: delete\n";
+
+Ensure(Cgreen, reads_records_of_all_change_types)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    char *path = write_ldif(ctx, RECORDS);
+    assert_that(path, is_non_null);
+
+    ld_ldif_reader_t *reader = ld_ldif_reader_new(ctx, path, 0, 0);
+    assert_that(reader, is_non_null);
+
+    ld_ldif_record_t *record = NULL;
+
+    assert_that(ld_ldif_read(reader, ctx, &record), is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(record, is_non_null);
+    assert_that(record->number, is_equal_to(1));
+    assert_that(record->change_type, is_equal_to(LD_LDIF_CHANGE_ADD));
+    assert_that(record->dn, is_equal_to_string("cn=test,ou=users,dc=domain,dc=alt"));
+    assert_that(record->mods[0]->mod_type, is_equal_to_string("objectClass"));
+    assert_that(record->mods[0]->mod_op, is_equal_to(LDAP_MOD_ADD | LDAP_MOD_BVALUES));
+    assert_that(record->mods[0]->mod_bvalues[1]->bv_val, is_equal_to_string("person"));
+    assert_that(record->mods[0]->mod_bvalues[2], is_null);
+    assert_that(record->mods[2]->mod_bvalues[0]->bv_val, is_equal_to_string("Test user"));
+    assert_that(record->mods[3], is_null);
+
+    assert_that(ld_ldif_read(reader, ctx, &record), is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(record->change_type, is_equal_to(LD_LDIF_CHANGE_MODIFY));
+    assert_that(record->mods[0]->mod_op, is_equal_to(LDAP_MOD_REPLACE | LDAP_MOD_BVALUES));
+    assert_that(record->mods[0]->mod_bvalues[0]->bv_val, is_equal_to_string("Changed"));
+    assert_that(record->mods[1]->mod_op, is_equal_to(LDAP_MOD_DELETE | LDAP_MOD_BVALUES));
+    assert_that(record->mods[1]->mod_type, is_equal_to_string("telephoneNumber"));
+    assert_that(record->mods[1]->mod_bvalues, is_null);
+    assert_that(record->mods[2], is_null);
+
+    assert_that(ld_ldif_read(reader, ctx, &record), is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(record->change_type, is_equal_to(LD_LDIF_CHANGE_MODRDN));
+    assert_that(record->new_rdn, is_equal_to_string("cn=renamed"));
+    assert_that(record->delete_old_rdn, is_true);
+    assert_that(record->new_superior, is_equal_to_string("ou=groups,dc=domain,dc=alt"));
+
+    assert_that(ld_ldif_read(reader, ctx, &record), is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(record->number, is_equal_to(4));
+    assert_that(record->change_type, is_equal_to(LD_LDIF_CHANGE_DELETE));
+    assert_that(record->mods, is_null);
+
+    assert_that(ld_ldif_read(reader, ctx, &record), is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(record, is_null);
+
+    unlink(path);
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, invalid_record_is_skipped)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    char *path = write_ldif(ctx,
+                            "dn: cn=first,dc=domain,dc=alt\n"
+                            "changetype: modify\n"
+                            "replace: description\n"
+                            "description: not terminated\n"
+                            "\n"
+                            "dn: cn=second,dc=domain,dc=alt\n"
+                            "cn: second\n");
+    assert_that(path, is_non_null);
+
+    ld_ldif_reader_t *reader = ld_ldif_reader_new(ctx, path, 0, 0);
+    ld_ldif_record_t *record = NULL;
+
+    assert_that(ld_ldif_read(reader, ctx, &record), is_equal_to(RETURN_CODE_FAILURE));
+    assert_that(record, is_non_null);
+    assert_that(record->number, is_equal_to(1));
+
+    assert_that(ld_ldif_read(reader, ctx, &record), is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(record->number, is_equal_to(2));
+    assert_that(record->dn, is_equal_to_string("cn=second,dc=domain,dc=alt"));
+
+    unlink(path);
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, reading_resumes_from_offset)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    char *path = write_ldif(ctx, RECORDS);
+    assert_that(path, is_non_null);
+
+    ld_ldif_reader_t *reader = ld_ldif_reader_new(ctx, path, 0, 0);
+    ld_ldif_record_t *record = NULL;
+
+    assert_that(ld_ldif_read(reader, ctx, &record), is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(ld_ldif_read(reader, ctx, &record), is_equal_to(RETURN_CODE_SUCCESS));
+
+    ld_ldif_reader_t *resumed = ld_ldif_reader_new(ctx, path, record->offset, record->number - 1);
+    assert_that(resumed, is_non_null);
+
+    ld_ldif_record_t *same = NULL;
+    assert_that(ld_ldif_read(resumed, ctx, &same), is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(same->number, is_equal_to(2));
+    assert_that(same->change_type, is_equal_to(LD_LDIF_CHANGE_MODIFY));
+
+    ld_ldif_reader_t *next = ld_ldif_reader_new(ctx, path, ld_ldif_reader_get_offset(reader),
+                                                ld_ldif_reader_get_number(reader));
+    assert_that(ld_ldif_read(next, ctx, &record), is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(record->number, is_equal_to(3));
+    assert_that(record->change_type, is_equal_to(LD_LDIF_CHANGE_MODRDN));
+
+    unlink(path);
+    talloc_free(ctx);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, reads_records_of_all_change_types);
+    add_test_with_context(suite, Cgreen, invalid_record_is_skipped);
+    add_test_with_context(suite, Cgreen, reading_resumes_from_offset);
+    return run_test_suite(suite, create_text_reporter());
+}
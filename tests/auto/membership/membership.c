@@ -0,0 +1,112 @@
+#include <cgreen/cgreen.h>
+
+#include <directory.h>
+#include <domain.h>
+#include <membership.h>
+#include <talloc.h>
+
+#include <connection_state_machine.h>
+
+#include <test_common.h>
+
+const int LDAP_DEBUG_ANY = -1;
+const int BUFFER_SIZE = 80;
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+const int CONNECTION_UPDATE_INTERVAL = 1000;
+
+static int current_directory_type = LDAP_TYPE_UNKNOWN;
+
+static verto_ctx *test_ctx = NULL;
+
+static ld_membership_cache_t *cache = NULL;
+
+static const char *NO_SUCH_GROUP = "cn=no_such_group,dc=domain,dc=alt";
+
+static void on_check(const char *dn, const char *group_dn, bool is_member, enum OperationReturnCode rc,
+                     void *user_data)
+{
+    (void)(group_dn);
+    (void)(user_data);
+
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(is_member, is_false);
+
+    // Result of the previous query is served from the cache.
+    assert_that(ld_membership_cache_hits(cache), is_equal_to(1));
+
+    bool cached_is_member = true;
+    assert_that(ld_membership_cache_lookup(cache, dn, NO_SUCH_GROUP, &cached_is_member), is_true);
+    assert_that(cached_is_member, is_false);
+
+    ld_membership_cache_invalidate(cache, dn, false);
+    assert_that(ld_membership_cache_count(cache), is_equal_to(0));
+
+    verto_break(test_ctx);
+}
+
+static void on_groups(const char *dn, const char **groups, int n_groups, enum OperationReturnCode rc,
+                      void *user_data)
+{
+    struct ldap_connection_ctx_t *connection = user_data;
+
+    (void)(groups);
+
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(n_groups >= 0, is_true);
+    assert_that(ld_membership_cache_count(cache), is_equal_to(1));
+
+    enum OperationReturnCode check_rc = ld_membership_is_member(connection, connection, dn, dn, NO_SUCH_GROUP,
+                                                                on_check, NULL);
+    assert_that(check_rc, is_equal_to(RETURN_CODE_SUCCESS));
+}
+
+static void connection_on_timeout(verto_ctx *ctx, verto_ev *ev)
+{
+    (void)(ctx);
+
+    struct ldap_connection_ctx_t* connection = verto_get_private(ev);
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_RUN)
+    {
+        verto_del(ev);
+
+        test_ctx = ctx;
+
+        const char *base_dn = current_directory_type == LDAP_TYPE_ACTIVE_DIRECTORY
+                ? "DC=domain,DC=alt"
+                : "dc=domain,dc=alt";
+
+        cache = ld_membership_cache_new(connection, 0, 0);
+        assert_that(cache, is_non_null);
+        ld_membership_cache_attach(connection, cache);
+
+        enum OperationReturnCode rc = ld_membership_get_groups(connection, connection, base_dn, base_dn,
+                                                               on_groups, connection);
+        assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    }
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_ERROR)
+    {
+        verto_break(ctx);
+
+        fail_test("Error encountered during bind\n");
+    }
+}
+
+Ensure(Cgreen, membership_test)
+{
+    start_test(connection_on_timeout, CONNECTION_UPDATE_INTERVAL, &current_directory_type, false);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, membership_test);
+    return run_test_suite(suite, create_text_reporter());
+}
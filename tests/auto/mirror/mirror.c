@@ -0,0 +1,242 @@
+#include <cgreen/cgreen.h>
+
+#include <domain.h>
+#include <entry.h>
+#include <entry_p.h>
+#include <mirror.h>
+#include <talloc.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+static void add_value(ld_entry_t *entry, const char *name, const char *value)
+{
+    LDAPAttribute_t *attribute = talloc_zero(entry, LDAPAttribute_t);
+    attribute->name = talloc_strdup(attribute, name);
+    attribute->values = talloc_array(attribute, char*, 2);
+    attribute->values[0] = talloc_strdup(attribute->values, value);
+    attribute->values[1] = NULL;
+
+    ld_entry_add_attribute(entry, attribute);
+}
+
+static ld_entry_t *create_user(TALLOC_CTX *ctx, const char *dn, const char *uid, const char *uid_number)
+{
+    ld_entry_t *entry = ld_entry_new(ctx, dn);
+
+    add_value(entry, "objectClass", "posixAccount");
+    add_value(entry, "uid", uid);
+    add_value(entry, "uidNumber", uid_number);
+
+    return entry;
+}
+
+static ld_mirror_t *create_mirror(TALLOC_CTX *ctx)
+{
+    ld_mirror_t *mirror = ld_mirror_new(ctx, NULL);
+
+    ld_mirror_put(mirror, ld_entry_new(ctx, "dc=domain,dc=alt"));
+    ld_mirror_put(mirror, ld_entry_new(ctx, "ou=users,dc=domain,dc=alt"));
+    ld_mirror_put(mirror, create_user(ctx, "cn=first,ou=users,dc=domain,dc=alt", "first", "1001"));
+    ld_mirror_put(mirror, create_user(ctx, "cn=second,ou=users,dc=domain,dc=alt", "second", "1002"));
+    ld_mirror_put(mirror, create_user(ctx, "cn=third,ou=admins,ou=users,dc=domain,dc=alt", "third", "1003"));
+
+    return mirror;
+}
+
+Ensure(Cgreen, lookup_ignores_case_and_spaces_in_dn)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    ld_mirror_t *mirror = create_mirror(ctx);
+
+    assert_that(ld_mirror_count(mirror), is_equal_to(5));
+
+    ld_entry_t *entry = ld_mirror_lookup(mirror, ctx, "CN=First, OU=Users, DC=domain, DC=alt");
+    assert_that(entry, is_not_null);
+    assert_that(ld_entry_get_dn(entry), is_equal_to_string("cn=first,ou=users,dc=domain,dc=alt"));
+    assert_that(ld_mirror_lookup(mirror, ctx, "ou=admins,ou=users,dc=domain,dc=alt"), is_null);
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, search_respects_scope)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    ld_mirror_t *mirror = create_mirror(ctx);
+    unsigned int count = 0;
+
+    ld_mirror_search(mirror, ctx, "ou=users,dc=domain,dc=alt", LDAP_SCOPE_SUBTREE, "(objectClass=*)", 0, &count);
+    assert_that(count, is_equal_to(3));
+
+    ld_mirror_search(mirror, ctx, "ou=users,dc=domain,dc=alt", LDAP_SCOPE_ONELEVEL, "(uid=*)", 0, &count);
+    assert_that(count, is_equal_to(2));
+
+    ld_entry_t **result = ld_mirror_search(mirror, ctx, "cn=first,ou=users,dc=domain,dc=alt", LDAP_SCOPE_BASE,
+                                           "(uid=FIRST)", 0, &count);
+    assert_that(count, is_equal_to(1));
+    assert_that(ld_entry_get_dn(result[0]), is_equal_to_string("cn=first,ou=users,dc=domain,dc=alt"));
+    assert_that(result[1], is_null);
+
+    ld_mirror_search(mirror, ctx, "ou=missing,dc=domain,dc=alt", LDAP_SCOPE_SUBTREE, "(uid=*)", 0, &count);
+    assert_that(count, is_equal_to(0));
+
+    ld_mirror_search(mirror, ctx, "dc=domain,dc=alt", LDAP_SCOPE_SUBTREE, "(uid=*)", 2, &count);
+    assert_that(count, is_equal_to(2));
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, indexed_search_matches_scan)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    ld_mirror_t *mirror = create_mirror(ctx);
+    unsigned int count = 0;
+
+    assert_that(ld_mirror_add_index(mirror, "uid", LD_MIRROR_INDEX_EQUALITY), is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(ld_mirror_add_index(mirror, "uidNumber", LD_MIRROR_INDEX_ORDERED), is_equal_to(RETURN_CODE_SUCCESS));
+
+    ld_entry_t **result = ld_mirror_search(mirror, ctx, "dc=domain,dc=alt", LDAP_SCOPE_SUBTREE,
+                                           "(&(uid=Second)(objectClass=posixAccount))", 0, &count);
+    assert_that(count, is_equal_to(1));
+    assert_that(ld_entry_get_dn(result[0]), is_equal_to_string("cn=second,ou=users,dc=domain,dc=alt"));
+
+    ld_mirror_search(mirror, ctx, "dc=domain,dc=alt", LDAP_SCOPE_SUBTREE, "(uidNumber>=1002)", 0, &count);
+    assert_that(count, is_equal_to(2));
+
+    ld_mirror_search(mirror, ctx, "dc=domain,dc=alt", LDAP_SCOPE_SUBTREE, "(|(uid=first)(uidNumber<=1002))", 0, &count);
+    assert_that(count, is_equal_to(2));
+
+    ld_mirror_search(mirror, ctx, "ou=admins,ou=users,dc=domain,dc=alt", LDAP_SCOPE_SUBTREE, "(uid=fir*)", 0, &count);
+    assert_that(count, is_equal_to(0));
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, sync_changes_update_mirror)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    ld_mirror_t *mirror = create_mirror(ctx);
+    unsigned int count = 0;
+
+    ld_mirror_add_index(mirror, "uid", LD_MIRROR_INDEX_EQUALITY);
+    ld_mirror_set_partial_updates(mirror, true);
+
+    ld_entry_t *update = ld_entry_new(ctx, "cn=first,ou=users,dc=domain,dc=alt");
+    add_value(update, "uid", "renamed");
+    ld_mirror_sync_change(NULL, LD_SYNC_CHANGE_MODIFY, ld_entry_get_dn(update), NULL, update, mirror);
+
+    ld_entry_t **result = ld_mirror_search(mirror, ctx, "dc=domain,dc=alt", LDAP_SCOPE_SUBTREE,
+                                           "(&(uid=renamed)(uidNumber=1001))", 0, &count);
+    assert_that(count, is_equal_to(1));
+    assert_that(ld_entry_get_dn(result[0]), is_equal_to_string("cn=first,ou=users,dc=domain,dc=alt"));
+
+    ld_entry_t *renamed = create_user(ctx, "cn=first,ou=admins,ou=users,dc=domain,dc=alt", "renamed", "1001");
+    ld_mirror_sync_change(NULL, LD_SYNC_CHANGE_RENAME, ld_entry_get_dn(renamed),
+                          "cn=first,ou=users,dc=domain,dc=alt", renamed, mirror);
+
+    assert_that(ld_mirror_lookup(mirror, ctx, "cn=first,ou=users,dc=domain,dc=alt"), is_null);
+    ld_mirror_search(mirror, ctx, "ou=admins,ou=users,dc=domain,dc=alt", LDAP_SCOPE_ONELEVEL, "(uid=renamed)", 0, &count);
+    assert_that(count, is_equal_to(1));
+
+    ld_mirror_sync_change(NULL, LD_SYNC_CHANGE_DELETE, "cn=second,ou=users,dc=domain,dc=alt", NULL, NULL, mirror);
+    assert_that(ld_mirror_count(mirror), is_equal_to(4));
+    ld_mirror_search(mirror, ctx, "dc=domain,dc=alt", LDAP_SCOPE_SUBTREE, "(uid=second)", 0, &count);
+    assert_that(count, is_equal_to(0));
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, referenced_entry_survives_removal)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    ld_mirror_t *mirror = create_mirror(ctx);
+
+    TALLOC_CTX *references = talloc_new(ctx);
+    ld_entry_t *entry = ld_mirror_lookup(mirror, references, "cn=second,ou=users,dc=domain,dc=alt");
+
+    assert_that(ld_mirror_remove(mirror, "cn=second,ou=users,dc=domain,dc=alt"), is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(ld_mirror_remove(mirror, "cn=second,ou=users,dc=domain,dc=alt"), is_equal_to(RETURN_CODE_FAILURE));
+    assert_that(ld_entry_get_dn(entry), is_equal_to_string("cn=second,ou=users,dc=domain,dc=alt"));
+
+    talloc_unlink(references, entry);
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, snapshot_restores_entries_and_indexes)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    ld_mirror_t *mirror = create_mirror(ctx);
+    unsigned int count = 0;
+
+    char path[] = "/tmp/libdomain_mirror_XXXXXX";
+    int fd = mkstemp(path);
+    assert_that(fd, is_not_equal_to(-1));
+    close(fd);
+
+    ld_mirror_add_index(mirror, "uidNumber", LD_MIRROR_INDEX_ORDERED);
+    ld_mirror_set_partial_updates(mirror, true);
+    ld_mirror_remove(mirror, "cn=second,ou=users,dc=domain,dc=alt");
+
+    assert_that(ld_mirror_save(mirror, NULL, path), is_equal_to(RETURN_CODE_SUCCESS));
+
+    ld_mirror_t *restored = ld_mirror_load(ctx, NULL, path, NULL);
+    assert_that(restored, is_not_null);
+    assert_that(ld_mirror_count(restored), is_equal_to(4));
+
+    ld_entry_t *entry = ld_mirror_lookup(restored, ctx, "cn=third,ou=admins,ou=users,dc=domain,dc=alt");
+    assert_that(entry, is_not_null);
+    assert_that(ld_entry_get_attribute(entry, "uid")->values[0], is_equal_to_string("third"));
+
+    ld_mirror_search(restored, ctx, "dc=domain,dc=alt", LDAP_SCOPE_SUBTREE, "(uidNumber>=1002)", 0, &count);
+    assert_that(count, is_equal_to(1));
+
+    ld_entry_t *update = ld_entry_new(ctx, "cn=third,ou=admins,ou=users,dc=domain,dc=alt");
+    add_value(update, "uidNumber", "999");
+    ld_mirror_sync_change(NULL, LD_SYNC_CHANGE_MODIFY, ld_entry_get_dn(update), NULL, update, restored);
+
+    ld_mirror_search(restored, ctx, "dc=domain,dc=alt", LDAP_SCOPE_SUBTREE, "(&(uidNumber<=1000)(uid=third))", 0,
+                     &count);
+    assert_that(count, is_equal_to(1));
+
+    unlink(path);
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, truncated_snapshot_is_rejected)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    ld_mirror_t *mirror = create_mirror(ctx);
+
+    char path[] = "/tmp/libdomain_mirror_XXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+
+    assert_that(ld_mirror_save(mirror, NULL, path), is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(truncate(path, 100), is_equal_to(0));
+
+    assert_that(ld_mirror_load(ctx, NULL, path, NULL), is_null);
+    assert_that(ld_mirror_load(ctx, NULL, "/nonexistent/mirror", NULL), is_null);
+
+    unlink(path);
+    talloc_free(ctx);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, lookup_ignores_case_and_spaces_in_dn);
+    add_test_with_context(suite, Cgreen, search_respects_scope);
+    add_test_with_context(suite, Cgreen, indexed_search_matches_scan);
+    add_test_with_context(suite, Cgreen, sync_changes_update_mirror);
+    add_test_with_context(suite, Cgreen, referenced_entry_survives_removal);
+    add_test_with_context(suite, Cgreen, snapshot_restores_entries_and_indexes);
+    add_test_with_context(suite, Cgreen, truncated_snapshot_is_rejected);
+    return run_test_suite(suite, create_text_reporter());
+}
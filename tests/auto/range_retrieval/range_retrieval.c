@@ -0,0 +1,209 @@
+#include <cgreen/cgreen.h>
+
+#include <connection.h>
+#include <connection_state_machine.h>
+#include <directory.h>
+#include <domain.h>
+#include <entry.h>
+#include <entry_p.h>
+#include <range_retrieval.h>
+#include <range_retrieval_p.h>
+#include <talloc.h>
+
+#include <test_common.h>
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+const int CONNECTION_UPDATE_INTERVAL = 1000;
+
+static int current_directory_type = LDAP_TYPE_UNKNOWN;
+
+static TALLOC_CTX* talloc_ctx = NULL;
+
+static int n_values = 0;
+static bool completed = false;
+
+static void add_values(ld_entry_t *entry, const char *name, int count)
+{
+    LDAPAttribute_t *attribute = talloc_zero(entry, LDAPAttribute_t);
+    attribute->name = talloc_strdup(attribute, name);
+    attribute->values = talloc_array(attribute, char*, count + 1);
+    for (int i = 0; i < count; ++i)
+    {
+        attribute->values[i] = talloc_asprintf(attribute->values, "cn=user%d,dc=domain,dc=alt", i);
+    }
+    attribute->values[count] = NULL;
+
+    ld_entry_add_attribute(entry, attribute);
+}
+
+static enum OperationReturnCode entries_callback(struct ldap_connection_ctx_t *connection,
+                                                 ld_entry_t **entries,
+                                                 void *user_data)
+{
+    (void)(connection);
+    (void)(entries);
+
+    ++*(int *)user_data;
+
+    return RETURN_CODE_SUCCESS;
+}
+
+Ensure(Cgreen, range_option_is_parsed)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    char *name = NULL;
+    unsigned int low = 0;
+    unsigned int high = 0;
+
+    assert_that(range_parse_description(ctx, "member;range=0-1499", &name, &low, &high), is_true);
+    assert_that(name, is_equal_to_string("member"));
+    assert_that(low, is_equal_to(0));
+    assert_that(high, is_equal_to(1499));
+
+    assert_that(range_parse_description(ctx, "member;Range=1500-*", &name, &low, &high), is_true);
+    assert_that(name, is_equal_to_string("member"));
+    assert_that(low, is_equal_to(1500));
+    assert_that(high, is_equal_to(RANGE_END));
+
+    assert_that(range_parse_description(ctx, "member;range=0-1;binary", &name, &low, &high), is_true);
+    assert_that(name, is_equal_to_string("member;binary"));
+    assert_that(high, is_equal_to(1));
+
+    assert_that(range_parse_description(ctx, "cn", &name, &low, &high), is_true);
+    assert_that(name, is_equal_to_string("cn"));
+    assert_that(high, is_equal_to(RANGE_END));
+
+    assert_that(range_parse_description(ctx, "member;range=5-1", &name, &low, &high), is_false);
+    assert_that(range_parse_description(ctx, "member;range=x-*", &name, &low, &high), is_false);
+    assert_that(range_parse_description(ctx, "member;range=0-", &name, &low, &high), is_false);
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, complete_ranges_are_renamed)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    int calls = 0;
+
+    ld_entry_t *entry = ld_entry_new(ctx, "cn=group,dc=domain,dc=alt");
+    add_values(entry, "member;range=0-*", 3);
+    add_values(entry, "cn", 1);
+
+    ld_entry_t *entries[] = { entry, NULL };
+
+    assert_that(range_complete_entries(NULL, entries, entries_callback, &calls), is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(calls, is_equal_to(1));
+
+    assert_that(ld_entry_get_attribute(entry, "member;range=0-*"), is_null);
+    LDAPAttribute_t *member = ld_entry_get_attribute(entry, "member");
+    assert_that(member, is_non_null);
+    assert_that(member->values[2], is_equal_to_string("cn=user2,dc=domain,dc=alt"));
+    assert_that(member->values[3], is_null);
+    assert_that(ld_entry_get_attribute(entry, "cn"), is_non_null);
+
+    talloc_free(ctx);
+}
+
+static enum OperationReturnCode range_values(struct ldap_connection_ctx_t *connection,
+                                             const char *dn,
+                                             const char *attribute,
+                                             char **values,
+                                             void *user_data)
+{
+    (void)(connection);
+    (void)(dn);
+    (void)(user_data);
+
+    assert_that(attribute, is_equal_to_string("objectClass"));
+
+    while (values[0])
+    {
+        ++n_values;
+        ++values;
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+static void range_complete(struct ldap_connection_ctx_t *connection,
+                           ld_range_t *range,
+                           enum OperationReturnCode rc,
+                           void *user_data)
+{
+    (void)(user_data);
+
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(ld_range_get_count(range), is_equal_to(n_values));
+
+    completed = true;
+
+    verto_break(connection->base);
+}
+
+static void connection_on_timeout(verto_ctx *ctx, verto_ev *ev)
+{
+    (void)(ctx);
+
+    struct ldap_connection_ctx_t* connection = verto_get_private(ev);
+
+    csm_next_state(connection->state_machine);
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_RUN)
+    {
+        verto_del(ev);
+
+        char* search_base = "dc=domain,dc=alt";
+
+        switch (current_directory_type)
+        {
+        case LDAP_TYPE_OPENLDAP:
+            search_base = "dc=domain,dc=alt";
+            break;
+        case LDAP_TYPE_ACTIVE_DIRECTORY:
+            search_base = "cn=users,dc=domain,dc=alt";
+            break;
+        default:
+            verto_break(ctx);
+
+            fail_test("Unknown directory type - not implemented!\n");
+
+            return;
+        }
+
+        talloc_ctx = talloc_new(NULL);
+
+        ld_range_t *range = ld_range_retrieve(talloc_ctx, connection, search_base, "objectClass",
+                                              range_values, range_complete, NULL);
+        assert_that(range, is_non_null);
+    }
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_ERROR)
+    {
+        verto_break(ctx);
+
+        fail_test("Error encountered during bind\n");
+    }
+}
+
+Ensure(Cgreen, range_retrieval_test) {
+    start_test(connection_on_timeout, CONNECTION_UPDATE_INTERVAL, &current_directory_type, false);
+
+    assert_that(completed, is_true);
+    assert_that(n_values, is_greater_than(0));
+
+    talloc_free(talloc_ctx);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, range_option_is_parsed);
+    add_test_with_context(suite, Cgreen, complete_ranges_are_renamed);
+    add_test_with_context(suite, Cgreen, range_retrieval_test);
+    return run_test_suite(suite, create_text_reporter());
+}
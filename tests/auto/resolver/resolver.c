@@ -0,0 +1,86 @@
+#include <cgreen/cgreen.h>
+
+#include <directory.h>
+#include <domain.h>
+#include <resolver.h>
+#include <talloc.h>
+
+#include <connection_state_machine.h>
+
+#include <test_common.h>
+
+const int LDAP_DEBUG_ANY = -1;
+const int BUFFER_SIZE = 80;
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+const int CONNECTION_UPDATE_INTERVAL = 1000;
+
+static int current_directory_type = LDAP_TYPE_UNKNOWN;
+
+static verto_ctx *test_ctx = NULL;
+
+static const char *NAMES[] = { "domain", "DOMAIN", "no_such_domain_component" };
+
+static void on_complete(const ld_resolve_result_t *results, int n_names, enum OperationReturnCode rc, void *user_data)
+{
+    (void)(user_data);
+
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(n_names, is_equal_to(3));
+
+    // Names are matched case insensitively.
+    assert_that(results[0].dn, is_non_null);
+    assert_that(results[1].dn, is_equal_to_string(results[0].dn));
+    assert_that(results[0].ambiguous, is_false);
+
+    assert_that(results[2].dn, is_null);
+    assert_that(results[2].rc, is_equal_to(RETURN_CODE_SUCCESS));
+
+    verto_break(test_ctx);
+}
+
+static void connection_on_timeout(verto_ctx *ctx, verto_ev *ev)
+{
+    (void)(ctx);
+
+    struct ldap_connection_ctx_t* connection = verto_get_private(ev);
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_RUN)
+    {
+        verto_del(ev);
+
+        test_ctx = ctx;
+
+        const char *base_dn = current_directory_type == LDAP_TYPE_ACTIVE_DIRECTORY
+                ? "DC=domain,DC=alt"
+                : "dc=domain,dc=alt";
+
+        enum OperationReturnCode rc = ld_resolve_names(connection, connection, base_dn, "dc", NAMES, 3, NULL, 0,
+                                                       on_complete, NULL);
+        assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    }
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_ERROR)
+    {
+        verto_break(ctx);
+
+        fail_test("Error encountered during bind\n");
+    }
+}
+
+Ensure(Cgreen, resolver_test)
+{
+    start_test(connection_on_timeout, CONNECTION_UPDATE_INTERVAL, &current_directory_type, false);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, resolver_test);
+    return run_test_suite(suite, create_text_reporter());
+}
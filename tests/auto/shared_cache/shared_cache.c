@@ -0,0 +1,166 @@
+#include <cgreen/cgreen.h>
+
+#include <domain.h>
+#include <entry.h>
+#include <entry_p.h>
+#include <shared_cache.h>
+#include <talloc.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+static void cache_name(char *name, size_t size)
+{
+    snprintf(name, size, "/libdomain_test_%d", (int)getpid());
+}
+
+static void add_value(ld_entry_t *entry, const char *name, const char *value)
+{
+    LDAPAttribute_t *attribute = talloc_zero(entry, LDAPAttribute_t);
+    attribute->name = talloc_strdup(attribute, name);
+    attribute->values = talloc_array(attribute, char*, 2);
+    attribute->values[0] = talloc_strdup(attribute->values, value);
+    attribute->values[1] = NULL;
+
+    ld_entry_add_attribute(entry, attribute);
+}
+
+static ld_entry_t *create_user(TALLOC_CTX *ctx, const char *dn, const char *uid)
+{
+    ld_entry_t *entry = ld_entry_new(ctx, dn);
+
+    add_value(entry, "objectClass", "posixAccount");
+    add_value(entry, "uid", uid);
+
+    return entry;
+}
+
+Ensure(Cgreen, reader_sees_published_entries)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    char name[64];
+    cache_name(name, sizeof(name));
+
+    ld_shared_cache_t *writer = ld_shared_cache_create(ctx, name, 256 * 1024, 0);
+    assert_that(writer, is_not_null);
+    assert_that(ld_shared_cache_is_writer(writer), is_true);
+
+    ld_shared_cache_t *reader = ld_shared_cache_open(ctx, name);
+    assert_that(reader, is_not_null);
+    assert_that(ld_shared_cache_is_writer(reader), is_false);
+
+    assert_that(ld_shared_cache_publish(writer, create_user(ctx, "cn=first,ou=users,dc=domain,dc=alt", "first")),
+                is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(ld_shared_cache_publish(reader, create_user(ctx, "cn=second,ou=users,dc=domain,dc=alt", "second")),
+                is_equal_to(RETURN_CODE_FAILURE));
+    assert_that(ld_shared_cache_count(reader), is_equal_to(1));
+
+    ld_entry_t *entry = ld_shared_cache_lookup(reader, ctx, "CN=First, OU=Users, DC=domain, DC=alt");
+    assert_that(entry, is_not_null);
+    assert_that(ld_entry_get_dn(entry), is_equal_to_string("cn=first,ou=users,dc=domain,dc=alt"));
+
+    LDAPAttribute_t *uid = ld_entry_get_attribute(entry, "uid");
+    assert_that(uid, is_not_null);
+    assert_that(uid->values[0], is_equal_to_string("first"));
+    assert_that(uid->values[1], is_null);
+
+    assert_that(ld_shared_cache_lookup(reader, ctx, "cn=second,ou=users,dc=domain,dc=alt"), is_null);
+
+    talloc_free(ctx);
+    ld_shared_cache_unlink(name);
+}
+
+Ensure(Cgreen, second_writer_is_refused)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    char name[64];
+    cache_name(name, sizeof(name));
+
+    ld_shared_cache_t *writer = ld_shared_cache_create(ctx, name, 256 * 1024, 0);
+    assert_that(writer, is_not_null);
+    assert_that(ld_shared_cache_create(ctx, name, 256 * 1024, 0), is_null);
+
+    talloc_free(writer);
+
+    ld_shared_cache_t *next = ld_shared_cache_create(ctx, name, 512 * 1024, 0);
+    assert_that(next, is_not_null);
+    assert_that(ld_shared_cache_count(next), is_equal_to(0));
+
+    talloc_free(ctx);
+    ld_shared_cache_unlink(name);
+}
+
+Ensure(Cgreen, invalidation_hides_entries)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    char name[64];
+    cache_name(name, sizeof(name));
+
+    ld_shared_cache_t *writer = ld_shared_cache_create(ctx, name, 256 * 1024, 0);
+    ld_shared_cache_t *reader = ld_shared_cache_open(ctx, name);
+
+    ld_shared_cache_publish(writer, create_user(ctx, "ou=users,dc=domain,dc=alt", "users"));
+    ld_shared_cache_publish(writer, create_user(ctx, "cn=first,ou=users,dc=domain,dc=alt", "first"));
+    ld_shared_cache_publish(writer, create_user(ctx, "cn=second,ou=admins,dc=domain,dc=alt", "second"));
+
+    ld_shared_cache_invalidate(reader, "ou=users,dc=domain,dc=alt", true);
+    assert_that(ld_shared_cache_lookup(reader, ctx, "cn=first,ou=users,dc=domain,dc=alt"), is_null);
+    assert_that(ld_shared_cache_lookup(reader, ctx, "cn=second,ou=admins,dc=domain,dc=alt"), is_not_null);
+    assert_that(ld_shared_cache_lookup(writer, ctx, "cn=first,ou=users,dc=domain,dc=alt"), is_not_null);
+
+    // Reader trusts copies published after its invalidation.
+    usleep(1000);
+    ld_shared_cache_publish(writer, create_user(ctx, "cn=first,ou=users,dc=domain,dc=alt", "first"));
+    assert_that(ld_shared_cache_lookup(reader, ctx, "cn=first,ou=users,dc=domain,dc=alt"), is_not_null);
+
+    ld_shared_cache_invalidate(writer, "dc=domain,dc=alt", true);
+    assert_that(ld_shared_cache_count(reader), is_equal_to(0));
+    assert_that(ld_shared_cache_lookup(reader, ctx, "cn=second,ou=admins,dc=domain,dc=alt"), is_null);
+
+    talloc_free(ctx);
+    ld_shared_cache_unlink(name);
+}
+
+Ensure(Cgreen, full_segment_is_compacted)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    char name[64];
+    cache_name(name, sizeof(name));
+
+    ld_shared_cache_t *writer = ld_shared_cache_create(ctx, name, 64 * 1024, 0);
+    ld_shared_cache_t *reader = ld_shared_cache_open(ctx, name);
+    assert_that(writer, is_not_null);
+
+    // Republishing the same entries leaves dead records behind that have to be dropped.
+    for (int i = 0; i < 2000; ++i)
+    {
+        char dn[64];
+        snprintf(dn, sizeof(dn), "cn=user%d,ou=users,dc=domain,dc=alt", i % 10);
+
+        ld_entry_t *entry = create_user(ctx, dn, "user");
+        assert_that(ld_shared_cache_publish(writer, entry), is_equal_to(RETURN_CODE_SUCCESS));
+        talloc_free(entry);
+    }
+
+    assert_that(ld_shared_cache_count(reader), is_equal_to(10));
+    assert_that(ld_shared_cache_lookup(reader, ctx, "cn=user7,ou=users,dc=domain,dc=alt"), is_not_null);
+
+    talloc_free(ctx);
+    ld_shared_cache_unlink(name);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, reader_sees_published_entries);
+    add_test_with_context(suite, Cgreen, second_writer_is_refused);
+    add_test_with_context(suite, Cgreen, invalidation_hides_entries);
+    add_test_with_context(suite, Cgreen, full_segment_is_compacted);
+    return run_test_suite(suite, create_text_reporter());
+}
@@ -0,0 +1,197 @@
+#include <cgreen/cgreen.h>
+
+#include <domain.h>
+#include <entry.h>
+#include <entry_p.h>
+#include <sorter.h>
+#include <talloc.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+static void add_value(ld_entry_t *entry, const char *name, const char *value)
+{
+    LDAPAttribute_t *attribute = talloc_zero(entry, LDAPAttribute_t);
+    attribute->name = talloc_strdup(attribute, name);
+    attribute->values = talloc_array(attribute, char*, 2);
+    attribute->values[0] = talloc_strdup(attribute->values, value);
+    attribute->values[1] = NULL;
+
+    ld_entry_add_attribute(entry, attribute);
+}
+
+static void add_user(ld_sorter_t *sorter, const char *uid, const char *sn, const char *number)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    char *dn = talloc_asprintf(ctx, "uid=%s,ou=users,dc=domain,dc=alt", uid);
+    ld_entry_t *entry = ld_entry_new(ctx, dn);
+
+    add_value(entry, "uid", uid);
+    if (sn)
+    {
+        add_value(entry, "sn", sn);
+    }
+    if (number)
+    {
+        add_value(entry, "uidNumber", number);
+    }
+
+    assert_that(ld_sorter_add(sorter, entry), is_equal_to(RETURN_CODE_SUCCESS));
+
+    talloc_free(ctx);
+}
+
+static char *read_uids(TALLOC_CTX *ctx, ld_sorter_t *sorter)
+{
+    char *result = talloc_strdup(ctx, "");
+    ld_entry_t *entry = NULL;
+
+    while ((entry = ld_sorter_next(sorter, ctx)) != NULL)
+    {
+        LDAPAttribute_t *uid = ld_entry_get_attribute(entry, "uid");
+        result = talloc_asprintf_append(result, "%s%s", *result ? " " : "", uid->values[0]);
+        talloc_free(entry);
+    }
+
+    return result;
+}
+
+Ensure(Cgreen, entries_are_sorted_by_string_attribute)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+
+    ld_sorter_t *sorter = ld_sorter_new(ctx, NULL, "sn:caseIgnoreOrderingMatch", 0, NULL);
+    assert_that(sorter, is_non_null);
+
+    add_user(sorter, "c", "Charlie", NULL);
+    add_user(sorter, "a", "alpha", NULL);
+    add_user(sorter, "b", "  BRAVO ", NULL);
+
+    assert_that(ld_sorter_finish(sorter), is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(read_uids(ctx, sorter), is_equal_to_string("a b c"));
+    assert_that(ld_sorter_get_count(sorter), is_equal_to(3));
+    assert_that(ld_sorter_get_run_count(sorter), is_equal_to(0));
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, reverse_order_places_missing_values_first)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+
+    ld_sorter_t *sorter = ld_sorter_new(ctx, NULL, "-sn:caseIgnoreOrderingMatch", 0, NULL);
+    assert_that(sorter, is_non_null);
+
+    add_user(sorter, "a", "alpha", NULL);
+    add_user(sorter, "none", NULL, NULL);
+    add_user(sorter, "c", "charlie", NULL);
+    add_user(sorter, "b", "bravo", NULL);
+
+    assert_that(ld_sorter_finish(sorter), is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(read_uids(ctx, sorter), is_equal_to_string("none c b a"));
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, integers_are_sorted_numerically)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+
+    ld_sorter_t *sorter = ld_sorter_new(ctx, NULL, "uidNumber:integerOrderingMatch", 0, NULL);
+    assert_that(sorter, is_non_null);
+
+    add_user(sorter, "a", NULL, "100");
+    add_user(sorter, "b", NULL, "-5");
+    add_user(sorter, "c", NULL, "20");
+    add_user(sorter, "d", NULL, "-40");
+    add_user(sorter, "e", NULL, "0");
+
+    assert_that(ld_sorter_finish(sorter), is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(read_uids(ctx, sorter), is_equal_to_string("d b e c a"));
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, equal_entries_keep_insertion_order)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+
+    ld_sorter_t *sorter = ld_sorter_new(ctx, NULL, "sn:caseIgnoreOrderingMatch uid:caseExactOrderingMatch", 0, NULL);
+    assert_that(sorter, is_non_null);
+
+    add_user(sorter, "x", "same", NULL);
+    add_user(sorter, "b", "same", NULL);
+    add_user(sorter, "a", "other", NULL);
+    add_user(sorter, "b", "same", NULL);
+
+    assert_that(ld_sorter_finish(sorter), is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(read_uids(ctx, sorter), is_equal_to_string("a b b x"));
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, large_input_is_spilled_and_merged)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+    char uid[32];
+    char number[32];
+
+    ld_sorter_t *sorter = ld_sorter_new(ctx, NULL, "-uidNumber:integerOrderingMatch", 1, NULL);
+    assert_that(sorter, is_non_null);
+
+    for (int i = 0; i < 5000; ++i)
+    {
+        int value = (i * 7919) % 5000;
+        snprintf(uid, sizeof(uid), "%d", value);
+        snprintf(number, sizeof(number), "%d", value);
+        add_user(sorter, uid, NULL, number);
+    }
+
+    assert_that(ld_sorter_finish(sorter), is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(ld_sorter_get_run_count(sorter), is_greater_than(1));
+
+    int expected = 4999;
+    ld_entry_t *entry = NULL;
+    while ((entry = ld_sorter_next(sorter, ctx)) != NULL)
+    {
+        LDAPAttribute_t *attribute = ld_entry_get_attribute(entry, "uidNumber");
+        assert_that(atoi(attribute->values[0]), is_equal_to(expected));
+        --expected;
+        talloc_free(entry);
+    }
+
+    assert_that(expected, is_equal_to(-1));
+    assert_that(ld_sorter_failed(sorter), is_false);
+
+    talloc_free(ctx);
+}
+
+Ensure(Cgreen, invalid_keys_are_rejected)
+{
+    TALLOC_CTX *ctx = talloc_new(NULL);
+
+    assert_that(ld_sorter_new(ctx, NULL, "", 0, NULL), is_null);
+    assert_that(ld_sorter_new(ctx, NULL, "-", 0, NULL), is_null);
+    assert_that(ld_sorter_new(ctx, NULL, "sn:unknownMatch", 0, NULL), is_null);
+
+    talloc_free(ctx);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, entries_are_sorted_by_string_attribute);
+    add_test_with_context(suite, Cgreen, reverse_order_places_missing_values_first);
+    add_test_with_context(suite, Cgreen, integers_are_sorted_numerically);
+    add_test_with_context(suite, Cgreen, equal_entries_keep_insertion_order);
+    add_test_with_context(suite, Cgreen, large_input_is_spilled_and_merged);
+    add_test_with_context(suite, Cgreen, invalid_keys_are_rejected);
+    return run_test_suite(suite, create_text_reporter());
+}
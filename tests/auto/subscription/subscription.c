@@ -0,0 +1,276 @@
+#include <cgreen/cgreen.h>
+
+#include <connection.h>
+#include <connection_state_machine.h>
+#include <directory.h>
+#include <entry.h>
+#include <organizational_unit.h>
+#include <subscription.h>
+#include <talloc.h>
+
+#include <string.h>
+
+#include <test_common.h>
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+#define number_of_elements(x)  (sizeof(x) / sizeof((x)[0]))
+
+char* LDAP_SUBSCRIPTION_ATTRS[] = { "objectClass", "ou", NULL };
+
+const int CONNECTION_UPDATE_INTERVAL = 1000;
+
+static const int MAX_WAIT_ITERATIONS = 15;
+
+static const char *SUBSCRIPTION_BASE = "dc=domain,dc=alt";
+static const char *SUBSCRIPTION_FILTER = "(ou=test_subscription_match)";
+static const char *MATCHING_OU = "test_subscription_match";
+static const char *SKIPPED_OU = "test_subscription_skip";
+
+static char* OU_OBJECTCLASS[] = { "top", "organizationalUnit", NULL };
+static char* MATCHING_OU_OU[] = { "test_subscription_match", NULL };
+static char* SKIPPED_OU_OU[] = { "test_subscription_skip", NULL };
+
+static LDAPAttribute_t MATCHING_OU_ATTRIBUTES[] =
+{
+    { .name = "objectClass", .values = OU_OBJECTCLASS },
+    { .name = "ou", .values = MATCHING_OU_OU }
+};
+
+static LDAPAttribute_t SKIPPED_OU_ATTRIBUTES[] =
+{
+    { .name = "objectClass", .values = OU_OBJECTCLASS },
+    { .name = "ou", .values = SKIPPED_OU_OU }
+};
+
+enum SubscriptionTestStep
+{
+    STEP_SUBSCRIBE          = 0,
+    STEP_ADD_ENTRIES        = 1,
+    STEP_AWAIT_CHANGE       = 2,
+    STEP_AWAIT_RECONNECT    = 3,
+    STEP_DELETE_ENTRY       = 4,
+    STEP_AWAIT_DELETION     = 5,
+    STEP_DONE               = 6,
+};
+
+static int current_directory_type = LDAP_TYPE_UNKNOWN;
+
+static TALLOC_CTX *talloc_ctx = NULL;
+
+static ld_subscription_t *subscription = NULL;
+static enum SubscriptionTestStep current_step = STEP_SUBSCRIBE;
+static int n_wait_iterations = 0;
+
+static bool reconnected = false;
+static int n_matching_changes = 0;
+static int n_skipped_changes = 0;
+static int n_changes_after_reconnect = 0;
+static ld_entry_t *kept_entry = NULL;
+
+static enum OperationReturnCode subscription_callback(struct ldap_connection_ctx_t *connection,
+                                                      ld_subscription_t *subscription,
+                                                      enum LdapSubscriptionChangeType change,
+                                                      ld_entry_t *entry,
+                                                      const char *previous_dn,
+                                                      void *user_data)
+{
+    (void)(connection);
+    (void)(subscription);
+    (void)(previous_dn);
+    (void)(user_data);
+
+    const char *dn = ld_entry_get_dn(entry);
+
+    ld_info("Change %d of entry %s\n", change, dn);
+
+    if (strstr(dn, SKIPPED_OU))
+    {
+        ++n_skipped_changes;
+    }
+    else if (strstr(dn, MATCHING_OU) && reconnected)
+    {
+        ++n_changes_after_reconnect;
+    }
+    else if (strstr(dn, MATCHING_OU))
+    {
+        // Entry stolen from callback must stay valid after callback returns.
+        if (!kept_entry)
+        {
+            kept_entry = talloc_steal(talloc_ctx, entry);
+        }
+
+        ++n_matching_changes;
+    }
+
+    return RETURN_CODE_SUCCESS;
+}
+
+static void finish_test(verto_ctx *ctx, struct ldap_connection_ctx_t *connection)
+{
+    if (subscription)
+    {
+        assert_that(ld_unsubscribe(connection, subscription), is_equal_to(RETURN_CODE_SUCCESS));
+        assert_that(connection->subscriptions, is_null);
+        subscription = NULL;
+    }
+
+    ld_del_ou(connection->handle, SKIPPED_OU, SUBSCRIPTION_BASE);
+    if (current_step != STEP_DONE)
+    {
+        ld_del_ou(connection->handle, MATCHING_OU, SUBSCRIPTION_BASE);
+    }
+
+    verto_break(ctx);
+}
+
+static bool wait_for(verto_ctx *ctx, struct ldap_connection_ctx_t *connection, bool condition, const char *what)
+{
+    if (condition)
+    {
+        n_wait_iterations = 0;
+        return true;
+    }
+
+    if (++n_wait_iterations > MAX_WAIT_ITERATIONS)
+    {
+        fail_test(what);
+        finish_test(ctx, connection);
+    }
+
+    return false;
+}
+
+static void connection_on_timeout(verto_ctx *ctx, verto_ev *ev)
+{
+    struct ldap_connection_ctx_t* connection = verto_get_private(ev);
+
+    csm_next_state(connection->state_machine);
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_ERROR && current_step != STEP_AWAIT_RECONNECT)
+    {
+        verto_del(ev);
+        verto_break(ctx);
+
+        fail_test("Error encountered during bind\n");
+
+        return;
+    }
+
+    if (current_directory_type != LDAP_TYPE_OPENLDAP && current_directory_type != LDAP_TYPE_ACTIVE_DIRECTORY)
+    {
+        verto_del(ev);
+        verto_break(ctx);
+
+        fail_test("Unknown directory type - not implemented!\n");
+
+        return;
+    }
+
+    if (connection->state_machine->state != LDAP_CONNECTION_STATE_RUN)
+    {
+        return;
+    }
+
+    switch (current_step)
+    {
+    case STEP_SUBSCRIBE:
+        talloc_ctx = talloc_new(NULL);
+
+        subscription = ld_subscribe(connection, SUBSCRIPTION_BASE, LDAP_SCOPE_ONELEVEL, SUBSCRIPTION_FILTER,
+                                    LDAP_SUBSCRIPTION_ATTRS, LD_SUBSCRIPTION_CHANGE_ANY, subscription_callback, NULL);
+        assert_that(subscription, is_non_null);
+
+        assert_that(ld_subscription_get_state(subscription), is_equal_to(LD_SUBSCRIPTION_STATE_ACTIVE));
+        assert_that(ld_subscription_get_mechanism(subscription), is_not_equal_to(LD_SUBSCRIPTION_MECHANISM_NONE));
+
+        current_step = STEP_ADD_ENTRIES;
+        break;
+
+    case STEP_ADD_ENTRIES:
+        assert_that(ld_add_ou(connection->handle, MATCHING_OU,
+                              fill_user_attributes(talloc_ctx, MATCHING_OU_ATTRIBUTES,
+                                                   number_of_elements(MATCHING_OU_ATTRIBUTES)),
+                              SUBSCRIPTION_BASE),
+                    is_equal_to(RETURN_CODE_SUCCESS));
+        assert_that(ld_add_ou(connection->handle, SKIPPED_OU,
+                              fill_user_attributes(talloc_ctx, SKIPPED_OU_ATTRIBUTES,
+                                                   number_of_elements(SKIPPED_OU_ATTRIBUTES)),
+                              SUBSCRIPTION_BASE),
+                    is_equal_to(RETURN_CODE_SUCCESS));
+
+        current_step = STEP_AWAIT_CHANGE;
+        break;
+
+    case STEP_AWAIT_CHANGE:
+        if (wait_for(ctx, connection, n_matching_changes > 0, "Change of matching entry has not been delivered!\n"))
+        {
+            // Entry which does not match the filter must not be reported.
+            assert_that(n_skipped_changes, is_equal_to(0));
+
+            assert_that(kept_entry, is_non_null);
+            assert_that(strstr(ld_entry_get_dn(kept_entry), MATCHING_OU), is_non_null);
+
+            // Drop connection, subscription should be re-established once it is restored.
+            reconnected = true;
+            connection->state_machine->state = LDAP_CONNECTION_STATE_ERROR;
+
+            current_step = STEP_AWAIT_RECONNECT;
+        }
+        break;
+
+    case STEP_AWAIT_RECONNECT:
+        if (wait_for(ctx, connection, ld_subscription_get_state(subscription) == LD_SUBSCRIPTION_STATE_ACTIVE,
+                     "Subscription has not been re-established after reconnect!\n"))
+        {
+            assert_that(connection->subscriptions, is_equal_to(subscription));
+
+            current_step = STEP_DELETE_ENTRY;
+        }
+        break;
+
+    case STEP_DELETE_ENTRY:
+        assert_that(ld_del_ou(connection->handle, MATCHING_OU, SUBSCRIPTION_BASE), is_equal_to(RETURN_CODE_SUCCESS));
+
+        current_step = STEP_AWAIT_DELETION;
+        break;
+
+    case STEP_AWAIT_DELETION:
+        if (wait_for(ctx, connection, n_changes_after_reconnect > 0,
+                     "Change has not been delivered after reconnect!\n"))
+        {
+            assert_that(n_skipped_changes, is_equal_to(0));
+
+            current_step = STEP_DONE;
+
+            verto_del(ev);
+            finish_test(ctx, connection);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+Ensure(Cgreen, subscription_test) {
+    start_test(connection_on_timeout, CONNECTION_UPDATE_INTERVAL, &current_directory_type, false);
+
+    assert_that(current_step, is_equal_to(STEP_DONE));
+    assert_that(n_matching_changes, is_greater_than(0));
+    assert_that(n_changes_after_reconnect, is_greater_than(0));
+    assert_that(n_skipped_changes, is_equal_to(0));
+
+    talloc_free(talloc_ctx);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, subscription_test);
+    return run_test_suite(suite, create_text_reporter());
+}
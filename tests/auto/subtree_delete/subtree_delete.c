@@ -0,0 +1,138 @@
+#include <cgreen/cgreen.h>
+
+#include <directory.h>
+#include <domain.h>
+#include <subtree_delete.h>
+#include <talloc.h>
+#include <write_scheduler.h>
+
+#include <connection_state_machine.h>
+
+#include <test_common.h>
+
+#include <stdio.h>
+
+const int LDAP_DEBUG_ANY = -1;
+const int BUFFER_SIZE = 80;
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+const int CONNECTION_UPDATE_INTERVAL = 1000;
+
+#define NUMBER_OF_CHILDREN 10
+#define NUMBER_OF_LEAVES 5
+
+static int current_directory_type = LDAP_TYPE_UNKNOWN;
+
+static verto_ctx *test_ctx = NULL;
+
+static char root_dn[256];
+
+static char *OBJECT_CLASS_VALUES[] = { "top", "organizationalUnit", NULL };
+static LDAPMod OBJECT_CLASS = { LDAP_MOD_ADD, "objectClass", { OBJECT_CLASS_VALUES } };
+static LDAPMod *OU_ATTRIBUTES[] = { &OBJECT_CLASS, NULL };
+
+static void on_delete_progress(ld_subtree_delete_t *subtree_delete, const char *dn, enum OperationReturnCode rc,
+                               int result_code, void *user_data)
+{
+    (void)(subtree_delete);
+    (void)(dn);
+    (void)(user_data);
+
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(result_code, is_equal_to(LDAP_SUCCESS));
+}
+
+static void on_delete_complete(ld_subtree_delete_t *subtree_delete, enum OperationReturnCode rc, void *user_data)
+{
+    (void)(user_data);
+
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(ld_subtree_delete_get_deleted(subtree_delete), is_greater_than(0));
+    assert_that(ld_subtree_delete_get_failed(subtree_delete), is_equal_to(0));
+
+    verto_break(test_ctx);
+}
+
+static void on_create_complete(ld_write_scheduler_t *scheduler, enum OperationReturnCode rc, void *user_data)
+{
+    struct ldap_connection_ctx_t *connection = user_data;
+
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(ld_write_scheduler_get_failed(scheduler), is_equal_to(0));
+
+    // Populated tree can not be deleted with a single delete request.
+    rc = ld_subtree_delete(connection, connection, root_dn, 4, on_delete_progress, on_delete_complete, NULL);
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+}
+
+static void schedule_tree(ld_write_scheduler_t *scheduler)
+{
+    char child[256];
+    char dn[256];
+
+    assert_that(ld_write_scheduler_add(scheduler, root_dn, OU_ATTRIBUTES), is_equal_to(RETURN_CODE_SUCCESS));
+
+    for (int i = 0; i < NUMBER_OF_CHILDREN; ++i)
+    {
+        snprintf(child, sizeof(child), "ou=child%d,%s", i, root_dn);
+        assert_that(ld_write_scheduler_add(scheduler, child, OU_ATTRIBUTES), is_equal_to(RETURN_CODE_SUCCESS));
+
+        for (int j = 0; j < NUMBER_OF_LEAVES; ++j)
+        {
+            snprintf(dn, sizeof(dn), "ou=leaf%d,%s", j, child);
+            assert_that(ld_write_scheduler_add(scheduler, dn, OU_ATTRIBUTES), is_equal_to(RETURN_CODE_SUCCESS));
+        }
+    }
+}
+
+static void connection_on_timeout(verto_ctx *ctx, verto_ev *ev)
+{
+    (void)(ctx);
+
+    struct ldap_connection_ctx_t* connection = verto_get_private(ev);
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_RUN)
+    {
+        verto_del(ev);
+
+        test_ctx = ctx;
+
+        const char *base_dn = current_directory_type == LDAP_TYPE_ACTIVE_DIRECTORY
+                ? "DC=domain,DC=alt"
+                : "dc=domain,dc=alt";
+
+        snprintf(root_dn, sizeof(root_dn), "ou=test_subtree_delete,%s", base_dn);
+
+        ld_write_scheduler_t *scheduler = ld_write_scheduler_new(connection, connection, 8, NULL, on_create_complete,
+                                                                 connection);
+        assert_that(scheduler, is_non_null);
+
+        schedule_tree(scheduler);
+
+        assert_that(ld_write_scheduler_finish(scheduler), is_equal_to(RETURN_CODE_SUCCESS));
+    }
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_ERROR)
+    {
+        verto_break(ctx);
+
+        fail_test("Error encountered during bind\n");
+    }
+}
+
+Ensure(Cgreen, subtree_delete_test)
+{
+    start_test(connection_on_timeout, CONNECTION_UPDATE_INTERVAL, &current_directory_type, false);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, subtree_delete_test);
+    return run_test_suite(suite, create_text_reporter());
+}
@@ -0,0 +1,146 @@
+#include <cgreen/cgreen.h>
+
+#include <directory.h>
+#include <domain.h>
+#include <user.h>
+#include <talloc.h>
+
+#include <connection_state_machine.h>
+
+#include <test_common.h>
+
+const int LDAP_DEBUG_ANY = -1;
+const int BUFFER_SIZE = 80;
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+#define NUMBER_OF_USERS 3
+
+static const int CONNECTION_UPDATE_INTERVAL = 1000;
+
+static int current_directory_type = LDAP_TYPE_UNKNOWN;
+
+static verto_ctx *test_ctx = NULL;
+
+static char *OPENLDAP_OBJECT_CLASS[] = { "top", "account", "posixAccount", "shadowAccount", NULL };
+static char *AD_OBJECT_CLASS[] = { "top", "person", "organizationalPerson", "user", NULL };
+static char *ZERO[] = { "0", NULL };
+static char *LOGIN_SHELL[] = { "/bin/bash", NULL };
+
+static LDAPAttribute_t OPENLDAP_DEFAULTS[] =
+{
+    { "objectClass", OPENLDAP_OBJECT_CLASS },
+    { "uidNumber", ZERO },
+    { "gidNumber", ZERO },
+    { "loginShell", LOGIN_SHELL },
+};
+
+static LDAPAttribute_t AD_DEFAULTS[] =
+{
+    { "objectClass", AD_OBJECT_CLASS },
+    { "userAccountControl", (char *[]){ "544", NULL } },
+};
+
+/**
+ * @brief create_attribute Creates attribute with a single value.
+ */
+static LDAPAttribute_t *create_attribute(TALLOC_CTX *ctx, const char *name, const char *value)
+{
+    LDAPAttribute_t *attribute = talloc(ctx, LDAPAttribute_t);
+
+    attribute->name = talloc_strdup(attribute, name);
+    attribute->values = talloc_array(attribute, char*, 2);
+    attribute->values[0] = talloc_strdup(attribute, value);
+    attribute->values[1] = NULL;
+
+    return attribute;
+}
+
+static void on_users_added(LDHandle *handle, const ld_batch_result_t *results, int n_items,
+                           enum OperationReturnCode rc, void *user_data)
+{
+    (void)(handle);
+    (void)(user_data);
+
+    assert_that(n_items, is_equal_to(NUMBER_OF_USERS));
+
+    for (int i = 0; i < n_items; ++i)
+    {
+        assert_that(results[i].rc, is_equal_to(RETURN_CODE_SUCCESS));
+        assert_that(results[i].result_code, is_equal_to(LDAP_SUCCESS));
+    }
+
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+
+    verto_break(test_ctx);
+}
+
+static void connection_on_timeout(verto_ctx *ctx, verto_ev *ev)
+{
+    (void)(ctx);
+
+    struct ldap_connection_ctx_t* connection = verto_get_private(ev);
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_RUN)
+    {
+        verto_del(ev);
+
+        test_ctx = ctx;
+
+        bool active_directory = current_directory_type == LDAP_TYPE_ACTIVE_DIRECTORY;
+        LDAPAttribute_t *source = active_directory ? AD_DEFAULTS : OPENLDAP_DEFAULTS;
+        int n_defaults = active_directory ? 2 : 4;
+
+        TALLOC_CTX *talloc_ctx = talloc_new(NULL);
+
+        LDAPAttribute_t **defaults = talloc_array(talloc_ctx, LDAPAttribute_t*, n_defaults + 1);
+        for (int i = 0; i < n_defaults; ++i)
+        {
+            defaults[i] = &source[i];
+        }
+        defaults[n_defaults] = NULL;
+
+        ld_batch_item_t users[NUMBER_OF_USERS];
+        for (int i = 0; i < NUMBER_OF_USERS; ++i)
+        {
+            char *name = talloc_asprintf(talloc_ctx, "test_bulk_user_%d", i);
+
+            users[i].name = name;
+            users[i].attrs = talloc_array(talloc_ctx, LDAPAttribute_t*, 4);
+            users[i].attrs[0] = create_attribute(talloc_ctx, "cn", name);
+            users[i].attrs[1] = create_attribute(talloc_ctx, active_directory ? "sAMAccountName" : "uid", name);
+            users[i].attrs[2] = create_attribute(talloc_ctx, "homeDirectory",
+                                                 talloc_asprintf(talloc_ctx, "/home/%s", name));
+            users[i].attrs[3] = NULL;
+        }
+
+        enum OperationReturnCode rc = ld_add_users(connection->handle, users, NUMBER_OF_USERS, defaults, NULL,
+                                                   on_users_added, NULL);
+        assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+
+        talloc_free(talloc_ctx);
+    }
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_ERROR)
+    {
+        verto_break(ctx);
+
+        fail_test("Error encountered during bind\n");
+    }
+}
+
+Ensure(Cgreen, user_bulk_add_test)
+{
+    start_test(connection_on_timeout, CONNECTION_UPDATE_INTERVAL, &current_directory_type, false);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, user_bulk_add_test);
+    return run_test_suite(suite, create_text_reporter());
+}
@@ -0,0 +1,138 @@
+#include <cgreen/cgreen.h>
+
+#include <directory.h>
+#include <domain.h>
+#include <talloc.h>
+#include <write_scheduler.h>
+
+#include <connection_state_machine.h>
+
+#include <test_common.h>
+
+#include <stdio.h>
+
+const int LDAP_DEBUG_ANY = -1;
+const int BUFFER_SIZE = 80;
+
+Describe(Cgreen);
+BeforeEach(Cgreen) {}
+AfterEach(Cgreen) {}
+
+const int CONNECTION_UPDATE_INTERVAL = 1000;
+
+#define NUMBER_OF_CHILDREN 20
+
+static int current_directory_type = LDAP_TYPE_UNKNOWN;
+
+static verto_ctx *test_ctx = NULL;
+
+static char *OBJECT_CLASS_VALUES[] = { "top", "organizationalUnit", NULL };
+static LDAPMod OBJECT_CLASS = { LDAP_MOD_ADD, "objectClass", { OBJECT_CLASS_VALUES } };
+static LDAPMod *OU_ATTRIBUTES[] = { &OBJECT_CLASS, NULL };
+
+static char *DESCRIPTION_VALUES[] = { "Scheduled", NULL };
+static LDAPMod DESCRIPTION = { LDAP_MOD_REPLACE, "description", { DESCRIPTION_VALUES } };
+static LDAPMod *DESCRIPTION_MODS[] = { &DESCRIPTION, NULL };
+
+static void on_request(ld_write_scheduler_t *scheduler, const ld_write_request_t *request,
+                       enum OperationReturnCode rc, int result_code, void *user_data)
+{
+    (void)(scheduler);
+    (void)(user_data);
+
+    assert_that(request->skipped, is_false);
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(result_code, is_equal_to(LDAP_SUCCESS));
+}
+
+static void on_complete(ld_write_scheduler_t *scheduler, enum OperationReturnCode rc, void *user_data)
+{
+    (void)(user_data);
+
+    assert_that(rc, is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(ld_write_scheduler_get_succeeded(scheduler), is_equal_to(3 * NUMBER_OF_CHILDREN + 4));
+    assert_that(ld_write_scheduler_get_failed(scheduler), is_equal_to(0));
+
+    verto_break(test_ctx);
+}
+
+static void schedule_tree(ld_write_scheduler_t *scheduler, const char *base_dn)
+{
+    char root[256];
+    char dn[256];
+
+    snprintf(root, sizeof(root), "ou=test_write_scheduler,%s", base_dn);
+
+    // Requests are submitted at once, children wait only for the root.
+    assert_that(ld_write_scheduler_add(scheduler, root, OU_ATTRIBUTES), is_equal_to(RETURN_CODE_SUCCESS));
+
+    for (int i = 0; i < NUMBER_OF_CHILDREN; ++i)
+    {
+        snprintf(dn, sizeof(dn), "ou=child%d,%s", i, root);
+        assert_that(ld_write_scheduler_add(scheduler, dn, OU_ATTRIBUTES), is_equal_to(RETURN_CODE_SUCCESS));
+        assert_that(ld_write_scheduler_modify(scheduler, dn, DESCRIPTION_MODS), is_equal_to(RETURN_CODE_SUCCESS));
+    }
+
+    snprintf(dn, sizeof(dn), "ou=child0,%s", root);
+    assert_that(ld_write_scheduler_rename(scheduler, dn, "ou=renamed", NULL, true), is_equal_to(RETURN_CODE_SUCCESS));
+
+    snprintf(dn, sizeof(dn), "ou=renamed,%s", root);
+    assert_that(ld_write_scheduler_modify(scheduler, dn, DESCRIPTION_MODS), is_equal_to(RETURN_CODE_SUCCESS));
+    assert_that(ld_write_scheduler_delete(scheduler, dn), is_equal_to(RETURN_CODE_SUCCESS));
+
+    for (int i = 1; i < NUMBER_OF_CHILDREN; ++i)
+    {
+        snprintf(dn, sizeof(dn), "ou=child%d,%s", i, root);
+        assert_that(ld_write_scheduler_delete(scheduler, dn), is_equal_to(RETURN_CODE_SUCCESS));
+    }
+
+    // Root is deleted only after all children.
+    assert_that(ld_write_scheduler_delete(scheduler, root), is_equal_to(RETURN_CODE_SUCCESS));
+}
+
+static void connection_on_timeout(verto_ctx *ctx, verto_ev *ev)
+{
+    (void)(ctx);
+
+    struct ldap_connection_ctx_t* connection = verto_get_private(ev);
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_RUN)
+    {
+        verto_del(ev);
+
+        test_ctx = ctx;
+
+        const char *base_dn = current_directory_type == LDAP_TYPE_ACTIVE_DIRECTORY
+                ? "DC=domain,DC=alt"
+                : "dc=domain,dc=alt";
+
+        ld_write_scheduler_t *scheduler = ld_write_scheduler_new(connection, connection, 4, on_request, on_complete,
+                                                                 NULL);
+        assert_that(scheduler, is_non_null);
+
+        schedule_tree(scheduler, base_dn);
+
+        assert_that(ld_write_scheduler_finish(scheduler), is_equal_to(RETURN_CODE_SUCCESS));
+    }
+
+    if (connection->state_machine->state == LDAP_CONNECTION_STATE_ERROR)
+    {
+        verto_break(ctx);
+
+        fail_test("Error encountered during bind\n");
+    }
+}
+
+Ensure(Cgreen, write_scheduler_test)
+{
+    start_test(connection_on_timeout, CONNECTION_UPDATE_INTERVAL, &current_directory_type, false);
+}
+
+int main(int argc, char **argv) {
+    (void)(argc);
+    (void)(argv);
+    (void)(contextForCgreen);
+    TestSuite *suite = create_test_suite();
+    add_test_with_context(suite, Cgreen, write_scheduler_test);
+    return run_test_suite(suite, create_text_reporter());
+}